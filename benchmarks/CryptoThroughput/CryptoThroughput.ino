@@ -0,0 +1,202 @@
+/**
+ * CryptoThroughput.ino
+ *
+ * Measures session crypto: ECDH key exchange time, then encrypt/decrypt
+ * cost per KB for AES-256-GCM and AES-CBC at several payload sizes, in
+ * place and through the allocating API. Also times the device side of a
+ * handshake with an inline keypair, with a precomputed one from the pool,
+ * and a ticket resumption. Results print as JSON lines.
+ *
+ * Host builds (benchmarks/host/build.sh CryptoThroughput) run against
+ * mocked mbedTLS, so they only measure framing, nonce and copy overhead.
+ */
+
+#include <WiBLE.h>
+#include <SecurityManager.h>
+#include <utils/BenchReport.h>
+#include <utils/LogManager.h>
+
+using namespace WiBLE;
+
+static const size_t PAYLOAD_SIZES[] = { 64, 244, 512, 1024 };
+static const size_t FRAME_CAPACITY = 1024 + WIBLE_GCM_OVERHEAD + WIBLE_AES_BLOCK_SIZE;
+static const size_t DECRYPT_BATCH = 8;   // Replay protection needs a fresh frame per decrypt
+
+static uint8_t frame[FRAME_CAPACITY];
+static uint8_t sealed[DECRYPT_BATCH][FRAME_CAPACITY];
+
+static const char* modeName(EncryptionMode mode) {
+    return mode == EncryptionMode::AES_256_GCM ? "gcm" : "cbc";
+}
+
+static bool establish(SecurityManager& device, SecurityManager& phone, EncryptionMode mode) {
+    SecurityConfig deviceConfig;
+    deviceConfig.encryptionMode = mode;
+    SecurityConfig phoneConfig = deviceConfig;
+    phoneConfig.peerRole = true;
+
+    if (!device.initialize(deviceConfig) || !phone.initialize(phoneConfig)) return false;
+    if (!device.generateKeyPair() || !phone.generateKeyPair()) return false;
+    if (!device.computeSharedSecret(phone.getPublicKey())) return false;
+    if (!phone.computeSharedSecret(device.getPublicKey())) return false;
+    return device.deriveSessionKey() && phone.deriveSessionKey();
+}
+
+static void reportPerKb(const char* metric, EncryptionMode mode, size_t size, double ns) {
+    char name[48];
+    double nsPerKb = ns * 1024.0 / size;
+    snprintf(name, sizeof(name), "%s_%s_%u_ns_per_kb", modeName(mode), metric, (unsigned)size);
+    Bench::report("crypto", name, nsPerKb, "ns");
+#ifndef WIBLE_HOST_BENCH
+    snprintf(name, sizeof(name), "%s_%s_%u_cycles_per_kb", modeName(mode), metric, (unsigned)size);
+    Bench::report("crypto", name, nsPerKb * ESP.getCpuFreqMHz() / 1000.0, "cycles");
+#endif
+}
+
+static void benchMode(EncryptionMode mode) {
+    SecurityManager device;
+    SecurityManager phone;
+
+    int64_t start = Bench::nowUs();
+    if (!establish(device, phone, mode)) {
+        Bench::report("crypto", "session_failed", 1, "count");
+        return;
+    }
+    char name[48];
+    snprintf(name, sizeof(name), "%s_key_exchange_us", modeName(mode));
+    Bench::report("crypto", name, (double)(Bench::nowUs() - start), "us");
+
+    size_t header = device.getCipherHeaderSize();
+    for (size_t s = 0; s < sizeof(PAYLOAD_SIZES) / sizeof(PAYLOAD_SIZES[0]); s++) {
+        size_t size = PAYLOAD_SIZES[s];
+        uint32_t iterations = 16384 / size + 8;
+        memset(frame + header, 0x5A, size);
+
+        // Phone -> device, the direction credentials travel
+        double encryptNs = Bench::measureNs(iterations, [&](uint32_t) {
+            phone.encryptInPlace(frame, size, FRAME_CAPACITY);
+        });
+
+        size_t frameLength = phone.getEncryptedSize(size);
+        int64_t decryptUs = 0;
+        uint32_t attempts = 0;
+        uint32_t failures = 0;
+        for (uint32_t round = 0; round < iterations; round += DECRYPT_BATCH) {
+            for (size_t i = 0; i < DECRYPT_BATCH; i++) {
+                memset(sealed[i] + header, 0x5A, size);
+                phone.encryptInPlace(sealed[i], size, FRAME_CAPACITY);
+            }
+            int64_t batchStart = Bench::nowUs();
+            for (size_t i = 0; i < DECRYPT_BATCH; i++) {
+                if (device.decryptInPlace(sealed[i], frameLength) != size) failures++;
+                attempts++;
+            }
+            decryptUs += Bench::nowUs() - batchStart;
+        }
+        double decryptNs = (double)decryptUs * 1000.0 / attempts;
+
+        Bench::resetHeapHighWater();
+        size_t heapBefore = Bench::heapInUse();
+        double allocatingNs = Bench::measureNs(iterations, [&](uint32_t) {
+            EncryptedMessage message = phone.encrypt(frame + header, size);
+            (void)message;
+        });
+        size_t heapPeak = Bench::heapHighWater();
+
+        reportPerKb("encrypt_in_place", mode, size, encryptNs);
+        reportPerKb("decrypt_in_place", mode, size, decryptNs);
+        reportPerKb("encrypt_allocating", mode, size, allocatingNs);
+        snprintf(name, sizeof(name), "%s_encrypt_allocating_%u_heap_bytes", modeName(mode), (unsigned)size);
+        Bench::report("crypto", name, (double)heapPeak - heapBefore, "bytes");
+        if (failures) {
+            snprintf(name, sizeof(name), "%s_decrypt_%u_failures", modeName(mode), (unsigned)size);
+            Bench::report("crypto", name, failures, "count");
+        }
+    }
+}
+
+static const uint8_t HANDSHAKE_ROUNDS = 8;
+
+static void reportHandshake(const char* metric, double totalUs) {
+    char name[48];
+    snprintf(name, sizeof(name), "handshake_%s_us", metric);
+    Bench::report("crypto", name, totalUs / HANDSHAKE_ROUNDS, "us");
+}
+
+static void benchHandshake() {
+    SecurityConfig deviceConfig;
+    deviceConfig.enableResumption = true;
+    SecurityConfig phoneConfig = deviceConfig;
+    phoneConfig.peerRole = true;
+
+    SecurityConfig inlineConfig = deviceConfig;
+    inlineConfig.keyPoolSize = 0;
+
+    SecurityManager inlineDevice;
+    SecurityManager device;
+    SecurityManager phone;
+    if (!inlineDevice.initialize(inlineConfig) || !device.initialize(deviceConfig) ||
+        !phone.initialize(phoneConfig)) {
+        Bench::report("crypto", "handshake_failed", 1, "count");
+        return;
+    }
+
+    double inlineUs = 0, pooledUs = 0, resumedUs = 0;
+    uint8_t ticketId[WIBLE_TICKET_ID_SIZE];
+    uint8_t phoneNonce[WIBLE_RESUME_NONCE_SIZE];
+    uint8_t deviceNonce[WIBLE_RESUME_NONCE_SIZE];
+    uint8_t nextTicketId[WIBLE_TICKET_ID_SIZE];
+
+    for (uint8_t round = 0; round < HANDSHAKE_ROUNDS; round++) {
+        phone.generateKeyPair();
+        std::vector<uint8_t> phoneKey = phone.getPublicKey();
+
+        // No pool: the keypair is generated while the phone waits
+        inlineDevice.reset();
+        inlineDevice.establishSession(phoneKey.data(), phoneKey.size());
+        inlineUs += inlineDevice.getHandshakeStats().lastHandshakeUs;
+
+        // Pool filled earlier (on the device, by the task while advertising)
+        device.reset();
+        device.refillKeyPool();
+        device.establishSession(phoneKey.data(), phoneKey.size());
+        pooledUs += device.getHandshakeStats().lastHandshakeUs;
+
+        phone.computeSharedSecret(device.getPublicKey());
+        phone.deriveSessionKey();
+        device.issueResumptionTicket(ticketId);
+        phone.acceptResumptionTicket(ticketId);
+
+        // Reconnect of a bonded phone: no ECDH at all
+        device.reset();
+        phone.beginResumption(ticketId, phoneNonce);
+        if (!device.resumeSession(ticketId, phoneNonce, deviceNonce, nextTicketId) ||
+            !phone.completeResumption(deviceNonce, nextTicketId)) {
+            Bench::report("crypto", "handshake_resume_failed", 1, "count");
+            return;
+        }
+        resumedUs += device.getHandshakeStats().lastHandshakeUs;
+    }
+
+    reportHandshake("inline_keypair", inlineUs);
+    reportHandshake("pooled_keypair", pooledUs);
+    reportHandshake("resumed", resumedUs);
+    Bench::report("crypto", "handshake_pooled_keypairs", device.getHandshakeStats().pooledKeyPairs, "count");
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(500);
+    LogManager::setLevel(LogLevel::NONE);
+
+    benchHandshake();
+    benchMode(EncryptionMode::AES_256_GCM);
+    benchMode(EncryptionMode::AES_256_CBC);
+
+    Bench::report("crypto", "heap_high_water_bytes", Bench::heapHighWater(), "bytes");
+    Bench::finish();
+}
+
+void loop() {
+    delay(1000);
+}
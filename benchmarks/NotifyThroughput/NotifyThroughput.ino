@@ -0,0 +1,131 @@
+/**
+ * NotifyThroughput.ino
+ *
+ * Measures notification throughput on the data characteristic through the
+ * GATT operation scheduler. Connect with any central (e.g. nRF Connect),
+ * request the MTU you want to test and subscribe to 6e400005; the sketch
+ * keeps the BULK lane full and reports bytes/s per window together with
+ * the negotiated MTU and the requested connection interval. Rebuild with
+ * -DWIBLE_BENCH_CONN_INTERVAL=<units of 1.25 ms> to sweep intervals.
+ *
+ * Host builds (benchmarks/host/build.sh NotifyThroughput) fake a connected
+ * peer and sweep MTUs, measuring the scheduler's CPU cost per notification.
+ */
+
+#include <WiBLE.h>
+#include <BLEManager.h>
+#include <utils/BenchReport.h>
+#include <utils/LogManager.h>
+
+using namespace WiBLE;
+
+#ifndef WIBLE_BENCH_CONN_INTERVAL
+#define WIBLE_BENCH_CONN_INTERVAL 24
+#endif
+
+static const uint32_t WINDOW_MS = 5000;
+static const uint8_t WINDOWS = 6;
+
+static BLEManager ble;
+static uint8_t payload[WIBLE_GATT_OP_MAX_DATA];
+static uint32_t bytesCompleted = 0;
+static uint32_t notificationsFailed = 0;
+
+static void onNotified(void* context, bool success) {
+    size_t length = (size_t)context;
+    if (success) bytesCompleted += length;
+    else notificationsFailed++;
+}
+
+static size_t payloadForMtu(uint16_t mtu) {
+    size_t length = mtu > 3 ? mtu - 3 : 0;
+    return length < sizeof(payload) ? length : sizeof(payload);
+}
+
+static void fillQueue(size_t length) {
+    while (ble.enqueueNotify(WIBLE_DATA_CHARACTERISTIC, payload, length, GATTPriority::BULK,
+                             onNotified, (void*)length)) {}
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(500);
+    LogManager::setLevel(LogLevel::NONE);
+
+    for (size_t i = 0; i < sizeof(payload); i++) payload[i] = (uint8_t)i;
+
+    BLEConfig config;
+    config.deviceName = "WiBLE_Bench";
+    config.connectionInterval = WIBLE_BENCH_CONN_INTERVAL;
+    config.maxNotificationsPerTick = 8;
+    ble.initialize(config);
+
+#ifdef WIBLE_HOST_BENCH
+    // No radio: a fake peer always has free buffers, so this measures the
+    // per-notification CPU cost of enqueue + dispatch
+    BLEServer::mockInstance()->mockConnect();
+    static const uint16_t MTUS[] = { 23, 185, 247 };
+    for (size_t m = 0; m < sizeof(MTUS) / sizeof(MTUS[0]); m++) {
+        size_t length = payloadForMtu(MTUS[m]);
+        const uint32_t notifications = 20000;
+        bytesCompleted = 0;
+
+        int64_t start = Bench::nowUs();
+        for (uint32_t sent = 0; sent < notifications; sent += WIBLE_GATT_OP_POOL_SIZE) {
+            fillQueue(length);
+            while (ble.getQueueSize() > 0) ble.loop();
+        }
+        int64_t elapsedUs = Bench::nowUs() - start;
+
+        char name[40];
+        snprintf(name, sizeof(name), "mtu_%u_ns_per_notify", (unsigned)MTUS[m]);
+        Bench::report("notify", name, elapsedUs * 1000.0 / notifications, "ns");
+        snprintf(name, sizeof(name), "mtu_%u_cpu_bound_bps", (unsigned)MTUS[m]);
+        Bench::report("notify", name, elapsedUs ? bytesCompleted * 1e6 / elapsedUs : 0, "bytes/s");
+    }
+    Bench::report("notify", "heap_high_water_bytes", Bench::heapHighWater(), "bytes");
+    Bench::finish();
+#else
+    ble.startAdvertising();
+    Serial.println("{\"bench\":\"notify\",\"status\":\"waiting_for_central\"}");
+#endif
+}
+
+void loop() {
+#ifndef WIBLE_HOST_BENCH
+    static uint32_t windowStart = 0;
+    static uint8_t windowsDone = 0;
+
+    if (Bench::isFinished()) {
+        delay(1000);
+        return;
+    }
+    if (!ble.isConnected()) {
+        windowStart = 0;
+        delay(10);
+        return;
+    }
+
+    uint16_t mtu = ble.getMTU();
+    fillQueue(payloadForMtu(mtu));
+    ble.loop();
+
+    uint32_t now = millis();
+    if (windowStart == 0) {
+        windowStart = now;
+        bytesCompleted = 0;
+        return;
+    }
+    if (now - windowStart < WINDOW_MS) return;
+
+    Bench::report("notify", "throughput_bps", bytesCompleted * 1000.0 / (now - windowStart), "bytes/s");
+    Bench::report("notify", "mtu", mtu, "bytes");
+    Bench::report("notify", "conn_interval_requested_ms", WIBLE_BENCH_CONN_INTERVAL * 1.25, "ms");
+    Bench::report("notify", "failed_notifications", notificationsFailed, "count");
+    Bench::report("notify", "heap_high_water_bytes", Bench::heapHighWater(), "bytes");
+
+    windowStart = now;
+    bytesCompleted = 0;
+    if (++windowsDone >= WINDOWS) Bench::finish();
+#endif
+}
@@ -0,0 +1,122 @@
+/**
+ * ProvisioningLatency.ino
+ *
+ * Measures time from BLE connect to PROVISIONED, broken down by the time
+ * spent in each state, from WiBLE's ProvisioningMetrics. Provision the
+ * device from any WiBLE app; each completed attempt prints JSON lines and
+ * the device is cleared so the next attempt can start. Results after
+ * ATTEMPTS successful runs include the running averages.
+ *
+ * Host builds (benchmarks/host/build.sh ProvisioningLatency) drive the
+ * flow through the BLE and WiFi mocks: connect, MTU exchange, plaintext
+ * credentials write, WiFi connect, without the connectivity check. That
+ * measures the library's own end-to-end CPU time and heap, not radio,
+ * access point or internet latency.
+ */
+
+#include <WiBLE.h>
+#include <BLEManager.h>
+#include <StateManager.h>
+#include <utils/BenchReport.h>
+
+using namespace WiBLE;
+
+static const uint8_t ATTEMPTS = 10;
+
+WiBLE::WiBLE provisioner;
+static bool attemptComplete = false;
+static uint8_t attemptsDone = 0;
+
+static void reportAttempt() {
+    ProvisioningMetrics metrics = provisioner.getMetrics();
+    Bench::report("provisioning", "connect_to_provisioned_ms", metrics.lastProvisioningTimeMs, "ms");
+    Bench::report("provisioning", "wifi_connect_ms", metrics.lastConnectionTimeMs, "ms");
+
+    for (uint8_t i = 0; i < WIBLE_STATE_COUNT; i++) {
+        ProvisioningState state = static_cast<ProvisioningState>(i);
+        if (state == ProvisioningState::PROVISIONED || state == ProvisioningState::IDLE) continue;
+
+        char name[48];
+        snprintf(name, sizeof(name), "state_%s_ms", StateUtils::stateToString(state).c_str());
+        Bench::report("provisioning", name, metrics.lastStateDurationMs[i], "ms");
+    }
+}
+
+static void reportSummary() {
+    ProvisioningMetrics metrics = provisioner.getMetrics();
+    Bench::report("provisioning", "average_connect_to_provisioned_ms", metrics.averageProvisioningTimeMs, "ms");
+    Bench::report("provisioning", "average_wifi_connect_ms", metrics.averageConnectionTimeMs, "ms");
+    Bench::report("provisioning", "attempts", metrics.totalProvisioningAttempts, "count");
+    Bench::report("provisioning", "successes", metrics.successfulProvisionings, "count");
+    Bench::report("provisioning", "failures", metrics.failedProvisionings, "count");
+    Bench::report("provisioning", "heap_high_water_bytes", Bench::heapHighWater(), "bytes");
+}
+
+#ifdef WIBLE_HOST_BENCH
+static int64_t attemptStartUs = 0;
+
+static void driveAttempt() {
+    static const char CREDENTIALS[] = "{\"ssid\":\"BenchNet\",\"pass\":\"benchpass1\"}";
+
+    attemptStartUs = Bench::nowUs();
+    BLEServer::mockInstance()->mockConnect();
+    BLEServer::mockInstance()->mockMtu(185);
+    BLECharacteristic::mockFind(WIBLE_CRED_CHARACTERISTIC)
+        ->mockWrite((const uint8_t*)CREDENTIALS, sizeof(CREDENTIALS) - 1);
+}
+#endif
+
+void setup() {
+    Serial.begin(115200);
+    delay(500);
+
+    ProvisioningConfig config;
+    config.deviceName = "WiBLE_Bench";
+    config.logLevel = LogLevel::ERROR;
+    config.securityLevel = SecurityLevel::NONE;
+#ifdef WIBLE_HOST_BENCH
+    config.validateConnectivity = false;    // The mocks have no network behind them
+#endif
+    provisioner.begin(config);
+
+    provisioner.onProvisioningComplete([](bool success, uint32_t durationMs) {
+        attemptComplete = true;
+    });
+
+    provisioner.startProvisioning();
+#ifdef WIBLE_HOST_BENCH
+    driveAttempt();
+#else
+    Serial.println("{\"bench\":\"provisioning\",\"status\":\"waiting_for_app\"}");
+#endif
+}
+
+void loop() {
+    if (Bench::isFinished()) {
+        delay(1000);
+        return;
+    }
+
+    provisioner.loop();
+    if (!attemptComplete) return;
+    attemptComplete = false;
+
+#ifdef WIBLE_HOST_BENCH
+    Bench::report("provisioning", "host_end_to_end_us", (double)(Bench::nowUs() - attemptStartUs), "us");
+    BLEServer::mockInstance()->mockDisconnect();
+#endif
+    reportAttempt();
+
+    if (++attemptsDone >= ATTEMPTS) {
+        reportSummary();
+        Bench::finish();
+        return;
+    }
+
+    // Back to advertising for the next attempt
+    provisioner.clearProvisioning();
+    provisioner.startProvisioning();
+#ifdef WIBLE_HOST_BENCH
+    driveAttempt();
+#endif
+}
@@ -0,0 +1,105 @@
+/**
+ * ScanIngest.ino
+ *
+ * Measures the gateway scanner: cost per advertisement folded into the
+ * device table, per advertisement rejected by the filters, per batch
+ * snapshot, and the heap used while ingesting. Results print as JSON lines.
+ *
+ * Also builds for the host: benchmarks/host/build.sh ScanIngest
+ */
+
+#include <WiBLE.h>
+#include <BLEScanner.h>
+#include <utils/BenchReport.h>
+#include <utils/LogManager.h>
+
+using namespace WiBLE;
+
+static const uint32_t ADVERTISEMENTS = 20000;
+static const uint8_t DEVICES = 40;          // Within the table's load limit
+static const uint16_t COMPANY_ID = 0x0499;  // Ruuvi
+
+// Flags + manufacturer data, like a typical sensor beacon
+static uint8_t advertisement[] = {
+    0x02, 0x01, 0x06,
+    0x1B, 0xFF, 0x99, 0x04, 0x05, 0x12, 0xFC, 0x53, 0x94, 0xC3, 0x7C, 0x00, 0x04,
+    0xFF, 0xFC, 0x04, 0x0C, 0xAC, 0x36, 0x42, 0x00, 0xCD, 0xCB, 0xB8, 0x33, 0x4C, 0x88, 0x4F
+};
+
+static void addressFor(uint32_t device, uint8_t* address) {
+    address[0] = 0xC8; address[1] = 0x2B; address[2] = 0x96;
+    address[3] = device >> 16; address[4] = device >> 8; address[5] = device;
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(500);
+    LogManager::setLevel(LogLevel::NONE);
+
+    std::unique_ptr<BLEScanner> scanner(new BLEScanner());
+    ScanConfig config;
+    config.batchIntervalMs = 0;
+    config.filter.companyId = COMPANY_ID;
+    config.filter.minRSSI = -90;
+    scanner->start(config);
+
+    size_t batched = 0;
+    scanner->onBatch([&batched](const ScanEntry*, size_t count) { batched += count; });
+
+    uint8_t address[6];
+    for (uint8_t d = 0; d < DEVICES; d++) {
+        addressFor(d, address);
+        scanner->processAdvertisement(address, 0, -60, advertisement, sizeof(advertisement));
+    }
+
+    Bench::resetHeapHighWater();
+    size_t heapBefore = Bench::heapInUse();
+
+    double acceptedNs = Bench::measureNs(ADVERTISEMENTS, [&scanner, &address](uint32_t i) {
+        addressFor(i % DEVICES, address);
+        scanner->processAdvertisement(address, 0, -60 - (int8_t)(i & 7), advertisement, sizeof(advertisement));
+    });
+
+    // Below the RSSI floor: rejected before the table is touched
+    double weakNs = Bench::measureNs(ADVERTISEMENTS, [&scanner, &address](uint32_t i) {
+        addressFor(i % DEVICES, address);
+        scanner->processAdvertisement(address, 0, -95, advertisement, sizeof(advertisement));
+    });
+
+    // Other company: the AD structures are walked, then rejected
+    advertisement[5] = 0x4C;
+    double otherCompanyNs = Bench::measureNs(ADVERTISEMENTS, [&scanner, &address](uint32_t i) {
+        addressFor(i % DEVICES, address);
+        scanner->processAdvertisement(address, 0, -60, advertisement, sizeof(advertisement));
+    });
+    advertisement[5] = 0x99;
+
+    double flushNs = Bench::measureNs(200, [&scanner, &address](uint32_t i) {
+        addressFor(i % DEVICES, address);
+        scanner->processAdvertisement(address, 0, -60, advertisement, sizeof(advertisement));
+        scanner->flush();
+    });
+    size_t heapPeak = Bench::heapHighWater();
+
+    // Many more devices than the table holds
+    for (uint32_t d = 0; d < 1000; d++) {
+        addressFor(1000 + d, address);
+        scanner->processAdvertisement(address, 0, -70, advertisement, sizeof(advertisement));
+    }
+    ScanStatistics stats = scanner->getStatistics();
+
+    Bench::report("scan", "accepted_advertisement_ns", acceptedNs, "ns");
+    Bench::report("scan", "rssi_rejected_advertisement_ns", weakNs, "ns");
+    Bench::report("scan", "filter_rejected_advertisement_ns", otherCompanyNs, "ns");
+    Bench::report("scan", "flush_ns", flushNs, "ns");
+    Bench::report("scan", "devices_batched", batched, "count");
+    Bench::report("scan", "devices_tracked", stats.devicesTracked, "count");
+    Bench::report("scan", "devices_dropped", stats.devicesDropped, "count");
+    Bench::report("scan", "heap_delta_bytes", (double)heapPeak - heapBefore, "bytes");
+    Bench::report("scan", "heap_high_water_bytes", heapPeak, "bytes");
+    Bench::finish();
+}
+
+void loop() {
+    delay(1000);
+}
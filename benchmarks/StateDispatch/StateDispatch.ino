@@ -0,0 +1,72 @@
+/**
+ * StateDispatch.ino
+ *
+ * Measures StateManager::handleEvent() cost: a full happy-path cycle
+ * (IDLE -> ... -> PROVISIONED -> IDLE), rejected events, and the heap
+ * used while dispatching. Results print as JSON lines.
+ *
+ * Also builds for the host: benchmarks/host/build.sh StateDispatch
+ */
+
+#include <WiBLE.h>
+#include <StateManager.h>
+#include <utils/BenchReport.h>
+#include <utils/LogManager.h>
+
+using namespace WiBLE;
+
+static const uint32_t CYCLES = 2000;
+
+static const StateEvent HAPPY_PATH[] = {
+    StateEvent::START_ADVERTISING,
+    StateEvent::BLE_CLIENT_CONNECTED,
+    StateEvent::AUTH_STARTED,
+    StateEvent::AUTH_SUCCESS,
+    StateEvent::CREDENTIALS_RECEIVED,
+    StateEvent::WIFI_CONNECTED,
+    StateEvent::VALIDATION_SUCCESS,
+    StateEvent::RESET_REQUESTED
+};
+static const size_t HAPPY_PATH_LENGTH = sizeof(HAPPY_PATH) / sizeof(HAPPY_PATH[0]);
+
+void setup() {
+    Serial.begin(115200);
+    delay(500);
+    LogManager::setLevel(LogLevel::NONE);
+
+    StateManager states;
+    states.initialize();
+
+    uint32_t transitions = 0;
+    states.onStateTransition([&transitions](ProvisioningState, ProvisioningState, StateEvent) {
+        transitions++;
+    });
+
+    // Warm up caches and the history ring
+    for (size_t i = 0; i < HAPPY_PATH_LENGTH; i++) states.handleEvent(HAPPY_PATH[i]);
+
+    Bench::resetHeapHighWater();
+    size_t heapBefore = Bench::heapInUse();
+
+    double cycleNs = Bench::measureNs(CYCLES, [&states](uint32_t) {
+        for (size_t i = 0; i < HAPPY_PATH_LENGTH; i++) states.handleEvent(HAPPY_PATH[i]);
+    });
+
+    // IDLE has no WIFI_CONNECTED transition
+    double rejectedNs = Bench::measureNs(CYCLES * HAPPY_PATH_LENGTH, [&states](uint32_t) {
+        states.handleEvent(StateEvent::WIFI_CONNECTED);
+    });
+    size_t heapPeak = Bench::heapHighWater();
+
+    Bench::report("state_dispatch", "happy_path_cycle_ns", cycleNs, "ns");
+    Bench::report("state_dispatch", "handle_event_ns", cycleNs / HAPPY_PATH_LENGTH, "ns");
+    Bench::report("state_dispatch", "rejected_event_ns", rejectedNs, "ns");
+    Bench::report("state_dispatch", "transitions", transitions, "count");
+    Bench::report("state_dispatch", "heap_delta_bytes", (double)heapPeak - heapBefore, "bytes");
+    Bench::report("state_dispatch", "heap_high_water_bytes", heapPeak, "bytes");
+    Bench::finish();
+}
+
+void loop() {
+    delay(1000);
+}
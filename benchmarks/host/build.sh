@@ -0,0 +1,31 @@
+#!/bin/sh
+# Build the benchmark sketches for the host against tests/mocks and run them.
+#
+#   benchmarks/host/build.sh                      # all sketches
+#   benchmarks/host/build.sh StateDispatch        # selected sketches
+#   RUN=0 benchmarks/host/build.sh                # build only
+#
+# Results are JSON lines on stdout (see benchmarks/README.md).
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/../.." && pwd)
+OUT=${OUT:-"$ROOT/benchmarks/host/out"}
+CXX=${CXX:-g++}
+RUN=${RUN:-1}
+SKETCHES=${*:-"StateDispatch CryptoThroughput NotifyThroughput ProvisioningLatency ScanIngest"}
+
+mkdir -p "$OUT"
+
+for sketch in $SKETCHES; do
+    "$CXX" -std=gnu++11 -O2 -DARDUINO=100 -DWIBLE_HOST_BENCH \
+        -I "$ROOT/src" -I "$ROOT/src/utils" -I "$ROOT/tests/mocks" \
+        -x c++ "$ROOT/benchmarks/$sketch/$sketch.ino" -x none \
+        "$ROOT/benchmarks/host/host_main.cpp" \
+        "$ROOT"/src/*.cpp "$ROOT"/src/utils/*.cpp "$ROOT"/tests/mocks/*.cpp \
+        -lpthread -o "$OUT/$sketch"
+
+    if [ "$RUN" = "1" ]; then
+        "$OUT/$sketch"
+    fi
+done
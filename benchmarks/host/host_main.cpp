@@ -0,0 +1,84 @@
+/**
+ * host_main.cpp - Runs a benchmark sketch on the host against tests/mocks
+ *
+ * The sketch is compiled as C++ next to this file (see build.sh). Radio and
+ * crypto are mocked, so host numbers cover the library's own CPU work
+ * (dispatch, framing, scheduling, copies) and heap use, not air time or
+ * cipher cost. Heap figures come from counting operator new/delete.
+ */
+
+#include <Arduino.h>
+#include <utils/BenchReport.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifndef WIBLE_BENCH_HOST_MAX_LOOPS
+#define WIBLE_BENCH_HOST_MAX_LOOPS 1000000
+#endif
+
+void setup();
+void loop();
+
+// ============================================================================
+// ALLOCATION COUNTING
+// ============================================================================
+
+namespace {
+
+std::atomic<size_t> bytesInUse(0);
+std::atomic<size_t> bytesHighWater(0);
+
+// Keeps the payload max_align_t aligned
+const size_t HEADER_SIZE = alignof(max_align_t) > sizeof(size_t)
+    ? alignof(max_align_t) : sizeof(size_t);
+
+void* countedAlloc(size_t size) {
+    uint8_t* block = static_cast<uint8_t*>(std::malloc(size + HEADER_SIZE));
+    if (!block) throw std::bad_alloc();
+    *reinterpret_cast<size_t*>(block) = size;
+
+    size_t now = bytesInUse.fetch_add(size) + size;
+    size_t peak = bytesHighWater.load();
+    while (now > peak && !bytesHighWater.compare_exchange_weak(peak, now)) {}
+    return block + HEADER_SIZE;
+}
+
+void countedFree(void* ptr) {
+    if (!ptr) return;
+    uint8_t* block = static_cast<uint8_t*>(ptr) - HEADER_SIZE;
+    bytesInUse.fetch_sub(*reinterpret_cast<size_t*>(block));
+    std::free(block);
+}
+
+} // namespace
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* ptr) noexcept { countedFree(ptr); }
+void operator delete[](void* ptr) noexcept { countedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { countedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { countedFree(ptr); }
+
+namespace WiBLE {
+namespace Bench {
+
+size_t hostHeapInUse() { return bytesInUse.load(); }
+size_t hostHeapHighWater() { return bytesHighWater.load(); }
+void hostHeapResetHighWater() { bytesHighWater.store(bytesInUse.load()); }
+
+} // namespace Bench
+} // namespace WiBLE
+
+// ============================================================================
+// ENTRY POINT
+// ============================================================================
+
+int main() {
+    setup();
+    for (uint32_t i = 0; i < WIBLE_BENCH_HOST_MAX_LOOPS && !WiBLE::Bench::isFinished(); i++) {
+        loop();
+    }
+    return WiBLE::Bench::isFinished() ? 0 : 1;
+}
@@ -30,9 +30,9 @@ void onWiFiConnected(String ssid, String ip) {
     // provisioner.sendWiFiData("/status", "Online");
 }
 
-void onError(ErrorCode code, String msg, bool canRetry) {
+void onError(ErrorCode code, const char* msg, bool canRetry) {
     Serial.printf("[Callback] Error %d: %s (Retryable: %s)\n", 
-                  (int)code, msg.c_str(), canRetry ? "Yes" : "No");
+                  (int)code, msg, canRetry ? "Yes" : "No");
 }
 
 void onDataReceived(const uint8_t* data, size_t len) {
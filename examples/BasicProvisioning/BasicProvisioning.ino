@@ -174,10 +174,10 @@ void onProvisioningComplete(bool success, uint32_t durationMs) {
     }
 }
 
-void onError(ErrorCode error, String message, bool canRetry) {
+void onError(ErrorCode error, const char* message, bool canRetry) {
     Serial.println("\n⚠️  ERROR OCCURRED");
     Serial.printf("   Code: %d\n", static_cast<int>(error));
-    Serial.printf("   Message: %s\n", message.c_str());
+    Serial.printf("   Message: %s\n", message);
     Serial.printf("   Can Retry: %s\n", canRetry ? "Yes" : "No");
     
     // Handle specific errors
@@ -379,10 +379,13 @@ void handleSerialCommand() {
             ESP.restart();
         }
         else if (command == "scan") {
-            Serial.println("Scanning WiFi networks...");
+            // Served from the scan cache; a stale cache refreshes in the background
             auto networks = provisioner.scanWiFiNetworks();
+            if (networks.empty()) {
+                Serial.println("Scanning WiFi networks... try 'scan' again in a few seconds");
+            }
             for (const auto& network : networks) {
-                Serial.printf("  • %s (%d dBm)\n", network.c_str(), -50);
+                Serial.printf("  • %s\n", network.c_str());
             }
         }
         else if (command == "metrics") {
@@ -2,7 +2,9 @@
  * BeaconMode.ino
  * 
  * Demonstrates the "Beacon Mode" capability of WiBLE.
- * The ESP32 acts as an iBeacon when not in provisioning mode.
+ * The ESP32 acts as an iBeacon and broadcasts a telemetry frame while
+ * staying discoverable for provisioning. On ESP32-C3/S3/C6 the three
+ * advertisements run concurrently; on the original ESP32 they take turns.
  * @author Chamath Adithya (SOLVEO)
  */
 
@@ -18,6 +20,13 @@ String BEACON_UUID = "12345678-1234-1234-1234-1234567890ab";
 uint16_t BEACON_MAJOR = 1;
 uint16_t BEACON_MINOR = 100;
 
+struct Telemetry {
+    uint16_t uptimeSeconds;
+    uint8_t freeHeapKB;
+} __attribute__((packed)) telemetry;
+
+uint32_t lastTelemetry = 0;
+
 void setup() {
     Serial.begin(115200);
     delay(1000);
@@ -35,15 +44,36 @@ void setup() {
         return;
     }
 
-    // Start Beacon Mode immediately
-    Serial.println("Starting iBeacon...");
-    provisioner.startBeaconMode(BEACON_UUID, BEACON_MAJOR, BEACON_MINOR);
+    // Provisioning stays advertised; the beacon and telemetry run beside it
+    MultiAdvertisingConfig multi;
+    multi.beacon = true;
+    multi.beaconUUID = BEACON_UUID;
+    multi.beaconMajor = BEACON_MAJOR;
+    multi.beaconMinor = BEACON_MINOR;
+    multi.beaconParams.intervalMs = 300;    // Beacons can be slow
+    multi.telemetry = true;
+    multi.telemetryParams.intervalMs = 500;
+    multi.telemetryParams.txPower = -6;     // Nearby gateway only
+
+    Serial.println("Starting iBeacon + telemetry...");
+    if (!provisioner.startMultiAdvertising(multi, (uint8_t*)&telemetry, sizeof(telemetry))) {
+        // Single advertisement fallback
+        provisioner.startBeaconMode(BEACON_UUID, BEACON_MAJOR, BEACON_MINOR);
+    }
     Serial.println("Beacon is active. Use a Beacon Scanner app to find it.");
 }
 
 void loop() {
     provisioner.loop();
     
+    // Telemetry is swapped in while all sets stay on air
+    if (millis() - lastTelemetry >= 1000) {
+        lastTelemetry = millis();
+        telemetry.uptimeSeconds = millis() / 1000;
+        telemetry.freeHeapKB = ESP.getFreeHeap() / 1024;
+        provisioner.updateTelemetry((uint8_t*)&telemetry, sizeof(telemetry));
+    }
+    
     // You can switch back to provisioning mode if a button is pressed, for example.
     // if (buttonPressed) {
     //     provisioner.startProvisioning();
@@ -8,6 +8,10 @@
  * 2. Check if provisioned
  * 3. If YES: Connect WiFi, Do Task, Sleep
  * 4. If NO: Start BLE Provisioning, Wait for user, Then Sleep
+ *
+ * prepareForSleep() keeps the state machine, the cached AP/IP lease and
+ * the metrics counters in RTC memory, so the next wake resumes without
+ * a cold start and rejoins WiFi without bringing BLE up.
  * @author Chamath Adithya (SOLVEO)
  */
 
@@ -33,8 +37,12 @@ void setup() {
     ProvisioningConfig config;
     config.deviceName = "WiBLE_DeepSleep";
     
-    // Initialize WiBLE (loads credentials)
+    // Initialize WiBLE (resumes from the RTC snapshot after deep sleep)
     provisioner.begin(config);
+    if (provisioner.isResumedFromSleep()) {
+        ProvisioningMetrics metrics = provisioner.getMetrics();
+        Serial.printf("Resumed (wake %u) in %u us\n", metrics.deepSleepWakes, metrics.resumeTimeUs);
+    }
 
     if (provisioner.isProvisioned()) {
         Serial.println("Device IS provisioned. Connecting to WiFi...");
@@ -57,6 +65,8 @@ void setup() {
         }
         
         Serial.println("Going to sleep...");
+        esp_sleep_enable_timer_wakeup(TIME_TO_SLEEP * uS_TO_S_FACTOR);
+        provisioner.prepareForSleep();
         esp_deep_sleep_start();
         
     } else {
@@ -77,6 +87,7 @@ void loop() {
     if (provisioner.isProvisioned() && provisioner.isWiFiConnected()) {
         Serial.println("Just provisioned! Going to sleep in 5 seconds...");
         delay(5000);
+        provisioner.prepareForSleep();
         esp_deep_sleep_start();
     }
 }
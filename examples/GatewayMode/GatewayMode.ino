@@ -4,6 +4,11 @@
  * Demonstrates the "Dual Role" capability of WiBLE.
  * The ESP32 acts as a Provisioning Server (waiting for mobile app)
  * AND as a Gateway Client (scanning for other BLE devices).
+ *
+ * The scan runs continuously and passively. Sensors are deduplicated by
+ * MAC address with a smoothed RSSI, and every few seconds the devices
+ * heard since the previous batch are handed over as one snapshot, ready
+ * to publish over MQTT or HTTP.
  * @author Chamath Adithya (SOLVEO)
  */
 
@@ -13,13 +18,35 @@ using namespace WiBLE;
 
 WiBLE::WiBLE provisioner;
 
-// Callback for discovered devices
-void onDeviceDiscovered(const String& address, int rssi, const String& mfgData) {
-    Serial.printf("[SCAN] Device: %s | RSSI: %d | Data: %s\n", 
-                  address.c_str(), rssi, mfgData.c_str());
-                  
-    // In a real gateway, you would filter for specific sensors here
-    // and upload their data to the cloud via WiFi.
+// Only forward sensors from one manufacturer (Ruuvi) that are in range
+static const uint16_t SENSOR_COMPANY_ID = 0x0499;
+static const int8_t SENSOR_MIN_RSSI = -85;
+
+// Called from provisioner.loop() with every sensor heard since the last batch
+void onSensorBatch(const ScanEntry* entries, size_t count) {
+    // One JSON document per batch; replace Serial with your MQTT/HTTP client
+    static char payload[2048];
+    size_t used = snprintf(payload, sizeof(payload), "{\"devices\":[");
+
+    for (size_t i = 0; i < count && used < sizeof(payload) - 96; i++) {
+        const ScanEntry& entry = entries[i];
+        char address[18];
+        entry.formatAddress(address);
+
+        uint8_t length = 0;
+        const uint8_t* data = entry.getManufacturerData(length);
+
+        used += snprintf(payload + used, sizeof(payload) - used,
+                         "%s{\"mac\":\"%s\",\"rssi\":%d,\"seen\":%u,\"data\":\"",
+                         i ? "," : "", address, entry.rssi, entry.advertisementCount);
+        for (uint8_t b = 0; b < length && used < sizeof(payload) - 8; b++) {
+            used += snprintf(payload + used, sizeof(payload) - used, "%02x", data[b]);
+        }
+        used += snprintf(payload + used, sizeof(payload) - used, "\"}");
+    }
+    snprintf(payload + used, sizeof(payload) - used, "]}");
+
+    Serial.printf("[SCAN] %u devices: %s\n", (unsigned)count, payload);
 }
 
 void setup() {
@@ -44,26 +71,31 @@ void setup() {
     provisioner.onWiFiConnected([](String ssid, String ip) {
         Serial.printf("Gateway Connected to WiFi: %s (%s)\n", ssid.c_str(), ip.c_str());
     });
-    
-    // Access the internal BLE Manager to set up scanning
-    // Note: In a production API, we would expose this via the main WiBLE class
-    // For now, we assume the user has modified WiBLE.h to expose bleManager or added a wrapper
-    // Since we are inside the library development, we can add a wrapper to WiBLE.h/cpp
-    // OR we can just use the BLEManager singleton if it were one.
-    // 
-    // Wait! WiBLE.h doesn't expose bleManager publicly. 
-    // We should add a `getBLEManager()` method or a `scan()` wrapper to WiBLE class.
-    // Let's add a wrapper to WiBLE.h first.
+
+    // Continuous passive scan, 30 ms out of every 100 ms so the radio
+    // still serves the provisioning app
+    ScanConfig scan;
+    scan.intervalMs = config.bleScanIntervalMs;
+    scan.windowMs = config.bleScanWindowMs;
+    scan.batchIntervalMs = 10000;
+    scan.filter.companyId = SENSOR_COMPANY_ID;
+    scan.filter.minRSSI = SENSOR_MIN_RSSI;
+
+    if (!provisioner.startGatewayScan(scan, onSensorBatch)) {
+        Serial.println("Scan failed to start!");
+    }
 }
 
 void loop() {
+    // Also delivers the scan batches
     provisioner.loop();
-    
-    // Periodically scan for devices (every 10 seconds)
-    static uint32_t lastScan = 0;
-    if (millis() - lastScan > 10000) {
-        Serial.println("Starting periodic scan...");
-        provisioner.scanForDevices(5, onDeviceDiscovered);
-        lastScan = millis();
+
+    static uint32_t lastStats = 0;
+    if (millis() - lastStats > 60000) {
+        ScanStatistics stats = provisioner.getScanStatistics();
+        Serial.printf("[SCAN] seen %u, filtered %u, tracking %u (dropped %u)\n",
+                      stats.advertisementsSeen, stats.advertisementsFiltered,
+                      stats.devicesTracked, stats.devicesDropped);
+        lastStats = millis();
     }
 }
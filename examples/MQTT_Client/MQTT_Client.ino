@@ -6,6 +6,9 @@
  * 2. Connect to WiFi
  * 3. Connect to MQTT Broker
  * 4. Publish/Subscribe
+ * 5. Sample sensors often and publish them in batches: samples are
+ *    delta-encoded, sent every few seconds as one MQTT message, kept
+ *    while the broker is unreachable and flushed when it comes back
  * 
  * Dependencies: PubSubClient by Nick O'Leary
  * @author Chamath Adithya (SOLVEO)
@@ -25,6 +28,10 @@ WiBLE::WiBLE provisioner;
 WiFiClient espClient;
 PubSubClient client(espClient);
 
+// Telemetry series IDs, shared with the consumer
+#define SERIES_RSSI      0
+#define SERIES_FREE_HEAP 1
+
 void onWiFiConnected(String ssid, String ip) {
     Serial.println("WiFi Connected! Connecting to MQTT...");
     // We can trigger MQTT connection here or in loop
@@ -59,6 +66,8 @@ void setup() {
     // Setup WiBLE
     ProvisioningConfig config;
     config.deviceName = "WiBLE_MQTT_Node";
+    config.enableTelemetry = true;
+    config.telemetry.batchIntervalMs = 10000;
     
     provisioner.onWiFiConnected(onWiFiConnected);
     
@@ -66,6 +75,14 @@ void setup() {
         Serial.println("WiBLE Init Failed");
         return;
     }
+    
+    provisioner.defineTelemetrySeries(SERIES_RSSI, TelemetryValueType::INT);
+    provisioner.defineTelemetrySeries(SERIES_FREE_HEAP, TelemetryValueType::UINT);
+    
+    // One publish per batch; a refused publish keeps the samples queued
+    provisioner.onTelemetryBatch([](const uint8_t* frame, size_t length) {
+        return client.connected() && client.publish("wible/telemetry", frame, length);
+    }, 256);
 }
 
 void loop() {
@@ -88,4 +105,12 @@ void loop() {
             client.publish("wible/uptime", msg.c_str());
         }
     }
+    
+    // Sample every second, connected or not; batches go out from provisioner.loop()
+    static uint32_t lastSample = 0;
+    if (millis() - lastSample > 1000) {
+        lastSample = millis();
+        provisioner.recordTelemetry(SERIES_RSSI, WiFi.RSSI());
+        provisioner.recordTelemetry(SERIES_FREE_HEAP, ESP.getFreeHeap());
+    }
 }
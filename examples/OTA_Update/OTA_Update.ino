@@ -1,67 +1,32 @@
 /**
  * OTA_Update.ino
- * 
+ *
  * Demonstrates Complex Scenario: Firmware Update via BLE.
- * 
+ *
  * Scenario:
- * 1. Device advertises "OTA Service".
- * 2. Mobile app connects and writes firmware chunks to "OTA Characteristic".
- * 3. Device writes chunks to OTA partition using `Update` library.
+ * 1. Device advertises the WiBLE provisioning service with OTA enabled.
+ * 2. Mobile app connects and writes OTA_BEGIN (0x05) to the control
+ *    characteristic: [0x05][image size, 4 bytes LE][SHA-256, 32 bytes].
+ * 3. Device replies on the status characteristic with READY and the byte
+ *    offset to send from (0 for a new image).
+ * 4. App streams the image from that offset as one chunked transfer on the
+ *    data characteristic. Flash writes overlap with the radio.
+ * 5. After a dropped link, the app sends the same OTA_BEGIN again and
+ *    continues from the offset in the reply.
+ * 6. Once the hash matches, the device reports COMPLETE and reboots into
+ *    the new image.
+ *
+ * Use a partition scheme with OTA (e.g. "Minimal SPIFFS (1.9MB APP with OTA)").
  * @author Chamath Adithya (SOLVEO)
  */
 
 #include <WiBLE.h>
-#include <Update.h>
 
 using namespace WiBLE;
 
 WiBLE::WiBLE provisioner;
 
-// In a real implementation, we would add a specific OTA Service to BLEManager.
-// For this example, we'll reuse the "Custom Data" channel of WiBLE to receive firmware chunks.
-// Protocol: 
-// - First packet: "START:<Size>"
-// - Subsequent packets: Binary Data
-// - Last packet: "END"
-
-bool otaStarted = false;
-size_t totalSize = 0;
-size_t receivedSize = 0;
-
-void onDataReceived(const uint8_t* data, size_t len) {
-    String packet = "";
-    for(size_t i=0; i<min(len, (size_t)20); i++) packet += (char)data[i];
-    
-    if (packet.startsWith("START:")) {
-        totalSize = packet.substring(6).toInt();
-        Serial.printf("OTA Start. Size: %d\n", totalSize);
-        if (Update.begin(totalSize)) {
-            otaStarted = true;
-            receivedSize = 0;
-        } else {
-            Serial.println("OTA Begin Failed");
-        }
-        return;
-    }
-    
-    if (otaStarted) {
-        if (packet.startsWith("END")) {
-            if (Update.end()) {
-                Serial.println("OTA Success! Rebooting...");
-                delay(1000);
-                ESP.restart();
-            } else {
-                Serial.printf("OTA Failed. Error: %d\n", Update.getError());
-            }
-            otaStarted = false;
-        } else {
-            // Write chunk
-            size_t written = Update.write((uint8_t*)data, len);
-            receivedSize += written;
-            Serial.printf("Progress: %d / %d\n", receivedSize, totalSize);
-        }
-    }
-}
+uint32_t lastPrintAt = 0;
 
 void setup() {
     Serial.begin(115200);
@@ -69,11 +34,21 @@ void setup() {
 
     ProvisioningConfig config;
     config.deviceName = "WiBLE_OTA_Target";
-    
-    provisioner.onDataReceived(onDataReceived);
+    config.enableOTA = true;
+    config.ota.idleTimeoutMs = 300000;     // Give the phone 5 minutes to reconnect
+
     provisioner.begin(config);
+    provisioner.startProvisioning();
 }
 
 void loop() {
     provisioner.loop();
+
+    // The app gets the same figures in its OTA reports
+    OTAProgress progress = provisioner.getOTAProgress();
+    if (progress.status == OTAStatus::RECEIVING && millis() - lastPrintAt > 1000) {
+        lastPrintAt = millis();
+        Serial.printf("OTA: %u / %u bytes, %u.%u KB/s\n", (unsigned)progress.received,
+                      (unsigned)progress.imageSize, progress.throughput / 10, progress.throughput % 10);
+    }
 }
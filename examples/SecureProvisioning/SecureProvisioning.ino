@@ -30,7 +30,10 @@ void setup() {
     // CRITICAL: Set security level to SECURE
     // This enables ECDH key exchange and AES-256 encryption
     config.securityLevel = SecurityLevel::SECURE;
-    
+
+    // Optional: let a bonded phone that reconnects skip the key exchange
+    config.enableSessionResumption = true;
+
     // Optional: Set a Proof of Possession (PoP) string
     // The user must enter this in the app to authenticate
     // config.proofOfPossession = "123456"; 
@@ -57,8 +60,8 @@ void setup() {
     });
     
     // Called on errors
-    provisioner.onError([](ErrorCode code, String msg, bool canRetry) {
-        Serial.printf("Error [%d]: %s\n", (int)code, msg.c_str());
+    provisioner.onError([](ErrorCode code, const char* msg, bool canRetry) {
+        Serial.printf("Error [%d]: %s\n", (int)code, msg);
     });
     
     // 4. Start Provisioning
@@ -69,10 +69,15 @@ const unsigned long SENSOR_UPDATE_INTERVAL = 2000; // Send sensor data every 2 s
 // Commands from App → Device
 #define CMD_LED1_CONTROL  0x01
 #define CMD_LED2_CONTROL  0x02
+#define CMD_GET_SCHEMA    0x03
 
 // Commands from Device → App
 #define CMD_SENSOR_DATA   0x10
 
+// The 12-byte sensor frame; size and offsets are compile-time constants
+using SensorFrame = PacketSchema<CMD_SENSOR_DATA, LE<float>, LE<float>, LE<uint16_t>, LE<bool>>;
+static_assert(SensorFrame::SIZE == 12, "PROTOCOL.md documents a 12-byte frame");
+
 // ============================================================================
 // SENSOR READING FUNCTIONS
 // ============================================================================
@@ -102,31 +107,24 @@ void readSensors() {
 // ============================================================================
 
 void sendSensorDataToApp() {
-    // Build packet: [CMD_ID][Temperature(4)][Humidity(4)][Light(2)][Motion(1)]
-    uint8_t packet[12];
-    packet[0] = CMD_SENSOR_DATA;
-    
-    // Pack temperature (float to bytes)
-    memcpy(&packet[1], &currentSensors.temperature, 4);
-    
-    // Pack humidity
-    memcpy(&packet[5], &currentSensors.humidity, 4);
-    
-    // Pack light (uint16_t)
-    uint16_t lightValue = (uint16_t)currentSensors.light;
-    memcpy(&packet[9], &lightValue, 2);
-    
-    // Pack motion (1 byte)
-    packet[11] = currentSensors.motion ? 1 : 0;
-    
-    // Send via BLE
-    if (provisioner.sendBLEData(packet, sizeof(packet))) {
+    // [CMD_ID][Temperature(4)][Humidity(4)][Light(2)][Motion(1)], laid out by SensorFrame
+    Result<bool> sent = provisioner.sendPacket<SensorFrame>(currentSensors.temperature,
+                                                            currentSensors.humidity,
+                                                            (uint16_t)currentSensors.light,
+                                                            currentSensors.motion);
+    if (sent.success) {
         Serial.println("✅ Sensor data sent to app");
     } else {
         Serial.println("❌ Failed to send sensor data");
     }
 }
 
+void sendSchemaToApp() {
+    uint8_t descriptor[SensorFrame::DESCRIPTOR_SIZE];
+    SensorFrame::describe(descriptor);
+    provisioner.sendBLEData(descriptor, sizeof(descriptor));
+}
+
 // ============================================================================
 // LED CONTROL
 // ============================================================================
@@ -148,6 +146,10 @@ void setLED2(bool state) {
 // ============================================================================
 
 void onDataReceived(const uint8_t* data, size_t len) {
+    if (len == 1 && data[0] == CMD_GET_SCHEMA) {
+        sendSchemaToApp();
+        return;
+    }
     if (len < 2) {
         Serial.println("⚠️ Invalid command (too short)");
         return;
@@ -227,7 +229,14 @@ void setup() {
     Serial.println("   App → Device: [CMD][VALUE]");
     Serial.println("     0x01 = LED1 (0=OFF, 1=ON)");
     Serial.println("     0x02 = LED2 (0=OFF, 1=ON)");
+    Serial.println("     0x03 = Get sensor frame schema");
     Serial.println("   Device → App: [0x10][Temp][Hum][Light][Motion]");
+    
+    static const char* fieldNames[] = { "temperature", "humidity", "light", "motion" };
+    char schema[160];
+    if (SensorFrame::describeJSON(schema, sizeof(schema), "sensor", fieldNames)) {
+        Serial.printf("   Schema: %s\n", schema);
+    }
 }
 
 // ============================================================================
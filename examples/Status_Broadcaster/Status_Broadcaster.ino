@@ -42,6 +42,7 @@ void setup() {
 void loop() {
     provisioner.loop();
     
+    static bool started = false;
     static uint32_t lastUpdate = 0;
     static uint32_t counter = 0;
     
@@ -56,8 +57,16 @@ void loop() {
         Serial.printf("Broadcasting: Temp=%.2f C, Hum=%.2f %%, Cnt=%d\n", 
                       data.temp/100.0, data.humidity/100.0, data.counter);
         
-        // Broadcast with Company ID 0xFFFF (Testing)
-        provisioner.startBroadcasting(0xFFFF, (uint8_t*)&data, sizeof(SensorData));
+        if (!started) {
+            // Broadcast with Company ID 0xFFFF (Testing)
+            provisioner.startBroadcasting(0xFFFF, (uint8_t*)&data, sizeof(SensorData));
+            started = true;
+        } else {
+            // Advertising keeps running; only the bytes after the type
+            // field are swapped into the controller
+            provisioner.updateBroadcast((uint8_t*)&data.temp, sizeof(SensorData) - 1,
+                                        offsetof(SensorData, temp));
+        }
         
         lastUpdate = millis();
     }
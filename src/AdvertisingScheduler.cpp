@@ -0,0 +1,342 @@
+/**
+ * AdvertisingScheduler.cpp - Concurrent advertising sets implementation
+ */
+
+#include "AdvertisingScheduler.h"
+#include "utils/LogManager.h"
+#include <esp_bt.h>
+#include <string.h>
+
+namespace WiBLE {
+
+static uint16_t msToAdvUnits(uint16_t ms) {
+    // 0.625 ms units, within the 20 ms .. 10.24 s advertising interval range
+    uint32_t units = (uint32_t)ms * 8 / 5;
+    if (units < 0x0020) units = 0x0020;
+    if (units > 0x4000) units = 0x4000;
+    return (uint16_t)units;
+}
+
+#if !WIBLE_EXTENDED_ADVERTISING
+static esp_power_level_t txPowerLevel(int8_t dbm) {
+    // Every controller's enum has 3 dB steps; -12..+9 dBm exists on all of them
+    if (dbm < -12) dbm = -12;
+    if (dbm > 9) dbm = 9;
+    return (esp_power_level_t)(ESP_PWR_LVL_N12 + (dbm + 12) / 3);
+}
+#endif
+
+// ============================================================================
+// ADVERTISING SCHEDULER IMPLEMENTATION
+// ============================================================================
+
+AdvertisingScheduler::AdvertisingScheduler()
+    : running(false),
+      current(WIBLE_NO_ADV_SET),
+      turnStart(0),
+      startTime(0) {
+    for (SetSlot& slot : sets) {
+        slot.length = 0;
+        slot.scanResponseLength = 0;
+        slot.inUse = false;
+        slot.enabled = false;
+        slot.onAir = false;
+        slot.onAirSince = 0;
+    }
+}
+
+int8_t AdvertisingScheduler::addSet(const AdvertisingSetParams& params, const uint8_t* data, size_t length,
+                                    const uint8_t* scanResponse, size_t scanResponseLength) {
+    if (length > WIBLE_ADV_LEGACY_MAX || scanResponseLength > WIBLE_ADV_LEGACY_MAX) {
+        WIBLE_LOGE("Advertising set payload too long");
+        return WIBLE_NO_ADV_SET;
+    }
+
+    for (uint8_t i = 0; i < WIBLE_MAX_ADV_SETS; i++) {
+        SetSlot& slot = sets[i];
+        if (slot.inUse) continue;
+
+        slot.params = params;
+        memcpy(slot.data, data, length);
+        slot.length = length;
+        if (scanResponseLength) memcpy(slot.scanResponse, scanResponse, scanResponseLength);
+        slot.scanResponseLength = scanResponseLength;
+        slot.stats = AdvertisingSetStats();
+        slot.stats.enabled = true;
+        slot.enabled = true;
+        slot.onAir = false;
+        slot.inUse = true;
+
+        if (running) {
+#if WIBLE_EXTENDED_ADVERTISING
+            configureSet(i);
+            startSet(i);
+#else
+            if (current == WIBLE_NO_ADV_SET) {
+                current = i;
+                startSet(i);
+            }
+#endif
+        }
+        return i;
+    }
+
+    WIBLE_LOGE("No free advertising set");
+    return WIBLE_NO_ADV_SET;
+}
+
+void AdvertisingScheduler::removeSet(int8_t set) {
+    if (!validSet(set)) return;
+    setEnabled(set, false);
+#if WIBLE_EXTENDED_ADVERTISING
+    esp_ble_gap_ext_adv_set_remove(set);
+#endif
+    sets[set].inUse = false;
+}
+
+bool AdvertisingScheduler::updateSet(int8_t set, const uint8_t* data, size_t length) {
+    if (!validSet(set) || length > WIBLE_ADV_LEGACY_MAX) return false;
+
+    SetSlot& slot = sets[set];
+    memcpy(slot.data, data, length);
+    slot.length = length;
+    slot.stats.updates++;
+
+    // In place: the controller takes new data while the set is on air
+    if (slot.onAir) {
+#if WIBLE_EXTENDED_ADVERTISING
+        esp_ble_gap_config_ext_adv_data_raw(set, slot.length, slot.data);
+#else
+        esp_ble_gap_config_adv_data_raw(slot.data, slot.length);
+#endif
+    }
+    return true;
+}
+
+bool AdvertisingScheduler::setEnabled(int8_t set, bool enabled) {
+    if (!validSet(set)) return false;
+
+    SetSlot& slot = sets[set];
+    if (slot.enabled == enabled) return true;
+    slot.enabled = enabled;
+    slot.stats.enabled = enabled;
+    if (!running) return true;
+
+#if WIBLE_EXTENDED_ADVERTISING
+    if (enabled) {
+        configureSet(set);
+        startSet(set);
+    } else {
+        stopSet(set);
+    }
+#else
+    if (!enabled && current == set) {
+        // Hand the advertiser to the next set straight away
+        stopSet(set);
+        current = nextEnabled(set);
+        if (current != WIBLE_NO_ADV_SET) startSet(current);
+    } else if (enabled && current == WIBLE_NO_ADV_SET) {
+        current = set;
+        startSet(set);
+    }
+#endif
+    return true;
+}
+
+bool AdvertisingScheduler::isEnabled(int8_t set) const {
+    return validSet(set) && sets[set].enabled;
+}
+
+void AdvertisingScheduler::resume(int8_t set) {
+    if (!running || !validSet(set) || !sets[set].enabled) return;
+#if WIBLE_EXTENDED_ADVERTISING
+    startSet(set);
+#else
+    if (current == set) startSet(set);
+#endif
+}
+
+bool AdvertisingScheduler::start() {
+    if (running) return true;
+    running = true;
+    startTime = millis();
+
+#if WIBLE_EXTENDED_ADVERTISING
+    for (uint8_t i = 0; i < WIBLE_MAX_ADV_SETS; i++) {
+        if (!sets[i].inUse || !sets[i].enabled) continue;
+        configureSet(i);
+        startSet(i);
+    }
+#else
+    current = nextEnabled(WIBLE_NO_ADV_SET);
+    if (current != WIBLE_NO_ADV_SET) startSet(current);
+#endif
+
+    WIBLE_LOGI("Advertising %u sets (%s)", (unsigned)getSetCount(), isExtended() ? "extended" : "rotating");
+    return true;
+}
+
+void AdvertisingScheduler::stop() {
+    if (!running) return;
+    for (uint8_t i = 0; i < WIBLE_MAX_ADV_SETS; i++) {
+        if (sets[i].onAir) stopSet(i);
+    }
+    running = false;
+    current = WIBLE_NO_ADV_SET;
+}
+
+void AdvertisingScheduler::loop() {
+#if !WIBLE_EXTENDED_ADVERTISING
+    if (!running || current == WIBLE_NO_ADV_SET) return;
+
+    uint32_t now = millis();
+    if (now - turnStart < turnLength(sets[current])) return;
+
+    int8_t next = nextEnabled(current);
+    if (next == current || next == WIBLE_NO_ADV_SET) {
+        // Only set left: it simply stays on air
+        turnStart = now;
+        return;
+    }
+    stopSet(current);
+    current = next;
+    startSet(current);
+#endif
+}
+
+uint8_t AdvertisingScheduler::getSetCount() const {
+    uint8_t count = 0;
+    for (const SetSlot& slot : sets) {
+        if (slot.inUse) count++;
+    }
+    return count;
+}
+
+AdvertisingSetStats AdvertisingScheduler::getStats(int8_t set) const {
+    if (!validSet(set)) return AdvertisingSetStats();
+
+    const SetSlot& slot = sets[set];
+    AdvertisingSetStats stats = slot.stats;
+    uint32_t now = millis();
+    if (slot.onAir) stats.onAirMs += now - slot.onAirSince;
+    uint32_t elapsed = now - startTime;
+    if (elapsed > 0) {
+        uint32_t permille = (uint32_t)((uint64_t)stats.onAirMs * 1000 / elapsed);
+        stats.dutyCyclePermille = permille > 1000 ? 1000 : permille;
+    }
+    return stats;
+}
+
+// ============================================================================
+// CONTROLLER ACCESS
+// ============================================================================
+
+bool AdvertisingScheduler::validSet(int8_t set) const {
+    return set >= 0 && set < WIBLE_MAX_ADV_SETS && sets[set].inUse;
+}
+
+void AdvertisingScheduler::configureSet(uint8_t index) {
+    SetSlot& slot = sets[index];
+#if WIBLE_EXTENDED_ADVERTISING
+    esp_ble_gap_ext_adv_params_t params = {};
+    if (slot.params.connectable) {
+        params.type = ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_IND;
+    } else if (slot.scanResponseLength) {
+        params.type = ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_SCAN;
+    } else {
+        params.type = ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_NONCONN;
+    }
+    params.interval_min = msToAdvUnits(slot.params.intervalMs);
+    params.interval_max = params.interval_min;
+    params.channel_map = ADV_CHNL_ALL;
+    params.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
+    params.filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+    params.tx_power = slot.params.txPower;
+    params.primary_phy = ESP_BLE_GAP_PHY_1M;
+    params.secondary_phy = ESP_BLE_GAP_PHY_1M;
+    params.sid = index;
+
+    // Bluedroid runs these in order, so no need to wait for each completion
+    esp_ble_gap_ext_adv_set_params(index, &params);
+    esp_ble_gap_config_ext_adv_data_raw(index, slot.length, slot.data);
+    if (slot.scanResponseLength) {
+        esp_ble_gap_config_ext_scan_rsp_data_raw(index, slot.scanResponseLength, slot.scanResponse);
+    }
+#else
+    esp_ble_gap_config_adv_data_raw(slot.data, slot.length);
+    if (slot.scanResponseLength) {
+        esp_ble_gap_config_scan_rsp_data_raw(slot.scanResponse, slot.scanResponseLength);
+    }
+    esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_ADV, txPowerLevel(slot.params.txPower));
+#endif
+}
+
+void AdvertisingScheduler::startSet(uint8_t index) {
+    SetSlot& slot = sets[index];
+    uint32_t now = millis();
+#if WIBLE_EXTENDED_ADVERTISING
+    esp_ble_gap_ext_adv_t instance = { index, 0, 0 };
+    if (esp_ble_gap_ext_adv_start(1, &instance) != ESP_OK) {
+        WIBLE_LOGW("Advertising set %u failed to start", (unsigned)index);
+        return;
+    }
+#else
+    configureSet(index);
+    esp_ble_adv_params_t params = {};
+    params.adv_int_min = msToAdvUnits(slot.params.intervalMs);
+    params.adv_int_max = params.adv_int_min;
+    if (slot.params.connectable) {
+        params.adv_type = ADV_TYPE_IND;
+    } else if (slot.scanResponseLength) {
+        params.adv_type = ADV_TYPE_SCAN_IND;
+    } else {
+        params.adv_type = ADV_TYPE_NONCONN_IND;
+    }
+    params.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
+    params.channel_map = ADV_CHNL_ALL;
+    params.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+    if (esp_ble_gap_start_advertising(&params) != ESP_OK) {
+        WIBLE_LOGW("Advertising set %u failed to start", (unsigned)index);
+        return;
+    }
+    turnStart = now;
+#endif
+    if (!slot.onAir) slot.stats.turns++;
+    setOnAir(slot, true, now);
+}
+
+void AdvertisingScheduler::stopSet(uint8_t index) {
+#if WIBLE_EXTENDED_ADVERTISING
+    uint8_t instance = index;
+    esp_ble_gap_ext_adv_stop(1, &instance);
+#else
+    esp_ble_gap_stop_advertising();
+#endif
+    setOnAir(sets[index], false, millis());
+}
+
+void AdvertisingScheduler::setOnAir(SetSlot& slot, bool onAir, uint32_t now) {
+    if (slot.onAir == onAir) return;
+    if (onAir) {
+        slot.onAirSince = now;
+    } else {
+        slot.stats.onAirMs += now - slot.onAirSince;
+    }
+    slot.onAir = onAir;
+}
+
+int8_t AdvertisingScheduler::nextEnabled(int8_t after) const {
+    for (uint8_t step = 1; step <= WIBLE_MAX_ADV_SETS; step++) {
+        int8_t index = (after + step + WIBLE_MAX_ADV_SETS) % WIBLE_MAX_ADV_SETS;
+        if (sets[index].inUse && sets[index].enabled) return index;
+    }
+    return WIBLE_NO_ADV_SET;
+}
+
+uint32_t AdvertisingScheduler::turnLength(const SetSlot& slot) const {
+    if (slot.params.turnMs) return slot.params.turnMs;
+    uint32_t turn = (uint32_t)slot.params.intervalMs * WIBLE_ADV_EVENTS_PER_TURN;
+    return turn < WIBLE_ADV_MIN_TURN_MS ? WIBLE_ADV_MIN_TURN_MS : turn;
+}
+
+} // namespace WiBLE
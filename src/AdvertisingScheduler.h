@@ -0,0 +1,142 @@
+/**
+ * AdvertisingScheduler.h - Concurrent advertising sets for WiBLE
+ *
+ * Runs several advertisements side by side, e.g. the provisioning service,
+ * an iBeacon and a telemetry frame, each with its own interval and TX
+ * power. On BLE 5 controllers (ESP32-C3/S3/C6) every set is an extended
+ * advertising instance and all of them are on air at once. On legacy
+ * controllers (ESP32) the single advertiser is time-sliced between the
+ * sets from loop().
+ */
+
+#ifndef WIBLE_ADVERTISING_SCHEDULER_H
+#define WIBLE_ADVERTISING_SCHEDULER_H
+
+#include <Arduino.h>
+#include <esp_gap_ble_api.h>
+#include "utils/AdvertisingData.h"
+
+namespace WiBLE {
+
+// ============================================================================
+// SCHEDULER LIMITS
+// ============================================================================
+
+// Extended advertising when the Bluedroid build has BLE 5.0 features
+#ifndef WIBLE_EXTENDED_ADVERTISING
+#if defined(CONFIG_BT_BLE_50_FEATURES_SUPPORTED) && CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+#define WIBLE_EXTENDED_ADVERTISING 1
+#else
+#define WIBLE_EXTENDED_ADVERTISING 0
+#endif
+#endif
+
+// Sets at once; also the extended advertising instances used (0..N-1)
+#ifndef WIBLE_MAX_ADV_SETS
+#define WIBLE_MAX_ADV_SETS 4
+#endif
+
+// Legacy rotation: advertising events per turn, and the shortest turn
+#define WIBLE_ADV_EVENTS_PER_TURN    3
+#define WIBLE_ADV_MIN_TURN_MS        100
+
+#define WIBLE_NO_ADV_SET -1
+
+// ============================================================================
+// CONFIGURATION / STATISTICS
+// ============================================================================
+
+struct AdvertisingSetParams {
+    uint16_t intervalMs = 100;
+    int8_t txPower = 3;             // dBm: -12, -9, -6, -3, 0, 3, 6, 9
+    bool connectable = false;
+    uint16_t turnMs = 0;            // Legacy rotation: time on air per turn; 0 = 3 advertising events
+};
+
+struct AdvertisingSetStats {
+    bool enabled = false;
+    uint32_t onAirMs = 0;
+    uint16_t dutyCyclePermille = 0; // Share of the time since start() this set was on air
+    uint32_t turns = 0;             // Times it was put on air
+    uint32_t updates = 0;           // Payload updates
+};
+
+// ============================================================================
+// ADVERTISING SCHEDULER
+// ============================================================================
+
+class AdvertisingScheduler {
+public:
+    AdvertisingScheduler();
+
+    /**
+     * Add a set. Payloads use legacy PDUs (31 bytes) even on BLE 5
+     * controllers, so phones that only scan legacy advertising see them.
+     * @return Set ID, or WIBLE_NO_ADV_SET if the table is full or a payload is too long
+     */
+    int8_t addSet(const AdvertisingSetParams& params, const uint8_t* data, size_t length,
+                  const uint8_t* scanResponse = nullptr, size_t scanResponseLength = 0);
+    void removeSet(int8_t set);
+
+    /**
+     * Replace a set's payload; a set on air is updated in place
+     */
+    bool updateSet(int8_t set, const uint8_t* data, size_t length);
+
+    /**
+     * Take a set off air (or back on) without removing it
+     */
+    bool setEnabled(int8_t set, bool enabled);
+    bool isEnabled(int8_t set) const;
+
+    /**
+     * Put a set back on air after the controller stopped it, as it does
+     * for a connectable set when a central connects
+     */
+    void resume(int8_t set);
+
+    bool start();
+    void stop();
+    bool isRunning() const { return running; }
+
+    /**
+     * Rotate the legacy advertiser; call regularly. Nothing to do on BLE 5.
+     */
+    void loop();
+
+    static bool isExtended() { return WIBLE_EXTENDED_ADVERTISING != 0; }
+    uint8_t getSetCount() const;
+    AdvertisingSetStats getStats(int8_t set) const;
+
+private:
+    struct SetSlot {
+        AdvertisingSetParams params;
+        uint8_t data[WIBLE_ADV_LEGACY_MAX];
+        uint8_t scanResponse[WIBLE_ADV_LEGACY_MAX];
+        uint8_t length;
+        uint8_t scanResponseLength;
+        bool inUse;
+        bool enabled;
+        bool onAir;
+        uint32_t onAirSince;
+        AdvertisingSetStats stats;
+    };
+
+    SetSlot sets[WIBLE_MAX_ADV_SETS];
+    bool running;
+    int8_t current;                 // Legacy: set on air
+    uint32_t turnStart;
+    uint32_t startTime;
+
+    bool validSet(int8_t set) const;
+    void startSet(uint8_t index);
+    void stopSet(uint8_t index);
+    void configureSet(uint8_t index);
+    void setOnAir(SetSlot& slot, bool onAir, uint32_t now);
+    int8_t nextEnabled(int8_t after) const;
+    uint32_t turnLength(const SetSlot& slot) const;
+};
+
+} // namespace WiBLE
+
+#endif // WIBLE_ADVERTISING_SCHEDULER_H
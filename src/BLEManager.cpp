@@ -4,6 +4,10 @@
 
 #include "BLEManager.h"
 #include "utils/LogManager.h"
+#include "utils/Metrics.h"
+#include <esp_timer.h>
+#include <esp_gap_ble_api.h>
+#include <esp_gatts_api.h>
 
 namespace WiBLE {
 
@@ -11,24 +15,122 @@ namespace WiBLE {
 // BLE MANAGER IMPLEMENTATION
 // ============================================================================
 
+const uint16_t BLEManager::LATENCY_BUCKET_LIMITS_MS[WIBLE_GATT_LATENCY_BUCKETS - 1] = {
+    5, 10, 20, 50, 100, 250, 500
+};
+
+static_assert(WIBLE_WRITE_QUEUE_DEPTH > 3 * WIBLE_MAX_CONNECTIONS,
+              "The write queue keeps a connect, a disconnect and an MTU slot per connection");
+static_assert(WIBLE_MAX_CONNECTIONS <= WIBLE_TUNER_MAX_LINKS,
+              "ConnectionTuner tracks one link per connection slot");
+
+static uint16_t payloadForMTU(uint16_t mtu) {
+    uint16_t payload = mtu > 3 ? mtu - 3 : 0;
+    return payload > WIBLE_MAX_ATT_PAYLOAD ? WIBLE_MAX_ATT_PAYLOAD : payload;
+}
+
 BLEManager::BLEManager() 
     : initialized(false), 
       advertisingActive(false),
       bleServer(nullptr),
       provisioningService(nullptr),
       deviceInfoService(nullptr),
-      advertising(nullptr) {
+      advertising(nullptr),
+      credentialsChar(nullptr),
+      statusChar(nullptr),
+      controlChar(nullptr),
+      dataChar(nullptr),
+      diagnosticsChar(nullptr),
+      queuedOperations(0),
+      processingOperation(false),
+      transferEventLock(portMUX_INITIALIZER_UNLOCKED),
+      writeWorker(nullptr),
+      writeWorkerStopRequested(false),
+      writeWorkerRunning(false),
+      transferSinkConnId(WIBLE_CONN_ID_ALL),
+      pendingSinkConnId(WIBLE_CONN_ID_ALL),
+      sinkChangePending(false),
+      provisioningSet(WIBLE_NO_ADV_SET) {
+    queueMutex = xSemaphoreCreateMutex();
+    connectionMutex = xSemaphoreCreateMutex();
+    
+    for (uint8_t i = 0; i < WIBLE_GATT_OP_POOL_SIZE; i++) {
+        operationNext[i] = i + 1 < WIBLE_GATT_OP_POOL_SIZE ? i + 1 : NO_OPERATION;
+    }
+    freeOperations = 0;
+    for (size_t lane = 0; lane < (size_t)GATTPriority::COUNT; lane++) {
+        laneHead[lane] = NO_OPERATION;
+        laneTail[lane] = NO_OPERATION;
+    }
+    
+    for (ConnectionSlot& slot : connectionTable) {
+        slot.rx.expectedSize = 0;
+        slot.rx.receivedSize = 0;
+        slot.rx.startTime = 0;
+        slot.rx.inProgress = false;
+        slot.rx.streaming = false;
+        slot.rx.nextSeq = 0;
+        slot.rx.framesSinceAck = 0;
+        slot.credits = 0;
+        slot.inUse = false;
+    }
+    
+    outgoingTransfer.connId = WIBLE_CONN_ID_ALL;
+    outgoingTransfer.firstFramePayload = 0;
+    outgoingTransfer.framePayload = 0;
+    outgoingTransfer.totalFrames = 0;
+    outgoingTransfer.nextSeq = 0;
+    outgoingTransfer.ackedSeq = 0;
+    outgoingTransfer.startTime = 0;
+    outgoingTransfer.lastAckTime = 0;
+    outgoingTransfer.retries = 0;
+    outgoingTransfer.lastProgress = 0;
+    outgoingTransfer.inProgress = false;
+    
+    memset(&broadcast, 0, sizeof(broadcast));
 }
 
 BLEManager::~BLEManager() {
     cleanup();
+    if (queueMutex) {
+        vSemaphoreDelete(queueMutex);
+    }
+    if (connectionMutex) {
+        vSemaphoreDelete(connectionMutex);
+    }
 }
 
 bool BLEManager::initialize(const BLEConfig& config) {
     this->config = config;
+    if (this->config.maxConnections == 0) this->config.maxConnections = 1;
+    if (this->config.maxConnections > WIBLE_MAX_CONNECTIONS) this->config.maxConnections = WIBLE_MAX_CONNECTIONS;
+    
+    ConnectionParams balanced = { config.connectionInterval, config.connectionInterval,
+                                  config.slaveLatency, config.supervisionTimeout };
+    tuner.configure(config.connectionTuning, balanced);
     
     // Initialize BLE Device
     BLEDevice::init(config.deviceName.c_str());
+    BLEDevice::setMTU(config.mtuSize);
+    
+    // Reassembly buffer is reserved once so incoming transfers never allocate;
+    // further slots reserve theirs when first served
+    connectionTable[0].rx.buffer.reserve(config.maxTransferSize);
+    
+    // Write worker must exist before the first write can arrive
+    if (config.useWriteWorker && !writeWorker) {
+        writeWorkerStopRequested.store(false);
+        writeWorkerRunning.store(true);
+        BaseType_t created = xTaskCreatePinnedToCore(writeWorkerTask, "wible_ble_rx",
+                                                     config.writeWorkerStackSize, this,
+                                                     config.writeWorkerPriority, &writeWorker,
+                                                     WIBLE_WRITE_WORKER_CORE);
+        if (created != pdPASS) {
+            writeWorkerRunning.store(false);
+            writeWorker = nullptr;
+            LogManager::warn("BLE write worker not started, handling writes inline");
+        }
+    }
     
     // Create Server
     bleServer = BLEDevice::createServer();
@@ -52,12 +154,68 @@ bool BLEManager::initialize(const BLEConfig& config) {
     return true;
 }
 
+void BLEManager::loop() {
+    if (!initialized) return;
+    
+    // Status/control first, then transfer frames, then everything else.
+    // Each client is paced by its own free controller buffers, so a slow
+    // link never holds back traffic to the others.
+    refreshSendCredits();
+    uint16_t budget = config.maxNotificationsPerTick;
+    budget -= dispatchOperations(GATTPriority::HIGH, GATTPriority::HIGH, budget);
+    applyTransferEvents();
+    budget -= processOutgoingTransfer(budget);
+    dispatchOperations(GATTPriority::NORMAL, GATTPriority::BULK, budget);
+    
+    if (tuner.isEnabled()) tuneConnections();
+    if (broadcast.pending) pushBroadcast();
+    if (scanner) scanner->loop();
+    if (advertisingSets) advertisingSets->loop();
+}
+
 void BLEManager::cleanup() {
+    stopScanning();
+    stopAdvertisingSets();
+    abortTransfers();
+    clearOperationQueue();
     if (advertisingActive) {
         stopAdvertising();
     }
-    // Note: ESP32 BLE library doesn't have a full de-init, usually we just stop advertising
+    // Leaves the stack running; deinitialize() shuts it down
     initialized = false;
+    
+    stopWriteWorker();
+    while (writeQueue.front()) writeQueue.pop();
+    
+    for (ConnectionSlot& slot : connectionTable) {
+        slot.inUse = false;
+        slot.rx.inProgress = false;
+        slot.info = BLEConnectionInfo();
+        std::vector<uint8_t>().swap(slot.rx.buffer);
+    }
+}
+
+void BLEManager::deinitialize(bool releaseMemory) {
+    if (!bleServer) return;
+    disconnectAll();
+    cleanup();
+    scanner.reset();
+    advertisingSets.reset();
+    provisioningSet = WIBLE_NO_ADV_SET;
+    
+    BLEDevice::deinit(releaseMemory);
+    
+    // The stack owned these; initialize() creates new ones
+    bleServer = nullptr;
+    provisioningService = nullptr;
+    deviceInfoService = nullptr;
+    advertising = nullptr;
+    credentialsChar = nullptr;
+    statusChar = nullptr;
+    controlChar = nullptr;
+    dataChar = nullptr;
+    diagnosticsChar = nullptr;
+    LogManager::info(releaseMemory ? "BLE shut down, controller memory released" : "BLE shut down");
 }
 
 bool BLEManager::initializeServices() {
@@ -95,6 +253,17 @@ bool BLEManager::initializeServices() {
     dataChar->setCallbacks(new CharacteristicCallbacks(this, WIBLE_DATA_CHARACTERISTIC));
     dataChar->addDescriptor(new BLE2902());
     
+#if WIBLE_ENABLE_METRICS
+    // Diagnostics Characteristic (Read), filled with a fresh snapshot per read
+    if (config.enableDiagnostics) {
+        diagnosticsChar = provisioningService->createCharacteristic(
+            WIBLE_DIAGNOSTICS_CHARACTERISTIC,
+            BLECharacteristic::PROPERTY_READ
+        );
+        diagnosticsChar->setCallbacks(new CharacteristicCallbacks(this, WIBLE_DIAGNOSTICS_CHARACTERISTIC));
+    }
+#endif
+    
     provisioningService->start();
     
     // 2. Create Device Info Service (Optional but recommended)
@@ -110,6 +279,13 @@ bool BLEManager::initializeServices() {
 bool BLEManager::startAdvertising() {
     if (!initialized || !advertising) return false;
     
+    if (areAdvertisingSetsRunning()) {
+        if (provisioningSet == WIBLE_NO_ADV_SET) return false;
+        advertisingSets->setEnabled(provisioningSet, true);
+        advertisingActive = true;
+        return true;
+    }
+    
     advertising->start();
     advertisingActive = true;
     LogManager::info("BLE Advertising started");
@@ -117,6 +293,12 @@ bool BLEManager::startAdvertising() {
 }
 
 void BLEManager::stopAdvertising() {
+    if (areAdvertisingSetsRunning()) {
+        // Only the provisioning set; beacon and telemetry sets stay on air
+        if (provisioningSet != WIBLE_NO_ADV_SET) advertisingSets->setEnabled(provisioningSet, false);
+        advertisingActive = false;
+        return;
+    }
     if (advertising) {
         advertising->stop();
     }
@@ -129,236 +311,1780 @@ void BLEManager::stopAdvertising() {
 // ============================================================================
 
 bool BLEManager::notify(const String& uuid, const std::vector<uint8_t>& data) {
-    BLECharacteristic* targetChar = nullptr;
+    return notifyRaw(findCharacteristic(uuid.c_str()), WIBLE_CONN_ID_ALL, data.data(), data.size());
+}
+
+bool BLEManager::notify(uint16_t connId, const String& uuid, const std::vector<uint8_t>& data) {
+    return notifyRaw(findCharacteristic(uuid.c_str()), connId, data.data(), data.size());
+}
+
+BLECharacteristic* BLEManager::findCharacteristic(const char* uuid) const {
+    if (!uuid) return nullptr;
+    if (strcmp(uuid, WIBLE_STATUS_CHARACTERISTIC) == 0) return statusChar;
+    if (strcmp(uuid, WIBLE_DATA_CHARACTERISTIC) == 0) return dataChar;
+    return nullptr;
+}
+
+bool BLEManager::notifyRaw(BLECharacteristic* characteristic, uint16_t connId, const uint8_t* data,
+                           size_t length, bool confirm) {
+    if (!characteristic) return false;
     
-    if (uuid == WIBLE_STATUS_CHARACTERISTIC) targetChar = statusChar;
-    else if (uuid == WIBLE_DATA_CHARACTERISTIC) targetChar = dataChar;
+    // Keep the value readable; the sends below carry their own copy
+    characteristic->setValue((uint8_t*)data, length);
+    if (connId != WIBLE_CONN_ID_ALL) {
+        return sendToClient(characteristic, connId, data, length, confirm);
+    }
     
-    if (targetChar) {
-        targetChar->setValue((uint8_t*)data.data(), data.size());
-        targetChar->notify();
-        return true;
+    // Broadcast to served clients only; queued ones are not part of the session
+    uint16_t connIds[WIBLE_MAX_CONNECTIONS];
+    uint8_t count = 0;
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    for (const ConnectionSlot& slot : connectionTable) {
+        if (slot.inUse && !slot.info.isQueued) connIds[count++] = slot.info.connectionId;
+    }
+    xSemaphoreGive(connectionMutex);
+    bool sent = false;
+    for (uint8_t i = 0; i < count; i++) {
+        sent |= sendToClient(characteristic, connIds[i], data, length, confirm);
     }
-    return false;
+    return sent;
+}
+
+bool BLEManager::sendToClient(BLECharacteristic* characteristic, uint16_t connId, const uint8_t* data,
+                              size_t length, bool confirm) {
+    if (!bleServer || !characteristic) return false;
+    
+    esp_err_t err = esp_ble_gatts_send_indicate(bleServer->getGattsIf(), connId, characteristic->getHandle(),
+                                                (uint16_t)length, (uint8_t*)data, confirm);
+    if (err != ESP_OK) return false;
+    Metrics::increment(MetricCounter::NOTIFICATIONS_SENT);
+    updateStatistics(0, length);
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    ConnectionSlot* slot = findSlot(connId);
+    if (slot) slot->bytesMoved += length;
+    xSemaphoreGive(connectionMutex);
+    return true;
 }
 
 // ============================================================================
-// CALLBACKS
+// MTU
 // ============================================================================
 
-void BLEManager::ServerCallbacks::onConnect(BLEServer* server) {
-    LogManager::info("BLE Client Connected");
-    // In real implementation, we would get the address and update connection info
-    if (manager->connectionCallback) {
-        BLEConnectionInfo info;
-        info.connectedAt = millis();
-        manager->connectionCallback(info);
+bool BLEManager::requestMTU(uint16_t size) {
+    if (size < 23 || size > 517) return false;
+    config.mtuSize = size;
+    BLEDevice::setMTU(size);
+    return true;
+}
+
+uint16_t BLEManager::getMTU() const {
+    // Broadcasts must fit the smallest MTU among served clients
+    uint16_t mtu = 0;
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    for (const ConnectionSlot& slot : connectionTable) {
+        if (!slot.inUse || slot.info.isQueued) continue;
+        if (mtu == 0 || slot.info.mtu < mtu) mtu = slot.info.mtu;
     }
+    xSemaphoreGive(connectionMutex);
+    return mtu ? mtu : 23;
+}
+
+uint16_t BLEManager::getMTU(uint16_t connId) const {
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    const ConnectionSlot* slot = findSlot(connId);
+    uint16_t mtu = slot ? slot->info.mtu : 23;
+    xSemaphoreGive(connectionMutex);
+    return mtu;
+}
+
+uint16_t BLEManager::getMaxPayloadSize() const {
+    return payloadForMTU(getMTU());
+}
+
+uint16_t BLEManager::getMaxPayloadSize(uint16_t connId) const {
+    return payloadForMTU(getMTU(connId));
+}
+
+// ============================================================================
+// CHUNKED DATA TRANSFER
+// ============================================================================
+
+bool BLEManager::isTransferFrame(const uint8_t* data, size_t length) {
+    return length >= WIBLE_FRAME_HEADER_SIZE - 1 &&
+           data[0] >= WIBLE_FRAME_START && data[0] <= WIBLE_FRAME_ABORT;
+}
+
+size_t BLEManager::frameOffset(uint16_t seq) const {
+    if (seq == 0) return 0;
+    return outgoingTransfer.firstFramePayload + (size_t)(seq - 1) * outgoingTransfer.framePayload;
+}
+
+bool BLEManager::sendLargeData(const std::vector<uint8_t>& data,
+                               std::function<void(uint8_t progress)> progressCallback) {
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    ConnectionSlot* slot = findOldestSlot(false);
+    uint16_t connId = slot ? slot->info.connectionId : WIBLE_CONN_ID_ALL;
+    xSemaphoreGive(connectionMutex);
+    if (connId == WIBLE_CONN_ID_ALL) return false;
+    return sendLargeData(connId, data, progressCallback);
 }
 
-void BLEManager::ServerCallbacks::onDisconnect(BLEServer* server) {
-    LogManager::info("BLE Client Disconnected");
-    if (manager->disconnectionCallback) {
-        manager->disconnectionCallback("", 0);
+bool BLEManager::sendLargeData(uint16_t connId, const std::vector<uint8_t>& data,
+                               std::function<void(uint8_t progress)> progressCallback) {
+    if (!initialized || !dataChar || data.empty() || !isConnected(connId)) return false;
+    
+    // Settle ACKs for a transfer that just finished, and drop any stale
+    // ones so they cannot be applied to this transfer
+    applyTransferEvents();
+    if (outgoingTransfer.inProgress) {
+        LogManager::warn("Chunked transfer already in progress");
+        return false;
     }
     
-    // Restart advertising if auto-reconnect or configured to do so
-    if (manager->initialized) {
-        server->startAdvertising();
+    // Frame size is fixed for the whole transfer so any seq maps to an offset
+    uint16_t mtu = getMTU(connId);
+    uint16_t maxPayload = payloadForMTU(mtu);
+    if (maxPayload <= WIBLE_FRAME_START_HEADER_SIZE) return false;
+    
+    OutgoingTransfer& tx = outgoingTransfer;
+    tx.connId = connId;
+    tx.buffer.assign(data.begin(), data.end());
+    tx.firstFramePayload = maxPayload - WIBLE_FRAME_START_HEADER_SIZE;
+    tx.framePayload = maxPayload - WIBLE_FRAME_HEADER_SIZE;
+    
+    size_t remaining = data.size() > tx.firstFramePayload ? data.size() - tx.firstFramePayload : 0;
+    size_t frames = 1 + (remaining + tx.framePayload - 1) / tx.framePayload;
+    if (frames > 0xFFFF) {
+        WIBLE_LOGE("Transfer too large for MTU %u", (unsigned)mtu);
+        tx.buffer.clear();
+        return false;
     }
+    
+    tx.totalFrames = (uint16_t)frames;
+    tx.nextSeq = 0;
+    tx.ackedSeq = 0;
+    tx.startTime = millis();
+    tx.lastAckTime = tx.startTime;
+    tx.retries = 0;
+    tx.lastProgress = 0;
+    tx.progressCallback = progressCallback;
+    tx.inProgress = true;
+    
+    WIBLE_LOGI("Chunked transfer to conn %u: %u bytes in %u frames (MTU %u)",
+               (unsigned)connId, (unsigned)data.size(), (unsigned)tx.totalFrames, (unsigned)mtu);
+    
+    refreshSendCredits();
+    processOutgoingTransfer(config.maxNotificationsPerTick);
+    return true;
 }
 
-void BLEManager::ServerCallbacks::onMtuChanged(BLEServer* server, esp_ble_gatts_cb_param_t* param) {
-    LogManager::info("BLE MTU Changed: " + String(param->mtu.mtu));
-    if (manager->mtuChangeCallback) {
-        manager->mtuChangeCallback(param->mtu.mtu);
+uint16_t BLEManager::processOutgoingTransfer(uint16_t budget) {
+    OutgoingTransfer& tx = outgoingTransfer;
+    if (!tx.inProgress) return 0;
+    
+    // Go-back-N: if the peer stopped acknowledging, resend from the last ACK
+    if (tx.nextSeq != tx.ackedSeq && millis() - tx.lastAckTime > config.chunkAckTimeoutMs) {
+        if (++tx.retries > config.chunkMaxRetries) {
+            WIBLE_LOGE("Chunked transfer timed out");
+            statistics.failedOperations++;
+            abortTransfers(ChunkAbortReason::TIMEOUT);
+            return 0;
+        }
+        statistics.framesRetransmitted += tx.nextSeq - tx.ackedSeq;
+        tx.nextSeq = tx.ackedSeq;
+        tx.lastAckTime = millis();
+    }
+    
+    // Pipeline frames up to the ACK window and the link's credits
+    uint16_t sent = 0;
+    while (sent < budget && tx.nextSeq < tx.totalFrames &&
+           (uint16_t)(tx.nextSeq - tx.ackedSeq) < config.chunkWindowSize &&
+           hasSendCredit(tx.connId)) {
+        if (!sendFrame(tx.nextSeq)) break;
+        consumeSendCredit(tx.connId);
+        tx.nextSeq++;
+        sent++;
     }
+    return sent;
 }
 
-void BLEManager::CharacteristicCallbacks::onWrite(BLECharacteristic* characteristic) {
-    std::string value = characteristic->getValue();
-    std::vector<uint8_t> data(value.begin(), value.end());
-    
-    if (data.empty()) return;
+bool BLEManager::sendFrame(uint16_t seq) {
+    OutgoingTransfer& tx = outgoingTransfer;
+    size_t offset = frameOffset(seq);
+    size_t header = WIBLE_FRAME_HEADER_SIZE;
+    size_t capacity = tx.framePayload;
     
-    LogManager::debug("BLE Write to " + characteristicUUID + ", len: " + String((int)data.size()));
+    frameBuffer[0] = seq == 0 ? WIBLE_FRAME_START : WIBLE_FRAME_DATA;
+    frameBuffer[1] = seq & 0xFF;
+    frameBuffer[2] = (seq >> 8) & 0xFF;
     
-    if (manager->dataReceivedCallback) {
-        manager->dataReceivedCallback(characteristicUUID, data);
+    if (seq == 0) {
+        uint32_t total = tx.buffer.size();
+        frameBuffer[3] = total & 0xFF;
+        frameBuffer[4] = (total >> 8) & 0xFF;
+        frameBuffer[5] = (total >> 16) & 0xFF;
+        frameBuffer[6] = (total >> 24) & 0xFF;
+        header = WIBLE_FRAME_START_HEADER_SIZE;
+        capacity = tx.firstFramePayload;
     }
+    
+    size_t length = tx.buffer.size() - offset;
+    if (length > capacity) length = capacity;
+    memcpy(frameBuffer + header, tx.buffer.data() + offset, length);
+    
+    return sendToClient(dataChar, tx.connId, frameBuffer, header + length, false);
 }
 
-void BLEManager::CharacteristicCallbacks::onRead(BLECharacteristic* characteristic) {
-    // Handle read request if needed
+void BLEManager::sendControlFrame(uint16_t connId, uint8_t type, uint16_t value) {
+    if (!dataChar) return;
+    
+    uint8_t frame[WIBLE_FRAME_HEADER_SIZE];
+    frame[0] = type;
+    frame[1] = value & 0xFF;
+    frame[2] = (value >> 8) & 0xFF;
+    
+    size_t length = type == WIBLE_FRAME_ABORT ? 2 : WIBLE_FRAME_HEADER_SIZE;
+    sendToClient(dataChar, connId, frame, length, false);
 }
 
-void BLEManager::CharacteristicCallbacks::onNotify(BLECharacteristic* characteristic) {
-    // Handle notify confirmation if needed
+void BLEManager::cancelOutgoingTransfer() {
+    OutgoingTransfer& tx = outgoingTransfer;
+    if (!tx.inProgress) return;
+    
+    statistics.transfersAborted++;
+    tx.inProgress = false;
+    tx.buffer.clear();
+    tx.progressCallback = nullptr;
 }
 
-// ============================================================================
-// PLACEHOLDERS
-// ============================================================================
+void BLEManager::handleTransferAck(uint16_t nextSeq) {
+    OutgoingTransfer& tx = outgoingTransfer;
+    if (!tx.inProgress) return;
+    
+    // Ignore stale or bogus ACKs
+    if (nextSeq <= tx.ackedSeq || nextSeq > tx.totalFrames) return;
+    
+    tx.ackedSeq = nextSeq;
+    tx.lastAckTime = millis();
+    tx.retries = 0;
+    
+    // The peer can also NACK by acknowledging less than we sent
+    if (tx.nextSeq < tx.ackedSeq) tx.nextSeq = tx.ackedSeq;
+    
+    size_t acked = tx.ackedSeq >= tx.totalFrames ? tx.buffer.size() : frameOffset(tx.ackedSeq);
+    uint8_t progress = (uint8_t)(acked * 100 / tx.buffer.size());
+    if (progress != tx.lastProgress && tx.progressCallback) {
+        tx.progressCallback(progress);
+    }
+    tx.lastProgress = progress;
+    
+    if (tx.ackedSeq >= tx.totalFrames) {
+        uint32_t elapsed = millis() - tx.startTime;
+        statistics.transfersSent++;
+        statistics.lastTxThroughputBps = elapsed ? (uint32_t)((uint64_t)tx.buffer.size() * 1000 / elapsed)
+                                                 : tx.buffer.size();
+        WIBLE_LOGI("Chunked transfer sent: %u bytes in %u ms (%u B/s)",
+                   (unsigned)tx.buffer.size(), (unsigned)elapsed,
+                   (unsigned)statistics.lastTxThroughputBps);
+        tx.inProgress = false;
+        tx.buffer.clear();
+        tx.progressCallback = nullptr;
+    }
+}
 
-bool BLEManager::isAdvertising() const { return advertisingActive; }
-bool BLEManager::isConnected() const { return bleServer->getConnectedCount() > 0; }
-uint8_t BLEManager::getConnectionCount() const { return bleServer->getConnectedCount(); }
+void BLEManager::postTransferEvent(uint8_t type, uint16_t connId, uint16_t seq) {
+    taskENTER_CRITICAL(&transferEventLock);
+    TransferEvent* event = transferEvents.beginWrite();
+    if (event) {
+        event->type = type;
+        event->connId = connId;
+        event->seq = seq;
+        transferEvents.commitWrite();
+    }
+    taskEXIT_CRITICAL(&transferEventLock);
+    if (!event) WIBLE_LOGW("Transfer event queue full, dropping 0x%02x", (unsigned)type);
+}
 
-void BLEManager::enqueueOperation(const GATTOperation& operation) {
-    if (xSemaphoreTake(queueMutex, portMAX_DELAY)) {
-        operationQueue.push(operation);
-        xSemaphoreGive(queueMutex);
+void BLEManager::applyTransferEvents() {
+    TransferEvent* event;
+    while ((event = transferEvents.front()) != nullptr) {
+        OutgoingTransfer& tx = outgoingTransfer;
+        if (tx.inProgress && tx.connId == event->connId) {
+            if (event->type == WIBLE_FRAME_ACK) {
+                handleTransferAck(event->seq);
+            } else {
+                cancelOutgoingTransfer();
+            }
+        }
+        transferEvents.pop();
     }
 }
 
-void BLEManager::processOperationQueue() {
-    if (processingOperation) {
+void BLEManager::handleIncomingChunk(uint16_t connId, const std::vector<uint8_t>& chunk) {
+    ConnectionSlot* slot = findSlot(connId);
+    if (slot && !slot->info.isQueued) handleIncomingFrame(*slot, chunk.data(), chunk.size());
+}
+
+void BLEManager::handleIncomingFrame(ConnectionSlot& slot, const uint8_t* chunk, size_t length) {
+    if (!isTransferFrame(chunk, length)) return;
+    
+    uint8_t type = chunk[0];
+    uint16_t connId = slot.info.connectionId;
+    applyPendingSink();
+    
+    if (type == WIBLE_FRAME_ABORT) {
+        WIBLE_LOGW("Conn %u aborted chunked transfer, reason %u", (unsigned)connId, (unsigned)chunk[1]);
+        slot.rx.inProgress = false;
+        postTransferEvent(WIBLE_FRAME_ABORT, connId, 0);
+        return;
+    }
+    
+    if (length < WIBLE_FRAME_HEADER_SIZE) return;
+    uint16_t seq = chunk[1] | (chunk[2] << 8);
+    
+    if (type == WIBLE_FRAME_ACK) {
+        postTransferEvent(WIBLE_FRAME_ACK, connId, seq);
+        return;
+    }
+    
+    ChunkedTransfer& rx = slot.rx;
+    const uint8_t* payload = chunk + WIBLE_FRAME_HEADER_SIZE;
+    size_t payloadLength = length - WIBLE_FRAME_HEADER_SIZE;
+    
+    if (type == WIBLE_FRAME_START) {
+        if (length < WIBLE_FRAME_START_HEADER_SIZE || seq != 0) return;
+        
+        uint32_t total = chunk[3] | (chunk[4] << 8) | (chunk[5] << 16) | ((uint32_t)chunk[6] << 24);
+        bool streaming = transferSink && transferSinkConnId == connId;
+        if (total == 0 || (!streaming && total > config.maxTransferSize)) {
+            WIBLE_LOGE("Incoming transfer too large: %u", (unsigned)total);
+            rx.inProgress = false;
+            sendControlFrame(connId, WIBLE_FRAME_ABORT, (uint8_t)ChunkAbortReason::TOO_LARGE);
+            return;
+        }
+        
+        // Capacity was reserved at init, so this never reallocates
+        if (!streaming) rx.buffer.resize(total);
+        rx.streaming = streaming;
+        rx.expectedSize = total;
+        rx.receivedSize = 0;
+        rx.startTime = millis();
+        rx.nextSeq = 0;
+        rx.framesSinceAck = 0;
+        rx.inProgress = true;
+        
+        payload = chunk + WIBLE_FRAME_START_HEADER_SIZE;
+        payloadLength = length - WIBLE_FRAME_START_HEADER_SIZE;
+    } else if (!rx.inProgress) {
+        return;
+    }
+    
+    if (seq != rx.nextSeq) {
+        // Lost frame: tell the sender where to resume
+        sendControlFrame(connId, WIBLE_FRAME_ACK, rx.nextSeq);
+        rx.framesSinceAck = 0;
+        return;
+    }
+    
+    if (rx.receivedSize + payloadLength > rx.expectedSize) {
+        WIBLE_LOGE("Incoming transfer overflow");
+        rx.inProgress = false;
+        sendControlFrame(connId, WIBLE_FRAME_ABORT, (uint8_t)ChunkAbortReason::TOO_LARGE);
         return;
     }
+    
+    if (!rx.streaming) {
+        memcpy(rx.buffer.data() + rx.receivedSize, payload, payloadLength);
+    } else {
+        TransferSinkResult result = transferSink && transferSinkConnId == connId
+            ? transferSink(connId, payload, payloadLength) : TransferSinkResult::REJECTED;
+        if (result == TransferSinkResult::BUSY) {
+            // Same as a lost frame: the sender rewinds to it
+            statistics.framesDeferred++;
+            sendControlFrame(connId, WIBLE_FRAME_ACK, rx.nextSeq);
+            rx.framesSinceAck = 0;
+            return;
+        }
+        if (result != TransferSinkResult::ACCEPTED) {
+            WIBLE_LOGW("Streamed transfer from conn %u rejected", (unsigned)connId);
+            rx.inProgress = false;
+            sendControlFrame(connId, WIBLE_FRAME_ABORT, (uint8_t)ChunkAbortReason::REJECTED);
+            return;
+        }
+    }
+    rx.receivedSize += payloadLength;
+    rx.nextSeq++;
+    rx.framesSinceAck++;
+    
+    bool complete = rx.receivedSize == rx.expectedSize;
+    uint8_t ackEvery = config.chunkWindowSize > 1 ? config.chunkWindowSize / 2 : 1;
+    if (complete || rx.framesSinceAck >= ackEvery) {
+        sendControlFrame(connId, WIBLE_FRAME_ACK, rx.nextSeq);
+        rx.framesSinceAck = 0;
+    }
+    
+    if (complete) {
+        completeIncomingTransfer(slot);
+    }
+}
 
-    if (xSemaphoreTake(queueMutex, 0)) {
-        if (!operationQueue.empty()) {
-            GATTOperation op = operationQueue.front();
-            operationQueue.pop();
-            xSemaphoreGive(queueMutex);
+void BLEManager::completeIncomingTransfer(ConnectionSlot& slot) {
+    ChunkedTransfer& rx = slot.rx;
+    uint32_t elapsed = millis() - rx.startTime;
+    
+    rx.inProgress = false;
+    statistics.transfersReceived++;
+    statistics.lastRxThroughputBps = elapsed ? (uint32_t)((uint64_t)rx.expectedSize * 1000 / elapsed)
+                                             : rx.expectedSize;
+    
+    WIBLE_LOGI("Chunked transfer received from conn %u: %u bytes in %u ms (%u B/s)",
+               (unsigned)slot.info.connectionId, (unsigned)rx.expectedSize, (unsigned)elapsed,
+               (unsigned)statistics.lastRxThroughputBps);
+    
+    // A streamed payload already went to the sink
+    if (dataReceivedCallback && !rx.streaming) {
+        dataReceivedCallback(slot.info.connectionId, WIBLE_DATA_CHARACTERISTIC,
+                             rx.buffer.data(), rx.expectedSize);
+    }
+}
 
-            processingOperation = true;
-            bool success = executeOperation(op);
-            if (!success && op.retryCount < op.maxRetries) {
-                op.retryCount++;
-                enqueueOperation(op);
-            } else if (op.callback) {
-                op.callback(success, std::vector<uint8_t>());
-            }
-            processingOperation = false;
-        } else {
-            xSemaphoreGive(queueMutex);
+void BLEManager::setTransferSink(uint16_t connId, TransferSink sink) {
+    // The write worker may be inside the current sink; it swaps this in
+    // before the next frame
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    pendingSink = sink;
+    pendingSinkConnId = sink ? connId : WIBLE_CONN_ID_ALL;
+    sinkChangePending.store(true);
+    xSemaphoreGive(connectionMutex);
+}
+
+void BLEManager::applyPendingSink() {
+    if (!sinkChangePending.load()) return;
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    transferSink = pendingSink;
+    transferSinkConnId = pendingSinkConnId;
+    pendingSink = nullptr;
+    sinkChangePending.store(false);
+    xSemaphoreGive(connectionMutex);
+}
+
+void BLEManager::abortTransfers(ChunkAbortReason reason) {
+    // Only tell a peer if it is still there to hear it, and only once
+    bool tellPeer = reason != ChunkAbortReason::CANCELLED;
+    uint16_t toldConnId = WIBLE_CONN_ID_ALL;
+    
+    if (outgoingTransfer.inProgress) {
+        cancelOutgoingTransfer();
+        if (tellPeer && isConnected(outgoingTransfer.connId)) {
+            toldConnId = outgoingTransfer.connId;
+            sendControlFrame(toldConnId, WIBLE_FRAME_ABORT, (uint8_t)reason);
+        }
+    }
+    
+    uint16_t connIds[WIBLE_MAX_CONNECTIONS];
+    uint8_t count = 0;
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    for (ConnectionSlot& slot : connectionTable) {
+        if (!slot.rx.inProgress) continue;
+        slot.rx.inProgress = false;
+        if (tellPeer && slot.inUse && slot.info.connectionId != toldConnId) {
+            connIds[count++] = slot.info.connectionId;
         }
     }
+    xSemaphoreGive(connectionMutex);
+    for (uint8_t i = 0; i < count; i++) {
+        sendControlFrame(connIds[i], WIBLE_FRAME_ABORT, (uint8_t)reason);
+    }
 }
 
-void BLEManager::clearOperationQueue() {
-    if (xSemaphoreTake(queueMutex, portMAX_DELAY)) {
-        while (!operationQueue.empty()) {
-            operationQueue.pop();
+std::vector<std::vector<uint8_t>> BLEManager::chunkData(const std::vector<uint8_t>& data, size_t chunkSize) {
+    // Splits `data` into complete frames (headers included) of at most
+    // `chunkSize` bytes; the streaming path builds frames on the fly instead.
+    std::vector<std::vector<uint8_t>> frames;
+    if (data.empty() || chunkSize <= WIBLE_FRAME_START_HEADER_SIZE) return frames;
+    
+    size_t offset = 0;
+    uint16_t seq = 0;
+    while (offset < data.size()) {
+        size_t header = seq == 0 ? WIBLE_FRAME_START_HEADER_SIZE : WIBLE_FRAME_HEADER_SIZE;
+        size_t length = data.size() - offset;
+        if (length > chunkSize - header) length = chunkSize - header;
+        
+        std::vector<uint8_t> frame;
+        frame.reserve(header + length);
+        frame.push_back(seq == 0 ? WIBLE_FRAME_START : WIBLE_FRAME_DATA);
+        frame.push_back(seq & 0xFF);
+        frame.push_back((seq >> 8) & 0xFF);
+        if (seq == 0) {
+            uint32_t total = data.size();
+            for (int i = 0; i < 4; i++) frame.push_back((total >> (8 * i)) & 0xFF);
         }
-        xSemaphoreGive(queueMutex);
+        frame.insert(frame.end(), data.begin() + offset, data.begin() + offset + length);
+        frames.push_back(frame);
+        
+        offset += length;
+        seq++;
     }
+    return frames;
 }
 
-bool BLEManager::executeOperation(const GATTOperation& operation) {
-    // Basic implementation for write/notify operations
-    if (operation.type == GATTOperationType::NOTIFY) {
-        return notify(operation.characteristicUUID, operation.data);
-    }
-    return true; // Placeholder for other types
+void BLEManager::updateStatistics(uint32_t bytesReceived, uint32_t bytesSent) {
+    statistics.totalBytesReceived += bytesReceived;
+    statistics.totalBytesSent += bytesSent;
 }
 
-void BLEManager::onConnection(BLEConnectionCallback callback) { connectionCallback = callback; }
-void BLEManager::setScanCallback(BLEScanCallback callback) {
-    scanCallback = callback;
+void BLEManager::dumpStatistics() const {
+    LogManager::info("=== BLE Statistics ===");
+    LogManager::info("Connections: " + String((int)statistics.totalConnections) +
+                     ", Disconnections: " + String((int)statistics.totalDisconnections) +
+                     ", Queued: " + String((int)statistics.connectionsQueued) +
+                     ", Rejected: " + String((int)statistics.connectionsRejected));
+    LogManager::info("Bytes RX: " + String((int)statistics.totalBytesReceived) +
+                     ", TX: " + String((int)statistics.totalBytesSent));
+    LogManager::info("Transfers RX: " + String((int)statistics.transfersReceived) +
+                     ", TX: " + String((int)statistics.transfersSent) +
+                     ", Aborted: " + String((int)statistics.transfersAborted) +
+                     ", Retransmits: " + String((int)statistics.framesRetransmitted));
+    LogManager::info("Last throughput RX: " + String((int)statistics.lastRxThroughputBps) +
+                     " B/s, TX: " + String((int)statistics.lastTxThroughputBps) + " B/s");
+    LogManager::info("Write queue: " + String((int)writeQueue.size()) + " queued, high water " +
+                     String((int)statistics.writeQueueHighWater) + ", dropped " +
+                     String((int)statistics.writesDropped));
+    LogManager::info("Write latency avg: " + String((int)statistics.writeLatencyAvgUs) +
+                     " us, max: " + String((int)statistics.writeLatencyMaxUs) + " us");
+    LogManager::info("Operations queued: " + String((int)queuedOperations) + ", high water " +
+                     String((int)statistics.operationQueueHighWater) + ", retried " +
+                     String((int)statistics.operationsRetried) + ", dropped " +
+                     String((int)statistics.operationsDropped));
+    String histogram = "Operation latency (ms):";
+    for (size_t i = 0; i < WIBLE_GATT_LATENCY_BUCKETS; i++) {
+        histogram += i < WIBLE_GATT_LATENCY_BUCKETS - 1
+            ? " <" + String((int)LATENCY_BUCKET_LIMITS_MS[i])
+            : String(" >=") + String((int)LATENCY_BUCKET_LIMITS_MS[i - 1]);
+        histogram += ":" + String((int)statistics.operationLatencyHistogram[i]);
+    }
+    LogManager::info(histogram);
+    LogManager::info("Failed operations: " + String((int)statistics.failedOperations));
 }
 
 // ============================================================================
-// BEACON MODE
+// WRITE WORKER
 // ============================================================================
 
-void BLEManager::startBeacon(String uuid, uint16_t major, uint16_t minor, int8_t rssiAt1m) {
-    if (!initialized || !advertising) return;
+bool BLEManager::enqueueWrite(uint16_t connId, const String* uuid, const uint8_t* data, size_t length) {
+    // The last slots are kept for connects, disconnects and MTU changes
+    WriteSlot* slot = writeQueue.size() < WIBLE_WRITE_QUEUE_DEPTH - 3 * WIBLE_MAX_CONNECTIONS
+        ? writeQueue.beginWrite() : nullptr;
+    if (!slot || length > WIBLE_WRITE_SLOT_SIZE) {
+        // Chunk frames recover through the ACK window; plain writes are lost
+        statistics.writesDropped++;
+        return false;
+    }
+    
+    slot->characteristicUUID = uuid;
+    slot->event = LinkEvent::WRITE;
+    slot->connId = connId;
+    slot->length = (uint16_t)length;
+    slot->enqueuedAtUs = esp_timer_get_time();
+    memcpy(slot->data, data, length);
+    writeQueue.commitWrite();
+    
+    statistics.writesQueued++;
+    uint32_t depth = writeQueue.size();
+    if (depth > statistics.writeQueueHighWater) statistics.writeQueueHighWater = depth;
+    return true;
+}
 
-    stopAdvertising(); // Stop any existing advertising
+bool BLEManager::enqueueLinkEvent(LinkEvent event, uint16_t connId, const uint8_t* data, size_t length) {
+    WriteSlot* slot = writeQueue.beginWrite();
+    if (!slot) return false;
+    
+    slot->characteristicUUID = nullptr;
+    slot->event = event;
+    slot->connId = connId;
+    slot->length = (uint16_t)length;
+    slot->enqueuedAtUs = esp_timer_get_time();
+    memcpy(slot->data, data, length);
+    writeQueue.commitWrite();
+    return true;
+}
+
+void BLEManager::postLinkEvent(LinkEvent event, uint16_t connId, const uint8_t* data, size_t length) {
+    if (!writeWorker) {
+        handleLinkEvent(event, connId, data);
+        return;
+    }
+    if (enqueueLinkEvent(event, connId, data, length)) {
+        xTaskNotifyGive(writeWorker);
+        return;
+    }
+    // Never handled here: the connection table belongs to the worker
+    statistics.linkEventsDropped++;
+    WIBLE_LOGE("Write queue full, link event %u for conn %u lost", (unsigned)event, (unsigned)connId);
+}
+
+void BLEManager::handleLinkEvent(LinkEvent event, uint16_t connId, const uint8_t* data) {
+    switch (event) {
+        case LinkEvent::CONNECT:    handleConnection(connId, data); break;
+        case LinkEvent::DISCONNECT: handleDisconnection(connId, data[0]); break;
+        case LinkEvent::MTU:        handleMtuChange(connId, (uint16_t)(data[0] | (data[1] << 8))); break;
+        default: break;
+    }
+}
 
-    BLEAdvertisementData oAdvertisementData = BLEAdvertisementData();
-    BLEAdvertisementData oScanResponseData = BLEAdvertisementData();
+void BLEManager::writeWorkerTask(void* param) {
+    BLEManager* manager = static_cast<BLEManager*>(param);
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (manager->writeWorkerStopRequested.load()) break;
+        manager->drainWriteQueue();
+    }
     
-    // iBeacon Flag (0x020106)
-    oAdvertisementData.setFlags(0x04); // BR_EDR_NOT_SUPPORTED 0x04
+    manager->writeWorkerRunning.store(false);
+    vTaskDelete(nullptr);
+}
+
+void BLEManager::stopWriteWorker() {
+    // Callbacks from here on are handled inline
+    TaskHandle_t worker = writeWorker;
+    writeWorker = nullptr;
+    if (worker && writeWorkerRunning.load()) {
+        writeWorkerStopRequested.store(true);
+        xTaskNotifyGive(worker);
+        // The write being handled finishes first; the task deletes itself
+        while (writeWorkerRunning.load()) vTaskDelay(pdMS_TO_TICKS(5));
+    }
+}
+
+void BLEManager::drainWriteQueue() {
+    WriteSlot* slot;
+    while ((slot = writeQueue.front()) != nullptr) {
+        if (slot->event != LinkEvent::WRITE) {
+            // Connection changes land here so they never race a write being handled
+            LinkEvent event = slot->event;
+            uint16_t connId = slot->connId;
+            uint8_t data[6];
+            memcpy(data, slot->data, sizeof(data));
+            writeQueue.pop();
+            handleLinkEvent(event, connId, data);
+            continue;
+        }
+        handleCharacteristicWrite(slot->connId, *slot->characteristicUUID, slot->data, slot->length);
+        
+        uint32_t latency = (uint32_t)(esp_timer_get_time() - slot->enqueuedAtUs);
+        writeQueue.pop();
+        
+        statistics.writesHandled++;
+        Metrics::observe(MetricHistogram::WRITE_LATENCY_US, latency);
+        if (latency > statistics.writeLatencyMaxUs) statistics.writeLatencyMaxUs = latency;
+        statistics.writeLatencyAvgUs = statistics.writesHandled == 1
+            ? latency
+            : statistics.writeLatencyAvgUs - (statistics.writeLatencyAvgUs >> 3) + (latency >> 3);
+    }
+}
+
+void BLEManager::handleCharacteristicWrite(uint16_t connId, const String& uuid, uint8_t* data, size_t length) {
+    // Gone by the time the worker got to it, or still waiting in the queue
+    ConnectionSlot* slot = findSlot(connId);
+    if (!slot || slot->info.isQueued) {
+        WIBLE_LOGD("Ignoring write from conn %u", (unsigned)connId);
+        return;
+    }
+    // Loop-side notifies count into bytesMoved too
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    slot->info.lastActivityAt = millis();
+    slot->bytesMoved += length;
+    xSemaphoreGive(connectionMutex);
+    Metrics::increment(MetricCounter::WRITES_RECEIVED);
     
-    // Construct iBeacon Payload
-    // Format: [Len] [Type] [CompanyID(2)] [BeaconType(2)] [ProximityUUID(16)] [Major(2)] [Minor(2)] [TxPower(1)]
-    // Total Manufacturer Data Length: 25 bytes
+    if (uuid == WIBLE_DATA_CHARACTERISTIC && isTransferFrame(data, length)) {
+        handleIncomingFrame(*slot, data, length);
+        return;
+    }
     
-    std::string mfgData;
-    mfgData += (char)0x4C; mfgData += (char)0x00; // Apple Company ID (0x004C)
-    mfgData += (char)0x02; mfgData += (char)0x15; // iBeacon Type (0x02, 0x15)
+    if (dataReceivedCallback) {
+        dataReceivedCallback(connId, uuid, data, length);
+    }
+}
+
+// ============================================================================
+// CALLBACKS
+// ============================================================================
+
+void BLEManager::ServerCallbacks::onConnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) {
+    // Links we opened as central (group provisioning) are not clients
+    if (param->connect.link_role == 0) return;
+    manager->postLinkEvent(LinkEvent::CONNECT, param->connect.conn_id, param->connect.remote_bda, 6);
+}
+
+void BLEManager::ServerCallbacks::onDisconnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) {
+    // Behind any writes still queued from this link
+    uint8_t reason = (uint8_t)param->disconnect.reason;
+    manager->postLinkEvent(LinkEvent::DISCONNECT, param->disconnect.conn_id, &reason, 1);
+}
+
+void BLEManager::ServerCallbacks::onMtuChanged(BLEServer* server, esp_ble_gatts_cb_param_t* param) {
+    uint8_t mtu[2] = { (uint8_t)param->mtu.mtu, (uint8_t)(param->mtu.mtu >> 8) };
+    manager->postLinkEvent(LinkEvent::MTU, param->mtu.conn_id, mtu, sizeof(mtu));
+}
+
+void BLEManager::CharacteristicCallbacks::onWrite(BLECharacteristic* characteristic, esp_ble_gatts_cb_param_t* param) {
+    // Runs on the Bluedroid task: copy once and get out
+    uint8_t* data = characteristic->getData();
+    size_t length = characteristic->getLength();
+    if (!data || length == 0) return;
     
-    // UUID (Need to parse string to bytes)
-    // For simplicity in this implementation, we'll assume a fixed UUID or parse it manually
-    // A real implementation would use a UUID parser. 
-    // Let's use a dummy UUID for now if parsing is complex, or try basic parsing.
-    // Actually, BLEUUID class can parse it.
-    BLEUUID bleUUID(uuid.c_str());
-    esp_bt_uuid_t rawUUID = *bleUUID.getNative();
+    manager->updateStatistics(length, 0);
     
-    // Check if it's 128-bit
-    if (rawUUID.len == 16) {
-        for(int i=0; i<16; i++) mfgData += (char)rawUUID.uuid.uuid128[i];
-    } else {
-        // Fallback or error
-        LogManager::error("Invalid Beacon UUID length");
+    uint16_t connId = param->write.conn_id;
+    if (!manager->writeWorker) {
+        manager->handleCharacteristicWrite(connId, characteristicUUID, data, length);
         return;
     }
-
-    mfgData += (char)((major >> 8) & 0xFF);
-    mfgData += (char)(major & 0xFF);
     
-    mfgData += (char)((minor >> 8) & 0xFF);
-    mfgData += (char)(minor & 0xFF);
+    if (manager->enqueueWrite(connId, &characteristicUUID, data, length)) {
+        xTaskNotifyGive(manager->writeWorker);
+    }
+}
+
+void BLEManager::CharacteristicCallbacks::onRead(BLECharacteristic* characteristic) {
+#if WIBLE_ENABLE_METRICS
+    if (characteristic != manager->diagnosticsChar) return;
+    uint8_t snapshot[WIBLE_METRICS_SNAPSHOT_SIZE];
+    size_t length = Metrics::snapshot(snapshot, sizeof(snapshot));
+    characteristic->setValue(snapshot, length);
+#endif
+}
+
+void BLEManager::CharacteristicCallbacks::onNotify(BLECharacteristic* characteristic) {
+    // Handle notify confirmation if needed
+}
+
+// ============================================================================
+// CONNECTION TABLE
+// ============================================================================
+
+void BLEManager::handleConnection(uint16_t connId, const uint8_t* address) {
+    statistics.totalConnections++;
     
-    mfgData += (char)rssiAt1m;
+    // Serve it if there is room, otherwise park it in a spare slot
+    bool serve = countSlots(false) < config.maxConnections;
+    ConnectionSlot* slot = nullptr;
+    if (serve || config.enableConnectionQueue) {
+        xSemaphoreTake(connectionMutex, portMAX_DELAY);
+        for (uint8_t i = 0; i < WIBLE_MAX_CONNECTIONS && !slot; i++) {
+            if (connectionTable[i].inUse) continue;
+            slot = &connectionTable[i];
+            slot->info = BLEConnectionInfo();
+            slot->info.clientAddress = BLEUtils::addressToString(address);
+            slot->info.connectionId = connId;
+            slot->info.connectedAt = millis();
+            slot->info.lastActivityAt = slot->info.connectedAt;
+            slot->info.isQueued = true;
+            slot->info.slot = i;
+            slot->rx.inProgress = false;
+            slot->credits = 0;
+            slot->bytesMoved = 0;
+            memcpy(slot->address, address, sizeof(slot->address));
+            slot->inUse = true;
+        }
+        xSemaphoreGive(connectionMutex);
+    }
     
-    oAdvertisementData.setManufacturerData(mfgData);
+    if (!slot) {
+        WIBLE_LOGW("No connection slot for conn %u, disconnecting", (unsigned)connId);
+        statistics.connectionsRejected++;
+        if (bleServer) bleServer->disconnect(connId);
+        return;
+    }
     
-    advertising->setAdvertisementData(oAdvertisementData);
-    advertising->setScanResponseData(oScanResponseData);
+    if (serve) {
+        serveConnection(*slot);
+    } else {
+        statistics.connectionsQueued++;
+        WIBLE_LOGI("BLE client %s queued (conn %u, %u waiting)", slot->info.clientAddress.c_str(),
+                   (unsigned)connId, (unsigned)countSlots(true));
+        BLEConnectionInfo info = slot->info;
+        if (connectionCallback) connectionCallback(info);
+    }
     
-    advertising->start();
-    advertisingActive = true;
-    LogManager::info("iBeacon started");
+    resumeAdvertising();
 }
 
-void BLEManager::setManufacturerData(uint16_t companyId, uint8_t* data, size_t length) {
-    if (!advertising) return;
+void BLEManager::serveConnection(ConnectionSlot& slot) {
+    // One-time allocation per slot; a single-client device reserved at init
+    if (slot.rx.buffer.capacity() < config.maxTransferSize) {
+        slot.rx.buffer.reserve(config.maxTransferSize);
+    }
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    slot.info.isQueued = false;
+    xSemaphoreGive(connectionMutex);
     
-    std::string mfgData;
-    mfgData += (char)(companyId & 0xFF);
-    mfgData += (char)((companyId >> 8) & 0xFF);
+    WIBLE_LOGI("BLE client %s connected (conn %u, slot %u)", slot.info.clientAddress.c_str(),
+               (unsigned)slot.info.connectionId, (unsigned)slot.info.slot);
     
-    for(size_t i=0; i<length; i++) {
-        mfgData += (char)data[i];
-    }
+    // Start every link on the configured parameters
+    tuner.attach(slot.info.slot, millis());
+    requestConnectionParams(slot, tuner.paramsFor(LinkProfile::BALANCED));
     
-    BLEAdvertisementData oAdvertisementData = BLEAdvertisementData();
-    oAdvertisementData.setFlags(0x04);
-    oAdvertisementData.setManufacturerData(mfgData);
-    advertising->setAdvertisementData(oAdvertisementData);
+    // Copy: the callback may disconnect and recycle the slot
+    BLEConnectionInfo info = slot.info;
+    if (connectionCallback) connectionCallback(info);
 }
 
-void BLEManager::startBroadcasting(uint16_t manufacturerId, const uint8_t* data, size_t length) {
-    if (!initialized || !advertising) return;
-
-    stopAdvertising();
-
-    BLEAdvertisementData oAdvertisementData = BLEAdvertisementData();
+void BLEManager::handleDisconnection(uint16_t connId, uint8_t reason) {
+    statistics.totalDisconnections++;
+    
+    ConnectionSlot* slot = findSlot(connId);
+    if (!slot) return;  // Rejected while the table was full
     
-    oAdvertisementData.setFlags(0x04); // BR_EDR_NOT_SUPPORTED
+    postTransferEvent(WIBLE_FRAME_ABORT, connId, 0);
+    tuner.detach(slot->info.slot);
     
-    std::string mfgData;
-    mfgData += (char)(manufacturerId & 0xFF);
-    mfgData += (char)((manufacturerId >> 8) & 0xFF);
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    BLEConnectionInfo info = slot->info;
+    slot->rx.inProgress = false;
+    slot->info = BLEConnectionInfo();
+    slot->inUse = false;
+    xSemaphoreGive(connectionMutex);
     
-    for(size_t i=0; i<length; i++) {
-        mfgData += (char)data[i];
+    WIBLE_LOGI("BLE client %s disconnected (conn %u, reason 0x%02x)", info.clientAddress.c_str(),
+               (unsigned)connId, (unsigned)reason);
+    if (disconnectionCallback) {
+        disconnectionCallback(info, reason);
     }
     
-    oAdvertisementData.setManufacturerData(mfgData);
-    advertising->setAdvertisementData(oAdvertisementData);
+    // The longest-waiting client takes over the freed slot
+    if (!info.isQueued) {
+        ConnectionSlot* next = findOldestSlot(true);
+        if (next) serveConnection(*next);
+    }
     
-    advertising->start();
-    advertisingActive = true;
-    LogManager::info("Broadcasting started");
+    resumeAdvertising();
+}
+
+void BLEManager::handleMtuChange(uint16_t connId, uint16_t mtu) {
+    WIBLE_LOGI("BLE MTU Changed: conn %u, %u", (unsigned)connId, (unsigned)mtu);
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    ConnectionSlot* slot = findSlot(connId);
+    if (slot) slot->info.mtu = mtu;
+    xSemaphoreGive(connectionMutex);
+    if (mtuChangeCallback) {
+        mtuChangeCallback(mtu);
+    }
+}
+
+void BLEManager::resumeAdvertising() {
+    // Bluedroid stops advertising when a client connects. Only come back if
+    // the application still wants to be discoverable and a slot is free.
+    if (!initialized || !advertisingActive || !advertising) return;
+    
+    uint8_t capacity = config.enableConnectionQueue ? WIBLE_MAX_CONNECTIONS : config.maxConnections;
+    bool slotFree = countSlots(false) + countSlots(true) < capacity;
+    if (areAdvertisingSetsRunning()) {
+        // The other sets keep advertising while the table is full
+        if (!slotFree) {
+            advertisingSets->setEnabled(provisioningSet, false);
+        } else if (advertisingSets->isEnabled(provisioningSet)) {
+            advertisingSets->resume(provisioningSet);
+        } else {
+            advertisingSets->setEnabled(provisioningSet, true);
+        }
+        return;
+    }
+    if (slotFree) {
+        advertising->start();
+    }
+}
+
+// ============================================================================
+// CONNECTION TUNING
+// ============================================================================
+
+void BLEManager::tuneConnections() {
+    uint32_t now = millis();
+    uint16_t queued = queuedOperations;
+    
+    // The parameter requests below only post to the BLE stack
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    for (ConnectionSlot& slot : connectionTable) {
+        if (!slot.inUse || slot.info.isQueued) continue;
+        
+        LinkSample sample;
+        sample.bytes = slot.bytesMoved;
+        sample.queueDepth = queued;
+        sample.transferActive = slot.rx.inProgress ||
+            (outgoingTransfer.inProgress && outgoingTransfer.connId == slot.info.connectionId);
+        
+        LinkProfile next;
+        bool change = tuner.sample(slot.info.slot, sample, now, next);
+        slot.info.throughputBps = tuner.getStats(slot.info.slot).throughputBps;
+        if (change) applyLinkProfile(slot, next);
+    }
+    xSemaphoreGive(connectionMutex);
+}
+
+void BLEManager::applyLinkProfile(ConnectionSlot& slot, LinkProfile profile) {
+    if (!requestConnectionParams(slot, tuner.paramsFor(profile))) return;
+    tuner.switched(slot.info.slot, profile, millis());
+    slot.info.linkProfile = profile;
+    if (profile != LinkProfile::BURST) return;
+    
+    statistics.burstSwitches++;
+    if (!tuner.needsLinkUpgrade(slot.info.slot)) return;
+    
+    // Both stay in place for the rest of the connection
+    const ConnectionTuningConfig& tuning = tuner.getConfig();
+    if (tuning.requestDataLength &&
+        esp_ble_gap_set_pkt_data_len(slot.address, WIBLE_BLE_DLE_TX_OCTETS) == ESP_OK) {
+        statistics.dataLengthRequests++;
+    }
+#if WIBLE_BLE_2M_PHY
+    if (tuning.request2MPhy &&
+        esp_ble_gap_set_prefered_phy(slot.address, 0, ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                     ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF) == ESP_OK) {
+        statistics.phyRequests++;
+    }
+#endif
+    tuner.markLinkUpgraded(slot.info.slot);
+}
+
+bool BLEManager::requestConnectionParams(ConnectionSlot& slot, const ConnectionParams& params) {
+    esp_ble_conn_update_params_t request = {};
+    memcpy(request.bda, slot.address, sizeof(request.bda));
+    request.min_int = params.minInterval;
+    request.max_int = params.maxInterval;
+    request.latency = params.latency;
+    request.timeout = params.timeout;
+    
+    if (esp_ble_gap_update_conn_params(&request) != ESP_OK) {
+        statistics.connectionParamFailures++;
+        WIBLE_LOGW("Connection parameter request failed (conn %u)", (unsigned)slot.info.connectionId);
+        return false;
+    }
+    statistics.connectionParamUpdates++;
+    slot.info.connectionInterval = params.maxInterval;
+    return true;
+}
+
+bool BLEManager::updateConnectionParameters(uint16_t minInterval, uint16_t maxInterval,
+                                            uint16_t latency, uint16_t timeout) {
+    // Valid ranges from the Core spec: 7.5 ms - 4 s, latency < 500, 100 ms - 32 s
+    if (minInterval < 6 || maxInterval > 3200 || minInterval > maxInterval ||
+        latency > 499 || timeout < 10 || timeout > 3200) {
+        return false;
+    }
+    
+    config.connectionInterval = maxInterval;
+    config.slaveLatency = latency;
+    config.supervisionTimeout = timeout;
+    ConnectionParams params = { minInterval, maxInterval, latency, timeout };
+    tuner.setBalancedParams(params);
+    
+    bool ok = true;
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    for (ConnectionSlot& slot : connectionTable) {
+        if (!slot.inUse || slot.info.isQueued) continue;
+        if (slot.info.linkProfile != LinkProfile::BALANCED && tuner.isEnabled()) continue;
+        ok = requestConnectionParams(slot, params) && ok;
+    }
+    xSemaphoreGive(connectionMutex);
+    return ok;
+}
+
+void BLEManager::setConnectionTuning(const ConnectionTuningConfig& tuning) {
+    config.connectionTuning = tuning;
+    tuner.configure(tuning, tuner.paramsFor(LinkProfile::BALANCED));
+}
+
+LinkTuningStats BLEManager::getLinkTuning(uint16_t connId) const {
+    uint8_t index = getConnectionSlot(connId);
+    return index != WIBLE_NO_SLOT ? tuner.getStats(index) : LinkTuningStats();
+}
+
+// Callers hold connectionMutex, or are the write worker and only read
+BLEManager::ConnectionSlot* BLEManager::findSlot(uint16_t connId) {
+    for (ConnectionSlot& slot : connectionTable) {
+        if (slot.inUse && slot.info.connectionId == connId) return &slot;
+    }
+    return nullptr;
+}
+
+const BLEManager::ConnectionSlot* BLEManager::findSlot(uint16_t connId) const {
+    for (const ConnectionSlot& slot : connectionTable) {
+        if (slot.inUse && slot.info.connectionId == connId) return &slot;
+    }
+    return nullptr;
+}
+
+BLEManager::ConnectionSlot* BLEManager::findOldestSlot(bool queued) {
+    ConnectionSlot* oldest = nullptr;
+    uint32_t now = millis();
+    for (ConnectionSlot& slot : connectionTable) {
+        if (!slot.inUse || slot.info.isQueued != queued) continue;
+        if (!oldest || now - slot.info.connectedAt > now - oldest->info.connectedAt) oldest = &slot;
+    }
+    return oldest;
+}
+
+uint8_t BLEManager::countSlots(bool queued) const {
+    uint8_t count = 0;
+    for (const ConnectionSlot& slot : connectionTable) {
+        if (slot.inUse && slot.info.isQueued == queued) count++;
+    }
+    return count;
+}
+
+uint8_t BLEManager::countSlotsLocked(bool queued) const {
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    uint8_t count = countSlots(queued);
+    xSemaphoreGive(connectionMutex);
+    return count;
+}
+
+bool BLEManager::isConnected() const { return countSlotsLocked(false) > 0; }
+uint8_t BLEManager::getConnectionCount() const { return countSlotsLocked(false); }
+uint8_t BLEManager::getQueuedCount() const { return countSlotsLocked(true); }
+
+bool BLEManager::isConnected(uint16_t connId) const {
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    const ConnectionSlot* slot = findSlot(connId);
+    bool connected = slot && !slot->info.isQueued;
+    xSemaphoreGive(connectionMutex);
+    return connected;
+}
+
+BLEConnectionInfo BLEManager::getConnectionInfo(const String& address) const {
+    // Copied under the lock: the worker may be recycling the slot
+    BLEConnectionInfo info;
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    for (const ConnectionSlot& slot : connectionTable) {
+        if (slot.inUse && slot.info.clientAddress == address) {
+            info = slot.info;
+            break;
+        }
+    }
+    xSemaphoreGive(connectionMutex);
+    return info;
+}
+
+BLEConnectionInfo BLEManager::getConnectionInfo(uint16_t connId) const {
+    BLEConnectionInfo info;
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    const ConnectionSlot* slot = findSlot(connId);
+    if (slot) info = slot->info;
+    xSemaphoreGive(connectionMutex);
+    return info;
+}
+
+uint8_t BLEManager::getConnectionSlot(uint16_t connId) const {
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    const ConnectionSlot* slot = findSlot(connId);
+    uint8_t index = slot ? slot->info.slot : WIBLE_NO_SLOT;
+    xSemaphoreGive(connectionMutex);
+    return index;
+}
+
+void BLEManager::setAuthenticated(uint16_t connId, bool authenticated) {
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    ConnectionSlot* slot = findSlot(connId);
+    if (slot) slot->info.isAuthenticated = authenticated;
+    xSemaphoreGive(connectionMutex);
+}
+
+bool BLEManager::isAuthenticated(uint16_t connId) const {
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    const ConnectionSlot* slot = findSlot(connId);
+    bool authenticated = slot && slot->info.isAuthenticated;
+    xSemaphoreGive(connectionMutex);
+    return authenticated;
+}
+
+std::vector<String> BLEManager::getConnectedClients() const {
+    std::vector<String> clients;
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    for (const ConnectionSlot& slot : connectionTable) {
+        if (slot.inUse) clients.push_back(slot.info.clientAddress);
+    }
+    xSemaphoreGive(connectionMutex);
+    return clients;
+}
+
+void BLEManager::disconnect(const String& address) {
+    uint16_t connId = WIBLE_CONN_ID_ALL;
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    for (const ConnectionSlot& slot : connectionTable) {
+        if (slot.inUse && slot.info.clientAddress == address) {
+            connId = slot.info.connectionId;
+            break;
+        }
+    }
+    xSemaphoreGive(connectionMutex);
+    if (connId != WIBLE_CONN_ID_ALL) disconnect(connId);
+}
+
+void BLEManager::disconnect(uint16_t connId) {
+    if (bleServer) bleServer->disconnect(connId);
+}
+
+void BLEManager::disconnectAll() {
+    // Collect first: the disconnect event may recycle slots as we go
+    uint16_t connIds[WIBLE_MAX_CONNECTIONS];
+    uint8_t count = 0;
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    for (const ConnectionSlot& slot : connectionTable) {
+        if (slot.inUse) connIds[count++] = slot.info.connectionId;
+    }
+    xSemaphoreGive(connectionMutex);
+    for (uint8_t i = 0; i < count; i++) disconnect(connIds[i]);
+}
+
+// ============================================================================
+// PLACEHOLDERS
+// ============================================================================
+
+bool BLEManager::isAdvertising() const { return advertisingActive; }
+
+// ============================================================================
+// OPERATION SCHEDULER
+// ============================================================================
+
+bool BLEManager::enqueueOperation(const GATTOperation& operation) {
+    if (operation.length > WIBLE_GATT_OP_MAX_DATA || operation.priority >= GATTPriority::COUNT) {
+        statistics.operationsDropped++;
+        return false;
+    }
+    
+    if (!xSemaphoreTake(queueMutex, portMAX_DELAY)) return false;
+    
+    uint8_t index = freeOperations;
+    if (index == NO_OPERATION) {
+        xSemaphoreGive(queueMutex);
+        statistics.operationsDropped++;
+        WIBLE_LOGW("GATT operation pool full");
+        return false;
+    }
+    freeOperations = operationNext[index];
+    
+    GATTOperation& op = operationPool[index];
+    op = operation;
+    op.timestamp = millis();
+    op.notBefore = 0;
+    op.retryCount = 0;
+    
+    size_t lane = (size_t)op.priority;
+    operationNext[index] = NO_OPERATION;
+    if (laneTail[lane] == NO_OPERATION) {
+        laneHead[lane] = index;
+    } else {
+        operationNext[laneTail[lane]] = index;
+    }
+    laneTail[lane] = index;
+    
+    queuedOperations++;
+    if (queuedOperations > statistics.operationQueueHighWater) {
+        statistics.operationQueueHighWater = queuedOperations;
+    }
+    xSemaphoreGive(queueMutex);
+    return true;
+}
+
+bool BLEManager::enqueueNotify(const char* uuid, const uint8_t* data, size_t length,
+                               GATTPriority priority, GATTOperationCallback callback, void* context,
+                               uint16_t connId) {
+    GATTOperation op;
+    op.type = GATTOperationType::NOTIFY;
+    op.priority = priority;
+    op.characteristicUUID = uuid;
+    op.connId = connId;
+    op.callback = callback;
+    op.callbackContext = context;
+    if (!op.setData(data, length)) {
+        statistics.operationsDropped++;
+        return false;
+    }
+    return enqueueOperation(op);
+}
+
+void BLEManager::processOperationQueue() {
+    refreshSendCredits();
+    dispatchOperations(GATTPriority::HIGH, GATTPriority::BULK, config.maxNotificationsPerTick);
+}
+
+void BLEManager::refreshSendCredits() {
+    // Free ACL buffers in the controller, per link; notifying beyond this
+    // only queues in the host stack and delays everything behind it
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    for (ConnectionSlot& slot : connectionTable) {
+        slot.credits = 0;
+        if (!slot.inUse || slot.info.isQueued) continue;
+        uint16_t credits = esp_ble_get_cur_sendable_packets_num(slot.info.connectionId);
+        slot.credits = credits < config.maxNotificationsPerTick ? credits : config.maxNotificationsPerTick;
+    }
+    xSemaphoreGive(connectionMutex);
+}
+
+bool BLEManager::hasSendCredit(uint16_t connId) const {
+    // Called with queueMutex held; connectionMutex is always taken second
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    bool ready;
+    if (connId != WIBLE_CONN_ID_ALL) {
+        const ConnectionSlot* slot = findSlot(connId);
+        ready = slot && !slot->info.isQueued && slot->credits > 0;
+    } else {
+        // A broadcast goes out at the pace of the slowest served client
+        bool any = false;
+        bool starved = false;
+        for (const ConnectionSlot& slot : connectionTable) {
+            if (!slot.inUse || slot.info.isQueued) continue;
+            if (slot.credits == 0) starved = true;
+            any = true;
+        }
+        ready = any && !starved;
+    }
+    xSemaphoreGive(connectionMutex);
+    return ready;
+}
+
+void BLEManager::consumeSendCredit(uint16_t connId) {
+    xSemaphoreTake(connectionMutex, portMAX_DELAY);
+    for (ConnectionSlot& slot : connectionTable) {
+        if (!slot.inUse || slot.info.isQueued || slot.credits == 0) continue;
+        if (connId == WIBLE_CONN_ID_ALL || slot.info.connectionId == connId) slot.credits--;
+    }
+    xSemaphoreGive(connectionMutex);
+}
+
+uint8_t BLEManager::takeReadyOperation(GATTPriority first, GATTPriority last, uint32_t now) {
+    // Caller holds queueMutex. An operation that is backing off or whose
+    // client is out of credits blocks only later operations for the same
+    // client, so each client's traffic stays FIFO within a lane while the
+    // other clients keep moving.
+    for (size_t lane = (size_t)first; lane <= (size_t)last; lane++) {
+        uint8_t blocked = 0;   // Slot bits
+        uint8_t prev = NO_OPERATION;
+        for (uint8_t index = laneHead[lane]; index != NO_OPERATION; prev = index, index = operationNext[index]) {
+            const GATTOperation& op = operationPool[index];
+            bool broadcast = op.connId == WIBLE_CONN_ID_ALL;
+            uint8_t slot = broadcast ? WIBLE_NO_SLOT : getConnectionSlot(op.connId);
+            uint8_t mask = broadcast ? (uint8_t)((1 << WIBLE_MAX_CONNECTIONS) - 1)
+                                     : slot == WIBLE_NO_SLOT ? 0 : (uint8_t)(1 << slot);
+            
+            // Operations for a departed client are taken so they can fail
+            bool departed = !broadcast && slot == WIBLE_NO_SLOT;
+            if (!departed && ((blocked & mask) || (int32_t)(now - op.notBefore) < 0 ||
+                              !hasSendCredit(op.connId))) {
+                blocked |= mask;
+                continue;
+            }
+            
+            uint8_t next = operationNext[index];
+            if (prev == NO_OPERATION) laneHead[lane] = next;
+            else operationNext[prev] = next;
+            if (laneTail[lane] == index) laneTail[lane] = prev;
+            operationNext[index] = NO_OPERATION;
+            return index;
+        }
+    }
+    return NO_OPERATION;
+}
+
+uint16_t BLEManager::dispatchOperations(GATTPriority first, GATTPriority last, uint16_t budget) {
+    if (processingOperation || budget == 0 || queuedOperations == 0) return 0;
+    
+    processingOperation = true;
+    uint16_t used = 0;
+    
+    while (used < budget) {
+        uint32_t now = millis();
+        if (!xSemaphoreTake(queueMutex, 0)) break;
+        uint8_t index = takeReadyOperation(first, last, now);
+        xSemaphoreGive(queueMutex);
+        if (index == NO_OPERATION) break;
+        
+        // The slot is unlinked, so it can be executed without holding the lock
+        GATTOperation& op = operationPool[index];
+        bool departed = op.connId != WIBLE_CONN_ID_ALL && getConnectionSlot(op.connId) == WIBLE_NO_SLOT;
+        bool success = !departed && executeOperation(op);
+        if (!departed) {
+            consumeSendCredit(op.connId);
+            used++;
+        }
+        
+        if (!success && !departed && op.retryCount < op.maxRetries) {
+            op.retryCount++;
+            op.notBefore = millis() + ((uint32_t)config.operationRetryDelayMs << (op.retryCount - 1));
+            statistics.operationsRetried++;
+            
+            // Back to the front of its lane to keep ordering
+            xSemaphoreTake(queueMutex, portMAX_DELAY);
+            size_t lane = (size_t)op.priority;
+            operationNext[index] = laneHead[lane];
+            laneHead[lane] = index;
+            if (laneTail[lane] == NO_OPERATION) laneTail[lane] = index;
+            xSemaphoreGive(queueMutex);
+            continue;
+        }
+        
+        if (!success) {
+            statistics.failedOperations++;
+            Metrics::increment(MetricCounter::GATT_OPERATIONS_FAILED);
+        }
+        recordOperationLatency(millis() - op.timestamp);
+        
+        GATTOperationCallback callback = op.callback;
+        void* context = op.callbackContext;
+        releaseOperation(index);
+        if (callback) callback(context, success);
+    }
+    
+    processingOperation = false;
+    return used;
+}
+
+void BLEManager::releaseOperation(uint8_t index) {
+    xSemaphoreTake(queueMutex, portMAX_DELAY);
+    operationNext[index] = freeOperations;
+    freeOperations = index;
+    queuedOperations--;
+    xSemaphoreGive(queueMutex);
+}
+
+void BLEManager::recordOperationLatency(uint32_t latencyMs) {
+    size_t bucket = 0;
+    while (bucket < WIBLE_GATT_LATENCY_BUCKETS - 1 && latencyMs >= LATENCY_BUCKET_LIMITS_MS[bucket]) {
+        bucket++;
+    }
+    statistics.operationLatencyHistogram[bucket]++;
+    Metrics::observe(MetricHistogram::NOTIFY_LATENCY_US, latencyMs * 1000);
+}
+
+void BLEManager::clearOperationQueue() {
+    for (;;) {
+        uint8_t index = NO_OPERATION;
+        xSemaphoreTake(queueMutex, portMAX_DELAY);
+        for (size_t lane = 0; lane < (size_t)GATTPriority::COUNT && index == NO_OPERATION; lane++) {
+            index = laneHead[lane];
+            if (index == NO_OPERATION) continue;
+            laneHead[lane] = operationNext[index];
+            if (laneHead[lane] == NO_OPERATION) laneTail[lane] = NO_OPERATION;
+            operationNext[index] = NO_OPERATION;
+        }
+        xSemaphoreGive(queueMutex);
+        if (index == NO_OPERATION) break;
+        
+        GATTOperationCallback callback = operationPool[index].callback;
+        void* context = operationPool[index].callbackContext;
+        releaseOperation(index);
+        if (callback) callback(context, false);
+    }
+}
+
+size_t BLEManager::getQueueSize() const {
+    return queuedOperations;
+}
+
+bool BLEManager::executeOperation(const GATTOperation& operation) {
+    BLECharacteristic* characteristic = findCharacteristic(operation.characteristicUUID);
+    if (!characteristic) return false;
+    
+    switch (operation.type) {
+        case GATTOperationType::NOTIFY:
+            return notifyRaw(characteristic, operation.connId, operation.data, operation.length);
+            
+        case GATTOperationType::INDICATE:
+            return notifyRaw(characteristic, operation.connId, operation.data, operation.length, true);
+            
+        default:
+            // As a server, writes and reads just update the local value
+            characteristic->setValue((uint8_t*)operation.data, operation.length);
+            return true;
+    }
+}
+
+void BLEManager::onConnection(BLEConnectionCallback callback) { connectionCallback = callback; }
+void BLEManager::setScanCallback(BLEScanCallback callback) {
+    scanCallback = callback;
+}
+
+void BLEManager::onScanBatch(ScanBatchCallback callback) {
+    scanBatchCallback = callback;
+}
+
+void BLEManager::startScanning(uint32_t duration) {
+    startScanning(config.scanConfig, duration);
+}
+
+bool BLEManager::startScanning(const ScanConfig& scanConfig, uint32_t duration) {
+    if (!initialized) return false;
+    if (!scanner) {
+        scanner = std::unique_ptr<BLEScanner>(new BLEScanner());
+        scanner->onBatch([this](const ScanEntry* entries, size_t count) {
+            deliverScanBatch(entries, count);
+        });
+    }
+    return scanner->start(scanConfig, duration);
+}
+
+void BLEManager::stopScanning() {
+    if (scanner) scanner->stop();
+}
+
+bool BLEManager::isScanning() const {
+    return scanner && scanner->isScanning();
+}
+
+ScanStatistics BLEManager::getScanStatistics() const {
+    return scanner ? scanner->getStatistics() : ScanStatistics();
+}
+
+void BLEManager::deliverScanBatch(const ScanEntry* entries, size_t count) {
+    if (scanBatchCallback) {
+        scanBatchCallback(entries, count);
+    }
+    if (!scanCallback) return;
+    
+    static const char hex[] = "0123456789abcdef";
+    char address[18];
+    char manufacturerData[WIBLE_SCAN_DATA_SIZE * 2 + 1];
+    for (size_t i = 0; i < count; i++) {
+        const ScanEntry& entry = entries[i];
+        entry.formatAddress(address);
+        
+        // Include the company ID, as BLEAdvertisedDevice::getManufacturerData does
+        uint8_t length = 0;
+        const uint8_t* data = entry.getManufacturerData(length);
+        size_t chars = 0;
+        if (data) {
+            data -= 2;
+            length += 2;
+            for (uint8_t b = 0; b < length; b++) {
+                manufacturerData[chars++] = hex[data[b] >> 4];
+                manufacturerData[chars++] = hex[data[b] & 0x0F];
+            }
+        }
+        manufacturerData[chars] = '\0';
+        scanCallback(String(address), entry.rssi, String(manufacturerData));
+    }
+}
+
+// ============================================================================
+// BEACON MODE
+// ============================================================================
+
+void BLEManager::startBeacon(String uuid, uint16_t major, uint16_t minor, int8_t rssiAt1m) {
+    if (!initialized || !advertising) return;
+    
+    uint8_t frame[IBeaconLayout::LENGTH];
+    if (!IBeaconLayout::write(frame, uuid.c_str(), major, minor, rssiAt1m)) {
+        LogManager::error("Invalid Beacon UUID");
+        return;
+    }
+    
+    stopAdvertisingSets();
+    int64_t stoppedAt = advertisingActive ? esp_timer_get_time() : 0;
+    stopAdvertising(); // Stop any existing advertising
+    broadcast.active = false;
+    applyRawAdvertisingData(frame, sizeof(frame));
+    applyRawScanResponseData(nullptr, 0);
+    
+    advertising->start();
+    advertisingActive = true;
+    recordAdvertisingGap(stoppedAt);
+    LogManager::info("iBeacon started");
+}
+
+void BLEManager::setManufacturerData(uint16_t companyId, uint8_t* data, size_t length) {
+    if (!advertising) return;
+    
+    AdvertisingDataBuilder<> payload;
+    if (!payload.addFlags() || !payload.addManufacturerData(companyId, data, length)) {
+        WIBLE_LOGE("Manufacturer data too long: %u bytes", (unsigned)length);
+        return;
+    }
+    broadcast.active = false;
+    applyRawAdvertisingData(payload.data(), payload.size());
+}
+
+void BLEManager::setStatusAdvertisement(uint8_t status) {
+    if (!advertising) return;
+    
+    AdvertisingDataBuilder<> payload;
+    payload.addFlags();
+    payload.addServiceUUID128(WIBLE_SERVICE_UUID);
+    payload.addManufacturerData(WIBLE_ADV_STATUS_COMPANY_ID, &status, 1);
+    broadcast.active = false;
+    applyRawAdvertisingData(payload.data(), payload.size());
+}
+
+void BLEManager::setAdvertisingData(const std::vector<uint8_t>& manufacturerData) {
+    if (manufacturerData.size() < 2) return;
+    uint16_t companyId = manufacturerData[0] | (manufacturerData[1] << 8);
+    setManufacturerData(companyId, const_cast<uint8_t*>(manufacturerData.data()) + 2,
+                        manufacturerData.size() - 2);
+}
+
+void BLEManager::updateAdvertisingData(uint8_t* data, size_t length) {
+    if (!advertising || !data) return;
+    if (length > WIBLE_ADV_LEGACY_MAX) {
+        WIBLE_LOGE("Advertising data too long: %u bytes", (unsigned)length);
+        return;
+    }
+    broadcast.active = false;
+    applyRawAdvertisingData(data, length);
+}
+
+void BLEManager::setScanResponseData(const std::vector<uint8_t>& data) {
+    if (!advertising) return;
+    if (data.size() > WIBLE_ADV_LEGACY_MAX) {
+        WIBLE_LOGE("Scan response too long: %u bytes", (unsigned)data.size());
+        return;
+    }
+    applyRawScanResponseData(data.data(), data.size());
+}
+
+void BLEManager::startBroadcasting(uint16_t manufacturerId, const uint8_t* data, size_t length) {
+    if (!initialized || !advertising) return;
+    
+    // Same frame layout already on air: just swap the payload in
+    if (broadcast.active && advertisingActive && broadcast.companyId == manufacturerId &&
+        broadcast.payloadLength == length) {
+        updateBroadcast(data, length, 0);
+        return;
+    }
+
+    AdvertisingDataBuilder<> payload;
+    if (!payload.addFlags() || !payload.addManufacturerData(manufacturerId, data, length)) {
+        WIBLE_LOGE("Broadcast payload too long: %u bytes", (unsigned)length);
+        return;
+    }
+
+    stopAdvertisingSets();
+    int64_t stoppedAt = advertisingActive ? esp_timer_get_time() : 0;
+    stopAdvertising();
+    applyRawAdvertisingData(payload.data(), payload.size());
+    
+    advertising->start();
+    advertisingActive = true;
+    recordAdvertisingGap(stoppedAt);
+    
+    memcpy(broadcast.frames[0], payload.data(), payload.size());
+    broadcast.length = payload.size();
+    broadcast.payloadLength = length;
+    broadcast.payloadOffset = payload.size() - length;
+    broadcast.companyId = manufacturerId;
+    broadcast.front = 0;
+    broadcast.pending = false;
+    broadcast.active = true;
+    broadcast.startTime = millis();
+    broadcast.lastPushTime = broadcast.startTime;
+    statistics.broadcastRestarts++;
+    LogManager::info("Broadcasting started");
+}
+
+bool BLEManager::updateBroadcast(const uint8_t* data, size_t length, size_t offset) {
+    if (!broadcast.active || !data || offset + length > broadcast.payloadLength) return false;
+    
+    uint8_t* front = broadcast.frames[broadcast.front];
+    uint8_t* back = broadcast.frames[broadcast.front ^ 1];
+    if (broadcast.pending) {
+        // The previous update never reached the controller
+        statistics.broadcastUpdatesCoalesced++;
+    } else {
+        memcpy(back, front, broadcast.length);
+    }
+    memcpy(back + broadcast.payloadOffset + offset, data, length);
+    
+    if (!broadcast.pending && memcmp(back, front, broadcast.length) == 0) {
+        statistics.broadcastUpdatesSkipped++;
+        return true;
+    }
+    broadcast.pending = true;
+    
+    uint32_t minInterval = config.broadcastMinUpdateMs ? config.broadcastMinUpdateMs
+                                                       : config.advertisingIntervalMs;
+    if (millis() - broadcast.lastPushTime >= minInterval) {
+        pushBroadcast();
+    }
+    return true;
+}
+
+void BLEManager::pushBroadcast() {
+    uint32_t minInterval = config.broadcastMinUpdateMs ? config.broadcastMinUpdateMs
+                                                       : config.advertisingIntervalMs;
+    uint32_t now = millis();
+    if (now - broadcast.lastPushTime < minInterval) return;
+    
+    uint8_t back = broadcast.front ^ 1;
+    if (memcmp(broadcast.frames[back], broadcast.frames[broadcast.front], broadcast.length) == 0) {
+        // Changed and changed back before it was sent
+        broadcast.pending = false;
+        statistics.broadcastUpdatesSkipped++;
+        return;
+    }
+    if (!swapAdvertisingData(broadcast.frames[back], broadcast.length)) return;  // Retried next loop()
+    
+    broadcast.front = back;
+    broadcast.pending = false;
+    broadcast.lastPushTime = now;
+    statistics.broadcastUpdates++;
+    uint32_t elapsed = now - broadcast.startTime;
+    if (elapsed > 0) {
+        statistics.broadcastUpdateRateMilliHz = (uint32_t)((uint64_t)statistics.broadcastUpdates * 1000000 / elapsed);
+    }
+}
+
+bool BLEManager::swapAdvertisingData(const uint8_t* data, size_t length) {
+    // The controller takes new advertising data while advertising; the
+    // stack copies the buffer before this returns
+    esp_err_t err = esp_ble_gap_config_adv_data_raw(const_cast<uint8_t*>(data), length);
+    if (err != ESP_OK) {
+        WIBLE_LOGW("Advertising data update failed: %d", (int)err);
+        return false;
+    }
+    return true;
+}
+
+void BLEManager::recordAdvertisingGap(int64_t stoppedAtUs) {
+    if (stoppedAtUs == 0) return;
+    statistics.lastAdvertisingGapUs = (uint32_t)(esp_timer_get_time() - stoppedAtUs);
+    statistics.advertisingGapUs += statistics.lastAdvertisingGapUs;
+}
+
+void BLEManager::applyRawAdvertisingData(const uint8_t* data, size_t length) {
+    // One copy into the Arduino payload instead of appending byte by byte.
+    // This also marks the data as custom, so later restarts keep it and
+    // swapAdvertisingData can replace it directly.
+    BLEAdvertisementData advertisementData;
+    advertisementData.addData(std::string((const char*)data, length));
+    advertising->setAdvertisementData(advertisementData);
+}
+
+void BLEManager::applyRawScanResponseData(const uint8_t* data, size_t length) {
+    BLEAdvertisementData scanResponseData;
+    if (length) scanResponseData.addData(std::string((const char*)data, length));
+    advertising->setScanResponseData(scanResponseData);
+}
+
+// ============================================================================
+// CONCURRENT ADVERTISING SETS
+// ============================================================================
+
+AdvertisingScheduler& BLEManager::scheduler() {
+    if (!advertisingSets) {
+        advertisingSets = std::unique_ptr<AdvertisingScheduler>(new AdvertisingScheduler());
+    }
+    return *advertisingSets;
+}
+
+int8_t BLEManager::addProvisioningSet(const AdvertisingSetParams& params) {
+    if (provisioningSet != WIBLE_NO_ADV_SET) return provisioningSet;
+    
+    AdvertisingDataBuilder<> payload;
+    payload.addFlags();
+    payload.addServiceUUID128(WIBLE_SERVICE_UUID);
+    AdvertisingDataBuilder<> scanResponse;
+    scanResponse.addName(config.deviceName.c_str());
+    
+    AdvertisingSetParams connectable = params;
+    connectable.connectable = true;
+    provisioningSet = scheduler().addSet(connectable, payload.data(), payload.size(),
+                                         scanResponse.data(), scanResponse.size());
+    return provisioningSet;
+}
+
+int8_t BLEManager::addBeaconSet(const String& uuid, uint16_t major, uint16_t minor, int8_t rssiAt1m,
+                                const AdvertisingSetParams& params) {
+    uint8_t frame[IBeaconLayout::LENGTH];
+    if (!IBeaconLayout::write(frame, uuid.c_str(), major, minor, rssiAt1m)) {
+        LogManager::error("Invalid Beacon UUID");
+        return WIBLE_NO_ADV_SET;
+    }
+    return scheduler().addSet(params, frame, sizeof(frame));
+}
+
+int8_t BLEManager::addBroadcastSet(uint16_t companyId, const uint8_t* data, size_t length,
+                                   const AdvertisingSetParams& params) {
+    AdvertisingDataBuilder<> payload;
+    if (!payload.addFlags() || !payload.addManufacturerData(companyId, data, length)) {
+        WIBLE_LOGE("Broadcast payload too long: %u bytes", (unsigned)length);
+        return WIBLE_NO_ADV_SET;
+    }
+    return scheduler().addSet(params, payload.data(), payload.size());
+}
+
+bool BLEManager::updateBroadcastSet(int8_t set, uint16_t companyId, const uint8_t* data, size_t length) {
+    AdvertisingDataBuilder<> payload;
+    if (!payload.addFlags() || !payload.addManufacturerData(companyId, data, length)) return false;
+    return updateAdvertisingSet(set, payload.data(), payload.size());
+}
+
+bool BLEManager::updateAdvertisingSet(int8_t set, const uint8_t* data, size_t length) {
+    return advertisingSets && advertisingSets->updateSet(set, data, length);
+}
+
+void BLEManager::removeAdvertisingSet(int8_t set) {
+    if (!advertisingSets) return;
+    advertisingSets->removeSet(set);
+    if (set == provisioningSet) provisioningSet = WIBLE_NO_ADV_SET;
+}
+
+bool BLEManager::startAdvertisingSets() {
+    if (!initialized || !advertisingSets || advertisingSets->getSetCount() == 0) return false;
+    if (advertisingSets->isRunning()) return true;
+    
+    // The sets drive the controller directly; take the single advertisement off air
+    if (advertisingActive && advertising) advertising->stop();
+    broadcast.active = false;
+    
+    advertisingSets->start();
+    advertisingActive = advertisingSets->isEnabled(provisioningSet);
+    return true;
+}
+
+void BLEManager::stopAdvertisingSets() {
+    if (!areAdvertisingSetsRunning()) return;
+    advertisingSets->stop();
+    advertisingActive = false;
+}
+
+bool BLEManager::areAdvertisingSetsRunning() const {
+    return advertisingSets && advertisingSets->isRunning();
+}
+
+AdvertisingSetStats BLEManager::getAdvertisingSetStats(int8_t set) const {
+    return advertisingSets ? advertisingSets->getStats(set) : AdvertisingSetStats();
+}
+
+void BLEManager::onDisconnection(BLEDisconnectionCallback callback) { disconnectionCallback = callback; }
+void BLEManager::onDataReceived(BLEDataReceivedCallback callback) { dataReceivedCallback = callback; }
+
+// ============================================================================
+// BLE UTILITIES
+// ============================================================================
+
+String BLEUtils::addressToString(const uint8_t* address) {
+    if (!address) return "";
+    char buffer[18];
+    snprintf(buffer, sizeof(buffer), "%02x:%02x:%02x:%02x:%02x:%02x",
+             address[0], address[1], address[2], address[3], address[4], address[5]);
+    return String(buffer);
+}
+
+std::map<uint8_t, std::vector<uint8_t>> BLEUtils::parseAdvertisingData(const std::vector<uint8_t>& data) {
+    std::map<uint8_t, std::vector<uint8_t>> elements;
+    for (AdStructure field : AdvertisingDataView(data.data(), data.size())) {
+        elements[field.type].assign(field.data, field.data + field.length);
+    }
+    return elements;
+}
+
+std::vector<uint8_t> BLEUtils::buildAdvertisingData(const std::map<uint8_t, std::vector<uint8_t>>& elements) {
+    AdvertisingDataBuilder<WIBLE_ADV_EXTENDED_MAX> payload;
+    for (const auto& element : elements) {
+        if (!payload.add(element.first, element.second.data(), element.second.size())) break;
+    }
+    return std::vector<uint8_t>(payload.data(), payload.data() + payload.size());
 }
-void BLEManager::onDisconnection(BLEDisconnectionCallback callback) { disconnectionCallback = callback; }
-void BLEManager::onDataReceived(BLEDataReceivedCallback callback) { dataReceivedCallback = callback; }
 
 } // namespace WiBLE
@@ -13,11 +13,19 @@
 #include <BLEServer.h>
 #include <BLEUtils.h>
 #include <BLE2902.h>
+#include <atomic>
 #include <functional>
 #include <map>
-#include <queue>
+#include <vector>
 #include <memory>
 #include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "utils/SPSCQueue.h"
+#include "utils/AdvertisingData.h"
+#include "utils/PacketSchema.h"
+#include "BLEScanner.h"
+#include "AdvertisingScheduler.h"
+#include "ConnectionTuner.h"
 
 namespace WiBLE {
 
@@ -33,6 +41,15 @@ namespace WiBLE {
 #define WIBLE_STATUS_CHARACTERISTIC  "6e400003-b5a3-f393-e0a9-e50e24dcca9e"  // Notify
 #define WIBLE_CONTROL_CHARACTERISTIC "6e400004-b5a3-f393-e0a9-e50e24dcca9e"  // Write
 #define WIBLE_DATA_CHARACTERISTIC    "6e400005-b5a3-f393-e0a9-e50e24dcca9e"  // Read/Write/Notify
+#define WIBLE_DIAGNOSTICS_CHARACTERISTIC "6e400006-b5a3-f393-e0a9-e50e24dcca9e"  // Read (metrics snapshot)
+
+// Provisioning status advertised after each state change:
+// flags, the WiBLE service UUID and manufacturer data [company][status]
+#define WIBLE_ADV_STATUS_COMPANY_ID  0xFFFF  // Test company ID
+#define WIBLE_ADV_STATUS_IDLE        0x00
+#define WIBLE_ADV_STATUS_BUSY        0x01    // Joining WiFi or validating
+#define WIBLE_ADV_STATUS_PROVISIONED 0x02
+#define WIBLE_ADV_STATUS_ERROR       0x03
 
 // Device Information Service (standard)
 #define DEVICE_INFO_SERVICE_UUID     "180a"
@@ -40,6 +57,91 @@ namespace WiBLE {
 #define MANUFACTURER_CHAR_UUID       "2a29"
 #define FIRMWARE_VERSION_CHAR_UUID   "2a26"
 
+// ============================================================================
+// CHUNKED TRANSFER FRAMING
+// ============================================================================
+
+// Frames carried on the data characteristic (both directions):
+//   START: [0xF1][seq=0 (u16 LE)][totalLength (u32 LE)][payload...]
+//   DATA:  [0xF2][seq (u16 LE)][payload...]
+//   ACK:   [0xF3][next expected seq (u16 LE)]
+//   ABORT: [0xF4][reason]
+// The sender keeps at most `chunkWindowSize` unacknowledged frames in flight;
+// the receiver ACKs every half window and on completion. Writes whose first
+// byte is outside 0xF1..0xF4 are delivered to the application unchanged.
+#define WIBLE_FRAME_START            0xF1
+#define WIBLE_FRAME_DATA             0xF2
+#define WIBLE_FRAME_ACK              0xF3
+#define WIBLE_FRAME_ABORT            0xF4
+#define WIBLE_FRAME_HEADER_SIZE      3
+#define WIBLE_FRAME_START_HEADER_SIZE 7
+#define WIBLE_MAX_ATT_PAYLOAD        514  // 517-byte ATT MTU minus 3-byte header
+
+// ACKs, ABORTs and disconnects for the outgoing transfer arrive on the write
+// path and are applied by loop(), which alone owns the transfer state. A
+// dropped ACK is recovered by go-back-N; a dropped cancel by the ACK timeout.
+#ifndef WIBLE_TRANSFER_EVENT_DEPTH
+#define WIBLE_TRANSFER_EVENT_DEPTH   16   // Events (power of two)
+#endif
+
+enum class ChunkAbortReason : uint8_t {
+    NONE = 0,
+    TOO_LARGE = 1,
+    OUT_OF_SEQUENCE = 2,
+    TIMEOUT = 3,
+    CANCELLED = 4,
+    REJECTED = 5            // The transfer sink refused the data
+};
+
+// ============================================================================
+// WRITE WORKER
+// ============================================================================
+
+// GATT writes are copied once into a preallocated ring slot in the Bluedroid
+// callback and handled by a worker task, so decryption, parsing and WiFi
+// bring-up never run on the BLE stack's task. Connects, disconnects and MTU
+// changes take the same ring, so the connection table and sessions change
+// only between writes; writes leave three slots per connection free for them.
+#ifndef WIBLE_WRITE_QUEUE_DEPTH
+#define WIBLE_WRITE_QUEUE_DEPTH      16   // Slots (power of two)
+#endif
+#define WIBLE_WRITE_SLOT_SIZE        512  // Largest GATT attribute value
+
+#ifndef WIBLE_WRITE_WORKER_CORE
+#if CONFIG_FREERTOS_UNICORE
+#define WIBLE_WRITE_WORKER_CORE      0
+#else
+#define WIBLE_WRITE_WORKER_CORE      1    // App core; Bluedroid runs on core 0
+#endif
+#endif
+
+// ============================================================================
+// OPERATION SCHEDULER
+// ============================================================================
+
+// Operations live in a fixed pool inside BLEManager and carry their payload
+// inline, so enqueueing never touches the heap. Lanes are drained strictly in
+// priority order; chunked-transfer frames are sent between HIGH and NORMAL.
+#ifndef WIBLE_GATT_OP_POOL_SIZE
+#define WIBLE_GATT_OP_POOL_SIZE      16
+#endif
+#define WIBLE_GATT_OP_MAX_DATA       244  // One notification at a 247-byte MTU
+#define WIBLE_GATT_LATENCY_BUCKETS   8
+
+// ============================================================================
+// CONNECTION TABLE
+// ============================================================================
+
+// Every link owns a slot for its lifetime (MTU, auth status, reassembly
+// state). Up to BLEConfig::maxConnections slots are served; the rest hold
+// queued clients, which stay connected but are ignored until a served
+// client leaves. Slots are found by Bluedroid conn_id with a linear scan.
+#ifndef WIBLE_MAX_CONNECTIONS
+#define WIBLE_MAX_CONNECTIONS        3    // CONFIG_BTDM_CTRL_BLE_MAX_CONN default
+#endif
+#define WIBLE_CONN_ID_ALL            0xFFFF  // Every served client
+#define WIBLE_NO_SLOT                0xFF
+
 // ============================================================================
 // BLE CONFIGURATION
 // ============================================================================
@@ -54,11 +156,13 @@ struct BLEConfig {
     uint16_t connectionInterval = 24;  // 30ms (units of 1.25ms)
     uint16_t slaveLatency = 0;
     uint16_t supervisionTimeout = 400; // 4s (units of 10ms)
+    ConnectionTuningConfig connectionTuning;   // Burst / idle switching around the above
     
     // Advertising parameters
     uint32_t advertisingIntervalMs = 100;
     bool advertisingEnabled = true;
     bool scanResponseEnabled = true;
+    uint16_t broadcastMinUpdateMs = 0;  // Coalesce updates closer than this; 0: one advertising interval
     
     // Security
     bool enableBonding = true;
@@ -70,10 +174,86 @@ struct BLEConfig {
     int8_t txPowerLevel = 3;  // dBm: -12, -9, -6, -3, 0, 3, 6, 9
     bool enablePowerSaving = false;
     
+    // Gateway scanning (startScanning)
+    ScanConfig scanConfig;
+    
     // Connection management
-    uint8_t maxConnections = 1;
+    uint8_t maxConnections = 1;         // Served at once, capped at WIBLE_MAX_CONNECTIONS
+    bool enableConnectionQueue = true;  // Hold extra clients in spare slots instead of dropping them
     uint32_t connectionTimeoutMs = 30000;
     bool autoReconnect = false;
+    
+    // Chunked transfer
+    uint8_t chunkWindowSize = 8;        // Frames in flight before an ACK is required
+    uint32_t chunkAckTimeoutMs = 1000;  // Go back to the last ACK after this long
+    uint8_t chunkMaxRetries = 3;
+    size_t maxTransferSize = 20480;     // Reassembly buffer, reserved at init
+    
+    // Operation scheduler
+    uint8_t maxNotificationsPerTick = 4;  // Further capped by controller buffer credits
+    uint16_t operationRetryDelayMs = 20;  // Doubled on every retry
+    
+    // Write worker
+    bool useWriteWorker = true;         // false: handle writes in the BLE callback
+    uint8_t writeWorkerPriority = 3;
+    uint32_t writeWorkerStackSize = 6144;
+    
+    // Diagnostics characteristic (Metrics snapshot, needs WIBLE_ENABLE_METRICS)
+    bool enableDiagnostics = true;
+};
+
+// ============================================================================
+// BLE STATISTICS
+// ============================================================================
+
+struct BLEStatistics {
+    uint32_t totalConnections = 0;
+    uint32_t totalDisconnections = 0;
+    uint32_t connectionsQueued = 0;
+    uint32_t connectionsRejected = 0;   // Table full (or queue disabled)
+    uint32_t totalBytesReceived = 0;
+    uint32_t totalBytesSent = 0;
+    uint32_t failedOperations = 0;
+    uint32_t transfersSent = 0;
+    uint32_t transfersReceived = 0;
+    uint32_t transfersAborted = 0;
+    uint32_t framesRetransmitted = 0;
+    uint32_t framesDeferred = 0;        // Streamed frames the sink could not take yet
+    uint32_t lastTxThroughputBps = 0;   // Bytes/s of the last completed outgoing transfer
+    uint32_t lastRxThroughputBps = 0;   // Bytes/s of the last completed incoming transfer
+    
+    // Write worker queue
+    uint32_t writesQueued = 0;
+    uint32_t writesHandled = 0;
+    uint32_t writesDropped = 0;         // Ring full or value larger than a slot
+    uint32_t linkEventsDropped = 0;     // Connect, disconnect or MTU change lost to a full ring
+    uint32_t writeQueueHighWater = 0;
+    uint32_t writeLatencyAvgUs = 0;     // Write callback to handler return (EMA)
+    uint32_t writeLatencyMaxUs = 0;
+    
+    // Operation scheduler
+    uint32_t operationsDropped = 0;     // Pool full or payload too large
+    uint32_t operationsRetried = 0;
+    uint32_t operationQueueHighWater = 0;
+    // Enqueue-to-completion latency; bucket upper bounds in
+    // BLEManager::LATENCY_BUCKET_LIMITS_MS, the last bucket is open-ended
+    uint32_t operationLatencyHistogram[WIBLE_GATT_LATENCY_BUCKETS] = {0};
+    
+    // Live broadcast
+    uint32_t broadcastUpdates = 0;          // Payloads swapped in while advertising
+    uint32_t broadcastUpdatesSkipped = 0;   // Payload unchanged, nothing sent
+    uint32_t broadcastUpdatesCoalesced = 0; // Superseded before they were sent
+    uint32_t broadcastRestarts = 0;         // Advertising stopped and restarted for a new frame
+    uint32_t broadcastUpdateRateMilliHz = 0; // Swapped-in updates per 1000 s since the broadcast started
+    uint32_t advertisingGapUs = 0;          // Total time off air across restarts
+    uint32_t lastAdvertisingGapUs = 0;
+    
+    // Connection tuning
+    uint32_t connectionParamUpdates = 0;    // Requests issued to the controller
+    uint32_t connectionParamFailures = 0;
+    uint32_t burstSwitches = 0;             // Links switched into BURST
+    uint32_t dataLengthRequests = 0;
+    uint32_t phyRequests = 0;
 };
 
 // ============================================================================
@@ -89,10 +269,18 @@ struct BLEConnectionInfo {
     uint32_t lastActivityAt;
     bool isAuthenticated;
     bool isNotifyEnabled;
+    bool isQueued;          // Waiting for a served slot
+    uint8_t slot;           // Index in the connection table
+    LinkProfile linkProfile;        // Parameters last requested by the tuner
+    uint16_t connectionInterval;    // Max interval last requested (1.25 ms units)
+    uint32_t throughputBps;         // Both directions, last tuner sample
     
     BLEConnectionInfo() : connectionId(0), mtu(23), rssi(0), 
                          connectedAt(0), lastActivityAt(0),
-                         isAuthenticated(false), isNotifyEnabled(false) {}
+                         isAuthenticated(false), isNotifyEnabled(false),
+                         isQueued(false), slot(WIBLE_NO_SLOT),
+                         linkProfile(LinkProfile::BALANCED), connectionInterval(0),
+                         throughputBps(0) {}
     
     uint32_t getConnectionDuration() const {
         return millis() - connectedAt;
@@ -107,7 +295,7 @@ struct BLEConnectionInfo {
 // GATT OPERATION
 // ============================================================================
 
-enum class GATTOperationType {
+enum class GATTOperationType : uint8_t {
     READ,
     WRITE,
     WRITE_NO_RESPONSE,
@@ -115,28 +303,60 @@ enum class GATTOperationType {
     INDICATE
 };
 
+enum class GATTPriority : uint8_t {
+    HIGH = 0,    // Status / control responses
+    NORMAL = 1,
+    BULK = 2,    // Large data, sent only when nothing else is waiting
+    COUNT = 3
+};
+
+using GATTOperationCallback = void (*)(void* context, bool success);
+
 struct GATTOperation {
-    GATTOperationType type;
-    String characteristicUUID;
-    std::vector<uint8_t> data;
-    std::function<void(bool success, const std::vector<uint8_t>& response)> callback;
-    uint32_t timestamp;
-    uint8_t retryCount;
-    uint8_t maxRetries;
-    
-    GATTOperation() : timestamp(millis()), retryCount(0), maxRetries(3) {}
+    GATTOperationType type = GATTOperationType::NOTIFY;
+    GATTPriority priority = GATTPriority::NORMAL;
+    const char* characteristicUUID = nullptr;  // Must outlive the operation (UUID macros)
+    uint16_t connId = WIBLE_CONN_ID_ALL;       // Target client
+    uint16_t length = 0;
+    uint8_t data[WIBLE_GATT_OP_MAX_DATA];
+    GATTOperationCallback callback = nullptr;
+    void* callbackContext = nullptr;
+    uint32_t timestamp = 0;     // Set when enqueued
+    uint32_t notBefore = 0;     // Retry backoff
+    uint8_t retryCount = 0;
+    uint8_t maxRetries = 3;
+    
+    bool setData(const uint8_t* bytes, size_t size) {
+        if (size > WIBLE_GATT_OP_MAX_DATA) return false;
+        memcpy(data, bytes, size);
+        length = (uint16_t)size;
+        return true;
+    }
 };
 
 // ============================================================================
 // BLE CALLBACKS
 // ============================================================================
 
+// Called when a client is queued (info.isQueued) and again once it is served.
+// Connection, disconnection and data callbacks all run on the write worker
+// (on the BLE task if it could not be started).
 using BLEConnectionCallback = std::function<void(const BLEConnectionInfo& info)>;
-using BLEDisconnectionCallback = std::function<void(String address, uint8_t reason)>;
-using BLEDataReceivedCallback = std::function<void(const String& characteristicUUID, 
-                                                   const std::vector<uint8_t>& data)>;
+using BLEDisconnectionCallback = std::function<void(const BLEConnectionInfo& info, uint8_t reason)>;
+// `data` points into a write-queue slot (or the reassembly buffer) and is only
+// valid for the duration of the call; handlers may modify it in place.
+// Writes from queued clients are dropped before they get here.
+using BLEDataReceivedCallback = std::function<void(uint16_t connId, const String& characteristicUUID,
+                                                   uint8_t* data, size_t length)>;
 using MTUChangeCallback = std::function<void(uint16_t mtu)>;
 using RSSIUpdateCallback = std::function<void(int8_t rssi)>;
+// Receives a streamed transfer frame by frame (see setTransferSink)
+enum class TransferSinkResult : uint8_t {
+    ACCEPTED,
+    BUSY,               // Not now: the sender is told to resend from this frame
+    REJECTED            // Aborts the transfer
+};
+using TransferSink = std::function<TransferSinkResult(uint16_t connId, const uint8_t* data, size_t length)>;
 
 // ============================================================================
 // BLE MANAGER CLASS
@@ -156,11 +376,23 @@ public:
      */
     bool initialize(const BLEConfig& config = BLEConfig());
     
+    /**
+     * Service chunked transfers and the operation queue (call in loop)
+     */
+    void loop();
+    
     /**
      * Cleanup BLE resources
      */
     void cleanup();
     
+    /**
+     * Shut Bluedroid and the controller down, freeing the host stack's heap.
+     * With releaseMemory the controller's memory goes back to the heap as
+     * well, and BLE cannot be initialized again until the next restart.
+     */
+    void deinitialize(bool releaseMemory = false);
+    
     /**
      * Check if BLE is initialized
      */
@@ -186,12 +418,14 @@ public:
     bool isAdvertising() const;
     
     /**
-     * Update advertising data
+     * Advertise flags plus this manufacturer data (company ID first),
+     * updated in place
      */
     void setAdvertisingData(const std::vector<uint8_t>& manufacturerData);
 
     /**
-     * Update advertising data with raw bytes
+     * Replace the advertising payload with raw AD structures, in place:
+     * advertising keeps running
      */
     void updateAdvertisingData(uint8_t* data, size_t length);
 
@@ -200,6 +434,12 @@ public:
      */
     void setManufacturerData(uint16_t companyId, uint8_t* data, size_t length);
     
+    /**
+     * Advertise a WIBLE_ADV_STATUS_* byte next to the service UUID, so
+     * scanners (group provisioning leads) tell provisioned devices apart
+     */
+    void setStatusAdvertisement(uint8_t status);
+    
     /**
      * Set scan response data
      */
@@ -210,18 +450,34 @@ public:
     // ========================================================================
     
     /**
-     * Start scanning for BLE devices
-     * @param duration Duration in seconds
+     * Start a timed scan with BLEConfig::scanConfig
+     * @param duration Duration in seconds, 0 until stopScanning()
      */
     void startScanning(uint32_t duration);
     
     /**
-     * Stop scanning
+     * Start scanning with explicit settings and filters. Batches are
+     * delivered from loop().
+     * @param duration Duration in seconds, 0 until stopScanning()
+     */
+    bool startScanning(const ScanConfig& scanConfig, uint32_t duration = 0);
+    
+    /**
+     * Stop scanning; the devices heard since the last batch are delivered
+     * on the next loop()
      */
     void stopScanning();
+    bool isScanning() const;
+    ScanStatistics getScanStatistics() const;
+    
+    /**
+     * Set callback for devices heard since the previous batch
+     */
+    void onScanBatch(ScanBatchCallback callback);
     
     /**
-     * Set callback for discovered devices
+     * Per-device form of the batch callback: once per device per batch,
+     * with the manufacturer data (company ID first) as hex
      */
     using BLEScanCallback = std::function<void(const String& address, int rssi, const String& manufacturerData)>;
     void setScanCallback(BLEScanCallback callback);
@@ -243,28 +499,105 @@ public:
      * Start broadcasting custom manufacturer data
      */
     void startBroadcasting(uint16_t manufacturerId, const uint8_t* data, size_t length);
+    
+    /**
+     * Patch bytes of the running broadcast's manufacturer payload. The frame
+     * is double-buffered and swapped into the controller without stopping
+     * advertising; updates closer together than broadcastMinUpdateMs are
+     * coalesced and sent from loop().
+     * @param offset Into the payload given to startBroadcasting
+     * @return false if no broadcast is running or the range is outside it
+     */
+    bool updateBroadcast(const uint8_t* data, size_t length, size_t offset = 0);
+    bool isBroadcasting() const { return broadcast.active; }
+
+    // ========================================================================
+    // CONCURRENT ADVERTISING SETS
+    // ========================================================================
+
+    /**
+     * Add the connectable provisioning advertisement (service UUID, with the
+     * device name in the scan response) as a set. While the sets run,
+     * startAdvertising()/stopAdvertising() only switch this set.
+     * @return Set ID, or WIBLE_NO_ADV_SET
+     */
+    int8_t addProvisioningSet(const AdvertisingSetParams& params = AdvertisingSetParams());
+
+    /**
+     * Add an iBeacon frame as a set
+     */
+    int8_t addBeaconSet(const String& uuid, uint16_t major, uint16_t minor, int8_t rssiAt1m,
+                        const AdvertisingSetParams& params = AdvertisingSetParams());
+
+    /**
+     * Add flags plus manufacturer data as a set
+     */
+    int8_t addBroadcastSet(uint16_t companyId, const uint8_t* data, size_t length,
+                           const AdvertisingSetParams& params = AdvertisingSetParams());
+
+    /**
+     * Replace a broadcast set's manufacturer data, in place
+     */
+    bool updateBroadcastSet(int8_t set, uint16_t companyId, const uint8_t* data, size_t length);
+
+    /**
+     * Replace a set's payload with raw AD structures, in place
+     */
+    bool updateAdvertisingSet(int8_t set, const uint8_t* data, size_t length);
+    void removeAdvertisingSet(int8_t set);
+
+    /**
+     * Put all added sets on air, replacing single-advertisement modes
+     * (provisioning, beacon, broadcast)
+     */
+    bool startAdvertisingSets();
+    void stopAdvertisingSets();
+    bool areAdvertisingSetsRunning() const;
+    AdvertisingSetStats getAdvertisingSetStats(int8_t set) const;
 
     // ========================================================================
     // CONNECTION MANAGEMENT
     // ========================================================================
     
     /**
-     * Check if any client is connected
+     * Check if any client is being served
      */
     bool isConnected() const;
     
     /**
-     * Get number of connected clients
+     * Check if a specific client is being served
+     */
+    bool isConnected(uint16_t connId) const;
+    
+    /**
+     * Get number of served clients
      */
     uint8_t getConnectionCount() const;
     
     /**
-     * Get connection info
+     * Get number of clients waiting for a served slot
+     */
+    uint8_t getQueuedCount() const;
+    
+    /**
+     * Get connection info (default-constructed if unknown)
      */
     BLEConnectionInfo getConnectionInfo(const String& address) const;
+    BLEConnectionInfo getConnectionInfo(uint16_t connId) const;
+    
+    /**
+     * Connection table slot of a client, or WIBLE_NO_SLOT
+     */
+    uint8_t getConnectionSlot(uint16_t connId) const;
+    
+    /**
+     * Record the application-level auth status of a client
+     */
+    void setAuthenticated(uint16_t connId, bool authenticated);
+    bool isAuthenticated(uint16_t connId) const;
     
     /**
-     * Get all connected clients
+     * Get all connected clients (served and queued)
      */
     std::vector<String> getConnectedClients() const;
     
@@ -272,6 +605,7 @@ public:
      * Disconnect specific client
      */
     void disconnect(const String& address);
+    void disconnect(uint16_t connId);
     
     /**
      * Disconnect all clients
@@ -279,11 +613,22 @@ public:
     void disconnectAll();
     
     /**
-     * Update connection parameters
+     * Make these the BALANCED parameters and request them on every
+     * balanced link; links in BURST or IDLE get them when they return
      */
     bool updateConnectionParameters(uint16_t minInterval, uint16_t maxInterval,
                                    uint16_t latency, uint16_t timeout);
     
+    /**
+     * Replace the burst / idle policy; links keep their current profile
+     */
+    void setConnectionTuning(const ConnectionTuningConfig& tuning);
+    
+    /**
+     * Tuner state of a served link (profile, throughput around the last switch)
+     */
+    LinkTuningStats getLinkTuning(uint16_t connId) const;
+    
     // ========================================================================
     // MTU NEGOTIATION
     // ========================================================================
@@ -294,14 +639,16 @@ public:
     bool requestMTU(uint16_t size);
     
     /**
-     * Get current MTU
+     * Get current MTU (smallest among served clients)
      */
     uint16_t getMTU() const;
+    uint16_t getMTU(uint16_t connId) const;
     
     /**
      * Get maximum payload size (MTU - 3 bytes overhead)
      */
     uint16_t getMaxPayloadSize() const;
+    uint16_t getMaxPayloadSize(uint16_t connId) const;
     
     // ========================================================================
     // GATT OPERATIONS
@@ -323,10 +670,15 @@ public:
     std::vector<uint8_t> readCharacteristic(const String& uuid);
     
     /**
-     * Send notification to client
+     * Send notification to every served client
      */
     bool notify(const String& uuid, const std::vector<uint8_t>& data);
     
+    /**
+     * Send notification to one client
+     */
+    bool notify(uint16_t connId, const String& uuid, const std::vector<uint8_t>& data);
+    
     /**
      * Send notification (string)
      */
@@ -347,39 +699,94 @@ public:
     // ========================================================================
     
     /**
-     * Enqueue GATT operation (for serialization)
+     * Enqueue GATT operation (copied into the pool).
+     * Returns false if the pool is full or the payload does not fit.
+     */
+    bool enqueueOperation(const GATTOperation& operation);
+    
+    /**
+     * Enqueue a notification without building a GATTOperation first
      */
-    void enqueueOperation(const GATTOperation& operation);
+    bool enqueueNotify(const char* uuid, const uint8_t* data, size_t length,
+                       GATTPriority priority = GATTPriority::NORMAL,
+                       GATTOperationCallback callback = nullptr, void* context = nullptr,
+                       uint16_t connId = WIBLE_CONN_ID_ALL);
+    
+    /**
+     * Encode a PacketSchema frame on the stack and queue it as a notification
+     */
+    template<typename Packet, typename... Values>
+    bool notifyPacket(const char* uuid, Values... values) {
+        static_assert(Packet::SIZE <= WIBLE_GATT_OP_MAX_DATA, "Packet does not fit one notification");
+        uint8_t frame[Packet::SIZE];
+        Packet::encode(frame, values...);
+        return enqueueNotify(uuid, frame, sizeof(frame));
+    }
     
     /**
-     * Process operation queue (call in loop)
+     * Dispatch queued operations up to each client's send credits (called from loop)
      */
     void processOperationQueue();
     
     /**
-     * Clear operation queue
+     * Clear operation queue (pending callbacks report failure)
      */
     void clearOperationQueue();
     
     /**
-     * Get queue size
+     * Get number of queued operations
      */
     size_t getQueueSize() const;
     
+    /**
+     * Upper bounds (ms) of the operation latency histogram buckets
+     */
+    static const uint16_t LATENCY_BUCKET_LIMITS_MS[WIBLE_GATT_LATENCY_BUCKETS - 1];
+    
     // ========================================================================
     // CHUNKED DATA TRANSFER
     // ========================================================================
     
     /**
-     * Send large data in chunks (handles MTU automatically)
+     * Send large data in chunks (handles MTU automatically).
+     * Returns once the transfer is queued; frames are paced from loop()
+     * by the ACK credit window and progress is reported as it is acknowledged.
+     * progressCallback runs on the task that calls loop().
+     * Without a connId the transfer goes to the longest-connected client.
      */
     bool sendLargeData(const std::vector<uint8_t>& data, 
                       std::function<void(uint8_t progress)> progressCallback = nullptr);
+    bool sendLargeData(uint16_t connId, const std::vector<uint8_t>& data,
+                      std::function<void(uint8_t progress)> progressCallback = nullptr);
+    
+    /**
+     * Receive large data from a client (reassembles chunks).
+     * The completed payload is delivered through onDataReceived().
+     */
+    void handleIncomingChunk(uint16_t connId, const std::vector<uint8_t>& chunk);
+    
+    /**
+     * Stream transfers from connId to sink as their frames arrive instead
+     * of reassembling them, so they are not bound by maxTransferSize.
+     * One connection streams at a time; a null sink ends streaming.
+     * Takes effect on the write worker before the next frame is handled.
+     */
+    void setTransferSink(uint16_t connId, TransferSink sink);
+    
+    /**
+     * Check if an outgoing chunked transfer is still running
+     */
+    bool isTransferInProgress() const { return outgoingTransfer.inProgress; }
+    
+    /**
+     * Cancel outgoing and incoming chunked transfers
+     */
+    void abortTransfers(ChunkAbortReason reason = ChunkAbortReason::CANCELLED);
     
     /**
-     * Receive large data (reassembles chunks)
+     * Check if a write is a chunked-transfer frame
      */
-    void handleIncomingChunk(const std::vector<uint8_t>& chunk);
+    static bool isTransferFrame(const uint8_t* data, size_t length);
     
     // ========================================================================
     // RSSI & SIGNAL STRENGTH
@@ -446,6 +853,12 @@ public:
     void dumpConnections() const;
     void dumpServices() const;
     void dumpStatistics() const;
+    const BLEStatistics& getStatistics() const { return statistics; }
+    
+    /**
+     * Writes waiting for the worker task
+     */
+    size_t getWriteQueueDepth() const { return writeQueue.size(); }
 
 private:
     // ESP32 BLE Objects
@@ -459,35 +872,138 @@ private:
     BLECharacteristic* statusChar;
     BLECharacteristic* controlChar;
     BLECharacteristic* dataChar;
+    BLECharacteristic* diagnosticsChar;
     
     // Configuration
     BLEConfig config;
     
-    // Connection tracking
-    std::map<String, BLEConnectionInfo> connections;
-    String primaryClientAddress;
-    
-    // Operation queue
-    std::queue<GATTOperation> operationQueue;
+    // Operation scheduler: pool slots are linked into a free list or one
+    // FIFO lane per priority through `operationNext`
+    static const uint8_t NO_OPERATION = 0xFF;
+    GATTOperation operationPool[WIBLE_GATT_OP_POOL_SIZE];
+    uint8_t operationNext[WIBLE_GATT_OP_POOL_SIZE];
+    uint8_t freeOperations;
+    uint8_t laneHead[(size_t)GATTPriority::COUNT];
+    uint8_t laneTail[(size_t)GATTPriority::COUNT];
+    uint8_t queuedOperations;
     bool processingOperation;
     SemaphoreHandle_t queueMutex;
     
-    // Chunked transfer state
+    // Chunked transfer state (incoming, one per connection)
     struct ChunkedTransfer {
         std::vector<uint8_t> buffer;
         size_t expectedSize;
         size_t receivedSize;
         uint32_t startTime;
         bool inProgress;
-    } chunkedTransfer;
+        bool streaming;         // Payload goes to transferSink, not buffer
+        uint16_t nextSeq;
+        uint8_t framesSinceAck;
+    };
+    
+    // Connection table. Reassembly buffers are reserved when a slot is
+    // first served and kept until cleanup(), so a write racing a
+    // disconnect never touches freed memory.
+    struct ConnectionSlot {
+        BLEConnectionInfo info;
+        ChunkedTransfer rx;
+        uint16_t credits;       // Send credits left this tick
+        uint32_t bytesMoved;    // Sent and received, for the tuner
+        uint8_t address[6];
+        bool inUse;
+    };
+    // The write worker is the only task that adds or removes slots; readers
+    // on other tasks hold connectionMutex and copy what they need out.
+    ConnectionSlot connectionTable[WIBLE_MAX_CONNECTIONS];
+    SemaphoreHandle_t connectionMutex;
+    
+    // Chunked transfer state (outgoing)
+    struct OutgoingTransfer {
+        uint16_t connId;
+        std::vector<uint8_t> buffer;
+        size_t firstFramePayload;   // START frame payload size
+        size_t framePayload;        // DATA frame payload size
+        uint16_t totalFrames;
+        uint16_t nextSeq;           // Next frame to put on air
+        uint16_t ackedSeq;          // Peer has everything below this
+        uint32_t startTime;
+        uint32_t lastAckTime;
+        uint8_t retries;
+        uint8_t lastProgress;
+        bool inProgress;
+        std::function<void(uint8_t progress)> progressCallback;
+    } outgoingTransfer;
+    
+    // Transfer control posted by the write path; only loop() consumes
+    struct TransferEvent {
+        uint8_t type;           // WIBLE_FRAME_ACK or WIBLE_FRAME_ABORT
+        uint16_t connId;
+        uint16_t seq;           // ACK: next expected seq
+    };
+    SPSCQueue<TransferEvent, WIBLE_TRANSFER_EVENT_DEPTH> transferEvents;
+    portMUX_TYPE transferEventLock;
+    
+    uint8_t frameBuffer[WIBLE_MAX_ATT_PAYLOAD];
+    
+    // Write worker (producer: Bluedroid callback, consumer: writeWorker)
+    enum class LinkEvent : uint8_t {
+        WRITE,
+        CONNECT,            // data: peer address
+        DISCONNECT,         // data[0]: reason
+        MTU                 // data: MTU, little-endian
+    };
+    struct WriteSlot {
+        const String* characteristicUUID;   // Owned by the characteristic's callbacks
+        LinkEvent event;
+        uint16_t connId;
+        uint16_t length;
+        int64_t enqueuedAtUs;
+        uint8_t data[WIBLE_WRITE_SLOT_SIZE];
+    };
+    SPSCQueue<WriteSlot, WIBLE_WRITE_QUEUE_DEPTH> writeQueue;
+    TaskHandle_t writeWorker;
+    std::atomic<bool> writeWorkerStopRequested;
+    std::atomic<bool> writeWorkerRunning;
     
     // Callbacks
     BLEConnectionCallback connectionCallback;
     BLEDisconnectionCallback disconnectionCallback;
     BLEDataReceivedCallback dataReceivedCallback;
+    TransferSink transferSink;              // Write worker only
+    uint16_t transferSinkConnId;
+    // Sink handed over by setTransferSink, under connectionMutex
+    TransferSink pendingSink;
+    uint16_t pendingSinkConnId;
+    std::atomic<bool> sinkChangePending;
     MTUChangeCallback mtuChangeCallback;
     RSSIUpdateCallback rssiUpdateCallback;
     BLEScanCallback scanCallback;
+    ScanBatchCallback scanBatchCallback;
+    
+    // Connection-parameter policy, sampled from loop()
+    ConnectionTuner tuner;
+    
+    // Created on first use; the device table is several KB
+    std::unique_ptr<BLEScanner> scanner;
+    
+    // Created on first use, with the provisioning set's ID once added
+    std::unique_ptr<AdvertisingScheduler> advertisingSets;
+    int8_t provisioningSet;
+    
+    // Live broadcast: frames[front] is what the controller has, updates are
+    // composed in the other frame and swapped in with a raw data config
+    struct BroadcastState {
+        uint8_t frames[2][WIBLE_ADV_LEGACY_MAX];
+        uint8_t length;
+        uint8_t payloadOffset;
+        uint8_t payloadLength;
+        uint8_t front;
+        uint16_t companyId;
+        bool active;
+        bool pending;           // Back frame holds changes not yet sent
+        uint32_t startTime;
+        uint32_t lastPushTime;
+    } broadcast;
     
     // RSSI monitoring
     bool rssiMonitoringEnabled;
@@ -500,24 +1016,66 @@ private:
     uint32_t initTime;
     
     // Statistics
-    struct {
-        uint32_t totalConnections;
-        uint32_t totalDisconnections;
-        uint32_t totalBytesReceived;
-        uint32_t totalBytesSent;
-        uint32_t failedOperations;
-    } statistics;
+    BLEStatistics statistics;
     
     // Internal methods
     bool initializeServices();
     bool initializeCharacteristics();
     void setupCallbacks();
-    void handleConnection(const String& address);
-    void handleDisconnection(const String& address, uint8_t reason);
-    void handleCharacteristicWrite(const String& uuid, const std::vector<uint8_t>& data);
+    void handleConnection(uint16_t connId, const uint8_t* address);
+    void handleDisconnection(uint16_t connId, uint8_t reason);
+    void handleMtuChange(uint16_t connId, uint16_t mtu);
+    void serveConnection(ConnectionSlot& slot);
+    ConnectionSlot* findSlot(uint16_t connId);
+    const ConnectionSlot* findSlot(uint16_t connId) const;
+    ConnectionSlot* findOldestSlot(bool queued);
+    uint8_t countSlots(bool queued) const;
+    uint8_t countSlotsLocked(bool queued) const;
+    void resumeAdvertising();
+    void tuneConnections();
+    void applyLinkProfile(ConnectionSlot& slot, LinkProfile profile);
+    bool requestConnectionParams(ConnectionSlot& slot, const ConnectionParams& params);
+    void deliverScanBatch(const ScanEntry* entries, size_t count);
+    void applyRawAdvertisingData(const uint8_t* data, size_t length);
+    void applyRawScanResponseData(const uint8_t* data, size_t length);
+    bool swapAdvertisingData(const uint8_t* data, size_t length);
+    void pushBroadcast();
+    void recordAdvertisingGap(int64_t stoppedAtUs);
+    AdvertisingScheduler& scheduler();
+    void handleCharacteristicWrite(uint16_t connId, const String& uuid, uint8_t* data, size_t length);
+    bool enqueueWrite(uint16_t connId, const String* uuid, const uint8_t* data, size_t length);
+    bool enqueueLinkEvent(LinkEvent event, uint16_t connId, const uint8_t* data, size_t length);
+    void postLinkEvent(LinkEvent event, uint16_t connId, const uint8_t* data, size_t length);
+    void handleLinkEvent(LinkEvent event, uint16_t connId, const uint8_t* data);
+    void drainWriteQueue();
+    static void writeWorkerTask(void* param);
+    void stopWriteWorker();
+    void handleIncomingFrame(ConnectionSlot& slot, const uint8_t* frame, size_t length);
+    void applyPendingSink();
     bool executeOperation(const GATTOperation& operation);
+    uint16_t dispatchOperations(GATTPriority first, GATTPriority last, uint16_t budget);
+    uint8_t takeReadyOperation(GATTPriority first, GATTPriority last, uint32_t now);
+    void releaseOperation(uint8_t index);
+    void recordOperationLatency(uint32_t latencyMs);
+    void refreshSendCredits();
+    bool hasSendCredit(uint16_t connId) const;
+    void consumeSendCredit(uint16_t connId);
+    BLECharacteristic* findCharacteristic(const char* uuid) const;
+    bool notifyRaw(BLECharacteristic* characteristic, uint16_t connId, const uint8_t* data,
+                   size_t length, bool confirm = false);
+    bool sendToClient(BLECharacteristic* characteristic, uint16_t connId, const uint8_t* data,
+                      size_t length, bool confirm);
     std::vector<std::vector<uint8_t>> chunkData(const std::vector<uint8_t>& data, size_t chunkSize);
     void updateStatistics(uint32_t bytesReceived, uint32_t bytesSent);
+    uint16_t processOutgoingTransfer(uint16_t budget);
+    bool sendFrame(uint16_t seq);
+    void sendControlFrame(uint16_t connId, uint8_t type, uint16_t value);
+    void cancelOutgoingTransfer();
+    void handleTransferAck(uint16_t nextSeq);
+    void postTransferEvent(uint8_t type, uint16_t connId, uint16_t seq);
+    void applyTransferEvents();
+    void completeIncomingTransfer(ConnectionSlot& slot);
+    size_t frameOffset(uint16_t seq) const;
     
     // Server callbacks (static wrapper to member functions)
     class ServerCallbacks;
@@ -535,8 +1093,9 @@ class BLEManager::ServerCallbacks : public BLEServerCallbacks {
 public:
     ServerCallbacks(BLEManager* manager) : manager(manager) {}
     
-    void onConnect(BLEServer* server) override;
-    void onDisconnect(BLEServer* server) override;
+    // The overloads carrying conn_id and the peer address
+    void onConnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) override;
+    void onDisconnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) override;
     void onMtuChanged(BLEServer* server, esp_ble_gatts_cb_param_t* param) override;
 
 private:
@@ -552,7 +1111,7 @@ public:
     CharacteristicCallbacks(BLEManager* manager, String uuid) 
         : manager(manager), characteristicUUID(uuid) {}
     
-    void onWrite(BLECharacteristic* characteristic) override;
+    void onWrite(BLECharacteristic* characteristic, esp_ble_gatts_cb_param_t* param) override;
     void onRead(BLECharacteristic* characteristic) override;
     void onNotify(BLECharacteristic* characteristic) override;
 
@@ -573,13 +1132,15 @@ public:
     static String addressToString(const uint8_t* address);
     
     /**
-     * Parse advertising data
+     * Parse advertising data into owned copies, one per AD type. Allocates;
+     * on hot paths iterate an AdvertisingDataView instead.
      */
     static std::map<uint8_t, std::vector<uint8_t>> parseAdvertisingData(
         const std::vector<uint8_t>& data);
     
     /**
-     * Build advertising data
+     * Build advertising data, in AD type order; stops at the first
+     * structure that does not fit 255 bytes (see AdvertisingDataBuilder)
      */
     static std::vector<uint8_t> buildAdvertisingData(
         const std::map<uint8_t, std::vector<uint8_t>>& elements);
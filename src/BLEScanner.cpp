@@ -0,0 +1,353 @@
+/**
+ * BLEScanner.cpp - Continuous, deduplicating BLE scanner implementation
+ */
+
+#include "BLEScanner.h"
+#include "utils/LogManager.h"
+#include "utils/AdvertisingData.h"
+#include <string.h>
+
+namespace WiBLE {
+
+#define SCAN_TABLE_MASK (WIBLE_SCAN_TABLE_SIZE - 1)
+#define SCAN_TABLE_LOAD_LIMIT (WIBLE_SCAN_TABLE_SIZE * 3 / 4)
+
+static_assert((WIBLE_SCAN_TABLE_SIZE & SCAN_TABLE_MASK) == 0,
+              "WIBLE_SCAN_TABLE_SIZE must be a power of two");
+
+BLEScanner* BLEScanner::activeScanner = nullptr;
+
+static uint16_t msToScanUnits(uint16_t ms) {
+    // 0.625 ms units, within the controller's 2.5 ms .. 10.24 s range
+    uint32_t units = (uint32_t)ms * 8 / 5;
+    if (units < 0x0004) units = 0x0004;
+    if (units > 0x4000) units = 0x4000;
+    return (uint16_t)units;
+}
+
+// ============================================================================
+// FILTER / ENTRY HELPERS
+// ============================================================================
+
+void ScanFilter::setServiceUUID16(uint16_t uuid) {
+    serviceUUID[0] = uuid & 0xFF;
+    serviceUUID[1] = uuid >> 8;
+    serviceUUIDLength = 2;
+}
+
+bool ScanFilter::setServiceUUID128(const char* uuid) {
+    if (!parseUUID128(uuid, serviceUUID, true)) return false;
+    serviceUUIDLength = 16;
+    return true;
+}
+
+const uint8_t* ScanEntry::getManufacturerData(uint8_t& length) const {
+    uint16_t company;
+    AdStructure field;
+    if (!AdvertisingDataView(data, dataLength).findManufacturerData(company, field)) {
+        length = 0;
+        return nullptr;
+    }
+    length = field.length;
+    return field.data;
+}
+
+void ScanEntry::formatAddress(char* out) const {
+    snprintf(out, 18, "%02x:%02x:%02x:%02x:%02x:%02x",
+             address[0], address[1], address[2], address[3], address[4], address[5]);
+}
+
+// ============================================================================
+// BLE SCANNER IMPLEMENTATION
+// ============================================================================
+
+BLEScanner::BLEScanner()
+    : tracked(0),
+      tableMux(portMUX_INITIALIZER_UNLOCKED),
+      scanning(false),
+      finalBatchPending(false),
+      scanDuration(0),
+      lastBatchTime(0) {
+    memset(table, 0, sizeof(table));
+}
+
+BLEScanner::~BLEScanner() {
+    stop();
+    if (activeScanner == this) {
+        activeScanner = nullptr;
+    }
+}
+
+bool BLEScanner::start(const ScanConfig& config, uint32_t durationSeconds) {
+    if (activeScanner && activeScanner != this && activeScanner->scanning) {
+        WIBLE_LOGW("Another scanner is active");
+        return false;
+    }
+    if (scanning) stop();
+
+    this->config = config;
+    scanDuration = durationSeconds;
+    lastBatchTime = millis();
+    activeScanner = this;
+
+    // Results come through the custom GAP handler. BLEScan is never started,
+    // so the stack does not build a BLEAdvertisedDevice per packet.
+    BLEDevice::setCustomGapHandler(gapEventHandler);
+
+    uint16_t interval = msToScanUnits(config.intervalMs);
+    uint16_t window = msToScanUnits(config.windowMs);
+    if (window > interval) window = interval;
+
+    esp_ble_scan_params_t params = {};
+    params.scan_type = config.activeScan ? BLE_SCAN_TYPE_ACTIVE : BLE_SCAN_TYPE_PASSIVE;
+    params.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
+    params.scan_filter_policy = BLE_SCAN_FILTER_ALLOW_ALL;
+    params.scan_interval = interval;
+    params.scan_window = window;
+    params.scan_duplicate = BLE_SCAN_DUPLICATE_DISABLE;  // Every sample feeds the RSSI average
+
+    // Scanning starts once the controller confirms the parameters
+    scanning = true;
+    if (esp_ble_gap_set_scan_params(&params) != ESP_OK) {
+        scanning = false;
+        WIBLE_LOGE("Failed to set scan parameters");
+        return false;
+    }
+
+    WIBLE_LOGI("Scanning (%s, %u/%u ms, batch %u ms)", config.activeScan ? "active" : "passive",
+               (unsigned)config.windowMs, (unsigned)config.intervalMs, (unsigned)config.batchIntervalMs);
+    return true;
+}
+
+void BLEScanner::stop() {
+    if (!scanning) return;
+    scanning = false;
+    finalBatchPending = true;
+    esp_ble_gap_stop_scanning();
+    WIBLE_LOGI("Scanning stopped");
+}
+
+void BLEScanner::loop() {
+    bool due = scanning && config.batchIntervalMs > 0 &&
+               millis() - lastBatchTime >= config.batchIntervalMs;
+    if (due || finalBatchPending) {
+        finalBatchPending = false;
+        flush();
+    }
+}
+
+void BLEScanner::flush() {
+    size_t count = snapshot();
+    lastBatchTime = millis();
+    if (count > 0 && batchCallback) {
+        batchCallback(batch, count);
+    }
+    statistics.batchesDelivered++;
+}
+
+void BLEScanner::setFilter(const ScanFilter& filter) {
+    taskENTER_CRITICAL(&tableMux);
+    config.filter = filter;
+    taskEXIT_CRITICAL(&tableMux);
+}
+
+void BLEScanner::clear() {
+    taskENTER_CRITICAL(&tableMux);
+    for (Slot& slot : table) slot.used = false;
+    tracked = 0;
+    statistics.devicesTracked = 0;
+    taskEXIT_CRITICAL(&tableMux);
+}
+
+ScanStatistics BLEScanner::getStatistics() const {
+    return statistics;
+}
+
+// ============================================================================
+// INGEST (GAP CALLBACK)
+// ============================================================================
+
+void BLEScanner::gapEventHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+    BLEScanner* scanner = activeScanner;
+    if (!scanner) return;
+
+    switch (event) {
+        case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT:
+            if (scanner->scanning) {
+                esp_ble_gap_start_scanning(scanner->scanDuration);
+            }
+            break;
+
+        case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT:
+            if (param->scan_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+                scanner->scanning = false;
+                WIBLE_LOGE("Scan start failed: %d", (int)param->scan_start_cmpl.status);
+            }
+            break;
+
+        case ESP_GAP_BLE_SCAN_RESULT_EVT:
+            if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_RES_EVT) {
+                // Scan responses arrive as separate results without
+                // advertising data; only advertisements are tracked
+                if (param->scan_rst.adv_data_len > 0) {
+                    scanner->processAdvertisement(param->scan_rst.bda, param->scan_rst.ble_addr_type,
+                                                  (int8_t)param->scan_rst.rssi, param->scan_rst.ble_adv,
+                                                  param->scan_rst.adv_data_len);
+                }
+            } else if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_CMPL_EVT) {
+                // Timed scan ended; loop() delivers what is left
+                scanner->scanning = false;
+                scanner->finalBatchPending = true;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+bool BLEScanner::processAdvertisement(const uint8_t* address, uint8_t addressType, int8_t rssi,
+                                      const uint8_t* data, uint8_t length) {
+    if (length > WIBLE_SCAN_DATA_SIZE) length = WIBLE_SCAN_DATA_SIZE;
+    uint32_t now = millis();
+
+    taskENTER_CRITICAL(&tableMux);
+    statistics.advertisementsSeen++;
+
+    uint16_t companyId;
+    if (!passesFilter(data, length, rssi, companyId)) {
+        statistics.advertisementsFiltered++;
+        taskEXIT_CRITICAL(&tableMux);
+        return false;
+    }
+
+    bool inserted = false;
+    Slot* slot = findOrInsert(address, inserted);
+    if (!slot) {
+        statistics.devicesDropped++;
+        taskEXIT_CRITICAL(&tableMux);
+        return true;
+    }
+
+    ScanEntry& entry = slot->entry;
+    if (inserted) {
+        memcpy(entry.address, address, 6);
+        entry.firstSeen = now;
+        entry.advertisementCount = 0;
+        slot->rssiAccumulator = rssi * 16;
+        statistics.devicesAdded++;
+        statistics.devicesTracked = tracked;
+        if (tracked > statistics.peakDevicesTracked) statistics.peakDevicesTracked = tracked;
+    } else {
+        slot->rssiAccumulator += (rssi * 16 - slot->rssiAccumulator) >> config.rssiSmoothingShift;
+    }
+
+    entry.addressType = addressType;
+    entry.rssi = (int8_t)(slot->rssiAccumulator / 16);
+    entry.lastRSSI = rssi;
+    entry.companyId = companyId;
+    entry.dataLength = length;
+    memcpy(entry.data, data, length);
+    entry.lastSeen = now;
+    if (entry.advertisementCount < 0xFFFF) entry.advertisementCount++;
+
+    taskEXIT_CRITICAL(&tableMux);
+    return true;
+}
+
+bool BLEScanner::passesFilter(const uint8_t* data, uint8_t length, int8_t rssi,
+                              uint16_t& companyId) const {
+    const ScanFilter& filter = config.filter;
+    if (rssi < filter.minRSSI) return false;
+
+    AdvertisingDataView view(data, length);
+    AdStructure manufacturer;
+    if (!view.findManufacturerData(companyId, manufacturer)) {
+        companyId = WIBLE_COMPANY_ID_ANY;
+    }
+    if (filter.companyId != WIBLE_COMPANY_ID_ANY && companyId != filter.companyId) return false;
+    if (filter.serviceUUIDLength && !view.hasServiceUUID(filter.serviceUUID, filter.serviceUUIDLength)) {
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// DEVICE TABLE
+// ============================================================================
+
+size_t BLEScanner::hashAddress(const uint8_t* address) {
+    // FNV-1a over the six address bytes
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        hash ^= address[i];
+        hash *= 16777619u;
+    }
+    return hash & SCAN_TABLE_MASK;
+}
+
+BLEScanner::Slot* BLEScanner::findOrInsert(const uint8_t* address, bool& inserted) {
+    // Linear probing; the load limit guarantees an empty slot ends the probe
+    size_t index = hashAddress(address);
+    while (table[index].used) {
+        if (memcmp(table[index].entry.address, address, 6) == 0) {
+            inserted = false;
+            return &table[index];
+        }
+        index = (index + 1) & SCAN_TABLE_MASK;
+    }
+
+    if (tracked >= SCAN_TABLE_LOAD_LIMIT) return nullptr;
+    table[index].used = true;
+    tracked++;
+    inserted = true;
+    return &table[index];
+}
+
+void BLEScanner::removeAt(size_t index) {
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    size_t hole = index;
+    table[hole].used = false;
+    tracked--;
+
+    size_t next = (hole + 1) & SCAN_TABLE_MASK;
+    while (table[next].used) {
+        size_t home = hashAddress(table[next].entry.address);
+        bool reachable = (hole <= next) ? (hole < home && home <= next)
+                                        : (hole < home || home <= next);
+        if (!reachable) {
+            table[hole] = table[next];
+            table[next].used = false;
+            hole = next;
+        }
+        next = (next + 1) & SCAN_TABLE_MASK;
+    }
+}
+
+void BLEScanner::expireStale(uint32_t now) {
+    if (config.entryTimeoutMs == 0) return;
+    for (size_t i = 0; i < WIBLE_SCAN_TABLE_SIZE; ) {
+        if (table[i].used && now - table[i].entry.lastSeen > config.entryTimeoutMs) {
+            removeAt(i);
+            statistics.devicesExpired++;
+            continue;  // Re-check the entry shifted into this slot
+        }
+        i++;
+    }
+    statistics.devicesTracked = tracked;
+}
+
+size_t BLEScanner::snapshot() {
+    size_t count = 0;
+    taskENTER_CRITICAL(&tableMux);
+    expireStale(millis());
+    for (Slot& slot : table) {
+        if (!slot.used || slot.entry.advertisementCount == 0) continue;
+        batch[count++] = slot.entry;
+        slot.entry.advertisementCount = 0;
+    }
+    taskEXIT_CRITICAL(&tableMux);
+    return count;
+}
+
+} // namespace WiBLE
@@ -0,0 +1,203 @@
+/**
+ * BLEScanner.h - Continuous, deduplicating BLE scanner for gateway mode
+ *
+ * Advertisements are taken straight from the GAP callback, filtered on the
+ * raw bytes and folded into a fixed-size table keyed by MAC address, so a
+ * busy radio environment costs no allocations. The application receives a
+ * snapshot of the devices heard since the last batch at a fixed interval,
+ * from loop(), instead of one callback per packet.
+ */
+
+#ifndef WIBLE_BLE_SCANNER_H
+#define WIBLE_BLE_SCANNER_H
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <esp_gap_ble_api.h>
+#include <freertos/task.h>
+#include <functional>
+
+namespace WiBLE {
+
+// ============================================================================
+// SCANNER LIMITS
+// ============================================================================
+
+// Devices tracked at once (power of two). The table is never filled beyond
+// three quarters so probe chains stay short; further devices are dropped
+// until stale entries expire.
+#ifndef WIBLE_SCAN_TABLE_SIZE
+#define WIBLE_SCAN_TABLE_SIZE 64
+#endif
+
+// Advertising payload kept per device (legacy advertising PDU)
+#define WIBLE_SCAN_DATA_SIZE 31
+
+#define WIBLE_COMPANY_ID_ANY 0xFFFF
+#define WIBLE_RSSI_FLOOR_NONE -127
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+/**
+ * Filters applied to the raw advertisement before it touches the table
+ */
+struct ScanFilter {
+    uint16_t companyId = WIBLE_COMPANY_ID_ANY;   // Manufacturer data company ID
+    uint8_t serviceUUID[16] = {0};               // Little-endian, as on air
+    uint8_t serviceUUIDLength = 0;               // 0 (any), 2 or 16
+    int8_t minRSSI = WIBLE_RSSI_FLOOR_NONE;
+
+    /**
+     * Match a 16-bit service UUID, e.g. 0x181A
+     */
+    void setServiceUUID16(uint16_t uuid);
+
+    /**
+     * Match a 128-bit service UUID given as "xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx"
+     * @return false if the string is not a UUID
+     */
+    bool setServiceUUID128(const char* uuid);
+};
+
+struct ScanConfig {
+    uint16_t intervalMs = 100;
+    uint16_t windowMs = 30;
+    bool activeScan = false;            // Passive: no scan requests on air
+    uint32_t batchIntervalMs = 5000;    // 0: only flush() delivers (and expires)
+    uint32_t entryTimeoutMs = 60000;    // Forget devices not heard for this long
+    uint8_t rssiSmoothingShift = 2;     // EMA weight 1/2^n for each new sample
+    ScanFilter filter;
+};
+
+// ============================================================================
+// RESULTS
+// ============================================================================
+
+/**
+ * One tracked device, as delivered in a batch
+ */
+struct ScanEntry {
+    uint8_t address[6];
+    uint8_t addressType;
+    int8_t rssi;                        // Smoothed
+    int8_t lastRSSI;                    // Most recent sample
+    uint8_t dataLength;
+    uint8_t data[WIBLE_SCAN_DATA_SIZE]; // Most recent advertising payload
+    uint16_t companyId;                 // From manufacturer data, or WIBLE_COMPANY_ID_ANY
+    uint16_t advertisementCount;        // Since the previous batch
+    uint32_t firstSeen;
+    uint32_t lastSeen;
+
+    /**
+     * Manufacturer-specific data after the company ID, or nullptr
+     */
+    const uint8_t* getManufacturerData(uint8_t& length) const;
+
+    /**
+     * "aa:bb:cc:dd:ee:ff" into out (at least 18 bytes)
+     */
+    void formatAddress(char* out) const;
+};
+
+struct ScanStatistics {
+    uint32_t advertisementsSeen = 0;
+    uint32_t advertisementsFiltered = 0;
+    uint32_t devicesAdded = 0;
+    uint32_t devicesExpired = 0;
+    uint32_t devicesDropped = 0;        // Table full
+    uint32_t batchesDelivered = 0;
+    uint16_t devicesTracked = 0;
+    uint16_t peakDevicesTracked = 0;
+};
+
+/**
+ * Called from loop() with the devices heard since the previous batch.
+ * The entries are only valid for the duration of the call.
+ */
+using ScanBatchCallback = std::function<void(const ScanEntry* entries, size_t count)>;
+
+// ============================================================================
+// BLE SCANNER
+// ============================================================================
+
+class BLEScanner {
+public:
+    BLEScanner();
+    ~BLEScanner();
+
+    /**
+     * Start scanning. Uses the Arduino custom GAP handler, so only one
+     * scanner can be active at a time.
+     * @param durationSeconds 0 scans until stop()
+     */
+    bool start(const ScanConfig& config, uint32_t durationSeconds = 0);
+    void stop();
+    bool isScanning() const { return scanning; }
+
+    /**
+     * Deliver the pending batch when due and expire stale devices.
+     * Call regularly from the application task.
+     */
+    void loop();
+
+    /**
+     * Deliver the pending batch now, regardless of the interval
+     */
+    void flush();
+
+    void onBatch(ScanBatchCallback callback) { batchCallback = callback; }
+    void setFilter(const ScanFilter& filter);
+
+    /**
+     * Forget all tracked devices
+     */
+    void clear();
+
+    ScanStatistics getStatistics() const;
+
+    /**
+     * Feed one advertisement into the table. Called from the GAP callback;
+     * public so host builds can inject traffic.
+     * @return true if the advertisement passed the filters
+     */
+    bool processAdvertisement(const uint8_t* address, uint8_t addressType, int8_t rssi,
+                              const uint8_t* data, uint8_t length);
+
+    static void gapEventHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+
+private:
+    struct Slot {
+        ScanEntry entry;
+        int16_t rssiAccumulator;        // Smoothed RSSI scaled by 16
+        bool used;
+    };
+
+    Slot table[WIBLE_SCAN_TABLE_SIZE];
+    ScanEntry batch[WIBLE_SCAN_TABLE_SIZE];
+    uint16_t tracked;
+
+    ScanConfig config;
+    ScanStatistics statistics;
+    ScanBatchCallback batchCallback;
+    portMUX_TYPE tableMux;
+
+    volatile bool scanning;             // Cleared by the GAP callback when a timed scan ends
+    volatile bool finalBatchPending;
+    uint32_t scanDuration;
+    uint32_t lastBatchTime;
+
+    static BLEScanner* activeScanner;
+
+    bool passesFilter(const uint8_t* data, uint8_t length, int8_t rssi, uint16_t& companyId) const;
+    Slot* findOrInsert(const uint8_t* address, bool& inserted);
+    void removeAt(size_t index);
+    void expireStale(uint32_t now);
+    size_t snapshot();
+    static size_t hashAddress(const uint8_t* address);
+};
+
+} // namespace WiBLE
+
+#endif // WIBLE_BLE_SCANNER_H
@@ -0,0 +1,127 @@
+/**
+ * ConnectionTuner.cpp - Connection-parameter policy implementation
+ */
+
+#include "ConnectionTuner.h"
+#include "utils/LogManager.h"
+
+namespace WiBLE {
+
+// ============================================================================
+// LIFECYCLE
+// ============================================================================
+
+ConnectionTuner::ConnectionTuner() {
+    balanced = { 24, 24, 0, 400 };
+    for (LinkState& link : links) link = LinkState();
+}
+
+void ConnectionTuner::configure(const ConnectionTuningConfig& cfg, const ConnectionParams& balancedParams) {
+    config = cfg;
+    if (config.sampleIntervalMs == 0) config.sampleIntervalMs = 1;
+    balanced = balancedParams;
+}
+
+void ConnectionTuner::attach(uint8_t link, uint32_t now) {
+    if (link >= WIBLE_TUNER_MAX_LINKS) return;
+    LinkState& state = links[link];
+    state = LinkState();
+    state.lastSampleAt = now;
+    state.lastBusyAt = now;
+    state.lastActiveAt = now;
+    state.attached = true;
+}
+
+void ConnectionTuner::detach(uint8_t link) {
+    if (link < WIBLE_TUNER_MAX_LINKS) links[link].attached = false;
+}
+
+// ============================================================================
+// POLICY
+// ============================================================================
+
+bool ConnectionTuner::sample(uint8_t link, const LinkSample& sample, uint32_t now, LinkProfile& next) {
+    if (!config.enabled || link >= WIBLE_TUNER_MAX_LINKS) return false;
+    LinkState& state = links[link];
+    if (!state.attached) return false;
+
+    uint32_t elapsed = now - state.lastSampleAt;
+    if (elapsed < config.sampleIntervalMs) return false;
+
+    uint32_t moved = sample.bytes - state.lastBytes;
+    uint32_t rate = (uint32_t)((uint64_t)moved * 1000 / elapsed);
+    state.lastBytes = sample.bytes;
+    state.lastSampleAt = now;
+    state.stats.throughputBps = rate;
+
+    if (state.afterPending && now - state.stats.lastSwitchAt >= config.settleMs) {
+        state.afterPending = false;
+        state.stats.throughputAfterSwitchBps = rate;
+        WIBLE_LOGI("Link %u: %u B/s in %s (%u B/s before)", (unsigned)link, (unsigned)rate,
+                   profileToString(state.stats.profile), (unsigned)state.stats.throughputBeforeSwitchBps);
+    }
+
+    bool busy = sample.transferActive || sample.queueDepth >= config.burstQueueDepth ||
+                rate >= config.burstBytesPerSec;
+    bool active = busy || sample.queueDepth > 0 || rate >= config.idleBytesPerSec;
+    if (busy) state.lastBusyAt = now;
+    if (active) state.lastActiveAt = now;
+
+    LinkProfile current = state.stats.profile;
+    next = current;
+    if (busy) {
+        next = LinkProfile::BURST;
+    } else if (current == LinkProfile::BURST) {
+        if (now - state.lastBusyAt >= config.quietPeriodMs) next = LinkProfile::BALANCED;
+    } else if (current == LinkProfile::BALANCED) {
+        if (now - state.lastActiveAt >= config.idlePeriodMs) next = LinkProfile::IDLE;
+    } else if (active) {
+        next = LinkProfile::BALANCED;
+    }
+    return next != current;
+}
+
+void ConnectionTuner::switched(uint8_t link, LinkProfile profile, uint32_t now) {
+    if (link >= WIBLE_TUNER_MAX_LINKS) return;
+    LinkState& state = links[link];
+    WIBLE_LOGI("Link %u: %s -> %s at %u B/s", (unsigned)link, profileToString(state.stats.profile),
+               profileToString(profile), (unsigned)state.stats.throughputBps);
+
+    state.stats.throughputBeforeSwitchBps = state.stats.throughputBps;
+    state.stats.profile = profile;
+    state.stats.lastSwitchAt = now;
+    state.stats.switches++;
+    state.afterPending = true;
+
+    // Quiet and idle timers run from the switch, not from the last traffic
+    state.lastBusyAt = now;
+    state.lastActiveAt = now;
+}
+
+bool ConnectionTuner::needsLinkUpgrade(uint8_t link) const {
+    return link < WIBLE_TUNER_MAX_LINKS && !links[link].upgraded &&
+           (config.requestDataLength || (config.request2MPhy && WIBLE_BLE_2M_PHY));
+}
+
+void ConnectionTuner::markLinkUpgraded(uint8_t link) {
+    if (link < WIBLE_TUNER_MAX_LINKS) links[link].upgraded = true;
+}
+
+const ConnectionParams& ConnectionTuner::paramsFor(LinkProfile profile) const {
+    switch (profile) {
+        case LinkProfile::BURST: return config.burst;
+        case LinkProfile::IDLE: return config.idle;
+        default: return balanced;
+    }
+}
+
+const char* ConnectionTuner::profileToString(LinkProfile profile) {
+    switch (profile) {
+        case LinkProfile::BALANCED: return "BALANCED";
+        case LinkProfile::BURST: return "BURST";
+        case LinkProfile::IDLE: return "IDLE";
+        default: return "UNKNOWN";
+    }
+}
+
+} // namespace WiBLE
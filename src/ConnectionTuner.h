@@ -0,0 +1,168 @@
+/**
+ * ConnectionTuner.h - Connection-parameter policy for WiBLE links
+ *
+ * Watches traffic on every served link and picks one of three profiles:
+ *
+ *   BURST     short interval, no latency; Data Length Extension and 2M PHY
+ *             are requested on the first burst of a link
+ *   BALANCED  the BLEConfig connection parameters
+ *   IDLE      long interval with peripheral latency, to save power
+ *
+ * A link enters BURST while operations queue up, a chunked transfer runs
+ * or its throughput passes burstBytesPerSec. It falls back to BALANCED
+ * after quietPeriodMs below that, and to IDLE after idlePeriodMs with
+ * hardly any traffic. Any traffic brings an idle link back.
+ *
+ * The tuner only decides; BLEManager issues the GAP requests. The central
+ * has the final word on the parameters: iOS, for one, does not grant
+ * intervals below 15 ms.
+ */
+
+#ifndef WIBLE_CONNECTION_TUNER_H
+#define WIBLE_CONNECTION_TUNER_H
+
+#include <Arduino.h>
+
+namespace WiBLE {
+
+// ============================================================================
+// LINK LIMITS
+// ============================================================================
+
+// Links tracked; matches the BLEManager connection table
+#ifndef WIBLE_TUNER_MAX_LINKS
+#define WIBLE_TUNER_MAX_LINKS        4
+#endif
+
+// LE Data Length Extension: largest link-layer payload
+#define WIBLE_BLE_DLE_TX_OCTETS      251
+
+// 2M PHY when the Bluedroid build has BLE 5.0 features
+#ifndef WIBLE_BLE_2M_PHY
+#if defined(CONFIG_BT_BLE_50_FEATURES_SUPPORTED) && CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+#define WIBLE_BLE_2M_PHY 1
+#else
+#define WIBLE_BLE_2M_PHY 0
+#endif
+#endif
+
+enum class LinkProfile : uint8_t {
+    BALANCED = 0,
+    BURST = 1,
+    IDLE = 2
+};
+
+/**
+ * Connection parameters in controller units: intervals 1.25 ms,
+ * supervision timeout 10 ms
+ */
+struct ConnectionParams {
+    uint16_t minInterval;
+    uint16_t maxInterval;
+    uint16_t latency;
+    uint16_t timeout;
+};
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+struct ConnectionTuningConfig {
+    bool enabled = true;
+    ConnectionParams burst = { 6, 12, 0, 400 };     // 7.5-15 ms
+    ConnectionParams idle = { 80, 160, 4, 600 };    // 100-200 ms, 4 skipped events, 6 s
+
+    uint8_t burstQueueDepth = 4;        // Queued operations that start a burst
+    uint32_t burstBytesPerSec = 1024;   // Throughput that starts or holds a burst
+    uint32_t idleBytesPerSec = 16;      // Below this a link counts as quiet
+    uint32_t quietPeriodMs = 2000;      // BURST -> BALANCED
+    uint32_t idlePeriodMs = 15000;      // BALANCED -> IDLE
+    uint32_t sampleIntervalMs = 250;
+    uint32_t settleMs = 1000;           // Throughput after a switch is logged this long after it
+
+    bool requestDataLength = true;
+    bool request2MPhy = true;           // BLE 5 builds only
+};
+
+/**
+ * One sample of a link, taken every sampleIntervalMs
+ */
+struct LinkSample {
+    uint32_t bytes = 0;                 // Total moved on the link so far (both directions)
+    uint16_t queueDepth = 0;            // Operations waiting for the link
+    bool transferActive = false;        // Chunked transfer to or from it
+};
+
+struct LinkTuningStats {
+    LinkProfile profile = LinkProfile::BALANCED;
+    uint32_t throughputBps = 0;         // Last sample window
+    uint32_t switches = 0;
+    uint32_t lastSwitchAt = 0;
+    uint32_t throughputBeforeSwitchBps = 0;
+    uint32_t throughputAfterSwitchBps = 0;  // settleMs after the switch
+};
+
+// ============================================================================
+// CONNECTION TUNER
+// ============================================================================
+
+class ConnectionTuner {
+public:
+    ConnectionTuner();
+
+    /**
+     * @param balanced Parameters of the BALANCED profile
+     */
+    void configure(const ConnectionTuningConfig& config, const ConnectionParams& balanced);
+    const ConnectionTuningConfig& getConfig() const { return config; }
+    bool isEnabled() const { return config.enabled; }
+
+    /**
+     * Start tracking a newly served link in BALANCED
+     */
+    void attach(uint8_t link, uint32_t now);
+    void detach(uint8_t link);
+
+    /**
+     * Feed a sample; rate-limited to sampleIntervalMs per link
+     * @return true if the link should switch to `next`
+     */
+    bool sample(uint8_t link, const LinkSample& sample, uint32_t now, LinkProfile& next);
+
+    /**
+     * Record that the link switched (after the request was issued)
+     */
+    void switched(uint8_t link, LinkProfile profile, uint32_t now);
+
+    /**
+     * First burst of the link: DLE and PHY are requested once
+     */
+    bool needsLinkUpgrade(uint8_t link) const;
+    void markLinkUpgraded(uint8_t link);
+
+    const ConnectionParams& paramsFor(LinkProfile profile) const;
+    void setBalancedParams(const ConnectionParams& params) { balanced = params; }
+    const LinkTuningStats& getStats(uint8_t link) const { return links[link].stats; }
+
+    static const char* profileToString(LinkProfile profile);
+
+private:
+    struct LinkState {
+        LinkTuningStats stats;
+        uint32_t lastSampleAt;
+        uint32_t lastBytes;
+        uint32_t lastBusyAt;            // Burst conditions last seen
+        uint32_t lastActiveAt;          // Any traffic last seen
+        bool attached;
+        bool upgraded;                  // DLE / PHY requested
+        bool afterPending;              // Post-switch throughput not logged yet
+    };
+
+    ConnectionTuningConfig config;
+    ConnectionParams balanced;
+    LinkState links[WIBLE_TUNER_MAX_LINKS];
+};
+
+} // namespace WiBLE
+
+#endif // WIBLE_CONNECTION_TUNER_H
@@ -0,0 +1,470 @@
+/**
+ * ConnectivityValidator.cpp - Non-blocking connectivity check implementation
+ */
+
+#include "ConnectivityValidator.h"
+#include "utils/LogManager.h"
+#include <lwip/sockets.h>
+#include <errno.h>
+#include <string.h>
+
+namespace WiBLE {
+
+static const uint16_t DNS_PORT = 53;
+static const size_t DNS_HEADER = 12;
+static const uint8_t DNS_TYPE_A = 1;
+static const uint8_t DNS_CLASS_IN = 1;
+static const uint8_t ICMP_ECHO_REQUEST = 8;
+static const uint8_t ICMP_ECHO_REPLY = 0;
+static const size_t ICMP_ECHO_SIZE = 16;    // 8-byte header, 8 bytes of payload
+
+static int openSocket(int type, int protocol) {
+    int fd = socket(AF_INET, type, protocol);
+    if (fd < 0) return -1;
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void closeSocket(int& fd) {
+    if (fd >= 0) close(fd);
+    fd = -1;
+}
+
+static sockaddr_in socketAddress(uint32_t address, uint16_t port) {
+    sockaddr_in to;
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_port = htons(port);
+    to.sin_addr.s_addr = address;
+    return to;
+}
+
+// ============================================================================
+// LIFECYCLE
+// ============================================================================
+
+ConnectivityValidator::ConnectivityValidator()
+    : running(false),
+      startedAt(0),
+      gatewayAddress(0),
+      dnsAddress(0),
+      probeAddress(0),
+      icmpSocket(-1),
+      dnsSocket(-1),
+      probeSocket(-1),
+      echoId(0),
+      echoSequence(0),
+      queryId(0),
+      lastEchoAt(0),
+      lastQueryAt(0),
+      probeStartedAt(0),
+      probePhase(PROBE_IDLE),
+      probeHeadLength(0) {
+}
+
+ConnectivityValidator::~ConnectivityValidator() {
+    closeSockets();
+}
+
+void ConnectivityValidator::start(const ValidationConfig& cfg, uint32_t gateway, uint32_t dnsServer) {
+    closeSockets();
+    config = cfg;
+    if (config.retryMs == 0) config.retryMs = 1;
+    result = ValidationResult();
+    startedAt = millis();
+    gatewayAddress = gateway;
+    dnsAddress = dnsServer;
+    probeAddress = 0;
+    probePhase = PROBE_IDLE;
+    probeHeadLength = 0;
+
+    uint32_t seed = esp_random();
+    echoId = (uint16_t)seed;
+    queryId = (uint16_t)(seed >> 16);
+    echoSequence = 0;
+    running = true;
+
+    // Gateway: raw ICMP; a stack without raw sockets skips the stage
+    if (config.pingGateway && gatewayAddress != 0) {
+        icmpSocket = openSocket(SOCK_RAW, IPPROTO_ICMP);
+        if (icmpSocket < 0 || !sendEcho()) {
+            closeSocket(icmpSocket);
+            result.gateway.status = StageStatus::SKIPPED;
+        }
+        lastEchoAt = startedAt;
+    } else {
+        result.gateway.status = StageStatus::SKIPPED;
+    }
+
+    // DNS: an IP literal (or no host) needs no lookup
+    in_addr literal;
+    if (config.host.length() == 0) {
+        result.dns.status = StageStatus::SKIPPED;
+    } else if (inet_pton(AF_INET, config.host.c_str(), &literal) == 1) {
+        result.dns.status = StageStatus::SKIPPED;
+        probeAddress = literal.s_addr;
+    } else {
+        dnsSocket = openSocket(SOCK_DGRAM, IPPROTO_UDP);
+        if (dnsSocket < 0 || dnsAddress == 0 || !sendQuery()) {
+            closeSocket(dnsSocket);
+            settle(result.dns, StageStatus::FAILED, startedAt, startedAt);
+        }
+        lastQueryAt = startedAt;
+    }
+
+    if (!config.probeHttp || config.host.length() == 0) {
+        result.probe.status = StageStatus::SKIPPED;
+    } else if (probeAddress != 0) {
+        startProbe(startedAt);      // Runs alongside the gateway ping right away
+    }
+
+    WIBLE_LOGD("Validation: started (gateway %s, dns %s, probe %s)",
+               result.gateway.status == StageStatus::SKIPPED ? "off" : "on",
+               result.dns.status == StageStatus::SKIPPED ? "off" : "on",
+               result.probe.status == StageStatus::SKIPPED ? "off" : "on");
+}
+
+void ConnectivityValidator::cancel() {
+    if (running) finish(ValidationOutcome::CANCELLED, millis());
+}
+
+void ConnectivityValidator::closeSockets() {
+    closeSocket(icmpSocket);
+    closeSocket(dnsSocket);
+    closeSocket(probeSocket);
+}
+
+// ============================================================================
+// POLLING
+// ============================================================================
+
+bool ConnectivityValidator::poll() {
+    if (!running) return true;
+    uint32_t now = millis();
+
+    if (result.gateway.status == StageStatus::PENDING) pollGateway(now);
+    if (result.dns.status == StageStatus::PENDING) pollDns(now);
+    if (result.probe.status == StageStatus::PENDING && probePhase != PROBE_IDLE) pollProbe(now);
+
+    ValidationOutcome outcome = verdict(now);
+    if (outcome == ValidationOutcome::PENDING) return false;
+    finish(outcome, now);
+    return true;
+}
+
+ValidationOutcome ConnectivityValidator::verdict(uint32_t now) const {
+    // Decisive answers, whichever arrives first
+    if (result.probe.status == StageStatus::PASSED) return ValidationOutcome::REACHABLE;
+    if (result.httpStatus != 0) return ValidationOutcome::CAPTIVE_PORTAL;
+    if (result.dns.status == StageStatus::FAILED) return ValidationOutcome::DNS_FAILED;
+
+    bool resolved = result.dns.status == StageStatus::PASSED;
+    if (result.probe.status == StageStatus::FAILED) {
+        return resolved && !config.requireProbe ? ValidationOutcome::REACHABLE : ValidationOutcome::NO_INTERNET;
+    }
+    if (result.probe.status == StageStatus::SKIPPED) {
+        if (resolved) return ValidationOutcome::REACHABLE;
+        if (result.dns.status == StageStatus::SKIPPED && result.gateway.status != StageStatus::PENDING) {
+            return result.gateway.status == StageStatus::FAILED ? ValidationOutcome::NO_INTERNET
+                                                                : ValidationOutcome::REACHABLE;
+        }
+    }
+
+    if (now - startedAt < config.timeoutMs) return ValidationOutcome::PENDING;
+    // A resolver that answered is upstream reachability; a slow probe only fails when required
+    return resolved && !config.requireProbe ? ValidationOutcome::REACHABLE : ValidationOutcome::TIMEOUT;
+}
+
+void ConnectivityValidator::finish(ValidationOutcome outcome, uint32_t now) {
+    closeSockets();
+    running = false;
+    result.outcome = outcome;
+    result.success = outcome == ValidationOutcome::REACHABLE;
+    result.totalMs = now - startedAt;
+    WIBLE_LOGI("Validation: %s in %u ms (gateway %u, dns %u, probe %u ms)", outcomeToString(outcome),
+               (unsigned)result.totalMs, (unsigned)result.gateway.latencyMs, (unsigned)result.dns.latencyMs,
+               (unsigned)result.probe.latencyMs);
+}
+
+void ConnectivityValidator::settle(StageResult& stage, StageStatus status, uint32_t stageStart, uint32_t now) {
+    // Failures are timed too: a refused lookup after 40 ms tells more than none
+    uint32_t elapsed = now - stageStart;
+    stage.status = status;
+    stage.latencyMs = elapsed < WIBLE_VALIDATION_NOT_MEASURED ? (uint16_t)elapsed
+                                                              : WIBLE_VALIDATION_NOT_MEASURED - 1;
+}
+
+// ============================================================================
+// GATEWAY (ICMP)
+// ============================================================================
+
+bool ConnectivityValidator::sendEcho() {
+    uint8_t packet[ICMP_ECHO_SIZE];
+    buildEchoRequest(packet, echoId, ++echoSequence);
+    sockaddr_in to = socketAddress(gatewayAddress, 0);
+    return sendto(icmpSocket, packet, sizeof(packet), 0, (sockaddr*)&to, sizeof(to)) == (int)sizeof(packet);
+}
+
+void ConnectivityValidator::pollGateway(uint32_t now) {
+    uint8_t packet[64];
+    sockaddr_in from;
+    socklen_t fromLength = sizeof(from);
+    int length;
+    while ((length = recvfrom(icmpSocket, packet, sizeof(packet), 0, (sockaddr*)&from, &fromLength)) > 0) {
+        fromLength = sizeof(from);
+        if (from.sin_addr.s_addr != gatewayAddress) continue;
+
+        // Raw IPv4 sockets deliver the IP header too
+        size_t offset = (packet[0] >> 4) == 4 ? (size_t)(packet[0] & 0x0F) * 4 : 0;
+        if ((size_t)length < offset + 8) continue;
+        const uint8_t* icmp = packet + offset;
+        uint16_t id = (uint16_t)((icmp[4] << 8) | icmp[5]);
+        if (icmp[0] != ICMP_ECHO_REPLY || id != echoId) continue;
+
+        settle(result.gateway, StageStatus::PASSED, startedAt, now);
+        closeSocket(icmpSocket);
+        return;
+    }
+
+    if (now - lastEchoAt >= config.retryMs) {
+        lastEchoAt = now;
+        sendEcho();
+    }
+}
+
+size_t ConnectivityValidator::buildEchoRequest(uint8_t* out, uint16_t id, uint16_t sequence) {
+    memset(out, 0, ICMP_ECHO_SIZE);
+    out[0] = ICMP_ECHO_REQUEST;
+    out[4] = (uint8_t)(id >> 8);
+    out[5] = (uint8_t)id;
+    out[6] = (uint8_t)(sequence >> 8);
+    out[7] = (uint8_t)sequence;
+    memcpy(out + 8, "WiBLEchk", 8);
+
+    uint32_t sum = 0;
+    for (size_t i = 0; i < ICMP_ECHO_SIZE; i += 2) {
+        sum += (uint32_t)((out[i] << 8) | out[i + 1]);
+    }
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    uint16_t checksum = (uint16_t)~sum;
+    out[2] = (uint8_t)(checksum >> 8);
+    out[3] = (uint8_t)checksum;
+    return ICMP_ECHO_SIZE;
+}
+
+// ============================================================================
+// DNS
+// ============================================================================
+
+bool ConnectivityValidator::sendQuery() {
+    uint8_t query[DNS_HEADER + 256 + 4];
+    size_t length = buildDnsQuery(query, sizeof(query), queryId, config.host.c_str());
+    if (length == 0) return false;
+    sockaddr_in to = socketAddress(dnsAddress, DNS_PORT);
+    return sendto(dnsSocket, query, length, 0, (sockaddr*)&to, sizeof(to)) == (int)length;
+}
+
+void ConnectivityValidator::pollDns(uint32_t now) {
+    uint8_t reply[WIBLE_DNS_MESSAGE_MAX];
+    sockaddr_in from;
+    socklen_t fromLength = sizeof(from);
+    int length;
+    while ((length = recvfrom(dnsSocket, reply, sizeof(reply), 0, (sockaddr*)&from, &fromLength)) > 0) {
+        fromLength = sizeof(from);
+        if (from.sin_addr.s_addr != dnsAddress) continue;
+
+        uint32_t address = 0;
+        uint8_t rcode = 0;
+        int parsed = parseDnsResponse(reply, (size_t)length, queryId, address, rcode);
+        if (parsed < 0) continue;
+
+        closeSocket(dnsSocket);
+        if (parsed == 0) {
+            WIBLE_LOGW("Validation: lookup of %s failed (rcode %u)", config.host.c_str(), (unsigned)rcode);
+            settle(result.dns, StageStatus::FAILED, startedAt, now);
+            return;
+        }
+        settle(result.dns, StageStatus::PASSED, startedAt, now);
+        result.resolvedAddress = address;
+        probeAddress = address;
+        if (result.probe.status == StageStatus::PENDING) startProbe(now);
+        return;
+    }
+
+    if (now - lastQueryAt >= config.retryMs) {
+        lastQueryAt = now;
+        sendQuery();
+    }
+}
+
+size_t ConnectivityValidator::buildDnsQuery(uint8_t* out, size_t capacity, uint16_t id, const char* host) {
+    size_t hostLength = strlen(host);
+    // Header, labels (one length byte more than the dots), root label, type and class
+    if (hostLength == 0 || hostLength > 253 || DNS_HEADER + hostLength + 2 + 4 > capacity) return 0;
+
+    memset(out, 0, DNS_HEADER);
+    out[0] = (uint8_t)(id >> 8);
+    out[1] = (uint8_t)id;
+    out[2] = 0x01;      // Recursion desired
+    out[5] = 1;         // One question
+
+    size_t used = DNS_HEADER;
+    const char* label = host;
+    while (*label) {
+        const char* dot = strchr(label, '.');
+        size_t labelLength = dot ? (size_t)(dot - label) : strlen(label);
+        if (labelLength == 0 || labelLength > 63) return 0;
+        out[used++] = (uint8_t)labelLength;
+        memcpy(out + used, label, labelLength);
+        used += labelLength;
+        label += labelLength;
+        if (*label == '.') label++;
+    }
+    out[used++] = 0;
+    out[used++] = 0;
+    out[used++] = DNS_TYPE_A;
+    out[used++] = 0;
+    out[used++] = DNS_CLASS_IN;
+    return used;
+}
+
+// Skip a possibly compressed name; returns the offset after it, 0 if malformed
+static size_t skipName(const uint8_t* data, size_t length, size_t offset) {
+    while (offset < length) {
+        uint8_t labelLength = data[offset];
+        if (labelLength == 0) return offset + 1;
+        if ((labelLength & 0xC0) == 0xC0) return offset + 2 <= length ? offset + 2 : 0;
+        offset += 1 + labelLength;
+    }
+    return 0;
+}
+
+int ConnectivityValidator::parseDnsResponse(const uint8_t* data, size_t length, uint16_t id,
+                                            uint32_t& address, uint8_t& rcode) {
+    if (length < DNS_HEADER) return -1;
+    if ((uint16_t)((data[0] << 8) | data[1]) != id || !(data[2] & 0x80)) return -1;
+
+    rcode = data[3] & 0x0F;
+    if (rcode != 0) return 0;
+
+    uint16_t questions = (uint16_t)((data[4] << 8) | data[5]);
+    uint16_t answers = (uint16_t)((data[6] << 8) | data[7]);
+    size_t offset = DNS_HEADER;
+    for (uint16_t i = 0; i < questions; i++) {
+        offset = skipName(data, length, offset);
+        if (offset == 0 || offset + 4 > length) return 0;
+        offset += 4;
+    }
+
+    // CNAME chains come first; the first A record wins
+    for (uint16_t i = 0; i < answers; i++) {
+        offset = skipName(data, length, offset);
+        if (offset == 0 || offset + 10 > length) return 0;
+        uint16_t type = (uint16_t)((data[offset] << 8) | data[offset + 1]);
+        uint16_t recordClass = (uint16_t)((data[offset + 2] << 8) | data[offset + 3]);
+        uint16_t dataLength = (uint16_t)((data[offset + 8] << 8) | data[offset + 9]);
+        offset += 10;
+        if (offset + dataLength > length) return 0;
+        if (type == DNS_TYPE_A && recordClass == DNS_CLASS_IN && dataLength == 4) {
+            memcpy(&address, data + offset, 4);     // Already network byte order
+            return 1;
+        }
+        offset += dataLength;
+    }
+    return 0;
+}
+
+// ============================================================================
+// CAPTIVE-PORTAL PROBE
+// ============================================================================
+
+void ConnectivityValidator::startProbe(uint32_t now) {
+    probeStartedAt = now;
+    probeSocket = openSocket(SOCK_STREAM, IPPROTO_TCP);
+    if (probeSocket < 0) {
+        settle(result.probe, StageStatus::FAILED, probeStartedAt, now);
+        return;
+    }
+
+    sockaddr_in to = socketAddress(probeAddress, config.probePort);
+    if (connect(probeSocket, (sockaddr*)&to, sizeof(to)) < 0 && errno != EINPROGRESS) {
+        closeSocket(probeSocket);
+        settle(result.probe, StageStatus::FAILED, probeStartedAt, now);
+        return;
+    }
+    probePhase = PROBE_CONNECTING;
+}
+
+void ConnectivityValidator::pollProbe(uint32_t now) {
+    if (probePhase == PROBE_CONNECTING) {
+        fd_set writable;
+        FD_ZERO(&writable);
+        FD_SET(probeSocket, &writable);
+        timeval immediate = { 0, 0 };
+        if (select(probeSocket + 1, nullptr, &writable, nullptr, &immediate) <= 0) return;
+
+        int error = 0;
+        socklen_t errorLength = sizeof(error);
+        getsockopt(probeSocket, SOL_SOCKET, SO_ERROR, &error, &errorLength);
+        if (error != 0) {
+            WIBLE_LOGW("Validation: probe connect failed (%d)", error);
+            closeSocket(probeSocket);
+            settle(result.probe, StageStatus::FAILED, probeStartedAt, now);
+            return;
+        }
+
+        String request = "GET " + config.probePath + " HTTP/1.1\r\nHost: " + config.host +
+                         "\r\nConnection: close\r\n\r\n";
+        if (send(probeSocket, request.c_str(), request.length(), 0) != (int)request.length()) {
+            closeSocket(probeSocket);
+            settle(result.probe, StageStatus::FAILED, probeStartedAt, now);
+            return;
+        }
+        probePhase = PROBE_SENT;
+    }
+
+    int received = recv(probeSocket, probeHead + probeHeadLength, sizeof(probeHead) - probeHeadLength, 0);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+    if (received > 0) probeHeadLength += (size_t)received;
+
+    uint16_t status = parseHttpStatus(probeHead, probeHeadLength);
+    if (status == 0 && received > 0 && probeHeadLength < sizeof(probeHead)) return;
+
+    // Status line complete, buffer full, connection closed or reset
+    closeSocket(probeSocket);
+    result.httpStatus = status == 204 ? 0 : status;
+    settle(result.probe, status == 204 ? StageStatus::PASSED : StageStatus::FAILED, probeStartedAt, now);
+    if (status != 0 && status != 204) {
+        WIBLE_LOGW("Validation: probe answered %u, captive portal", (unsigned)status);
+    }
+}
+
+uint16_t ConnectivityValidator::parseHttpStatus(const char* head, size_t length) {
+    // "HTTP/1.1 204"
+    if (length < 12 || memcmp(head, "HTTP/1.", 7) != 0 || head[8] != ' ') return 0;
+    uint16_t status = 0;
+    for (size_t i = 9; i < 12; i++) {
+        if (head[i] < '0' || head[i] > '9') return 0;
+        status = (uint16_t)(status * 10 + (head[i] - '0'));
+    }
+    return status;
+}
+
+const char* ConnectivityValidator::outcomeToString(ValidationOutcome outcome) {
+    switch (outcome) {
+        case ValidationOutcome::PENDING: return "PENDING";
+        case ValidationOutcome::REACHABLE: return "REACHABLE";
+        case ValidationOutcome::CAPTIVE_PORTAL: return "CAPTIVE_PORTAL";
+        case ValidationOutcome::DNS_FAILED: return "DNS_FAILED";
+        case ValidationOutcome::NO_INTERNET: return "NO_INTERNET";
+        case ValidationOutcome::TIMEOUT: return "TIMEOUT";
+        case ValidationOutcome::CANCELLED: return "CANCELLED";
+        default: return "UNKNOWN";
+    }
+}
+
+} // namespace WiBLE
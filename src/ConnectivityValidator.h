@@ -0,0 +1,199 @@
+/**
+ * ConnectivityValidator.h - Non-blocking post-connect connectivity check
+ *
+ * Runs three probes side by side on non-blocking lwIP sockets:
+ *
+ *   GATEWAY  ICMP echo to the gateway (diagnostic only: many APs drop it)
+ *   DNS      A query for the probe host, sent straight to the resolver
+ *   PROBE    HTTP GET of a generate_204 URL once the host is resolved;
+ *            204 means open internet, any other answer a captive portal
+ *
+ * poll() advances every stage and settles on the first decisive signal,
+ * so a healthy network validates in one DNS plus one HTTP round trip.
+ * Each stage reports the time from its start to its answer.
+ */
+
+#ifndef WIBLE_CONNECTIVITY_VALIDATOR_H
+#define WIBLE_CONNECTIVITY_VALIDATOR_H
+
+#include <Arduino.h>
+#include <functional>
+
+namespace WiBLE {
+
+// ============================================================================
+// VALIDATION LIMITS
+// ============================================================================
+
+#ifndef WIBLE_VALIDATION_HOST
+#define WIBLE_VALIDATION_HOST        "connectivitycheck.gstatic.com"
+#endif
+
+// Stage latency that was never measured
+#define WIBLE_VALIDATION_NOT_MEASURED 0xFFFF
+
+// DNS over UDP stays within 512 bytes
+#define WIBLE_DNS_MESSAGE_MAX        512
+
+// Bytes of the probe response kept to find the status line
+#define WIBLE_VALIDATION_HTTP_HEAD   32
+
+enum class ValidationOutcome : uint8_t {
+    PENDING = 0,
+    REACHABLE = 1,          // Probe answered 204, or the host resolved and no probe ran
+    CAPTIVE_PORTAL = 2,     // Probe answered with anything but 204
+    DNS_FAILED = 3,         // Resolver refused or does not know the host
+    NO_INTERNET = 4,        // Probe could not connect (requireProbe, or host given as an IP)
+    TIMEOUT = 5,            // No decisive answer within timeoutMs
+    CANCELLED = 6           // Link dropped or the caller aborted
+};
+
+/**
+ * PENDING after the verdict means the stage had not answered by then
+ */
+enum class StageStatus : uint8_t {
+    PENDING = 0,
+    PASSED = 1,
+    FAILED = 2,
+    SKIPPED = 3
+};
+
+// ============================================================================
+// CONFIGURATION AND RESULT
+// ============================================================================
+
+struct ValidationConfig {
+    bool pingGateway = true;
+    bool probeHttp = true;
+    bool requireProbe = false;          // Fail when the probe cannot connect (firewalled port 80 passes on DNS)
+    String host = WIBLE_VALIDATION_HOST;    // Resolved, then probed; an IP skips DNS, empty skips both
+    String probePath = "/generate_204";
+    uint16_t probePort = 80;
+    uint32_t timeoutMs = 4000;
+    uint32_t retryMs = 1000;            // ICMP and DNS retransmission
+};
+
+struct StageResult {
+    StageStatus status = StageStatus::PENDING;
+    uint16_t latencyMs = WIBLE_VALIDATION_NOT_MEASURED;
+};
+
+struct ValidationResult {
+    ValidationOutcome outcome = ValidationOutcome::PENDING;
+    bool success = false;               // outcome == REACHABLE
+    StageResult gateway;
+    StageResult dns;
+    StageResult probe;
+    uint16_t httpStatus = 0;            // Probe status line, 0 without an answer
+    uint32_t resolvedAddress = 0;       // Network byte order
+    uint32_t totalMs = 0;
+};
+
+using ValidationCallback = std::function<void(const ValidationResult& result)>;
+
+// ============================================================================
+// CONNECTIVITY VALIDATOR
+// ============================================================================
+
+class ConnectivityValidator {
+public:
+    ConnectivityValidator();
+    ~ConnectivityValidator();
+
+    /**
+     * Open the sockets and send the first packets; never blocks.
+     * Stages that cannot open their socket are skipped or failed.
+     * @param gateway ICMP target, network byte order (0 skips the stage)
+     * @param dnsServer Resolver, network byte order
+     */
+    void start(const ValidationConfig& config, uint32_t gateway, uint32_t dnsServer);
+
+    /**
+     * Advance every stage; call from loop()
+     * @return true once the result is final
+     */
+    bool poll();
+
+    /**
+     * Abort a running validation with CANCELLED
+     */
+    void cancel();
+
+    bool isRunning() const { return running; }
+    const ValidationResult& getResult() const { return result; }
+
+    static const char* outcomeToString(ValidationOutcome outcome);
+
+    // ========================================================================
+    // WIRE FORMAT
+    // ========================================================================
+
+    /**
+     * DNS A query with recursion desired
+     * @return Message length, 0 if the name does not fit
+     */
+    static size_t buildDnsQuery(uint8_t* out, size_t capacity, uint16_t id, const char* host);
+
+    /**
+     * @return 1 with the first A record in address, 0 for a failed lookup
+     *         (rcode set), -1 if data is not a reply to id
+     */
+    static int parseDnsResponse(const uint8_t* data, size_t length, uint16_t id, uint32_t& address,
+                                uint8_t& rcode);
+
+    /**
+     * ICMP echo request, 16 bytes
+     */
+    static size_t buildEchoRequest(uint8_t* out, uint16_t id, uint16_t sequence);
+
+    /**
+     * Status code of an "HTTP/1.x NNN" line, 0 if incomplete or malformed
+     */
+    static uint16_t parseHttpStatus(const char* head, size_t length);
+
+private:
+    enum ProbePhase : uint8_t {
+        PROBE_IDLE,
+        PROBE_CONNECTING,
+        PROBE_SENT
+    };
+
+    ValidationConfig config;
+    ValidationResult result;
+    bool running;
+
+    uint32_t startedAt;
+    uint32_t gatewayAddress;
+    uint32_t dnsAddress;
+    uint32_t probeAddress;
+
+    int icmpSocket;
+    int dnsSocket;
+    int probeSocket;
+
+    uint16_t echoId;
+    uint16_t echoSequence;
+    uint16_t queryId;
+    uint32_t lastEchoAt;
+    uint32_t lastQueryAt;
+    uint32_t probeStartedAt;
+    ProbePhase probePhase;
+
+    char probeHead[WIBLE_VALIDATION_HTTP_HEAD];
+    size_t probeHeadLength;
+
+    void pollGateway(uint32_t now);
+    void pollDns(uint32_t now);
+    void pollProbe(uint32_t now);
+    bool sendEcho();
+    bool sendQuery();
+    void startProbe(uint32_t now);
+    void settle(StageResult& stage, StageStatus status, uint32_t stageStart, uint32_t now);
+    ValidationOutcome verdict(uint32_t now) const;
+    void finish(ValidationOutcome outcome, uint32_t now);
+    void closeSockets();
+};
+
+} // namespace WiBLE
+
+#endif // WIBLE_CONNECTIVITY_VALIDATOR_H
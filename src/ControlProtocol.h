@@ -0,0 +1,132 @@
+/**
+ * ControlProtocol.h - Batched commands on the control characteristic
+ *
+ * One write can carry several commands and gets one notification back:
+ *
+ *   BATCH   [0x07] { [opcode][payload length][payload] }...
+ *        -> [0x07] [count | 0x80 if truncated] { [opcode][ControlStatus][reply length][reply] }...
+ *
+ * A command written on its own ([opcode][payload...]) is answered the same
+ * way, as a batch of one. The reply is at most one notification at the
+ * client's MTU: a command whose reply does not fit in the room left answers
+ * REPLY_TOO_LARGE, and once not even an entry header fits the remaining
+ * commands are not run and the count is flagged truncated. A malformed
+ * entry answers INVALID_PAYLOAD and ends the batch.
+ *
+ * Built-in commands:
+ *   SCAN_WIFI    [flags]                -> (none); scan pages follow as before
+ *   GET_STATUS   (none)                 -> [ProvisioningState][WiFi up][RSSI][IPv4 (4)]
+ *                                          [BLE clients][queued][credentials stored]
+ *   SET_PARAM    [ControlParam][value]  -> (none)
+ *   REBOOT       ([delay ms u16])       -> (none); restarts once the reply is out
+ *   GET_METRICS  (none)                 -> [uptime s u32][attempts][successes][failures]
+ *                                          [avg provisioning ms][avg connection ms]
+ *                                          [BLE drops][WiFi drops][free heap u32]
+ *                                          (u16 unless noted, LE, saturating)
+ * Opcodes WIBLE_OP_APP_FIRST..WIBLE_OP_APP_LAST are free for the application
+ * (WiBLE::registerControlCommand). With encryption on, every command needs
+ * an authenticated connection.
+ */
+
+#ifndef WIBLE_CONTROL_PROTOCOL_H
+#define WIBLE_CONTROL_PROTOCOL_H
+
+#include <Arduino.h>
+#include <functional>
+
+namespace WiBLE {
+
+// ============================================================================
+// OPCODES AND LIMITS
+// ============================================================================
+
+#define WIBLE_OP_BATCH               0x07
+#define WIBLE_OP_GET_STATUS          0x08
+#define WIBLE_OP_SET_PARAM           0x09
+#define WIBLE_OP_REBOOT              0x0A
+#define WIBLE_OP_GET_METRICS         0x0B
+
+#define WIBLE_OP_APP_FIRST           0x40
+#define WIBLE_OP_APP_LAST            0x7F
+
+#define WIBLE_CONTROL_TRUNCATED      0x80    // In the reply count
+#define WIBLE_CONTROL_ENTRY_HEADER   3       // [opcode][status][length]
+
+// Largest reply: one notification at a 247-byte MTU
+#define WIBLE_CONTROL_REPLY_MAX      244
+
+#ifndef WIBLE_CONTROL_APP_COMMANDS
+#define WIBLE_CONTROL_APP_COMMANDS   8
+#endif
+
+// Lets the REBOOT reply reach the phone
+#define WIBLE_CONTROL_REBOOT_DELAY_MS 500
+
+enum class ControlStatus : uint8_t {
+    OK = 0,
+    UNKNOWN_COMMAND = 1,
+    INVALID_PAYLOAD = 2,
+    AUTH_REQUIRED = 3,
+    BUSY = 4,
+    UNSUPPORTED = 5,
+    REPLY_TOO_LARGE = 6,
+    FAILED = 7
+};
+
+// SET_PARAM parameters
+enum class ControlParam : uint8_t {
+    LOG_LEVEL = 0x01,       // [LogLevel]
+    WIRE_FORMAT = 0x02      // [WireFormat], same as SET_FORMAT
+};
+
+// ============================================================================
+// REPLY WRITER
+// ============================================================================
+
+/**
+ * A command's reply bytes, written straight into the batch notification
+ */
+class ControlReply {
+public:
+    ControlReply(uint8_t* buffer, size_t capacity) : buffer(buffer), capacity(capacity), used(0) {}
+
+    bool put(const uint8_t* data, size_t length) {
+        if (length > capacity - used) return false;
+        memcpy(buffer + used, data, length);
+        used += length;
+        return true;
+    }
+    bool putU8(uint8_t value) { return put(&value, 1); }
+    bool putU16(uint16_t value) {
+        uint8_t bytes[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+        return put(bytes, sizeof(bytes));
+    }
+    bool putU32(uint32_t value) {
+        uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+        return put(bytes, sizeof(bytes));
+    }
+
+    /**
+     * Room for writing directly; call commit() with what was written
+     */
+    uint8_t* tail() { return buffer + used; }
+    size_t available() const { return capacity - used; }
+    void commit(size_t length) { used += length <= available() ? length : available(); }
+
+    size_t length() const { return used; }
+
+private:
+    uint8_t* buffer;
+    size_t capacity;
+    size_t used;
+};
+
+/**
+ * Application command handler; payload is the command's own bytes
+ */
+using ControlCommandHandler = std::function<ControlStatus(uint16_t connId, const uint8_t* payload,
+                                                          size_t length, ControlReply& reply)>;
+
+} // namespace WiBLE
+
+#endif // WIBLE_CONTROL_PROTOCOL_H
@@ -0,0 +1,130 @@
+/**
+ * EventBus.cpp - Event queue and listener dispatch
+ */
+
+#include "EventBus.h"
+#include "utils/LogManager.h"
+#include "utils/Metrics.h"
+#include <esp_timer.h>
+#include <type_traits>
+
+namespace WiBLE {
+
+static_assert(std::is_trivially_copyable<Event>::value, "Events are copied by value into the queue");
+
+void Event::setText(const char* source) {
+    strncpy(text, source ? source : "", sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+}
+
+EventBus::EventBus()
+    : delivery(EventDelivery::IMMEDIATE), slowListenerUs(WIBLE_EVENT_SLOW_LISTENER_US),
+      queueLock(portMUX_INITIALIZER_UNLOCKED) {
+    for (Listener& listener : listeners) {
+        listener.function = nullptr;
+        listener.context = nullptr;
+        listener.mask = 0;
+        listener.name = "";
+        listener.maxUs = 0;
+    }
+}
+
+// ============================================================================
+// LISTENERS
+// ============================================================================
+
+bool EventBus::subscribe(uint32_t mask, EventListener function, void* context, const char* name) {
+    if (!function) return false;
+    for (Listener& listener : listeners) {
+        if (listener.function) continue;
+        listener.function = function;
+        listener.context = context;
+        listener.mask = mask;
+        listener.name = name;
+        listener.maxUs = 0;
+        return true;
+    }
+    WIBLE_LOGW("No free event listener slot for %s", name);
+    return false;
+}
+
+void EventBus::unsubscribe(EventListener function, void* context) {
+    for (Listener& listener : listeners) {
+        if (listener.function == function && listener.context == context) {
+            listener.function = nullptr;
+            listener.mask = 0;
+        }
+    }
+}
+
+// ============================================================================
+// PUBLISHING AND DELIVERY
+// ============================================================================
+
+bool EventBus::publish(Event& event) {
+    event.timestampMs = millis();
+    if (delivery == EventDelivery::IMMEDIATE) {
+        statistics.published++;
+        deliver(event);
+        return true;
+    }
+
+    taskENTER_CRITICAL(&queueLock);
+    Event* slot = queue.beginWrite();
+    if (slot) {
+        *slot = event;
+        queue.commitWrite();
+        statistics.published++;
+        uint16_t depth = (uint16_t)queue.size();
+        if (depth > statistics.maxQueueDepth) statistics.maxQueueDepth = depth;
+    } else {
+        statistics.dropped++;
+    }
+    taskEXIT_CRITICAL(&queueLock);
+    return slot != nullptr;
+}
+
+void EventBus::dispatch() {
+    // Events published by listeners wait for the next call
+    size_t pending = queue.size();
+    Event event;
+    Event* slot;
+    while (pending-- > 0 && (slot = queue.front()) != nullptr) {
+        event = *slot;
+        queue.pop();
+        deliver(event);
+    }
+}
+
+void EventBus::deliver(const Event& event) {
+    uint32_t bit = WIBLE_EVENT_MASK(event.type);
+    for (Listener& listener : listeners) {
+        if (!listener.function || !(listener.mask & bit)) continue;
+
+        int64_t startedAt = esp_timer_get_time();
+        listener.function(event, listener.context);
+        uint32_t elapsed = (uint32_t)(esp_timer_get_time() - startedAt);
+
+        statistics.delivered++;
+        Metrics::observe(MetricHistogram::LISTENER_US, elapsed);
+        if (elapsed > statistics.maxListenerUs) statistics.maxListenerUs = elapsed;
+        if (elapsed > slowListenerUs) {
+            statistics.slowCalls++;
+            Metrics::increment(MetricCounter::SLOW_LISTENERS);
+            // Once per new worst case, so a slow callback does not flood the log
+            if (elapsed > listener.maxUs) {
+                WIBLE_LOGW("Slow %s for event %u: %u us", listener.name, (unsigned)event.type,
+                           (unsigned)elapsed);
+            }
+        }
+        if (elapsed > listener.maxUs) listener.maxUs = elapsed;
+    }
+}
+
+EventBusStatistics EventBus::getStatistics() const {
+    EventBusStatistics snapshot = statistics;
+    snapshot.queued = (uint16_t)queue.size();
+    return snapshot;
+}
+
+} // namespace WiBLE
@@ -0,0 +1,157 @@
+/**
+ * EventBus.h - Fixed-size event dispatch between WiBLE components
+ *
+ * Components publish small POD events; listeners registered in a static
+ * table receive the ones whose type is in their mask. Nothing is allocated:
+ * an event is copied by value into a fixed queue, and a listener is a plain
+ * function pointer with a context pointer.
+ *
+ * With EventDelivery::LOOP, events published from the BLE and WiFi stack
+ * tasks wait in the queue and are delivered by dispatch() on the task that
+ * calls WiBLE::loop(). With IMMEDIATE they are delivered in the publishing
+ * task. Every listener call is timed; one that runs longer than the slow
+ * threshold is logged and counted, since it stalls the task it runs on.
+ *
+ * publish() may be called from any task. Subscribe during setup, before
+ * events flow.
+ */
+
+#ifndef WIBLE_EVENT_BUS_H
+#define WIBLE_EVENT_BUS_H
+
+#include <Arduino.h>
+#include <freertos/task.h>
+#include "utils/SPSCQueue.h"
+
+namespace WiBLE {
+
+// ============================================================================
+// EVENT LIMITS
+// ============================================================================
+
+#ifndef WIBLE_EVENT_QUEUE_SIZE
+#define WIBLE_EVENT_QUEUE_SIZE       16     // Events (power of two)
+#endif
+
+#ifndef WIBLE_EVENT_MAX_LISTENERS
+#define WIBLE_EVENT_MAX_LISTENERS    8
+#endif
+
+#ifndef WIBLE_EVENT_SLOW_LISTENER_US
+#define WIBLE_EVENT_SLOW_LISTENER_US 5000
+#endif
+
+#define WIBLE_EVENT_TEXT_SIZE        33     // SSID, address or status text, NUL-terminated
+
+enum class EventType : uint8_t {
+    STATE_CHANGED = 0,          // code: new ProvisioningState, value: old
+    BLE_CONNECTED,              // connId, text: client address
+    BLE_DISCONNECTED,           // connId, code: HCI reason, text: client address
+    AUTHENTICATED,              // connId, value: 1 on success, text: client address
+    CREDENTIALS_RECEIVED,       // connId, text: SSID
+    WIFI_CONNECTED,             // number: IPv4 (network order), text: SSID
+    WIFI_DISCONNECTED,          // code: WiFiDisconnectReason, text: reason
+    WIFI_PROGRESS,              // code: percent, text: status
+    PROVISIONING_COMPLETE,      // value: 1 on success, number: duration ms
+    ERROR,                      // code: ErrorCode, value: 1 if retryable, message
+    COUNT
+};
+
+#define WIBLE_EVENT_MASK(type)       (1UL << (uint8_t)(type))
+#define WIBLE_EVENT_ALL              0xFFFFFFFFUL
+
+static_assert((uint8_t)EventType::COUNT <= 32, "Event masks are 32 bits");
+
+enum class EventDelivery : uint8_t {
+    IMMEDIATE = 0,              // In the publishing task
+    LOOP = 1                    // Queued for dispatch() on the loop task
+};
+
+/**
+ * One event; which fields are set depends on the type
+ */
+struct Event {
+    EventType type = EventType::STATE_CHANGED;
+    uint8_t code = 0;
+    uint8_t value = 0;
+    uint16_t connId = 0;
+    uint32_t timestampMs = 0;
+    uint32_t number = 0;
+    const char* message = nullptr;          // Static text only, it outlives the queue
+    char text[WIBLE_EVENT_TEXT_SIZE] = {0};
+
+    void setText(const char* source);
+};
+
+/**
+ * Listener: a plain function, so the table needs no heap
+ */
+using EventListener = void (*)(const Event& event, void* context);
+
+struct EventBusStatistics {
+    uint32_t published = 0;
+    uint32_t delivered = 0;             // Listener calls
+    uint32_t dropped = 0;               // Queue full
+    uint32_t slowCalls = 0;             // Listener calls over the slow threshold
+    uint32_t maxListenerUs = 0;
+    uint16_t maxQueueDepth = 0;
+    uint16_t queued = 0;
+};
+
+// ============================================================================
+// EVENT BUS
+// ============================================================================
+
+class EventBus {
+public:
+    EventBus();
+
+    void setDelivery(EventDelivery mode) { delivery = mode; }
+    EventDelivery getDelivery() const { return delivery; }
+    void setSlowListenerThreshold(uint32_t us) { slowListenerUs = us; }
+
+    /**
+     * @param mask WIBLE_EVENT_MASK bits of the types to receive
+     * @param name Shown when the listener is slow (static text)
+     * @return false when every slot is taken
+     */
+    bool subscribe(uint32_t mask, EventListener listener, void* context, const char* name = "listener");
+    void unsubscribe(EventListener listener, void* context);
+
+    /**
+     * Timestamp and deliver (IMMEDIATE) or queue (LOOP) an event
+     * @return false if the queue was full and the event was dropped
+     */
+    bool publish(Event& event);
+
+    /**
+     * Deliver queued events; call from loop()
+     */
+    void dispatch();
+
+    EventBusStatistics getStatistics() const;
+
+private:
+    struct Listener {
+        EventListener function;
+        void* context;
+        uint32_t mask;
+        const char* name;
+        uint32_t maxUs;
+    };
+
+    Listener listeners[WIBLE_EVENT_MAX_LISTENERS];
+    EventDelivery delivery;
+    uint32_t slowListenerUs;
+
+    // Any task produces under queueLock; only dispatch() consumes
+    SPSCQueue<Event, WIBLE_EVENT_QUEUE_SIZE> queue;
+    portMUX_TYPE queueLock;
+    EventBusStatistics statistics;
+
+    void deliver(const Event& event);
+};
+
+} // namespace WiBLE
+
+#endif // WIBLE_EVENT_BUS_H
@@ -0,0 +1,763 @@
+/**
+ * GroupProvisioner.cpp - Credential relay from a provisioned lead to its peers
+ */
+
+#include "GroupProvisioner.h"
+#include "BLEManager.h"
+#include "ProvisioningOrchestrator.h"
+#include "SecurityManager.h"
+#include "utils/AdvertisingData.h"
+#include "utils/LogManager.h"
+#include <string.h>
+
+namespace WiBLE {
+
+static_assert((WIBLE_GROUP_EVENT_QUEUE_SIZE & (WIBLE_GROUP_EVENT_QUEUE_SIZE - 1)) == 0,
+              "WIBLE_GROUP_EVENT_QUEUE_SIZE must be a power of two");
+static_assert(WIBLE_GROUP_NOTIFY_MAX >= 1 + WIBLE_ECDH_KEY_SIZE,
+              "A notification must hold the key exchange reply");
+static_assert(WIBLE_GROUP_MAX_PEERS <= INT16_MAX, "Peers are indexed with int16_t");
+
+GroupProvisioner* GroupProvisioner::activeProvisioner = nullptr;
+
+// Progress reported on entering each state, in GroupPeerState order
+static const uint8_t STATE_PROGRESS[] = { 0, 10, 25, 35, 45, 60, 70, 100, 100, 100 };
+
+static_assert(sizeof(STATE_PROGRESS) == (size_t)GroupPeerState::SKIPPED + 1,
+              "One progress value per peer state");
+
+static esp_bt_uuid_t uuid128(const char* text) {
+    esp_bt_uuid_t uuid = {};
+    uuid.len = ESP_UUID_LEN_128;
+    parseUUID128(text, uuid.uuid.uuid128, true);
+    return uuid;
+}
+
+// ============================================================================
+// PEER HELPERS
+// ============================================================================
+
+void GroupPeer::formatAddress(char* out) const {
+    snprintf(out, 18, "%02x:%02x:%02x:%02x:%02x:%02x",
+             address[0], address[1], address[2], address[3], address[4], address[5]);
+}
+
+const char* GroupProvisioner::stateToString(GroupPeerState state) {
+    switch (state) {
+        case GroupPeerState::DISCOVERED: return "DISCOVERED";
+        case GroupPeerState::CONNECTING: return "CONNECTING";
+        case GroupPeerState::DISCOVERING: return "DISCOVERING";
+        case GroupPeerState::SUBSCRIBING: return "SUBSCRIBING";
+        case GroupPeerState::HANDSHAKE: return "HANDSHAKE";
+        case GroupPeerState::SENDING: return "SENDING";
+        case GroupPeerState::JOINING: return "JOINING";
+        case GroupPeerState::PROVISIONED: return "PROVISIONED";
+        case GroupPeerState::FAILED: return "FAILED";
+        case GroupPeerState::SKIPPED: return "SKIPPED";
+        default: return "UNKNOWN";
+    }
+}
+
+ScanFilter GroupProvisioner::candidateFilter(const GroupConfig& config) {
+    ScanFilter filter;
+    filter.setServiceUUID128(WIBLE_SERVICE_UUID);
+    filter.minRSSI = config.minRSSI;
+    return filter;
+}
+
+// ============================================================================
+// CONSTRUCTOR & DESTRUCTOR
+// ============================================================================
+
+GroupProvisioner::GroupProvisioner()
+    : active(false),
+      gattcIf(ESP_GATT_IF_NONE),
+      peerCount(0),
+      credentialLength(0),
+      eventLock(portMUX_INITIALIZER_UNLOCKED),
+      eventsDropped(0),
+      startedAt(0),
+      lastActivityAt(0),
+      totalSessionMs(0) {
+    memset(retryAt, 0, sizeof(retryAt));
+    memset(credentialFrame, 0, sizeof(credentialFrame));
+    for (Session& session : sessions) {
+        session.peer = -1;
+        session.open = false;
+    }
+}
+
+GroupProvisioner::~GroupProvisioner() {
+    stop();
+    if (activeProvisioner == this) {
+        activeProvisioner = nullptr;
+    }
+}
+
+// ============================================================================
+// CONTROL
+// ============================================================================
+
+bool GroupProvisioner::start(const GroupConfig& config, const WiFiCredentials& credentials) {
+    if (config.fleetSecret.isEmpty() || !credentials.isValid()) {
+        WIBLE_LOGW("Group provisioning needs a fleet secret and valid credentials");
+        return false;
+    }
+    if (active) stop();
+
+    this->config = config;
+    if (this->config.parallelSessions == 0) this->config.parallelSessions = 1;
+    if (this->config.parallelSessions > WIBLE_GROUP_MAX_SESSIONS) {
+        this->config.parallelSessions = WIBLE_GROUP_MAX_SESSIONS;
+    }
+
+    // One TLV frame for every peer: [marker][SSID][passphrase][flags]
+    size_t length = 0;
+    credentialFrame[length++] = WIBLE_TLV_FRAME_V1;
+    credentialFrame[length++] = WIBLE_TLV_SSID;
+    credentialFrame[length++] = (uint8_t)credentials.ssid.length();
+    memcpy(credentialFrame + length, credentials.ssid.c_str(), credentials.ssid.length());
+    length += credentials.ssid.length();
+    credentialFrame[length++] = WIBLE_TLV_PASSPHRASE;
+    credentialFrame[length++] = (uint8_t)credentials.password.length();
+    memcpy(credentialFrame + length, credentials.password.c_str(), credentials.password.length());
+    length += credentials.password.length();
+    if (credentials.hidden) {
+        credentialFrame[length++] = WIBLE_TLV_FLAGS;
+        credentialFrame[length++] = 1;
+        credentialFrame[length++] = WIBLE_TLV_FLAG_HIDDEN;
+    }
+    credentialLength = length;
+
+    peerCount = 0;
+    memset(retryAt, 0, sizeof(retryAt));
+    statistics = GroupStatistics();
+    eventsDropped.store(0);
+    totalSessionMs = 0;
+    startedAt = millis();
+    lastActivityAt = startedAt;
+    active = true;
+    activeProvisioner = this;
+
+    // Events come through the custom GATTC handler; the interface arrives
+    // with ESP_GATTC_REG_EVT
+    if (gattcIf == ESP_GATT_IF_NONE) {
+        BLEDevice::setCustomGattcHandler(gattcEventHandler);
+        if (esp_ble_gattc_app_register(WIBLE_GROUP_APP_ID) != ESP_OK) {
+            WIBLE_LOGE("Failed to register the group GATT client");
+            stop();
+            return false;
+        }
+    }
+
+    WIBLE_LOGI("Group provisioning started (%u sessions, relay %s)", (unsigned)this->config.parallelSessions,
+               this->config.relay ? "on" : "off");
+    return true;
+}
+
+void GroupProvisioner::stop() {
+    if (!active) return;
+    for (Session& session : sessions) {
+        if (session.peer < 0) continue;
+        GroupPeer& peer = peers[session.peer];
+        close(session);
+        if (!peer.isFinished()) setState(peer, GroupPeerState::DISCOVERED);
+    }
+    SecurityUtils::secureWipe(credentialFrame, sizeof(credentialFrame));
+    credentialLength = 0;
+    active = false;
+
+    // The application stays registered for the next start()
+    WIBLE_LOGI("Group provisioning stopped: %u provisioned, %u failed, %u skipped",
+               (unsigned)statistics.peersProvisioned, (unsigned)statistics.peersFailed,
+               (unsigned)statistics.peersSkipped);
+}
+
+bool GroupProvisioner::isIdle() const {
+    if (!active || statistics.activeSessions > 0) return false;
+    for (size_t i = 0; i < peerCount; i++) {
+        if (peers[i].state == GroupPeerState::DISCOVERED) return false;
+    }
+    return millis() - lastActivityAt >= config.idleTimeoutMs;
+}
+
+GroupStatistics GroupProvisioner::getStatistics() const {
+    GroupStatistics snapshot = statistics;
+    snapshot.eventsDropped = eventsDropped.load();
+    snapshot.elapsedMs = startedAt ? millis() - startedAt : 0;
+    return snapshot;
+}
+
+// ============================================================================
+// CANDIDATES
+// ============================================================================
+
+void GroupProvisioner::addCandidates(const ScanEntry* entries, size_t count) {
+    if (!active) return;
+    uint8_t service[16];
+    parseUUID128(WIBLE_SERVICE_UUID, service, true);
+
+    for (size_t i = 0; i < count; i++) {
+        const ScanEntry& entry = entries[i];
+        if (entry.rssi < config.minRSSI) continue;
+        if (!AdvertisingDataView(entry.data, entry.dataLength).hasServiceUUID(service, sizeof(service))) continue;
+
+        uint8_t length = 0;
+        const uint8_t* status = entry.companyId == WIBLE_ADV_STATUS_COMPANY_ID
+            ? entry.getManufacturerData(length) : nullptr;
+        uint8_t advertised = status && length ? status[0] : WIBLE_ADV_STATUS_IDLE;
+
+        int16_t index = findPeer(entry.address);
+        if (index >= 0) {
+            GroupPeer& peer = peers[index];
+            peer.rssi = entry.rssi;
+            if (peer.state != GroupPeerState::DISCOVERED) continue;
+            if (advertised == WIBLE_ADV_STATUS_PROVISIONED) {
+                // Another lead or a phone got there first
+                setState(peer, GroupPeerState::SKIPPED);
+                statistics.peersSkipped++;
+            } else if (advertised == WIBLE_ADV_STATUS_BUSY) {
+                retryAt[index] = millis() + config.retryDelayMs;
+            }
+            continue;
+        }
+        if (advertised == WIBLE_ADV_STATUS_PROVISIONED || advertised == WIBLE_ADV_STATUS_BUSY) continue;
+
+        // A full table makes room by forgetting skipped peers
+        if (peerCount == WIBLE_GROUP_MAX_PEERS) {
+            for (index = 0; index < (int16_t)peerCount && peers[index].state != GroupPeerState::SKIPPED; index++) {}
+            if (index == (int16_t)peerCount) {
+                statistics.peersDropped++;
+                continue;
+            }
+        } else {
+            index = (int16_t)peerCount++;
+        }
+
+        GroupPeer& peer = peers[index];
+        peer = GroupPeer();
+        memcpy(peer.address, entry.address, sizeof(peer.address));
+        peer.addressType = entry.addressType;
+        peer.rssi = entry.rssi;
+        peer.discoveredAt = millis();
+        retryAt[index] = 0;
+        statistics.peersDiscovered++;
+        lastActivityAt = millis();
+        if (progressCallback) progressCallback(peer);
+    }
+}
+
+// ============================================================================
+// LOOP
+// ============================================================================
+
+void GroupProvisioner::loop() {
+    // Events queued by the Bluedroid task; newer ones wait for the next call
+    size_t pending = events.size();
+    LinkEvent event;
+    LinkEvent* slot;
+    while (pending-- > 0 && (slot = events.front()) != nullptr) {
+        event = *slot;
+        events.pop();
+        process(event);
+    }
+    if (!active) return;
+
+    uint32_t now = millis();
+    for (Session& session : sessions) {
+        if (session.peer < 0 || (int32_t)(now - session.deadline) < 0) continue;
+        GroupPeer& peer = peers[session.peer];
+        WIBLE_LOGW("Group peer timed out in %s", stateToString(peer.state));
+        retryLater(session);
+    }
+
+    startSessions();
+}
+
+void GroupProvisioner::startSessions() {
+    if (gattcIf == ESP_GATT_IF_NONE) return;
+
+    // The controller opens one connection at a time
+    uint8_t busy = 0;
+    for (const Session& session : sessions) {
+        if (session.peer < 0) continue;
+        if (peers[session.peer].state == GroupPeerState::CONNECTING) return;
+        busy++;
+    }
+    if (busy >= config.parallelSessions) return;
+
+    int16_t peer = pickPeer();
+    if (peer < 0) return;
+    for (Session& session : sessions) {
+        if (session.peer < 0) {
+            open(session, peer);
+            return;
+        }
+    }
+}
+
+int16_t GroupProvisioner::pickPeer() {
+    uint32_t now = millis();
+    int8_t best = INT8_MIN;
+    for (size_t i = 0; i < peerCount; i++) {
+        if (peers[i].state == GroupPeerState::DISCOVERED && (int32_t)(now - retryAt[i]) >= 0 &&
+            peers[i].rssi > best) {
+            best = peers[i].rssi;
+        }
+    }
+    if (best == INT8_MIN) return -1;
+
+    // A random pick among the closest keeps leads that hear the same peers
+    // from all dialing the strongest one
+    int16_t candidates[WIBLE_GROUP_MAX_PEERS];
+    size_t count = 0;
+    for (size_t i = 0; i < peerCount; i++) {
+        if (peers[i].state == GroupPeerState::DISCOVERED && (int32_t)(now - retryAt[i]) >= 0 &&
+            peers[i].rssi >= best - WIBLE_GROUP_RSSI_BAND) {
+            candidates[count++] = (int16_t)i;
+        }
+    }
+    return candidates[esp_random() % count];
+}
+
+// ============================================================================
+// SESSIONS
+// ============================================================================
+
+bool GroupProvisioner::open(Session& session, int16_t index) {
+    GroupPeer& peer = peers[index];
+
+    // One phone-side security context per link, kept for the next peer
+    if (!session.security) {
+        SecurityConfig securityConfig;
+        securityConfig.peerRole = true;
+        securityConfig.keyPoolSize = 0;
+        session.security = std::unique_ptr<SecurityManager>(new SecurityManager());
+        if (!session.security->initialize(securityConfig)) {
+            session.security.reset();
+            WIBLE_LOGE("Group session security failed to initialize");
+            return false;
+        }
+    }
+    session.security->reset();
+
+    session.peer = index;
+    session.connId = 0;
+    session.open = false;
+    session.serviceStart = 0;
+    session.serviceEnd = 0;
+    session.credentialsHandle = 0;
+    session.controlHandle = 0;
+    session.statusHandle = 0;
+    session.deadline = millis() + config.connectTimeoutMs;
+
+    peer.attempts++;
+    peer.startedAt = millis();
+    peer.error = ProtocolError::NONE;
+    statistics.sessionsStarted++;
+    statistics.activeSessions++;
+    setState(peer, GroupPeerState::CONNECTING);
+
+    if (esp_ble_gattc_open(gattcIf, peer.address, (esp_ble_addr_type_t)peer.addressType, true) != ESP_OK) {
+        WIBLE_LOGW("Group open request failed");
+        retryLater(session);
+        return false;
+    }
+    return true;
+}
+
+void GroupProvisioner::close(Session& session) {
+    if (session.open) esp_ble_gattc_close(gattcIf, session.connId);
+    session.open = false;
+    if (session.security) session.security->reset();
+    if (session.peer >= 0 && statistics.activeSessions > 0) statistics.activeSessions--;
+    session.peer = -1;
+}
+
+void GroupProvisioner::finish(Session& session, GroupPeerState outcome, ProtocolError error) {
+    GroupPeer& peer = peers[session.peer];
+    uint32_t elapsed = millis() - peer.startedAt;
+    peer.error = error;
+    peer.finishedAt = millis();
+    close(session);
+
+    switch (outcome) {
+        case GroupPeerState::PROVISIONED:
+            statistics.peersProvisioned++;
+            totalSessionMs += elapsed;
+            statistics.averageSessionMs = (uint32_t)(totalSessionMs / statistics.peersProvisioned);
+            break;
+        case GroupPeerState::FAILED: statistics.peersFailed++; break;
+        default: statistics.peersSkipped++; break;
+    }
+    setState(peer, outcome);
+}
+
+void GroupProvisioner::retryLater(Session& session) {
+    GroupPeer& peer = peers[session.peer];
+    if (peer.attempts >= config.maxAttempts) {
+        finish(session, GroupPeerState::FAILED, peer.error);
+        return;
+    }
+    retryAt[session.peer] = millis() + config.retryDelayMs;
+    close(session);
+    setState(peer, GroupPeerState::DISCOVERED);
+}
+
+void GroupProvisioner::setState(GroupPeer& peer, GroupPeerState state) {
+    peer.state = state;
+    if (STATE_PROGRESS[(uint8_t)state] > peer.progress || state == GroupPeerState::DISCOVERED) {
+        peer.progress = state == GroupPeerState::FAILED ? peer.progress : STATE_PROGRESS[(uint8_t)state];
+    }
+    lastActivityAt = millis();
+    if (progressCallback) progressCallback(peer);
+}
+
+GroupProvisioner::Session* GroupProvisioner::findSession(uint16_t connId) {
+    for (Session& session : sessions) {
+        if (session.peer >= 0 && session.open && session.connId == connId) return &session;
+    }
+    return nullptr;
+}
+
+GroupProvisioner::Session* GroupProvisioner::findConnecting(const uint8_t* address) {
+    for (Session& session : sessions) {
+        if (session.peer >= 0 && !session.open &&
+            memcmp(peers[session.peer].address, address, 6) == 0) {
+            return &session;
+        }
+    }
+    return nullptr;
+}
+
+int16_t GroupProvisioner::findPeer(const uint8_t* address) const {
+    for (size_t i = 0; i < peerCount; i++) {
+        if (memcmp(peers[i].address, address, 6) == 0) return (int16_t)i;
+    }
+    return -1;
+}
+
+// ============================================================================
+// GATT CLIENT EVENTS
+// ============================================================================
+
+void GroupProvisioner::gattcEventHandler(esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf,
+                                         esp_ble_gattc_cb_param_t* param) {
+    GroupProvisioner* provisioner = activeProvisioner;
+    if (provisioner) provisioner->handleGattcEvent(event, gattcIf, param);
+}
+
+void GroupProvisioner::handleGattcEvent(esp_gattc_cb_event_t event, esp_gatt_if_t eventIf,
+                                        esp_ble_gattc_cb_param_t* param) {
+    // Other GATT client applications (BLEClient) share the callback
+    if (event == ESP_GATTC_REG_EVT) {
+        if (param->reg.app_id != WIBLE_GROUP_APP_ID) return;
+    } else if (eventIf != gattcIf.load()) {
+        return;
+    }
+
+    LinkEvent copy;
+    copy.type = event;
+    copy.status = ESP_GATT_OK;
+    copy.gattcIf = eventIf;
+    copy.connId = 0;
+    copy.handle = 0;
+    copy.value = 0;
+    copy.length = 0;
+    memset(copy.address, 0, sizeof(copy.address));
+
+    switch (event) {
+        case ESP_GATTC_REG_EVT:
+            copy.status = (uint8_t)param->reg.status;
+            // Claimed here so requests can go out before loop() runs
+            if (param->reg.status == ESP_GATT_OK) gattcIf.store(eventIf);
+            break;
+        case ESP_GATTC_OPEN_EVT:
+            copy.status = (uint8_t)param->open.status;
+            copy.connId = param->open.conn_id;
+            copy.value = param->open.mtu;
+            memcpy(copy.address, param->open.remote_bda, sizeof(copy.address));
+            break;
+        case ESP_GATTC_CFG_MTU_EVT:
+            copy.status = (uint8_t)param->cfg_mtu.status;
+            copy.connId = param->cfg_mtu.conn_id;
+            copy.value = param->cfg_mtu.mtu;
+            break;
+        case ESP_GATTC_SEARCH_RES_EVT:
+            copy.connId = param->search_res.conn_id;
+            copy.handle = param->search_res.start_handle;
+            copy.value = param->search_res.end_handle;
+            break;
+        case ESP_GATTC_SEARCH_CMPL_EVT:
+            copy.status = (uint8_t)param->search_cmpl.status;
+            copy.connId = param->search_cmpl.conn_id;
+            break;
+        case ESP_GATTC_WRITE_DESCR_EVT:
+        case ESP_GATTC_WRITE_CHAR_EVT:
+            copy.status = (uint8_t)param->write.status;
+            copy.connId = param->write.conn_id;
+            copy.handle = param->write.handle;
+            break;
+        case ESP_GATTC_NOTIFY_EVT:
+            copy.connId = param->notify.conn_id;
+            copy.handle = param->notify.handle;
+            copy.length = (uint8_t)(param->notify.value_len < WIBLE_GROUP_NOTIFY_MAX
+                                    ? param->notify.value_len : WIBLE_GROUP_NOTIFY_MAX);
+            memcpy(copy.data, param->notify.value, copy.length);
+            break;
+        case ESP_GATTC_DISCONNECT_EVT:
+            copy.connId = param->disconnect.conn_id;
+            copy.value = (uint16_t)param->disconnect.reason;
+            memcpy(copy.address, param->disconnect.remote_bda, sizeof(copy.address));
+            break;
+        default:
+            return;
+    }
+
+    taskENTER_CRITICAL(&eventLock);
+    LinkEvent* slot = events.beginWrite();
+    if (slot) {
+        *slot = copy;
+        events.commitWrite();
+    } else {
+        eventsDropped++;
+    }
+    taskEXIT_CRITICAL(&eventLock);
+}
+
+void GroupProvisioner::process(const LinkEvent& event) {
+    if (event.type == ESP_GATTC_REG_EVT) {
+        if (event.status != ESP_GATT_OK) WIBLE_LOGE("Group GATT client registration failed: %u", event.status);
+        return;
+    }
+
+    if (event.type == ESP_GATTC_OPEN_EVT) {
+        Session* session = active ? findConnecting(event.address) : nullptr;
+        if (session && peers[session->peer].state == GroupPeerState::CONNECTING) {
+            onOpened(*session, event);
+        } else if (event.status == ESP_GATT_OK) {
+            // Opened after its session timed out, or after stop()
+            esp_ble_gattc_close(gattcIf, event.connId);
+        }
+        return;
+    }
+
+    Session* session = findSession(event.connId);
+    if (!session) return;
+    GroupPeer& peer = peers[session->peer];
+
+    switch (event.type) {
+        case ESP_GATTC_CFG_MTU_EVT:
+            // A smaller MTU still works: the credential write goes out as a long write
+            if (peer.state == GroupPeerState::DISCOVERING) {
+                esp_bt_uuid_t service = uuid128(WIBLE_SERVICE_UUID);
+                esp_ble_gattc_search_service(gattcIf, session->connId, &service);
+            }
+            break;
+        case ESP_GATTC_SEARCH_RES_EVT:
+            onServiceFound(*session, event);
+            break;
+        case ESP_GATTC_SEARCH_CMPL_EVT:
+            onDiscoveryComplete(*session, event);
+            break;
+        case ESP_GATTC_WRITE_DESCR_EVT:
+            if (peer.state != GroupPeerState::SUBSCRIBING) break;
+            if (event.status != ESP_GATT_OK) {
+                retryLater(*session);
+                break;
+            }
+            {
+                // Status notifications flow: offer our key
+                uint8_t frame[1 + WIBLE_ECDH_KEY_SIZE];
+                std::vector<uint8_t> publicKey;
+                if (session->security->generateKeyPair()) publicKey = session->security->getPublicKey();
+                if (publicKey.size() != WIBLE_ECDH_KEY_SIZE) {
+                    WIBLE_LOGE("Group key generation failed");
+                    retryLater(*session);
+                    break;
+                }
+                frame[0] = WIBLE_OP_GROUP_KEY_EXCHANGE;
+                memcpy(frame + 1, publicKey.data(), WIBLE_ECDH_KEY_SIZE);
+                setState(peer, GroupPeerState::HANDSHAKE);
+                session->deadline = peer.startedAt + config.sessionTimeoutMs;
+                if (!write(*session, session->controlHandle, frame, sizeof(frame))) retryLater(*session);
+            }
+            break;
+        case ESP_GATTC_WRITE_CHAR_EVT:
+            if (event.status != ESP_GATT_OK) {
+                WIBLE_LOGW("Group write failed: %u", event.status);
+                retryLater(*session);
+            } else if (peer.state == GroupPeerState::SENDING && event.handle == session->credentialsHandle) {
+                setState(peer, GroupPeerState::JOINING);
+            }
+            break;
+        case ESP_GATTC_NOTIFY_EVT:
+            onNotification(*session, event);
+            break;
+        case ESP_GATTC_DISCONNECT_EVT:
+            // The peer may still join WiFi; its advertisement tells the next lead
+            session->open = false;
+            WIBLE_LOGW("Group peer disconnected in %s (reason 0x%02x)", stateToString(peer.state),
+                       (unsigned)event.value);
+            retryLater(*session);
+            break;
+        default:
+            break;
+    }
+}
+
+void GroupProvisioner::onOpened(Session& session, const LinkEvent& event) {
+    if (event.status != ESP_GATT_OK) {
+        WIBLE_LOGW("Group open failed: %u", event.status);
+        retryLater(session);
+        return;
+    }
+    session.open = true;
+    session.connId = event.connId;
+    setState(peers[session.peer], GroupPeerState::DISCOVERING);
+    esp_ble_gattc_send_mtu_req(gattcIf, session.connId);
+}
+
+void GroupProvisioner::onServiceFound(Session& session, const LinkEvent& event) {
+    // The search is filtered on the WiBLE service
+    session.serviceStart = event.handle;
+    session.serviceEnd = event.value;
+}
+
+void GroupProvisioner::onDiscoveryComplete(Session& session, const LinkEvent& event) {
+    if (peers[session.peer].state != GroupPeerState::DISCOVERING) return;
+    if (event.status != ESP_GATT_OK) {
+        retryLater(session);
+        return;
+    }
+    resolveHandles(session);
+    if (!session.credentialsHandle || !session.controlHandle || !session.statusHandle) {
+        WIBLE_LOGW("Group peer has no WiBLE service");
+        finish(session, GroupPeerState::SKIPPED);
+        return;
+    }
+
+    esp_bt_uuid_t cccdUUID = {};
+    cccdUUID.len = ESP_UUID_LEN_16;
+    cccdUUID.uuid.uuid16 = ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
+    esp_gattc_descr_elem_t descriptor;
+    uint16_t count = 1;
+    if (esp_ble_gattc_get_descr_by_char_handle(gattcIf, session.connId, session.statusHandle, cccdUUID,
+                                               &descriptor, &count) != ESP_GATT_OK || count == 0) {
+        finish(session, GroupPeerState::SKIPPED);
+        return;
+    }
+
+    // Registration is local; the CCCD write response confirms both
+    setState(peers[session.peer], GroupPeerState::SUBSCRIBING);
+    esp_ble_gattc_register_for_notify(gattcIf, peers[session.peer].address, session.statusHandle);
+    uint8_t enable[2] = { 0x01, 0x00 };
+    if (esp_ble_gattc_write_char_descr(gattcIf, session.connId, descriptor.handle, sizeof(enable), enable,
+                                       ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE) != ESP_OK) {
+        retryLater(session);
+    }
+}
+
+void GroupProvisioner::resolveHandles(Session& session) {
+    struct Wanted { const char* uuid; uint16_t* handle; };
+    Wanted wanted[] = {
+        { WIBLE_CRED_CHARACTERISTIC, &session.credentialsHandle },
+        { WIBLE_CONTROL_CHARACTERISTIC, &session.controlHandle },
+        { WIBLE_STATUS_CHARACTERISTIC, &session.statusHandle }
+    };
+    for (const Wanted& characteristic : wanted) {
+        esp_gattc_char_elem_t element;
+        uint16_t count = 1;
+        if (esp_ble_gattc_get_char_by_uuid(gattcIf, session.connId, session.serviceStart, session.serviceEnd,
+                                           uuid128(characteristic.uuid), &element, &count) == ESP_GATT_OK &&
+            count > 0) {
+            *characteristic.handle = element.char_handle;
+        }
+    }
+}
+
+void GroupProvisioner::onNotification(Session& session, const LinkEvent& event) {
+    if (event.handle != session.statusHandle || event.length == 0) return;
+    if (event.data[0] == WIBLE_OP_GROUP_KEY_EXCHANGE) {
+        onKeyExchange(session, event.data + 1, event.length - 1);
+    } else if (event.data[0] == WIBLE_TLV_FRAME_V1) {
+        onStatus(session, event.data, event.length);
+    }
+}
+
+void GroupProvisioner::onKeyExchange(Session& session, const uint8_t* data, size_t length) {
+    GroupPeer& peer = peers[session.peer];
+    if (peer.state != GroupPeerState::HANDSHAKE) return;
+
+    SecurityManager& security = *session.security;
+    bool established = length == WIBLE_ECDH_KEY_SIZE &&
+                       security.computeSharedSecret(std::vector<uint8_t>(data, data + length)) &&
+                       security.deriveSessionKey() &&
+                       security.bindSessionKey((const uint8_t*)config.fleetSecret.c_str(),
+                                               config.fleetSecret.length());
+    if (!established) {
+        statistics.handshakeFailures++;
+        WIBLE_LOGE("Group handshake failed");
+        retryLater(session);
+        return;
+    }
+
+    setState(peer, GroupPeerState::SENDING);
+    if (!sendCredentials(session)) retryLater(session);
+}
+
+bool GroupProvisioner::sendCredentials(Session& session) {
+    uint8_t sealed[WIBLE_GROUP_FRAME_MAX + WIBLE_GCM_OVERHEAD + WIBLE_AES_BLOCK_SIZE];
+    size_t length = session.security->encrypt(credentialFrame, credentialLength, sealed, sizeof(sealed));
+    bool sent = length > 0 && write(session, session.credentialsHandle, sealed, length);
+    SecurityUtils::secureWipe(sealed, sizeof(sealed));
+    return sent;
+}
+
+void GroupProvisioner::onStatus(Session& session, const uint8_t* data, size_t length) {
+    // [marker][ProtocolStatus][progress %][detail]...
+    if (length < 4) return;
+    GroupPeer& peer = peers[session.peer];
+    ProtocolStatus status = (ProtocolStatus)data[1];
+
+    switch (status) {
+        case ProtocolStatus::CONNECTING:
+        case ProtocolStatus::VALIDATING:
+            if (peer.state == GroupPeerState::SENDING || peer.state == GroupPeerState::JOINING) {
+                uint8_t progress = (uint8_t)(STATE_PROGRESS[(uint8_t)GroupPeerState::JOINING] +
+                                             (data[2] > 100 ? 100 : data[2]) * 29 / 100);
+                if (progress > peer.progress) peer.progress = progress;
+                setState(peer, GroupPeerState::JOINING);
+            }
+            break;
+        case ProtocolStatus::SUCCESS:
+            if (peer.state == GroupPeerState::SENDING || peer.state == GroupPeerState::JOINING) {
+                finish(session, GroupPeerState::PROVISIONED);
+            }
+            break;
+        case ProtocolStatus::ERROR:
+            peer.error = (ProtocolError)data[3];
+            if (peer.state == GroupPeerState::HANDSHAKE || peer.state == GroupPeerState::SUBSCRIBING) {
+                // Outside the fleet, or without encryption: never retried
+                statistics.handshakeFailures++;
+                finish(session, GroupPeerState::SKIPPED, peer.error);
+            } else {
+                retryLater(session);
+            }
+            break;
+        case ProtocolStatus::BUSY:
+        case ProtocolStatus::QUEUED:
+            // Another client is being served; its result shows in the advertisement
+            retryLater(session);
+            break;
+        default:
+            break;
+    }
+}
+
+bool GroupProvisioner::write(Session& session, uint16_t handle, const uint8_t* data, size_t length) {
+    return esp_ble_gattc_write_char(gattcIf, session.connId, handle, (uint16_t)length, const_cast<uint8_t*>(data),
+                                    ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE) == ESP_OK;
+}
+
+} // namespace WiBLE
@@ -0,0 +1,288 @@
+/**
+ * GroupProvisioner.h - A provisioned device relays its credentials to nearby peers
+ *
+ * One phone session provisions a whole batch: once a device is on WiFi it
+ * becomes a lead, finds unprovisioned WiBLE devices in its scan results
+ * and provisions several of them at once over GATT client links, the way
+ * a phone would:
+ *
+ *   connect -> MTU -> find the service -> subscribe to status
+ *     -> GROUP_KEY_EXCHANGE -> sealed TLV credentials -> SUCCESS or ERROR
+ *
+ * Peers only answer GROUP_KEY_EXCHANGE with encryption on and a fleet
+ * secret configured; the session key is bound to that secret on both
+ * sides, so a lead never sends credentials in the clear or to a device
+ * outside the fleet. With relay on, every peer that gets provisioned
+ * leads in turn, so a batch of N devices takes about log2(N) rounds of
+ * one WiFi join each instead of N phone sessions.
+ *
+ * Bluedroid delivers GATT client events on its own task. They are copied
+ * into a fixed queue and every link advances from loop(), so sessions run
+ * side by side without blocking and without allocating per event. Only
+ * one connection is being opened at a time, as the controller allows.
+ */
+
+#ifndef WIBLE_GROUP_PROVISIONER_H
+#define WIBLE_GROUP_PROVISIONER_H
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <esp_gattc_api.h>
+#include <freertos/task.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "WiBLE_Defs.h"
+#include "BLEScanner.h"
+#include "ProvisioningProtocol.h"
+#include "utils/SPSCQueue.h"
+
+namespace WiBLE {
+
+class SecurityManager;
+
+// ============================================================================
+// GROUP LIMITS
+// ============================================================================
+
+#ifndef WIBLE_GROUP_MAX_PEERS
+#define WIBLE_GROUP_MAX_PEERS        32     // Devices tracked per group run
+#endif
+
+// Concurrent GATT client links; the controller also serves the phone
+#ifndef WIBLE_GROUP_MAX_SESSIONS
+#define WIBLE_GROUP_MAX_SESSIONS     3
+#endif
+
+#ifndef WIBLE_GROUP_EVENT_QUEUE_SIZE
+#define WIBLE_GROUP_EVENT_QUEUE_SIZE 32     // GATT client events (power of two)
+#endif
+
+#define WIBLE_GROUP_APP_ID           0x57   // GATT client application ID
+#define WIBLE_GROUP_NOTIFY_MAX       48     // Notification bytes kept per event
+#define WIBLE_GROUP_FRAME_MAX        112    // TLV credential frame, before sealing
+#define WIBLE_GROUP_RSSI_BAND        6      // Leads pick among peers this close to the best RSSI
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+struct GroupConfig {
+    String fleetSecret;                     // Shared by the fleet; empty disables group mode
+    bool relay = true;                      // Lead in turn when provisioned by another lead
+    uint8_t parallelSessions = 2;           // Up to WIBLE_GROUP_MAX_SESSIONS
+    int8_t minRSSI = -85;                   // Peers heard weaker are left for a closer lead
+    uint32_t connectTimeoutMs = 5000;       // Open to subscribed
+    uint32_t sessionTimeoutMs = 30000;      // Open to SUCCESS or ERROR, WiFi join included
+    uint8_t maxAttempts = 2;                // Per peer
+    uint32_t retryDelayMs = 3000;
+    uint32_t idleTimeoutMs = 30000;         // Stop once nothing new was heard or pending this long
+    uint32_t scanBatchMs = 1000;            // Scan batch interval while leading
+};
+
+// ============================================================================
+// PEERS AND PROGRESS
+// ============================================================================
+
+enum class GroupPeerState : uint8_t {
+    DISCOVERED = 0,                         // Heard advertising unprovisioned
+    CONNECTING,
+    DISCOVERING,                            // MTU and service discovery
+    SUBSCRIBING,
+    HANDSHAKE,
+    SENDING,
+    JOINING,                                // Credentials delivered; the peer joins WiFi
+    PROVISIONED,
+    FAILED,                                 // Out of attempts
+    SKIPPED                                 // Provisioned by someone else, or refused us
+};
+
+/**
+ * One peer, as reported to the progress callback
+ */
+struct GroupPeer {
+    uint8_t address[6] = {0};
+    uint8_t addressType = 0;
+    int8_t rssi = 0;
+    GroupPeerState state = GroupPeerState::DISCOVERED;
+    uint8_t progress = 0;                   // Percent
+    uint8_t attempts = 0;
+    ProtocolError error = ProtocolError::NONE;  // Last ERROR status from the peer
+    uint32_t discoveredAt = 0;
+    uint32_t startedAt = 0;                 // Current attempt
+    uint32_t finishedAt = 0;
+
+    bool isFinished() const {
+        return state == GroupPeerState::PROVISIONED || state == GroupPeerState::FAILED ||
+               state == GroupPeerState::SKIPPED;
+    }
+
+    /**
+     * "aa:bb:cc:dd:ee:ff" into out (at least 18 bytes)
+     */
+    void formatAddress(char* out) const;
+};
+
+struct GroupStatistics {
+    uint16_t peersDiscovered = 0;
+    uint16_t peersProvisioned = 0;
+    uint16_t peersFailed = 0;
+    uint16_t peersSkipped = 0;
+    uint16_t peersDropped = 0;              // Table full
+    uint16_t activeSessions = 0;
+    uint32_t sessionsStarted = 0;
+    uint32_t handshakeFailures = 0;
+    uint32_t eventsDropped = 0;             // Event queue full
+    uint32_t averageSessionMs = 0;          // Open to SUCCESS
+    uint32_t elapsedMs = 0;                 // Since start()
+};
+
+/**
+ * Called from loop() whenever a peer changes state
+ */
+using GroupProgressCallback = std::function<void(const GroupPeer& peer)>;
+
+// ============================================================================
+// GROUP PROVISIONER
+// ============================================================================
+
+class GroupProvisioner {
+public:
+    GroupProvisioner();
+    ~GroupProvisioner();
+
+    /**
+     * Start leading with these credentials; peers come from addCandidates().
+     * Registers a GATT client application and takes over the GATTC
+     * callback, so a chip runs one provisioner at a time.
+     * @return false without a fleet secret or valid credentials
+     */
+    bool start(const GroupConfig& config, const WiFiCredentials& credentials);
+
+    /**
+     * Close every link and wipe the credentials
+     */
+    void stop();
+
+    bool isActive() const { return active; }
+
+    /**
+     * True once start() ran and nothing is left to do for idleTimeoutMs
+     */
+    bool isIdle() const;
+
+    /**
+     * Advance every link; call regularly from the application task
+     */
+    void loop();
+
+    /**
+     * Scan results: devices advertising the WiBLE service UUID and an
+     * unprovisioned status become peers, provisioned ones are skipped
+     */
+    void addCandidates(const ScanEntry* entries, size_t count);
+
+    /**
+     * Scan filter for the WiBLE service UUID at config.minRSSI
+     */
+    static ScanFilter candidateFilter(const GroupConfig& config);
+
+    void onProgress(GroupProgressCallback callback) { progressCallback = callback; }
+
+    GroupStatistics getStatistics() const;
+    size_t getPeerCount() const { return peerCount; }
+    const GroupPeer* getPeer(size_t index) const { return index < peerCount ? &peers[index] : nullptr; }
+
+    /**
+     * Queue one GATT client event. Called from the GATTC callback; public
+     * so host builds can inject traffic.
+     */
+    void handleGattcEvent(esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf, esp_ble_gattc_cb_param_t* param);
+
+    static void gattcEventHandler(esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf,
+                                  esp_ble_gattc_cb_param_t* param);
+
+    static const char* stateToString(GroupPeerState state);
+
+private:
+    /**
+     * A GATT client event, as copied out of the Bluedroid task
+     */
+    struct LinkEvent {
+        esp_gattc_cb_event_t type;
+        uint8_t status;
+        esp_gatt_if_t gattcIf;
+        uint16_t connId;
+        uint16_t handle;
+        uint16_t value;                     // MTU, or the service end handle
+        uint8_t address[6];
+        uint8_t length;
+        uint8_t data[WIBLE_GROUP_NOTIFY_MAX];
+    };
+
+    struct Session {
+        int16_t peer;                       // Index into peers, -1 when free
+        uint16_t connId;
+        bool open;
+        uint16_t serviceStart;
+        uint16_t serviceEnd;
+        uint16_t credentialsHandle;
+        uint16_t controlHandle;
+        uint16_t statusHandle;
+        uint32_t deadline;
+        std::unique_ptr<SecurityManager> security;
+    };
+
+    GroupConfig config;
+    GroupProgressCallback progressCallback;
+    bool active;
+    std::atomic<esp_gatt_if_t> gattcIf;     // ESP_GATT_IF_NONE until registered; set on Bluedroid
+
+    GroupPeer peers[WIBLE_GROUP_MAX_PEERS];
+    uint32_t retryAt[WIBLE_GROUP_MAX_PEERS];
+    size_t peerCount;
+    Session sessions[WIBLE_GROUP_MAX_SESSIONS];
+
+    // Plaintext TLV frame, sealed per session
+    uint8_t credentialFrame[WIBLE_GROUP_FRAME_MAX];
+    size_t credentialLength;
+
+    // The Bluedroid task produces under eventLock; only loop() consumes
+    SPSCQueue<LinkEvent, WIBLE_GROUP_EVENT_QUEUE_SIZE> events;
+    portMUX_TYPE eventLock;
+    std::atomic<uint32_t> eventsDropped;    // Counted on Bluedroid, merged into getStatistics()
+
+    GroupStatistics statistics;
+    uint32_t startedAt;
+    uint32_t lastActivityAt;
+    uint64_t totalSessionMs;
+
+    static GroupProvisioner* activeProvisioner;
+
+    void process(const LinkEvent& event);
+    void onOpened(Session& session, const LinkEvent& event);
+    void onServiceFound(Session& session, const LinkEvent& event);
+    void onDiscoveryComplete(Session& session, const LinkEvent& event);
+    void onNotification(Session& session, const LinkEvent& event);
+    void onKeyExchange(Session& session, const uint8_t* data, size_t length);
+    void onStatus(Session& session, const uint8_t* data, size_t length);
+
+    void startSessions();
+    int16_t pickPeer();
+    bool open(Session& session, int16_t peer);
+    void finish(Session& session, GroupPeerState outcome, ProtocolError error = ProtocolError::NONE);
+    void retryLater(Session& session);
+    void close(Session& session);
+
+    Session* findSession(uint16_t connId);
+    Session* findConnecting(const uint8_t* address);
+    int16_t findPeer(const uint8_t* address) const;
+    void setState(GroupPeer& peer, GroupPeerState state);
+    bool sendCredentials(Session& session);
+    void resolveHandles(Session& session);
+    bool write(Session& session, uint16_t handle, const uint8_t* data, size_t length);
+};
+
+} // namespace WiBLE
+
+#endif // WIBLE_GROUP_PROVISIONER_H
@@ -0,0 +1,329 @@
+/**
+ * OTAManager.cpp - Double-buffered OTA writer implementation
+ */
+
+#include "OTAManager.h"
+#include "utils/LogManager.h"
+#include <Update.h>
+
+namespace WiBLE {
+
+// ============================================================================
+// LIFECYCLE
+// ============================================================================
+
+OTAManager::OTAManager()
+    : status(OTAStatus::IDLE), connId(0xFFFF), imageSize(0), expectedHash(),
+      fillIndex(0), flushIndex(0), received(0), flashed(0), writeFailed(false),
+      writerTask(nullptr), writerStopRequested(false), writerRunning(false),
+      suspended(false), suspendedAt(0), segmentStartedAt(0), segmentStartOffset(0),
+      elapsedBeforeSegment(0), lastProgressAt(0), completedAt(0) {
+    resetBuffers();
+}
+
+OTAManager::~OTAManager() {
+    if (isActive()) {
+        stopWriter();
+        Update.abort();
+    }
+}
+
+void OTAManager::initialize(const OTAConfig& cfg) {
+    config = cfg;
+}
+
+void OTAManager::resetBuffers() {
+    for (Buffer& buffer : buffers) {
+        buffer.length = 0;
+        buffer.full.store(false);
+    }
+    fillIndex = 0;
+    flushIndex = 0;
+}
+
+// ============================================================================
+// SESSION
+// ============================================================================
+
+OTAStatus OTAManager::begin(uint16_t owner, uint32_t size, const uint8_t* sha256) {
+    uint32_t now = millis();
+
+    if (isActive()) {
+        bool sameImage = size == imageSize && memcmp(sha256, expectedHash, sizeof(expectedHash)) == 0;
+        if (sameImage && (suspended || owner == connId)) {
+            // A suspended segment was already counted by suspend()
+            if (!suspended) elapsedBeforeSegment += now - segmentStartedAt;
+            connId = owner;
+            suspended = false;
+            segmentStartedAt = now;
+            segmentStartOffset = received.load();
+            WIBLE_LOGI("OTA resumed at %u of %u bytes", (unsigned)segmentStartOffset, (unsigned)imageSize);
+            return OTAStatus::READY;
+        }
+        if (!suspended) return OTAStatus::BUSY;
+
+        WIBLE_LOGW("OTA: new image replaces the suspended session");
+        abort(OTAStatus::ABORTED);
+    }
+
+    if (size == 0 || !Update.begin(size)) {
+        WIBLE_LOGE("OTA: cannot begin a %u byte image", (unsigned)size);
+        return OTAStatus::BEGIN_FAILED;
+    }
+
+    imageSize = size;
+    memcpy(expectedHash, sha256, sizeof(expectedHash));
+    sha.reset();
+    resetBuffers();
+    received.store(0);
+    flashed.store(0);
+    writeFailed.store(false);
+
+    connId = owner;
+    status = OTAStatus::READY;
+    suspended = false;
+    segmentStartedAt = now;
+    segmentStartOffset = 0;
+    elapsedBeforeSegment = 0;
+    lastProgressAt = now;
+
+    if (!startWriter()) {
+        LogManager::warn("OTA writer task not started, writing flash inline");
+    }
+    WIBLE_LOGI("OTA started: %u bytes", (unsigned)size);
+    return OTAStatus::READY;
+}
+
+void OTAManager::suspend(uint16_t owner) {
+    if (!isActive() || suspended || owner != connId) return;
+
+    uint32_t now = millis();
+    suspended = true;
+    suspendedAt = now;
+    elapsedBeforeSegment += now - segmentStartedAt;
+    WIBLE_LOGW("OTA suspended at %u of %u bytes", (unsigned)received.load(), (unsigned)imageSize);
+}
+
+void OTAManager::abort(OTAStatus reason) {
+    if (!isActive()) return;
+
+    stopWriter();
+    Update.abort();
+    WIBLE_LOGW("OTA aborted: %s at %u bytes", statusToString(reason), (unsigned)received.load());
+    report(reason);
+
+    status = OTAStatus::IDLE;
+    suspended = false;
+    resetBuffers();
+}
+
+bool OTAManager::isActive() const {
+    return status == OTAStatus::READY || status == OTAStatus::RECEIVING;
+}
+
+// ============================================================================
+// RECEIVE SIDE
+// ============================================================================
+
+bool OTAManager::write(const uint8_t* data, size_t length) {
+    if (!isActive() || suspended || writeFailed.load()) return false;
+    if (received.load() + length > imageSize) return false;
+    // Flash is behind: take none of it rather than part
+    if (!canAccept(length)) return false;
+    status = OTAStatus::RECEIVING;
+
+    while (length > 0) {
+        Buffer& buffer = buffers[fillIndex];
+        size_t room = WIBLE_OTA_BUFFER_SIZE - buffer.length;
+        size_t take = length < room ? length : room;
+        memcpy(buffer.data + buffer.length, data, take);
+        buffer.length += take;
+        data += take;
+        length -= take;
+        uint32_t total = received.load() + take;
+        received.store(total);
+
+        if (buffer.length == WIBLE_OTA_BUFFER_SIZE || total == imageSize) {
+            buffer.full.store(true, std::memory_order_release);
+            fillIndex ^= 1;
+            if (writerRunning.load()) xTaskNotifyGive(writerTask);
+            else flushBuffers();
+        }
+    }
+    return true;
+}
+
+bool OTAManager::canAccept(size_t length) const {
+    const Buffer& current = buffers[fillIndex];
+    if (current.full.load(std::memory_order_acquire)) return false;
+    if (length <= WIBLE_OTA_BUFFER_SIZE - current.length) return true;
+    return length <= 2 * WIBLE_OTA_BUFFER_SIZE - current.length &&
+           !buffers[fillIndex ^ 1].full.load(std::memory_order_acquire);
+}
+
+// ============================================================================
+// WRITER SIDE
+// ============================================================================
+
+bool OTAManager::startWriter() {
+    if (writerRunning.load()) return true;
+
+    writerStopRequested.store(false);
+    writerRunning.store(true);
+    if (xTaskCreatePinnedToCore(writerTaskEntry, "wible_ota", WIBLE_OTA_WRITER_STACK_SIZE, this,
+                                config.writerPriority, &writerTask, tskNO_AFFINITY) != pdPASS) {
+        writerRunning.store(false);
+        writerTask = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void OTAManager::stopWriter() {
+    if (writerRunning.load()) {
+        writerStopRequested.store(true);
+        xTaskNotifyGive(writerTask);
+        // A flash write in progress finishes first
+        while (writerRunning.load()) vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    writerTask = nullptr;
+}
+
+void OTAManager::writerTaskEntry(void* param) {
+    OTAManager* self = static_cast<OTAManager*>(param);
+
+    while (!self->writerStopRequested.load()) {
+        self->flushBuffers();
+        // Woken when a buffer fills, or to stop
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+
+    self->writerRunning.store(false);
+    vTaskDelete(nullptr);
+}
+
+void OTAManager::flushBuffers() {
+    // Buffers fill in turn, so they are written in the same order
+    while (buffers[flushIndex].full.load(std::memory_order_acquire)) {
+        Buffer& buffer = buffers[flushIndex];
+        if (!writeFailed.load()) {
+            sha.update(buffer.data, buffer.length);
+            if (Update.write(buffer.data, buffer.length) == buffer.length) {
+                flashed.store(flashed.load() + buffer.length);
+            } else {
+                writeFailed.store(true);
+            }
+        }
+        buffer.length = 0;
+        buffer.full.store(false, std::memory_order_release);
+        flushIndex ^= 1;
+    }
+}
+
+// ============================================================================
+// COMPLETION AND REPORTING
+// ============================================================================
+
+void OTAManager::loop() {
+    uint32_t now = millis();
+
+    if (status == OTAStatus::COMPLETE) {
+        if (config.rebootOnSuccess && now - completedAt >= config.rebootDelayMs) {
+            status = OTAStatus::IDLE;
+            LogManager::info("Restarting into the new firmware");
+            ESP.restart();
+        }
+        return;
+    }
+    if (!isActive()) return;
+
+    if (writeFailed.load()) {
+        abort(OTAStatus::WRITE_FAILED);
+        return;
+    }
+    if (flashed.load() == imageSize) {
+        finish();
+        return;
+    }
+    if (suspended) {
+        if (now - suspendedAt >= config.idleTimeoutMs) abort(OTAStatus::TIMEOUT);
+        return;
+    }
+    if (status == OTAStatus::RECEIVING && now - lastProgressAt >= config.progressIntervalMs) {
+        lastProgressAt = now;
+        report(OTAStatus::RECEIVING);
+    }
+}
+
+void OTAManager::finish() {
+    stopWriter();
+
+    uint8_t digest[WIBLE_SHA256_SIZE] = {0};
+    sha.finish(digest);
+    uint8_t diff = 0;
+    for (size_t i = 0; i < sizeof(digest); i++) diff |= digest[i] ^ expectedHash[i];
+    if (diff != 0) {
+        abort(OTAStatus::HASH_MISMATCH);
+        return;
+    }
+    if (!Update.end(true)) {
+        abort(OTAStatus::WRITE_FAILED);
+        return;
+    }
+
+    uint32_t now = millis();
+    if (!suspended) elapsedBeforeSegment += now - segmentStartedAt;
+    segmentStartedAt = now;
+    completedAt = now;
+    OTAProgress progress = getProgress();
+    status = OTAStatus::COMPLETE;
+    WIBLE_LOGI("OTA complete: %u bytes in %u ms, hash verified", (unsigned)imageSize,
+               (unsigned)progress.elapsedMs);
+    report(OTAStatus::COMPLETE);
+}
+
+OTAProgress OTAManager::getProgress() const {
+    OTAProgress progress;
+    progress.status = status;
+    progress.imageSize = imageSize;
+    progress.received = received.load();
+    progress.flashed = flashed.load();
+
+    bool running = isActive() && !suspended;
+    uint32_t segmentMs = running ? millis() - segmentStartedAt : 0;
+    progress.elapsedMs = elapsedBeforeSegment + segmentMs;
+
+    // Current segment only: a resume restarts the figure
+    uint32_t bytes = progress.received - segmentStartOffset;
+    uint32_t ms = running ? segmentMs : progress.elapsedMs;
+    if (ms > 0) {
+        uint64_t rate = (uint64_t)bytes * 10000 / 1024 / ms;
+        progress.throughput = rate > 0xFFFF ? 0xFFFF : (uint16_t)rate;
+    }
+    return progress;
+}
+
+void OTAManager::report(OTAStatus reportStatus) {
+    if (!progressCallback) return;
+    OTAProgress progress = getProgress();
+    progress.status = reportStatus;
+    progressCallback(connId, progress);
+}
+
+const char* OTAManager::statusToString(OTAStatus status) {
+    switch (status) {
+        case OTAStatus::IDLE: return "IDLE";
+        case OTAStatus::READY: return "READY";
+        case OTAStatus::RECEIVING: return "RECEIVING";
+        case OTAStatus::COMPLETE: return "COMPLETE";
+        case OTAStatus::ABORTED: return "ABORTED";
+        case OTAStatus::BEGIN_FAILED: return "BEGIN_FAILED";
+        case OTAStatus::WRITE_FAILED: return "WRITE_FAILED";
+        case OTAStatus::HASH_MISMATCH: return "HASH_MISMATCH";
+        case OTAStatus::BUSY: return "BUSY";
+        case OTAStatus::TIMEOUT: return "TIMEOUT";
+        default: return "UNKNOWN";
+    }
+}
+
+} // namespace WiBLE
@@ -0,0 +1,177 @@
+/**
+ * OTAManager.h - Firmware update streamed over BLE
+ *
+ * The phone announces the image (size and SHA-256), then sends it as a
+ * streamed chunked transfer on the data characteristic. Frames land in one
+ * of two sector-sized buffers; a full buffer is handed to a writer task
+ * that hashes it and writes it to the OTA partition while the other one
+ * fills, so flash erase/write time overlaps with the radio. When flash
+ * falls behind, frames are refused until a buffer frees and the phone's ACK
+ * window resends them.
+ *
+ * A session survives a BLE disconnect: announcing the same image again
+ * resumes at the byte offset already received. The image boots once its
+ * hash matches; the hash guards against corruption, it does not
+ * authenticate the image (use signed app images for that).
+ */
+
+#ifndef WIBLE_OTA_MANAGER_H
+#define WIBLE_OTA_MANAGER_H
+
+#include <Arduino.h>
+#include <functional>
+#include <atomic>
+#include <freertos/task.h>
+#include "SecurityManager.h"
+
+namespace WiBLE {
+
+// ============================================================================
+// OTA LIMITS
+// ============================================================================
+
+// Each of the two buffers holds one flash sector
+#ifndef WIBLE_OTA_BUFFER_SIZE
+#define WIBLE_OTA_BUFFER_SIZE        4096
+#endif
+
+#ifndef WIBLE_OTA_WRITER_STACK_SIZE
+#define WIBLE_OTA_WRITER_STACK_SIZE  4096
+#endif
+
+enum class OTAStatus : uint8_t {
+    IDLE = 0,
+    READY = 1,              // Begun or resumed; send from the offset
+    RECEIVING = 2,          // Progress report
+    COMPLETE = 3,           // Hash verified, image set to boot
+    ABORTED = 4,
+    BEGIN_FAILED = 5,       // No OTA partition, or the image does not fit
+    WRITE_FAILED = 6,
+    HASH_MISMATCH = 7,
+    BUSY = 8,               // Another phone owns the session
+    TIMEOUT = 9             // Suspended longer than idleTimeoutMs
+};
+
+// ============================================================================
+// CONFIGURATION AND PROGRESS
+// ============================================================================
+
+struct OTAConfig {
+    uint32_t idleTimeoutMs = 120000;        // Suspended session kept for a reconnect this long
+    uint32_t progressIntervalMs = 500;
+    bool rebootOnSuccess = true;
+    uint32_t rebootDelayMs = 1000;          // Lets the COMPLETE report reach the phone
+    uint8_t writerPriority = 2;
+};
+
+struct OTAProgress {
+    OTAStatus status = OTAStatus::IDLE;
+    uint32_t imageSize = 0;
+    uint32_t received = 0;                  // Resume offset
+    uint32_t flashed = 0;
+    uint16_t throughput = 0;                // 0.1 KB/s, current segment
+    uint32_t elapsedMs = 0;                 // Receiving time, suspensions excluded
+};
+
+using OTAProgressCallback = std::function<void(uint16_t connId, const OTAProgress& progress)>;
+
+// ============================================================================
+// OTA MANAGER
+// ============================================================================
+
+class OTAManager {
+public:
+    OTAManager();
+    ~OTAManager();
+
+    void initialize(const OTAConfig& config);
+
+    /**
+     * Start a session for an image, or resume the suspended one when
+     * size and hash match
+     * @return READY with progress.received as the offset to send from,
+     *         BUSY or BEGIN_FAILED otherwise
+     */
+    OTAStatus begin(uint16_t connId, uint32_t imageSize, const uint8_t* sha256);
+
+    /**
+     * Image bytes in order, from the BLE receive path. Never waits for flash.
+     * @return false if the session cannot take them, or the buffers they
+     *         would go to are still being flashed (see canAccept)
+     */
+    bool write(const uint8_t* data, size_t length);
+
+    /**
+     * The buffers `length` bytes would fill are free; up to one buffer's
+     * worth per call
+     */
+    bool canAccept(size_t length) const;
+
+    /**
+     * The owning phone went away; the session waits idleTimeoutMs for it
+     */
+    void suspend(uint16_t connId);
+
+    void abort(OTAStatus reason = OTAStatus::ABORTED);
+
+    /**
+     * Verify once everything is flashed, report progress, expire suspended
+     * sessions and reboot after success; call from loop()
+     */
+    void loop();
+
+    bool isActive() const;
+    uint16_t getConnId() const { return connId; }
+    OTAProgress getProgress() const;
+
+    void onProgress(OTAProgressCallback callback) { progressCallback = callback; }
+
+    static const char* statusToString(OTAStatus status);
+
+private:
+    struct Buffer {
+        uint8_t data[WIBLE_OTA_BUFFER_SIZE];
+        size_t length;
+        std::atomic<bool> full;
+    };
+
+    OTAConfig config;
+    OTAProgressCallback progressCallback;
+
+    OTAStatus status;
+    uint16_t connId;
+    uint32_t imageSize;
+    uint8_t expectedHash[WIBLE_SHA256_SIZE];
+    Sha256 sha;
+
+    Buffer buffers[2];
+    uint8_t fillIndex;                      // Receiver side
+    uint8_t flushIndex;                     // Writer side
+    std::atomic<uint32_t> received;
+    std::atomic<uint32_t> flashed;
+    std::atomic<bool> writeFailed;
+
+    TaskHandle_t writerTask;
+    std::atomic<bool> writerStopRequested;
+    std::atomic<bool> writerRunning;
+
+    bool suspended;
+    uint32_t suspendedAt;
+    uint32_t segmentStartedAt;
+    uint32_t segmentStartOffset;
+    uint32_t elapsedBeforeSegment;
+    uint32_t lastProgressAt;
+    uint32_t completedAt;
+
+    bool startWriter();
+    void stopWriter();
+    static void writerTaskEntry(void* param);
+    void flushBuffers();
+    void finish();
+    void report(OTAStatus reportStatus);
+    void resetBuffers();
+};
+
+} // namespace WiBLE
+
+#endif // WIBLE_OTA_MANAGER_H
@@ -8,126 +8,904 @@
 #include "StateManager.h"
 #include "WiFiManager.h"
 #include "utils/LogManager.h"
+#include "utils/Metrics.h"
 
 namespace WiBLE {
 
+static_assert(WIBLE_SESSION_SLOTS >= WIBLE_MAX_CONNECTIONS,
+              "Every BLE connection slot needs a security session slot");
+static_assert(WIBLE_CONTROL_REPLY_MAX <= WIBLE_SCAN_PAGE_MAX,
+              "A batch reply is one notification");
+
+const ProvisioningOrchestrator::ControlTableEntry ProvisioningOrchestrator::controlTable[] = {
+    { WIBLE_OP_KEY_EXCHANGE, &ProvisioningOrchestrator::handleKeyExchange, nullptr },
+    { WIBLE_OP_RESUME, &ProvisioningOrchestrator::handleResume, nullptr },
+    { WIBLE_OP_SET_FORMAT, &ProvisioningOrchestrator::handleSetFormat, nullptr },
+    { WIBLE_OP_SCAN_WIFI, &ProvisioningOrchestrator::handleScanRequest, &ProvisioningOrchestrator::commandScan },
+    { WIBLE_OP_OTA_BEGIN, &ProvisioningOrchestrator::handleOTABegin, nullptr },
+    { WIBLE_OP_OTA_ABORT, &ProvisioningOrchestrator::handleOTAAbort, nullptr },
+    { WIBLE_OP_GROUP_KEY_EXCHANGE, &ProvisioningOrchestrator::handleGroupKeyExchange, nullptr },
+    { WIBLE_OP_GET_STATUS, nullptr, &ProvisioningOrchestrator::commandGetStatus },
+    { WIBLE_OP_SET_PARAM, nullptr, &ProvisioningOrchestrator::commandSetParam },
+    { WIBLE_OP_REBOOT, nullptr, &ProvisioningOrchestrator::commandReboot },
+    { WIBLE_OP_GET_METRICS, nullptr, &ProvisioningOrchestrator::commandGetMetrics },
+};
+
 ProvisioningOrchestrator::ProvisioningOrchestrator(
     StateManager* stateMgr,
     BLEManager* bleMgr,
     WiFiManager* wifiMgr,
     SecurityManager* secMgr
-) : stateManager(stateMgr), bleManager(bleMgr), wifiManager(wifiMgr), securityManager(secMgr) {
+) : stateManager(stateMgr), bleManager(bleMgr), wifiManager(wifiMgr), securityManager(secMgr),
+    otaManager(nullptr), eventBus(nullptr), credentialsConnId(WIBLE_CONN_ID_ALL), validationEnabled(true), connectedAddress(0),
+    credentialsFromGroup(false), rebootPending(false), rebootAt(0), commandSeq(0) {
+    for (ClientProtocol& client : clients) {
+        client.connId = WIBLE_CONN_ID_ALL;
+        client.format = WireFormat::JSON;
+        client.inUse = false;
+        client.scanRequested = false;
+        client.groupLead = false;
+    }
+    for (AppCommand& command : appCommands) command.opcode = 0;
 }
 
 void ProvisioningOrchestrator::initialize() {
     // Register for BLE data events
     if (bleManager) {
-        bleManager->onDataReceived([this](const String& uuid, const std::vector<uint8_t>& data) {
-            processBLEData(uuid, data);
+        bleManager->onDataReceived([this](uint16_t connId, const String& uuid, uint8_t* data, size_t length) {
+            processBLEData(connId, uuid, data, length);
+        });
+        
+        bleManager->onConnection([this](const BLEConnectionInfo& info) {
+            handleClientConnected(info);
         });
+        
+        bleManager->onDisconnection([this](const BLEConnectionInfo& info, uint8_t reason) {
+            handleClientDisconnected(info, reason);
+        });
+    }
+}
+
+void ProvisioningOrchestrator::handleClientConnected(const BLEConnectionInfo& info) {
+    // Every client starts on JSON until it asks for TLV
+    if (info.slot < WIBLE_MAX_CONNECTIONS && !(clients[info.slot].inUse &&
+                                              clients[info.slot].connId == info.connectionId)) {
+        clients[info.slot].connId = info.connectionId;
+        clients[info.slot].format = WireFormat::JSON;
+        clients[info.slot].inUse = true;
+        clients[info.slot].scanRequested = false;
+        clients[info.slot].groupLead = false;
+    }
+    
+    if (info.isQueued) {
+        uint8_t position = bleManager->getQueuedCount();
+        char text[4];
+        snprintf(text, sizeof(text), "%u", (unsigned)position);
+        sendStatus(info.connectionId, ProtocolStatus::QUEUED, position, "Position ", text);
+        return;
+    }
+    
+    // Every connection negotiates its own session
+    if (securityManager) securityManager->releaseSession(info.slot);
+    publishClientEvent(EventType::BLE_CONNECTED, info.connectionId, 0, 0, info.clientAddress.c_str());
+    postEvent(ClientEventType::CONNECTED, info.connectionId);
+    
+    // With encryption on, AUTH_SUCCESS waits for KEY_EXCHANGE or RESUME
+    if (!requiresHandshake()) {
+        bleManager->setAuthenticated(info.connectionId, true);
+        publishClientEvent(EventType::AUTHENTICATED, info.connectionId, 0, 1, info.clientAddress.c_str());
+        postEvent(ClientEventType::AUTH_SUCCESS, info.connectionId);
     }
 }
 
-void ProvisioningOrchestrator::processBLEData(const String& characteristicUUID, const std::vector<uint8_t>& data) {
+void ProvisioningOrchestrator::handleClientDisconnected(const BLEConnectionInfo& info, uint8_t reason) {
+    if (securityManager) securityManager->releaseSession(info.slot);
+    ClientProtocol* client = findClient(info.connectionId);
+    if (client) client->inUse = false;
+    if (info.isQueued) return;
+    publishClientEvent(EventType::BLE_DISCONNECTED, info.connectionId, reason, 0, info.clientAddress.c_str());
+    postEvent(ClientEventType::DISCONNECTED, info.connectionId, reason);
+}
+
+void ProvisioningOrchestrator::postEvent(ClientEventType type, uint16_t connId, uint8_t reason) {
+    ClientEvent* event = clientEvents.beginWrite();
+    if (!event) {
+        WIBLE_LOGE("Client event queue full, dropping event %u for conn %u", (unsigned)type, (unsigned)connId);
+        return;
+    }
+    event->seq = commandSeq++;
+    event->connId = connId;
+    event->type = type;
+    event->reason = reason;
+    clientEvents.commitWrite();
+}
+
+bool ProvisioningOrchestrator::postCommand(bool credentials, uint16_t connId, const uint8_t* data, size_t length) {
+    ClientCommand* command = commands.beginWrite();
+    if (!command || length > sizeof(command->data)) return false;
+    
+    command->seq = commandSeq++;
+    command->connId = connId;
+    command->length = (uint16_t)length;
+    command->credentials = credentials;
+    memcpy(command->data, data, length);
+    commands.commitWrite();
+    return true;
+}
+
+void ProvisioningOrchestrator::processEvent(const ClientEvent& event) {
+    uint16_t connId = event.connId;
+    switch (event.type) {
+        case ClientEventType::CONNECTED:
+            // Only the first served client moves the state machine along
+            if (stateManager->isEventValid(StateEvent::BLE_CLIENT_CONNECTED)) {
+                stateManager->handleEvent(StateEvent::BLE_CLIENT_CONNECTED);
+                stateManager->handleEvent(StateEvent::AUTH_STARTED);
+            }
+            break;
+        
+        case ClientEventType::DISCONNECTED:
+            // The image waits for the phone to come back and resume
+            if (otaManager && otaManager->isActive() && otaManager->getConnId() == connId) {
+                otaManager->suspend(connId);
+                bleManager->setTransferSink(connId, nullptr);
+            }
+            
+            // After credentials arrive the WiFi attempt carries on without BLE;
+            // before that, fall back only once the last served client has left
+            if (bleManager->getConnectionCount() == 0 &&
+                stateManager->isEventValid(StateEvent::BLE_CLIENT_DISCONNECTED)) {
+                stateManager->handleEvent(StateEvent::BLE_CLIENT_DISCONNECTED);
+            }
+            break;
+        
+        case ClientEventType::AUTH_SUCCESS:
+            if (stateManager->isEventValid(StateEvent::AUTH_SUCCESS)) {
+                stateManager->handleEvent(StateEvent::AUTH_SUCCESS);
+            }
+            break;
+        
+        case ClientEventType::AUTH_FAILED:
+            applyAuthFailure(connId);
+            break;
+    }
+}
+
+void ProvisioningOrchestrator::processCommand(ClientCommand& command) {
+    if (command.credentials) {
+        applyCredentials(command.connId, command.data, command.length);
+        SecurityUtils::secureWipe(command.data, command.length);
+    } else {
+        runControlCommand(command.connId, command.data, command.length);
+    }
+}
+
+void ProvisioningOrchestrator::processBLEData(uint16_t connId, const String& characteristicUUID,
+                                              uint8_t* data, size_t length) {
+    // Decrypt and reply with the sending client's own session
+    if (securityManager && !securityManager->selectSession(bleManager->getConnectionSlot(connId))) {
+        SecurityUtils::secureWipe(data, length);
+        return;
+    }
+    
     if (characteristicUUID == WIBLE_CRED_CHARACTERISTIC) {
-        handleCredentials(data);
+        handleCredentials(connId, data, length);
     } else if (characteristicUUID == WIBLE_CONTROL_CHARACTERISTIC) {
-        handleControlCommand(data);
+        handleControlCommand(connId, data, length);
     }
 }
 
-void ProvisioningOrchestrator::handleCredentials(const std::vector<uint8_t>& data) {
-    LogManager::info("Received credentials packet (" + String((int)data.size()) + " bytes)");
+void ProvisioningOrchestrator::handleCredentials(uint16_t connId, uint8_t* data, size_t length) {
+    WIBLE_LOGI("Received credentials packet from conn %u (%u bytes)", (unsigned)connId, (unsigned)length);
+
+    // Never accept plaintext credentials when a session is required
+    if (requiresHandshake() && (!bleManager->isAuthenticated(connId) ||
+                                !securityManager->isSessionEstablished())) {
+        SecurityUtils::secureWipe(data, length);
+        sendStatus(connId, ProtocolStatus::ERROR, (uint8_t)ProtocolError::KEY_EXCHANGE_REQUIRED,
+                   "Key exchange required");
+        return;
+    }
+    
+    // 1. Decrypt in place over the received frame
+    //    GCM: [Nonce (12 bytes)] [Ciphertext] [Tag (16 bytes)]
+    //    CBC: [IV (16 bytes)] [Ciphertext]
+    uint8_t* plaintext = data;
+    size_t plaintextLength = length;
+    if (securityManager && securityManager->isSessionEstablished()) {
+        plaintextLength = securityManager->decryptInPlace(data, length);
+        plaintext = data + securityManager->getCipherHeaderSize();
+    }
+    
+    if (plaintextLength == 0) {
+        WIBLE_LOGE("Decryption failed or empty data");
+        SecurityUtils::secureWipe(data, length);
+        sendStatus(connId, ProtocolStatus::ERROR, (uint8_t)ProtocolError::DECRYPTION_FAILED,
+                   "Decryption failed");
+        return;
+    }
     
+    // The rest drives the state machine and WiFi, so it runs on loop()
+    bool queued = postCommand(true, connId, plaintext, plaintextLength);
+    SecurityUtils::secureWipe(data, length);
+    if (!queued) sendStatus(connId, ProtocolStatus::BUSY, 0, "Provisioning in progress");
+}
+
+void ProvisioningOrchestrator::applyCredentials(uint16_t connId, uint8_t* plaintext, size_t plaintextLength) {
+    // Another client's credentials are already being tried
+    if (attemptInFlight()) {
+        sendStatus(connId, ProtocolStatus::BUSY, 0, "Provisioning in progress");
+        return;
+    }
+    
+    // 2. Parse in place; the fields point into the frame until it is wiped.
+    //    A TLV frame also switches this client's replies to TLV.
+    CredentialFrame frame;
+    bool parsed = ProvisioningProtocol::parseCredentials(plaintext, plaintextLength, frame);
+    if (frame.format == WireFormat::TLV) {
+        ClientProtocol* client = findClient(connId);
+        if (client) client->format = WireFormat::TLV;
+    }
+    
+    WiFiCredentials creds;
+    if (parsed) {
+        creds.ssid = String(frame.ssid, frame.ssidLength);
+        if (frame.passphraseLength) creds.password = String(frame.passphrase, frame.passphraseLength);
+        creds.hidden = frame.hidden;
+        applyCredentialExtras(frame, creds);
+    }
+    SecurityUtils::secureWipe(plaintext, plaintextLength);
+    // A bad frame leaves the state machine where it was
+    if (!parsed || !creds.isValid()) {
+        WIBLE_LOGE("Invalid credentials format");
+        sendStatus(connId, ProtocolStatus::ERROR, (uint8_t)ProtocolError::INVALID_FORMAT, "Invalid format");
+        return;
+    }
+    publishClientEvent(EventType::CREDENTIALS_RECEIVED, connId, 0, 0, creds.ssid.c_str());
+    
+    ClientProtocol* sender = findClient(connId);
+    credentialsFromGroup = sender && sender->groupLead;
     stateManager->handleEvent(StateEvent::CREDENTIALS_RECEIVED);
     
-    // 1. Decrypt
-    std::vector<uint8_t> decryptedData;
-    if (securityManager && securityManager->isSessionEstablished()) {
-        EncryptedMessage msg;
-        // Assuming data format: [IV (16 bytes)] [Ciphertext]
-        if (data.size() > 16) {
-            msg.iv.assign(data.begin(), data.begin() + 16);
-            msg.ciphertext.assign(data.begin() + 16, data.end());
-            decryptedData = securityManager->decrypt(msg);
-        } else {
-            LogManager::error("Invalid encrypted packet size");
-            return;
+    // 3. Connect (returns immediately; result arrives via onWiFiConnected/onWiFiDisconnected)
+    stateManager->handleEvent(StateEvent::WIFI_CONNECT_STARTED);
+    if (wifiManager) {
+        credentialsConnId = connId;
+        wifiManager->connectWithRetry(creds.ssid, creds.password);
+        sendStatus(connId, ProtocolStatus::CONNECTING, 0, "Connecting to ", creds.ssid.c_str());
+    }
+}
+
+bool ProvisioningOrchestrator::attemptInFlight() const {
+    // A reset can end the attempt without a WiFi outcome
+    return credentialsConnId != WIBLE_CONN_ID_ALL &&
+           (stateManager->isInState(ProvisioningState::CONNECTING_WIFI) ||
+            stateManager->isInState(ProvisioningState::VALIDATING_CONNECTION));
+}
+
+void ProvisioningOrchestrator::applyCredentialExtras(const CredentialFrame& frame, const WiFiCredentials& creds) {
+    if (wifiManager) {
+        // BSSID/channel hint: the first attempt skips the all-channel scan
+        if (frame.bssid && frame.channel) {
+            wifiManager->setConnectionHint(creds.ssid, frame.bssid, frame.channel);
+        }
+        if (frame.hasStaticIP) {
+            wifiManager->configureStaticIP(IPAddress(frame.ip).toString(), IPAddress(frame.gateway).toString(),
+                                           IPAddress(frame.subnet).toString(),
+                                           frame.dns ? IPAddress(frame.dns).toString() : String(""));
         }
+    }
+    
+    if (!customFieldCallback) return;
+    for (uint8_t i = 0; i < frame.customCount; i++) {
+        const CustomField& field = frame.custom[i];
+        customFieldCallback(String(field.key, field.keyLength),
+                            String((const char*)field.value, field.valueLength));
+    }
+}
+
+void ProvisioningOrchestrator::handleControlCommand(uint16_t connId, uint8_t* data, size_t length) {
+    if (length == 0) return;
+    
+    // Handshakes and formats stay with the sessions; everything else runs on loop()
+    switch (data[0]) {
+        case WIBLE_OP_KEY_EXCHANGE:
+        case WIBLE_OP_RESUME:
+        case WIBLE_OP_GROUP_KEY_EXCHANGE:
+        case WIBLE_OP_SET_FORMAT:
+            (this->*findControlEntry(data[0])->exchange)(connId, data + 1, length - 1);
+            return;
+    }
+    if (!postCommand(false, connId, data, length)) {
+        sendStatus(connId, ProtocolStatus::BUSY, 0, "Busy");
+    }
+}
+
+void ProvisioningOrchestrator::runControlCommand(uint16_t connId, uint8_t* data, size_t length) {
+    if (data[0] == WIBLE_OP_BATCH) {
+        handleBatch(connId, data + 1, length - 1, true);
+        return;
+    }
+    const ControlTableEntry* entry = findControlEntry(data[0]);
+    if (entry && entry->exchange) {
+        (this->*entry->exchange)(connId, data + 1, length - 1);
+        return;
+    }
+    // Any other command is answered as a batch of one
+    handleBatch(connId, data, length, false);
+}
+
+void ProvisioningOrchestrator::publishClientEvent(EventType type, uint16_t connId, uint8_t code, uint8_t value,
+                                                  const char* text) {
+    if (!eventBus) return;
+    Event event;
+    event.type = type;
+    event.connId = connId;
+    event.code = code;
+    event.value = value;
+    // Handshake replies only know the connection; the address comes from the table
+    event.setText(text ? text : bleManager->getConnectionInfo(connId).clientAddress.c_str());
+    eventBus->publish(event);
+}
+
+bool ProvisioningOrchestrator::requiresHandshake() const {
+    return securityManager && securityManager->isEncryptionEnabled();
+}
+
+void ProvisioningOrchestrator::handleAuthFailure(uint16_t connId) {
+    publishClientEvent(EventType::AUTHENTICATED, connId, 0, 0);
+    postEvent(ClientEventType::AUTH_FAILED, connId);
+}
+
+void ProvisioningOrchestrator::applyAuthFailure(uint16_t connId) {
+    // Only the client that failed is dropped; AUTH_FAILED (which disconnects
+    // everyone) is raised when it is the only one being served
+    if (bleManager->getConnectionCount() <= 1 && stateManager->isEventValid(StateEvent::AUTH_FAILED)) {
+        stateManager->handleEvent(StateEvent::AUTH_FAILED);
     } else {
-        // Plaintext (for testing or OPEN security)
-        decryptedData = data;
+        bleManager->disconnect(connId);
     }
+}
+
+void ProvisioningOrchestrator::handleKeyExchange(uint16_t connId, const uint8_t* data, size_t length) {
+    if (!requiresHandshake() || bleManager->isAuthenticated(connId)) return;
     
-    if (decryptedData.empty()) {
-        LogManager::error("Decryption failed or empty data");
-        sendResponse("ERROR", "Decryption failed");
+    if (!securityManager->establishSession(data, length)) {
+        WIBLE_LOGE("Key exchange failed");
+        sendStatus(connId, ProtocolStatus::ERROR, (uint8_t)ProtocolError::KEY_EXCHANGE_FAILED,
+                   "Key exchange failed");
+        handleAuthFailure(connId);
         return;
     }
     
-    String jsonStr((char*)decryptedData.data(), decryptedData.size());
-    LogManager::debug("Decrypted JSON: " + jsonStr);
+    std::vector<uint8_t> reply;
+    reply.reserve(1 + WIBLE_ECDH_KEY_SIZE + WIBLE_TICKET_ID_SIZE);
+    reply.push_back(WIBLE_OP_KEY_EXCHANGE);
+    std::vector<uint8_t> publicKey = securityManager->getPublicKey();
+    reply.insert(reply.end(), publicKey.begin(), publicKey.end());
+    
+    uint8_t ticketId[WIBLE_TICKET_ID_SIZE];
+    if (securityManager->issueResumptionTicket(ticketId)) {
+        reply.insert(reply.end(), ticketId, ticketId + sizeof(ticketId));
+    }
+    bleManager->setAuthenticated(connId, true);
+    bleManager->notify(connId, WIBLE_STATUS_CHARACTERISTIC, reply);
+    publishClientEvent(EventType::AUTHENTICATED, connId, 0, 1);
+    
+    WIBLE_LOGI("Session established for conn %u (%u us)", (unsigned)connId,
+               (unsigned)securityManager->getHandshakeStats().lastHandshakeUs);
+    postEvent(ClientEventType::AUTH_SUCCESS, connId);
+}
+
+void ProvisioningOrchestrator::handleResume(uint16_t connId, const uint8_t* data, size_t length) {
+    if (!requiresHandshake() || bleManager->isAuthenticated(connId)) return;
     
-    // 2. Parse
-    WiFiCredentials creds = parseCredentials(jsonStr);
-    if (!creds.isValid()) {
-        LogManager::error("Invalid credentials format");
-        sendResponse("ERROR", "Invalid format");
+    uint8_t reply[2 + WIBLE_RESUME_NONCE_SIZE + WIBLE_TICKET_ID_SIZE];
+    reply[0] = WIBLE_OP_RESUME;
+    
+    bool resumed = length == WIBLE_TICKET_ID_SIZE + WIBLE_RESUME_NONCE_SIZE &&
+                   securityManager->resumeSession(data, data + WIBLE_TICKET_ID_SIZE,
+                                                  reply + 2, reply + 2 + WIBLE_RESUME_NONCE_SIZE);
+    if (!resumed) {
+        // Unknown or expired ticket: the phone falls back to KEY_EXCHANGE
+        reply[1] = 1;
+        bleManager->notify(connId, WIBLE_STATUS_CHARACTERISTIC, std::vector<uint8_t>(reply, reply + 2));
         return;
     }
     
-    // 3. Connect
-    stateManager->handleEvent(StateEvent::WIFI_CONNECT_STARTED);
-    if (wifiManager) {
-        wifiManager->connect(creds.ssid, creds.password);
+    reply[1] = 0;
+    bleManager->setAuthenticated(connId, true);
+    bleManager->notify(connId, WIBLE_STATUS_CHARACTERISTIC, std::vector<uint8_t>(reply, reply + sizeof(reply)));
+    publishClientEvent(EventType::AUTHENTICATED, connId, 0, 1);
+    
+    WIBLE_LOGI("Session resumed for conn %u (%u us)", (unsigned)connId,
+               (unsigned)securityManager->getHandshakeStats().lastHandshakeUs);
+    postEvent(ClientEventType::AUTH_SUCCESS, connId);
+}
+
+void ProvisioningOrchestrator::handleGroupKeyExchange(uint16_t connId, const uint8_t* data, size_t length) {
+    if (bleManager->isAuthenticated(connId)) return;
+    
+    // Leads only speak TLV
+    ClientProtocol* client = findClient(connId);
+    if (client) client->format = WireFormat::TLV;
+    
+    // Credentials are only relayed over a session bound to the fleet secret
+    if (!requiresHandshake() || groupSecret.isEmpty()) {
+        sendStatus(connId, ProtocolStatus::ERROR, (uint8_t)ProtocolError::KEY_EXCHANGE_FAILED,
+                   "Group provisioning disabled");
+        return;
+    }
+    
+    if (!securityManager->establishSession(data, length) ||
+        !securityManager->bindSessionKey((const uint8_t*)groupSecret.c_str(), groupSecret.length())) {
+        WIBLE_LOGE("Group key exchange failed");
+        sendStatus(connId, ProtocolStatus::ERROR, (uint8_t)ProtocolError::KEY_EXCHANGE_FAILED,
+                   "Key exchange failed");
+        handleAuthFailure(connId);
+        return;
+    }
+    
+    // The lead derives the same key from ours and binds it the same way
+    std::vector<uint8_t> reply;
+    reply.reserve(1 + WIBLE_ECDH_KEY_SIZE);
+    reply.push_back(WIBLE_OP_GROUP_KEY_EXCHANGE);
+    std::vector<uint8_t> publicKey = securityManager->getPublicKey();
+    reply.insert(reply.end(), publicKey.begin(), publicKey.end());
+    
+    if (client) client->groupLead = true;
+    bleManager->setAuthenticated(connId, true);
+    bleManager->notify(connId, WIBLE_STATUS_CHARACTERISTIC, reply);
+    publishClientEvent(EventType::AUTHENTICATED, connId, 0, 1);
+    
+    WIBLE_LOGI("Group session established for conn %u (%u us)", (unsigned)connId,
+               (unsigned)securityManager->getHandshakeStats().lastHandshakeUs);
+    postEvent(ClientEventType::AUTH_SUCCESS, connId);
+}
+
+void ProvisioningOrchestrator::handleSetFormat(uint16_t connId, const uint8_t* data, size_t length) {
+    ClientProtocol* client = findClient(connId);
+    if (!client) return;
+    if (length == 1 && data[0] <= (uint8_t)WireFormat::TLV) {
+        client->format = (WireFormat)data[0];
     }
+    uint8_t reply[2] = { WIBLE_OP_SET_FORMAT, (uint8_t)client->format };
+    bleManager->notify(connId, WIBLE_STATUS_CHARACTERISTIC, std::vector<uint8_t>(reply, reply + sizeof(reply)));
 }
 
-void ProvisioningOrchestrator::handleControlCommand(const std::vector<uint8_t>& data) {
-    // Handle commands like "SCAN", "RESET", etc.
+void ProvisioningOrchestrator::handleScanRequest(uint16_t connId, const uint8_t* data, size_t length) {
+    ClientProtocol* client = findClient(connId);
+    if (!client || !wifiManager || !bleManager->isConnected(connId)) return;
+    
+    bool force = length > 0 && (data[0] & WIBLE_SCAN_REQUEST_FORCE);
+    if (wifiManager->startScan(force)) {
+        client->scanRequested = true;
+        return;
+    }
+    
+    // Fresh cache, or no scan possible right now (WiFi connecting)
+    size_t count = 0;
+    const WiFiScanEntry* entries = wifiManager->getScanResults(count);
+    sendScanPages(connId, entries, count, 100, true);
 }
 
-WiFiCredentials ProvisioningOrchestrator::parseCredentials(const String& json) {
-    WiFiCredentials creds;
-    // Simple manual JSON parsing for "ssid":"..." and "pass":"..."
-    // In production, use ArduinoJson
-    
-    int ssidStart = json.indexOf("\"ssid\":\"");
-    if (ssidStart != -1) {
-        ssidStart += 8;
-        int ssidEnd = json.indexOf("\"", ssidStart);
-        if (ssidEnd != -1) {
-            creds.ssid = json.substring(ssidStart, ssidEnd);
+void ProvisioningOrchestrator::onWiFiScanProgress(const WiFiScanEntry* updated, size_t count,
+                                                  uint8_t progress, bool complete) {
+    for (ClientProtocol& client : clients) {
+        if (!client.inUse || !client.scanRequested) continue;
+        if (!bleManager->isConnected(client.connId)) {
+            client.scanRequested = false;
+            continue;
         }
+        // Sweeps that found nothing new send nothing, until the last one
+        if (count > 0 || complete) sendScanPages(client.connId, updated, count, progress, complete);
+        if (complete) client.scanRequested = false;
+    }
+}
+
+void ProvisioningOrchestrator::sendScanPages(uint16_t connId, const WiFiScanEntry* entries, size_t count,
+                                             uint8_t progress, bool done) {
+    // Pages sized to the client's MTU; a done scan ends on a flagged page
+    WireFormat format = formatFor(connId);
+    uint16_t capacity = bleManager->getMaxPayloadSize(connId);
+    uint8_t page[WIBLE_SCAN_PAGE_MAX];
+    size_t sent = 0;
+    do {
+        size_t consumed = 0;
+        size_t length = ProvisioningProtocol::encodeScanPage(page, capacity, format, entries + sent,
+                                                             count - sent, progress, done, consumed);
+        if (length == 0) return;    // MTU too small for a page
+        sent += consumed;
+        bleManager->notify(connId, WIBLE_STATUS_CHARACTERISTIC, std::vector<uint8_t>(page, page + length));
+    } while (sent < count);
+}
+
+void ProvisioningOrchestrator::setOTAManager(OTAManager* ota) {
+    otaManager = ota;
+    if (!otaManager) return;
+    
+    otaManager->onProgress([this](uint16_t connId, const OTAProgress& progress) {
+        sendOTAReport(connId, progress);
+        bool ended = progress.status != OTAStatus::READY && progress.status != OTAStatus::RECEIVING;
+        if (ended) bleManager->setTransferSink(connId, nullptr);
+    });
+}
+
+void ProvisioningOrchestrator::handleOTABegin(uint16_t connId, const uint8_t* data, size_t length) {
+    if (!otaManager) return;
+    
+    // Firmware is at least as sensitive as credentials
+    if (requiresHandshake() && !bleManager->isAuthenticated(connId)) {
+        sendStatus(connId, ProtocolStatus::ERROR, (uint8_t)ProtocolError::KEY_EXCHANGE_REQUIRED,
+                   "Key exchange required");
+        return;
+    }
+    
+    OTAProgress progress;
+    if (length != 4 + WIBLE_SHA256_SIZE) {
+        progress.status = OTAStatus::BEGIN_FAILED;
+        sendOTAReport(connId, progress);
+        return;
     }
     
-    int passStart = json.indexOf("\"pass\":\"");
-    if (passStart != -1) {
-        passStart += 8;
-        int passEnd = json.indexOf("\"", passStart);
-        if (passEnd != -1) {
-            creds.password = json.substring(passStart, passEnd);
+    uint32_t imageSize = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+    OTAStatus status = otaManager->begin(connId, imageSize, data + 4);
+    if (status == OTAStatus::READY) {
+        OTAManager* ota = otaManager;
+        bleManager->setTransferSink(connId, [ota](uint16_t, const uint8_t* chunk, size_t chunkLength) {
+            // Flash is behind: the ACK window resends the frame
+            if (!ota->canAccept(chunkLength)) return TransferSinkResult::BUSY;
+            return ota->write(chunk, chunkLength) ? TransferSinkResult::ACCEPTED : TransferSinkResult::REJECTED;
+        });
+        progress = otaManager->getProgress();
+    }
+    progress.status = status;
+    sendOTAReport(connId, progress);
+}
+
+void ProvisioningOrchestrator::handleOTAAbort(uint16_t connId, const uint8_t* data, size_t length) {
+    // Reported through the progress callback, which also drops the sink
+    if (otaManager && otaManager->isActive() && otaManager->getConnId() == connId) {
+        otaManager->abort(OTAStatus::ABORTED);
+    }
+}
+
+void ProvisioningOrchestrator::sendOTAReport(uint16_t connId, const OTAProgress& progress) {
+    uint8_t report[WIBLE_OTA_REPORT_SIZE];
+    report[0] = WIBLE_OP_OTA_BEGIN;
+    report[1] = (uint8_t)progress.status;
+    for (size_t i = 0; i < 4; i++) report[2 + i] = (uint8_t)(progress.received >> (8 * i));
+    report[6] = (uint8_t)progress.throughput;
+    report[7] = (uint8_t)(progress.throughput >> 8);
+    bleManager->notify(connId, WIBLE_STATUS_CHARACTERISTIC, std::vector<uint8_t>(report, report + sizeof(report)));
+}
+
+// ============================================================================
+// BATCHED CONTROL COMMANDS
+// ============================================================================
+
+const ProvisioningOrchestrator::ControlTableEntry* ProvisioningOrchestrator::findControlEntry(uint8_t opcode) const {
+    for (const ControlTableEntry& entry : controlTable) {
+        if (entry.opcode == opcode) return &entry;
+    }
+    return nullptr;
+}
+
+bool ProvisioningOrchestrator::registerControlCommand(uint8_t opcode, ControlCommandHandler handler) {
+    if (opcode < WIBLE_OP_APP_FIRST || opcode > WIBLE_OP_APP_LAST) return false;
+    
+    AppCommand* free = nullptr;
+    for (AppCommand& command : appCommands) {
+        if (command.handler && command.opcode == opcode) {
+            command.handler = handler;
+            return true;
         }
+        if (!command.handler && !free) free = &command;
     }
+    if (!handler) return true;
+    if (!free) {
+        WIBLE_LOGW("No free control command slot for opcode %u", (unsigned)opcode);
+        return false;
+    }
+    free->opcode = opcode;
+    free->handler = handler;
+    return true;
+}
+
+void ProvisioningOrchestrator::handleBatch(uint16_t connId, const uint8_t* data, size_t length, bool framed) {
+    // One notification at the client's MTU
+    uint8_t reply[WIBLE_CONTROL_REPLY_MAX];
+    size_t capacity = bleManager->getMaxPayloadSize(connId);
+    if (capacity > sizeof(reply)) capacity = sizeof(reply);
+    if (capacity < 2 + WIBLE_CONTROL_ENTRY_HEADER) return;
     
-    return creds;
+    reply[0] = WIBLE_OP_BATCH;
+    size_t used = 2;
+    uint8_t count = 0;
+    bool truncated = false;
+    size_t pos = 0;
+    while (pos < length) {
+        if (capacity - used < WIBLE_CONTROL_ENTRY_HEADER) {
+            truncated = true;
+            break;
+        }
+        
+        // Framed: [opcode][length][payload]; alone: the rest of the write
+        uint8_t opcode = data[pos];
+        const uint8_t* payload = data + pos + 1;
+        size_t payloadLength = length - pos - 1;
+        bool malformed = false;
+        if (framed) {
+            malformed = payloadLength == 0 || data[pos + 1] > payloadLength - 1;
+            payloadLength = malformed ? 0 : data[pos + 1];
+            payload = data + pos + 2;
+            pos += 2 + payloadLength;
+        } else {
+            pos = length;
+        }
+        
+        size_t room = capacity - used - WIBLE_CONTROL_ENTRY_HEADER;
+        ControlReply out(reply + used + WIBLE_CONTROL_ENTRY_HEADER, room < 0xFF ? room : 0xFF);
+        ControlStatus status = malformed ? ControlStatus::INVALID_PAYLOAD
+                                         : runCommand(connId, opcode, payload, payloadLength, out);
+        reply[used] = opcode;
+        reply[used + 1] = (uint8_t)status;
+        reply[used + 2] = (uint8_t)out.length();
+        used += WIBLE_CONTROL_ENTRY_HEADER + out.length();
+        count++;
+        Metrics::increment(MetricCounter::CONTROL_COMMANDS);
+        
+        // The rest of a malformed batch cannot be framed
+        if (malformed) break;
+    }
+    reply[1] = count | (truncated ? WIBLE_CONTROL_TRUNCATED : 0);
+    bleManager->notify(connId, WIBLE_STATUS_CHARACTERISTIC, std::vector<uint8_t>(reply, reply + used));
 }
 
-void ProvisioningOrchestrator::sendResponse(const String& status, const String& message) {
-    String response = "{\"status\":\"" + status + "\",\"msg\":\"" + message + "\"}";
-    if (bleManager) {
-        bleManager->notify(WIBLE_STATUS_CHARACTERISTIC, std::vector<uint8_t>(response.begin(), response.end()));
+ControlStatus ProvisioningOrchestrator::runCommand(uint16_t connId, uint8_t opcode, const uint8_t* payload,
+                                                   size_t length, ControlReply& reply) {
+    // Handshake and OTA opcodes only work alone
+    const ControlTableEntry* entry = findControlEntry(opcode);
+    ControlCommandHandler* handler = nullptr;
+    if (!entry) {
+        for (AppCommand& command : appCommands) {
+            if (command.handler && command.opcode == opcode) handler = &command.handler;
+        }
     }
+    if (entry ? !entry->command : !handler) return ControlStatus::UNKNOWN_COMMAND;
+    
+    if (requiresHandshake() && !bleManager->isAuthenticated(connId)) return ControlStatus::AUTH_REQUIRED;
+    
+    return entry ? (this->*entry->command)(connId, payload, length, reply)
+                 : (*handler)(connId, payload, length, reply);
+}
+
+ControlStatus ProvisioningOrchestrator::commandScan(uint16_t connId, const uint8_t* data, size_t length,
+                                                    ControlReply& reply) {
+    if (!wifiManager) return ControlStatus::UNSUPPORTED;
+    if (length > 1) return ControlStatus::INVALID_PAYLOAD;
+    handleScanRequest(connId, data, length);
+    return ControlStatus::OK;
+}
+
+ControlStatus ProvisioningOrchestrator::commandGetStatus(uint16_t connId, const uint8_t* data, size_t length,
+                                                         ControlReply& reply) {
+    bool wifiUp = wifiManager && wifiManager->isConnected();
+    uint32_t address = wifiUp ? (uint32_t)WiFi.localIP() : 0;
+    uint8_t status[10];
+    status[0] = (uint8_t)stateManager->getCurrentState();
+    status[1] = wifiUp ? 1 : 0;
+    status[2] = (uint8_t)(wifiUp ? wifiManager->getRSSI() : 0);
+    for (size_t i = 0; i < 4; i++) status[3 + i] = (uint8_t)(address >> (8 * i));     // Network order
+    status[7] = bleManager->getConnectionCount();
+    status[8] = bleManager->getQueuedCount();
+    status[9] = wifiManager && wifiManager->hasStoredCredentials() ? 1 : 0;
+    return reply.put(status, sizeof(status)) ? ControlStatus::OK : ControlStatus::REPLY_TOO_LARGE;
+}
+
+ControlStatus ProvisioningOrchestrator::commandSetParam(uint16_t connId, const uint8_t* data, size_t length,
+                                                        ControlReply& reply) {
+    if (length != 2) return ControlStatus::INVALID_PAYLOAD;
+    
+    switch ((ControlParam)data[0]) {
+        case ControlParam::LOG_LEVEL:
+            if (data[1] > (uint8_t)LogLevel::NONE) return ControlStatus::INVALID_PAYLOAD;
+            LogManager::setLevel((LogLevel)data[1]);
+            return ControlStatus::OK;
+        
+        case ControlParam::WIRE_FORMAT: {
+            ClientProtocol* client = findClient(connId);
+            if (!client) return ControlStatus::FAILED;
+            if (data[1] > (uint8_t)WireFormat::TLV) return ControlStatus::INVALID_PAYLOAD;
+            client->format = (WireFormat)data[1];
+            return ControlStatus::OK;
+        }
+    }
+    return ControlStatus::UNSUPPORTED;
+}
+
+ControlStatus ProvisioningOrchestrator::commandReboot(uint16_t connId, const uint8_t* data, size_t length,
+                                                      ControlReply& reply) {
+    if (length != 0 && length != 2) return ControlStatus::INVALID_PAYLOAD;
+    if (otaManager && otaManager->isActive()) return ControlStatus::BUSY;
+    
+    uint32_t delayMs = length == 2 ? (uint32_t)(data[0] | (data[1] << 8)) : 0;
+    if (delayMs < WIBLE_CONTROL_REBOOT_DELAY_MS) delayMs = WIBLE_CONTROL_REBOOT_DELAY_MS;
+    rebootPending = true;
+    rebootAt = millis() + delayMs;
+    WIBLE_LOGW("Reboot requested by conn %u, in %u ms", (unsigned)connId, (unsigned)delayMs);
+    return ControlStatus::OK;
+}
+
+ControlStatus ProvisioningOrchestrator::commandGetMetrics(uint16_t connId, const uint8_t* data, size_t length,
+                                                          ControlReply& reply) {
+    if (!metricsProvider) return ControlStatus::UNSUPPORTED;
+    size_t written = metricsProvider(reply.tail(), reply.available());
+    if (written == 0) return ControlStatus::REPLY_TOO_LARGE;
+    reply.commit(written);
+    return ControlStatus::OK;
+}
+
+void ProvisioningOrchestrator::loop() {
+    // Events and writes in the order the worker posted them
+    for (;;) {
+        ClientEvent* event = clientEvents.front();
+        ClientCommand* command = commands.front();
+        if (event && (!command || (int32_t)(event->seq - command->seq) < 0)) {
+            processEvent(*event);
+            clientEvents.pop();
+        } else if (command) {
+            processCommand(*command);
+            commands.pop();
+        } else {
+            break;
+        }
+    }
+    
+    if (rebootPending && (int32_t)(millis() - rebootAt) >= 0) {
+        rebootPending = false;
+        LogManager::warn("Restarting on REBOOT command");
+        ESP.restart();
+    }
+}
+
+ProvisioningOrchestrator::ClientProtocol* ProvisioningOrchestrator::findClient(uint16_t connId) {
+    for (ClientProtocol& client : clients) {
+        if (client.inUse && client.connId == connId) return &client;
+    }
+    return nullptr;
+}
+
+WireFormat ProvisioningOrchestrator::formatFor(uint16_t connId) {
+    ClientProtocol* client = findClient(connId);
+    return client ? client->format : WireFormat::JSON;
+}
+
+void ProvisioningOrchestrator::sendStatus(uint16_t connId, ProtocolStatus status, uint8_t detail,
+                                          const char* message, const char* messageArg,
+                                          const uint8_t* extra, size_t extraLength, uint8_t progress) {
+    if (!bleManager) return;
+    
+    if (connId == WIBLE_CONN_ID_ALL) {
+        for (const ClientProtocol& client : clients) {
+            if (client.inUse && bleManager->isConnected(client.connId)) {
+                sendStatus(client.connId, status, detail, message, messageArg, extra, extraLength, progress);
+            }
+        }
+        return;
+    }
+    
+    uint8_t frame[WIBLE_STATUS_FRAME_MAX];
+    size_t length = ProvisioningProtocol::encodeStatus(frame, formatFor(connId), status, progress, detail,
+                                                       message, messageArg, extra, extraLength);
+    bleManager->notify(connId, WIBLE_STATUS_CHARACTERISTIC, std::vector<uint8_t>(frame, frame + length));
+}
+
+void ProvisioningOrchestrator::setValidation(bool enabled, const ValidationConfig& config) {
+    validationEnabled = enabled;
+    validationConfig = config;
 }
 
 void ProvisioningOrchestrator::onWiFiConnected(const ConnectionInfo& info) {
+    // Reconnects after provisioning are not part of the provisioning flow
+    if (!stateManager->isInState(ProvisioningState::CONNECTING_WIFI)) return;
+    
     stateManager->handleEvent(StateEvent::WIFI_CONNECTED);
-    sendResponse("SUCCESS", "Connected to " + info.ssid);
+    
+    IPAddress ip;
+    ip.fromString(info.ipAddress);
+    connectedAddress = (uint32_t)ip;
+    connectedSsid = info.ssid;
+    
+    // Success waits for the verdict; WiFiManager::monitor() delivers it
+    if (validationEnabled && wifiManager && wifiManager->startValidation(validationConfig)) {
+        sendStatus(credentialsConnId, ProtocolStatus::VALIDATING, 0, "Checking connectivity", "", nullptr, 0, 100);
+        return;
+    }
+    
+    stateManager->handleEvent(StateEvent::VALIDATION_SUCCESS);
+    reportConnected(nullptr);
+}
+
+// [gateway][dns][probe] latencies, 2 bytes each, little-endian
+static size_t encodeLatencies(uint8_t* out, const ValidationResult& result) {
+    const StageResult* stages[] = { &result.gateway, &result.dns, &result.probe };
+    for (size_t i = 0; i < 3; i++) {
+        out[2 * i] = (uint8_t)stages[i]->latencyMs;
+        out[2 * i + 1] = (uint8_t)(stages[i]->latencyMs >> 8);
+    }
+    return 6;
+}
+
+void ProvisioningOrchestrator::onValidationComplete(const ValidationResult& result) {
+    // Checks started by the application are not part of the provisioning flow
+    if (!stateManager->isInState(ProvisioningState::VALIDATING_CONNECTION)) return;
+    
+    if (result.success) {
+        stateManager->handleEvent(StateEvent::VALIDATION_SUCCESS);
+        reportConnected(&result);
+        return;
+    }
+    
+    stateManager->handleEvent(StateEvent::VALIDATION_FAILED);
+    uint8_t extra[7];
+    extra[0] = (uint8_t)result.outcome;
+    encodeLatencies(extra + 1, result);
+    sendStatus(credentialsConnId, ProtocolStatus::ERROR, (uint8_t)ProtocolError::VALIDATION_FAILED,
+               "Connectivity check failed: ", ConnectivityValidator::outcomeToString(result.outcome),
+               extra, sizeof(extra));
+    credentialsConnId = WIBLE_CONN_ID_ALL;
+}
+
+void ProvisioningOrchestrator::reportConnected(const ValidationResult* validation) {
+    uint8_t extra[10];
+    memcpy(extra, &connectedAddress, 4);
+    size_t extraLength = 4;
+    String messageArg = connectedSsid;
+    
+    if (validation) {
+        extraLength += encodeLatencies(extra + 4, *validation);
+        
+        // JSON clients read the latencies from the message
+        const char* names[] = { "gw", "dns", "http" };
+        const StageResult* stages[] = { &validation->gateway, &validation->dns, &validation->probe };
+        String latencies;
+        for (size_t i = 0; i < 3; i++) {
+            if (stages[i]->status != StageStatus::PASSED) continue;
+            latencies += String(latencies.length() ? ", " : " (") + names[i] + " " +
+                         String((int)stages[i]->latencyMs);
+        }
+        if (latencies.length()) messageArg += latencies + " ms)";
+    }
+    sendStatus(credentialsConnId, ProtocolStatus::SUCCESS, 0, "Connected to ", messageArg.c_str(),
+               extra, extraLength, 100);
+    credentialsConnId = WIBLE_CONN_ID_ALL;
 }
 
 void ProvisioningOrchestrator::onWiFiDisconnected(WiFiDisconnectReason reason) {
+    // The validation in flight reports the lost link as CANCELLED
+    if (stateManager->isInState(ProvisioningState::VALIDATING_CONNECTION)) return;
+    
+    if (stateManager->isInState(ProvisioningState::CONNECTING_WIFI)) {
+        // All retries exhausted
+        stateManager->handleEvent(StateEvent::WIFI_CONNECTION_FAILED);
+        uint8_t reasonCode = (uint8_t)reason;
+        sendStatus(credentialsConnId, ProtocolStatus::ERROR, (uint8_t)ProtocolError::WIFI_CONNECTION_FAILED,
+                   WiFiUtils::disconnectReasonToString(reason), "", &reasonCode, 1);
+        credentialsConnId = WIBLE_CONN_ID_ALL;
+        return;
+    }
+    
     stateManager->handleEvent(StateEvent::WIFI_DISCONNECTED);
-    sendResponse("ERROR", "WiFi Disconnected");
+    sendStatus(WIBLE_CONN_ID_ALL, ProtocolStatus::ERROR, (uint8_t)ProtocolError::WIFI_DISCONNECTED,
+               "WiFi Disconnected");
+}
+
+void ProvisioningOrchestrator::onWiFiProgress(uint8_t progress) {
+    // JSON clients never had progress replies; only TLV clients get them
+    if (!stateManager->isInState(ProvisioningState::CONNECTING_WIFI)) return;
+    if (formatFor(credentialsConnId) != WireFormat::TLV) return;
+    sendStatus(credentialsConnId, ProtocolStatus::CONNECTING, 0, "", "", nullptr, 0, progress);
 }
 
 } // namespace WiBLE
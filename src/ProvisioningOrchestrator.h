@@ -7,12 +7,71 @@
 
 #include <Arduino.h>
 #include <memory>
+#include <functional>
 #include "WiBLE_Defs.h"
 #include "WiFiManager.h" // For WiFiCredentials
+#include "BLEManager.h"  // For WIBLE_MAX_CONNECTIONS
+#include "ProvisioningProtocol.h"
+#include "OTAManager.h"
+#include "ControlProtocol.h"
+#include "EventBus.h"
+#include "utils/SPSCQueue.h"
+
+// Handshake opcodes, written to the control characteristic. Replies are
+// notified on the status characteristic with the same opcode in front.
+//   KEY_EXCHANGE  [op][phone public key (32)]
+//              -> [op][device public key (32)]([ticket id (8)] when resumption is on)
+//   RESUME        [op][ticket id (8)][phone nonce (16)]
+//              -> [op][0][device nonce (16)][next ticket id (8)], or [op][1] to fall back
+//   SET_FORMAT    [op][WireFormat] -> [op][WireFormat in use]
+//                 Status replies switch format; a TLV credential frame also does
+//   SCAN_WIFI     [op]([flags]) -> SCAN_RESULTS status pages, flag 0x01 forces a rescan.
+//                 A fresh cache is sent at once; otherwise every channel sweep
+//                 sends the networks it found, and the last page is flagged done
+//   OTA_BEGIN     [op][image size u32 LE][SHA-256 (32)] -> OTA report, READY with the offset
+//                 to send from; the image (from that offset) then streams as one chunked
+//                 transfer on the data characteristic. The same image after a reconnect resumes.
+//   OTA_ABORT     [op] -> OTA report ABORTED
+//   OTA reports   [OTA_BEGIN][OTAStatus][offset u32 LE][throughput u16 LE, 0.1 KB/s]
+//                 while receiving, and once more when the session ends
+//   GROUP_KEY_EXCHANGE [op][lead public key (32)] -> [op][device public key (32)]
+//                 From a provisioned WiBLE device (see GroupProvisioner.h). The session
+//                 key is bound to the fleet secret and replies switch to TLV; without a
+//                 fleet secret or encryption the answer is ERROR KEY_EXCHANGE_FAILED
+// Handshake and OTA opcodes stand alone; the other commands can also be
+// batched into one write (see ControlProtocol.h).
+#define WIBLE_OP_KEY_EXCHANGE        0x01
+#define WIBLE_OP_RESUME              0x02
+#define WIBLE_OP_SET_FORMAT          0x03
+#define WIBLE_OP_SCAN_WIFI           0x04
+#define WIBLE_OP_OTA_BEGIN           0x05
+#define WIBLE_OP_OTA_ABORT           0x06
+#define WIBLE_OP_GROUP_KEY_EXCHANGE  0x0C
+
+#define WIBLE_OTA_REPORT_SIZE        8
+
+#define WIBLE_SCAN_REQUEST_FORCE     0x01
+
+// BLE callbacks run on the write worker, which owns the security sessions.
+// Whatever drives the state machine, WiFi or OTA is handed to loop(): link
+// and auth events through a small ring, decrypted writes through a ring of
+// attribute-sized slots. Both are stamped so loop() applies them in order.
+#ifndef WIBLE_CLIENT_EVENT_DEPTH
+#define WIBLE_CLIENT_EVENT_DEPTH     16   // Events (power of two)
+#endif
+#ifndef WIBLE_CLIENT_COMMAND_DEPTH
+#define WIBLE_CLIENT_COMMAND_DEPTH   4    // Writes (power of two)
+#endif
 
 namespace WiBLE {
 
-class BLEManager;
+using CustomFieldCallback = std::function<void(const String& key, const String& value)>;
+
+/**
+ * Writes the GET_METRICS reply; returns its length, 0 if it does not fit
+ */
+using ControlMetricsProvider = std::function<size_t(uint8_t* out, size_t capacity)>;
+
 class SecurityManager;
 class StateManager;
 class WiFiManager;
@@ -28,26 +87,190 @@ public:
     
     void initialize();
     
-    // Handle incoming data from BLE
-    void processBLEData(const String& characteristicUUID, const std::vector<uint8_t>& data);
+    // Handle incoming data from a BLE client (on the BLE write worker)
+    void processBLEData(uint16_t connId, const String& characteristicUUID, uint8_t* data, size_t length);
     
     // Handle WiFi events
     void onWiFiConnected(const ConnectionInfo& info);
     void onWiFiDisconnected(WiFiDisconnectReason reason);
+    void onWiFiProgress(uint8_t progress);
+    void onWiFiScanProgress(const WiFiScanEntry* updated, size_t count, uint8_t progress, bool complete);
+    void onValidationComplete(const ValidationResult& result);
+    
+    /**
+     * Check connectivity in VALIDATING_CONNECTION before reporting success;
+     * when disabled, a WiFi connection is reported right away
+     */
+    void setValidation(bool enabled, const ValidationConfig& config);
+    
+    /**
+     * Custom key/values sent with the credentials (TLV clients)
+     */
+    void onCustomField(CustomFieldCallback callback) { customFieldCallback = callback; }
+    
+    /**
+     * Serve OTA_BEGIN/OTA_ABORT and stream images into ota (null disables)
+     */
+    void setOTAManager(OTAManager* ota);
+    
+    /**
+     * Serve an application opcode (WIBLE_OP_APP_FIRST..WIBLE_OP_APP_LAST),
+     * alone or in a batch; a null handler removes it
+     * @return false if the opcode is outside the range or every slot is taken
+     */
+    bool registerControlCommand(uint8_t opcode, ControlCommandHandler handler);
+    
+    void setMetricsProvider(ControlMetricsProvider provider) { metricsProvider = provider; }
+    
+    /**
+     * Accept GROUP_KEY_EXCHANGE from leads holding this fleet secret
+     * (empty refuses them)
+     */
+    void setGroupSecret(const String& secret) { groupSecret = secret; }
+    
+    /**
+     * True when the last credentials came from a group lead, not a phone
+     */
+    bool credentialsFromLead() const { return credentialsFromGroup; }
+    
+    /**
+     * Publish BLE client, authentication and credential events on bus
+     */
+    void setEventBus(EventBus* bus) { eventBus = bus; }
+    
+    /**
+     * Apply the commands handed over by the BLE write worker and carry out
+     * a scheduled REBOOT; call from loop()
+     */
+    void loop();
 
 private:
+    // Control opcode -> handler. A command written alone goes to exchange
+    // when there is one (it replies in its own format); batches go to command.
+    struct ControlTableEntry {
+        uint8_t opcode;
+        void (ProvisioningOrchestrator::*exchange)(uint16_t connId, const uint8_t* data, size_t length);
+        ControlStatus (ProvisioningOrchestrator::*command)(uint16_t connId, const uint8_t* data, size_t length,
+                                                           ControlReply& reply);
+    };
+    static const ControlTableEntry controlTable[];
+    
+    struct AppCommand {
+        uint8_t opcode;
+        ControlCommandHandler handler;
+    };
+    
     StateManager* stateManager;
     BLEManager* bleManager;
     WiFiManager* wifiManager;
     SecurityManager* securityManager;
+    OTAManager* otaManager;
+    EventBus* eventBus;
+    
+    // Client whose credentials drive the WiFi attempt; WiFi results go to it.
+    // WIBLE_CONN_ID_ALL once the attempt has an outcome.
+    uint16_t credentialsConnId;
+    
+    // Reply format per connection table slot
+    struct ClientProtocol {
+        uint16_t connId;
+        WireFormat format;
+        bool inUse;
+        bool scanRequested;     // Waiting for scan pages
+        bool groupLead;         // Authenticated with GROUP_KEY_EXCHANGE
+    };
+    ClientProtocol clients[WIBLE_MAX_CONNECTIONS];
+    
+    CustomFieldCallback customFieldCallback;
+    
+    // Connectivity validation; the connection it checks is reported after it
+    bool validationEnabled;
+    ValidationConfig validationConfig;
+    String connectedSsid;
+    uint32_t connectedAddress;
+    
+    AppCommand appCommands[WIBLE_CONTROL_APP_COMMANDS];
+    ControlMetricsProvider metricsProvider;
+    String groupSecret;
+    bool credentialsFromGroup;
+    
+    // REBOOT waits for its reply to go out
+    bool rebootPending;
+    uint32_t rebootAt;
+    
+    // Write worker -> loop()
+    enum class ClientEventType : uint8_t {
+        CONNECTED,
+        DISCONNECTED,
+        AUTH_SUCCESS,
+        AUTH_FAILED
+    };
+    struct ClientEvent {
+        uint32_t seq;
+        uint16_t connId;
+        ClientEventType type;
+        uint8_t reason;         // DISCONNECTED
+    };
+    struct ClientCommand {
+        uint32_t seq;
+        uint16_t connId;
+        uint16_t length;
+        bool credentials;       // Decrypted credential frame, else a control write
+        uint8_t data[WIBLE_WRITE_SLOT_SIZE];
+    };
+    SPSCQueue<ClientEvent, WIBLE_CLIENT_EVENT_DEPTH> clientEvents;
+    SPSCQueue<ClientCommand, WIBLE_CLIENT_COMMAND_DEPTH> commands;
+    uint32_t commandSeq;        // Producer side
+    
+    void handleClientConnected(const BLEConnectionInfo& info);
+    void handleClientDisconnected(const BLEConnectionInfo& info, uint8_t reason);
+    void handleCredentials(uint16_t connId, uint8_t* data, size_t length);
+    void handleControlCommand(uint16_t connId, uint8_t* data, size_t length);
+    void postEvent(ClientEventType type, uint16_t connId, uint8_t reason = 0);
+    bool postCommand(bool credentials, uint16_t connId, const uint8_t* data, size_t length);
+    void processEvent(const ClientEvent& event);
+    void processCommand(ClientCommand& command);
+    void applyCredentials(uint16_t connId, uint8_t* plaintext, size_t length);
+    bool attemptInFlight() const;
+    void runControlCommand(uint16_t connId, uint8_t* data, size_t length);
+    void applyAuthFailure(uint16_t connId);
+    void handleKeyExchange(uint16_t connId, const uint8_t* data, size_t length);
+    void handleResume(uint16_t connId, const uint8_t* data, size_t length);
+    void handleGroupKeyExchange(uint16_t connId, const uint8_t* data, size_t length);
+    void handleSetFormat(uint16_t connId, const uint8_t* data, size_t length);
+    void handleScanRequest(uint16_t connId, const uint8_t* data, size_t length);
+    void handleOTABegin(uint16_t connId, const uint8_t* data, size_t length);
+    void handleOTAAbort(uint16_t connId, const uint8_t* data, size_t length);
+    void sendOTAReport(uint16_t connId, const OTAProgress& progress);
     
-    void handleCredentials(const std::vector<uint8_t>& data);
-    void handleControlCommand(const std::vector<uint8_t>& data);
+    const ControlTableEntry* findControlEntry(uint8_t opcode) const;
+    void handleBatch(uint16_t connId, const uint8_t* data, size_t length, bool framed);
+    ControlStatus runCommand(uint16_t connId, uint8_t opcode, const uint8_t* payload, size_t length,
+                             ControlReply& reply);
+    ControlStatus commandScan(uint16_t connId, const uint8_t* data, size_t length, ControlReply& reply);
+    ControlStatus commandGetStatus(uint16_t connId, const uint8_t* data, size_t length, ControlReply& reply);
+    ControlStatus commandSetParam(uint16_t connId, const uint8_t* data, size_t length, ControlReply& reply);
+    ControlStatus commandReboot(uint16_t connId, const uint8_t* data, size_t length, ControlReply& reply);
+    ControlStatus commandGetMetrics(uint16_t connId, const uint8_t* data, size_t length, ControlReply& reply);
+    void sendScanPages(uint16_t connId, const WiFiScanEntry* entries, size_t count, uint8_t progress,
+                       bool done);
+    void handleAuthFailure(uint16_t connId);
+    void publishClientEvent(EventType type, uint16_t connId, uint8_t code = 0, uint8_t value = 0,
+                            const char* text = nullptr);
+    void reportConnected(const ValidationResult* validation);
+    bool requiresHandshake() const;
     
-    // Helper to parse JSON credentials (simple parser)
-    WiFiCredentials parseCredentials(const String& json);
+    void applyCredentialExtras(const CredentialFrame& frame, const WiFiCredentials& creds);
+    ClientProtocol* findClient(uint16_t connId);
+    WireFormat formatFor(uint16_t connId);
     
-    void sendResponse(const String& status, const String& message);
+    /**
+     * Status reply in the client's format; WIBLE_CONN_ID_ALL reaches every
+     * served client. JSON clients get message + messageArg as "msg".
+     */
+    void sendStatus(uint16_t connId, ProtocolStatus status, uint8_t detail, const char* message,
+                    const char* messageArg = "", const uint8_t* extra = nullptr, size_t extraLength = 0,
+                    uint8_t progress = 0);
 };
 
 } // namespace WiBLE
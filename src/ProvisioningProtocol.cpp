@@ -0,0 +1,330 @@
+/**
+ * ProvisioningProtocol.cpp - Credential and status frame implementation
+ */
+
+#include "ProvisioningProtocol.h"
+#include "WiFiManager.h"
+#include <string.h>
+
+namespace WiBLE {
+
+// ============================================================================
+// CREDENTIAL FRAMES
+// ============================================================================
+
+bool ProvisioningProtocol::parseCredentials(uint8_t* data, size_t length, CredentialFrame& frame) {
+    if (isTLVFrame(data, length)) return parseCredentialsTLV(data, length, frame);
+    return parseCredentialsJSON((char*)data, length, frame);
+}
+
+bool ProvisioningProtocol::parseCredentialsTLV(const uint8_t* data, size_t length, CredentialFrame& frame) {
+    frame = CredentialFrame();
+    frame.format = WireFormat::TLV;
+    if (length == 0 || data[0] != WIBLE_TLV_FRAME_V1) return false;
+
+    TLVReader reader(data + 1, length - 1);
+    TLVField field;
+    while (reader.next(field)) {
+        switch (field.type) {
+            case WIBLE_TLV_SSID:
+                if (field.length == 0 || field.length > 32) return false;
+                frame.ssid = (const char*)field.value;
+                frame.ssidLength = field.length;
+                break;
+            case WIBLE_TLV_PASSPHRASE:
+                if (field.length > 64) return false;
+                frame.passphrase = (const char*)field.value;
+                frame.passphraseLength = field.length;
+                break;
+            case WIBLE_TLV_BSSID:
+                if (field.length != 6) return false;
+                frame.bssid = field.value;
+                break;
+            case WIBLE_TLV_CHANNEL:
+                if (field.length != 1) return false;
+                frame.channel = field.value[0];
+                break;
+            case WIBLE_TLV_STATIC_IP:
+                if (field.length != 16) return false;
+                memcpy(&frame.ip, field.value, 4);
+                memcpy(&frame.gateway, field.value + 4, 4);
+                memcpy(&frame.subnet, field.value + 8, 4);
+                memcpy(&frame.dns, field.value + 12, 4);
+                frame.hasStaticIP = frame.ip != 0 && frame.subnet != 0;
+                break;
+            case WIBLE_TLV_FLAGS:
+                if (field.length != 1) return false;
+                frame.hidden = (field.value[0] & WIBLE_TLV_FLAG_HIDDEN) != 0;
+                break;
+            case WIBLE_TLV_CUSTOM: {
+                if (field.length == 0 || field.value[0] == 0 || field.value[0] > field.length - 1) return false;
+                if (frame.customCount >= WIBLE_PROTOCOL_MAX_CUSTOM_FIELDS) break;
+                CustomField& custom = frame.custom[frame.customCount++];
+                custom.keyLength = field.value[0];
+                custom.key = (const char*)field.value + 1;
+                custom.value = field.value + 1 + custom.keyLength;
+                custom.valueLength = field.length - 1 - custom.keyLength;
+                break;
+            }
+            default:
+                break;  // Newer field
+        }
+    }
+    return reader.atEnd() && frame.ssid != nullptr;
+}
+
+bool ProvisioningProtocol::parseCredentialsJSON(char* json, size_t length, CredentialFrame& frame) {
+    frame = CredentialFrame();
+    frame.format = WireFormat::JSON;
+
+    // Locate both values before unescaping either: an unescaped quote
+    // would end the string early on a second scan
+    char* ssid;
+    size_t ssidLength;
+    if (!findJSONString(json, length, "ssid", ssid, ssidLength)) return false;
+    char* pass = nullptr;
+    size_t passLength = 0;
+    bool hasPass = findJSONString(json, length, "pass", pass, passLength);
+
+    if (!unescapeJSON(ssid, ssidLength) || ssidLength == 0 || ssidLength > 32) return false;
+    if (hasPass && (!unescapeJSON(pass, passLength) || passLength > 64)) return false;
+
+    frame.ssid = ssid;
+    frame.ssidLength = ssidLength;
+    frame.passphrase = pass;
+    frame.passphraseLength = passLength;
+    return true;
+}
+
+// ============================================================================
+// JSON FALLBACK
+// ============================================================================
+
+static size_t skipSpace(const char* json, size_t length, size_t i) {
+    while (i < length && (json[i] == ' ' || json[i] == '\t' || json[i] == '\r' || json[i] == '\n')) i++;
+    return i;
+}
+
+// Index of the closing quote of the string opened at json[start], or length
+static size_t stringEnd(const char* json, size_t length, size_t start) {
+    for (size_t i = start + 1; i < length; i++) {
+        if (json[i] == '\\') {
+            i++;
+        } else if (json[i] == '"') {
+            return i;
+        }
+    }
+    return length;
+}
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool ProvisioningProtocol::unescapeJSON(char* json, size_t& length) {
+    size_t out = 0;
+    const size_t end = length;
+    for (size_t i = 0; i < end; i++) {
+        char c = json[i];
+        if (c != '\\') {
+            json[out++] = c;
+            continue;
+        }
+        if (++i >= end) return false;
+        switch (json[i]) {
+            case '"': case '\\': case '/': json[out++] = json[i]; break;
+            case 'b': json[out++] = '\b'; break;
+            case 'f': json[out++] = '\f'; break;
+            case 'n': json[out++] = '\n'; break;
+            case 'r': json[out++] = '\r'; break;
+            case 't': json[out++] = '\t'; break;
+            case 'u': {
+                if (i + 4 >= end) return false;
+                uint16_t code = 0;
+                for (int k = 1; k <= 4; k++) {
+                    int digit = hexDigit(json[i + k]);
+                    if (digit < 0) return false;
+                    code = (code << 4) | digit;
+                }
+                i += 4;
+                // UTF-8 from six escape characters fits in place; surrogate
+                // pairs are out of scope for SSIDs and passphrases
+                if (code >= 0xD800 && code <= 0xDFFF) return false;
+                if (code < 0x80) {
+                    json[out++] = (char)code;
+                } else if (code < 0x800) {
+                    json[out++] = (char)(0xC0 | (code >> 6));
+                    json[out++] = (char)(0x80 | (code & 0x3F));
+                } else {
+                    json[out++] = (char)(0xE0 | (code >> 12));
+                    json[out++] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    json[out++] = (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    length = out;
+    return true;
+}
+
+bool ProvisioningProtocol::findJSONString(char* json, size_t length, const char* key,
+                                          char*& value, size_t& valueLength) {
+    size_t keyLength = strlen(key);
+
+    // Strings are skipped whole, so a value that looks like a key never matches
+    for (size_t i = 0; i < length; i++) {
+        if (json[i] != '"') continue;
+        size_t close = stringEnd(json, length, i);
+        if (close >= length) return false;
+
+        size_t next = skipSpace(json, length, close + 1);
+        bool isKey = next < length && json[next] == ':';
+        bool matches = isKey && close - i - 1 == keyLength && memcmp(json + i + 1, key, keyLength) == 0;
+        if (!matches) {
+            i = close;
+            continue;
+        }
+
+        size_t open = skipSpace(json, length, next + 1);
+        if (open >= length || json[open] != '"') return false;
+        close = stringEnd(json, length, open);
+        if (close >= length) return false;
+        value = json + open + 1;
+        valueLength = close - open - 1;
+        return true;
+    }
+    return false;
+}
+
+// ============================================================================
+// STATUS FRAMES
+// ============================================================================
+
+const char* ProvisioningProtocol::statusToString(ProtocolStatus status) {
+    switch (status) {
+        case ProtocolStatus::CONNECTING: return "CONNECTING";
+        case ProtocolStatus::SUCCESS: return "SUCCESS";
+        case ProtocolStatus::ERROR: return "ERROR";
+        case ProtocolStatus::BUSY: return "BUSY";
+        case ProtocolStatus::QUEUED: return "QUEUED";
+        case ProtocolStatus::SCAN_RESULTS: return "SCAN";
+        case ProtocolStatus::VALIDATING: return "VALIDATING";
+        default: return "UNKNOWN";
+    }
+}
+
+static size_t appendEscaped(char* out, size_t used, size_t limit, const char* text) {
+    for (; *text; text++) {
+        char c = *text;
+        const char* escape = nullptr;
+        if (c == '"') escape = "\\\"";
+        else if (c == '\\') escape = "\\\\";
+        else if ((uint8_t)c < 0x20) escape = " ";  // Control characters read as a space
+        size_t needed = escape ? strlen(escape) : 1;
+        if (used + needed > limit) break;
+        if (escape) {
+            memcpy(out + used, escape, needed);
+        } else {
+            out[used] = c;
+        }
+        used += needed;
+    }
+    return used;
+}
+
+size_t ProvisioningProtocol::encodeStatus(uint8_t* out, WireFormat format, ProtocolStatus status, uint8_t progress,
+                                          uint8_t detail, const char* message, const char* messageArg,
+                                          const uint8_t* extra, size_t extraLength) {
+    if (format == WireFormat::TLV) {
+        if (extraLength > WIBLE_STATUS_FRAME_MAX - 4) extraLength = WIBLE_STATUS_FRAME_MAX - 4;
+        out[0] = WIBLE_TLV_FRAME_V1;
+        out[1] = (uint8_t)status;
+        out[2] = progress;
+        out[3] = detail;
+        if (extraLength) memcpy(out + 4, extra, extraLength);
+        return 4 + extraLength;
+    }
+
+    // {"status":"...","msg":"..."}, truncating the message to fit
+    char* text = (char*)out;
+    int used = snprintf(text, WIBLE_STATUS_FRAME_MAX, "{\"status\":\"%s\",\"msg\":\"", statusToString(status));
+    const size_t limit = WIBLE_STATUS_FRAME_MAX - 2;
+    size_t length = appendEscaped(text, used, limit, message ? message : "");
+    length = appendEscaped(text, length, limit, messageArg ? messageArg : "");
+    text[length++] = '"';
+    text[length++] = '}';
+    return length;
+}
+
+size_t ProvisioningProtocol::encodeScanPage(uint8_t* out, size_t capacity, WireFormat format,
+                                            const WiFiScanEntry* entries, size_t count, uint8_t progress,
+                                            bool done, size_t& consumed) {
+    if (capacity > WIBLE_SCAN_PAGE_MAX) capacity = WIBLE_SCAN_PAGE_MAX;
+    consumed = 0;
+
+    if (format == WireFormat::TLV) {
+        out[0] = WIBLE_TLV_FRAME_V1;
+        out[1] = (uint8_t)ProtocolStatus::SCAN_RESULTS;
+        out[2] = progress;
+        size_t length = 4;
+        for (; consumed < count; consumed++) {
+            const WiFiScanEntry& entry = entries[consumed];
+            size_t ssidLength = strnlen(entry.ssid, sizeof(entry.ssid) - 1);
+            size_t needed = 4 + ssidLength;
+            if (length + needed > capacity) {
+                if (length == 4) continue;
+                break;
+            }
+            out[length++] = (uint8_t)entry.rssi;
+            out[length++] = entry.channel;
+            out[length++] = (uint8_t)entry.security;
+            out[length++] = (uint8_t)ssidLength;
+            memcpy(out + length, entry.ssid, ssidLength);
+            length += ssidLength;
+        }
+        out[3] = (done && consumed == count) ? WIBLE_SCAN_FLAG_DONE : 0;
+        return length;
+    }
+
+    // {"status":"SCAN","progress":N,"nets":[["ssid",rssi,ch,sec],...],"done":false}
+    char* text = (char*)out;
+    static const char TRAILER_MORE[] = "],\"done\":false}";
+    static const char TRAILER_DONE[] = "],\"done\":true}";
+    const size_t trailer = sizeof(TRAILER_MORE) - 1;
+    size_t length = snprintf(text, capacity, "{\"status\":\"%s\",\"progress\":%u,\"nets\":[",
+                             statusToString(ProtocolStatus::SCAN_RESULTS), (unsigned)progress);
+    const size_t header = length;
+    if (header + trailer > capacity) return 0;
+
+    char item[2 * sizeof(entries[0].ssid) + 24];
+    for (; consumed < count; consumed++) {
+        const WiFiScanEntry& entry = entries[consumed];
+        size_t used = 0;
+        if (length > header) item[used++] = ',';
+        item[used++] = '[';
+        item[used++] = '"';
+        used = appendEscaped(item, used, sizeof(item) - 20, entry.ssid);
+        used += snprintf(item + used, sizeof(item) - used, "\",%d,%u,%u]", (int)entry.rssi,
+                         (unsigned)entry.channel, (unsigned)entry.security);
+        if (length + used + trailer > capacity) {
+            if (length == header) continue;
+            break;
+        }
+        memcpy(text + length, item, used);
+        length += used;
+    }
+
+    // Written without a terminator; the page is sent by length
+    const char* end = (done && consumed == count) ? TRAILER_DONE : TRAILER_MORE;
+    size_t endLength = strlen(end);
+    memcpy(text + length, end, endLength);
+    return length + endLength;
+}
+
+} // namespace WiBLE
@@ -0,0 +1,221 @@
+/**
+ * ProvisioningProtocol.h - Wire format of credential and status frames
+ *
+ * Credentials and status replies travel as compact TLV frames:
+ *
+ *   [0x80 | version] { [type (1)][length (1)][value (length)] }*
+ *
+ * Frames are parsed in place over the (decrypted) BLE write; fields point
+ * into the received buffer and nothing is allocated. Unknown types are
+ * skipped, so newer phones can add fields. A full credential frame is
+ * at most 133 bytes plus custom fields, inside one 185-byte MTU with the
+ * AES-GCM header and tag.
+ *
+ * The JSON format of earlier releases ({"ssid":"...","pass":"..."}) is
+ * still accepted and is what a client gets until it negotiates TLV.
+ */
+
+#ifndef WIBLE_PROVISIONING_PROTOCOL_H
+#define WIBLE_PROVISIONING_PROTOCOL_H
+
+#include <Arduino.h>
+
+namespace WiBLE {
+
+struct WiFiScanEntry;
+
+// ============================================================================
+// FRAME LAYOUT
+// ============================================================================
+
+#define WIBLE_PROTOCOL_VERSION       1
+#define WIBLE_TLV_FRAME_MARKER       0x80    // High bit of the first byte; never '{' or an opcode
+#define WIBLE_TLV_FRAME_V1           (WIBLE_TLV_FRAME_MARKER | WIBLE_PROTOCOL_VERSION)
+
+// Credential frame fields
+#define WIBLE_TLV_SSID               0x01    // 1..32 bytes
+#define WIBLE_TLV_PASSPHRASE         0x02    // 0..64 bytes
+#define WIBLE_TLV_BSSID              0x03    // 6 bytes; with CHANNEL, the first attempt is directed
+#define WIBLE_TLV_CHANNEL            0x04    // 1 byte
+#define WIBLE_TLV_STATIC_IP          0x05    // 16 bytes: IP, gateway, subnet, DNS (a.b.c.d order)
+#define WIBLE_TLV_FLAGS              0x06    // 1 byte: WIBLE_TLV_FLAG_*
+#define WIBLE_TLV_CUSTOM             0x10    // [key length (1)][key][value]
+
+#define WIBLE_TLV_FLAG_HIDDEN        0x01
+
+// Custom key/values kept per credential frame
+#ifndef WIBLE_PROTOCOL_MAX_CUSTOM_FIELDS
+#define WIBLE_PROTOCOL_MAX_CUSTOM_FIELDS 4
+#endif
+
+// Largest status frame either format produces
+#define WIBLE_STATUS_FRAME_MAX       96
+
+// Largest scan results page: one DLE link-layer packet of ATT payload
+#define WIBLE_SCAN_PAGE_MAX          244
+#define WIBLE_SCAN_FLAG_DONE         0x01    // Last page of the scan
+
+enum class WireFormat : uint8_t {
+    JSON = 0,
+    TLV = 1
+};
+
+/**
+ * Status frame: [marker][status][progress %][detail][extra...]
+ *   CONNECTING  detail 0
+ *   SUCCESS     extra: IPv4 address (4), then after a validation the stage
+ *               latencies: gateway, DNS, probe (ms, 2 each, little-endian,
+ *               0xFFFF = not measured)
+ *   ERROR       detail: ProtocolError; WIFI_CONNECTION_FAILED adds the
+ *               WiFiDisconnectReason as one extra byte, VALIDATION_FAILED
+ *               the ValidationOutcome (1) and the three stage latencies
+ *   BUSY        detail 0
+ *   QUEUED      detail: position in the queue
+ *   SCAN_RESULTS detail: WIBLE_SCAN_FLAG_*; extra: networks, each
+ *               [rssi (1)][channel (1)][WiFiSecurityType (1)][ssid length (1)][ssid]
+ *               JSON: {"status":"SCAN","progress":N,"nets":[["ssid",rssi,ch,sec],...],"done":false}
+ *   VALIDATING  detail 0; WiFi is up, connectivity is being checked
+ */
+enum class ProtocolStatus : uint8_t {
+    CONNECTING = 0x01,
+    SUCCESS = 0x02,
+    ERROR = 0x03,
+    BUSY = 0x04,
+    QUEUED = 0x05,
+    SCAN_RESULTS = 0x06,
+    VALIDATING = 0x07
+};
+
+enum class ProtocolError : uint8_t {
+    NONE = 0x00,
+    KEY_EXCHANGE_REQUIRED = 0x01,
+    KEY_EXCHANGE_FAILED = 0x02,
+    DECRYPTION_FAILED = 0x03,
+    INVALID_FORMAT = 0x04,
+    WIFI_CONNECTION_FAILED = 0x05,
+    WIFI_DISCONNECTED = 0x06,
+    VALIDATION_FAILED = 0x07
+};
+
+// ============================================================================
+// PARSED FRAMES
+// ============================================================================
+
+struct TLVField {
+    uint8_t type;
+    uint8_t length;
+    const uint8_t* value;
+};
+
+/**
+ * Walks the fields of a TLV frame body; stops at a truncated field
+ */
+class TLVReader {
+public:
+    TLVReader(const uint8_t* data, size_t length) : cursor(data), end(data + length) {}
+
+    bool next(TLVField& field) {
+        if (end - cursor < 2 || (size_t)(end - cursor - 2) < cursor[1]) return false;
+        field.type = cursor[0];
+        field.length = cursor[1];
+        field.value = cursor + 2;
+        cursor += 2 + field.length;
+        return true;
+    }
+
+    bool atEnd() const { return cursor == end; }
+
+private:
+    const uint8_t* cursor;
+    const uint8_t* end;
+};
+
+struct CustomField {
+    const char* key;
+    uint8_t keyLength;
+    const uint8_t* value;
+    uint8_t valueLength;
+};
+
+/**
+ * Credentials as views into the received frame; valid until it is wiped
+ */
+struct CredentialFrame {
+    const char* ssid = nullptr;
+    uint8_t ssidLength = 0;
+    const char* passphrase = nullptr;
+    uint8_t passphraseLength = 0;
+    const uint8_t* bssid = nullptr;
+    uint8_t channel = 0;
+    bool hidden = false;
+
+    bool hasStaticIP = false;
+    uint32_t ip = 0;                // As held by IPAddress
+    uint32_t gateway = 0;
+    uint32_t subnet = 0;
+    uint32_t dns = 0;
+
+    CustomField custom[WIBLE_PROTOCOL_MAX_CUSTOM_FIELDS];
+    uint8_t customCount = 0;
+
+    WireFormat format = WireFormat::JSON;
+};
+
+// ============================================================================
+// PROTOCOL
+// ============================================================================
+
+class ProvisioningProtocol {
+public:
+    static bool isTLVFrame(const uint8_t* data, size_t length) {
+        return length > 0 && (data[0] & WIBLE_TLV_FRAME_MARKER) != 0;
+    }
+
+    /**
+     * Parse a credential frame of either format. JSON strings are unescaped
+     * in place, which is why the buffer is not const.
+     * @return false on an unknown version, a malformed frame or a missing SSID
+     */
+    static bool parseCredentials(uint8_t* data, size_t length, CredentialFrame& frame);
+
+    static bool parseCredentialsTLV(const uint8_t* data, size_t length, CredentialFrame& frame);
+    static bool parseCredentialsJSON(char* json, size_t length, CredentialFrame& frame);
+
+    /**
+     * Encode a status frame into out (WIBLE_STATUS_FRAME_MAX bytes).
+     * JSON replies carry message + messageArg, escaped, as "msg".
+     * @return Frame length
+     */
+    static size_t encodeStatus(uint8_t* out, WireFormat format, ProtocolStatus status, uint8_t progress,
+                               uint8_t detail, const char* message, const char* messageArg = "",
+                               const uint8_t* extra = nullptr, size_t extraLength = 0);
+
+    /**
+     * Encode a page of scan results, as many networks as fit in capacity
+     * (at most WIBLE_SCAN_PAGE_MAX). A network too long for an empty page
+     * is skipped.
+     * @param consumed Networks taken from entries, written or skipped
+     * @return Page length
+     */
+    static size_t encodeScanPage(uint8_t* out, size_t capacity, WireFormat format,
+                                 const WiFiScanEntry* entries, size_t count, uint8_t progress,
+                                 bool done, size_t& consumed);
+
+    static const char* statusToString(ProtocolStatus status);
+
+    /**
+     * Find "key":"value" in a JSON object; value is still escaped
+     * @return false if the key is missing or its value is not a string
+     */
+    static bool findJSONString(char* json, size_t length, const char* key,
+                               char*& value, size_t& valueLength);
+
+    /**
+     * Resolve JSON escapes onto the same buffer; the result is never longer
+     */
+    static bool unescapeJSON(char* text, size_t& length);
+};
+
+} // namespace WiBLE
+
+#endif // WIBLE_PROVISIONING_PROTOCOL_H
@@ -4,7 +4,7 @@
 
 #include "SecurityManager.h"
 #include "utils/LogManager.h"
-#include <Preferences.h> // For secure storage on ESP32
+#include "utils/Metrics.h"
 
 namespace WiBLE {
 
@@ -13,9 +13,20 @@ namespace WiBLE {
 // ============================================================================
 
 SecurityManager::SecurityManager() 
-    : initialized(false), 
+    : keyPoolTask(nullptr),
+      keyPoolStopRequested(false),
+      keyPoolRunning(false),
+      activeSession(0),
+      txNonceCounter(0),
+      rxNonceCounter(0),
+      rxNonceSeen(false),
+      initialized(false), 
       sessionEstablished(false), 
-      sessionStartTime(0) {
+      sessionStartTime(0),
+      storage(nullptr) {
+    memset(nonceSalt, 0, sizeof(nonceSalt));
+    memset(pendingPeerNonce, 0, sizeof(pendingPeerNonce));
+    for (PooledKeyPair& slot : keyPool) slot.ready.store(false);
 }
 
 SecurityManager::~SecurityManager() {
@@ -27,6 +38,7 @@ bool SecurityManager::initialize(const SecurityConfig& config) {
     
     if (!initializeMbedTLS()) {
         LogManager::error("Failed to initialize mbedTLS");
+        cleanupMbedTLS();
         return false;
     }
     
@@ -36,7 +48,11 @@ bool SecurityManager::initialize(const SecurityConfig& config) {
 }
 
 void SecurityManager::cleanup() {
-    cleanupMbedTLS();
+    stopKeyPool();
+    clearResumptionTickets();
+    for (uint8_t i = 0; i < WIBLE_SESSION_SLOTS; i++) releaseSession(i);
+    // mbedTLS contexts only exist after a successful initialize()
+    if (initialized) cleanupMbedTLS();
     keyPair.clear();
     sessionKey.clear();
     initialized = false;
@@ -45,10 +61,13 @@ void SecurityManager::cleanup() {
 
 void SecurityManager::reset() {
     sessionEstablished = false;
+    SecurityUtils::secureWipe(sessionKey.key);
     sessionKey.clear();
-    // Re-generate keys for new session if perfect forward secrecy is enabled
-    if (config.enablePerfectForwardSecrecy) {
-        generateKeyPair();
+    // Perfect forward secrecy: never reuse the keypair. The next handshake
+    // takes a precomputed one from the pool, so nothing is generated here.
+    if (config.enablePerfectForwardSecrecy && initialized) {
+        keyPair.clear();
+        mbedtls_mpi_lset(&ecdhContext.d, 0);
     }
 }
 
@@ -59,10 +78,15 @@ void SecurityManager::reset() {
 bool SecurityManager::generateKeyPair() {
     if (!initialized) return false;
     
+    if (takePooledKeyPair()) {
+        handshakeStats.pooledKeyPairs++;
+        return true;
+    }
+    
     int ret = mbedtls_ecdh_gen_public(&ecdhContext.grp, &ecdhContext.d, &ecdhContext.Q, 
                                      mbedtls_ctr_drbg_random, &ctrDrbgContext);
     if (ret != 0) {
-        LogManager::error("ECDH gen public failed: " + String(ret));
+        WIBLE_LOGE("ECDH gen public failed: %d", ret);
         return false;
     }
     
@@ -79,6 +103,7 @@ bool SecurityManager::generateKeyPair() {
     keyPair.publicKey.assign(buf, buf + mbedtls_mpi_size(&ecdhContext.grp.P));
     keyPair.generatedAt = millis();
     keyPair.isValid = true;
+    handshakeStats.inlineKeyPairs++;
     
     return true;
 }
@@ -104,7 +129,7 @@ bool SecurityManager::computeSharedSecret(const std::vector<uint8_t>& peerPublic
                                       mbedtls_ctr_drbg_random, &ctrDrbgContext);
                                       
     if (ret != 0) {
-        LogManager::error("ECDH compute shared failed: " + String(ret));
+        WIBLE_LOGE("ECDH compute shared failed: %d", ret);
         return false;
     }
     
@@ -121,7 +146,48 @@ bool SecurityManager::deriveSessionKey() {
     if (sharedSecret.empty()) return false;
     
     // Use SHA-256 to derive session key from shared secret
-    sessionKey.key = hash(sharedSecret);
+    std::vector<uint8_t> key = hash(sharedSecret);
+    SecurityUtils::secureWipe(sharedSecret);
+    
+    bool installed = installSessionKey(key.data());
+    SecurityUtils::secureWipe(key);
+    return installed;
+}
+
+bool SecurityManager::establishSession(const uint8_t* peerPublicKey, size_t length) {
+    if (!initialized || !peerPublicKey || length != WIBLE_ECDH_KEY_SIZE) return false;
+    uint32_t start = micros();
+    
+    if ((config.enablePerfectForwardSecrecy || !keyPair.isValid) && !generateKeyPair()) return false;
+    
+    std::vector<uint8_t> peer(peerPublicKey, peerPublicKey + length);
+    if (!computeSharedSecret(peer) || !deriveSessionKey()) return false;
+    
+    recordHandshake(micros() - start, false);
+    return true;
+}
+
+bool SecurityManager::bindSessionKey(const uint8_t* secret, size_t length) {
+    if (!sessionEstablished || !secret || length == 0 || sessionKey.key.size() != WIBLE_TICKET_SECRET_SIZE) {
+        return false;
+    }
+    
+    static const char LABEL[] = "WiBLE group";
+    uint8_t input[sizeof(LABEL) - 1 + WIBLE_TICKET_SECRET_SIZE];
+    memcpy(input, LABEL, sizeof(LABEL) - 1);
+    memcpy(input + sizeof(LABEL) - 1, sessionKey.key.data(), WIBLE_TICKET_SECRET_SIZE);
+    
+    uint8_t key[WIBLE_TICKET_SECRET_SIZE] = {0};
+    bool bound = mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), secret, length,
+                                 input, sizeof(input), key) == 0 &&
+                 installSessionKey(key);
+    SecurityUtils::secureWipe(input, sizeof(input));
+    SecurityUtils::secureWipe(key, sizeof(key));
+    return bound;
+}
+
+bool SecurityManager::installSessionKey(const uint8_t* key) {
+    sessionKey.key.assign(key, key + WIBLE_TICKET_SECRET_SIZE);
     sessionKey.iv = generateIV();
     sessionKey.createdAt = millis();
     sessionKey.expiresAt = millis() + config.sessionTimeoutMs;
@@ -130,69 +196,318 @@ bool SecurityManager::deriveSessionKey() {
     // Initialize AES contexts
     setAESKey(sessionKey.key);
     
+    // Fresh nonce space for the new key
+    generateRandomBytes(nonceSalt, sizeof(nonceSalt));
+    txNonceCounter = 0;
+    rxNonceCounter = 0;
+    rxNonceSeen = false;
+    
     sessionEstablished = true;
     sessionStartTime = millis();
     
-    // Wipe shared secret
-    SecurityUtils::secureWipe(sharedSecret);
+    return true;
+}
+
+void SecurityManager::recordHandshake(uint32_t elapsedUs, bool resumed) {
+    handshakeStats.lastHandshakeUs = elapsedUs;
+    handshakeStats.lastHandshakeResumed = resumed;
+    
+    uint32_t& count = resumed ? handshakeStats.resumedHandshakes : handshakeStats.fullHandshakes;
+    uint32_t& average = resumed ? handshakeStats.averageResumeUs : handshakeStats.averageFullUs;
+    count++;
+    average = (uint32_t)(((uint64_t)average * (count - 1) + elapsedUs) / count);
+    Metrics::observe(MetricHistogram::HANDSHAKE_US, elapsedUs);
     
+    WIBLE_LOGD("%s handshake: %u us", resumed ? "Resumed" : "Full", (unsigned)elapsedUs);
+}
+
+// ============================================================================
+// KEYPAIR POOL
+// ============================================================================
+
+bool SecurityManager::startKeyPool() {
+    if (!initialized || config.keyPoolSize == 0) return false;
+    if (keyPoolRunning.load()) return true;
+    
+    keyPoolStopRequested.store(false);
+    keyPoolRunning.store(true);
+    if (xTaskCreatePinnedToCore(keyPoolTaskEntry, "wible_keys", WIBLE_KEY_POOL_STACK_SIZE, this,
+                                config.keyPoolTaskPriority, &keyPoolTask, tskNO_AFFINITY) != pdPASS) {
+        keyPoolRunning.store(false);
+        keyPoolTask = nullptr;
+        LogManager::warn("Key pool task failed to start, keypairs are generated inline");
+        return false;
+    }
     return true;
 }
 
+void SecurityManager::stopKeyPool() {
+    if (keyPoolRunning.load()) {
+        keyPoolStopRequested.store(true);
+        xTaskNotifyGive(keyPoolTask);
+        // Let a generation in progress finish so its MPIs are not leaked
+        while (keyPoolRunning.load()) vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    keyPoolTask = nullptr;
+    
+    for (PooledKeyPair& slot : keyPool) {
+        if (!slot.ready.load(std::memory_order_acquire)) continue;
+        mbedtls_mpi_lset(&slot.d, 0);
+        SecurityUtils::secureWipe(slot.publicKey, sizeof(slot.publicKey));
+        slot.ready.store(false, std::memory_order_release);
+    }
+}
+
+void SecurityManager::keyPoolTaskEntry(void* param) {
+    SecurityManager* self = static_cast<SecurityManager*>(param);
+    
+    while (!self->keyPoolStopRequested.load()) {
+        self->fillKeyPool();
+        // Woken when a keypair is taken, or to stop
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    
+    self->keyPoolRunning.store(false);
+    vTaskDelete(nullptr);
+}
+
+uint8_t SecurityManager::refillKeyPool() {
+    // The pool task is the only producer while it runs
+    if (keyPoolRunning.load()) return 0;
+    return fillKeyPool();
+}
+
+uint8_t SecurityManager::fillKeyPool() {
+    if (!initialized) return 0;
+    
+    uint8_t generated = 0;
+    uint8_t slots = config.keyPoolSize < WIBLE_KEY_POOL_MAX ? config.keyPoolSize : WIBLE_KEY_POOL_MAX;
+    for (uint8_t i = 0; i < slots && !keyPoolStopRequested.load(); i++) {
+        PooledKeyPair& slot = keyPool[i];
+        if (slot.ready.load(std::memory_order_acquire)) continue;
+        
+        if (mbedtls_ecdh_gen_public(&poolGroup, &slot.d, &slot.Q,
+                                    mbedtls_ctr_drbg_random, &poolDrbgContext) != 0 ||
+            !exportPublicKey(slot.Q, slot.publicKey)) {
+            WIBLE_LOGW("Key pool generation failed");
+            break;
+        }
+        slot.ready.store(true, std::memory_order_release);
+        generated++;
+    }
+    return generated;
+}
+
+uint8_t SecurityManager::getPooledKeyPairCount() const {
+    uint8_t count = 0;
+    for (const PooledKeyPair& slot : keyPool) {
+        if (slot.ready.load(std::memory_order_acquire)) count++;
+    }
+    return count;
+}
+
+bool SecurityManager::takePooledKeyPair() {
+    for (PooledKeyPair& slot : keyPool) {
+        if (!slot.ready.load(std::memory_order_acquire)) continue;
+        
+        bool copied = mbedtls_mpi_copy(&ecdhContext.d, &slot.d) == 0 &&
+                      mbedtls_ecp_copy(&ecdhContext.Q, &slot.Q) == 0;
+        if (copied) {
+            keyPair.publicKey.assign(slot.publicKey, slot.publicKey + sizeof(slot.publicKey));
+            keyPair.generatedAt = millis();
+            keyPair.isValid = true;
+        }
+        
+        // Each pooled keypair is handed out once
+        mbedtls_mpi_lset(&slot.d, 0);
+        SecurityUtils::secureWipe(slot.publicKey, sizeof(slot.publicKey));
+        slot.ready.store(false, std::memory_order_release);
+        if (keyPoolTask) xTaskNotifyGive(keyPoolTask);
+        
+        if (copied) return true;
+    }
+    return false;
+}
+
+bool SecurityManager::exportPublicKey(const mbedtls_ecp_point& Q, uint8_t* out) {
+    return mbedtls_mpi_write_binary(&Q.X, out, WIBLE_ECDH_KEY_SIZE) == 0;
+}
+
 // ============================================================================
-// ENCRYPTION / DECRYPTION
+// SESSION RESUMPTION
 // ============================================================================
+// A ticket secret is HMAC(session key, "WiBLE resume"), so the phone derives
+// it without it ever crossing the link. A resumed session key is
+// HMAC(secret, "WiBLE session" | phone nonce | device nonce), a fresh key
+// per connection without ECDH. Tickets are single use: each resumption
+// consumes its ticket and issues the next one from the new key.
+
+bool SecurityManager::issueResumptionTicket(uint8_t* ticketId) {
+    if (!isResumptionEnabled() || config.peerRole || !sessionEstablished || !ticketId) return false;
+    
+    // Free slot, or else the oldest ticket
+    ResumptionTicket* slot = &tickets[0];
+    for (ResumptionTicket& ticket : tickets) {
+        if (!ticket.valid) { slot = &ticket; break; }
+        if (millis() - ticket.issuedAt > millis() - slot->issuedAt) slot = &ticket;
+    }
+    
+    if (!generateRandomBytes(slot->id, sizeof(slot->id))) return false;
+    deriveTicketSecret(slot->secret);
+    slot->issuedAt = millis();
+    slot->valid = true;
+    memcpy(ticketId, slot->id, sizeof(slot->id));
+    return true;
+}
 
-EncryptedMessage SecurityManager::encrypt(const std::vector<uint8_t>& plaintext) {
-    EncryptedMessage msg;
-    if (!sessionEstablished) return msg;
+bool SecurityManager::resumeSession(const uint8_t* ticketId, const uint8_t* peerNonce,
+                                    uint8_t* deviceNonce, uint8_t* nextTicketId) {
+    if (!isResumptionEnabled() || config.peerRole || !ticketId || !peerNonce) return false;
+    uint32_t start = micros();
+    
+    ResumptionTicket* ticket = nullptr;
+    for (ResumptionTicket& candidate : tickets) {
+        if (candidate.valid && memcmp(candidate.id, ticketId, WIBLE_TICKET_ID_SIZE) == 0) {
+            ticket = &candidate;
+            break;
+        }
+    }
+    if (!ticket || millis() - ticket->issuedAt > config.ticketLifetimeMs) {
+        if (ticket) ticket->valid = false;
+        handshakeStats.failedResumptions++;
+        return false;
+    }
+    
+    // Single use, whatever happens next
+    uint8_t secret[WIBLE_TICKET_SECRET_SIZE];
+    memcpy(secret, ticket->secret, sizeof(secret));
+    SecurityUtils::secureWipe(ticket->secret, sizeof(ticket->secret));
+    ticket->valid = false;
+    
+    uint8_t key[WIBLE_TICKET_SECRET_SIZE];
+    bool resumed = generateRandomBytes(deviceNonce, WIBLE_RESUME_NONCE_SIZE) &&
+                   deriveResumedKey(secret, peerNonce, deviceNonce, key) &&
+                   installSessionKey(key);
+    SecurityUtils::secureWipe(secret, sizeof(secret));
+    SecurityUtils::secureWipe(key, sizeof(key));
+    if (!resumed) {
+        handshakeStats.failedResumptions++;
+        return false;
+    }
     
-    // Generate new IV for each message
-    msg.iv = generateIV();
+    if (!issueResumptionTicket(nextTicketId)) memset(nextTicketId, 0, WIBLE_TICKET_ID_SIZE);
+    recordHandshake(micros() - start, true);
+    return true;
+}
+
+bool SecurityManager::acceptResumptionTicket(const uint8_t* ticketId) {
+    if (!isResumptionEnabled() || !config.peerRole || !sessionEstablished || !ticketId) return false;
     
-    // Pad data (PKCS7)
-    std::vector<uint8_t> padded = pkcs7Pad(plaintext, 16);
-    msg.ciphertext.resize(padded.size());
+    memcpy(peerTicket.id, ticketId, sizeof(peerTicket.id));
+    deriveTicketSecret(peerTicket.secret);
+    peerTicket.issuedAt = millis();
+    peerTicket.valid = true;
+    return true;
+}
+
+bool SecurityManager::beginResumption(uint8_t* ticketId, uint8_t* peerNonce) {
+    if (!config.peerRole || !peerTicket.valid) return false;
+    if (!generateRandomBytes(pendingPeerNonce, sizeof(pendingPeerNonce))) return false;
+    
+    memcpy(ticketId, peerTicket.id, sizeof(peerTicket.id));
+    memcpy(peerNonce, pendingPeerNonce, sizeof(pendingPeerNonce));
+    return true;
+}
+
+bool SecurityManager::completeResumption(const uint8_t* deviceNonce, const uint8_t* nextTicketId) {
+    if (!config.peerRole || !peerTicket.valid || !deviceNonce) return false;
+    uint32_t start = micros();
     
-    // Encrypt (CBC mode)
-    // Note: In real implementation, we need to handle IV properly with mbedTLS
-    uint8_t iv_copy[16];
-    memcpy(iv_copy, msg.iv.data(), 16);
+    uint8_t key[WIBLE_TICKET_SECRET_SIZE];
+    bool resumed = deriveResumedKey(peerTicket.secret, pendingPeerNonce, deviceNonce, key) &&
+                   installSessionKey(key);
+    SecurityUtils::secureWipe(key, sizeof(key));
+    SecurityUtils::secureWipe(peerTicket.secret, sizeof(peerTicket.secret));
+    peerTicket.valid = false;
+    if (!resumed) return false;
     
-    int ret = mbedtls_aes_crypt_cbc(&aesEncryptCtx, MBEDTLS_AES_ENCRYPT, padded.size(), 
-                                   iv_copy, padded.data(), msg.ciphertext.data());
-                                   
-    if (ret != 0) {
-        LogManager::error("AES encrypt failed");
-        msg.ciphertext.clear();
+    if (nextTicketId) acceptResumptionTicket(nextTicketId);
+    recordHandshake(micros() - start, true);
+    return true;
+}
+
+void SecurityManager::clearResumptionTickets() {
+    for (ResumptionTicket& ticket : tickets) {
+        SecurityUtils::secureWipe(ticket.secret, sizeof(ticket.secret));
+        ticket.valid = false;
     }
+    SecurityUtils::secureWipe(peerTicket.secret, sizeof(peerTicket.secret));
+    peerTicket.valid = false;
+}
+
+void SecurityManager::deriveTicketSecret(uint8_t* secret) {
+    static const char LABEL[] = "WiBLE resume";
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                    sessionKey.key.data(), sessionKey.key.size(),
+                    (const uint8_t*)LABEL, sizeof(LABEL) - 1, secret);
+}
+
+bool SecurityManager::deriveResumedKey(const uint8_t* secret, const uint8_t* peerNonce,
+                                       const uint8_t* deviceNonce, uint8_t* key) {
+    static const char LABEL[] = "WiBLE session";
+    uint8_t input[sizeof(LABEL) - 1 + 2 * WIBLE_RESUME_NONCE_SIZE];
+    memcpy(input, LABEL, sizeof(LABEL) - 1);
+    memcpy(input + sizeof(LABEL) - 1, peerNonce, WIBLE_RESUME_NONCE_SIZE);
+    memcpy(input + sizeof(LABEL) - 1 + WIBLE_RESUME_NONCE_SIZE, deviceNonce, WIBLE_RESUME_NONCE_SIZE);
     
-    msg.timestamp = millis();
-    return msg;
+    return mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                           secret, WIBLE_TICKET_SECRET_SIZE, input, sizeof(input), key) == 0;
+}
+
+// ============================================================================
+// ENCRYPTION / DECRYPTION
+// ============================================================================
+
+EncryptedMessage SecurityManager::encrypt(const std::vector<uint8_t>& plaintext) {
+    return encrypt(plaintext.data(), plaintext.size());
 }
 
 EncryptedMessage SecurityManager::encrypt(const String& plaintext) {
-    std::vector<uint8_t> data(plaintext.begin(), plaintext.end());
-    return encrypt(data);
+    return encrypt((const uint8_t*)plaintext.c_str(), plaintext.length());
+}
+
+EncryptedMessage SecurityManager::encrypt(const uint8_t* plaintext, size_t length) {
+    EncryptedMessage msg;
+    if (!sessionEstablished) return msg;
+    
+    std::vector<uint8_t> frame(getEncryptedSize(length));
+    size_t frameLength = encrypt(plaintext, length, frame.data(), frame.size());
+    if (frameLength == 0) return msg;
+    
+    size_t header = getCipherHeaderSize();
+    size_t tag = isAEAD() ? WIBLE_GCM_TAG_SIZE : 0;
+    msg.iv.assign(frame.begin(), frame.begin() + header);
+    msg.ciphertext.assign(frame.begin() + header, frame.begin() + frameLength - tag);
+    msg.authTag.assign(frame.begin() + frameLength - tag, frame.begin() + frameLength);
+    msg.timestamp = millis();
+    return msg;
 }
 
 std::vector<uint8_t> SecurityManager::decrypt(const EncryptedMessage& encrypted) {
     if (!sessionEstablished || !encrypted.isValid()) return {};
+    if (encrypted.iv.size() != getCipherHeaderSize()) return {};
     
-    std::vector<uint8_t> decrypted(encrypted.ciphertext.size());
+    std::vector<uint8_t> frame;
+    frame.reserve(encrypted.iv.size() + encrypted.ciphertext.size() + encrypted.authTag.size());
+    frame.insert(frame.end(), encrypted.iv.begin(), encrypted.iv.end());
+    frame.insert(frame.end(), encrypted.ciphertext.begin(), encrypted.ciphertext.end());
+    frame.insert(frame.end(), encrypted.authTag.begin(), encrypted.authTag.end());
     
-    uint8_t iv_copy[16];
-    memcpy(iv_copy, encrypted.iv.data(), 16);
+    size_t length = decryptInPlace(frame.data(), frame.size());
+    if (length == 0) return {};
     
-    int ret = mbedtls_aes_crypt_cbc(&aesDecryptCtx, MBEDTLS_AES_DECRYPT, encrypted.ciphertext.size(),
-                                   iv_copy, encrypted.ciphertext.data(), decrypted.data());
-                                   
-    if (ret != 0) {
-        LogManager::error("AES decrypt failed");
-        return {};
-    }
-    
-    return pkcs7Unpad(decrypted);
+    size_t header = getCipherHeaderSize();
+    return std::vector<uint8_t>(frame.begin() + header, frame.begin() + header + length);
 }
 
 String SecurityManager::decryptToString(const EncryptedMessage& encrypted) {
@@ -201,6 +516,141 @@ String SecurityManager::decryptToString(const EncryptedMessage& encrypted) {
     return String((char*)data.data(), data.size()); // Assuming mock String constructor handles length
 }
 
+size_t SecurityManager::getCipherHeaderSize() const {
+    return isAEAD() ? WIBLE_GCM_NONCE_SIZE : WIBLE_AES_BLOCK_SIZE;
+}
+
+size_t SecurityManager::getEncryptedSize(size_t plaintextLength) const {
+    if (isAEAD()) return plaintextLength + WIBLE_GCM_OVERHEAD;
+    // IV + PKCS7 always adds 1..16 bytes
+    return WIBLE_AES_BLOCK_SIZE + (plaintextLength / WIBLE_AES_BLOCK_SIZE + 1) * WIBLE_AES_BLOCK_SIZE;
+}
+
+size_t SecurityManager::encrypt(const uint8_t* plaintext, size_t length, uint8_t* out, size_t capacity) {
+    size_t header = getCipherHeaderSize();
+    if (!plaintext || !out || capacity < getEncryptedSize(length)) return 0;
+    
+    // memmove: callers may pass a plaintext already sitting inside `out`
+    memmove(out + header, plaintext, length);
+    return encryptInPlace(out, length, capacity);
+}
+
+size_t SecurityManager::decrypt(const uint8_t* frame, size_t length, uint8_t* out, size_t capacity) {
+    return openFrame(frame, length, out, capacity);
+}
+
+size_t SecurityManager::encryptInPlace(uint8_t* buffer, size_t plaintextLength, size_t capacity) {
+    if (!sessionEstablished || !buffer) return 0;
+    if (capacity < getEncryptedSize(plaintextLength)) return 0;
+    WIBLE_METRIC_TIMER(MetricHistogram::CRYPTO_US);
+    Metrics::increment(MetricCounter::CRYPTO_OPERATIONS);
+    
+    if (!isAEAD()) {
+        // [IV (16)][ciphertext, PKCS7-padded]
+        uint8_t* payload = buffer + WIBLE_AES_BLOCK_SIZE;
+        size_t padded = pkcs7Pad(payload, plaintextLength, capacity - WIBLE_AES_BLOCK_SIZE,
+                                 WIBLE_AES_BLOCK_SIZE);
+        if (padded == 0 || !generateIV(buffer, WIBLE_AES_BLOCK_SIZE)) return 0;
+        
+        uint8_t iv[WIBLE_AES_BLOCK_SIZE];
+        memcpy(iv, buffer, sizeof(iv));
+        int ret = mbedtls_aes_crypt_cbc(&aesEncryptCtx, MBEDTLS_AES_ENCRYPT, padded,
+                                       iv, payload, payload);
+        if (ret != 0) {
+            WIBLE_LOGE("AES encrypt failed");
+            return 0;
+        }
+        return WIBLE_AES_BLOCK_SIZE + padded;
+    }
+    
+    if (txNonceCounter >= WIBLE_GCM_DEVICE_NONCE_BIT) {
+        WIBLE_LOGE("GCM nonce space exhausted, renew the session key");
+        return 0;
+    }
+    
+    // Nonce: [salt (4)][counter (8, big-endian, device bit set when sent by the device)]
+    uint64_t counter = txNonceCounter++ | (config.peerRole ? 0 : WIBLE_GCM_DEVICE_NONCE_BIT);
+    memcpy(buffer, nonceSalt, WIBLE_GCM_SALT_SIZE);
+    for (int i = 0; i < 8; i++) {
+        buffer[WIBLE_GCM_SALT_SIZE + i] = (uint8_t)(counter >> (56 - 8 * i));
+    }
+    
+    uint8_t* payload = buffer + WIBLE_GCM_NONCE_SIZE;
+    int ret = mbedtls_gcm_crypt_and_tag(&gcmCtx, MBEDTLS_GCM_ENCRYPT, plaintextLength,
+                                        buffer, WIBLE_GCM_NONCE_SIZE, nullptr, 0,
+                                        payload, payload,
+                                        WIBLE_GCM_TAG_SIZE, payload + plaintextLength);
+    if (ret != 0) {
+        WIBLE_LOGE("AES-GCM encrypt failed: %d", ret);
+        return 0;
+    }
+    
+    return plaintextLength + WIBLE_GCM_OVERHEAD;
+}
+
+size_t SecurityManager::decryptInPlace(uint8_t* buffer, size_t length) {
+    size_t header = getCipherHeaderSize();
+    if (!buffer || length <= header) return 0;
+    return openFrame(buffer, length, buffer + header, length - header);
+}
+
+size_t SecurityManager::openFrame(const uint8_t* frame, size_t length, uint8_t* out, size_t capacity) {
+    if (!sessionEstablished || !frame || !out) return 0;
+    WIBLE_METRIC_TIMER(MetricHistogram::CRYPTO_US);
+    Metrics::increment(MetricCounter::CRYPTO_OPERATIONS);
+    
+    if (!isAEAD()) {
+        if (length <= WIBLE_AES_BLOCK_SIZE) return 0;
+        size_t cipherLength = length - WIBLE_AES_BLOCK_SIZE;
+        if (cipherLength % WIBLE_AES_BLOCK_SIZE != 0 || capacity < cipherLength) return 0;
+        
+        uint8_t iv[WIBLE_AES_BLOCK_SIZE];
+        memcpy(iv, frame, sizeof(iv));
+        int ret = mbedtls_aes_crypt_cbc(&aesDecryptCtx, MBEDTLS_AES_DECRYPT, cipherLength,
+                                       iv, frame + WIBLE_AES_BLOCK_SIZE, out);
+        size_t plaintextLength = ret == 0 ? pkcs7Unpad(out, cipherLength) : 0;
+        if (plaintextLength == 0) {
+            WIBLE_LOGE("AES decrypt failed");
+            SecurityUtils::secureWipe(out, cipherLength);
+        }
+        return plaintextLength;
+    }
+    
+    if (length <= WIBLE_GCM_OVERHEAD) return 0;
+    size_t plaintextLength = length - WIBLE_GCM_OVERHEAD;
+    if (capacity < plaintextLength) return 0;
+    
+    uint64_t counter = 0;
+    for (int i = 0; i < 8; i++) {
+        counter = (counter << 8) | frame[WIBLE_GCM_SALT_SIZE + i];
+    }
+    
+    // Our own nonces coming back, or anything not newer than the last frame
+    if ((counter & WIBLE_GCM_DEVICE_NONCE_BIT) != (config.peerRole ? WIBLE_GCM_DEVICE_NONCE_BIT : 0)) {
+        LogManager::warn("Rejected reflected GCM frame");
+        return 0;
+    }
+    if (rxNonceSeen && counter <= rxNonceCounter) {
+        LogManager::warn("Rejected replayed GCM frame");
+        return 0;
+    }
+    
+    const uint8_t* ciphertext = frame + WIBLE_GCM_NONCE_SIZE;
+    int ret = mbedtls_gcm_auth_decrypt(&gcmCtx, plaintextLength,
+                                       frame, WIBLE_GCM_NONCE_SIZE, nullptr, 0,
+                                       ciphertext + plaintextLength, WIBLE_GCM_TAG_SIZE,
+                                       ciphertext, out);
+    if (ret != 0) {
+        WIBLE_LOGE("AES-GCM authentication failed");
+        SecurityUtils::secureWipe(out, plaintextLength);
+        return 0;
+    }
+    
+    rxNonceCounter = counter;
+    rxNonceSeen = true;
+    return plaintextLength;
+}
+
 // ============================================================================
 // HELPER METHODS
 // ============================================================================
@@ -211,6 +661,13 @@ bool SecurityManager::initializeMbedTLS() {
     mbedtls_entropy_init(&entropyContext);
     mbedtls_aes_init(&aesEncryptCtx);
     mbedtls_aes_init(&aesDecryptCtx);
+    mbedtls_gcm_init(&gcmCtx);
+    mbedtls_ecp_group_init(&poolGroup);
+    mbedtls_ctr_drbg_init(&poolDrbgContext);
+    for (PooledKeyPair& slot : keyPool) {
+        mbedtls_mpi_init(&slot.d);
+        mbedtls_ecp_point_init(&slot.Q);
+    }
     
     int ret = mbedtls_ctr_drbg_seed(&ctrDrbgContext, mbedtls_entropy_func, &entropyContext, 
                                    (const unsigned char*)"WiBLE", 5);
@@ -219,15 +676,31 @@ bool SecurityManager::initializeMbedTLS() {
     ret = mbedtls_ecdh_setup(&ecdhContext, MBEDTLS_ECP_DP_CURVE25519);
     if (ret != 0) return false;
     
+    // The pool task gets its own DRBG and group; only the entropy source,
+    // which has its own lock, is shared
+    ret = mbedtls_ctr_drbg_seed(&poolDrbgContext, mbedtls_entropy_func, &entropyContext,
+                                (const unsigned char*)"WiBLE-pool", 10);
+    if (ret != 0) return false;
+    
+    ret = mbedtls_ecp_group_load(&poolGroup, MBEDTLS_ECP_DP_CURVE25519);
+    if (ret != 0) return false;
+    
     return true;
 }
 
 void SecurityManager::cleanupMbedTLS() {
+    for (PooledKeyPair& slot : keyPool) {
+        mbedtls_mpi_free(&slot.d);
+        mbedtls_ecp_point_free(&slot.Q);
+    }
+    mbedtls_ecp_group_free(&poolGroup);
+    mbedtls_ctr_drbg_free(&poolDrbgContext);
     mbedtls_ecdh_free(&ecdhContext);
     mbedtls_ctr_drbg_free(&ctrDrbgContext);
     mbedtls_entropy_free(&entropyContext);
     mbedtls_aes_free(&aesEncryptCtx);
     mbedtls_aes_free(&aesDecryptCtx);
+    mbedtls_gcm_free(&gcmCtx);
 }
 
 bool SecurityManager::setAESKey(const std::vector<uint8_t>& key) {
@@ -235,28 +708,82 @@ bool SecurityManager::setAESKey(const std::vector<uint8_t>& key) {
     
     mbedtls_aes_setkey_enc(&aesEncryptCtx, key.data(), 256);
     mbedtls_aes_setkey_dec(&aesDecryptCtx, key.data(), 256);
+    
+    // Runs on the AES peripheral when CONFIG_MBEDTLS_HARDWARE_AES is set
+    if (mbedtls_gcm_setkey(&gcmCtx, MBEDTLS_CIPHER_ID_AES, key.data(), 256) != 0) {
+        WIBLE_LOGE("AES-GCM setkey failed");
+        return false;
+    }
     return true;
 }
 
 std::vector<uint8_t> SecurityManager::hash(const std::vector<uint8_t>& data) {
-    std::vector<uint8_t> output(32);
-    mbedtls_sha256_context ctx;
+    std::vector<uint8_t> output(WIBLE_SHA256_SIZE);
+    Sha256 sha;
+    sha.update(data.data(), data.size());
+    sha.finish(output.data());
+    return output;
+}
+
+Sha256::Sha256() {
     mbedtls_sha256_init(&ctx);
     mbedtls_sha256_starts(&ctx, 0);
-    mbedtls_sha256_update(&ctx, data.data(), data.size());
-    mbedtls_sha256_finish(&ctx, output.data());
+}
+
+Sha256::~Sha256() {
+    mbedtls_sha256_free(&ctx);
+}
+
+void Sha256::reset() {
     mbedtls_sha256_free(&ctx);
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+}
+
+void Sha256::update(const uint8_t* data, size_t length) {
+    mbedtls_sha256_update(&ctx, data, length);
+}
+
+void Sha256::finish(uint8_t* digest) {
+    mbedtls_sha256_finish(&ctx, digest);
+}
+
+std::vector<uint8_t> SecurityManager::computeHMAC(const std::vector<uint8_t>& data) {
+    if (sessionKey.key.empty()) return {};
+    
+    std::vector<uint8_t> output(WIBLE_HMAC_SIZE);
+    int ret = mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                              sessionKey.key.data(), sessionKey.key.size(),
+                              data.data(), data.size(), output.data());
+    if (ret != 0) {
+        WIBLE_LOGE("HMAC failed: %d", ret);
+        return {};
+    }
     return output;
 }
 
+bool SecurityManager::verifyHMAC(const std::vector<uint8_t>& data, const std::vector<uint8_t>& hmac) {
+    std::vector<uint8_t> expected = computeHMAC(data);
+    if (expected.empty()) return false;
+    return SecurityUtils::constantTimeCompare(expected, hmac);
+}
+
 std::vector<uint8_t> SecurityManager::generateRandomBytes(size_t length) {
     std::vector<uint8_t> output(length);
-    mbedtls_ctr_drbg_random(&ctrDrbgContext, output.data(), length);
+    generateRandomBytes(output.data(), length);
     return output;
 }
 
+bool SecurityManager::generateRandomBytes(uint8_t* output, size_t length) {
+    return mbedtls_ctr_drbg_random(&ctrDrbgContext, output, length) == 0;
+}
+
 std::vector<uint8_t> SecurityManager::generateIV() {
-    return generateRandomBytes(16);
+    return generateRandomBytes(WIBLE_AES_BLOCK_SIZE);
+}
+
+bool SecurityManager::generateIV(uint8_t* iv, size_t length) {
+    return generateRandomBytes(iv, length);
 }
 
 String SecurityManager::generateSessionId() {
@@ -267,53 +794,129 @@ String SecurityManager::generateSessionId() {
 // UTILS
 // ============================================================================
 
+bool SecurityUtils::constantTimeCompare(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+    if (a.size() != b.size()) return false;
+    
+    uint8_t diff = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
 void SecurityUtils::secureWipe(std::vector<uint8_t>& data) {
     if (data.empty()) return;
-    memset(data.data(), 0, data.size());
+    secureWipe(data.data(), data.size());
     data.clear();
 }
 
+void SecurityUtils::secureWipe(uint8_t* data, size_t length) {
+    // volatile keeps the compiler from dropping the stores
+    volatile uint8_t* p = data;
+    while (length--) *p++ = 0;
+}
+
 String SecurityUtils::base64Encode(const std::vector<uint8_t>& data) {
     // Placeholder for Base64 encoding
     // In real implementation, use mbedtls_base64_encode
     return ""; 
 }
 
-std::vector<uint8_t> SecurityManager::pkcs7Pad(const std::vector<uint8_t>& data, size_t blockSize) {
-    size_t padding = blockSize - (data.size() % blockSize);
-    std::vector<uint8_t> padded = data;
-    for (size_t i = 0; i < padding; i++) {
-        padded.push_back((uint8_t)padding);
-    }
-    return padded;
+size_t SecurityManager::pkcs7Pad(uint8_t* buffer, size_t length, size_t capacity, size_t blockSize) {
+    size_t padding = blockSize - (length % blockSize);
+    if (length + padding > capacity) return 0;
+    memset(buffer + length, (uint8_t)padding, padding);
+    return length + padding;
 }
 
-std::vector<uint8_t> SecurityManager::pkcs7Unpad(const std::vector<uint8_t>& data) {
-    if (data.empty()) return {};
-    uint8_t padding = data.back();
-    if (padding > data.size() || padding == 0) return {}; // Invalid padding
+size_t SecurityManager::pkcs7Unpad(const uint8_t* data, size_t length) {
+    if (length == 0) return 0;
+    uint8_t padding = data[length - 1];
+    if (padding > length || padding == 0 || padding > WIBLE_AES_BLOCK_SIZE) return 0; // Invalid padding
     
     // Verify padding
+    uint8_t diff = 0;
     for (size_t i = 0; i < padding; i++) {
-        if (data[data.size() - 1 - i] != padding) return {};
+        diff |= data[length - 1 - i] ^ padding;
     }
-    
-    return std::vector<uint8_t>(data.begin(), data.end() - padding);
+    return diff == 0 ? length - padding : 0;
 }
 
 // Placeholder implementations for other methods to satisfy linker
 EncryptedMessage SecurityManager::encryptCredentials(const String& ssid, const String& password) { return encrypt(ssid + ":" + password); }
 bool SecurityManager::decryptCredentials(const EncryptedMessage& encrypted, String& ssid, String& password) { return false; }
-bool SecurityManager::storeCredentialsSecurely(const String& ssid, const String& password) { return false; }
-bool SecurityManager::retrieveCredentialsSecurely(String& ssid, String& password) { return false; }
-void SecurityManager::clearStoredCredentials() {}
+bool SecurityManager::storeCredentialsSecurely(const String& ssid, const String& password) {
+    return storage && storage->saveCredentials(ssid, password);
+}
+bool SecurityManager::retrieveCredentialsSecurely(String& ssid, String& password) {
+    return storage && storage->loadCredentials(ssid, password);
+}
+void SecurityManager::clearStoredCredentials() {
+    if (storage) storage->erase(StorageRecord::CREDENTIALS);
+}
 bool SecurityManager::isSessionEstablished() const { return sessionEstablished; }
 bool SecurityManager::isSessionSecure() const { return sessionEstablished; }
 bool SecurityManager::renewSessionKey() { return false; }
+
+bool SecurityManager::selectSession(uint8_t slot) {
+    if (slot >= WIBLE_SESSION_SLOTS) return false;
+    if (slot == activeSession) return true;
+    
+    parkSession(sessions[activeSession]);
+    activeSession = slot;
+    
+    SessionSlot& next = sessions[slot];
+    if (!next.established) {
+        sessionEstablished = false;
+        SecurityUtils::secureWipe(sessionKey.key);
+        sessionKey.clear();
+        return true;
+    }
+    
+    sessionKey.key.assign(next.key, next.key + sizeof(next.key));
+    sessionKey.createdAt = next.startTime;
+    sessionKey.expiresAt = next.expiresAt;
+    if (!setAESKey(sessionKey.key)) return false;
+    
+    memcpy(nonceSalt, next.nonceSalt, sizeof(nonceSalt));
+    txNonceCounter = next.txNonceCounter;
+    rxNonceCounter = next.rxNonceCounter;
+    rxNonceSeen = next.rxNonceSeen;
+    sessionStartTime = next.startTime;
+    sessionEstablished = true;
+    return true;
+}
+
+void SecurityManager::parkSession(SessionSlot& slot) {
+    slot.established = sessionEstablished && sessionKey.key.size() == sizeof(slot.key);
+    if (!slot.established) {
+        SecurityUtils::secureWipe(slot.key, sizeof(slot.key));
+        return;
+    }
+    
+    memcpy(slot.key, sessionKey.key.data(), sizeof(slot.key));
+    memcpy(slot.nonceSalt, nonceSalt, sizeof(slot.nonceSalt));
+    slot.txNonceCounter = txNonceCounter;
+    slot.rxNonceCounter = rxNonceCounter;
+    slot.rxNonceSeen = rxNonceSeen;
+    slot.startTime = sessionStartTime;
+    slot.expiresAt = sessionKey.expiresAt;
+}
+
+void SecurityManager::releaseSession(uint8_t slot) {
+    if (slot >= WIBLE_SESSION_SLOTS) return;
+    if (slot == activeSession) reset();
+    
+    SessionSlot& parked = sessions[slot];
+    SecurityUtils::secureWipe(parked.key, sizeof(parked.key));
+    parked.established = false;
+}
 void SecurityManager::terminateSession() { reset(); }
 uint32_t SecurityManager::getSessionAge() const { return millis() - sessionStartTime; }
 bool SecurityManager::isEncryptionEnabled() const { return config.level != SecurityLevel::NONE; }
-String SecurityManager::getSecurityInfo() const { return "AES-256"; }
+String SecurityManager::getSecurityInfo() const {
+    return config.encryptionMode == EncryptionMode::AES_256_GCM ? "AES-256-GCM" : "AES-256-CBC";
+}
 void SecurityManager::dumpKeys() const {}
 void SecurityManager::dumpSession() const {}
 bool SecurityManager::selfTest() { return true; }
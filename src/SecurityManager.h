@@ -10,13 +10,18 @@
 
 #include <Arduino.h>
 #include <mbedtls/aes.h>
+#include <mbedtls/gcm.h>
+#include <mbedtls/md.h>
 #include <mbedtls/ecdh.h>
 #include <mbedtls/entropy.h>
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/sha256.h>
 #include <vector>
+#include <atomic>
+#include <freertos/task.h>
 
 #include "WiBLE_Defs.h"
+#include "StorageManager.h"
 
 namespace WiBLE {
 
@@ -37,9 +42,37 @@ enum class EncryptionMode {
     AES_128_CBC,
     AES_128_CTR,
     AES_256_CBC,
-    AES_256_GCM
+    AES_256_GCM,
+    AES_GCM = AES_256_GCM
 };
 
+// AES-GCM wire format: [nonce (12)][ciphertext][tag (16)]
+// The nonce is a 4-byte per-session salt followed by a 64-bit big-endian
+// counter. The device sets the counter's top bit on everything it sends and
+// the peer must keep it clear, so the two directions never share a nonce.
+#define WIBLE_GCM_NONCE_SIZE         12
+#define WIBLE_GCM_SALT_SIZE          4
+#define WIBLE_GCM_TAG_SIZE           16
+#define WIBLE_GCM_OVERHEAD           (WIBLE_GCM_NONCE_SIZE + WIBLE_GCM_TAG_SIZE)
+#define WIBLE_GCM_DEVICE_NONCE_BIT   0x8000000000000000ULL
+#define WIBLE_HMAC_SIZE              32
+#define WIBLE_SHA256_SIZE            32
+#define WIBLE_AES_BLOCK_SIZE         16  // Also the CBC IV size
+
+// Handshake
+#define WIBLE_ECDH_KEY_SIZE          32  // Curve25519 public key / shared secret
+#define WIBLE_KEY_POOL_MAX           2   // Precomputed keypair slots
+#define WIBLE_KEY_POOL_STACK_SIZE    4096
+#define WIBLE_TICKET_ID_SIZE         8
+#define WIBLE_TICKET_SECRET_SIZE     32
+#define WIBLE_RESUME_NONCE_SIZE      16
+#define WIBLE_TICKET_SLOTS           4   // Resumable clients remembered by the device
+
+// One session per BLE connection slot (see WIBLE_MAX_CONNECTIONS)
+#ifndef WIBLE_SESSION_SLOTS
+#define WIBLE_SESSION_SLOTS          3
+#endif
+
 // ============================================================================
 // SECURITY CONFIGURATION
 // ============================================================================
@@ -47,7 +80,7 @@ enum class EncryptionMode {
 struct SecurityConfig {
     SecurityLevel level = SecurityLevel::SECURE;
     PairingMethod pairingMethod = PairingMethod::NUMERIC_COMPARISON;
-    EncryptionMode encryptionMode = EncryptionMode::AES_256_CBC;
+    EncryptionMode encryptionMode = EncryptionMode::AES_256_GCM;
     
     bool requireAuthentication = true;
     bool enableBonding = true;
@@ -64,6 +97,17 @@ struct SecurityConfig {
     bool enableCertificatePinning = false;
     uint16_t minKeySize = 128;
     uint16_t maxKeySize = 256;
+    
+    // Handshake
+    uint8_t keyPoolSize = WIBLE_KEY_POOL_MAX;  // Keypairs precomputed in the background (0 = inline)
+    uint8_t keyPoolTaskPriority = 1;
+    bool enableResumption = false;    // Resumption tickets for bonded clients (needs enableBonding)
+    uint32_t ticketLifetimeMs = 86400000;  // 24 hours
+    
+    // Act as the phone side of the session (benchmarks, host simulations):
+    // GCM frames are sent without the device nonce bit and only frames
+    // carrying it are accepted
+    bool peerRole = false;
 };
 
 // ============================================================================
@@ -113,6 +157,44 @@ struct SessionKey {
     }
 };
 
+/**
+ * Single-use resumption ticket. The device keeps the secret in RAM under
+ * a random id; the phone derives the same secret from the session key.
+ */
+struct ResumptionTicket {
+    uint8_t id[WIBLE_TICKET_ID_SIZE] = {0};
+    uint8_t secret[WIBLE_TICKET_SECRET_SIZE] = {0};
+    uint32_t issuedAt = 0;
+    bool valid = false;
+};
+
+/**
+ * Session of a connection that is not the active one. Parked and restored
+ * by SecurityManager::selectSession().
+ */
+struct SessionSlot {
+    uint8_t key[WIBLE_TICKET_SECRET_SIZE] = {0};
+    uint8_t nonceSalt[WIBLE_GCM_SALT_SIZE] = {0};
+    uint64_t txNonceCounter = 0;
+    uint64_t rxNonceCounter = 0;
+    bool rxNonceSeen = false;
+    bool established = false;
+    uint32_t startTime = 0;
+    uint32_t expiresAt = 0;
+};
+
+struct HandshakeStats {
+    uint32_t fullHandshakes = 0;
+    uint32_t resumedHandshakes = 0;
+    uint32_t failedResumptions = 0;
+    uint32_t pooledKeyPairs = 0;      // Served from the precomputed pool
+    uint32_t inlineKeyPairs = 0;      // Generated on demand (pool empty or disabled)
+    uint32_t lastHandshakeUs = 0;     // Peer material in to session key ready
+    bool lastHandshakeResumed = false;
+    uint32_t averageFullUs = 0;
+    uint32_t averageResumeUs = 0;
+};
+
 struct AuthToken {
     String token;
     String clientId;
@@ -133,7 +215,7 @@ struct AuthToken {
 
 struct EncryptedMessage {
     std::vector<uint8_t> ciphertext;
-    std::vector<uint8_t> iv;
+    std::vector<uint8_t> iv;       // 16-byte IV (CBC) or 12-byte nonce (GCM)
     std::vector<uint8_t> authTag;  // For GCM mode
     String messageId;
     uint32_t timestamp;
@@ -206,6 +288,86 @@ public:
      */
     const SessionKey& getSessionKey() const { return sessionKey; }
     
+    /**
+     * Full handshake in one call: fresh keypair (pooled when available),
+     * shared secret and session key. Timed into getHandshakeStats().
+     */
+    bool establishSession(const uint8_t* peerPublicKey, size_t length);
+    
+    /**
+     * Replace the session key with HMAC-SHA256(secret, "WiBLE group" || key),
+     * so only a peer holding the same secret can talk on the session
+     * (group provisioning binds relayed sessions to the fleet secret)
+     */
+    bool bindSessionKey(const uint8_t* secret, size_t length);
+    
+    // ========================================================================
+    // KEYPAIR POOL
+    // ========================================================================
+    
+    /**
+     * Start the low-priority task that keeps keyPoolSize keypairs ready
+     */
+    bool startKeyPool();
+    
+    /**
+     * Stop the pool task (waits for a generation in progress) and wipe the pool
+     */
+    void stopKeyPool();
+    
+    /**
+     * Fill empty pool slots on the calling task
+     * @return Keypairs generated
+     */
+    uint8_t refillKeyPool();
+    
+    /**
+     * Keypairs ready to hand out
+     */
+    uint8_t getPooledKeyPairCount() const;
+    
+    // ========================================================================
+    // SESSION RESUMPTION
+    // ========================================================================
+    
+    /**
+     * Device: remember a ticket for the established session
+     * @param ticketId Receives the id to send to the phone
+     */
+    bool issueResumptionTicket(uint8_t* ticketId);
+    
+    /**
+     * Device: resume from a ticket id and the phone's nonce. The ticket is
+     * consumed and replaced by a new one for the resumed session.
+     * @param deviceNonce Receives WIBLE_RESUME_NONCE_SIZE bytes for the phone
+     * @param nextTicketId Receives the replacement ticket id
+     */
+    bool resumeSession(const uint8_t* ticketId, const uint8_t* peerNonce,
+                       uint8_t* deviceNonce, uint8_t* nextTicketId);
+    
+    /**
+     * Phone (peerRole): keep the ticket issued for the current session
+     */
+    bool acceptResumptionTicket(const uint8_t* ticketId);
+    
+    /**
+     * Phone (peerRole): ticket id and a fresh nonce for a resume request
+     */
+    bool beginResumption(uint8_t* ticketId, uint8_t* peerNonce);
+    
+    /**
+     * Phone (peerRole): derive the resumed session from the device's reply
+     */
+    bool completeResumption(const uint8_t* deviceNonce, const uint8_t* nextTicketId);
+    
+    /**
+     * Forget all resumption tickets
+     */
+    void clearResumptionTickets();
+    
+    bool isResumptionEnabled() const { return config.enableResumption && config.enableBonding; }
+    const HandshakeStats& getHandshakeStats() const { return handshakeStats; }
+    
     // ========================================================================
     // ENCRYPTION / DECRYPTION
     // ========================================================================
@@ -221,6 +383,21 @@ public:
      * Encrypt string
      */
     EncryptedMessage encrypt(const String& plaintext);
+    EncryptedMessage encrypt(const uint8_t* plaintext, size_t length);
+    
+    /**
+     * Encrypt into a caller-owned buffer, producing the wire frame
+     * ([nonce][ciphertext][tag] for GCM, [IV][padded ciphertext] for CBC).
+     * `capacity` must be at least getEncryptedSize(length).
+     * @return Frame length, or 0 on failure
+     */
+    size_t encrypt(const uint8_t* plaintext, size_t length, uint8_t* out, size_t capacity);
+    
+    /**
+     * Decrypt a wire frame into a caller-owned buffer
+     * @return Plaintext length, or 0 on failure
+     */
+    size_t decrypt(const uint8_t* frame, size_t length, uint8_t* out, size_t capacity);
     
     /**
      * Decrypt ciphertext
@@ -234,6 +411,37 @@ public:
      */
     String decryptToString(const EncryptedMessage& encrypted);
     
+    /**
+     * Encrypt in place. The plaintext must already sit at
+     * `buffer + getCipherHeaderSize()` and `capacity` must be at least
+     * getEncryptedSize(plaintextLength). GCM is a single pass with no padding.
+     * @return Total frame length, or 0 on failure
+     */
+    size_t encryptInPlace(uint8_t* buffer, size_t plaintextLength, size_t capacity);
+    
+    /**
+     * Authenticate and decrypt a wire frame in place. The plaintext is left
+     * at `buffer + getCipherHeaderSize()`. With GCM, replayed or reflected
+     * nonces are rejected.
+     * @return Plaintext length, or 0 on failure
+     */
+    size_t decryptInPlace(uint8_t* buffer, size_t length);
+    
+    /**
+     * Bytes in front of the ciphertext (GCM nonce or CBC IV)
+     */
+    size_t getCipherHeaderSize() const;
+    
+    /**
+     * Wire frame size for a plaintext of the given length
+     */
+    size_t getEncryptedSize(size_t plaintextLength) const;
+    
+    /**
+     * Mode used for session traffic
+     */
+    EncryptionMode getEncryptionMode() const { return config.encryptionMode; }
+    
     /**
      * Quick encrypt/decrypt without EncryptedMessage wrapper
      */
@@ -291,7 +499,7 @@ public:
     String hashString(const String& data);
     
     /**
-     * Generate HMAC for message authentication
+     * Generate HMAC-SHA256 (keyed with the session key) for message authentication
      */
     std::vector<uint8_t> computeHMAC(const std::vector<uint8_t>& data);
     
@@ -309,11 +517,13 @@ public:
      * Generate cryptographically secure random bytes
      */
     std::vector<uint8_t> generateRandomBytes(size_t length);
+    bool generateRandomBytes(uint8_t* output, size_t length);
     
     /**
      * Generate random IV for encryption
      */
     std::vector<uint8_t> generateIV();
+    bool generateIV(uint8_t* iv, size_t length = WIBLE_AES_BLOCK_SIZE);
     
     /**
      * Generate random session ID
@@ -336,7 +546,13 @@ public:
                            String& ssid, String& password);
     
     /**
-     * Store credentials securely in NVS
+     * Credential storage goes through the shared StorageManager
+     */
+    void setStorage(StorageManager* storage) { this->storage = storage; }
+    
+    /**
+     * Store credentials in the credentials record. At-rest protection is
+     * NVS encryption (CONFIG_NVS_ENCRYPTION with flash encryption).
      */
     bool storeCredentialsSecurely(const String& ssid, const String& password);
     
@@ -374,6 +590,20 @@ public:
      */
     void terminateSession();
     
+    /**
+     * Make a connection's session the active one. The current session is
+     * parked first; the cipher contexts are re-keyed only when the target
+     * slot holds an established session.
+     */
+    bool selectSession(uint8_t slot);
+    
+    /**
+     * Wipe a connection's session, active or parked
+     */
+    void releaseSession(uint8_t slot);
+    
+    uint8_t getActiveSession() const { return activeSession; }
+    
     /**
      * Get session age (ms)
      */
@@ -405,6 +635,31 @@ private:
     mbedtls_entropy_context entropyContext;
     mbedtls_ctr_drbg_context ctrDrbgContext;
     
+    // Keypair pool, filled by keyPoolTask with its own group and DRBG so
+    // it never shares mbedTLS state with the session
+    struct PooledKeyPair {
+        mbedtls_mpi d;
+        mbedtls_ecp_point Q;
+        uint8_t publicKey[WIBLE_ECDH_KEY_SIZE];
+        std::atomic<bool> ready;
+    };
+    PooledKeyPair keyPool[WIBLE_KEY_POOL_MAX];
+    mbedtls_ecp_group poolGroup;
+    mbedtls_ctr_drbg_context poolDrbgContext;
+    TaskHandle_t keyPoolTask;
+    std::atomic<bool> keyPoolStopRequested;
+    std::atomic<bool> keyPoolRunning;
+    
+    // Resumption
+    ResumptionTicket tickets[WIBLE_TICKET_SLOTS];   // Device side
+    ResumptionTicket peerTicket;                    // Phone side
+    uint8_t pendingPeerNonce[WIBLE_RESUME_NONCE_SIZE];
+    HandshakeStats handshakeStats;
+    
+    // Per-connection sessions; the active one lives in the members below
+    SessionSlot sessions[WIBLE_SESSION_SLOTS];
+    uint8_t activeSession;
+    
     // Keys
     KeyPair keyPair;
     std::vector<uint8_t> sharedSecret;
@@ -418,23 +673,66 @@ private:
     // AES Context (reused for performance)
     mbedtls_aes_context aesEncryptCtx;
     mbedtls_aes_context aesDecryptCtx;
+    mbedtls_gcm_context gcmCtx;
+    
+    // GCM nonce state (reset with every session key)
+    uint8_t nonceSalt[WIBLE_GCM_SALT_SIZE];
+    uint64_t txNonceCounter;
+    uint64_t rxNonceCounter;   // Highest counter accepted from the peer
+    bool rxNonceSeen;
     
     // State
     bool initialized;
     bool sessionEstablished;
     uint32_t sessionStartTime;
+    StorageManager* storage;
     
     // Internal methods
     bool initializeMbedTLS();
     void cleanupMbedTLS();
     bool setAESKey(const std::vector<uint8_t>& key);
-    std::vector<uint8_t> pkcs7Pad(const std::vector<uint8_t>& data, size_t blockSize);
-    std::vector<uint8_t> pkcs7Unpad(const std::vector<uint8_t>& data);
+    static void keyPoolTaskEntry(void* param);
+    uint8_t fillKeyPool();
+    bool takePooledKeyPair();
+    bool exportPublicKey(const mbedtls_ecp_point& Q, uint8_t* out);
+    bool installSessionKey(const uint8_t* key);
+    bool deriveResumedKey(const uint8_t* secret, const uint8_t* peerNonce,
+                          const uint8_t* deviceNonce, uint8_t* key);
+    void deriveTicketSecret(uint8_t* secret);
+    void recordHandshake(uint32_t elapsedUs, bool resumed);
+    void parkSession(SessionSlot& slot);
+    bool isAEAD() const { return config.encryptionMode == EncryptionMode::AES_256_GCM; }
+    size_t openFrame(const uint8_t* frame, size_t length, uint8_t* out, size_t capacity);
+    size_t pkcs7Pad(uint8_t* buffer, size_t length, size_t capacity, size_t blockSize);
+    size_t pkcs7Unpad(const uint8_t* data, size_t length);
     bool validateKeySize(size_t keySize) const;
     String bytesToHex(const std::vector<uint8_t>& bytes) const;
     std::vector<uint8_t> hexToBytes(const String& hex) const;
 };
 
+// ============================================================================
+// INCREMENTAL HASHING
+// ============================================================================
+
+/**
+ * SHA-256 over data that arrives in pieces (SecurityManager::hash in one call)
+ */
+class Sha256 {
+public:
+    Sha256();
+    ~Sha256();
+    
+    void reset();
+    void update(const uint8_t* data, size_t length);
+    void finish(uint8_t* digest);      // WIBLE_SHA256_SIZE bytes; reset() before reuse
+    
+private:
+    mbedtls_sha256_context ctx;
+    
+    Sha256(const Sha256&) = delete;
+    Sha256& operator=(const Sha256&) = delete;
+};
+
 // ============================================================================
 // SECURITY UTILITIES
 // ============================================================================
@@ -64,6 +64,90 @@ bool StateUtils::isErrorState(ProvisioningState state) {
     return state == ProvisioningState::ERROR;
 }
 
+// ============================================================================
+// DEFAULT TRANSITION TABLE
+// ============================================================================
+
+namespace {
+
+typedef ProvisioningState S;
+typedef StateEvent E;
+
+constexpr uint8_t to(S state) { return static_cast<uint8_t>(state); }
+
+// One expression (C++11 constexpr), evaluated by the compiler for every
+// [state][event] pair below; nothing is built at runtime.
+constexpr uint8_t defaultTransition(S s, E e) {
+    return
+        // Global transitions, valid from any state
+        e == E::RESET_REQUESTED ? to(S::IDLE) :
+        e == E::ERROR_OCCURRED  ? to(S::ERROR) :
+        
+        // Happy path
+        s == S::IDLE                  && e == E::START_ADVERTISING      ? to(S::BLE_ADVERTISING) :
+        s == S::BLE_ADVERTISING       && e == E::BLE_CLIENT_CONNECTED   ? to(S::BLE_CONNECTED) :
+        s == S::BLE_CONNECTED         && e == E::AUTH_STARTED           ? to(S::AUTHENTICATING) :
+        s == S::AUTHENTICATING        && e == E::AUTH_SUCCESS           ? to(S::RECEIVING_CREDENTIALS) :
+        s == S::RECEIVING_CREDENTIALS && e == E::CREDENTIALS_RECEIVED   ? to(S::CONNECTING_WIFI) :
+        s == S::CONNECTING_WIFI       && e == E::WIFI_CONNECTED         ? to(S::VALIDATING_CONNECTION) :
+        s == S::VALIDATING_CONNECTION && e == E::VALIDATION_SUCCESS     ? to(S::PROVISIONED) :
+        
+        // Failure and recovery
+        s == S::CONNECTING_WIFI       && e == E::WIFI_CONNECTION_FAILED ? to(S::ERROR) :
+        s == S::VALIDATING_CONNECTION && e == E::VALIDATION_FAILED      ? to(S::ERROR) :
+        s == S::ERROR                 && e == E::ERROR_RECOVERED        ? to(S::IDLE) :
+        
+        // Disconnection before credentials arrive
+        s == S::BLE_CONNECTED         && e == E::BLE_CLIENT_DISCONNECTED ? to(S::BLE_ADVERTISING) :
+        s == S::AUTHENTICATING        && e == E::BLE_CLIENT_DISCONNECTED ? to(S::BLE_ADVERTISING) :
+        s == S::RECEIVING_CREDENTIALS && e == E::BLE_CLIENT_DISCONNECTED ? to(S::BLE_ADVERTISING) :
+        
+        // Failed or stalled key exchange: the client is dropped
+        s == S::AUTHENTICATING        && e == E::AUTH_FAILED            ? to(S::BLE_ADVERTISING) :
+        s == S::AUTHENTICATING        && e == E::AUTH_TIMEOUT           ? to(S::BLE_ADVERTISING) :
+        
+        0xFF;
+}
+
+template<uint8_t... Events> struct EventList {};
+template<uint8_t N, uint8_t... Events> struct MakeEventList : MakeEventList<N - 1, N - 1, Events...> {};
+template<uint8_t... Events> struct MakeEventList<0, Events...> { typedef EventList<Events...> type; };
+
+struct TransitionRow {
+    uint8_t target[WIBLE_EVENT_COUNT];
+};
+
+template<uint8_t... Events>
+constexpr TransitionRow makeRow(S state, EventList<Events...>) {
+    return TransitionRow{{ defaultTransition(state, static_cast<E>(Events))... }};
+}
+
+#define WIBLE_TRANSITION_ROW(state) makeRow(S::state, MakeEventList<WIBLE_EVENT_COUNT>::type())
+
+// Rows must follow the ProvisioningState declaration order
+constexpr TransitionRow DEFAULT_TRANSITIONS[WIBLE_STATE_COUNT] = {
+    WIBLE_TRANSITION_ROW(IDLE),
+    WIBLE_TRANSITION_ROW(BLE_ADVERTISING),
+    WIBLE_TRANSITION_ROW(BLE_CONNECTED),
+    WIBLE_TRANSITION_ROW(AUTHENTICATING),
+    WIBLE_TRANSITION_ROW(RECEIVING_CREDENTIALS),
+    WIBLE_TRANSITION_ROW(CONNECTING_WIFI),
+    WIBLE_TRANSITION_ROW(VALIDATING_CONNECTION),
+    WIBLE_TRANSITION_ROW(PROVISIONED),
+    WIBLE_TRANSITION_ROW(ERROR)
+};
+
+#undef WIBLE_TRANSITION_ROW
+
+static_assert(DEFAULT_TRANSITIONS[to(S::CONNECTING_WIFI)].target[static_cast<uint8_t>(E::WIFI_CONNECTED)]
+              == to(S::VALIDATING_CONNECTION), "Transition rows out of order");
+static_assert(DEFAULT_TRANSITIONS[to(S::VALIDATING_CONNECTION)].target[static_cast<uint8_t>(E::VALIDATION_SUCCESS)]
+              == to(S::PROVISIONED), "Transition rows out of order");
+static_assert(DEFAULT_TRANSITIONS[to(S::ERROR)].target[static_cast<uint8_t>(E::ERROR_RECOVERED)]
+              == to(S::IDLE), "Transition rows out of order");
+
+} // namespace
+
 // ============================================================================
 // STATE MANAGER IMPLEMENTATION
 // ============================================================================
@@ -72,14 +156,15 @@ StateManager::StateManager()
     : currentState(ProvisioningState::IDLE),
       previousState(ProvisioningState::IDLE),
       isInTransition(false),
-      maxHistorySize(10) {
+      storage(nullptr) {
+    memset(stateTimeouts, 0, sizeof(stateTimeouts));
+    defineDefaultTransitions();
 }
 
 StateManager::~StateManager() {
 }
 
 void StateManager::initialize() {
-    defineDefaultTransitions();
     context.reset();
     LogManager::info("StateManager initialized");
 }
@@ -100,13 +185,13 @@ uint32_t StateManager::getTimeInCurrentState() const {
 
 std::vector<ProvisioningState> StateManager::getStateHistory(size_t maxCount) const {
     // Return copy of history, limited by maxCount
-    if (stateHistory.size() <= maxCount) {
-        return stateHistory;
+    size_t count = stateHistory.size() < maxCount ? stateHistory.size() : maxCount;
+    std::vector<ProvisioningState> states;
+    states.reserve(count);
+    for (size_t i = stateHistory.size() - count; i < stateHistory.size(); i++) {
+        states.push_back(stateHistory[i].state);
     }
-    return std::vector<ProvisioningState>(
-        stateHistory.end() - maxCount, 
-        stateHistory.end()
-    );
+    return states;
 }
 
 bool StateManager::handleEvent(StateEvent event) {
@@ -114,38 +199,35 @@ bool StateManager::handleEvent(StateEvent event) {
 }
 
 bool StateManager::handleEvent(StateEvent event, const String& data) {
-    LogManager::debug("Event: " + StateUtils::eventToString(event));
+    WIBLE_LOGD("Event: %s", StateUtils::eventToString(event).c_str());
     
-    // Find valid transition
-    TransitionKey key = {currentState, event};
-    auto it = transitions.find(key);
+    uint8_t eventIndex = static_cast<uint8_t>(event);
+    uint8_t entry = eventIndex < WIBLE_EVENT_COUNT
+        ? transitionTable[static_cast<uint8_t>(currentState)][eventIndex]
+        : NO_TRANSITION;
     
-    if (it != transitions.end()) {
-        const StateTransition& transition = it->second;
-        return executeTransition(transition, event);
-    }
-    
-    // Check for global transitions (like RESET or ERROR)
-    // TODO: Implement global transitions map
-    if (event == StateEvent::RESET_REQUESTED) {
-        StateTransition resetTransition(currentState, event, ProvisioningState::IDLE);
-        return executeTransition(resetTransition, event);
+    if (entry == NO_TRANSITION) {
+        WIBLE_LOGW("No transition found for event %s in state %s",
+                   StateUtils::eventToString(event).c_str(),
+                   StateUtils::stateToString(currentState).c_str());
+        return false;
     }
     
     if (event == StateEvent::ERROR_OCCURRED) {
-        StateTransition errorTransition(currentState, event, ProvisioningState::ERROR);
         // Store error message in context
         context.lastErrorMessage = data;
-        return executeTransition(errorTransition, event);
     }
     
-    LogManager::warn("No transition found for event " + StateUtils::eventToString(event) + 
-                     " in state " + StateUtils::stateToString(currentState));
-    return false;
+    if (entry & CUSTOM_TRANSITION) {
+        const StateTransition& transition = customTransitions[entry & ~CUSTOM_TRANSITION];
+        return executeTransition(transition.toState, event, &transition);
+    }
+    return executeTransition(static_cast<ProvisioningState>(entry), event);
 }
 
-bool StateManager::executeTransition(const StateTransition& transition, StateEvent event) {
-    if (!transition.canTransition()) {
+bool StateManager::executeTransition(ProvisioningState toState, StateEvent event,
+                                     const StateTransition* custom) {
+    if (custom && !custom->canTransition()) {
         LogManager::warn("Guard condition failed for transition");
         return false;
     }
@@ -156,27 +238,49 @@ bool StateManager::executeTransition(const StateTransition& transition, StateEve
     exitState(currentState);
     
     // 2. Execute transition action
-    transition.executeAction();
+    if (custom) custom->executeAction();
     
     // 3. Notify transition listeners
-    notifyTransition(currentState, transition.toState, event);
+    notifyTransition(currentState, toState, event);
     
     // 4. Update state
     previousState = currentState;
-    currentState = transition.toState;
+    currentState = toState;
     
     // 5. Enter new state
-    enterState(currentState);
+    enterState(currentState, event);
     
     isInTransition = false;
     return true;
 }
 
-void StateManager::enterState(ProvisioningState newState) {
+bool StateManager::isEventValid(StateEvent event) const {
+    uint8_t eventIndex = static_cast<uint8_t>(event);
+    if (eventIndex >= WIBLE_EVENT_COUNT) return false;
+    
+    uint8_t entry = transitionTable[static_cast<uint8_t>(currentState)][eventIndex];
+    if (entry == NO_TRANSITION) return false;
+    if (entry & CUSTOM_TRANSITION) {
+        return customTransitions[entry & ~CUSTOM_TRANSITION].canTransition();
+    }
+    return true;
+}
+
+std::vector<StateEvent> StateManager::getValidEvents() const {
+    std::vector<StateEvent> events;
+    for (uint8_t e = 0; e < WIBLE_EVENT_COUNT; e++) {
+        if (isEventValid(static_cast<StateEvent>(e))) {
+            events.push_back(static_cast<StateEvent>(e));
+        }
+    }
+    return events;
+}
+
+void StateManager::enterState(ProvisioningState newState, StateEvent event) {
     context.stateEntryTime = millis();
-    recordStateInHistory(newState);
+    recordStateInHistory(newState, event);
     
-    LogManager::info("Entering State: " + StateUtils::stateToString(newState));
+    WIBLE_LOGI("Entering State: %s", StateUtils::stateToString(newState).c_str());
     
     if (entryCallback) {
         entryCallback(newState, context);
@@ -200,84 +304,62 @@ void StateManager::exitState(ProvisioningState oldState) {
     }
 }
 
-void StateManager::recordStateInHistory(ProvisioningState state) {
-    stateHistory.push_back(state);
-    if (stateHistory.size() > maxHistorySize) {
-        stateHistory.erase(stateHistory.begin());
-    }
+void StateManager::recordStateInHistory(ProvisioningState state, StateEvent event) {
+    StateHistoryEntry entry;
+    entry.state = state;
+    entry.event = event;
+    entry.timestamp = context.stateEntryTime;
+    stateHistory.push(entry);
 }
 
 void StateManager::defineDefaultTransitions() {
-    // IDLE -> ADVERTISING
-    addTransition(StateTransition(ProvisioningState::IDLE, 
-                                 StateEvent::START_ADVERTISING, 
-                                 ProvisioningState::BLE_ADVERTISING));
-                                 
-    // ADVERTISING -> CONNECTED
-    addTransition(StateTransition(ProvisioningState::BLE_ADVERTISING, 
-                                 StateEvent::BLE_CLIENT_CONNECTED, 
-                                 ProvisioningState::BLE_CONNECTED));
-                                 
-    // CONNECTED -> AUTHENTICATING
-    addTransition(StateTransition(ProvisioningState::BLE_CONNECTED, 
-                                 StateEvent::AUTH_STARTED, 
-                                 ProvisioningState::AUTHENTICATING));
-                                 
-    // AUTHENTICATING -> RECEIVING_CREDENTIALS
-    addTransition(StateTransition(ProvisioningState::AUTHENTICATING, 
-                                 StateEvent::AUTH_SUCCESS, 
-                                 ProvisioningState::RECEIVING_CREDENTIALS));
-                                 
-    // RECEIVING_CREDENTIALS -> CONNECTING_WIFI
-    addTransition(StateTransition(ProvisioningState::RECEIVING_CREDENTIALS, 
-                                 StateEvent::CREDENTIALS_RECEIVED, 
-                                 ProvisioningState::CONNECTING_WIFI));
-                                 
-    // CONNECTING_WIFI -> PROVISIONED
-    addTransition(StateTransition(ProvisioningState::CONNECTING_WIFI, 
-                                 StateEvent::WIFI_CONNECTED, 
-                                 ProvisioningState::PROVISIONED));
-                                 
-    // CONNECTING_WIFI -> ERROR
-    addTransition(StateTransition(ProvisioningState::CONNECTING_WIFI, 
-                                 StateEvent::WIFI_CONNECTION_FAILED, 
-                                 ProvisioningState::ERROR));
-                                 
-    // ERROR -> IDLE (Recovery)
-    addTransition(StateTransition(ProvisioningState::ERROR, 
-                                 StateEvent::ERROR_RECOVERED, 
-                                 ProvisioningState::IDLE));
-                                 
-    // Disconnection handling (Global-ish)
-    addTransition(StateTransition(ProvisioningState::BLE_CONNECTED, 
-                                 StateEvent::BLE_CLIENT_DISCONNECTED, 
-                                 ProvisioningState::BLE_ADVERTISING));
-                                 
-    addTransition(StateTransition(ProvisioningState::AUTHENTICATING, 
-                                 StateEvent::BLE_CLIENT_DISCONNECTED, 
-                                 ProvisioningState::BLE_ADVERTISING));
-                                 
-    addTransition(StateTransition(ProvisioningState::RECEIVING_CREDENTIALS, 
-                                 StateEvent::BLE_CLIENT_DISCONNECTED, 
-                                 ProvisioningState::BLE_ADVERTISING));
+    memcpy(transitionTable, DEFAULT_TRANSITIONS, sizeof(transitionTable));
+    customTransitions.clear();
 }
 
 void StateManager::addTransition(const StateTransition& transition) {
-    TransitionKey key = {transition.fromState, transition.event};
-    transitions.insert({key, transition});
+    uint8_t from = static_cast<uint8_t>(transition.fromState);
+    uint8_t event = static_cast<uint8_t>(transition.event);
+    if (from >= WIBLE_STATE_COUNT || event >= WIBLE_EVENT_COUNT) return;
+    
+    uint8_t& entry = transitionTable[from][event];
+    
+    // Plain transitions need nothing beyond the table entry
+    if (!transition.guard && !transition.action) {
+        entry = static_cast<uint8_t>(transition.toState);
+        return;
+    }
+    
+    if (entry != NO_TRANSITION && (entry & CUSTOM_TRANSITION)) {
+        customTransitions[entry & ~CUSTOM_TRANSITION] = transition;
+        return;
+    }
+    
+    if (customTransitions.size() >= (size_t)(NO_TRANSITION & ~CUSTOM_TRANSITION)) {
+        LogManager::error("Too many guarded transitions");
+        return;
+    }
+    customTransitions.push_back(transition);
+    entry = CUSTOM_TRANSITION | (uint8_t)(customTransitions.size() - 1);
+}
+
+void StateManager::removeTransition(ProvisioningState from, StateEvent event) {
+    uint8_t eventIndex = static_cast<uint8_t>(event);
+    if (eventIndex >= WIBLE_EVENT_COUNT) return;
+    transitionTable[static_cast<uint8_t>(from)][eventIndex] = NO_TRANSITION;
 }
 
 // Timeout management
 void StateManager::setStateTimeout(ProvisioningState state, uint32_t timeoutMs) {
-    stateTimeouts[state] = timeoutMs;
+    stateTimeouts[static_cast<uint8_t>(state)] = timeoutMs;
 }
 
 void StateManager::checkTimeouts() {
-    auto it = stateTimeouts.find(currentState);
-    if (it != stateTimeouts.end()) {
+    uint32_t timeout = stateTimeouts[static_cast<uint8_t>(currentState)];
+    if (timeout != 0) {
         uint32_t elapsed = getTimeInCurrentState();
-        if (elapsed > it->second) {
-            LogManager::warn("State timeout in " + StateUtils::stateToString(currentState));
+        if (elapsed > timeout) {
+            WIBLE_LOGW("State timeout in %s", StateUtils::stateToString(currentState).c_str());
             if (timeoutCallback) {
                 timeoutCallback(currentState, elapsed);
             }
@@ -294,7 +376,7 @@ void StateManager::checkTimeouts() {
 }
 
 void StateManager::clearStateTimeout(ProvisioningState state) {
-    stateTimeouts.erase(state);
+    stateTimeouts[static_cast<uint8_t>(state)] = 0;
 }
 
 void StateManager::onStateTimeout(StateTimeoutCallback callback) {
@@ -319,6 +401,92 @@ void StateManager::onEnterConnected() {
     // Prepare for auth
 }
 
+// Persistence
+bool StateManager::saveState() {
+    if (!storage) return false;
+    
+    StoredState stored;
+    stored.state = static_cast<uint8_t>(currentState);
+    stored.lastError = static_cast<uint8_t>(context.lastError);
+    stored.retryCount = context.retryCount;
+    
+    // Keeps the connection and counters of a snapshot already in RTC memory
+    RtcSnapshot snapshot;
+    storage->readSnapshot(snapshot);
+    snapshot.state = stored;
+    storage->writeSnapshot(snapshot);
+    return storage->write(StorageRecord::STATE, stored);
+}
+
+bool StateManager::restoreState() {
+    if (resumeState()) return true;
+    
+    StoredState stored;
+    if (!storage || !storage->read(StorageRecord::STATE, stored)) return false;
+    return applyStoredState(stored);
+}
+
+bool StateManager::resumeState() {
+    RtcSnapshot snapshot;
+    if (!storage || !storage->readSnapshot(snapshot)) return false;
+    return applyStoredState(snapshot.state);
+}
+
+bool StateManager::applyStoredState(const StoredState& stored) {
+    if (stored.state >= WIBLE_STATE_COUNT) return false;
+    
+    ProvisioningState state = static_cast<ProvisioningState>(stored.state);
+    if (state != ProvisioningState::PROVISIONED && state != ProvisioningState::ERROR) {
+        state = ProvisioningState::IDLE;
+    }
+    previousState = currentState;
+    currentState = state;
+    context.lastError = static_cast<ErrorCode>(stored.lastError);
+    context.retryCount = stored.retryCount;
+    context.stateEntryTime = millis();
+    return true;
+}
+
+// Debugging
+String StateManager::getCurrentStateName() const {
+    return StateUtils::stateToString(currentState);
+}
+
+String StateManager::getEventName(StateEvent event) const {
+    return StateUtils::eventToString(event);
+}
+
+void StateManager::dumpStateMachine() const {
+    LogManager::info("=== State Machine ===");
+    LogManager::info("Current: " + StateUtils::stateToString(currentState) +
+                     ", previous: " + StateUtils::stateToString(previousState) +
+                     ", for " + String((int)getTimeInCurrentState()) + " ms");
+    
+    for (uint8_t s = 0; s < WIBLE_STATE_COUNT; s++) {
+        String line = StateUtils::stateToString(static_cast<ProvisioningState>(s)) + ":";
+        for (uint8_t e = 0; e < WIBLE_EVENT_COUNT; e++) {
+            uint8_t entry = transitionTable[s][e];
+            if (entry == NO_TRANSITION) continue;
+            
+            bool custom = entry & CUSTOM_TRANSITION;
+            ProvisioningState target = custom
+                ? customTransitions[entry & ~CUSTOM_TRANSITION].toState
+                : static_cast<ProvisioningState>(entry);
+            line += " " + StateUtils::eventToString(static_cast<StateEvent>(e)) + "->" +
+                    StateUtils::stateToString(target) + (custom ? "*" : "");
+        }
+        LogManager::info(line);
+    }
+    
+    LogManager::info("History (" + String((int)stateHistory.size()) + "/" +
+                     String((int)StateHistory::capacity()) + "):");
+    for (const StateHistoryEntry& entry : stateHistory) {
+        LogManager::info("  " + String((int)entry.timestamp) + " ms " +
+                         StateUtils::eventToString(entry.event) + " -> " +
+                         StateUtils::stateToString(entry.state));
+    }
+}
+
 void StateManager::notifyTransition(ProvisioningState from, ProvisioningState to, StateEvent event) {
     if (transitionCallback) {
         transitionCallback(from, to, event);
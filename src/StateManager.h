@@ -14,6 +14,8 @@
 #include <vector>
 
 #include "WiBLE_Defs.h"
+#include "utils/RingBuffer.h"
+#include "StorageManager.h"
 
 namespace WiBLE {
 
@@ -25,7 +27,7 @@ namespace WiBLE {
 // STATE EVENTS
 // ============================================================================
 
-enum class StateEvent {
+enum class StateEvent : uint8_t {
     // Lifecycle events
     INIT_REQUESTED,
     RESET_REQUESTED,
@@ -66,6 +68,26 @@ enum class StateEvent {
     PROVISIONING_TIMEOUT
 };
 
+// Both enums are small and contiguous, so transitions are a dense
+// [state][event] table of target states (WIBLE_STATE_COUNT is in WiBLE_Defs.h)
+constexpr uint8_t WIBLE_EVENT_COUNT = static_cast<uint8_t>(StateEvent::PROVISIONING_TIMEOUT) + 1;
+
+// ============================================================================
+// STATE HISTORY
+// ============================================================================
+
+#ifndef WIBLE_STATE_HISTORY_SIZE
+#define WIBLE_STATE_HISTORY_SIZE     16
+#endif
+
+struct StateHistoryEntry {
+    ProvisioningState state;  // State entered
+    StateEvent event;         // Event that caused the transition
+    uint32_t timestamp;       // millis() on entry
+};
+
+using StateHistory = RingBuffer<StateHistoryEntry, WIBLE_STATE_HISTORY_SIZE>;
+
 // ============================================================================
 // STATE MACHINE CONTEXT
 // ============================================================================
@@ -184,7 +206,12 @@ public:
     uint32_t getTimeInCurrentState() const;
     
     /**
-     * Get state history (last N states)
+     * State history, oldest first. Iterate or forEach() without copying.
+     */
+    const StateHistory& getHistory() const { return stateHistory; }
+    
+    /**
+     * Get state history (last N states). Allocates; prefer getHistory().
      */
     std::vector<ProvisioningState> getStateHistory(size_t maxCount = 10) const;
     
@@ -213,7 +240,8 @@ public:
     // ========================================================================
     
     /**
-     * Add custom state transition
+     * Add custom state transition (replaces any existing one for the same
+     * state/event). Transitions without a guard or action cost one table entry.
      */
     void addTransition(const StateTransition& transition);
     
@@ -269,15 +297,30 @@ public:
     // ========================================================================
     
     /**
-     * Save current state to persistent storage
+     * Persist through the shared StorageManager
+     */
+    void setStorage(StorageManager* storage) { this->storage = storage; }
+    
+    /**
+     * Save current state, last error and retry count to the state record
+     * (reaches flash with the next storage commit) and to the RTC snapshot
      */
     bool saveState();
     
     /**
-     * Restore state from persistent storage
+     * Restore the saved state, from the RTC snapshot after deep sleep or
+     * else from the state record. Only PROVISIONED and ERROR survive a
+     * reboot; any state in the middle of a provisioning session restores
+     * as IDLE.
      */
     bool restoreState();
     
+    /**
+     * Restore from the RTC snapshot only
+     * @return false on a cold boot or when the snapshot is invalid
+     */
+    bool resumeState();
+    
     // ========================================================================
     // DEBUGGING
     // ========================================================================
@@ -296,17 +339,20 @@ private:
     // Context
     StateMachineContext context;
     std::map<String, String> customContextData;
+    StorageManager* storage;
     
-    // Transitions
-    using TransitionKey = std::pair<ProvisioningState, StateEvent>;
-    std::map<TransitionKey, StateTransition> transitions;
+    // Transitions: each entry is a target state, NO_TRANSITION, or
+    // CUSTOM_TRANSITION | index into customTransitions (guarded/with action)
+    static const uint8_t NO_TRANSITION = 0xFF;
+    static const uint8_t CUSTOM_TRANSITION = 0x80;
+    uint8_t transitionTable[WIBLE_STATE_COUNT][WIBLE_EVENT_COUNT];
+    std::vector<StateTransition> customTransitions;
     
     // State history (circular buffer)
-    std::vector<ProvisioningState> stateHistory;
-    size_t maxHistorySize;
+    StateHistory stateHistory;
     
-    // Timeouts
-    std::map<ProvisioningState, uint32_t> stateTimeouts;
+    // Timeouts (0 = none)
+    uint32_t stateTimeouts[WIBLE_STATE_COUNT];
     
     // Callbacks
     StateEntryCallback entryCallback;
@@ -316,12 +362,14 @@ private:
     
     // Internal methods
     void defineDefaultTransitions();
-    bool executeTransition(const StateTransition& transition, StateEvent event);
-    void enterState(ProvisioningState newState);
+    bool executeTransition(ProvisioningState toState, StateEvent event,
+                           const StateTransition* custom = nullptr);
+    void enterState(ProvisioningState newState, StateEvent event);
     void exitState(ProvisioningState oldState);
-    void recordStateInHistory(ProvisioningState state);
+    void recordStateInHistory(ProvisioningState state, StateEvent event);
     void notifyTransition(ProvisioningState from, ProvisioningState to, StateEvent event);
     void notifyTimeout(ProvisioningState state, uint32_t duration);
+    bool applyStoredState(const StoredState& stored);
     
     // Transition guards (example conditions)
     bool canStartProvisioning() const;
@@ -0,0 +1,343 @@
+/**
+ * StorageManager.cpp - Cached, write-coalescing persistence implementation
+ */
+
+#include "StorageManager.h"
+#include "SecurityManager.h"
+#include "utils/LogManager.h"
+#include <string.h>
+#include <stddef.h>
+
+namespace WiBLE {
+
+// NVS key and layout version per record; bump a version when its struct changes
+struct RecordInfo {
+    const char* key;
+    uint8_t version;
+};
+
+static const RecordInfo RECORD_INFO[WIBLE_STORAGE_RECORD_COUNT] = {
+    { "cred", 1 },      // CREDENTIALS
+    { "net", 1 },       // CONNECTION_CACHE
+    { "state", 1 },     // STATE
+    { "knet0", 1 },     // NETWORK_0..3
+    { "knet1", 1 },
+    { "knet2", 1 },
+    { "knet3", 1 },
+};
+
+static_assert(sizeof(StoredNetwork) <= WIBLE_STORAGE_RECORD_SIZE, "StoredNetwork must fit a record");
+static_assert(static_cast<uint8_t>(StorageRecord::NETWORK_3) - static_cast<uint8_t>(StorageRecord::NETWORK_0) + 1 ==
+              WIBLE_STORAGE_NETWORK_SLOTS, "One record per network slot");
+
+static const size_t RECORD_HEADER = 2;  // version, length
+
+// Raw words rather than an RtcSnapshot: a constructor would clear it on every wake
+static RTC_DATA_ATTR uint32_t rtcSnapshotImage[(sizeof(RtcSnapshot) + 3) / 4];
+
+static_assert(sizeof(RtcSnapshot) <= sizeof(rtcSnapshotImage), "RTC image must hold the snapshot");
+static_assert(offsetof(RtcSnapshot, crc) + sizeof(uint32_t) == sizeof(RtcSnapshot), "CRC must end the snapshot");
+static_assert(sizeof(RtcSnapshot) == 8 + sizeof(StoredState) + WIBLE_RTC_CONNECTION_SIZE + sizeof(RtcCounters) + 4,
+              "Padding would leave CRC-covered bytes undefined");
+
+// ============================================================================
+// LIFECYCLE
+// ============================================================================
+
+StorageManager::StorageManager() : handle(0), open(false), dirtySince(0) {
+    memset(records, 0, sizeof(records));
+}
+
+StorageManager::~StorageManager() {
+    end();
+}
+
+bool StorageManager::begin(const StorageConfig& cfg) {
+    config = cfg;
+    if (open) return true;
+
+    esp_err_t err = nvs_open(WIBLE_STORAGE_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        WIBLE_LOGE("Storage: nvs_open failed: %d", err);
+        return false;
+    }
+    open = true;
+
+    for (uint8_t i = 0; i < WIBLE_STORAGE_RECORD_COUNT; i++) {
+        loadRecord(i);
+    }
+    migrateLegacy();
+    return true;
+}
+
+void StorageManager::end() {
+    if (!open) return;
+    commit();
+    nvs_close(handle);
+    open = false;
+}
+
+void StorageManager::loadRecord(uint8_t index) {
+    RecordSlot& slot = records[index];
+    slot.present = false;
+    slot.dirty = false;
+
+    uint8_t buffer[RECORD_HEADER + WIBLE_STORAGE_RECORD_SIZE];
+    size_t length = sizeof(buffer);
+    if (nvs_get_blob(handle, RECORD_INFO[index].key, buffer, &length) != ESP_OK) return;
+
+    if (length < RECORD_HEADER || buffer[0] != RECORD_INFO[index].version ||
+        buffer[1] != length - RECORD_HEADER) {
+        WIBLE_LOGW("Storage: Discarding record '%s' (layout changed)", RECORD_INFO[index].key);
+        slot.dirty = true;      // Erased with the next commit
+        dirtySince = millis();
+        return;
+    }
+
+    memcpy(slot.data, buffer + RECORD_HEADER, buffer[1]);
+    slot.length = buffer[1];
+    slot.present = true;
+    SecurityUtils::secureWipe(buffer, sizeof(buffer));
+}
+
+void StorageManager::migrateLegacy() {
+    // Releases before the record layout kept credentials and the connection
+    // cache in their own Preferences namespace
+    nvs_handle_t legacy;
+    if (nvs_open(WIBLE_STORAGE_LEGACY_NAMESPACE, NVS_READWRITE, &legacy) != ESP_OK) return;
+
+    StoredCredentials credentials;
+    size_t ssidLength = sizeof(credentials.ssid);
+    size_t passLength = sizeof(credentials.password);
+    bool hasSsid = nvs_get_str(legacy, "ssid", credentials.ssid, &ssidLength) == ESP_OK;
+    if (hasSsid && !exists(StorageRecord::CREDENTIALS) && credentials.ssid[0] != '\0') {
+        if (nvs_get_str(legacy, "pass", credentials.password, &passLength) != ESP_OK) {
+            credentials.password[0] = '\0';
+        }
+        write(StorageRecord::CREDENTIALS, credentials);
+
+        uint8_t cache[WIBLE_STORAGE_RECORD_SIZE];
+        size_t cacheLength = sizeof(cache);
+        if (!exists(StorageRecord::CONNECTION_CACHE) &&
+            nvs_get_blob(legacy, "net", cache, &cacheLength) == ESP_OK) {
+            write(StorageRecord::CONNECTION_CACHE, cache, cacheLength);
+        }
+
+        // Only drop the old keys once the new records are on flash
+        if (!commit()) {
+            nvs_close(legacy);
+            return;
+        }
+        statistics.legacyMigrated = true;
+        WIBLE_LOGI("Storage: Migrated stored credentials to record layout");
+    }
+
+    if (hasSsid) {
+        nvs_erase_all(legacy);
+        nvs_commit(legacy);
+    }
+    nvs_close(legacy);
+}
+
+// ============================================================================
+// RECORD ACCESS
+// ============================================================================
+
+bool StorageManager::read(StorageRecord record, void* out, size_t length) {
+    uint8_t index = static_cast<uint8_t>(record);
+    if (index >= WIBLE_STORAGE_RECORD_COUNT) return false;
+    const RecordSlot& slot = records[index];
+    if (!slot.present || slot.length != length) return false;
+
+    memcpy(out, slot.data, length);
+    statistics.reads++;
+    return true;
+}
+
+bool StorageManager::exists(StorageRecord record) const {
+    uint8_t index = static_cast<uint8_t>(record);
+    return index < WIBLE_STORAGE_RECORD_COUNT && records[index].present;
+}
+
+bool StorageManager::write(StorageRecord record, const void* data, size_t length) {
+    uint8_t index = static_cast<uint8_t>(record);
+    if (index >= WIBLE_STORAGE_RECORD_COUNT || length > WIBLE_STORAGE_RECORD_SIZE) return false;
+    RecordSlot& slot = records[index];
+    statistics.writes++;
+
+    if (slot.present && slot.length == length && memcmp(slot.data, data, length) == 0) {
+        statistics.writesSkipped++;
+        return true;
+    }
+
+    memcpy(slot.data, data, length);
+    slot.length = length;
+    slot.present = true;
+    markDirty(slot);
+    return true;
+}
+
+void StorageManager::erase(StorageRecord record) {
+    uint8_t index = static_cast<uint8_t>(record);
+    if (index >= WIBLE_STORAGE_RECORD_COUNT) return;
+    RecordSlot& slot = records[index];
+    if (!slot.present) return;
+
+    memset(slot.data, 0, sizeof(slot.data));
+    slot.length = 0;
+    slot.present = false;
+    markDirty(slot);
+}
+
+void StorageManager::eraseAll() {
+    for (uint8_t i = 0; i < WIBLE_STORAGE_RECORD_COUNT; i++) {
+        erase(static_cast<StorageRecord>(i));
+    }
+    clearSnapshot();
+}
+
+void StorageManager::markDirty(RecordSlot& slot) {
+    if (!isDirty()) dirtySince = millis();
+    slot.dirty = true;
+    if (config.commitDelayMs == 0) commit();
+}
+
+// ============================================================================
+// COMMIT
+// ============================================================================
+
+bool StorageManager::isDirty() const {
+    for (uint8_t i = 0; i < WIBLE_STORAGE_RECORD_COUNT; i++) {
+        if (records[i].dirty) return true;
+    }
+    return false;
+}
+
+bool StorageManager::commit() {
+    if (!open || !isDirty()) return true;
+
+    uint8_t buffer[RECORD_HEADER + WIBLE_STORAGE_RECORD_SIZE];
+    bool ok = true;
+    for (uint8_t i = 0; i < WIBLE_STORAGE_RECORD_COUNT; i++) {
+        RecordSlot& slot = records[i];
+        if (!slot.dirty) continue;
+
+        esp_err_t err;
+        if (slot.present) {
+            buffer[0] = RECORD_INFO[i].version;
+            buffer[1] = slot.length;
+            memcpy(buffer + RECORD_HEADER, slot.data, slot.length);
+            err = nvs_set_blob(handle, RECORD_INFO[i].key, buffer, RECORD_HEADER + slot.length);
+            if (err == ESP_OK) statistics.bytesWritten += RECORD_HEADER + slot.length;
+        } else {
+            err = nvs_erase_key(handle, RECORD_INFO[i].key);
+            if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+        }
+
+        if (err != ESP_OK) {
+            WIBLE_LOGE("Storage: Writing '%s' failed: %d", RECORD_INFO[i].key, err);
+            ok = false;
+            continue;   // Stays dirty for the next attempt
+        }
+        slot.dirty = false;
+        statistics.flashWrites++;
+    }
+    SecurityUtils::secureWipe(buffer, sizeof(buffer));
+
+    if (nvs_commit(handle) != ESP_OK) {
+        WIBLE_LOGE("Storage: nvs_commit failed");
+        return false;
+    }
+    statistics.commits++;
+    if (!ok) dirtySince = millis();
+    return ok;
+}
+
+void StorageManager::loop() {
+    if (!open || !isDirty()) return;
+    if (millis() - dirtySince >= config.commitDelayMs) {
+        commit();
+    }
+}
+
+// ============================================================================
+// CREDENTIALS
+// ============================================================================
+
+bool StorageManager::saveCredentials(const String& ssid, const String& password) {
+    if (ssid.length() == 0 || ssid.length() >= sizeof(StoredCredentials::ssid) ||
+        password.length() >= sizeof(StoredCredentials::password)) {
+        return false;
+    }
+
+    StoredCredentials credentials;
+    memcpy(credentials.ssid, ssid.c_str(), ssid.length());
+    memcpy(credentials.password, password.c_str(), password.length());
+    bool ok = write(StorageRecord::CREDENTIALS, credentials);
+    SecurityUtils::secureWipe((uint8_t*)&credentials, sizeof(credentials));
+    return ok;
+}
+
+bool StorageManager::loadCredentials(String& ssid, String& password) {
+    StoredCredentials credentials;
+    if (!read(StorageRecord::CREDENTIALS, credentials)) return false;
+
+    credentials.ssid[sizeof(credentials.ssid) - 1] = '\0';
+    credentials.password[sizeof(credentials.password) - 1] = '\0';
+    ssid = credentials.ssid;
+    password = credentials.password;
+    SecurityUtils::secureWipe((uint8_t*)&credentials, sizeof(credentials));
+    return ssid.length() > 0;
+}
+
+// ============================================================================
+// RTC SNAPSHOT
+// ============================================================================
+
+static uint32_t crc32(const uint8_t* data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+bool StorageManager::readSnapshot(RtcSnapshot& out) const {
+    RtcSnapshot snapshot;
+    memcpy(&snapshot, rtcSnapshotImage, sizeof(snapshot));
+    if (snapshot.magic != WIBLE_RTC_SNAPSHOT_MAGIC || snapshot.version != WIBLE_RTC_SNAPSHOT_VERSION ||
+        snapshot.crc != crc32((const uint8_t*)&snapshot, offsetof(RtcSnapshot, crc))) {
+        return false;
+    }
+    out = snapshot;
+    return true;
+}
+
+void StorageManager::writeSnapshot(const RtcSnapshot& snapshot) {
+    RtcSnapshot stamped = snapshot;
+    stamped.magic = WIBLE_RTC_SNAPSHOT_MAGIC;
+    stamped.version = WIBLE_RTC_SNAPSHOT_VERSION;
+    stamped.crc = crc32((const uint8_t*)&stamped, offsetof(RtcSnapshot, crc));
+    memcpy(rtcSnapshotImage, &stamped, sizeof(stamped));
+}
+
+void StorageManager::clearSnapshot() {
+    memset(rtcSnapshotImage, 0, sizeof(rtcSnapshotImage));
+}
+
+// ============================================================================
+// STATISTICS
+// ============================================================================
+
+StorageStatistics StorageManager::getStatistics() const {
+    StorageStatistics stats = statistics;
+    uint32_t uptimeSeconds = millis() / 1000;
+    if (uptimeSeconds < 3600) uptimeSeconds = 3600;
+    stats.flashWritesPerDay = (uint32_t)((uint64_t)statistics.flashWrites * 86400 / uptimeSeconds);
+    return stats;
+}
+
+} // namespace WiBLE
@@ -1,8 +1,235 @@
+/**
+ * StorageManager.h - Cached, write-coalescing persistence over NVS
+ *
+ * Everything WiBLE persists lives in a few fixed, versioned records in one
+ * NVS namespace, opened once. Records are read into RAM at begin() and
+ * served from there. Writes update the cache and mark the record dirty;
+ * unchanged data never reaches flash. Dirty records are committed together
+ * once they are commitDelayMs old, or on commit(), so provisioning costs
+ * one batch of flash writes instead of one per key.
+ */
+
 #ifndef STORAGE_MANAGER_H
 #define STORAGE_MANAGER_H
 
+#include <Arduino.h>
+#include <nvs.h>
+
 namespace WiBLE {
-class StorageManager {};
-}
 
+// ============================================================================
+// STORAGE LAYOUT
+// ============================================================================
+
+#define WIBLE_STORAGE_NAMESPACE      "wible"
+#define WIBLE_STORAGE_LEGACY_NAMESPACE "wible_creds"    // Preferences layout before records
+
+// Largest record payload
+#define WIBLE_STORAGE_RECORD_SIZE    104
+
+#ifndef WIBLE_STORAGE_COMMIT_DELAY_MS
+#define WIBLE_STORAGE_COMMIT_DELAY_MS 2000
 #endif
+
+// Known networks for roaming; one record each
+#define WIBLE_STORAGE_NETWORK_SLOTS  4
+
+/**
+ * Records are stored as [version (1)][length (1)][payload]. A record whose
+ * version differs from the one compiled in is ignored on load.
+ */
+enum class StorageRecord : uint8_t {
+    CREDENTIALS,        // StoredCredentials
+    CONNECTION_CACHE,   // WiFiConnectionCache
+    STATE,              // StoredState
+    NETWORK_0,          // StoredNetwork, one per slot
+    NETWORK_1,
+    NETWORK_2,
+    NETWORK_3,
+    COUNT
+};
+
+constexpr uint8_t WIBLE_STORAGE_RECORD_COUNT = static_cast<uint8_t>(StorageRecord::COUNT);
+
+inline StorageRecord networkRecord(uint8_t slot) {
+    return static_cast<StorageRecord>(static_cast<uint8_t>(StorageRecord::NETWORK_0) + slot);
+}
+
+struct StoredCredentials {
+    char ssid[33] = {0};
+    char password[65] = {0};
+    uint8_t hidden = 0;
+    uint8_t reserved = 0;
+};
+
+/**
+ * A roaming candidate and its connection history
+ */
+struct StoredNetwork {
+    char ssid[33] = {0};
+    char password[65] = {0};
+    uint8_t priority = 0;       // Higher is preferred
+    uint8_t successes = 0;      // Saturates at WIBLE_ROAM_HISTORY_CAP
+    uint8_t failureStreak = 0;  // Consecutive failed attempts
+    uint8_t reserved = 0;
+};
+
+struct StoredState {
+    uint8_t state = 0;          // ProvisioningState
+    uint8_t lastError = 0;      // ErrorCode
+    uint8_t retryCount = 0;
+    uint8_t reserved = 0;
+};
+
+// ============================================================================
+// RTC SNAPSHOT
+// ============================================================================
+
+#define WIBLE_RTC_SNAPSHOT_MAGIC     0x57425254  // "WBRT"
+#define WIBLE_RTC_SNAPSHOT_VERSION   1
+
+// WiFiConnectionCache carried as raw bytes
+#define WIBLE_RTC_CONNECTION_SIZE    60
+
+/**
+ * ProvisioningMetrics counters carried across deep-sleep cycles
+ */
+struct RtcCounters {
+    uint32_t wakeCount = 0;
+    uint32_t totalProvisioningAttempts = 0;
+    uint32_t successfulProvisionings = 0;
+    uint32_t failedProvisionings = 0;
+    uint32_t totalConnectionAttempts = 0;
+    uint32_t bleDisconnections = 0;
+    uint32_t wifiDisconnections = 0;
+};
+
+/**
+ * Resume point kept in RTC slow memory. It survives deep sleep and soft
+ * resets but not power loss; the CRC rejects an image left by another
+ * layout or never written.
+ */
+struct RtcSnapshot {
+    uint32_t magic = 0;
+    uint8_t version = 0;
+    uint8_t reserved[3] = {0};
+    StoredState state;
+    uint8_t connection[WIBLE_RTC_CONNECTION_SIZE] = {0};
+    RtcCounters counters;
+    uint32_t crc = 0;           // CRC-32 of everything before it
+};
+
+// ============================================================================
+// CONFIGURATION / STATISTICS
+// ============================================================================
+
+struct StorageConfig {
+    uint32_t commitDelayMs = WIBLE_STORAGE_COMMIT_DELAY_MS;    // 0: write through
+};
+
+struct StorageStatistics {
+    uint32_t reads = 0;                 // Served from the cache
+    uint32_t writes = 0;
+    uint32_t writesSkipped = 0;         // Unchanged data; no flash access
+    uint32_t commits = 0;
+    uint32_t flashWrites = 0;           // Records written or erased in NVS
+    uint32_t bytesWritten = 0;
+    uint32_t flashWritesPerDay = 0;     // Rate over this boot (at least one hour)
+    bool legacyMigrated = false;
+};
+
+// ============================================================================
+// STORAGE MANAGER
+// ============================================================================
+
+class StorageManager {
+public:
+    StorageManager();
+    ~StorageManager();
+
+    /**
+     * Open the namespace and load every record. Credentials saved by
+     * earlier releases are migrated once.
+     */
+    bool begin(const StorageConfig& config = StorageConfig());
+
+    /**
+     * Commit pending records and close the handle
+     */
+    void end();
+    bool isOpen() const { return open; }
+
+    /**
+     * Copy a record out of the cache
+     * @return false if absent or stored with a different size
+     */
+    bool read(StorageRecord record, void* out, size_t length);
+    bool exists(StorageRecord record) const;
+
+    /**
+     * Update a record in the cache; it reaches flash with the next commit
+     */
+    bool write(StorageRecord record, const void* data, size_t length);
+    void erase(StorageRecord record);
+
+    template<typename T>
+    bool read(StorageRecord record, T& out) { return read(record, &out, sizeof(T)); }
+    template<typename T>
+    bool write(StorageRecord record, const T& data) { return write(record, &data, sizeof(T)); }
+
+    /**
+     * Write every dirty record and commit once
+     */
+    bool commit();
+    bool isDirty() const;
+
+    /**
+     * Commit dirty records once they are commitDelayMs old
+     */
+    void loop();
+
+    /**
+     * Forget every record, in RAM and in flash
+     */
+    void eraseAll();
+
+    bool saveCredentials(const String& ssid, const String& password);
+    bool loadCredentials(String& ssid, String& password);
+
+    /**
+     * Copy the RTC snapshot out
+     * @return false if none was written since power-on, or its CRC fails
+     */
+    bool readSnapshot(RtcSnapshot& out) const;
+
+    /**
+     * Stamp magic, version and CRC, and store in RTC memory (no flash access)
+     */
+    void writeSnapshot(const RtcSnapshot& snapshot);
+    void clearSnapshot();
+
+    StorageStatistics getStatistics() const;
+
+private:
+    struct RecordSlot {
+        uint8_t data[WIBLE_STORAGE_RECORD_SIZE];
+        uint8_t length;
+        bool present;
+        bool dirty;
+    };
+
+    RecordSlot records[WIBLE_STORAGE_RECORD_COUNT];
+    StorageConfig config;
+    StorageStatistics statistics;
+    nvs_handle_t handle;
+    bool open;
+    uint32_t dirtySince;
+
+    void loadRecord(uint8_t index);
+    void migrateLegacy();
+    void markDirty(RecordSlot& slot);
+};
+
+} // namespace WiBLE
+
+#endif // STORAGE_MANAGER_H
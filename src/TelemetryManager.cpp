@@ -0,0 +1,298 @@
+/**
+ * TelemetryManager.cpp - Telemetry batching and encoding
+ */
+
+#include "TelemetryManager.h"
+#include "utils/LogManager.h"
+#include <math.h>
+
+namespace WiBLE {
+
+static_assert(WIBLE_TELEMETRY_MAX_SERIES <= 256, "Series IDs are one byte on the wire");
+static_assert(WIBLE_TELEMETRY_BATCH_MAX > WIBLE_TELEMETRY_HEADER_SIZE + 11,
+              "A batch must hold at least one sample");
+
+// Bytes per sample before encoding: timestamp, series, value
+#define WIBLE_TELEMETRY_RAW_SAMPLE   9
+
+// ============================================================================
+// VARINT ENCODING
+// ============================================================================
+
+static size_t putVarint(uint8_t* out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static bool getVarint(const uint8_t* data, size_t length, size_t& pos, uint32_t& value) {
+    value = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        if (pos >= length) return false;
+        uint8_t byte = data[pos++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Small deltas of either sign stay small
+static uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// ============================================================================
+// LIFECYCLE AND SERIES
+// ============================================================================
+
+TelemetryManager::TelemetryManager()
+    : batchSeq(0), flushRequested(false), lastSentAt(0), retryAt(0) {
+    for (Series& entry : series) {
+        entry.type = TelemetryValueType::UINT;
+        entry.resolution = 1.0f;
+        entry.defined = false;
+    }
+    for (Link& link : links) {
+        link.maxBatchBytes = WIBLE_TELEMETRY_BATCH_MAX;
+        link.up = false;
+        link.wasUp = false;
+    }
+}
+
+void TelemetryManager::initialize(const TelemetryConfig& cfg) {
+    config = cfg;
+    lastSentAt = millis();
+}
+
+bool TelemetryManager::defineSeries(uint8_t id, TelemetryValueType type, float resolution) {
+    if (id >= WIBLE_TELEMETRY_MAX_SERIES || !(resolution > 0.0f)) return false;
+    series[id].type = type;
+    series[id].resolution = resolution;
+    series[id].defined = true;
+    return true;
+}
+
+bool TelemetryManager::getSeriesType(uint8_t id, TelemetryValueType& type) const {
+    if (id >= WIBLE_TELEMETRY_MAX_SERIES || !series[id].defined) return false;
+    type = series[id].type;
+    return true;
+}
+
+// ============================================================================
+// RECORDING
+// ============================================================================
+
+bool TelemetryManager::record(uint8_t id, TelemetryValueType type, int32_t value) {
+    if (id >= WIBLE_TELEMETRY_MAX_SERIES || !series[id].defined || series[id].type != type) return false;
+
+    if (samples.full()) statistics.samplesDropped++;
+    TelemetrySample sample;
+    sample.timestampMs = millis();
+    sample.value = value;
+    sample.series = id;
+    samples.push(sample);
+    statistics.samplesRecorded++;
+    return true;
+}
+
+bool TelemetryManager::recordUInt(uint8_t id, uint32_t value) {
+    return record(id, TelemetryValueType::UINT, (int32_t)value);
+}
+
+bool TelemetryManager::recordInt(uint8_t id, int32_t value) {
+    return record(id, TelemetryValueType::INT, value);
+}
+
+bool TelemetryManager::recordFloat(uint8_t id, float value) {
+    if (id >= WIBLE_TELEMETRY_MAX_SERIES || isnan(value)) return false;
+    float steps = value / series[id].resolution;
+    if (steps > 2147483520.0f) steps = 2147483520.0f;      // Largest float below INT32_MAX
+    if (steps < -2147483648.0f) steps = -2147483648.0f;
+    return record(id, TelemetryValueType::FLOAT, (int32_t)lroundf(steps));
+}
+
+// ============================================================================
+// LINKS
+// ============================================================================
+
+void TelemetryManager::setSink(TelemetryTransport transport, TelemetrySink sink, size_t maxBatchBytes) {
+    Link& link = links[(size_t)transport];
+    link.sink = sink;
+    link.maxBatchBytes = maxBatchBytes;
+}
+
+void TelemetryManager::setLinkState(TelemetryTransport transport, bool up, size_t maxBatchBytes) {
+    Link& link = links[(size_t)transport];
+    link.up = up;
+    if (maxBatchBytes) link.maxBatchBytes = maxBatchBytes;
+}
+
+TelemetryManager::Link* TelemetryManager::activeLink() {
+    for (Link& link : links) {
+        if (link.sink && link.up) return &link;
+    }
+    return nullptr;
+}
+
+bool TelemetryManager::sendText(const uint8_t* text, size_t length) {
+    Link* link = activeLink();
+    size_t capacity = link && link->maxBatchBytes < sizeof(frame) ? link->maxBatchBytes : sizeof(frame);
+    if (!link || length + 1 > capacity) return false;
+
+    frame[0] = WIBLE_TELEMETRY_FRAME_TEXT;
+    memcpy(frame + 1, text, length);
+    return link->sink(frame, length + 1);
+}
+
+// ============================================================================
+// BATCHING
+// ============================================================================
+
+void TelemetryManager::loop() {
+    uint32_t now = millis();
+
+    // The backlog goes out in one burst when any link comes back
+    bool cameUp = false;
+    for (Link& link : links) {
+        if (link.sink && link.up && !link.wasUp) cameUp = true;
+        link.wasUp = link.up;
+    }
+    Link* link = activeLink();
+    if (!link) return;
+
+    if (cameUp && !samples.empty()) {
+        WIBLE_LOGI("Telemetry link up, sending %u queued samples", (unsigned)samples.size());
+        statistics.bursts++;
+        flushRequested = true;
+        retryAt = now;
+    }
+    if ((int32_t)(now - retryAt) < 0) return;
+
+    if (!samples.empty()) {
+        bool due = flushRequested || samples.size() >= config.maxBatchSamples ||
+                   now - samples.front().timestampMs >= config.batchIntervalMs;
+        if (due && sendBatches(*link)) flushRequested = false;
+        return;
+    }
+
+    flushRequested = false;
+    if (config.keepAliveIntervalS && now - lastSentAt >= config.keepAliveIntervalS * 1000UL) {
+        sendBatches(*link);
+    }
+}
+
+bool TelemetryManager::sendBatches(Link& link) {
+    // Everything waiting, in as few frames as the sink allows
+    do {
+        size_t consumed = 0;
+        size_t length = encodeBatch(link.maxBatchBytes, consumed);
+        if (consumed == 0 && !samples.empty()) return false;   // Payload limit below one sample
+
+        uint32_t now = millis();
+        if (!link.sink(frame, length)) {
+            statistics.sendFailures++;
+            retryAt = now + config.retryIntervalMs;
+            return false;
+        }
+
+        batchSeq++;
+        lastSentAt = now;
+        statistics.bytesSent += length;
+        if (consumed == 0) {
+            statistics.keepAlivesSent++;
+        } else {
+            statistics.batchesSent++;
+            statistics.samplesSent += consumed;
+            statistics.rawBytes += consumed * WIBLE_TELEMETRY_RAW_SAMPLE;
+            samples.discard(consumed);
+        }
+    } while (!samples.empty());
+    return true;
+}
+
+size_t TelemetryManager::encodeBatch(size_t capacity, size_t& consumed) {
+    if (capacity > sizeof(frame)) capacity = sizeof(frame);
+
+    uint32_t base = samples.empty() ? millis() : samples.front().timestampMs;
+    frame[0] = WIBLE_TELEMETRY_FRAME_BATCH;
+    frame[1] = batchSeq;
+    for (size_t i = 0; i < 4; i++) frame[2 + i] = (uint8_t)(base >> (8 * i));
+
+    // Deltas restart per batch so a lost batch does not break the next one
+    int32_t previous[WIBLE_TELEMETRY_MAX_SERIES];
+    bool seen[WIBLE_TELEMETRY_MAX_SERIES] = {};
+    uint32_t previousTime = base;
+    size_t length = WIBLE_TELEMETRY_HEADER_SIZE;
+    consumed = 0;
+
+    while (consumed < samples.size() && consumed < 0xFF) {
+        const TelemetrySample& sample = samples[consumed];
+        uint8_t entry[11];
+        size_t n = 0;
+        entry[n++] = sample.series;
+        n += putVarint(entry + n, sample.timestampMs - previousTime);
+        int32_t delta = seen[sample.series]
+            ? (int32_t)((uint32_t)sample.value - (uint32_t)previous[sample.series])
+            : sample.value;
+        n += putVarint(entry + n, zigzag(delta));
+        if (length + n > capacity) break;
+
+        memcpy(frame + length, entry, n);
+        length += n;
+        previous[sample.series] = sample.value;
+        seen[sample.series] = true;
+        previousTime = sample.timestampMs;
+        consumed++;
+    }
+    frame[6] = (uint8_t)consumed;
+    return length;
+}
+
+TelemetryStatistics TelemetryManager::getStatistics() const {
+    TelemetryStatistics snapshot = statistics;
+    snapshot.backlog = (uint16_t)samples.size();
+    return snapshot;
+}
+
+bool TelemetryManager::decodeBatch(const uint8_t* data, size_t length, TelemetrySample* out,
+                                   size_t capacity, size_t& count) {
+    count = 0;
+    if (length < WIBLE_TELEMETRY_HEADER_SIZE || data[0] != WIBLE_TELEMETRY_FRAME_BATCH) return false;
+
+    uint32_t time = data[2] | (data[3] << 8) | (data[4] << 16) | ((uint32_t)data[5] << 24);
+    size_t total = data[6];
+    if (total > capacity) return false;
+
+    int32_t previous[256];
+    bool seen[256] = {};
+    size_t pos = WIBLE_TELEMETRY_HEADER_SIZE;
+    for (size_t i = 0; i < total; i++) {
+        uint32_t step = 0;
+        uint32_t encoded = 0;
+        if (pos >= length) return false;
+        uint8_t id = data[pos++];
+        if (!getVarint(data, length, pos, step) || !getVarint(data, length, pos, encoded)) return false;
+
+        time += step;
+        int32_t delta = unzigzag(encoded);
+        int32_t value = seen[id] ? (int32_t)((uint32_t)previous[id] + (uint32_t)delta) : delta;
+        previous[id] = value;
+        seen[id] = true;
+
+        out[i].timestampMs = time;
+        out[i].value = value;
+        out[i].series = id;
+    }
+    count = total;
+    return pos == length;
+}
+
+} // namespace WiBLE
@@ -0,0 +1,193 @@
+/**
+ * TelemetryManager.h - Batched, delta-encoded sensor telemetry
+ *
+ * Samples of up to WIBLE_TELEMETRY_MAX_SERIES typed series are queued in a
+ * fixed ring and sent as batches: when the oldest sample is batchIntervalMs
+ * old, when maxBatchSamples are waiting, or all at once when a link comes
+ * back. A batch holds as many samples as fit in one payload of the sink,
+ * each as a series ID, a varint time step and a zigzag varint delta from
+ * the previous value of its series, so a slowly changing reading costs
+ * about three bytes instead of nine.
+ *
+ * Batch frame:
+ *   [0xB1][seq][first timestamp ms u32 LE][count]
+ *   {[series id][ms since previous sample, varint][zigzag delta, varint]}...
+ * Deltas restart in every batch, so each batch decodes on its own. Float
+ * series are sent as integer multiples of their resolution. A batch with
+ * no samples is a keep-alive.
+ *
+ * Not synchronized; record and loop from the same task.
+ */
+
+#ifndef WIBLE_TELEMETRY_MANAGER_H
+#define WIBLE_TELEMETRY_MANAGER_H
+
+#include <Arduino.h>
+#include <functional>
+#include "utils/RingBuffer.h"
+
+namespace WiBLE {
+
+// ============================================================================
+// TELEMETRY LIMITS
+// ============================================================================
+
+#ifndef WIBLE_TELEMETRY_BUFFER_SIZE
+#define WIBLE_TELEMETRY_BUFFER_SIZE  256    // Samples held while no link is up
+#endif
+
+#ifndef WIBLE_TELEMETRY_MAX_SERIES
+#define WIBLE_TELEMETRY_MAX_SERIES   16
+#endif
+
+// Largest batch for any sink; BLE batches are also bound by the MTU
+#ifndef WIBLE_TELEMETRY_BATCH_MAX
+#define WIBLE_TELEMETRY_BATCH_MAX    512
+#endif
+
+#define WIBLE_TELEMETRY_FRAME_BATCH  0xB1
+#define WIBLE_TELEMETRY_FRAME_TEXT   0xB2
+#define WIBLE_TELEMETRY_HEADER_SIZE  7
+
+enum class TelemetryValueType : uint8_t {
+    UINT = 0,
+    INT = 1,
+    FLOAT = 2               // Quantized to the series resolution
+};
+
+/**
+ * Batches go to the first transport whose link is up, WiFi before BLE
+ */
+enum class TelemetryTransport : uint8_t {
+    WIFI = 0,               // Application sink (MQTT publish, HTTP POST, ...)
+    BLE = 1,                // Notification on the data characteristic
+    COUNT = 2
+};
+
+// ============================================================================
+// SAMPLES, CONFIGURATION AND STATISTICS
+// ============================================================================
+
+struct TelemetrySample {
+    uint32_t timestampMs = 0;
+    int32_t value = 0;                  // UINT series: the bits of the uint32_t
+    uint8_t series = 0;
+};
+
+struct TelemetryConfig {
+    uint32_t batchIntervalMs = 5000;    // Oldest sample waits at most this long
+    uint16_t maxBatchSamples = 32;      // Send early once this many are waiting
+    uint16_t keepAliveIntervalS = 60;   // Empty batch after this long without one (0 = off)
+    uint32_t retryIntervalMs = 1000;    // After a sink refused a batch
+};
+
+struct TelemetryStatistics {
+    uint32_t samplesRecorded = 0;
+    uint32_t samplesDropped = 0;        // Overwritten in the ring before they were sent
+    uint32_t samplesSent = 0;
+    uint32_t batchesSent = 0;
+    uint32_t keepAlivesSent = 0;
+    uint32_t bytesSent = 0;
+    uint32_t rawBytes = 0;              // The same samples unencoded, 9 bytes each
+    uint32_t sendFailures = 0;
+    uint32_t bursts = 0;                // Backlog flushes after a link came back
+    uint16_t backlog = 0;               // Samples waiting
+};
+
+/**
+ * Sends one frame; false keeps the samples queued for a retry
+ */
+using TelemetrySink = std::function<bool(const uint8_t* frame, size_t length)>;
+
+// ============================================================================
+// TELEMETRY MANAGER
+// ============================================================================
+
+class TelemetryManager {
+public:
+    TelemetryManager();
+
+    void initialize(const TelemetryConfig& config);
+
+    /**
+     * Declare a series before recording into it
+     * @param resolution FLOAT series: value of one step on the wire
+     */
+    bool defineSeries(uint8_t id, TelemetryValueType type, float resolution = 1.0f);
+    bool getSeriesType(uint8_t id, TelemetryValueType& type) const;
+
+    /**
+     * Queue a sample, timestamped now; false if the series is unknown or
+     * of another type. A full ring drops its oldest sample.
+     */
+    bool recordUInt(uint8_t id, uint32_t value);
+    bool recordInt(uint8_t id, int32_t value);
+    bool recordFloat(uint8_t id, float value);
+
+    /**
+     * Send a text record right away, outside any batch
+     */
+    bool sendText(const uint8_t* text, size_t length);
+
+    void setSink(TelemetryTransport transport, TelemetrySink sink, size_t maxBatchBytes);
+
+    /**
+     * Report a transport's link state (and payload limit, 0 keeps it);
+     * a link coming up flushes the backlog on the next loop()
+     */
+    void setLinkState(TelemetryTransport transport, bool up, size_t maxBatchBytes = 0);
+
+    /**
+     * Send every queued sample on the next loop()
+     */
+    void flush() { flushRequested = true; }
+
+    /**
+     * Send due batches and keep-alives; call from loop()
+     */
+    void loop();
+
+    TelemetryStatistics getStatistics() const;
+
+    /**
+     * Decode a batch frame; values are raw (scale FLOAT series by their resolution)
+     * @return false if the frame is malformed or has more than capacity samples
+     */
+    static bool decodeBatch(const uint8_t* frame, size_t length, TelemetrySample* samples,
+                            size_t capacity, size_t& count);
+
+private:
+    struct Series {
+        TelemetryValueType type;
+        float resolution;
+        bool defined;
+    };
+
+    struct Link {
+        TelemetrySink sink;
+        size_t maxBatchBytes;
+        bool up;
+        bool wasUp;
+    };
+
+    TelemetryConfig config;
+    Series series[WIBLE_TELEMETRY_MAX_SERIES];
+    Link links[(size_t)TelemetryTransport::COUNT];
+    RingBuffer<TelemetrySample, WIBLE_TELEMETRY_BUFFER_SIZE> samples;
+    TelemetryStatistics statistics;
+
+    uint8_t batchSeq;
+    bool flushRequested;
+    uint32_t lastSentAt;
+    uint32_t retryAt;
+    uint8_t frame[WIBLE_TELEMETRY_BATCH_MAX];
+
+    bool record(uint8_t id, TelemetryValueType type, int32_t value);
+    Link* activeLink();
+    bool sendBatches(Link& link);
+    size_t encodeBatch(size_t capacity, size_t& consumed);
+};
+
+} // namespace WiBLE
+
+#endif // WIBLE_TELEMETRY_MANAGER_H
@@ -9,20 +9,42 @@
 #include "StateManager.h"
 #include "ProvisioningOrchestrator.h"
 #include "utils/LogManager.h"
+#include <math.h>
 
 namespace WiBLE {
 
+const char* errorCodeToString(ErrorCode code) {
+    switch (code) {
+        case ErrorCode::NONE: return "No error";
+        case ErrorCode::BLE_INIT_FAILED: return "BLE init failed";
+        case ErrorCode::BLE_CONNECTION_LOST: return "BLE connection lost";
+        case ErrorCode::WIFI_INIT_FAILED: return "WiFi init failed";
+        case ErrorCode::WIFI_CONNECTION_FAILED: return "WiFi connection failed";
+        case ErrorCode::WIFI_CREDENTIALS_INVALID: return "Invalid WiFi credentials";
+        case ErrorCode::AUTHENTICATION_FAILED: return "Authentication failed";
+        case ErrorCode::ENCRYPTION_FAILED: return "Encryption failed";
+        case ErrorCode::STORAGE_FAILED: return "Storage failed";
+        case ErrorCode::TIMEOUT_ERROR: return "Timeout";
+        default: return "Unknown error";
+    }
+}
+
 // ============================================================================
 // CONSTRUCTOR & DESTRUCTOR
 // ============================================================================
 
-WiBLE::WiBLE() : initialized(false), startTime(0) {
+WiBLE::WiBLE()
+    : initialized(false), startTime(0), bleReady(false), bleReleased(false), onlineRecorded(false),
+      resumed(false), teardownAt(0), metricsSampledAt(0), stateEnteredAt(0),
+      attemptInProgress(false), provisioningStartedAt(0), connectionStartedAt(0), attemptStateDurationMs(),
+      telemetrySet(WIBLE_NO_ADV_SET), telemetryCompanyId(0xFFFF) {
     // Initialize PIMPL pointers
     // Note: In a full implementation, we would initialize all managers here.
     // For Phase 1, we focus on StateManager.
     stateManager = std::unique_ptr<StateManager>(new StateManager());
     
     // Initialize Managers
+    storageManager = std::unique_ptr<StorageManager>(new StorageManager());
     bleManager = std::unique_ptr<BLEManager>(new BLEManager());
     wifiManager = std::unique_ptr<WiFiManager>(new WiFiManager());
     securityManager = std::unique_ptr<SecurityManager>(new SecurityManager());
@@ -36,6 +58,11 @@ WiBLE::WiBLE() : initialized(false), startTime(0) {
             securityManager.get()
         )
     );
+    
+    // Every user callback is reached through the event bus
+    eventBus = std::unique_ptr<EventBus>(new EventBus());
+    eventBus->subscribe(WIBLE_EVENT_ALL, &WiBLE::deliverCallbacks, this, "WiBLE callback");
+    orchestrator->setEventBus(eventBus.get());
 }
 
 WiBLE::~WiBLE() {
@@ -46,13 +73,27 @@ WiBLE::~WiBLE() {
 // LIFECYCLE MANAGEMENT
 // ============================================================================
 
+static_assert(sizeof(WiFiConnectionCache) == WIBLE_RTC_CONNECTION_SIZE, "RTC snapshot must hold the connection cache");
+
 bool WiBLE::begin(const ProvisioningConfig& config) {
     this->config = config;
+    uint32_t beginAt = micros();
     
     // Initialize Logging
-    if (config.enableSerialLog) {
-        // Serial.begin(115200); // User usually does this in setup()
-        LogManager::info("WiBLE initializing...");
+    LogManager::setLevel(config.enableSerialLog ? config.logLevel : LogLevel::NONE);
+    if (config.enableAsyncLog) {
+        LogManager::startAsync(config.asyncLogPriority);
+    }
+    // Serial.begin(115200); // User usually does this in setup()
+    LogManager::info("WiBLE initializing...");
+    eventBus->setDelivery(config.eventDelivery);
+    eventBus->setSlowListenerThreshold(config.slowListenerUs);
+    
+    // One NVS handle and record cache shared by every manager
+    if (storageManager && storageManager->begin()) {
+        if (stateManager) stateManager->setStorage(storageManager.get());
+        if (wifiManager) wifiManager->setStorage(storageManager.get());
+        if (securityManager) securityManager->setStorage(storageManager.get());
     }
     
     // Initialize State Manager
@@ -61,26 +102,43 @@ bool WiBLE::begin(const ProvisioningConfig& config) {
         
         // Register internal state callbacks
         stateManager->onStateTransition([this](ProvisioningState from, ProvisioningState to, StateEvent event) {
-            handleStateTransition(to);
+            if (event == StateEvent::BLE_CLIENT_DISCONNECTED) metrics.bleDisconnections++;
+            if (event == StateEvent::WIFI_DISCONNECTED) metrics.wifiDisconnections++;
+            if ((event == StateEvent::AUTH_FAILED || event == StateEvent::AUTH_TIMEOUT) && bleManager) {
+                bleManager->disconnectAll();
+            }
+            handleStateTransition(from, to);
         });
+        stateManager->setStateTimeout(ProvisioningState::AUTHENTICATING, config.authTimeoutMs);
     }
     
-    // Initialize other components
-    if (bleManager) {
-        BLEConfig bleConfig;
-        bleConfig.deviceName = config.deviceName;
-        bleConfig.mtuSize = config.mtuSize;
-        bleConfig.connectionInterval = config.connectionInterval;
-        bleConfig.enableBonding = config.enableBonding;
-        bleManager->initialize(bleConfig);
+    // Deep-sleep wake: pick up where the last cycle stopped instead of a cold start
+    RtcSnapshot snapshot;
+    resumed = false;
+    if (storageManager && storageManager->readSnapshot(snapshot)) {
+        if (stateManager && wifiManager && wifiManager->hasStoredCredentials() && stateManager->resumeState()) {
+            resumed = true;
+            metrics.deepSleepWakes = snapshot.counters.wakeCount + 1;
+            metrics.totalProvisioningAttempts = snapshot.counters.totalProvisioningAttempts;
+            metrics.successfulProvisionings = snapshot.counters.successfulProvisionings;
+            metrics.failedProvisionings = snapshot.counters.failedProvisionings;
+            metrics.totalConnectionAttempts = snapshot.counters.totalConnectionAttempts;
+            metrics.bleDisconnections = snapshot.counters.bleDisconnections;
+            metrics.wifiDisconnections = snapshot.counters.wifiDisconnections;
+        } else {
+            // Credentials were cleared since: the snapshot no longer applies
+            storageManager->clearSnapshot();
+        }
     }
     
-    if (securityManager) {
-        SecurityConfig secConfig;
-        secConfig.level = config.securityLevel;
-        secConfig.pinCode = config.pinCode;
-        secConfig.authTimeoutMs = config.authTimeoutMs;
-        securityManager->initialize(secConfig);
+    // Already provisioned and lazy: BLE only comes up if rejoining fails
+    bool resumedOnline = resumed && stateManager->getCurrentState() == ProvisioningState::PROVISIONED;
+    bool deferBLE = (config.lazyStartup || resumedOnline) && config.autoReconnect && config.persistCredentials &&
+                    wifiManager && wifiManager->hasStoredCredentials();
+    if (deferBLE) {
+        LogManager::info("Stored credentials found, deferring BLE bring-up");
+    } else {
+        bringUpBLE();
     }
     
     if (wifiManager) {
@@ -90,12 +148,97 @@ bool WiBLE::begin(const ProvisioningConfig& config) {
         wifiConfig.retryDelayMs = config.wifiRetryDelayMs;
         wifiConfig.autoReconnect = config.autoReconnect;
         wifiConfig.persistCredentials = config.persistCredentials;
+        wifiConfig.enableRoaming = config.enableWiFiRoaming;
         wifiManager->initialize(wifiConfig);
+        if (resumed) {
+            WiFiConnectionCache cache;
+            memcpy(&cache, snapshot.connection, sizeof(cache));
+            wifiManager->setConnectionCache(cache);
+        }
+    }
+    if (orchestrator) {
+        orchestrator->initialize();
+        orchestrator->setValidation(config.validateConnectivity, config.validation);
+        orchestrator->setGroupSecret(config.group.fleetSecret);
+        orchestrator->onCustomField([this](const ::String& key, const ::String& value) {
+            customData[key] = value;
+        });
+        orchestrator->setMetricsProvider([this](uint8_t* out, size_t capacity) {
+            return encodeControlMetrics(out, capacity);
+        });
+    }
+    if (config.enableOTA) enableOTA();
+    if (config.enableTelemetry) {
+        TelemetryConfig telemetryConfig = config.telemetry;
+        telemetryConfig.keepAliveIntervalS = config.keepAliveIntervalS;
+        telemetryManager = std::unique_ptr<TelemetryManager>(new TelemetryManager());
+        telemetryManager->initialize(telemetryConfig);
+        telemetryManager->setSink(TelemetryTransport::BLE, [this](const uint8_t* frame, size_t length) {
+            return bleManager->enqueueNotify(WIBLE_DATA_CHARACTERISTIC, frame, length, GATTPriority::BULK);
+        }, WIBLE_GATT_OP_MAX_DATA);
+    }
+    
+    // Route WiFi results (reported asynchronously from WiFiManager::monitor)
+    if (wifiManager) {
+        wifiManager->onConnected([this](const ConnectionInfo& info) {
+            if (!onlineRecorded) {
+                onlineRecorded = true;
+                metrics.bootToOnlineMs = millis() - startTime;
+                WIBLE_LOGI("Online %u ms after boot (BLE %s)", (unsigned)metrics.bootToOnlineMs,
+                           bleReady ? "up" : "deferred");
+            }
+            Metrics::increment(MetricCounter::WIFI_CONNECTIONS);
+            if (orchestrator) orchestrator->onWiFiConnected(info);
+            IPAddress address;
+            address.fromString(info.ipAddress);
+            publishEvent(EventType::WIFI_CONNECTED, 0, 0, info.ssid.c_str(), (uint32_t)address);
+        });
+        
+        wifiManager->onDisconnected([this](WiFiDisconnectReason reason, const char* message) {
+            // Deferred by lazyStartup and the stored network is out of reach
+            if (!bleReady && !bleReleased &&
+                wifiManager->getConnectionState() == WiFiConnectionState::CONNECTION_FAILED) {
+                LogManager::warn("Stored network unreachable, starting BLE provisioning");
+                // Resumed as PROVISIONED; provisioning starts again from IDLE
+                if (stateManager && stateManager->getCurrentState() == ProvisioningState::PROVISIONED) {
+                    stateManager->handleEvent(StateEvent::RESET_REQUESTED);
+                }
+                startProvisioning();
+            }
+            Metrics::increment(MetricCounter::WIFI_DISCONNECTIONS);
+            if (orchestrator) orchestrator->onWiFiDisconnected(reason);
+            publishEvent(EventType::WIFI_DISCONNECTED, (uint8_t)reason, 0, message);
+        });
+        
+        wifiManager->onConnectionProgress([this](uint8_t progress, const char* status) {
+            if (orchestrator) orchestrator->onWiFiProgress(progress);
+            publishEvent(EventType::WIFI_PROGRESS, progress, 0, status);
+        });
+        
+        wifiManager->onScanProgress([this](const WiFiScanEntry* updated, size_t count,
+                                           uint8_t progress, bool complete) {
+            if (orchestrator) orchestrator->onWiFiScanProgress(updated, count, progress, complete);
+        });
+        
+        wifiManager->onValidationComplete([this](const ValidationResult& result) {
+            if (orchestrator) orchestrator->onValidationComplete(result);
+        });
     }
-    if (orchestrator) orchestrator->initialize();
     
     initialized = true;
     startTime = millis();
+    stateEnteredAt = startTime;
+    if (resumed) {
+        metrics.resumeTimeUs = micros() - beginAt;
+        WIBLE_LOGI("Resumed from RTC snapshot (wake %u, state %s) in %u us", (unsigned)metrics.deepSleepWakes,
+                   stateManager->getCurrentStateName().c_str(), (unsigned)metrics.resumeTimeUs);
+    }
+    
+    // Already provisioned: rejoin right away, directed to the cached AP
+    if (wifiManager && config.autoReconnect && config.persistCredentials &&
+        wifiManager->hasStoredCredentials()) {
+        wifiManager->connectWithStoredCredentials();
+    }
     
     LogManager::info("WiBLE initialized successfully");
     return true;
@@ -103,23 +246,149 @@ bool WiBLE::begin(const ProvisioningConfig& config) {
 
 void WiBLE::loop() {
     if (!initialized) return;
+    WIBLE_METRIC_TIMER(MetricHistogram::LOOP_US);
     
     // 1. Update State Machine
     if (stateManager) {
         stateManager->checkTimeouts();
     }
     
-    // 2. Process BLE Operations
-    if (bleManager) bleManager->processOperationQueue();
+    // 2. Process BLE Operations and chunked transfers
+    if (bleManager) bleManager->loop();
     
     // 3. Monitor WiFi
     if (wifiManager) wifiManager->monitor();
+    
+    // 4. Flush coalesced storage writes
+    if (storageManager) storageManager->loop();
+    
+    // 5. Verify, report and reboot BLE firmware updates
+    if (otaManager) otaManager->loop();
+    
+    // 6. Client commands handed over by the BLE write worker, and a
+    //    REBOOT requested on the control characteristic
+    if (orchestrator) orchestrator->loop();
+    
+    // 7. Telemetry batches over whichever link is up
+    if (telemetryManager) {
+        bool bleLink = bleReady && bleManager->getConnectionCount() > 0;
+        telemetryManager->setLinkState(TelemetryTransport::BLE, bleLink,
+                                       bleLink ? bleManager->getMaxPayloadSize() : 0);
+        telemetryManager->setLinkState(TelemetryTransport::WIFI, wifiManager && wifiManager->isConnected());
+        telemetryManager->loop();
+    }
+    
+    // 8. Group provisioning links; the scan stops once nothing is left
+    if (groupProvisioner && groupProvisioner->isActive()) {
+        groupProvisioner->loop();
+        if (groupProvisioner->isIdle()) stopGroupProvisioning();
+    }
+    
+    // 9. BLE teardown scheduled by PROVISIONED, held off by a firmware
+    //    update or group provisioning
+    if (teardownAt != 0 && (int32_t)(millis() - teardownAt) >= 0) {
+        if ((otaManager && otaManager->isActive()) || isGroupProvisioning()) {
+            teardownAt = millis() + WIBLE_BLE_TEARDOWN_DELAY_MS;
+        } else {
+            teardownAt = 0;
+            tearDownBLE(config.bleAfterProvisioning == BLETeardown::RELEASE_MEMORY);
+        }
+    }
+    
+    // 10. Callbacks queued by the BLE and WiFi tasks (EventDelivery::LOOP)
+    eventBus->dispatch();
+    
+    // 11. Heap and queue depth gauges
+    if (millis() - metricsSampledAt >= WIBLE_METRICS_SAMPLE_MS) {
+        metricsSampledAt = millis();
+        sampleMetrics();
+    }
+}
+
+void WiBLE::sampleMetrics() {
+    Metrics::sampleHeap();
+    Metrics::setGauge(MetricGauge::EVENT_QUEUE_DEPTH, eventBus->getStatistics().queued);
+    if (bleReady && bleManager) {
+        Metrics::setGauge(MetricGauge::GATT_QUEUE_DEPTH, (uint32_t)bleManager->getQueueSize());
+        Metrics::setGauge(MetricGauge::WRITE_QUEUE_DEPTH, (uint32_t)bleManager->getWriteQueueDepth());
+        Metrics::setGauge(MetricGauge::BLE_CONNECTIONS, bleManager->getConnectionCount());
+    } else {
+        Metrics::setGauge(MetricGauge::GATT_QUEUE_DEPTH, 0);
+        Metrics::setGauge(MetricGauge::WRITE_QUEUE_DEPTH, 0);
+        Metrics::setGauge(MetricGauge::BLE_CONNECTIONS, 0);
+    }
+    if (telemetryManager) {
+        Metrics::setGauge(MetricGauge::TELEMETRY_BACKLOG, telemetryManager->getStatistics().backlog);
+    }
+}
+
+bool WiBLE::bringUpBLE() {
+    if (bleReady) return true;
+    if (bleReleased) {
+        LogManager::error("BLE controller memory was released; restart to provision again");
+        return false;
+    }
+    
+    size_t heapBefore = ESP.getFreeHeap();
+    bool ok = true;
+    if (bleManager) {
+        BLEConfig bleConfig;
+        bleConfig.deviceName = config.deviceName;
+        bleConfig.mtuSize = config.mtuSize;
+        bleConfig.connectionInterval = config.connectionInterval;
+        bleConfig.slaveLatency = config.slaveLatency;
+        bleConfig.supervisionTimeout = config.supervisionTimeout;
+        bleConfig.connectionTuning.enabled = config.enableConnectionTuning;
+        bleConfig.enableBonding = config.enableBonding;
+        bleConfig.maxConnections = config.maxSimultaneousConnections;
+        bleConfig.enableConnectionQueue = config.enableConnectionQueue;
+        bleConfig.scanConfig.intervalMs = config.bleScanIntervalMs;
+        bleConfig.scanConfig.windowMs = config.bleScanWindowMs;
+        bleConfig.enableDiagnostics = config.enableDiagnostics;
+        ok = bleManager->initialize(bleConfig);
+    }
+    
+    if (securityManager) {
+        SecurityConfig secConfig;
+        secConfig.level = config.securityLevel;
+        secConfig.pinCode = config.pinCode;
+        secConfig.authTimeoutMs = config.authTimeoutMs;
+        secConfig.enableBonding = config.enableBonding;
+        secConfig.keyPoolSize = config.keyPoolSize;
+        secConfig.enableResumption = config.enableSessionResumption;
+        securityManager->initialize(secConfig);
+    }
+    
+    size_t heapAfter = ESP.getFreeHeap();
+    metrics.bleHeapBytes = heapBefore > heapAfter ? heapBefore - heapAfter : 0;
+    bleReady = true;
+    WIBLE_LOGI("BLE up, %u bytes of heap", (unsigned)metrics.bleHeapBytes);
+    return ok;
+}
+
+void WiBLE::tearDownBLE(bool releaseMemory) {
+    if (!bleReady) return;
+    
+    stopGroupProvisioning();
+    size_t heapBefore = ESP.getFreeHeap();
+    if (securityManager) securityManager->cleanup();
+    if (bleManager) bleManager->deinitialize(releaseMemory);
+    size_t heapAfter = ESP.getFreeHeap();
+    
+    metrics.bleHeapReleasedBytes = heapAfter > heapBefore ? heapAfter - heapBefore : 0;
+    bleReady = false;
+    bleReleased = releaseMemory;
+    WIBLE_LOGI("BLE torn down, %u bytes of heap released", (unsigned)metrics.bleHeapReleasedBytes);
 }
 
 void WiBLE::end() {
     initialized = false;
     // Cleanup resources
+    if (otaManager) otaManager->abort();
+    if (securityManager) securityManager->stopKeyPool();
+    if (storageManager) storageManager->commit();
     LogManager::info("WiBLE stopped");
+    LogManager::stopAsync();
 }
 
 // ============================================================================
@@ -131,7 +400,8 @@ ProvisioningState WiBLE::getState() const {
 }
 
 bool WiBLE::isProvisioned() const {
-    return getState() == ProvisioningState::PROVISIONED;
+    return getState() == ProvisioningState::PROVISIONED ||
+           (wifiManager && wifiManager->hasStoredCredentials());
 }
 
 bool WiBLE::isBLEConnected() const {
@@ -140,6 +410,10 @@ bool WiBLE::isBLEConnected() const {
            getState() == ProvisioningState::RECEIVING_CREDENTIALS;
 }
 
+bool WiBLE::isBLEActive() const {
+    return bleReady;
+}
+
 bool WiBLE::isWiFiConnected() const {
     return wifiManager && wifiManager->isConnected();
 }
@@ -150,6 +424,8 @@ bool WiBLE::isWiFiConnected() const {
 
 bool WiBLE::startProvisioning() {
     if (!initialized) return false;
+    teardownAt = 0;
+    if (!bringUpBLE()) return false;
     
     LogManager::info("Starting provisioning...");
     
@@ -161,6 +437,14 @@ bool WiBLE::startProvisioning() {
     return false;
 }
 
+void WiBLE::shutdownBLE(bool releaseMemory) {
+    teardownAt = 0;
+    if (stateManager && stateManager->getCurrentState() == ProvisioningState::BLE_ADVERTISING) {
+        stateManager->handleEvent(StateEvent::STOP_ADVERTISING);
+    }
+    tearDownBLE(releaseMemory);
+}
+
 void WiBLE::stopProvisioning() {
     if (stateManager) {
         stateManager->handleEvent(StateEvent::STOP_ADVERTISING);
@@ -185,10 +469,41 @@ Result<bool> WiBLE::provisionManually(const WiFiCredentials& credentials) {
 void WiBLE::clearProvisioning() {
     if (wifiManager) {
         wifiManager->clearCredentials();
+        wifiManager->clearNetworks();
     }
     if (stateManager) {
         stateManager->reset();
     }
+    if (storageManager) {
+        storageManager->erase(StorageRecord::STATE);
+        storageManager->clearSnapshot();
+        storageManager->commit();
+    }
+}
+
+void WiBLE::prepareForSleep() {
+    if (!storageManager) return;
+    if (stateManager) stateManager->saveState();
+    
+    RtcSnapshot snapshot;
+    storageManager->readSnapshot(snapshot);
+    if (wifiManager) {
+        const WiFiConnectionCache& cache = wifiManager->getConnectionCache();
+        memcpy(snapshot.connection, &cache, sizeof(cache));
+    }
+    snapshot.counters.wakeCount = metrics.deepSleepWakes;
+    snapshot.counters.totalProvisioningAttempts = metrics.totalProvisioningAttempts;
+    snapshot.counters.successfulProvisionings = metrics.successfulProvisionings;
+    snapshot.counters.failedProvisionings = metrics.failedProvisionings;
+    snapshot.counters.totalConnectionAttempts = metrics.totalConnectionAttempts;
+    snapshot.counters.bleDisconnections = metrics.bleDisconnections;
+    snapshot.counters.wifiDisconnections = metrics.wifiDisconnections;
+    storageManager->writeSnapshot(snapshot);
+    storageManager->commit();
+}
+
+bool WiBLE::isResumedFromSleep() const {
+    return resumed;
 }
 
 // ============================================================================
@@ -240,67 +555,321 @@ void WiBLE::onDataReceived(DataReceivedCallback callback) {
 }
 
 void WiBLE::scanForDevices(uint32_t duration, std::function<void(const String&, int, const String&)> callback) {
-    if (bleManager) {
+    if (bleManager && bringUpBLE()) {
         bleManager->setScanCallback(callback);
         bleManager->startScanning(duration);
     }
 }
 
-void WiBLE::startBeaconMode(String uuid, uint16_t major, uint16_t minor) {
+bool WiBLE::startGatewayScan(const ScanConfig& scanConfig, ScanBatchCallback callback) {
+    if (!bleManager || !bringUpBLE()) return false;
+    bleManager->onScanBatch(callback);
+    return bleManager->startScanning(scanConfig);
+}
+
+void WiBLE::stopGatewayScan() {
+    if (bleManager) {
+        bleManager->stopScanning();
+    }
+}
+
+ScanStatistics WiBLE::getScanStatistics() const {
+    return bleManager ? bleManager->getScanStatistics() : ScanStatistics();
+}
+
+bool WiBLE::startGroupProvisioning() {
+    if (isGroupProvisioning()) return true;
+    if (!bleManager || !bringUpBLE()) return false;
+    if (bleManager->isScanning()) {
+        WIBLE_LOGW("Group provisioning needs the scanner; stop the gateway scan first");
+        return false;
+    }
+    
+    if (!groupProvisioner) {
+        groupProvisioner = std::unique_ptr<GroupProvisioner>(new GroupProvisioner());
+        groupProvisioner->onProgress([this](const GroupPeer& peer) {
+            if (groupProgressCallback) groupProgressCallback(peer);
+        });
+    }
+    if (!groupProvisioner->start(config.group, getStoredCredentials())) return false;
+    
+    // Passive is enough: the status byte rides in the advertisement itself
+    ScanConfig scanConfig;
+    scanConfig.intervalMs = config.bleScanIntervalMs;
+    scanConfig.windowMs = config.bleScanWindowMs;
+    scanConfig.batchIntervalMs = config.group.scanBatchMs;
+    scanConfig.filter = GroupProvisioner::candidateFilter(config.group);
+    bleManager->onScanBatch([this](const ScanEntry* entries, size_t count) {
+        if (groupProvisioner) groupProvisioner->addCandidates(entries, count);
+    });
+    if (!bleManager->startScanning(scanConfig)) {
+        groupProvisioner->stop();
+        return false;
+    }
+    return true;
+}
+
+void WiBLE::stopGroupProvisioning() {
+    if (!isGroupProvisioning()) return;
     if (bleManager) {
+        bleManager->stopScanning();
+        bleManager->onScanBatch(nullptr);
+    }
+    groupProvisioner->stop();
+}
+
+bool WiBLE::isGroupProvisioning() const {
+    return groupProvisioner && groupProvisioner->isActive();
+}
+
+void WiBLE::onGroupProgress(GroupProgressCallback callback) {
+    groupProgressCallback = callback;
+}
+
+GroupStatistics WiBLE::getGroupStatistics() const {
+    return groupProvisioner ? groupProvisioner->getStatistics() : GroupStatistics();
+}
+
+void WiBLE::startBeaconMode(String uuid, uint16_t major, uint16_t minor) {
+    if (bleManager && bringUpBLE()) {
         // Default RSSI at 1m is -59dBm
         bleManager->startBeacon(uuid, major, minor, -59);
     }
 }
 
 void WiBLE::startBroadcasting(uint16_t manufacturerId, const uint8_t* data, size_t length) {
-    if (bleManager) {
+    if (bleManager && bringUpBLE()) {
         bleManager->startBroadcasting(manufacturerId, data, length);
     }
 }
 
+bool WiBLE::updateBroadcast(const uint8_t* data, size_t length, size_t offset) {
+    return bleManager && bleManager->updateBroadcast(data, length, offset);
+}
+
+bool WiBLE::startMultiAdvertising(const MultiAdvertisingConfig& multiConfig,
+                                  const uint8_t* telemetry, size_t telemetryLength) {
+    if (!bleManager || !bringUpBLE() || !bleManager->isInitialized()) return false;
+    stopMultiAdvertising();
+    
+    if (multiConfig.provisioning &&
+        bleManager->addProvisioningSet(multiConfig.provisioningParams) == WIBLE_NO_ADV_SET) {
+        return false;
+    }
+    if (multiConfig.beacon &&
+        bleManager->addBeaconSet(multiConfig.beaconUUID, multiConfig.beaconMajor, multiConfig.beaconMinor,
+                                 multiConfig.beaconRSSIAt1m, multiConfig.beaconParams) == WIBLE_NO_ADV_SET) {
+        return false;
+    }
+    if (multiConfig.telemetry) {
+        telemetryCompanyId = multiConfig.telemetryCompanyId;
+        telemetrySet = bleManager->addBroadcastSet(telemetryCompanyId, telemetry, telemetryLength,
+                                                   multiConfig.telemetryParams);
+        if (telemetrySet == WIBLE_NO_ADV_SET) return false;
+    }
+    return bleManager->startAdvertisingSets();
+}
+
+bool WiBLE::updateTelemetry(const uint8_t* data, size_t length) {
+    if (!bleManager || telemetrySet == WIBLE_NO_ADV_SET) return false;
+    return bleManager->updateBroadcastSet(telemetrySet, telemetryCompanyId, data, length);
+}
+
+void WiBLE::stopMultiAdvertising() {
+    if (!bleManager) return;
+    bleManager->stopAdvertisingSets();
+    for (int8_t set = 0; set < WIBLE_MAX_ADV_SETS; set++) {
+        bleManager->removeAdvertisingSet(set);
+    }
+    telemetrySet = WIBLE_NO_ADV_SET;
+}
+
 // ============================================================================
 // INTERNAL METHODS
 // ============================================================================
 
-void WiBLE::handleStateTransition(ProvisioningState newState) {
+void WiBLE::handleStateTransition(ProvisioningState oldState, ProvisioningState newState) {
+    updateMetrics(oldState, newState);
+    Metrics::enterState(newState);
+    
     // Notify user callback
-    if (stateChangeCallback) {
-        // Note: We need previous state here, but for now just passing IDLE as dummy
-        // In real impl, StateManager passes both
-        stateChangeCallback(ProvisioningState::IDLE, newState);
-    }
+    publishEvent(EventType::STATE_CHANGED, (uint8_t)newState, (uint8_t)oldState);
 
     // Broadcast new state via BLE Advertising
     if (bleManager && bleManager->isInitialized()) {
-        uint8_t statusByte = 0x00;
+        uint8_t statusByte = 0xFF;
         switch (newState) {
-            case ProvisioningState::IDLE: statusByte = 0x00; break;
-            case ProvisioningState::CONNECTING_WIFI: statusByte = 0x01; break;
-            case ProvisioningState::PROVISIONED: statusByte = 0x02; break;
-            case ProvisioningState::ERROR: statusByte = 0x03; break;
-            default: statusByte = 0xFF; break; // Other states
+            case ProvisioningState::IDLE: statusByte = WIBLE_ADV_STATUS_IDLE; break;
+            case ProvisioningState::BLE_ADVERTISING: statusByte = WIBLE_ADV_STATUS_IDLE; break;
+            case ProvisioningState::BLE_CONNECTED: statusByte = WIBLE_ADV_STATUS_BUSY; break;
+            case ProvisioningState::CONNECTING_WIFI: statusByte = WIBLE_ADV_STATUS_BUSY; break;
+            case ProvisioningState::VALIDATING_CONNECTION: statusByte = WIBLE_ADV_STATUS_BUSY; break;
+            case ProvisioningState::PROVISIONED: statusByte = WIBLE_ADV_STATUS_PROVISIONED; break;
+            case ProvisioningState::ERROR: statusByte = WIBLE_ADV_STATUS_ERROR; break;
+            default: break; // Other states
         }
         
-        // Company ID 0xFFFF (Test), Data: [Status]
-        if (statusByte != 0xFF) {
-            bleManager->setManufacturerData(0xFFFF, &statusByte, 1);
+        // An application broadcast or advertising sets keep their payloads
+        if (statusByte != 0xFF && !bleManager->isBroadcasting() &&
+            !bleManager->areAdvertisingSetsRunning()) {
+            bleManager->setStatusAdvertisement(statusByte);
         }
     }
     
     // Handle specific state actions
     switch (newState) {
+        case ProvisioningState::BLE_ADVERTISING:
+            // Precompute keypairs while waiting for a phone
+            if (securityManager && securityManager->isEncryptionEnabled()) {
+                securityManager->startKeyPool();
+            }
+            break;
+            
+        case ProvisioningState::IDLE:
+            if (securityManager) securityManager->stopKeyPool();
+            break;
+            
         case ProvisioningState::PROVISIONED:
-            if (provisioningCompleteCallback) {
-                provisioningCompleteCallback(true, millis() - startTime);
+            if (securityManager) securityManager->stopKeyPool();
+            // Credentials, connection cache and state land in one commit
+            if (stateManager) stateManager->saveState();
+            if (storageManager) storageManager->commit();
+            publishEvent(EventType::PROVISIONING_COMPLETE, 0, 1, nullptr, millis() - startTime);
+            if (config.bleAfterProvisioning != BLETeardown::KEEP && bleReady) {
+                teardownAt = millis() + WIBLE_BLE_TEARDOWN_DELAY_MS;
+                if (teardownAt == 0) teardownAt = 1;
+            }
+            // A phone-provisioned device always leads; peers only with relay
+            if (config.enableGroupProvisioning && bleReady &&
+                (config.group.relay || !orchestrator || !orchestrator->credentialsFromLead())) {
+                startGroupProvisioning();
             }
             break;
             
         case ProvisioningState::ERROR:
-            if (errorCallback) {
-                errorCallback(ErrorCode::UNKNOWN_ERROR, "State machine entered error state", false);
+            if (stateManager) stateManager->saveState();
+            handleError(ErrorCode::UNKNOWN_ERROR, "State machine entered error state");
+            break;
+            
+        default:
+            break;
+    }
+}
+
+void WiBLE::handleError(ErrorCode code, const char* message, bool canRetry) {
+    // Text is resolved here, the event carries the static pointer
+    WIBLE_LOGE("%s: %s", errorCodeToString(code), message ? message : "");
+    publishEvent(EventType::ERROR, (uint8_t)code, canRetry ? 1 : 0, nullptr, 0, message);
+}
+
+void WiBLE::publishEvent(EventType type, uint8_t code, uint8_t value, const char* text, uint32_t number,
+                         const char* message) {
+    Event event;
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    event.number = number;
+    event.message = message;
+    event.setText(text);
+    eventBus->publish(event);
+}
+
+void WiBLE::deliverCallbacks(const Event& event, void* context) {
+    // Strings are built here, so an unset callback costs nothing
+    WiBLE* self = static_cast<WiBLE*>(context);
+    switch (event.type) {
+        case EventType::STATE_CHANGED:
+            if (self->stateChangeCallback) {
+                self->stateChangeCallback((ProvisioningState)event.value, (ProvisioningState)event.code);
+            }
+            break;
+        case EventType::BLE_CONNECTED:
+            if (self->bleConnectedCallback) self->bleConnectedCallback(::String(event.text));
+            break;
+        case EventType::BLE_DISCONNECTED:
+            if (self->bleDisconnectedCallback) self->bleDisconnectedCallback(::String(event.text));
+            break;
+        case EventType::AUTHENTICATED:
+            if (self->authenticationCallback) self->authenticationCallback(event.value != 0, ::String(event.text));
+            break;
+        case EventType::CREDENTIALS_RECEIVED:
+            // The passphrase never enters the queue; getStoredCredentials() has it
+            if (self->credentialsReceivedCallback) {
+                WiFiCredentials creds;
+                creds.ssid = event.text;
+                self->credentialsReceivedCallback(creds);
             }
             break;
+        case EventType::WIFI_CONNECTED:
+            if (self->wifiConnectedCallback) {
+                self->wifiConnectedCallback(::String(event.text), IPAddress(event.number).toString());
+            }
+            break;
+        case EventType::WIFI_DISCONNECTED:
+            if (self->wifiDisconnectedCallback) self->wifiDisconnectedCallback(::String(event.text));
+            break;
+        case EventType::WIFI_PROGRESS:
+            if (self->progressCallback) self->progressCallback(event.code, ::String(event.text));
+            break;
+        case EventType::PROVISIONING_COMPLETE:
+            if (self->provisioningCompleteCallback) {
+                self->provisioningCompleteCallback(event.value != 0, event.number);
+            }
+            break;
+        case EventType::ERROR:
+            if (self->errorCallback) {
+                ErrorCode code = (ErrorCode)event.code;
+                self->errorCallback(code, event.message ? event.message : errorCodeToString(code),
+                                    event.value != 0);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void WiBLE::updateMetrics(ProvisioningState oldState, ProvisioningState newState) {
+    uint32_t now = millis();
+    if (attemptInProgress) {
+        attemptStateDurationMs[(uint8_t)oldState] += now - stateEnteredAt;
+    }
+    stateEnteredAt = now;
+    
+    switch (newState) {
+        case ProvisioningState::BLE_CONNECTED:
+            // An attempt runs from BLE connect until PROVISIONED or ERROR
+            metrics.totalProvisioningAttempts++;
+            attemptInProgress = true;
+            provisioningStartedAt = now;
+            memset(attemptStateDurationMs, 0, sizeof(attemptStateDurationMs));
+            break;
+            
+        case ProvisioningState::CONNECTING_WIFI:
+            metrics.totalConnectionAttempts++;
+            connectionStartedAt = now;
+            break;
+            
+        case ProvisioningState::PROVISIONED: {
+            if (!attemptInProgress) break;   // Restored from storage, not provisioned over BLE
+            metrics.successfulProvisionings++;
+            uint32_t n = metrics.successfulProvisionings;
+            
+            // Running means over successful attempts
+            metrics.lastProvisioningTimeMs = now - provisioningStartedAt;
+            metrics.lastConnectionTimeMs = now - connectionStartedAt;
+            metrics.averageProvisioningTimeMs +=
+                ((int32_t)metrics.lastProvisioningTimeMs - (int32_t)metrics.averageProvisioningTimeMs) / (int32_t)n;
+            metrics.averageConnectionTimeMs +=
+                ((int32_t)metrics.lastConnectionTimeMs - (int32_t)metrics.averageConnectionTimeMs) / (int32_t)n;
+            memcpy(metrics.lastStateDurationMs, attemptStateDurationMs, sizeof(attemptStateDurationMs));
+            attemptInProgress = false;
+            break;
+        }
+            
+        case ProvisioningState::ERROR:
+            if (attemptInProgress) metrics.failedProvisionings++;
+            attemptInProgress = false;
+            break;
             
         default:
             break;
@@ -312,26 +881,34 @@ void WiBLE::handleStateTransition(ProvisioningState newState) {
 // ============================================================================
 
 std::vector<String> WiBLE::scanWiFiNetworks(bool showHidden) {
+    // Never blocks: a stale cache is refreshed in the background by loop()
     std::vector<String> ssids;
     if (wifiManager) {
-        auto networks = wifiManager->scanNetworks(showHidden);
-        for (const auto& net : networks) {
-            ssids.push_back(net.ssid);
+        wifiManager->startScan();
+        size_t count = 0;
+        const WiFiScanEntry* entries = wifiManager->getScanResults(count);
+        for (size_t i = 0; i < count; i++) {
+            ssids.push_back(entries[i].ssid);
         }
     }
     return ssids;
 }
 
+bool WiBLE::addWiFiNetwork(const WiFiCredentials& credentials, uint8_t priority) {
+    return wifiManager && wifiManager->addNetwork(credentials.ssid, credentials.password, priority);
+}
+
+void WiBLE::removeWiFiNetwork(const String& ssid) {
+    if (wifiManager) wifiManager->removeNetwork(ssid);
+}
+
 Result<bool> WiBLE::connectWiFi(const WiFiCredentials& credentials) {
     if (wifiManager) {
-        // Simple security type mapping fallback to WPA2
-        WiFiSecurityType secType = WiFiSecurityType::WPA2_PSK;
-        if (credentials.securityType == "OPEN") secType = WiFiSecurityType::OPEN;
-        else if (credentials.securityType == "WEP") secType = WiFiSecurityType::WEP;
-
-        ConnectionResult res = wifiManager->connect(credentials.ssid, credentials.password, secType);
-        if (res.success) return Result<bool>(true);
-        else return Result<bool>(ErrorCode::WIFI_CONNECTION_FAILED, res.errorMessage);
+        // Non-blocking: value is true only if already connected, the outcome
+        // is reported through onWiFiConnected / onWiFiDisconnected
+        ConnectionResult res = wifiManager->connectWithRetry(credentials.ssid, credentials.password);
+        if (res.success || res.state == WiFiConnectionState::CONNECTING) return Result<bool>(res.success);
+        else return Result<bool>(ErrorCode::WIFI_CONNECTION_FAILED, res.errorMessage, (uint16_t)res.failureReason);
     }
     return Result<bool>(ErrorCode::WIFI_INIT_FAILED, "WiFi Manager not initialized");
 }
@@ -360,21 +937,149 @@ int8_t WiBLE::getWiFiRSSI() const {
     }
     return 0;
 }
+Result<bool> WiBLE::sendBLEData(const uint8_t* data, size_t length) {
+    if (!bleManager || !bleManager->isInitialized()) {
+        return Result<bool>(ErrorCode::BLE_INIT_FAILED, "BLE Manager not initialized");
+    }
+    if (!bleManager->isConnected()) {
+        return Result<bool>(ErrorCode::BLE_CONNECTION_LOST, "No BLE client connected");
+    }
+    
+    std::vector<uint8_t> payload(data, data + length);
+    
+    // Single notify when it fits, framed streaming transfer otherwise
+    bool sent = length <= bleManager->getMaxPayloadSize()
+        ? bleManager->notify(WIBLE_DATA_CHARACTERISTIC, payload)
+        : bleManager->sendLargeData(payload);
+    
+    if (!sent) return Result<bool>(ErrorCode::UNKNOWN_ERROR, "BLE send failed");
+    return Result<bool>(true);
+}
+
 bool WiBLE::setEncryptionKey(const uint8_t* key, size_t length) { return false; }
 void WiBLE::setSecureMode(bool enabled) {}
 bool WiBLE::isSecureConnectionEstablished() const { return false; }
 DeviceInfo WiBLE::getDeviceInfo() const { return DeviceInfo(); }
-ProvisioningMetrics WiBLE::getMetrics() const { return metrics; }
-WiFiCredentials WiBLE::getStoredCredentials() const { return WiFiCredentials(); }
-Result<bool> WiBLE::sendBLEData(const uint8_t* data, size_t length) { return Result<bool>(false); }
+ProvisioningMetrics WiBLE::getMetrics() const {
+    ProvisioningMetrics snapshot = metrics;
+    snapshot.uptimeSeconds = (millis() - startTime) / 1000;
+    snapshot.peakMemoryUsage = ESP.getHeapSize() - ESP.getMinFreeHeap();
+    if (securityManager) {
+        const HandshakeStats& handshakes = securityManager->getHandshakeStats();
+        snapshot.lastHandshakeUs = handshakes.lastHandshakeUs;
+        snapshot.lastHandshakeResumed = handshakes.lastHandshakeResumed;
+        snapshot.resumedSessions = handshakes.resumedHandshakes;
+    }
+    return snapshot;
+}
+size_t WiBLE::getMetricsSnapshot(uint8_t* out, size_t capacity) const {
+    return Metrics::snapshot(out, capacity);
+}
+WiFiCredentials WiBLE::getStoredCredentials() const {
+    WiFiCredentials creds;
+    if (wifiManager) wifiManager->loadCredentials(creds.ssid, creds.password);
+    return creds;
+}
+StorageStatistics WiBLE::getStorageStatistics() const {
+    return storageManager ? storageManager->getStatistics() : StorageStatistics();
+}
 Result<bool> WiBLE::sendWiFiData(const String& endpoint, const String& data) { return Result<bool>(false); }
-void WiBLE::setLogLevel(LogLevel level) {}
-void WiBLE::enableSerialLogging(bool enabled) {}
+void WiBLE::setLogLevel(LogLevel level) {
+    config.logLevel = level;
+    if (config.enableSerialLog) LogManager::setLevel(level);
+}
+void WiBLE::enableSerialLogging(bool enabled) {
+    config.enableSerialLog = enabled;
+    LogManager::setLevel(enabled ? config.logLevel : LogLevel::NONE);
+}
 void WiBLE::log(LogLevel level, const String& message) { LogManager::log(level, message); }
-void WiBLE::dumpState() const { if (stateManager) stateManager->dumpStateMachine(); }
-bool WiBLE::enableOTA(const ::String& otaUrl) { return false; }
-void WiBLE::sendTelemetry(const ::String& data) {}
-void WiBLE::setCustomData(const ::String& key, const ::String& value) {}
-::String WiBLE::getCustomData(const ::String& key) const { return ""; }
+void WiBLE::dumpState() const {
+    if (stateManager) stateManager->dumpStateMachine();
+    Metrics::dump();
+}
+bool WiBLE::enableOTA(const ::String& otaUrl) {
+    if (otaUrl.length() > 0) {
+        LogManager::warn("OTA from a URL is not supported; stream the image over BLE");
+        return false;
+    }
+    config.enableOTA = true;
+    if (!otaManager) {
+        otaManager = std::unique_ptr<OTAManager>(new OTAManager());
+        otaManager->initialize(config.ota);
+        if (orchestrator) orchestrator->setOTAManager(otaManager.get());
+    }
+    return true;
+}
+
+OTAProgress WiBLE::getOTAProgress() const {
+    return otaManager ? otaManager->getProgress() : OTAProgress();
+}
+void WiBLE::sendTelemetry(const ::String& data) {
+    if (!telemetryManager || !telemetryManager->sendText((const uint8_t*)data.c_str(), data.length())) {
+        WIBLE_LOGW("Telemetry text not sent (%u bytes)", (unsigned)data.length());
+    }
+}
+
+bool WiBLE::defineTelemetrySeries(uint8_t id, TelemetryValueType type, float resolution) {
+    return telemetryManager && telemetryManager->defineSeries(id, type, resolution);
+}
+
+bool WiBLE::recordTelemetry(uint8_t id, double value) {
+    TelemetryValueType type;
+    if (!telemetryManager || !telemetryManager->getSeriesType(id, type)) return false;
+    switch (type) {
+        case TelemetryValueType::UINT: return telemetryManager->recordUInt(id, (uint32_t)llround(value));
+        case TelemetryValueType::INT: return telemetryManager->recordInt(id, (int32_t)llround(value));
+        default: return telemetryManager->recordFloat(id, (float)value);
+    }
+}
+
+void WiBLE::onTelemetryBatch(TelemetrySink sink, size_t maxBatchBytes) {
+    if (telemetryManager) telemetryManager->setSink(TelemetryTransport::WIFI, sink, maxBatchBytes);
+}
+
+void WiBLE::flushTelemetry() {
+    if (telemetryManager) telemetryManager->flush();
+}
+
+TelemetryStatistics WiBLE::getTelemetryStatistics() const {
+    return telemetryManager ? telemetryManager->getStatistics() : TelemetryStatistics();
+}
+bool WiBLE::subscribeEvents(uint32_t mask, EventListener listener, void* context, const char* name) {
+    return eventBus->subscribe(mask, listener, context, name);
+}
+void WiBLE::unsubscribeEvents(EventListener listener, void* context) {
+    eventBus->unsubscribe(listener, context);
+}
+EventBusStatistics WiBLE::getEventStatistics() const {
+    return eventBus->getStatistics();
+}
+bool WiBLE::registerControlCommand(uint8_t opcode, ControlCommandHandler handler) {
+    return orchestrator && orchestrator->registerControlCommand(opcode, handler);
+}
+size_t WiBLE::encodeControlMetrics(uint8_t* out, size_t capacity) const {
+    // Counters saturate at 16 bits to keep the reply small
+    auto clamp16 = [](uint32_t value) { return (uint16_t)(value > 0xFFFF ? 0xFFFF : value); };
+    ProvisioningMetrics snapshot = getMetrics();
+    ControlReply reply(out, capacity);
+    bool ok = reply.putU32((uint32_t)snapshot.uptimeSeconds) &&
+              reply.putU16(clamp16(snapshot.totalProvisioningAttempts)) &&
+              reply.putU16(clamp16(snapshot.successfulProvisionings)) &&
+              reply.putU16(clamp16(snapshot.failedProvisionings)) &&
+              reply.putU16(clamp16(snapshot.averageProvisioningTimeMs)) &&
+              reply.putU16(clamp16(snapshot.averageConnectionTimeMs)) &&
+              reply.putU16(clamp16(snapshot.bleDisconnections)) &&
+              reply.putU16(clamp16(snapshot.wifiDisconnections)) &&
+              reply.putU32(ESP.getFreeHeap());
+    return ok ? reply.length() : 0;
+}
+void WiBLE::setCustomData(const ::String& key, const ::String& value) {
+    customData[key] = value;
+}
+
+::String WiBLE::getCustomData(const ::String& key) const {
+    auto it = customData.find(key);
+    return it != customData.end() ? it->second : ::String();
+}
 
 } // namespace WiBLE
@@ -18,8 +18,20 @@
 #include <Arduino.h>
 #include <memory>
 #include <vector>
+#include <map>
 #include <functional>
 #include "WiBLE_Defs.h"
+#include "BLEScanner.h"
+#include "AdvertisingScheduler.h"
+#include "StorageManager.h"
+#include "ConnectivityValidator.h"
+#include "OTAManager.h"
+#include "TelemetryManager.h"
+#include "ControlProtocol.h"
+#include "EventBus.h"
+#include "GroupProvisioner.h"
+#include "utils/PacketSchema.h"
+#include "utils/Metrics.h"
 
 namespace WiBLE {
 
@@ -28,9 +40,13 @@ class WiFiManager;
 class SecurityManager;
 class StateManager;
 class ProvisioningOrchestrator;
-class StorageManager;
 class LogManager;
 
+// PROVISIONED to BLE teardown, long enough for the SUCCESS status to reach the phone
+#ifndef WIBLE_BLE_TEARDOWN_DELAY_MS
+#define WIBLE_BLE_TEARDOWN_DELAY_MS 1500
+#endif
+
 // ============================================================================
 // DATA STRUCTURES
 // ============================================================================
@@ -57,12 +73,15 @@ struct ProvisioningConfig {
     bool requirePinAuth = false;
     String pinCode = "000000";
     uint32_t authTimeoutMs = 30000;
+    uint8_t keyPoolSize = 2;                // ECDH keypairs precomputed while advertising (0 = inline)
+    bool enableSessionResumption = false;   // Resumption tickets let bonded phones skip ECDH
     
     // BLE Configuration
     uint16_t mtuSize = 512;
     uint16_t connectionInterval = 24; // 30ms (24 * 1.25ms)
     uint16_t slaveLatency = 0;
     uint16_t supervisionTimeout = 400; // 4s
+    bool enableConnectionTuning = true;     // Short intervals / DLE / 2M PHY in bursts, long when idle
     bool enableBonding = true;
     
     // WiFi Configuration
@@ -71,6 +90,13 @@ struct ProvisioningConfig {
     uint32_t wifiRetryDelayMs = 2000;
     bool autoReconnect = true;
     bool persistCredentials = true;
+    bool enableWiFiRoaming = true;      // Roam between known networks / APs before the link drops
+    bool validateConnectivity = true;   // DNS / captive-portal check before PROVISIONED
+    ValidationConfig validation;
+    
+    // Startup and Teardown
+    bool lazyStartup = false;           // With stored credentials, join WiFi first; BLE only if that fails
+    BLETeardown bleAfterProvisioning = BLETeardown::KEEP;
     
     // Power Management
     bool enablePowerSaving = true;
@@ -81,28 +107,79 @@ struct ProvisioningConfig {
     LogLevel logLevel = LogLevel::INFO;
     bool enableSerialLog = true;
     bool enableFileLog = false;
+    bool enableAsyncLog = false;        // Defer integer-only WIBLE_LOG* records to a low-priority task
+    uint8_t asyncLogPriority = 1;
+    
+    // Events and callbacks
+    EventDelivery eventDelivery = EventDelivery::IMMEDIATE;    // LOOP: callbacks run in loop()
+    uint32_t slowListenerUs = WIBLE_EVENT_SLOW_LISTENER_US;    // Callbacks slower than this are logged
     
     // Advanced Features
-    bool enableOTA = false;
-    bool enableTelemetry = false;
-    uint16_t keepAliveIntervalS = 60;
+    bool enableOTA = false;             // Accept firmware images over BLE (see OTAManager)
+    OTAConfig ota;
+    bool enableTelemetry = false;       // Batched samples, see recordTelemetry()
+    TelemetryConfig telemetry;          // keepAliveIntervalS below takes precedence
+    uint16_t keepAliveIntervalS = 60;   // Empty telemetry batch when nothing else was sent
+    bool enableDiagnostics = true;      // Metrics snapshot on a readable characteristic
     
     // Connection Management
-    uint8_t maxSimultaneousConnections = 1;
-    bool enableConnectionQueue = true;
+    uint8_t maxSimultaneousConnections = 1;  // Phones served at once (up to WIBLE_MAX_CONNECTIONS)
+    bool enableConnectionQueue = true;       // Keep further phones connected and waiting
+
+    // Group Provisioning
+    bool enableGroupProvisioning = false;    // Once provisioned, pass the credentials to nearby peers
+    GroupConfig group;                       // fleetSecret also lets peers accept a lead
 };
 
 struct ProvisioningMetrics {
     uint32_t totalProvisioningAttempts = 0;
     uint32_t successfulProvisionings = 0;
     uint32_t failedProvisionings = 0;
-    uint32_t averageProvisioningTimeMs = 0;
+    uint32_t averageProvisioningTimeMs = 0;     // BLE connect to PROVISIONED
     uint32_t totalConnectionAttempts = 0;
-    uint32_t averageConnectionTimeMs = 0;
+    uint32_t averageConnectionTimeMs = 0;       // CONNECTING_WIFI to PROVISIONED
     uint32_t bleDisconnections = 0;
     uint32_t wifiDisconnections = 0;
     uint64_t uptimeSeconds = 0;
-    size_t peakMemoryUsage = 0;
+    size_t peakMemoryUsage = 0;                 // Heap size minus the all-time minimum free heap
+    
+    // Last successful provisioning, broken down by time spent in each state
+    uint32_t lastProvisioningTimeMs = 0;
+    uint32_t lastConnectionTimeMs = 0;
+    uint32_t lastStateDurationMs[WIBLE_STATE_COUNT] = {0};
+    
+    // Key exchange of the last connection (see SecurityManager::getHandshakeStats)
+    uint32_t lastHandshakeUs = 0;
+    bool lastHandshakeResumed = false;
+    uint32_t resumedSessions = 0;
+    
+    // Bring-up cost and teardown (see lazyStartup, bleAfterProvisioning)
+    uint32_t bootToOnlineMs = 0;                // begin() to the first WiFi connection
+    size_t bleHeapBytes = 0;                    // Heap taken by BLE and security bring-up
+    size_t bleHeapReleasedBytes = 0;            // Heap returned by the last teardown
+    
+    // Deep-sleep cycles (see prepareForSleep); counters above carry across them
+    uint32_t deepSleepWakes = 0;                // Boots resumed from the RTC snapshot
+    uint32_t resumeTimeUs = 0;                  // Time begin() took to resume the last one
+};
+
+/**
+ * Advertisements kept on air side by side (see startMultiAdvertising)
+ */
+struct MultiAdvertisingConfig {
+    bool provisioning = true;                   // Connectable provisioning service
+    AdvertisingSetParams provisioningParams;
+    
+    bool beacon = false;
+    String beaconUUID;
+    uint16_t beaconMajor = 0;
+    uint16_t beaconMinor = 0;
+    int8_t beaconRSSIAt1m = -59;
+    AdvertisingSetParams beaconParams;
+    
+    bool telemetry = false;                     // Manufacturer data, see updateTelemetry()
+    uint16_t telemetryCompanyId = 0xFFFF;
+    AdvertisingSetParams telemetryParams;
 };
 
 // ============================================================================
@@ -117,7 +194,7 @@ using CredentialsReceivedCallback = std::function<void(const WiFiCredentials& cr
 using WiFiConnectedCallback = std::function<void(String ssid, String ipAddress)>;
 using WiFiDisconnectedCallback = std::function<void(String reason)>;
 using ProvisioningCompleteCallback = std::function<void(bool success, uint32_t durationMs)>;
-using ErrorCallback = std::function<void(ErrorCode error, String message, bool canRetry)>;
+using ErrorCallback = std::function<void(ErrorCode error, const char* message, bool canRetry)>;
 using ProgressCallback = std::function<void(uint8_t percentage, String message)>;
 using DataReceivedCallback = std::function<void(const uint8_t* data, size_t length)>;
 
@@ -125,20 +202,30 @@ using DataReceivedCallback = std::function<void(const uint8_t* data, size_t leng
 // RESULT TYPE FOR ERROR HANDLING
 // ============================================================================
 
+/**
+ * Value or error. Failures carry the code, optional static text and a
+ * code-specific detail (e.g. a WiFiDisconnectReason), so returning one
+ * never allocates; message() resolves the text when it is needed.
+ */
 template<typename T>
 class Result {
 public:
     bool success;
     T value;
     ErrorCode errorCode;
-    String errorMessage;
+    const char* errorMessage;               // Static text or nullptr
+    uint16_t errorDetail;
     
-    Result(T val) : success(true), value(val), errorCode(ErrorCode::NONE) {}
-    Result(ErrorCode code, String msg) : success(false), errorCode(code), errorMessage(msg) {}
+    Result(T val) : success(true), value(val), errorCode(ErrorCode::NONE),
+                    errorMessage(nullptr), errorDetail(0) {}
+    Result(ErrorCode code, const char* msg = nullptr, uint16_t detail = 0)
+        : success(false), value(), errorCode(code), errorMessage(msg), errorDetail(detail) {}
     
     operator bool() const { return success; }
     T& operator*() { return value; }
     const T& operator*() const { return value; }
+    
+    const char* message() const { return errorMessage ? errorMessage : errorCodeToString(errorCode); }
 };
 
 // ============================================================================
@@ -186,6 +273,12 @@ public:
     bool isBLEConnected() const;
     bool isWiFiConnected() const;
     
+    /**
+     * BLE stack and security are up (false while deferred by lazyStartup
+     * or after a teardown)
+     */
+    bool isBLEActive() const;
+    
     // ========================================================================
     // PROVISIONING CONTROL
     // ========================================================================
@@ -200,6 +293,13 @@ public:
      */
     void stopProvisioning();
     
+    /**
+     * Shut BLE and the security contexts down now, disconnecting any phone.
+     * releaseMemory also frees the controller's memory, after which BLE
+     * cannot start again until the next restart.
+     */
+    void shutdownBLE(bool releaseMemory = false);
+    
     /**
      * Manually provision with credentials
      */
@@ -210,12 +310,28 @@ public:
      */
     void clearProvisioning();
     
+    /**
+     * Keep the state machine position, the cached association and the
+     * metrics counters in RTC memory, and flush storage. Call right before
+     * esp_deep_sleep_start(); the next begin() resumes from the snapshot
+     * and, when provisioned, rejoins WiFi without starting BLE.
+     */
+    void prepareForSleep();
+    
+    /**
+     * This boot resumed from an RTC snapshot
+     */
+    bool isResumedFromSleep() const;
+    
     // ========================================================================
     // WIFI MANAGEMENT
     // ========================================================================
     
     /**
-     * Get list of available WiFi networks
+     * Get list of available WiFi networks, strongest first, from the scan
+     * cache. A stale cache starts a background refresh; the list is the
+     * previous scan (empty the first time) until it completes. Hidden
+     * networks are never listed.
      */
     std::vector<String> scanWiFiNetworks(bool showHidden = false);
     
@@ -224,6 +340,12 @@ public:
      */
     Result<bool> connectWiFi(const WiFiCredentials& credentials);
     
+    /**
+     * Add a known network for roaming and failover (persisted)
+     */
+    bool addWiFiNetwork(const WiFiCredentials& credentials, uint8_t priority = 0);
+    void removeWiFiNetwork(const String& ssid);
+    
     /**
      * Disconnect from WiFi
      */
@@ -269,8 +391,23 @@ public:
     
     DeviceInfo getDeviceInfo() const;
     ProvisioningMetrics getMetrics() const;
+    
+    /**
+     * Counters, gauges, latency histograms and per-state times as one binary
+     * record (format in utils/Metrics.h), the same bytes the diagnostics
+     * characteristic serves
+     * @param out Holds WIBLE_METRICS_SNAPSHOT_SIZE bytes
+     * @return Bytes written, 0 if out is too small or metrics are compiled out
+     */
+    size_t getMetricsSnapshot(uint8_t* out, size_t capacity) const;
+    
     WiFiCredentials getStoredCredentials() const;
     
+    /**
+     * Persistent storage activity, including flash writes per day
+     */
+    StorageStatistics getStorageStatistics() const;
+    
     // ========================================================================
     // DATA TRANSFER
     // ========================================================================
@@ -280,6 +417,16 @@ public:
      */
     Result<bool> sendBLEData(const uint8_t* data, size_t length);
     
+    /**
+     * Send one PacketSchema frame over BLE, encoded on the stack
+     */
+    template<typename Packet, typename... Values>
+    Result<bool> sendPacket(Values... values) {
+        uint8_t frame[Packet::SIZE];
+        Packet::encode(frame, values...);
+        return sendBLEData(frame, sizeof(frame));
+    }
+    
     /**
      * Send custom data over WiFi
      */
@@ -288,10 +435,32 @@ public:
     /**
      * Start scanning for BLE devices (Gateway Mode)
      * @param duration Duration in seconds
-     * @param callback Callback for discovered devices
+     * @param callback Called once per device heard, with the manufacturer data as hex
      */
     void scanForDevices(uint32_t duration, std::function<void(const String&, int, const String&)> callback);
 
+    /**
+     * Scan continuously and deliver deduplicated batches for uplink
+     * @param scanConfig Scan window and interval, filters, batch interval
+     * @param callback Devices heard since the previous batch, called from loop()
+     */
+    bool startGatewayScan(const ScanConfig& scanConfig, ScanBatchCallback callback);
+    void stopGatewayScan();
+    ScanStatistics getScanStatistics() const;
+
+    /**
+     * Lead group provisioning: scan for unprovisioned peers and provision
+     * them with the stored credentials (see GroupProvisioner). Starts on
+     * its own after PROVISIONED when enableGroupProvisioning is set.
+     * @return false without stored credentials or a fleet secret, or while
+     *         a gateway scan holds the scanner
+     */
+    bool startGroupProvisioning();
+    void stopGroupProvisioning();
+    bool isGroupProvisioning() const;
+    void onGroupProgress(GroupProgressCallback callback);
+    GroupStatistics getGroupStatistics() const;
+
     /**
      * Start Beacon Mode (Phase 8)
      * @param uuid UUID string
@@ -307,6 +476,30 @@ public:
      * @param length Length of data
      */
     void startBroadcasting(uint16_t manufacturerId, const uint8_t* data, size_t length);
+
+    /**
+     * Change part of the running broadcast without restarting advertising
+     * @param data Changed bytes
+     * @param length Number of changed bytes
+     * @param offset Position in the data given to startBroadcasting
+     * @return false if not broadcasting or the range is outside the payload
+     */
+    bool updateBroadcast(const uint8_t* data, size_t length, size_t offset = 0);
+
+    /**
+     * Advertise provisioning, an iBeacon and a telemetry frame at the same
+     * time, each with its own interval and TX power. Concurrent on BLE 5
+     * controllers, time-sliced on the original ESP32.
+     * @param telemetry Initial telemetry payload (manufacturer data after the company ID)
+     */
+    bool startMultiAdvertising(const MultiAdvertisingConfig& multiConfig,
+                               const uint8_t* telemetry = nullptr, size_t telemetryLength = 0);
+
+    /**
+     * Replace the telemetry payload while everything stays on air
+     */
+    bool updateTelemetry(const uint8_t* data, size_t length);
+    void stopMultiAdvertising();
     
     // ========================================================================
     // CALLBACK REGISTRATION
@@ -324,6 +517,20 @@ public:
     void onProgress(ProgressCallback callback);
     void onDataReceived(DataReceivedCallback callback);
     
+    /**
+     * Allocation-free alternative to the callbacks above: listener gets
+     * every event whose WIBLE_EVENT_MASK bit is in mask, delivered like
+     * the callbacks (see ProvisioningConfig::eventDelivery)
+     */
+    bool subscribeEvents(uint32_t mask, EventListener listener, void* context = nullptr,
+                         const char* name = "listener");
+    void unsubscribeEvents(EventListener listener, void* context = nullptr);
+    
+    /**
+     * Events published, dropped, and the slowest listener call
+     */
+    EventBusStatistics getEventStatistics() const;
+    
     // ========================================================================
     // LOGGING & DEBUGGING
     // ========================================================================
@@ -338,17 +545,56 @@ public:
     // ========================================================================
     
     /**
-     * Enable OTA updates
+     * Accept firmware images streamed over BLE (OTA_BEGIN on the control
+     * characteristic). Only BLE is supported: a URL is refused.
      */
     bool enableOTA(const String& otaUrl = "");
     
     /**
-     * Send telemetry data
+     * Progress of the current or last BLE firmware update
+     */
+    OTAProgress getOTAProgress() const;
+    
+    /**
+     * Send a text record right away over the telemetry link, outside the
+     * batches (needs enableTelemetry)
      */
     void sendTelemetry(const String& data);
     
     /**
-     * Set custom provisioning data
+     * Declare a telemetry series; FLOAT values are sent as multiples of resolution
+     */
+    bool defineTelemetrySeries(uint8_t id, TelemetryValueType type, float resolution = 1.0f);
+    
+    /**
+     * Queue a sample for the next batch. Exact for any 32-bit integer;
+     * TelemetryManager has typed recorders.
+     */
+    bool recordTelemetry(uint8_t id, double value);
+    
+    /**
+     * Send batches through the application (MQTT, HTTP, ...) while WiFi
+     * is up; BLE notifications are used otherwise. Returning false keeps
+     * the samples queued.
+     */
+    void onTelemetryBatch(TelemetrySink sink, size_t maxBatchBytes = WIBLE_TELEMETRY_BATCH_MAX);
+    
+    /**
+     * Send every queued sample on the next loop(), e.g. before sleeping
+     */
+    void flushTelemetry();
+    
+    TelemetryStatistics getTelemetryStatistics() const;
+    
+    /**
+     * Serve an application opcode (WIBLE_OP_APP_FIRST..WIBLE_OP_APP_LAST)
+     * on the control characteristic, written alone or in a batch
+     */
+    bool registerControlCommand(uint8_t opcode, ControlCommandHandler handler);
+    
+    /**
+     * Custom provisioning data: set locally, or received from the app as
+     * custom fields of a TLV credential frame
      */
     void setCustomData(const String& key, const String& value);
     String getCustomData(const String& key) const;
@@ -360,13 +606,18 @@ private:
     std::unique_ptr<SecurityManager> securityManager;
     std::unique_ptr<StateManager> stateManager;
     std::unique_ptr<ProvisioningOrchestrator> orchestrator;
-    // std::unique_ptr<StorageManager> storageManager;
+    std::unique_ptr<StorageManager> storageManager;
     std::unique_ptr<LogManager> logManager;
+    std::unique_ptr<OTAManager> otaManager;
+    std::unique_ptr<TelemetryManager> telemetryManager;
+    std::unique_ptr<EventBus> eventBus;
+    std::unique_ptr<GroupProvisioner> groupProvisioner;
+    GroupProgressCallback groupProgressCallback;
     
     // Configuration
     ProvisioningConfig config;
     
-    // Callbacks
+    // Callbacks, invoked from the event bus by deliverCallbacks()
     StateChangeCallback stateChangeCallback;
     BLEConnectedCallback bleConnectedCallback;
     BLEDisconnectedCallback bleDisconnectedCallback;
@@ -382,14 +633,34 @@ private:
     // Internal state
     bool initialized;
     uint32_t startTime;
+    bool bleReady;                      // bringUpBLE() ran since the last teardown
+    bool bleReleased;                   // Controller memory released, BLE unavailable
+    bool onlineRecorded;                // bootToOnlineMs taken
+    bool resumed;                       // begin() took the RTC snapshot
+    uint32_t teardownAt;                // Scheduled teardown after PROVISIONED (0 = none)
+    uint32_t metricsSampledAt;          // Last gauge sample in loop()
     ProvisioningMetrics metrics;
+    uint32_t stateEnteredAt;
+    bool attemptInProgress;             // BLE connect seen, not yet PROVISIONED or ERROR
+    uint32_t provisioningStartedAt;
+    uint32_t connectionStartedAt;
+    uint32_t attemptStateDurationMs[WIBLE_STATE_COUNT];
+    int8_t telemetrySet;
+    uint16_t telemetryCompanyId;
+    std::map<String, String> customData;
     
     // Internal methods
     void initializeComponents();
-    void handleStateTransition(ProvisioningState newState);
-    void handleError(ErrorCode code, const String& message, bool canRetry = false);
-    void updateMetrics();
-    void triggerCallbackSafely(std::function<void()> callback);
+    bool bringUpBLE();
+    void tearDownBLE(bool releaseMemory);
+    void handleStateTransition(ProvisioningState oldState, ProvisioningState newState);
+    void handleError(ErrorCode code, const char* message, bool canRetry = false);
+    void updateMetrics(ProvisioningState oldState, ProvisioningState newState);
+    void sampleMetrics();
+    size_t encodeControlMetrics(uint8_t* out, size_t capacity) const;
+    void publishEvent(EventType type, uint8_t code = 0, uint8_t value = 0, const char* text = nullptr,
+                      uint32_t number = 0, const char* message = nullptr);
+    static void deliverCallbacks(const Event& event, void* context);
 };
 
 } // namespace WiBLE
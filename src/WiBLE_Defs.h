@@ -21,7 +21,7 @@ struct WiFiCredentials {
     }
 };
 
-enum class ProvisioningState {
+enum class ProvisioningState : uint8_t {
     IDLE,
     BLE_ADVERTISING,
     BLE_CONNECTED,
@@ -33,6 +33,8 @@ enum class ProvisioningState {
     ERROR
 };
 
+constexpr uint8_t WIBLE_STATE_COUNT = static_cast<uint8_t>(ProvisioningState::ERROR) + 1;
+
 enum class SecurityLevel {
     NONE,           // No encryption (dev only)
     BASIC,          // Simple pairing
@@ -54,6 +56,20 @@ enum class ErrorCode {
     UNKNOWN_ERROR
 };
 
+/**
+ * Static name of an error code, for logs and callbacks
+ */
+const char* errorCodeToString(ErrorCode code);
+
+/**
+ * What happens to BLE once the device is provisioned
+ */
+enum class BLETeardown : uint8_t {
+    KEEP,           // Stay up for the status characteristic and re-provisioning
+    DEINIT,         // Shut Bluedroid and the controller down; startProvisioning() brings them back
+    RELEASE_MEMORY  // Also hand the controller's memory to the heap; BLE is gone until restart
+};
+
 enum class LogLevel {
     VERBOSE,
     DEBUG,
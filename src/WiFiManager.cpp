@@ -3,8 +3,8 @@
  */
 
 #include "WiFiManager.h"
+#include "SecurityManager.h"
 #include "utils/LogManager.h"
-#include <Preferences.h>
 
 namespace WiBLE {
 
@@ -13,12 +13,46 @@ namespace WiBLE {
 // ============================================================================
 
 WiFiManager::WiFiManager() 
-    : initialized(false), 
-      isScanning(false) {
+    : connectionState(WiFiConnectionState::DISCONNECTED),
+      initialized(false), 
+      autoReconnectEnabled(true),
+      lastReconnectAttempt(0),
+      reconnectAttemptCount(0),
+      attemptNumber(0),
+      maxAttempts(1),
+      retryPending(false),
+      attemptStartTime(0),
+      nextRetryAt(0),
+      lastProgressAt(0),
+      directedAttempt(false),
+      leaseApplied(false),
+      storage(nullptr),
+      pendingEvents(0),
+      roamRound(false),
+      roaming(false),
+      ignoreNextDisconnect(false),
+      roamTried(0),
+      smoothedRssi(0),
+      roamStartedAt(0),
+      lastRoamCheckAt(0),
+      lastRoamScanAt(0),
+      connectionStartTime(0),
+      lastConnectionTime(0),
+      isScanning(false),
+      scanCacheValid(false),
+      scanSweep(0),
+      scanId(0),
+      sweepStartedAt(0),
+      scanCacheAt(0),
+      scanCacheCount(0),
+      wifiEventId(0),
+      wifiEventRegistered(false) {
+    memset(&statistics, 0, sizeof(statistics));
 }
 
 WiFiManager::~WiFiManager() {
     disconnect();
+    if (wifiEventRegistered) WiFi.removeEvent(wifiEventId);
 }
 
 bool WiFiManager::initialize(const WiFiConfig& config) {
@@ -27,14 +61,32 @@ bool WiFiManager::initialize(const WiFiConfig& config) {
     // Set mode to STATION (client)
     WiFi.mode(WIFI_STA);
     
-    // Configure auto-reconnect
-    WiFi.setAutoReconnect(config.autoReconnect);
+    // Reconnection is driven by handleReconnection() with backoff,
+    // so the core's own immediate reconnect is turned off
+    WiFi.setAutoReconnect(false);
+    autoReconnectEnabled = config.autoReconnect;
+    
+    // Connection progress is event driven; monitor() consumes the events
+    if (!wifiEventRegistered) {
+        wifiEventId = WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t) { handleWiFiEvent(event); });
+        wifiEventRegistered = true;
+    }
     
     // Set static IP if configured
     if (!config.staticIP.isEmpty()) {
         configureStaticIP(config.staticIP, config.gateway, config.subnet, config.dns1, config.dns2);
     }
     
+    if (!storage) {
+        StorageConfig storageConfig;
+        storageConfig.commitDelayMs = 0;
+        ownedStorage = std::unique_ptr<StorageManager>(new StorageManager());
+        ownedStorage->begin(storageConfig);
+        storage = ownedStorage.get();
+    }
+    loadConnectionCache();
+    loadKnownNetworks();
+    
     initialized = true;
     LogManager::info("WiFiManager initialized");
     return true;
@@ -44,61 +96,253 @@ bool WiFiManager::initialize(const WiFiConfig& config) {
 // SCANNING
 // ============================================================================
 
+// Roaming candidate index meaning "none"
+static const uint8_t NO_CANDIDATE = 0xFF;
+
+// Busiest channels first, so the first pages already hold most networks
+static const uint8_t SCAN_CHANNELS[] = { 1, 6, 11, 2, 3, 4, 5, 7, 8, 9, 10, 12, 13 };
+static const uint8_t SCAN_CHANNEL_COUNT = sizeof(SCAN_CHANNELS);
+
 void WiFiManager::scanNetworksAsync(WiFiScanCompleteCallback callback) {
-    if (isScanning) return;
-    
     scanCompleteCallback = callback;
+    if (!startScan() && !isScanning && callback) {
+        callback(cachedNetworks());
+    }
+}
+
+bool WiFiManager::startScan(bool force) {
+    if (isScanning) return true;
+    if (!force && isScanCacheFresh()) return false;
+    
+    // Scanning would stall a running association
+    if (connectionState == WiFiConnectionState::CONNECTING) return false;
+    
+    scanId++;
+    scanSweep = 0;
     isScanning = true;
+    pendingEvents.fetch_and((uint8_t)~EVENT_SCAN_DONE);
     LogManager::info("Starting WiFi scan...");
+    if (!startChannelSweep()) {
+        finishScan(false);
+        return false;
+    }
+    return true;
+}
+
+bool WiFiManager::startChannelSweep() {
+    sweepStartedAt = millis();
+    int16_t result = WiFi.scanNetworks(true, config.scanHiddenNetworks, false, config.scanDwellMs,
+                                       SCAN_CHANNELS[scanSweep]);
+    if (result == WIFI_SCAN_FAILED) {
+        LogManager::warn("WiFi scan could not be started");
+        return false;
+    }
+    return true;
+}
+
+void WiFiManager::processScan(uint8_t events) {
+    // Driven by the scan-done event; a sweep that never reports is dropped
+    bool timedOut = millis() - sweepStartedAt >= config.scanTimeoutMs;
+    if (!(events & EVENT_SCAN_DONE) && !timedOut) return;
+    
+    int16_t count = WiFi.scanComplete();
+    if (count > 0) ingestScanResults(count);
+    WiFi.scanDelete();
     
-    // Async scan
-    WiFi.scanNetworks(true);
+    if (++scanSweep >= SCAN_CHANNEL_COUNT) {
+        finishScan(true);
+        return;
+    }
+    reportSweep(false);
+    if (!startChannelSweep()) finishScan(false);
 }
 
-std::vector<NetworkInfo> WiFiManager::scanNetworks(bool showHidden) {
-    LogManager::info("Starting blocking WiFi scan...");
-    int16_t count = WiFi.scanNetworks(false); // Blocking
+void WiFiManager::finishScan(bool complete) {
+    isScanning = false;
     
-    std::vector<NetworkInfo> networks;
+    if (complete) {
+        // Networks that did not show up in this scan are gone
+        size_t kept = 0;
+        for (size_t i = 0; i < scanCacheCount; i++) {
+            if (scanCache[i].scanId == scanId) scanCache[kept++] = scanCache[i];
+        }
+        scanCacheCount = kept;
+        scanCacheAt = millis();
+        scanCacheValid = true;
+        LogManager::info("WiFi scan complete: " + String((int)scanCacheCount) + " networks");
+    }
     
-    if (count == -2) {
-        // Scan not triggered
-        return networks;
-    } else if (count == -1) {
-        // Scan in progress
-        return networks;
+    reportSweep(true);
+    if (scanCompleteCallback) {
+        scanCompleteCallback(cachedNetworks());
     }
+}
+
+void WiFiManager::ingestScanResults(int16_t count) {
+    size_t limit = config.maxScanResults < WIBLE_WIFI_SCAN_CACHE_SIZE ? config.maxScanResults
+                                                                      : WIBLE_WIFI_SCAN_CACHE_SIZE;
     
-    for (int i = 0; i < count; ++i) {
-        NetworkInfo info;
-        info.ssid = WiFi.SSID(i);
-        info.rssi = WiFi.RSSI(i);
-        info.channel = WiFi.channel(i);
+    for (int16_t i = 0; i < count; i++) {
+        String ssid = WiFi.SSID(i);
+        // Hidden networks have no name to show or to deduplicate on
+        if (ssid.isEmpty() || ssid.length() >= sizeof(WiFiScanEntry::ssid)) continue;
+        int8_t rssi = (int8_t)WiFi.RSSI(i);
         
-        // Map encryption type
-        switch (WiFi.encryptionType(i)) {
-            case WIFI_AUTH_OPEN: info.securityType = WiFiSecurityType::OPEN; break;
-            case WIFI_AUTH_WEP: info.securityType = WiFiSecurityType::WEP; break;
-            case WIFI_AUTH_WPA_PSK: info.securityType = WiFiSecurityType::WPA_PSK; break;
-            case WIFI_AUTH_WPA2_PSK: info.securityType = WiFiSecurityType::WPA2_PSK; break;
-            case WIFI_AUTH_WPA_WPA2_PSK: info.securityType = WiFiSecurityType::WPA_WPA2_PSK; break;
-            case WIFI_AUTH_WPA2_ENTERPRISE: info.securityType = WiFiSecurityType::WPA2_ENTERPRISE; break;
-            default: info.securityType = WiFiSecurityType::OPEN; break; // Fallback
+        WiFiScanEntry* entry = nullptr;
+        for (size_t j = 0; j < scanCacheCount; j++) {
+            if (strcmp(scanCache[j].ssid, ssid.c_str()) == 0) {
+                entry = &scanCache[j];
+                break;
+            }
         }
         
-        networks.push_back(info);
+        if (entry) {
+            // One entry per SSID, with its strongest AP in this scan
+            if (entry->scanId == scanId && rssi <= entry->rssi) continue;
+        } else if (scanCacheCount < limit) {
+            entry = &scanCache[scanCacheCount++];
+        } else {
+            // Full: replace a network missing from this scan, else the weakest
+            entry = &scanCache[scanCacheCount - 1];
+            for (size_t j = 0; j < scanCacheCount; j++) {
+                if (scanCache[j].scanId != scanId) {
+                    entry = &scanCache[j];
+                    break;
+                }
+            }
+            if (entry->scanId == scanId && rssi <= entry->rssi) continue;
+        }
+        
+        *entry = WiFiScanEntry();
+        memcpy(entry->ssid, ssid.c_str(), ssid.length());
+        const uint8_t* bssid = WiFi.BSSID(i);
+        if (bssid) memcpy(entry->bssid, bssid, sizeof(entry->bssid));
+        entry->rssi = rssi;
+        entry->channel = (uint8_t)WiFi.channel(i);
+        entry->security = getSecurityType(WiFi.encryptionType(i));
+        entry->scanId = scanId;
+        entry->sweep = scanSweep;
+        
+        // Keep the cache sorted by RSSI; at most one entry is out of place
+        size_t index = entry - scanCache;
+        while (index > 0 && scanCache[index - 1].rssi < scanCache[index].rssi) {
+            WiFiScanEntry swap = scanCache[index - 1];
+            scanCache[index - 1] = scanCache[index];
+            scanCache[index] = swap;
+            index--;
+        }
+        while (index + 1 < scanCacheCount && scanCache[index + 1].rssi > scanCache[index].rssi) {
+            WiFiScanEntry swap = scanCache[index + 1];
+            scanCache[index + 1] = scanCache[index];
+            scanCache[index] = swap;
+            index++;
+        }
     }
+}
+
+void WiFiManager::reportSweep(bool complete) {
+    if (!scanProgressCallback) return;
     
-    WiFi.scanDelete();
-    isScanning = false;
-    
-    if (scanCompleteCallback) {
-        scanCompleteCallback(networks);
+    // Networks added or improved by the sweep that just finished
+    WiFiScanEntry updated[WIBLE_WIFI_SCAN_CACHE_SIZE];
+    size_t count = 0;
+    uint8_t sweep = scanSweep - 1;
+    for (size_t i = 0; i < scanCacheCount; i++) {
+        if (scanCache[i].scanId == scanId && scanCache[i].sweep == sweep) updated[count++] = scanCache[i];
     }
     
+    uint8_t progress = complete ? 100 : (uint8_t)(scanSweep * 100 / SCAN_CHANNEL_COUNT);
+    scanProgressCallback(updated, count, progress, complete);
+}
+
+bool WiFiManager::isScanCacheFresh() const {
+    return scanCacheValid && millis() - scanCacheAt < config.scanCacheTtlMs;
+}
+
+const WiFiScanEntry* WiFiManager::getScanResults(size_t& count) const {
+    count = scanCacheCount;
+    return scanCache;
+}
+
+static NetworkInfo toNetworkInfo(const WiFiScanEntry& entry) {
+    NetworkInfo info;
+    info.ssid = entry.ssid;
+    info.rssi = entry.rssi;
+    info.channel = entry.channel;
+    info.securityType = entry.security;
+    info.bssid = const_cast<uint8_t*>(entry.bssid);
+    return info;
+}
+
+std::vector<NetworkInfo> WiFiManager::cachedNetworks() const {
+    std::vector<NetworkInfo> networks;
+    networks.reserve(scanCacheCount);
+    for (size_t i = 0; i < scanCacheCount; i++) {
+        networks.push_back(toNetworkInfo(scanCache[i]));
+    }
     return networks;
 }
 
+const WiFiScanEntry* WiFiManager::findScanEntry(const char* ssid) const {
+    for (size_t i = 0; i < scanCacheCount; i++) {
+        if (strcmp(scanCache[i].ssid, ssid) == 0) return &scanCache[i];
+    }
+    return nullptr;
+}
+
+bool WiFiManager::isNetworkAvailable(const String& ssid) {
+    return findScanEntry(ssid.c_str()) != nullptr;
+}
+
+NetworkInfo WiFiManager::getNetworkInfo(const String& ssid) {
+    const WiFiScanEntry* entry = findScanEntry(ssid.c_str());
+    return entry ? toNetworkInfo(*entry) : NetworkInfo();
+}
+
+NetworkInfo WiFiManager::getStrongestNetwork(const std::vector<String>& ssidList) {
+    // The cache is sorted, so the first listed SSID found is the strongest
+    for (size_t i = 0; i < scanCacheCount; i++) {
+        for (const String& ssid : ssidList) {
+            if (ssid == scanCache[i].ssid) return toNetworkInfo(scanCache[i]);
+        }
+    }
+    return NetworkInfo();
+}
+
+std::vector<NetworkInfo> WiFiManager::scanNetworks(bool showHidden) {
+    if (isScanCacheFresh() || isScanning) return cachedNetworks();
+    
+    LogManager::info("Starting blocking WiFi scan...");
+    int16_t count = WiFi.scanNetworks(false, showHidden);
+    if (count < 0) {
+        // Not triggered or still running
+        return cachedNetworks();
+    }
+    
+    // One pass over every channel counts as the last sweep of a scan
+    scanId++;
+    scanSweep = SCAN_CHANNEL_COUNT - 1;
+    ingestScanResults(count);
+    WiFi.scanDelete();
+    scanSweep = SCAN_CHANNEL_COUNT;
+    finishScan(true);
+    return cachedNetworks();
+}
+
+WiFiSecurityType WiFiManager::getSecurityType(wifi_auth_mode_t authMode) {
+    switch (authMode) {
+        case WIFI_AUTH_OPEN: return WiFiSecurityType::OPEN;
+        case WIFI_AUTH_WEP: return WiFiSecurityType::WEP;
+        case WIFI_AUTH_WPA_PSK: return WiFiSecurityType::WPA_PSK;
+        case WIFI_AUTH_WPA2_PSK: return WiFiSecurityType::WPA2_PSK;
+        case WIFI_AUTH_WPA_WPA2_PSK: return WiFiSecurityType::WPA_WPA2_PSK;
+        case WIFI_AUTH_WPA2_ENTERPRISE: return WiFiSecurityType::WPA2_ENTERPRISE;
+        case WIFI_AUTH_WPA3_PSK:
+        case WIFI_AUTH_WPA2_WPA3_PSK: return WiFiSecurityType::WPA3_PSK;
+        default: return WiFiSecurityType::OPEN; // Fallback
+    }
+}
+
 // ============================================================================
 // CONNECTION
 // ============================================================================
@@ -106,64 +350,755 @@ std::vector<NetworkInfo> WiFiManager::scanNetworks(bool showHidden) {
 ConnectionResult WiFiManager::connect(const String& ssid, const String& password, WiFiSecurityType securityType) {
     ConnectionResult result;
     
-    LogManager::info("Connecting to WiFi: " + ssid);
-    
     if (ssid.isEmpty()) {
         result.success = false;
+        result.state = WiFiConnectionState::CONNECTION_FAILED;
         result.errorMessage = "Empty SSID";
         return result;
     }
     
-    WiFi.begin(ssid.c_str(), password.c_str());
+    currentSSID = ssid;
+    currentPassword = password;
+    maxAttempts = 1;
+    retryPending = false;
+    reconnectAttemptCount = 0;
+    roamRound = false;
+    roaming = false;
+    
+    connectInternal(ssid, password, 1);
+    
+    result.state = connectionState;
+    result.attemptCount = 1;
+    return result;
+}
+
+ConnectionResult WiFiManager::connectWithRetry(const String& ssid, const String& password) {
+    ConnectionResult result = connect(ssid, password);
+    if (result.state == WiFiConnectionState::CONNECTING) {
+        maxAttempts = config.maxConnectionRetries > 0 ? config.maxConnectionRetries : 1;
+    }
+    return result;
+}
+
+ConnectionResult WiFiManager::connectWithStoredCredentials() {
+    String ssid, password;
+    if (!loadCredentials(ssid, password)) {
+        ConnectionResult result;
+        result.state = WiFiConnectionState::CONNECTION_FAILED;
+        result.errorMessage = "No stored credentials";
+        return result;
+    }
+    ConnectionResult result = connectWithRetry(ssid, password);
+    
+    // Once the provisioned network is out of retries, known networks take over
+    if (config.enableRoaming && result.state == WiFiConnectionState::CONNECTING) {
+        roamRound = true;
+        roamTried = 1 << WIBLE_WIFI_MAX_NETWORKS;
+        for (uint8_t i = 0; i < WIBLE_WIFI_MAX_NETWORKS; i++) {
+            if (ssid == knownNetworks[i].ssid) roamTried |= 1 << i;
+        }
+    }
+    return result;
+}
+
+bool WiFiManager::connectInternal(const String& ssid, const String& password, uint8_t attempt) {
+    WIBLE_LOGI("Connecting to WiFi: %s (attempt %u)", ssid.c_str(), (unsigned)attempt);
+    
+    attemptNumber = attempt;
+    retryPending = false;
+    
+    // The association takes the radio; a partial scan still reaches its listeners
+    if (isScanning) {
+        WiFi.scanDelete();
+        finishScan(false);
+    }
+    
+    if (attempt == 1) connectionStartTime = millis();
+    statistics.totalConnections++;
     
-    // Wait for connection (blocking for simplicity in this method, but usually handled async in loop)
-    // For this implementation, we'll return immediately and rely on callbacks/loop monitoring
-    // unless we want a blocking connect.
-    // Let's implement a simple blocking wait with timeout for the `connect` method,
-    // as it returns a Result.
+    // Only the first attempt of a round is directed; retries always scan
+    beginAssociation(ssid, password, attempt == 1 && canFastConnect(ssid));
+    updateConnectionState(WiFiConnectionState::CONNECTING);
+    notifyProgress(0, "Connecting...");
+    return true;
+}
+
+void WiFiManager::beginAssociation(const String& ssid, const String& password, bool directed) {
+    pendingEvents.store(0);
+    attemptStartTime = millis();
+    lastProgressAt = 0;
+    directedAttempt = directed;
     
-    uint32_t start = millis();
-    while (WiFi.status() != WL_CONNECTED && millis() - start < config.connectionTimeoutMs) {
-        delay(100);
-        if (progressCallback) {
-            // Calculate progress roughly
-            uint8_t progress = (millis() - start) * 100 / config.connectionTimeoutMs;
-            progressCallback(progress, "Connecting...");
+    if (!directed) {
+        releaseCachedLease();
+        WiFi.begin(ssid.c_str(), password.c_str());
+        return;
+    }
+    
+    // A reused lease skips DHCP entirely; only when the app opted in and
+    // has not configured its own static address
+    if (config.reuseIPLease && config.useDHCP && connectionCache.hasLease()) {
+        leaseApplied = WiFi.config(IPAddress(connectionCache.ip), IPAddress(connectionCache.gateway),
+                                   IPAddress(connectionCache.subnet), IPAddress(connectionCache.dns));
+    }
+    WIBLE_LOGD("Fast connect: channel %u, BSSID %02X:%02X:%02X:%02X", connectionCache.channel,
+               connectionCache.bssid[2], connectionCache.bssid[3], connectionCache.bssid[4], connectionCache.bssid[5]);
+    WiFi.begin(ssid.c_str(), password.c_str(), connectionCache.channel, connectionCache.bssid);
+}
+
+bool WiFiManager::canFastConnect(const String& ssid) const {
+    return config.fastConnect && connectionCache.isValid() &&
+           strncmp(connectionCache.ssid, ssid.c_str(), sizeof(connectionCache.ssid)) == 0;
+}
+
+void WiFiManager::releaseCachedLease() {
+    if (!leaseApplied) return;
+    // All-zero config hands the interface back to DHCP
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    leaseApplied = false;
+}
+
+void WiFiManager::disconnect() {
+    retryPending = false;
+    maxAttempts = 1;
+    reconnectAttemptCount = 0;
+    
+    if (connectionState == WiFiConnectionState::CONNECTED) {
+        lastConnectionTime = millis() - lastConnectionTime;
+        if (lastConnectionTime > statistics.longestConnection) {
+            statistics.longestConnection = lastConnectionTime;
         }
     }
     
-    if (WiFi.status() == WL_CONNECTED) {
-        result.success = true;
-        result.state = WiFiConnectionState::CONNECTED;
-        result.connectionTimeMs = millis() - start;
-        LogManager::info("WiFi Connected! IP: " + WiFi.localIP().toString());
-        
-        if (connectedCallback) {
-            connectedCallback(getConnectionInfo());
+    WiFi.disconnect(true);
+    updateConnectionState(WiFiConnectionState::DISCONNECTED);
+    LogManager::info("WiFi Disconnected");
+}
+
+// ============================================================================
+// CONNECTION STATE MACHINE
+// ============================================================================
+
+void WiFiManager::handleWiFiEvent(WiFiEvent_t event) {
+    // Runs in the WiFi event task: only record what happened
+    switch (event) {
+        case ARDUINO_EVENT_WIFI_STA_CONNECTED:
+            pendingEvents.fetch_or(EVENT_STA_CONNECTED);
+            break;
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            pendingEvents.fetch_or(EVENT_GOT_IP);
+            break;
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+            pendingEvents.fetch_or(EVENT_DISCONNECTED);
+            break;
+        case ARDUINO_EVENT_WIFI_SCAN_DONE:
+            pendingEvents.fetch_or(EVENT_SCAN_DONE);
+            break;
+        default:
+            break;
+    }
+}
+
+void WiFiManager::monitor() {
+    if (!initialized) return;
+    
+    uint8_t events = pendingEvents.exchange(0);
+    if (isScanning) processScan(events);
+    
+    switch (connectionState) {
+        case WiFiConnectionState::CONNECTING:
+            processConnectingState(events);
+            break;
+            
+        case WiFiConnectionState::CONNECTION_FAILED:
+            if (retryPending && (int32_t)(millis() - nextRetryAt) >= 0) {
+                connectInternal(currentSSID, currentPassword, attemptNumber + 1);
+            }
+            break;
+            
+        case WiFiConnectionState::CONNECTED:
+            if ((events & EVENT_DISCONNECTED) || WiFi.status() != WL_CONNECTED) {
+                WiFiDisconnectReason reason = getDisconnectReason();
+                WIBLE_LOGW("WiFi connection lost (%s)", WiFiUtils::disconnectReasonToString(reason));
+                
+                lastConnectionTime = millis() - lastConnectionTime;
+                if (lastConnectionTime > statistics.longestConnection) {
+                    statistics.longestConnection = lastConnectionTime;
+                }
+                lastReconnectAttempt = millis();
+                roamStartedAt = lastReconnectAttempt;
+                reconnectAttemptCount = 0;
+                updateConnectionState(WiFiConnectionState::CONNECTION_LOST);
+                
+                if (disconnectedCallback) {
+                    disconnectedCallback(reason, WiFiUtils::disconnectReasonToString(reason));
+                }
+            } else {
+                monitorRoaming();
+            }
+            break;
+            
+        case WiFiConnectionState::CONNECTION_LOST:
+            handleReconnection();
+            break;
+            
+        default:
+            break;
+    }
+    
+    if (validator && validator->isRunning()) monitorValidation();
+}
+
+void WiFiManager::processConnectingState(uint8_t events) {
+    if ((events & EVENT_GOT_IP) || WiFi.status() == WL_CONNECTED) {
+        handleConnectionSuccess();
+        return;
+    }
+    
+    if (events & EVENT_DISCONNECTED) {
+        if (ignoreNextDisconnect) {
+            ignoreNextDisconnect = false;
+        } else {
+            handleConnectionFailure(getDisconnectReason());
+            return;
         }
+    }
+    
+    uint32_t elapsed = millis() - attemptStartTime;
+    uint32_t timeoutMs = directedAttempt ? config.fastConnectTimeoutMs : config.connectionTimeoutMs;
+    if (elapsed >= timeoutMs) {
+        handleConnectionFailure(WiFiDisconnectReason::CONNECTION_TIMEOUT);
+        return;
+    }
+    
+    // Progress at most every 500 ms
+    if (millis() - lastProgressAt >= 500) {
+        lastProgressAt = millis();
+        uint8_t progress = (uint8_t)((uint64_t)elapsed * 100 / timeoutMs);
+        notifyProgress(progress, (events & EVENT_STA_CONNECTED) ? "Obtaining IP..." : "Connecting...");
+    }
+}
+
+void WiFiManager::handleConnectionSuccess() {
+    uint32_t now = millis();
+    
+    lastResult = ConnectionResult();
+    lastResult.success = true;
+    lastResult.state = WiFiConnectionState::CONNECTED;
+    lastResult.connectionTimeMs = now - connectionStartTime;
+    lastResult.attemptCount = attemptNumber;
+    lastResult.fastConnect = directedAttempt;
+    lastResult.roamed = roaming;
+    
+    if (roaming) {
+        uint32_t roamTimeMs = now - roamStartedAt;
+        statistics.totalRoams++;
+        statistics.lastRoamTimeMs = roamTimeMs;
+        statistics.averageRoamTimeMs =
+            (statistics.averageRoamTimeMs * (statistics.totalRoams - 1) + roamTimeMs) / statistics.totalRoams;
+        LogManager::info("Roamed to " + currentSSID + " in " + String((int)roamTimeMs) + " ms");
+    }
+    roaming = false;
+    roamRound = false;
+    ignoreNextDisconnect = false;
+    smoothedRssi = 0;
+    lastRoamCheckAt = now;
+    recordOutcome(true);
+    lastValidation = ValidationResult();
+    
+    statistics.successfulConnections++;
+    lastConnectionTime = now;
+    reconnectAttemptCount = 0;
+    retryPending = false;
+    updateStatistics();
+    
+    updateConnectionState(WiFiConnectionState::CONNECTED);
+    notifyProgress(100, "Connected");
+    LogManager::info("WiFi Connected! IP: " + WiFi.localIP().toString() +
+                     " (" + String((int)lastResult.connectionTimeMs) + " ms)");
+    
+    // Save credentials if configured
+    if (config.persistCredentials) {
+        saveCredentials(currentSSID, currentPassword);
+    }
+    updateConnectionCache();
+    
+    if (connectedCallback) {
+        connectedCallback(getConnectionInfo());
+    }
+    if (ipAcquiredCallback) {
+        ipAcquiredCallback(WiFi.localIP().toString());
+    }
+}
+
+void WiFiManager::handleConnectionFailure(WiFiDisconnectReason reason) {
+    WiFi.disconnect(false);
+    
+    // The AP moved channel or the BSSID is gone: scan right away without
+    // spending a retry, keeping the original start time for time-to-IP
+    if (directedAttempt) {
+        WIBLE_LOGW("Fast connect failed (%s), falling back to full scan",
+                   WiFiUtils::disconnectReasonToString(reason));
+        // The disconnect above arrives asynchronously; it is not a failure
+        // of the scan attempt
+        ignoreNextDisconnect = true;
+        beginAssociation(currentSSID, currentPassword, false);
+        return;
+    }
+    
+    statistics.failedConnections++;
+    
+    if (attemptNumber < maxAttempts) {
+        uint32_t delayMs = calculateRetryDelay(attemptNumber);
+        nextRetryAt = millis() + delayMs;
+        retryPending = true;
+        updateConnectionState(WiFiConnectionState::CONNECTION_FAILED);
         
-        // Save credentials if configured
-        if (config.persistCredentials) {
-            saveCredentials(ssid, password);
+        WIBLE_LOGW("WiFi attempt %u failed (%s), retrying in %u ms", (unsigned)attemptNumber,
+                   WiFiUtils::disconnectReasonToString(reason), (unsigned)delayMs);
+        notifyProgress(0, "Retrying...");
+        return;
+    }
+    
+    recordOutcome(false);
+    ignoreNextDisconnect = false;
+    if (roamRound) {
+        int16_t score;
+        const WiFiScanEntry* seen;
+        uint8_t next = pickCandidate(score, seen, false);
+        if (next != NO_CANDIDATE) {
+            WIBLE_LOGW("WiFi %s failed, trying the next known network", currentSSID.c_str());
+            connectCandidate(next, seen);
+            return;
         }
+    }
+    roamRound = false;
+    
+    // Out of candidates during a reconnect: keep reconnecting with backoff
+    if (autoReconnectEnabled && reconnectAttemptCount > 0 &&
+        reconnectAttemptCount < config.maxReconnectAttempts) {
+        updateConnectionState(WiFiConnectionState::CONNECTION_LOST);
+        return;
+    }
+    roaming = false;
+    
+    lastResult = ConnectionResult();
+    lastResult.success = false;
+    lastResult.state = WiFiConnectionState::CONNECTION_FAILED;
+    lastResult.failureReason = reason;
+    lastResult.errorMessage = WiFiUtils::disconnectReasonToString(reason);
+    lastResult.connectionTimeMs = millis() - connectionStartTime;
+    lastResult.attemptCount = attemptNumber;
+    
+    retryPending = false;
+    updateConnectionState(WiFiConnectionState::CONNECTION_FAILED);
+    WIBLE_LOGE("WiFi Connection Failed: %s", lastResult.errorMessage);
+    
+    if (disconnectedCallback) {
+        disconnectedCallback(reason, lastResult.errorMessage);
+    }
+}
+
+void WiFiManager::handleReconnection() {
+    if (!autoReconnectEnabled || connectionState != WiFiConnectionState::CONNECTION_LOST) return;
+    if (currentSSID.isEmpty() || reconnectAttemptCount >= config.maxReconnectAttempts) return;
+    
+    // Back off between reconnect rounds just like between connect attempts
+    // With roaming the first round starts at once, from the cached scan
+    uint32_t interval = config.reconnectIntervalMs;
+    if (reconnectAttemptCount > 0) interval += calculateRetryDelay(reconnectAttemptCount);
+    else if (config.enableRoaming) interval = 0;
+    if (millis() - lastReconnectAttempt < interval) return;
+    
+    lastReconnectAttempt = millis();
+    reconnectAttemptCount++;
+    statistics.totalReconnects++;
+    
+    if (config.enableRoaming) {
+        roamTried = 0;
+        int16_t score;
+        const WiFiScanEntry* seen;
+        uint8_t best = pickCandidate(score, seen, false);
+        if (best != NO_CANDIDATE) {
+            roaming = true;
+            connectCandidate(best, seen);
+            return;
+        }
+    }
+    
+    maxAttempts = 1;
+    connectInternal(currentSSID, currentPassword, 1);
+}
+
+uint32_t WiFiManager::calculateRetryDelay(uint8_t attempt) {
+    if (!config.useExponentialBackoff || attempt <= 1) return config.retryDelayMs;
+    
+    uint8_t shift = attempt - 1 > 4 ? 4 : attempt - 1;
+    uint32_t delayMs = config.retryDelayMs << shift;
+    return delayMs > 30000 ? 30000 : delayMs;
+}
+
+WiFiDisconnectReason WiFiManager::getDisconnectReason() {
+    switch (WiFi.status()) {
+        case WL_NO_SSID_AVAIL: return WiFiDisconnectReason::SSID_NOT_FOUND;
+        case WL_CONNECT_FAILED: return WiFiDisconnectReason::AUTHENTICATION_FAILED;
+        case WL_CONNECTION_LOST: return WiFiDisconnectReason::AP_DISCONNECTED;
+        default: return WiFiDisconnectReason::UNKNOWN;
+    }
+}
+
+void WiFiManager::updateConnectionState(WiFiConnectionState newState) {
+    connectionState = newState;
+}
+
+void WiFiManager::updateStatistics() {
+    uint32_t n = statistics.successfulConnections;
+    if (n == 0) return;
+    statistics.averageConnectionTimeMs =
+        (statistics.averageConnectionTimeMs * (n - 1) + lastResult.connectionTimeMs) / n;
+}
+
+void WiFiManager::notifyProgress(uint8_t progress, const char* status) {
+    if (progressCallback) {
+        progressCallback(progress, status);
+    }
+}
+
+// ============================================================================
+// MULTI-NETWORK ROAMING
+// ============================================================================
+
+bool WiFiManager::addNetwork(const String& ssid, const String& password, uint8_t priority) {
+    if (ssid.isEmpty() || ssid.length() >= sizeof(StoredNetwork::ssid) ||
+        password.length() >= sizeof(StoredNetwork::password)) {
+        return false;
+    }
+    
+    // Same SSID: update in place; otherwise a free slot, else the lowest priority
+    uint8_t slot = WIBLE_WIFI_MAX_NETWORKS;
+    for (uint8_t i = 0; i < WIBLE_WIFI_MAX_NETWORKS; i++) {
+        if (ssid == knownNetworks[i].ssid) {
+            slot = i;
+            break;
+        }
+        if (slot == WIBLE_WIFI_MAX_NETWORKS && knownNetworks[i].ssid[0] == '\0') slot = i;
+    }
+    if (slot == WIBLE_WIFI_MAX_NETWORKS) {
+        slot = 0;
+        for (uint8_t i = 1; i < WIBLE_WIFI_MAX_NETWORKS; i++) {
+            if (knownNetworks[i].priority < knownNetworks[slot].priority) slot = i;
+        }
+        if (knownNetworks[slot].priority > priority) {
+            WIBLE_LOGW("Known network table full; %s not added", ssid.c_str());
+            return false;
+        }
+    }
+    
+    StoredNetwork& network = knownNetworks[slot];
+    bool sameNetwork = ssid == network.ssid && password == network.password;
+    if (!sameNetwork) {
+        SecurityUtils::secureWipe((uint8_t*)&network, sizeof(network));
+        network = StoredNetwork();
+        memcpy(network.ssid, ssid.c_str(), ssid.length());
+        memcpy(network.password, password.c_str(), password.length());
+    }
+    network.priority = priority;
+    return storage && storage->write(networkRecord(slot), network);
+}
+
+void WiFiManager::removeNetwork(const String& ssid) {
+    for (uint8_t i = 0; i < WIBLE_WIFI_MAX_NETWORKS; i++) {
+        if (ssid != knownNetworks[i].ssid) continue;
+        SecurityUtils::secureWipe((uint8_t*)&knownNetworks[i], sizeof(knownNetworks[i]));
+        knownNetworks[i] = StoredNetwork();
+        if (storage) storage->erase(networkRecord(i));
+    }
+}
+
+void WiFiManager::clearNetworks() {
+    for (uint8_t i = 0; i < WIBLE_WIFI_MAX_NETWORKS; i++) {
+        SecurityUtils::secureWipe((uint8_t*)&knownNetworks[i], sizeof(knownNetworks[i]));
+        knownNetworks[i] = StoredNetwork();
+        if (storage) storage->erase(networkRecord(i));
+    }
+}
+
+std::vector<String> WiFiManager::getNetworkList() const {
+    std::vector<String> ssids;
+    for (int priority = 255; priority >= 0; priority--) {
+        for (const StoredNetwork& network : knownNetworks) {
+            if (network.ssid[0] != '\0' && network.priority == priority) ssids.push_back(network.ssid);
+        }
+    }
+    return ssids;
+}
+
+ConnectionResult WiFiManager::connectToBestNetwork() {
+    ConnectionResult result;
+    roamTried = 0;
+    int16_t score;
+    const WiFiScanEntry* seen;
+    uint8_t best = pickCandidate(score, seen, false);
+    if (best == NO_CANDIDATE || !connectCandidate(best, seen)) {
+        result.state = WiFiConnectionState::CONNECTION_FAILED;
+        result.errorMessage = "No known networks";
+        return result;
+    }
+    result.state = connectionState;
+    result.attemptCount = 1;
+    return result;
+}
+
+void WiFiManager::loadKnownNetworks() {
+    for (uint8_t i = 0; i < WIBLE_WIFI_MAX_NETWORKS; i++) {
+        knownNetworks[i] = StoredNetwork();
+        if (storage && storage->read(networkRecord(i), knownNetworks[i])) {
+            knownNetworks[i].ssid[sizeof(knownNetworks[i].ssid) - 1] = '\0';
+            knownNetworks[i].password[sizeof(knownNetworks[i].password) - 1] = '\0';
+        }
+    }
+}
+
+bool WiFiManager::candidateAt(uint8_t index, StoredNetwork& network) {
+    if (index < WIBLE_WIFI_MAX_NETWORKS) {
+        if (knownNetworks[index].ssid[0] == '\0') return false;
+        network = knownNetworks[index];
+        return true;
+    }
+    
+    // Last candidate: the provisioned network, unless it is also in the table
+    StoredCredentials credentials;
+    if (!storage || !storage->read(StorageRecord::CREDENTIALS, credentials)) return false;
+    bool known = false;
+    for (const StoredNetwork& entry : knownNetworks) {
+        if (strncmp(entry.ssid, credentials.ssid, sizeof(entry.ssid)) == 0) known = true;
+    }
+    network = StoredNetwork();
+    if (!known && credentials.ssid[0] != '\0') {
+        memcpy(network.ssid, credentials.ssid, sizeof(network.ssid) - 1);
+        memcpy(network.password, credentials.password, sizeof(network.password) - 1);
+    }
+    SecurityUtils::secureWipe((uint8_t*)&credentials, sizeof(credentials));
+    return network.ssid[0] != '\0';
+}
+
+int16_t WiFiManager::scoreNetwork(const StoredNetwork& network, int16_t rssi) const {
+    uint8_t successes = network.successes < WIBLE_ROAM_HISTORY_CAP ? network.successes : WIBLE_ROAM_HISTORY_CAP;
+    return rssi + network.priority * WIBLE_ROAM_PRIORITY_DB + successes * WIBLE_ROAM_SUCCESS_DB -
+           network.failureStreak * WIBLE_ROAM_FAILURE_DB;
+}
+
+uint8_t WiFiManager::pickCandidate(int16_t& score, const WiFiScanEntry*& seen, bool seenOnly) {
+    uint8_t best = NO_CANDIDATE;
+    score = 0;
+    seen = nullptr;
+    
+    // Known slots, then the provisioned network
+    for (uint8_t i = 0; i <= WIBLE_WIFI_MAX_NETWORKS; i++) {
+        if (roamTried & (1 << i)) continue;
+        StoredNetwork network;
+        if (!candidateAt(i, network)) continue;
         
-    } else {
-        result.success = false;
-        result.state = WiFiConnectionState::DISCONNECTED;
-        result.errorMessage = "Timeout";
-        LogManager::error("WiFi Connection Failed");
+        const WiFiScanEntry* entry = findScanEntry(network.ssid);
+        if (!seenOnly || (entry && entry->rssi >= config.minRSSI)) {
+            int16_t candidateScore = scoreNetwork(network, entry ? entry->rssi : WIBLE_ROAM_UNSEEN_RSSI);
+            if (best == NO_CANDIDATE || candidateScore > score) {
+                best = i;
+                score = candidateScore;
+                seen = entry;
+            }
+        }
+        SecurityUtils::secureWipe((uint8_t*)&network, sizeof(network));
+    }
+    return best;
+}
+
+bool WiFiManager::connectCandidate(uint8_t index, const WiFiScanEntry* seen) {
+    StoredNetwork network;
+    if (!candidateAt(index, network)) return false;
+    roamTried |= 1 << index;
+    
+    currentSSID = network.ssid;
+    currentPassword = network.password;
+    SecurityUtils::secureWipe((uint8_t*)&network, sizeof(network));
+    
+    // Seen in the cached scan: go straight to its AP and channel
+    if (seen && seen->channel) setConnectionHint(currentSSID, seen->bssid, seen->channel);
+    
+    maxAttempts = 1;
+    retryPending = false;
+    roamRound = true;
+    connectInternal(currentSSID, currentPassword, 1);
+    return true;
+}
+
+void WiFiManager::recordOutcome(bool success) {
+    for (uint8_t i = 0; i < WIBLE_WIFI_MAX_NETWORKS; i++) {
+        StoredNetwork& network = knownNetworks[i];
+        if (currentSSID != network.ssid) continue;
         
-        if (disconnectedCallback) {
-            disconnectedCallback(WiFiDisconnectReason::UNKNOWN, "Connection timeout");
+        // Saturating counters, so a stable network stops rewriting its record
+        StoredNetwork updated = network;
+        if (success) {
+            if (updated.successes < WIBLE_ROAM_HISTORY_CAP) updated.successes++;
+            updated.failureStreak = 0;
+        } else if (updated.failureStreak < 7) {
+            updated.failureStreak++;
+        }
+        if (memcmp(&updated, &network, sizeof(updated)) != 0) {
+            network = updated;
+            if (storage) storage->write(networkRecord(i), network);
         }
+        SecurityUtils::secureWipe((uint8_t*)&updated, sizeof(updated));
+        return;
     }
+}
+
+void WiFiManager::monitorRoaming() {
+    uint32_t now = millis();
+    if (!config.enableRoaming || now - lastRoamCheckAt < config.roamCheckIntervalMs) return;
+    lastRoamCheckAt = now;
     
-    return result;
+    int16_t rssi = WiFi.RSSI();
+    if (rssi == 0) return;
+    smoothedRssi = smoothedRssi == 0 ? rssi : (smoothedRssi * 3 + rssi) / 4;
+    if (smoothedRssi >= config.roamRssiThreshold || isScanning) return;
+    
+    // Weak link: look for a better AP in the cache, refreshing it now and then
+    if (!isScanCacheFresh()) {
+        if (lastRoamScanAt == 0 || now - lastRoamScanAt >= config.roamScanIntervalMs) {
+            lastRoamScanAt = now;
+            startScan(true);
+        }
+        return;
+    }
+    
+    int16_t currentScore = smoothedRssi;
+    for (const StoredNetwork& network : knownNetworks) {
+        if (currentSSID == network.ssid) currentScore = scoreNetwork(network, smoothedRssi);
+    }
+    
+    roamTried = 0;
+    int16_t score;
+    const WiFiScanEntry* seen;
+    uint8_t best = pickCandidate(score, seen, true);
+    if (best == NO_CANDIDATE || score < currentScore + config.roamHysteresisDb) return;
+    
+    // The best AP is the one we are on
+    const uint8_t* bssid = WiFi.BSSID();
+    if (currentSSID == seen->ssid && bssid && memcmp(bssid, seen->bssid, sizeof(seen->bssid)) == 0) return;
+    
+    LogManager::info("Roaming from " + currentSSID + " (" + String((int)smoothedRssi) + " dBm) to " +
+                     String(seen->ssid) + " (" + String((int)seen->rssi) + " dBm)");
+    roaming = true;
+    roamStartedAt = now;
+    reconnectAttemptCount = 0;
+    ignoreNextDisconnect = true;
+    WiFi.disconnect(false);
+    connectCandidate(best, seen);
 }
 
-void WiFiManager::disconnect() {
-    WiFi.disconnect(true);
-    LogManager::info("WiFi Disconnected");
+// ============================================================================
+// CONNECTIVITY TESTING
+// ============================================================================
+
+bool WiFiManager::startValidation(const ValidationConfig& validationConfig) {
+    if (!isConnected()) return false;
+    if (!validator) validator = std::unique_ptr<ConnectivityValidator>(new ConnectivityValidator());
+    lastValidation = ValidationResult();
+    validator->start(validationConfig, (uint32_t)WiFi.gatewayIP(), (uint32_t)WiFi.dnsIP(0));
+    return true;
+}
+
+void WiFiManager::cancelValidation() {
+    if (!isValidating()) return;
+    validator->cancel();
+    monitorValidation();
+}
+
+bool WiFiManager::isValidating() const {
+    return validator && validator->isRunning();
+}
+
+void WiFiManager::monitorValidation() {
+    // A dropped link (or a roam) leaves nothing to validate
+    if (connectionState != WiFiConnectionState::CONNECTED) validator->cancel();
+    if (!validator->poll()) return;
+    
+    lastValidation = validator->getResult();
+    if (validationCallback) validationCallback(lastValidation);
+}
+
+ValidationResult WiFiManager::runValidation(const ValidationConfig& validationConfig, uint32_t target) {
+    // Own instance, so a blocking check never disturbs a background one
+    ConnectivityValidator check;
+    check.start(validationConfig, target, (uint32_t)WiFi.dnsIP(0));
+    while (!check.poll()) delay(5);
+    return check.getResult();
+}
+
+bool WiFiManager::pingGateway(uint32_t timeoutMs) {
+    return pingHost(WiFi.gatewayIP().toString(), timeoutMs);
+}
+
+bool WiFiManager::pingHost(const String& host, uint32_t timeoutMs) {
+    if (!isConnected()) return false;
+    
+    IPAddress target;
+    if (!target.fromString(host)) {
+        ValidationConfig lookup;
+        lookup.pingGateway = false;
+        lookup.probeHttp = false;
+        lookup.host = host;
+        lookup.timeoutMs = timeoutMs;
+        ValidationResult resolved = runValidation(lookup, 0);
+        if (resolved.dns.status != StageStatus::PASSED) return false;
+        target = IPAddress(resolved.resolvedAddress);
+    }
+    
+    ValidationConfig ping;
+    ping.probeHttp = false;
+    ping.host = "";
+    ping.timeoutMs = timeoutMs;
+    ping.retryMs = timeoutMs / 3;
+    return runValidation(ping, (uint32_t)target).gateway.status == StageStatus::PASSED;
+}
+
+bool WiFiManager::hasInternetAccess(uint32_t timeoutMs) {
+    if (!isConnected()) return false;
+    
+    ValidationConfig check;
+    check.pingGateway = false;      // Never decisive
+    check.timeoutMs = timeoutMs;
+    return runValidation(check, 0).success;
+}
+
+uint8_t WiFiManager::getConnectionQuality() {
+    if (!isConnected()) return 0;
+    
+    // 60 points of signal, 40 of reachability
+    uint32_t score = (uint32_t)WiFiUtils::rssiToQuality((int8_t)WiFi.RSSI()) * 60 / 100;
+    switch (lastValidation.outcome) {
+        case ValidationOutcome::REACHABLE: {
+            // Slow lookups and probes cost up to half the reachability share
+            uint32_t latency = 0;
+            if (lastValidation.dns.latencyMs != WIBLE_VALIDATION_NOT_MEASURED) latency += lastValidation.dns.latencyMs;
+            if (lastValidation.probe.latencyMs != WIBLE_VALIDATION_NOT_MEASURED) latency += lastValidation.probe.latencyMs;
+            uint32_t penalty = latency / 50;
+            score += 40 - (penalty > 20 ? 20 : penalty);
+            break;
+        }
+        case ValidationOutcome::PENDING:
+            score += 20;    // Not validated (yet)
+            break;
+        case ValidationOutcome::CAPTIVE_PORTAL:
+            score += 10;
+            break;
+        default:
+            break;
+    }
+    return (uint8_t)score;
 }
 
 // ============================================================================
@@ -171,31 +1106,76 @@ void WiFiManager::disconnect() {
 // ============================================================================
 
 bool WiFiManager::saveCredentials(const String& ssid, const String& password) {
-    Preferences prefs;
-    if (!prefs.begin("wible_creds", false)) return false;
-    
-    prefs.putString("ssid", ssid);
-    prefs.putString("pass", password);
-    prefs.end();
-    return true;
+    // Unchanged credentials (every reconnect) never reach flash
+    return storage && storage->saveCredentials(ssid, password);
 }
 
 bool WiFiManager::loadCredentials(String& ssid, String& password) {
-    Preferences prefs;
-    if (!prefs.begin("wible_creds", true)) return false;
+    return storage && storage->loadCredentials(ssid, password);
+}
+
+void WiFiManager::clearCredentials() {
+    if (storage) {
+        storage->erase(StorageRecord::CREDENTIALS);
+        storage->erase(StorageRecord::CONNECTION_CACHE);
+    }
+    connectionCache = WiFiConnectionCache();
+}
+
+bool WiFiManager::hasStoredCredentials() const {
+    return storage && storage->exists(StorageRecord::CREDENTIALS);
+}
+
+void WiFiManager::clearConnectionCache() {
+    connectionCache = WiFiConnectionCache();
+    if (storage) storage->erase(StorageRecord::CONNECTION_CACHE);
+}
+
+void WiFiManager::setConnectionHint(const String& ssid, const uint8_t* bssid, uint8_t channel) {
+    if (!bssid || channel == 0) return;
     
-    ssid = prefs.getString("ssid", "");
-    password = prefs.getString("pass", "");
-    prefs.end();
+    WiFiConnectionCache hint;
+    hint.version = WIBLE_WIFI_CACHE_VERSION;
+    hint.channel = channel;
+    memcpy(hint.bssid, bssid, sizeof(hint.bssid));
+    strncpy(hint.ssid, ssid.c_str(), sizeof(hint.ssid) - 1);
+    connectionCache = hint;
+}
+
+void WiFiManager::setConnectionCache(const WiFiConnectionCache& cache) {
+    if (!cache.isValid()) return;
+    connectionCache = cache;
+    connectionCache.ssid[sizeof(connectionCache.ssid) - 1] = '\0';
+}
+
+void WiFiManager::loadConnectionCache() {
+    connectionCache = WiFiConnectionCache();
     
-    return !ssid.isEmpty();
+    WiFiConnectionCache stored;
+    if (storage && storage->read(StorageRecord::CONNECTION_CACHE, stored) && stored.isValid()) {
+        stored.ssid[sizeof(stored.ssid) - 1] = '\0';
+        connectionCache = stored;
+    }
 }
 
-void WiFiManager::clearCredentials() {
-    Preferences prefs;
-    if (prefs.begin("wible_creds", false)) {
-        prefs.clear();
-        prefs.end();
+void WiFiManager::updateConnectionCache() {
+    WiFiConnectionCache fresh;
+    fresh.version = WIBLE_WIFI_CACHE_VERSION;
+    fresh.channel = (uint8_t)WiFi.channel();
+    const uint8_t* bssid = WiFi.BSSID();
+    if (bssid) memcpy(fresh.bssid, bssid, sizeof(fresh.bssid));
+    strncpy(fresh.ssid, currentSSID.c_str(), sizeof(fresh.ssid) - 1);
+    
+    fresh.ip = (uint32_t)WiFi.localIP();
+    fresh.gateway = (uint32_t)WiFi.gatewayIP();
+    fresh.subnet = (uint32_t)WiFi.subnetMask();
+    fresh.dns = (uint32_t)WiFi.dnsIP(0);
+    
+    if (memcmp(&fresh, &connectionCache, sizeof(fresh)) == 0) return;
+    connectionCache = fresh;
+    
+    if (config.persistCredentials && storage) {
+        storage->write(StorageRecord::CONNECTION_CACHE, connectionCache);
     }
 }
 
@@ -203,6 +1183,10 @@ void WiFiManager::clearCredentials() {
 // INFO & STATUS
 // ============================================================================
 
+WiFiManager::ConnectionStats WiFiManager::getStatistics() const {
+    return statistics;
+}
+
 ConnectionInfo WiFiManager::getConnectionInfo() const {
     ConnectionInfo info;
     if (WiFi.status() == WL_CONNECTED) {
@@ -220,10 +1204,26 @@ bool WiFiManager::isConnected() const {
     return WiFi.status() == WL_CONNECTED;
 }
 
+WiFiConnectionState WiFiManager::getConnectionState() const {
+    return connectionState;
+}
+
+void WiFiManager::setAutoReconnect(bool enabled) {
+    autoReconnectEnabled = enabled;
+}
+
+bool WiFiManager::isAutoReconnectEnabled() const {
+    return autoReconnectEnabled;
+}
+
 String WiFiManager::getIPAddress() const {
     return WiFi.localIP().toString();
 }
 
+int8_t WiFiManager::getRSSI() const {
+    return (int8_t)WiFi.RSSI();
+}
+
 // ============================================================================
 // CALLBACK REGISTRATION
 // ============================================================================
@@ -240,24 +1240,79 @@ void WiFiManager::onScanComplete(WiFiScanCompleteCallback callback) {
     scanCompleteCallback = callback;
 }
 
+void WiFiManager::onScanProgress(WiFiScanProgressCallback callback) {
+    scanProgressCallback = callback;
+}
+
+void WiFiManager::onValidationComplete(ValidationCallback callback) {
+    validationCallback = callback;
+}
+
 void WiFiManager::onConnectionProgress(WiFiConnectionProgressCallback callback) {
     progressCallback = callback;
 }
 
+void WiFiManager::onIPAcquired(WiFiIPAcquiredCallback callback) {
+    ipAcquiredCallback = callback;
+}
+
 // ============================================================================
-// PLACEHOLDERS
+// IP CONFIGURATION
 // ============================================================================
 
-void WiFiManager::monitor() {
-    // Check connection status periodically
-    // Handle auto-reconnect if needed
+bool WiFiManager::configureStaticIP(const String& ip, const String& gateway, const String& subnet, const String& dns1, const String& dns2) {
+    IPAddress localIP, gatewayIP, subnetMask, primaryDNS, secondaryDNS;
+    if (!localIP.fromString(ip) || !gatewayIP.fromString(gateway) || !subnetMask.fromString(subnet)) {
+        LogManager::error("Invalid static IP configuration");
+        return false;
+    }
+    if (!dns1.isEmpty()) primaryDNS.fromString(dns1);
+    if (!dns2.isEmpty()) secondaryDNS.fromString(dns2);
+    
+    if (!WiFi.config(localIP, gatewayIP, subnetMask, primaryDNS, secondaryDNS)) return false;
+    
+    releaseCachedLease();
+    config.useDHCP = false;
+    config.staticIP = ip;
+    config.gateway = gateway;
+    config.subnet = subnet;
+    config.dns1 = dns1;
+    config.dns2 = dns2;
+    return true;
 }
 
-bool WiFiManager::configureStaticIP(const String& ip, const String& gateway, const String& subnet, const String& dns1, const String& dns2) {
-    // IPAddress local_ip, gw, sn, d1, d2;
-    // local_ip.fromString(ip); ...
-    // return WiFi.config(local_ip, gw, sn, d1, d2);
-    return true; 
+void WiFiManager::enableDHCP() {
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    leaseApplied = false;
+    config.useDHCP = true;
+    config.staticIP = "";
+}
+
+bool WiFiManager::isDHCPEnabled() const {
+    return config.useDHCP;
+}
+
+// ============================================================================
+// WIFI UTILITIES
+// ============================================================================
+
+uint8_t WiFiUtils::rssiToQuality(int8_t rssi) {
+    if (rssi <= -100) return 0;
+    if (rssi >= -50) return 100;
+    return (uint8_t)(2 * (rssi + 100));
+}
+
+const char* WiFiUtils::disconnectReasonToString(WiFiDisconnectReason reason) {
+    switch (reason) {
+        case WiFiDisconnectReason::USER_REQUESTED: return "User requested";
+        case WiFiDisconnectReason::CONNECTION_TIMEOUT: return "Connection timeout";
+        case WiFiDisconnectReason::AUTHENTICATION_FAILED: return "Authentication failed";
+        case WiFiDisconnectReason::SSID_NOT_FOUND: return "SSID not found";
+        case WiFiDisconnectReason::WEAK_SIGNAL: return "Weak signal";
+        case WiFiDisconnectReason::AP_DISCONNECTED: return "AP disconnected";
+        case WiFiDisconnectReason::DHCP_FAILED: return "DHCP failed";
+        default: return "Unknown";
+    }
 }
 
 } // namespace WiBLE
@@ -13,6 +13,29 @@
 #include <functional>
 #include <vector>
 #include <map>
+#include <atomic>
+#include <memory>
+#include "StorageManager.h"
+#include "ConnectivityValidator.h"
+
+#define WIBLE_WIFI_CACHE_VERSION     1
+
+// Networks kept by the scan cache (strongest first, one per SSID)
+#ifndef WIBLE_WIFI_SCAN_CACHE_SIZE
+#define WIBLE_WIFI_SCAN_CACHE_SIZE   24
+#endif
+
+// Known networks (addNetwork); one storage record each
+#define WIBLE_WIFI_MAX_NETWORKS      WIBLE_STORAGE_NETWORK_SLOTS
+
+// Roaming score: RSSI in dBm, plus these per priority step and past success,
+// minus per consecutive failure. Networks missing from the scan cache count
+// as WIBLE_ROAM_UNSEEN_RSSI.
+#define WIBLE_ROAM_PRIORITY_DB       6
+#define WIBLE_ROAM_SUCCESS_DB        2
+#define WIBLE_ROAM_FAILURE_DB        10
+#define WIBLE_ROAM_HISTORY_CAP       5
+#define WIBLE_ROAM_UNSEEN_RSSI       (-100)
 
 namespace WiBLE {
 
@@ -70,7 +93,9 @@ struct WiFiConfig {
     // Scanning
     bool scanHiddenNetworks = true;
     uint8_t maxScanResults = 20;
-    uint32_t scanTimeoutMs = 5000;
+    uint32_t scanTimeoutMs = 5000;      // Per channel sweep
+    uint32_t scanCacheTtlMs = 30000;    // Results younger than this are served without scanning
+    uint16_t scanDwellMs = 120;         // Active scan time per channel
     
     // Power management
     bool enablePowerSaving = false;
@@ -87,8 +112,17 @@ struct WiFiConfig {
     // Advanced
     int8_t minRSSI = -80;  // Minimum acceptable signal strength
     uint8_t channel = 0;   // 0 = auto
-    bool fastConnect = false;  // Skip scan if SSID/channel known
+    bool fastConnect = true;   // Directed connect to the cached BSSID/channel, full scan on failure
+    uint32_t fastConnectTimeoutMs = 4000;
+    bool reuseIPLease = false; // Also reapply the cached IP/gateway/DNS, skipping DHCP (networks with stable leases)
     uint16_t keepAliveIntervalS = 60;
+    
+    // Roaming between known networks (addNetwork) and between APs of one SSID
+    bool enableRoaming = true;
+    int8_t roamRssiThreshold = -72;     // Smoothed RSSI below this looks for a better AP
+    uint8_t roamHysteresisDb = 8;       // Score margin a candidate needs over the current link
+    uint32_t roamCheckIntervalMs = 2000;
+    uint32_t roamScanIntervalMs = 30000;    // Background scans while the link stays weak
 };
 
 // ============================================================================
@@ -111,6 +145,40 @@ struct NetworkInfo {
     uint8_t getSignalQuality() const;  // 0-100%
 };
 
+/**
+ * Last good association, persisted next to the credentials so reconnects
+ * can skip the all-channel scan (and optionally DHCP). Laid out without
+ * padding so it can be compared and stored as raw bytes.
+ */
+struct WiFiConnectionCache {
+    uint32_t ip = 0;            // Last lease, as held by IPAddress
+    uint32_t gateway = 0;
+    uint32_t subnet = 0;
+    uint32_t dns = 0;
+    uint8_t version = 0;        // WIBLE_WIFI_CACHE_VERSION when valid
+    uint8_t channel = 0;
+    uint8_t bssid[6] = {0};
+    char ssid[33] = {0};        // Network the entry belongs to
+    uint8_t reserved[3] = {0};
+    
+    bool isValid() const { return version == WIBLE_WIFI_CACHE_VERSION && channel != 0; }
+    bool hasLease() const { return ip != 0 && subnet != 0; }
+};
+
+/**
+ * One network in the scan cache. scanId/sweep tell which scan and which
+ * channel sweep last changed it, so results can be streamed per sweep.
+ */
+struct WiFiScanEntry {
+    char ssid[33] = {0};
+    uint8_t bssid[6] = {0};             // Strongest AP seen for the SSID
+    int8_t rssi = 0;
+    uint8_t channel = 0;
+    WiFiSecurityType security = WiFiSecurityType::OPEN;
+    uint16_t scanId = 0;
+    uint8_t sweep = 0;
+};
+
 struct ConnectionInfo {
     String ssid;
     String ipAddress;
@@ -134,14 +202,16 @@ struct ConnectionResult {
     bool success;
     WiFiConnectionState state;
     WiFiDisconnectReason failureReason;
-    String errorMessage;
-    uint32_t connectionTimeMs;
+    const char* errorMessage;   // Static text, nullptr on success
+    uint32_t connectionTimeMs;  // Connect start to IP acquired, including fallbacks and retries
     uint8_t attemptCount;
+    bool fastConnect;           // Completed through the cached BSSID/channel
+    bool roamed;                // Reached through roaming or failover
     
     ConnectionResult() : success(false), 
                         state(WiFiConnectionState::DISCONNECTED),
                         failureReason(WiFiDisconnectReason::UNKNOWN),
-                        connectionTimeMs(0), attemptCount(0) {}
+                        errorMessage(nullptr), connectionTimeMs(0), attemptCount(0), fastConnect(false), roamed(false) {}
 };
 
 // ============================================================================
@@ -149,10 +219,12 @@ struct ConnectionResult {
 // ============================================================================
 
 using WiFiMgrConnectedCallback = std::function<void(const ConnectionInfo& info)>;
-using WiFiMgrDisconnectedCallback = std::function<void(WiFiDisconnectReason reason, String message)>;
+using WiFiMgrDisconnectedCallback = std::function<void(WiFiDisconnectReason reason, const char* message)>;
 using WiFiScanCompleteCallback = std::function<void(const std::vector<NetworkInfo>& networks)>;
+using WiFiScanProgressCallback = std::function<void(const WiFiScanEntry* updated, size_t count,
+                                                    uint8_t progress, bool complete)>;
 using WiFiIPAcquiredCallback = std::function<void(String ipAddress)>;
-using WiFiConnectionProgressCallback = std::function<void(uint8_t progress, String status)>;
+using WiFiConnectionProgressCallback = std::function<void(uint8_t progress, const char* status)>;
 
 // ============================================================================
 // WIFI MANAGER CLASS
@@ -172,6 +244,12 @@ public:
      */
     bool initialize(const WiFiConfig& config = WiFiConfig());
     
+    /**
+     * Persist through a shared StorageManager (set before initialize()).
+     * Without one, the manager opens its own, writing through.
+     */
+    void setStorage(StorageManager* storage) { this->storage = storage; }
+    
     /**
      * Cleanup WiFi resources
      */
@@ -192,27 +270,45 @@ public:
     // ========================================================================
     
     /**
-     * Scan for available networks (blocking)
+     * Scan for available networks. Served from the cache while it is
+     * fresh; otherwise blocks for a full scan, which refills it.
      */
     std::vector<NetworkInfo> scanNetworks(bool showHidden = false);
     
     /**
-     * Scan for available networks (non-blocking)
+     * Scan for available networks (non-blocking). The callback runs from
+     * monitor() when the scan ends, or right away from a fresh cache.
      */
     void scanNetworksAsync(WiFiScanCompleteCallback callback);
     
     /**
-     * Check if specific SSID is available
+     * Refresh the scan cache in the background, one channel at a time
+     * (1, 6 and 11 first). Each finished sweep is reported through
+     * onScanProgress with the networks it added or improved.
+     * @param force Scan even if the cache is still fresh
+     * @return true if a scan is running
+     */
+    bool startScan(bool force = false);
+    bool isScanInProgress() const { return isScanning; }
+    bool isScanCacheFresh() const;
+    
+    /**
+     * Cached networks, strongest first
+     */
+    const WiFiScanEntry* getScanResults(size_t& count) const;
+    
+    /**
+     * Check if specific SSID is in the scan cache
      */
     bool isNetworkAvailable(const String& ssid);
     
     /**
-     * Get network info by SSID
+     * Get network info by SSID, from the scan cache
      */
     NetworkInfo getNetworkInfo(const String& ssid);
     
     /**
-     * Get strongest network
+     * Get strongest cached network of the list (empty SSID if none)
      */
     NetworkInfo getStrongestNetwork(const std::vector<String>& ssidList);
     
@@ -221,16 +317,23 @@ public:
     // ========================================================================
     
     /**
-     * Connect to WiFi network
+     * Connect to WiFi network (non-blocking).
+     * Returns with state CONNECTING once the attempt is started; the outcome
+     * is reported from monitor() through onConnected/onDisconnected.
      */
     ConnectionResult connect(const String& ssid, const String& password,
                             WiFiSecurityType securityType = WiFiSecurityType::WPA2_PSK);
     
     /**
-     * Connect with retry logic
+     * Connect with retry logic (non-blocking, exponential backoff between attempts)
      */
     ConnectionResult connectWithRetry(const String& ssid, const String& password);
     
+    /**
+     * Result of the last completed connection attempt
+     */
+    const ConnectionResult& getLastConnectionResult() const { return lastResult; }
+    
     /**
      * Disconnect from current network
      */
@@ -295,10 +398,33 @@ public:
     bool hasStoredCredentials() const;
     
     /**
-     * Connect using stored credentials
+     * Connect using stored credentials (directed to the cached AP when known)
      */
     ConnectionResult connectWithStoredCredentials();
     
+    /**
+     * Cached association for the stored network
+     */
+    const WiFiConnectionCache& getConnectionCache() const { return connectionCache; }
+    
+    /**
+     * Take a cached association kept outside NVS (the RTC snapshot after
+     * deep sleep); invalid entries are ignored
+     */
+    void setConnectionCache(const WiFiConnectionCache& cache);
+    
+    /**
+     * Forget the cached BSSID/channel/lease; the next connect scans
+     */
+    void clearConnectionCache();
+    
+    /**
+     * Direct the next connect to this AP (e.g. from the provisioning app),
+     * with the usual scan fallback. Replaces the cached association in
+     * memory only; it is persisted once the connection succeeds.
+     */
+    void setConnectionHint(const String& ssid, const uint8_t* bssid, uint8_t channel);
+    
     // ========================================================================
     // NETWORK INFORMATION
     // ========================================================================
@@ -393,22 +519,37 @@ public:
     // ========================================================================
     
     /**
-     * Ping gateway
+     * Validate the connection in the background: gateway ping, DNS and
+     * captive-portal probe at once. monitor() drives it; the verdict goes
+     * to onValidationComplete. Needs a connection.
+     */
+    bool startValidation(const ValidationConfig& config = ValidationConfig());
+    void cancelValidation();
+    bool isValidating() const;
+    
+    /**
+     * Last verdict for the current connection (PENDING if none)
+     */
+    const ValidationResult& getLastValidation() const { return lastValidation; }
+    
+    /**
+     * Ping gateway (blocks up to timeoutMs)
      */
     bool pingGateway(uint32_t timeoutMs = 1000);
     
     /**
-     * Ping specific host
+     * Ping specific host, resolving it first (blocks up to 2 * timeoutMs)
      */
     bool pingHost(const String& host, uint32_t timeoutMs = 1000);
     
     /**
-     * Test internet connectivity
+     * Test internet connectivity (blocks until the first decisive answer)
      */
     bool hasInternetAccess(uint32_t timeoutMs = 5000);
     
     /**
-     * Get connection quality score (0-100)
+     * Get connection quality score (0-100): signal, plus the last
+     * validation verdict and its latency
      */
     uint8_t getConnectionQuality();
     
@@ -417,9 +558,10 @@ public:
     // ========================================================================
     
     /**
-     * Add network to priority list
+     * Add or update a known network (persisted; WIBLE_WIFI_MAX_NETWORKS).
+     * A full table replaces its lowest-priority entry, if no higher.
      */
-    void addNetwork(const String& ssid, const String& password, uint8_t priority = 0);
+    bool addNetwork(const String& ssid, const String& password, uint8_t priority = 0);
     
     /**
      * Remove network from list
@@ -427,12 +569,20 @@ public:
     void removeNetwork(const String& ssid);
     
     /**
-     * Connect to best available network from list
+     * Forget every known network
+     */
+    void clearNetworks();
+    
+    /**
+     * Connect to the best known network, scored by priority, cached RSSI
+     * and connection history, without scanning. The provisioned
+     * credentials take part at priority 0. A failed candidate hands over to
+     * the next one right away.
      */
     ConnectionResult connectToBestNetwork();
     
     /**
-     * Get network list
+     * Known SSIDs, highest priority first
      */
     std::vector<String> getNetworkList() const;
     
@@ -443,6 +593,8 @@ public:
     void onConnected(WiFiMgrConnectedCallback callback);
     void onDisconnected(WiFiMgrDisconnectedCallback callback);
     void onScanComplete(WiFiScanCompleteCallback callback);
+    void onScanProgress(WiFiScanProgressCallback callback);
+    void onValidationComplete(ValidationCallback callback);
     void onIPAcquired(WiFiIPAcquiredCallback callback);
     void onConnectionProgress(WiFiConnectionProgressCallback callback);
     
@@ -467,6 +619,9 @@ public:
         uint32_t totalUptime;
         uint32_t totalDowntime;
         uint32_t longestConnection;
+        uint32_t totalRoams;            // Proactive roams and failovers that connected
+        uint32_t lastRoamTimeMs;        // Decision (or link loss) to IP
+        uint32_t averageRoamTimeMs;
     };
     
     ConnectionStats getStatistics() const;
@@ -495,13 +650,44 @@ private:
     uint32_t lastReconnectAttempt;
     uint8_t reconnectAttemptCount;
     
-    // Multi-network support
-    struct NetworkEntry {
-        String ssid;
-        String password;
-        uint8_t priority;
+    // Connect attempt state (driven by monitor())
+    uint8_t attemptNumber;
+    uint8_t maxAttempts;
+    bool retryPending;
+    uint32_t attemptStartTime;
+    uint32_t nextRetryAt;
+    uint32_t lastProgressAt;
+    bool directedAttempt;           // Current attempt targets the cached BSSID/channel
+    bool leaseApplied;              // Cached lease set as a static config for this attempt
+    ConnectionResult lastResult;
+    
+    WiFiConnectionCache connectionCache;
+    
+    // Persistence
+    StorageManager* storage;
+    std::unique_ptr<StorageManager> ownedStorage;
+    
+    // Set from the WiFi event task, consumed by monitor()
+    enum PendingEvent : uint8_t {
+        EVENT_STA_CONNECTED = 1 << 0,
+        EVENT_GOT_IP        = 1 << 1,
+        EVENT_DISCONNECTED  = 1 << 2,
+        EVENT_SCAN_DONE     = 1 << 3
     };
-    std::vector<NetworkEntry> knownNetworks;
+    std::atomic<uint8_t> pendingEvents;
+    
+    // Multi-network support; slot i is storage record NETWORK_i
+    StoredNetwork knownNetworks[WIBLE_WIFI_MAX_NETWORKS];
+    
+    // Roaming state
+    bool roamRound;                 // Failing candidates hand over to the next one
+    bool roaming;                   // A roam or failover is in progress
+    bool ignoreNextDisconnect;      // The old AP's disconnect after a proactive roam
+    uint8_t roamTried;              // Candidates tried this round (bit per candidate)
+    int16_t smoothedRssi;           // Link RSSI average while connected (0 = none yet)
+    uint32_t roamStartedAt;
+    uint32_t lastRoamCheckAt;
+    uint32_t lastRoamScanAt;
     
     // Statistics
     ConnectionStats statistics;
@@ -514,28 +700,61 @@ private:
     WiFiScanCompleteCallback scanCompleteCallback;
     WiFiIPAcquiredCallback ipAcquiredCallback;
     WiFiConnectionProgressCallback progressCallback;
+    WiFiScanProgressCallback scanProgressCallback;
+    ValidationCallback validationCallback;
+    
+    // Connectivity validation (created on first use)
+    std::unique_ptr<ConnectivityValidator> validator;
+    ValidationResult lastValidation;
     
     // Scan state
-    bool scanInProgress;
     bool isScanning;
-    std::vector<NetworkInfo> lastScanResults;
+    bool scanCacheValid;
+    uint8_t scanSweep;              // Index into the channel order
+    uint16_t scanId;
+    uint32_t sweepStartedAt;
+    uint32_t scanCacheAt;
+    WiFiScanEntry scanCache[WIBLE_WIFI_SCAN_CACHE_SIZE];
+    size_t scanCacheCount;
     
     // Internal methods
     bool connectInternal(const String& ssid, const String& password, 
                         uint8_t attemptNumber = 1);
+    void beginAssociation(const String& ssid, const String& password, bool directed);
+    bool canFastConnect(const String& ssid) const;
+    void loadConnectionCache();
+    void updateConnectionCache();
+    void releaseCachedLease();
     void handleConnectionSuccess();
     void handleConnectionFailure(WiFiDisconnectReason reason);
     void updateConnectionState(WiFiConnectionState newState);
     uint32_t calculateRetryDelay(uint8_t attemptNumber);
     WiFiDisconnectReason getDisconnectReason();
     void updateStatistics();
-    void notifyProgress(uint8_t progress, const String& status);
-    NetworkInfo convertWiFiScanResult(int index);
+    void processConnectingState(uint8_t events);
+    void notifyProgress(uint8_t progress, const char* status);
+    bool startChannelSweep();
+    void processScan(uint8_t events);
+    void finishScan(bool complete);
+    void ingestScanResults(int16_t count);
+    void reportSweep(bool complete);
+    std::vector<NetworkInfo> cachedNetworks() const;
+    const WiFiScanEntry* findScanEntry(const char* ssid) const;
+    bool candidateAt(uint8_t index, StoredNetwork& network);
+    int16_t scoreNetwork(const StoredNetwork& network, int16_t rssi) const;
+    uint8_t pickCandidate(int16_t& score, const WiFiScanEntry*& seen, bool seenOnly);
+    bool connectCandidate(uint8_t index, const WiFiScanEntry* seen);
+    void recordOutcome(bool success);
+    void monitorRoaming();
+    void monitorValidation();
+    ValidationResult runValidation(const ValidationConfig& config, uint32_t target);
+    void loadKnownNetworks();
     WiFiSecurityType getSecurityType(wifi_auth_mode_t authMode);
-    static void WiFiEventHandler(WiFiEvent_t event);
+    void handleWiFiEvent(WiFiEvent_t event);
     
-    // Static instance for event handler
-    static WiFiManager* instance;
+    // Registered per instance, so each manager hears its own interface
+    wifi_event_id_t wifiEventId;
+    bool wifiEventRegistered;
 };
 
 // ============================================================================
@@ -577,7 +796,7 @@ public:
     /**
      * Get disconnect reason string
      */
-    static String disconnectReasonToString(WiFiDisconnectReason reason);
+    static const char* disconnectReasonToString(WiFiDisconnectReason reason);
     
     /**
      * Check if IP address is valid
@@ -0,0 +1,358 @@
+/**
+ * AdvertisingData.h - Zero-copy BLE advertising data parser and builder
+ *
+ * AdvertisingDataView walks the AD structures ([length][type][data...]) of
+ * a raw payload in place; every AdStructure points into the caller's
+ * buffer. AdvertisingDataBuilder appends AD structures to a fixed inline
+ * buffer: 31 bytes for legacy advertising, up to 255 for extended
+ * advertising sets. The frame layouts below give fixed offsets, so a
+ * beacon's changing fields can be patched in place.
+ */
+
+#ifndef WIBLE_ADVERTISING_DATA_H
+#define WIBLE_ADVERTISING_DATA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace WiBLE {
+
+// ============================================================================
+// AD TYPES
+// ============================================================================
+
+#define WIBLE_AD_FLAGS                0x01
+#define WIBLE_AD_UUID16_INCOMPLETE    0x02
+#define WIBLE_AD_UUID16_COMPLETE      0x03
+#define WIBLE_AD_UUID128_INCOMPLETE   0x06
+#define WIBLE_AD_UUID128_COMPLETE     0x07
+#define WIBLE_AD_NAME_SHORT           0x08
+#define WIBLE_AD_NAME_COMPLETE        0x09
+#define WIBLE_AD_TX_POWER             0x0A
+#define WIBLE_AD_SERVICE_DATA16       0x16
+#define WIBLE_AD_SERVICE_DATA128      0x21
+#define WIBLE_AD_MANUFACTURER         0xFF
+
+#define WIBLE_AD_FLAGS_LE_ONLY        0x06  // LE General Discoverable, BR/EDR not supported
+
+#define WIBLE_ADV_LEGACY_MAX          31
+#define WIBLE_ADV_EXTENDED_MAX        255
+
+// ============================================================================
+// PARSER
+// ============================================================================
+
+/**
+ * One AD structure; data points into the parsed buffer
+ */
+struct AdStructure {
+    uint8_t type;
+    uint8_t length;         // Of data, excluding the length and type bytes
+    const uint8_t* data;
+};
+
+class AdvertisingDataView {
+public:
+    AdvertisingDataView(const uint8_t* payload, size_t length)
+        : payload(payload), length(length) {}
+
+    class Iterator {
+    public:
+        Iterator(const uint8_t* payload, size_t length, size_t pos)
+            : payload(payload), length(length), pos(pos) { settle(); }
+
+        AdStructure operator*() const {
+            AdStructure field;
+            field.type = payload[pos + 1];
+            field.length = payload[pos] - 1;
+            field.data = &payload[pos + 2];
+            return field;
+        }
+        Iterator& operator++() {
+            pos += 1 + payload[pos];
+            settle();
+            return *this;
+        }
+        bool operator!=(const Iterator& other) const { return pos != other.pos; }
+
+    private:
+        const uint8_t* payload;
+        size_t length;
+        size_t pos;
+
+        // Stops at the end, a zero-length terminator or a truncated structure
+        void settle() {
+            if (pos >= length || pos + 1 >= length || payload[pos] == 0 ||
+                pos + 1 + payload[pos] > length) {
+                pos = length;
+            }
+        }
+    };
+
+    Iterator begin() const { return Iterator(payload, length, 0); }
+    Iterator end() const { return Iterator(payload, length, length); }
+
+    /**
+     * First AD structure of the given type
+     */
+    bool find(uint8_t type, AdStructure& out) const {
+        for (AdStructure field : *this) {
+            if (field.type == type) {
+                out = field;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Manufacturer-specific data: company ID and the bytes after it
+     */
+    bool findManufacturerData(uint16_t& companyId, AdStructure& out) const {
+        if (!find(WIBLE_AD_MANUFACTURER, out) || out.length < 2) return false;
+        companyId = out.data[0] | (out.data[1] << 8);
+        out.data += 2;
+        out.length -= 2;
+        return true;
+    }
+
+    /**
+     * True if a UUID list or service data structure carries this service
+     * UUID (2 or 16 bytes, little-endian as on air)
+     */
+    bool hasServiceUUID(const uint8_t* uuid, size_t uuidLength) const {
+        for (AdStructure field : *this) {
+            bool list = (uuidLength == 2 && (field.type == WIBLE_AD_UUID16_INCOMPLETE ||
+                                             field.type == WIBLE_AD_UUID16_COMPLETE)) ||
+                        (uuidLength == 16 && (field.type == WIBLE_AD_UUID128_INCOMPLETE ||
+                                              field.type == WIBLE_AD_UUID128_COMPLETE));
+            bool serviceData = (uuidLength == 2 && field.type == WIBLE_AD_SERVICE_DATA16) ||
+                               (uuidLength == 16 && field.type == WIBLE_AD_SERVICE_DATA128);
+            if (list) {
+                for (size_t i = 0; i + uuidLength <= field.length; i += uuidLength) {
+                    if (memcmp(&field.data[i], uuid, uuidLength) == 0) return true;
+                }
+            } else if (serviceData && field.length >= uuidLength &&
+                       memcmp(field.data, uuid, uuidLength) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const uint8_t* payload;
+    size_t length;
+};
+
+/**
+ * Parse "xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx" into 16 bytes, in text order
+ * (big-endian, as in iBeacon) or reversed (little-endian, as in AD UUID lists)
+ * @return false if the string is not a UUID
+ */
+inline bool parseUUID128(const char* text, uint8_t* out, bool littleEndian) {
+    uint8_t parsed[16];
+    size_t digits = 0;
+    for (const char* p = text; *p; p++) {
+        if (*p == '-') continue;
+        uint8_t nibble;
+        if (*p >= '0' && *p <= '9') nibble = *p - '0';
+        else if (*p >= 'a' && *p <= 'f') nibble = *p - 'a' + 10;
+        else if (*p >= 'A' && *p <= 'F') nibble = *p - 'A' + 10;
+        else return false;
+        if (digits >= 32) return false;
+        uint8_t& byte = parsed[littleEndian ? 15 - digits / 2 : digits / 2];
+        byte = (digits % 2 == 0) ? (nibble << 4) : (byte | nibble);
+        digits++;
+    }
+    if (digits != 32) return false;
+    memcpy(out, parsed, sizeof(parsed));
+    return true;
+}
+
+// ============================================================================
+// BUILDER
+// ============================================================================
+
+template<size_t Capacity = WIBLE_ADV_LEGACY_MAX>
+class AdvertisingDataBuilder {
+    static_assert(Capacity >= 3 && Capacity <= WIBLE_ADV_EXTENDED_MAX,
+                  "Advertising payloads are 3..255 bytes");
+
+public:
+    AdvertisingDataBuilder() : used(0) {}
+
+    /**
+     * Append one AD structure
+     * @return false (and nothing appended) if it does not fit
+     */
+    bool add(uint8_t type, const uint8_t* data, size_t length) {
+        uint8_t* field = reserve(type, length);
+        if (!field) return false;
+        if (length) memcpy(field, data, length);
+        return true;
+    }
+
+    /**
+     * Append an AD structure and return its data area for the caller to
+     * fill, or nullptr if it does not fit
+     */
+    uint8_t* reserve(uint8_t type, size_t length) {
+        if (length > 254 || used + 2 + length > Capacity) return nullptr;
+        buffer[used] = (uint8_t)(length + 1);
+        buffer[used + 1] = type;
+        uint8_t* field = &buffer[used + 2];
+        used += 2 + length;
+        return field;
+    }
+
+    bool addFlags(uint8_t flags = WIBLE_AD_FLAGS_LE_ONLY) {
+        return add(WIBLE_AD_FLAGS, &flags, 1);
+    }
+
+    bool addManufacturerData(uint16_t companyId, const uint8_t* data, size_t length) {
+        uint8_t* field = reserve(WIBLE_AD_MANUFACTURER, length + 2);
+        if (!field) return false;
+        field[0] = companyId & 0xFF;
+        field[1] = companyId >> 8;
+        if (length) memcpy(field + 2, data, length);
+        return true;
+    }
+
+    bool addServiceUUID16(uint16_t uuid) {
+        uint8_t le[2] = { (uint8_t)(uuid & 0xFF), (uint8_t)(uuid >> 8) };
+        return add(WIBLE_AD_UUID16_COMPLETE, le, 2);
+    }
+
+    bool addServiceUUID128(const char* uuid) {
+        uint8_t le[16];
+        return parseUUID128(uuid, le, true) && add(WIBLE_AD_UUID128_COMPLETE, le, 16);
+    }
+
+    /**
+     * Complete name, or as much of it as fits marked as shortened
+     */
+    bool addName(const char* name) {
+        size_t length = strlen(name);
+        if (used + 2 + length <= Capacity) {
+            return add(WIBLE_AD_NAME_COMPLETE, (const uint8_t*)name, length);
+        }
+        if (used + 3 > Capacity) return false;
+        return add(WIBLE_AD_NAME_SHORT, (const uint8_t*)name, Capacity - used - 2);
+    }
+
+    bool addTxPower(int8_t dbm) {
+        return add(WIBLE_AD_TX_POWER, (const uint8_t*)&dbm, 1);
+    }
+
+    void clear() { used = 0; }
+    const uint8_t* data() const { return buffer; }
+    uint8_t* data() { return buffer; }
+    size_t size() const { return used; }
+    size_t remaining() const { return Capacity - used; }
+    AdvertisingDataView view() const { return AdvertisingDataView(buffer, used); }
+
+private:
+    uint8_t buffer[Capacity];
+    size_t used;
+};
+
+// ============================================================================
+// FRAME LAYOUTS
+// ============================================================================
+
+// Complete legacy payloads; offsets index the raw advertising data, so the
+// changing fields can be rewritten in place without rebuilding the frame.
+
+/**
+ * Apple iBeacon: flags, then manufacturer data 0x004C / 0x02 0x15
+ */
+struct IBeaconLayout {
+    enum : uint8_t {
+        UUID_OFFSET = 9,
+        MAJOR_OFFSET = 25,      // Big-endian
+        MINOR_OFFSET = 27,      // Big-endian
+        TX_POWER_OFFSET = 29,   // Measured RSSI at 1 m
+        LENGTH = 30
+    };
+
+    static bool write(uint8_t* out, const char* uuid, uint16_t major, uint16_t minor, int8_t rssiAt1m) {
+        static const uint8_t header[UUID_OFFSET] = {
+            0x02, WIBLE_AD_FLAGS, WIBLE_AD_FLAGS_LE_ONLY,
+            0x1A, WIBLE_AD_MANUFACTURER, 0x4C, 0x00, 0x02, 0x15
+        };
+        if (!parseUUID128(uuid, out + UUID_OFFSET, false)) return false;
+        memcpy(out, header, sizeof(header));
+        setMajor(out, major);
+        setMinor(out, minor);
+        out[TX_POWER_OFFSET] = (uint8_t)rssiAt1m;
+        return true;
+    }
+
+    static void setMajor(uint8_t* frame, uint16_t major) {
+        frame[MAJOR_OFFSET] = major >> 8;
+        frame[MAJOR_OFFSET + 1] = major & 0xFF;
+    }
+
+    static void setMinor(uint8_t* frame, uint16_t minor) {
+        frame[MINOR_OFFSET] = minor >> 8;
+        frame[MINOR_OFFSET + 1] = minor & 0xFF;
+    }
+};
+
+/**
+ * Eddystone-UID: flags, the 0xFEAA service UUID, then the UID service data
+ */
+struct EddystoneUIDLayout {
+    enum : uint8_t {
+        TX_POWER_OFFSET = 12,   // Calibrated at 0 m
+        NAMESPACE_OFFSET = 13,  // 10 bytes
+        INSTANCE_OFFSET = 23,   // 6 bytes
+        LENGTH = 31
+    };
+
+    static void write(uint8_t* out, const uint8_t* namespaceId, const uint8_t* instanceId, int8_t txPowerAt0m) {
+        static const uint8_t header[TX_POWER_OFFSET] = {
+            0x02, WIBLE_AD_FLAGS, WIBLE_AD_FLAGS_LE_ONLY,
+            0x03, WIBLE_AD_UUID16_COMPLETE, 0xAA, 0xFE,
+            0x17, WIBLE_AD_SERVICE_DATA16, 0xAA, 0xFE, 0x00   // Frame type UID
+        };
+        memcpy(out, header, sizeof(header));
+        out[TX_POWER_OFFSET] = (uint8_t)txPowerAt0m;
+        memcpy(out + NAMESPACE_OFFSET, namespaceId, 10);
+        memcpy(out + INSTANCE_OFFSET, instanceId, 6);
+        out[LENGTH - 2] = 0;    // Reserved
+        out[LENGTH - 1] = 0;
+    }
+};
+
+/**
+ * Flags plus one manufacturer-data structure with a fixed-size payload
+ */
+template<size_t PayloadLength>
+struct ManufacturerDataLayout {
+    static_assert(PayloadLength <= WIBLE_ADV_LEGACY_MAX - 7,
+                  "Manufacturer payload does not fit a legacy advertisement");
+
+    enum : uint8_t {
+        COMPANY_ID_OFFSET = 5,
+        PAYLOAD_OFFSET = 7,
+        LENGTH = PAYLOAD_OFFSET + PayloadLength
+    };
+
+    static void write(uint8_t* out, uint16_t companyId, const uint8_t* payload) {
+        out[0] = 0x02;
+        out[1] = WIBLE_AD_FLAGS;
+        out[2] = WIBLE_AD_FLAGS_LE_ONLY;
+        out[3] = (uint8_t)(PayloadLength + 3);
+        out[4] = WIBLE_AD_MANUFACTURER;
+        out[COMPANY_ID_OFFSET] = companyId & 0xFF;
+        out[COMPANY_ID_OFFSET + 1] = companyId >> 8;
+        if (payload) memcpy(out + PAYLOAD_OFFSET, payload, PayloadLength);
+    }
+};
+
+} // namespace WiBLE
+
+#endif // WIBLE_ADVERTISING_DATA_H
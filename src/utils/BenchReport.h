@@ -0,0 +1,92 @@
+/**
+ * BenchReport.h - Machine-readable benchmark output for WiBLE
+ *
+ * Each result is one JSON object per line on Serial, e.g.
+ *   {"bench":"crypto","metric":"gcm_encrypt_cycles_per_kb","value":41230.000,"unit":"cycles","target":"esp32"}
+ * so runs can be captured with any serial monitor and diffed between
+ * releases. Used by the sketches in benchmarks/ and their host builds.
+ */
+
+#ifndef WIBLE_BENCH_REPORT_H
+#define WIBLE_BENCH_REPORT_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <stdio.h>
+
+#ifdef CONFIG_IDF_TARGET
+#define WIBLE_BENCH_TARGET CONFIG_IDF_TARGET
+#else
+#define WIBLE_BENCH_TARGET "host"
+#endif
+
+namespace WiBLE {
+namespace Bench {
+
+inline int64_t nowUs() { return esp_timer_get_time(); }
+
+/**
+ * Print one result line
+ */
+inline void report(const char* bench, const char* metric, double value, const char* unit) {
+    char line[192];
+    snprintf(line, sizeof(line),
+             "{\"bench\":\"%s\",\"metric\":\"%s\",\"value\":%.3f,\"unit\":\"%s\",\"target\":\"%s\"}",
+             bench, metric, value, unit, WIBLE_BENCH_TARGET);
+    Serial.println(line);
+}
+
+/**
+ * Time `iterations` calls of `body` and return the mean in nanoseconds
+ */
+template<typename Body>
+double measureNs(uint32_t iterations, Body body) {
+    int64_t start = nowUs();
+    for (uint32_t i = 0; i < iterations; i++) body(i);
+    int64_t elapsed = nowUs() - start;
+    return iterations ? (double)elapsed * 1000.0 / iterations : 0.0;
+}
+
+// ============================================================================
+// HEAP
+// ============================================================================
+
+#ifdef WIBLE_HOST_BENCH
+// Provided by benchmarks/host/host_main.cpp, which counts operator new
+size_t hostHeapInUse();
+size_t hostHeapHighWater();
+void hostHeapResetHighWater();
+
+inline size_t heapInUse() { return hostHeapInUse(); }
+inline size_t heapHighWater() { return hostHeapHighWater(); }
+inline void resetHeapHighWater() { hostHeapResetHighWater(); }
+#else
+inline size_t heapInUse() { return ESP.getHeapSize() - ESP.getFreeHeap(); }
+// The device minimum free heap cannot be reset, so this is the peak since boot
+inline size_t heapHighWater() { return ESP.getHeapSize() - ESP.getMinFreeHeap(); }
+inline void resetHeapHighWater() {}
+#endif
+
+// ============================================================================
+// COMPLETION
+// ============================================================================
+
+inline bool& finishedFlag() {
+    static bool finished = false;
+    return finished;
+}
+
+/**
+ * Mark the run complete; host builds stop calling loop() after this
+ */
+inline void finish() {
+    finishedFlag() = true;
+    Serial.println("{\"bench\":\"done\"}");
+}
+
+inline bool isFinished() { return finishedFlag(); }
+
+} // namespace Bench
+} // namespace WiBLE
+
+#endif // WIBLE_BENCH_REPORT_H
@@ -0,0 +1,132 @@
+/**
+ * LogManager.cpp - Formatted and deferred logging backend
+ */
+
+#include "LogManager.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+namespace WiBLE {
+
+SPSCQueue<LogManager::LogRecord, WIBLE_LOG_QUEUE_DEPTH> LogManager::asyncQueue;
+portMUX_TYPE LogManager::asyncLock = portMUX_INITIALIZER_UNLOCKED;
+TaskHandle_t LogManager::asyncTask = nullptr;
+std::atomic<bool> LogManager::asyncStopRequested(false);
+std::atomic<bool> LogManager::asyncRunning(false);
+uint32_t LogManager::droppedRecords = 0;
+
+static const char* levelPrefix(LogLevel level) {
+    switch (level) {
+        case LogLevel::VERBOSE: return "[VERB] ";
+        case LogLevel::DEBUG:   return "[DEBG] ";
+        case LogLevel::INFO:    return "[INFO] ";
+        case LogLevel::WARN:    return "[WARN] ";
+        case LogLevel::ERROR:   return "[ERR ] ";
+        default:                return "";
+    }
+}
+
+// ============================================================================
+// SYNCHRONOUS PATH
+// ============================================================================
+
+void LogManager::logf(LogLevel level, const char* format, ...) {
+    if (!isEnabled(level)) return;
+
+    char line[WIBLE_LOG_LINE_SIZE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    printLine(level, 0, line);
+}
+
+void LogManager::printLine(LogLevel level, uint32_t timestamp, const char* line) {
+    Serial.print(levelPrefix(level));
+    if (timestamp) {
+        // Deferred records print late; show when they were captured
+        char stamp[16];
+        snprintf(stamp, sizeof(stamp), "@%lu ", (unsigned long)timestamp);
+        Serial.print(stamp);
+    }
+    Serial.println(line);
+}
+
+// ============================================================================
+// DEFERRED PATH
+// ============================================================================
+
+void LogManager::enqueue(LogLevel level, const char* format, uint8_t argCount, const uint32_t* args) {
+    taskENTER_CRITICAL(&asyncLock);
+    LogRecord* record = asyncQueue.beginWrite();
+    if (record) {
+        record->format = format;
+        record->timestamp = millis();
+        for (uint8_t i = 0; i < WIBLE_LOG_MAX_ARGS; i++) {
+            record->args[i] = i < argCount ? args[i] : 0;
+        }
+        record->level = (uint8_t)level;
+        record->argCount = argCount;
+        asyncQueue.commitWrite();
+    } else {
+        droppedRecords++;
+    }
+    taskEXIT_CRITICAL(&asyncLock);
+}
+
+void LogManager::flush() {
+    char line[WIBLE_LOG_LINE_SIZE];
+    LogRecord* record;
+    while ((record = asyncQueue.front()) != nullptr) {
+        // Unused trailing arguments are zero and ignored by the format
+        snprintf(line, sizeof(line), record->format,
+                 record->args[0], record->args[1], record->args[2], record->args[3]);
+        printLine((LogLevel)record->level, record->timestamp, line);
+        asyncQueue.pop();
+    }
+}
+
+void LogManager::drainTask(void* param) {
+    (void)param;
+    while (!asyncStopRequested.load()) {
+        flush();
+        // Sleep between drains; stopAsync() wakes us early
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+    }
+    asyncRunning.store(false);
+    vTaskDelete(nullptr);
+}
+
+bool LogManager::startAsync(uint8_t priority, uint32_t stackSize) {
+    if (asyncTask) return true;
+
+    TaskHandle_t handle = nullptr;
+    asyncStopRequested.store(false);
+    asyncRunning.store(true);
+    if (xTaskCreatePinnedToCore(drainTask, "wible_log", stackSize, nullptr,
+                                priority, &handle, tskNO_AFFINITY) != pdPASS) {
+        asyncRunning.store(false);
+        warn("Async log task failed to start, logging synchronously");
+        return false;
+    }
+    asyncTask = handle;
+    return true;
+}
+
+void LogManager::stopAsync() {
+    if (!asyncTask) return;
+
+    TaskHandle_t handle = asyncTask;
+    asyncTask = nullptr;   // New records go straight to Serial from here on
+
+    // Let the drain task leave its loop so it never dies holding Serial
+    asyncStopRequested.store(true);
+    xTaskNotifyGive(handle);
+    while (asyncRunning.load()) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    flush();           // Sole consumer now
+}
+
+} // namespace WiBLE
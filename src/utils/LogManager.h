@@ -1,23 +1,92 @@
 /**
  * LogManager.h - Simple logging utility for WiBLE
+ *
+ * Two ways in:
+ *  - LogManager::info(String) etc. format eagerly and print synchronously.
+ *  - WIBLE_LOGE/W/I/D/V(fmt, ...) compile out below WIBLE_LOG_LEVEL, skip
+ *    argument evaluation below the runtime level, and format printf-style
+ *    into a stack buffer. With the async sink running, calls whose
+ *    arguments are all integers are queued as binary records (format
+ *    pointer + up to four 32-bit values) and printed by a low-priority task.
  */
 
 #ifndef WIBLE_LOG_MANAGER_H
 #define WIBLE_LOG_MANAGER_H
 
 #include <Arduino.h>
+#include <type_traits>
+#include <atomic>
+#include <freertos/task.h>
 #include "../WiBLE_Defs.h"
+#include "SPSCQueue.h"
 // #include "../WiBLE.h" // Avoid circular dependency if possible
 
+// ============================================================================
+// COMPILE-TIME LEVEL
+// ============================================================================
+
+// Numeric values follow the LogLevel enum
+#define WIBLE_LOG_LEVEL_VERBOSE      0
+#define WIBLE_LOG_LEVEL_DEBUG        1
+#define WIBLE_LOG_LEVEL_INFO         2
+#define WIBLE_LOG_LEVEL_WARN         3
+#define WIBLE_LOG_LEVEL_ERROR        4
+#define WIBLE_LOG_LEVEL_NONE         5
+
+#ifndef WIBLE_LOG_LEVEL
+#define WIBLE_LOG_LEVEL              WIBLE_LOG_LEVEL_DEBUG
+#endif
+
+#ifndef WIBLE_LOG_QUEUE_DEPTH
+#define WIBLE_LOG_QUEUE_DEPTH        32   // Records (power of two)
+#endif
+#define WIBLE_LOG_MAX_ARGS           4
+#define WIBLE_LOG_LINE_SIZE          160
+
+#define WIBLE_LOG_IMPL(level, fmt, ...) \
+    do { \
+        if (::WiBLE::LogManager::isEnabled(level)) { \
+            ::WiBLE::LogManager::write(level, fmt, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#if WIBLE_LOG_LEVEL <= WIBLE_LOG_LEVEL_ERROR
+#define WIBLE_LOGE(fmt, ...) WIBLE_LOG_IMPL(::WiBLE::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+#else
+#define WIBLE_LOGE(fmt, ...) do {} while (0)
+#endif
+
+#if WIBLE_LOG_LEVEL <= WIBLE_LOG_LEVEL_WARN
+#define WIBLE_LOGW(fmt, ...) WIBLE_LOG_IMPL(::WiBLE::LogLevel::WARN, fmt, ##__VA_ARGS__)
+#else
+#define WIBLE_LOGW(fmt, ...) do {} while (0)
+#endif
+
+#if WIBLE_LOG_LEVEL <= WIBLE_LOG_LEVEL_INFO
+#define WIBLE_LOGI(fmt, ...) WIBLE_LOG_IMPL(::WiBLE::LogLevel::INFO, fmt, ##__VA_ARGS__)
+#else
+#define WIBLE_LOGI(fmt, ...) do {} while (0)
+#endif
+
+#if WIBLE_LOG_LEVEL <= WIBLE_LOG_LEVEL_DEBUG
+#define WIBLE_LOGD(fmt, ...) WIBLE_LOG_IMPL(::WiBLE::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define WIBLE_LOGD(fmt, ...) do {} while (0)
+#endif
+
+#if WIBLE_LOG_LEVEL <= WIBLE_LOG_LEVEL_VERBOSE
+#define WIBLE_LOGV(fmt, ...) WIBLE_LOG_IMPL(::WiBLE::LogLevel::VERBOSE, fmt, ##__VA_ARGS__)
+#else
+#define WIBLE_LOGV(fmt, ...) do {} while (0)
+#endif
+
 namespace WiBLE {
 
 class LogManager {
 public:
     static void log(LogLevel level, const String& message) {
-        // Simple implementation for now, can be expanded later
-        // In a real implementation, we would check config.logLevel
-        // For now, we assume INFO level and Serial enabled
-        
+        if (!isEnabled(level)) return;
+
         String prefix = "";
         switch (level) {
             case LogLevel::VERBOSE: prefix = "[VERB] "; break;
@@ -27,18 +96,18 @@ public:
             case LogLevel::ERROR:   prefix = "[ERR ] "; break;
             default: break;
         }
-        
+
         Serial.println(prefix + message);
     }
-    
+
     static void info(const String& message) {
         log(LogLevel::INFO, message);
     }
-    
+
     static void error(const String& message) {
         log(LogLevel::ERROR, message);
     }
-    
+
     static void debug(const String& message) {
         log(LogLevel::DEBUG, message);
     }
@@ -46,8 +115,111 @@ public:
     static void warn(const String& message) {
         log(LogLevel::WARN, message);
     }
+
+    /**
+     * Runtime threshold; check isEnabled() before building expensive messages
+     */
+    static void setLevel(LogLevel level) { threshold() = level; }
+    static LogLevel getLevel() { return threshold(); }
+    static bool isEnabled(LogLevel level) {
+        return level != LogLevel::NONE && level >= threshold() &&
+               (int)level >= WIBLE_LOG_LEVEL;
+    }
+
+    // ========================================================================
+    // FORMATTED / DEFERRED LOGGING (used by the WIBLE_LOG* macros)
+    // ========================================================================
+
+    /**
+     * printf-style, formatted into a stack buffer and printed now
+     */
+    static void logf(LogLevel level, const char* format, ...);
+
+    /**
+     * Queue as a binary record if the async sink is running and every
+     * argument is an integer (formats must use 32-bit conversions such as
+     * %d %u %x %c); otherwise format and print now.
+     */
+    template<typename... Args>
+    static void write(LogLevel level, const char* format, Args... args) {
+        dispatch(std::integral_constant<bool, DeferrableArgs<Args...>::value>(),
+                 level, format, args...);
+    }
+
+    /**
+     * Start the drain task for deferred records
+     */
+    static bool startAsync(uint8_t priority = 1, uint32_t stackSize = 3072);
+
+    /**
+     * Print everything queued, then stop the drain task
+     */
+    static void stopAsync();
+
+    static bool isAsync() { return asyncTask != nullptr; }
+    static uint32_t getDroppedCount() { return droppedRecords; }
+
+private:
+    static LogLevel& threshold() {
+        static LogLevel level = LogLevel::INFO;
+        return level;
+    }
+
+    struct LogRecord {
+        const char* format;     // Format string in flash doubles as the record id
+        uint32_t timestamp;
+        uint32_t args[WIBLE_LOG_MAX_ARGS];
+        uint8_t level;
+        uint8_t argCount;
+    };
+
+    // Producers (any task) serialize on asyncLock; the drain task is the
+    // only consumer
+    static SPSCQueue<LogRecord, WIBLE_LOG_QUEUE_DEPTH> asyncQueue;
+    static portMUX_TYPE asyncLock;
+    static TaskHandle_t asyncTask;
+    static std::atomic<bool> asyncStopRequested;
+    static std::atomic<bool> asyncRunning;
+    static uint32_t droppedRecords;
+
+    template<typename... Args> struct AllIntegral;
+    template<typename... Args> struct DeferrableArgs {
+        static const bool value = sizeof...(Args) <= WIBLE_LOG_MAX_ARGS && AllIntegral<Args...>::value;
+    };
+
+    template<typename T>
+    static uint32_t toArg(T value) { return (uint32_t)value; }
+
+    template<typename... Args>
+    static void dispatch(std::true_type, LogLevel level, const char* format, Args... args) {
+        if (asyncTask) {
+            uint32_t values[WIBLE_LOG_MAX_ARGS + 1] = { toArg(args)... };
+            enqueue(level, format, (uint8_t)sizeof...(Args), values);
+        } else {
+            logf(level, format, args...);
+        }
+    }
+
+    template<typename... Args>
+    static void dispatch(std::false_type, LogLevel level, const char* format, Args... args) {
+        logf(level, format, args...);
+    }
+
+    static void enqueue(LogLevel level, const char* format, uint8_t argCount, const uint32_t* args);
+    static void printLine(LogLevel level, uint32_t timestamp, const char* line);
+    // Print queued records; only the drain task, or stopAsync() once the
+    // task has exited, may consume the queue
+    static void flush();
+    static void drainTask(void* param);
 };
 
+template<> struct LogManager::AllIntegral<> : std::true_type {};
+
+template<typename T, typename... Rest>
+struct LogManager::AllIntegral<T, Rest...>
+    : std::integral_constant<bool, (std::is_integral<T>::value || std::is_enum<T>::value) &&
+                                   AllIntegral<Rest...>::value> {};
+
 } // namespace WiBLE
 
 #endif // WIBLE_LOG_MANAGER_H
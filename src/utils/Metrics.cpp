@@ -0,0 +1,216 @@
+/**
+ * Metrics.cpp - Metrics registry storage and snapshot encoding
+ */
+
+#include "Metrics.h"
+
+#if WIBLE_ENABLE_METRICS
+
+#include "LogManager.h"
+#include <freertos/task.h>
+#include <atomic>
+
+namespace WiBLE {
+
+// A long read serves at most 512 bytes of an attribute
+static_assert(WIBLE_METRICS_SNAPSHOT_SIZE <= 512, "The metrics snapshot must fit one attribute value");
+
+// ============================================================================
+// STORAGE
+// ============================================================================
+
+namespace {
+
+struct Histogram {
+    uint32_t count;
+    uint64_t sumUs;
+    uint32_t maxUs;
+    uint16_t buckets[WIBLE_METRICS_BUCKETS];    // Saturating
+};
+
+struct StateRecord {
+    uint32_t entries;
+    uint32_t totalMs;
+    uint32_t minFreeHeap;
+};
+
+std::atomic<uint32_t> counters[(size_t)MetricCounter::COUNT];
+std::atomic<uint32_t> gauges[(size_t)MetricGauge::COUNT];
+
+// Histograms and state times are updated from several tasks
+portMUX_TYPE metricsLock = portMUX_INITIALIZER_UNLOCKED;
+Histogram histograms[(size_t)MetricHistogram::COUNT];
+StateRecord states[WIBLE_STATE_COUNT];
+uint8_t currentState = 0;
+uint32_t stateEnteredAt = 0;
+
+void put16(uint8_t*& out, uint16_t value) {
+    *out++ = (uint8_t)value;
+    *out++ = (uint8_t)(value >> 8);
+}
+
+void put32(uint8_t*& out, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) *out++ = (uint8_t)(value >> (8 * i));
+}
+
+void lowerHeap(StateRecord& record, uint32_t freeHeap) {
+    if (record.minFreeHeap == 0 || freeHeap < record.minFreeHeap) record.minFreeHeap = freeHeap;
+}
+
+} // namespace
+
+// ============================================================================
+// RECORDING
+// ============================================================================
+
+void Metrics::increment(MetricCounter counter, uint32_t amount) {
+    counters[(size_t)counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void Metrics::setGauge(MetricGauge gauge, uint32_t value) {
+    gauges[(size_t)gauge].store(value, std::memory_order_relaxed);
+}
+
+uint8_t Metrics::bucketFor(uint32_t valueUs) {
+    // Bucket i ends at 8 * 4^i = 2^(3 + 2i)
+    uint8_t bucket = 0;
+    while (bucket < WIBLE_METRICS_BUCKETS - 1 && valueUs >= (8UL << (2 * bucket))) bucket++;
+    return bucket;
+}
+
+void Metrics::observe(MetricHistogram histogram, uint32_t valueUs) {
+    uint8_t bucket = bucketFor(valueUs);
+    taskENTER_CRITICAL(&metricsLock);
+    Histogram& entry = histograms[(size_t)histogram];
+    entry.count++;
+    entry.sumUs += valueUs;
+    if (valueUs > entry.maxUs) entry.maxUs = valueUs;
+    if (entry.buckets[bucket] != 0xFFFF) entry.buckets[bucket]++;
+    taskEXIT_CRITICAL(&metricsLock);
+}
+
+void Metrics::enterState(ProvisioningState state) {
+    uint32_t now = millis();
+    uint32_t freeHeap = ESP.getFreeHeap();
+    taskENTER_CRITICAL(&metricsLock);
+    StateRecord& previous = states[currentState];
+    previous.totalMs += now - stateEnteredAt;
+    lowerHeap(previous, freeHeap);
+    currentState = (uint8_t)state < WIBLE_STATE_COUNT ? (uint8_t)state : 0;
+    stateEnteredAt = now;
+    states[currentState].entries++;
+    lowerHeap(states[currentState], freeHeap);
+    taskEXIT_CRITICAL(&metricsLock);
+}
+
+void Metrics::sampleHeap() {
+    uint32_t freeHeap = ESP.getFreeHeap();
+    setGauge(MetricGauge::HEAP_FREE, freeHeap);
+    setGauge(MetricGauge::HEAP_MIN_FREE, ESP.getMinFreeHeap());
+    setGauge(MetricGauge::HEAP_LARGEST_BLOCK, ESP.getMaxAllocHeap());
+    taskENTER_CRITICAL(&metricsLock);
+    lowerHeap(states[currentState], freeHeap);
+    taskEXIT_CRITICAL(&metricsLock);
+}
+
+// ============================================================================
+// READING
+// ============================================================================
+
+uint32_t Metrics::getCounter(MetricCounter counter) {
+    return counters[(size_t)counter].load(std::memory_order_relaxed);
+}
+
+uint32_t Metrics::getGauge(MetricGauge gauge) {
+    return gauges[(size_t)gauge].load(std::memory_order_relaxed);
+}
+
+HistogramSnapshot Metrics::getHistogram(MetricHistogram histogram) {
+    HistogramSnapshot snapshot;
+    taskENTER_CRITICAL(&metricsLock);
+    const Histogram& entry = histograms[(size_t)histogram];
+    snapshot.count = entry.count;
+    snapshot.meanUs = entry.count ? (uint32_t)(entry.sumUs / entry.count) : 0;
+    snapshot.maxUs = entry.maxUs;
+    for (size_t i = 0; i < WIBLE_METRICS_BUCKETS; i++) snapshot.buckets[i] = entry.buckets[i];
+    taskEXIT_CRITICAL(&metricsLock);
+    return snapshot;
+}
+
+StateMetrics Metrics::getState(ProvisioningState state) {
+    StateMetrics snapshot;
+    if ((uint8_t)state >= WIBLE_STATE_COUNT) return snapshot;
+    uint32_t now = millis();
+    taskENTER_CRITICAL(&metricsLock);
+    const StateRecord& record = states[(uint8_t)state];
+    snapshot.entries = record.entries;
+    snapshot.totalMs = record.totalMs + ((uint8_t)state == currentState ? now - stateEnteredAt : 0);
+    snapshot.minFreeHeap = record.minFreeHeap;
+    taskEXIT_CRITICAL(&metricsLock);
+    return snapshot;
+}
+
+size_t Metrics::snapshot(uint8_t* out, size_t capacity) {
+    if (!out || capacity < WIBLE_METRICS_SNAPSHOT_SIZE) return 0;
+
+    uint8_t* p = out;
+    *p++ = WIBLE_METRICS_MAGIC;
+    *p++ = WIBLE_METRICS_VERSION;
+    put32(p, millis() / 1000);
+    *p++ = (uint8_t)MetricCounter::COUNT;
+    *p++ = (uint8_t)MetricGauge::COUNT;
+    *p++ = (uint8_t)MetricHistogram::COUNT;
+    *p++ = WIBLE_METRICS_BUCKETS;
+    *p++ = WIBLE_STATE_COUNT;
+
+    for (size_t i = 0; i < (size_t)MetricCounter::COUNT; i++) put32(p, getCounter((MetricCounter)i));
+    for (size_t i = 0; i < (size_t)MetricGauge::COUNT; i++) put32(p, getGauge((MetricGauge)i));
+    for (size_t i = 0; i < (size_t)MetricHistogram::COUNT; i++) {
+        HistogramSnapshot histogram = getHistogram((MetricHistogram)i);
+        put32(p, histogram.count);
+        put32(p, histogram.meanUs);
+        put32(p, histogram.maxUs);
+        for (size_t b = 0; b < WIBLE_METRICS_BUCKETS; b++) put16(p, (uint16_t)histogram.buckets[b]);
+    }
+    for (uint8_t i = 0; i < WIBLE_STATE_COUNT; i++) {
+        StateMetrics state = getState((ProvisioningState)i);
+        put16(p, (uint16_t)(state.entries > 0xFFFF ? 0xFFFF : state.entries));
+        put32(p, state.totalMs);
+        put32(p, state.minFreeHeap);
+    }
+    return p - out;
+}
+
+void Metrics::reset() {
+    for (std::atomic<uint32_t>& counter : counters) counter.store(0, std::memory_order_relaxed);
+    for (std::atomic<uint32_t>& gauge : gauges) gauge.store(0, std::memory_order_relaxed);
+    taskENTER_CRITICAL(&metricsLock);
+    memset(histograms, 0, sizeof(histograms));
+    memset(states, 0, sizeof(states));
+    stateEnteredAt = millis();
+    taskEXIT_CRITICAL(&metricsLock);
+}
+
+void Metrics::dump() {
+    static const char* const HISTOGRAM_NAMES[(size_t)MetricHistogram::COUNT] = {
+        "notify", "write", "crypto", "handshake", "listener", "loop"
+    };
+    WIBLE_LOGI("Heap free %u, min %u, largest %u", (unsigned)getGauge(MetricGauge::HEAP_FREE),
+               (unsigned)getGauge(MetricGauge::HEAP_MIN_FREE), (unsigned)getGauge(MetricGauge::HEAP_LARGEST_BLOCK));
+    for (size_t i = 0; i < (size_t)MetricHistogram::COUNT; i++) {
+        HistogramSnapshot histogram = getHistogram((MetricHistogram)i);
+        if (histogram.count == 0) continue;
+        WIBLE_LOGI("%s: %u samples, mean %u us, max %u us", HISTOGRAM_NAMES[i], (unsigned)histogram.count,
+                   (unsigned)histogram.meanUs, (unsigned)histogram.maxUs);
+    }
+    for (uint8_t i = 0; i < WIBLE_STATE_COUNT; i++) {
+        StateMetrics state = getState((ProvisioningState)i);
+        if (state.entries == 0) continue;
+        WIBLE_LOGI("State %u: %u entries, %u ms, min free heap %u", (unsigned)i, (unsigned)state.entries,
+                   (unsigned)state.totalMs, (unsigned)state.minFreeHeap);
+    }
+}
+
+} // namespace WiBLE
+
+#endif // WIBLE_ENABLE_METRICS
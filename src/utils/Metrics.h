@@ -0,0 +1,186 @@
+/**
+ * Metrics.h - Counters, gauges and latency histograms for WiBLE
+ *
+ * One static registry every component records into:
+ *   Metrics::increment(MetricCounter::WRITES_RECEIVED);
+ *   Metrics::observe(MetricHistogram::CRYPTO_US, elapsedUs);
+ *   WIBLE_METRIC_TIMER(MetricHistogram::LOOP_US);     // Times the enclosing scope
+ *
+ * IDs are fixed enums and storage is static, so recording is an atomic add
+ * or a short critical section, timed with esp_timer_get_time(). Heap gauges
+ * and queue depths are sampled from WiBLE::loop(); time and lowest free heap
+ * are also kept per provisioning state.
+ *
+ * snapshot() writes everything as one little-endian binary record, served
+ * on the diagnostics characteristic and by WiBLE::getMetricsSnapshot():
+ *   [0x4D][version][uptime s u32][counters][gauges][histograms][buckets][states]
+ *   counters   {u32}...
+ *   gauges     {u32}...
+ *   histograms {[count u32][mean u32][max u32]{bucket count u16}...}...
+ *   states     {[entries u16][total ms u32][lowest free heap u32]}...
+ * Bucket i counts values below 8 * 4^i us; the last bucket is open-ended.
+ *
+ * Build with WIBLE_ENABLE_METRICS=0 to compile every call out.
+ */
+
+#ifndef WIBLE_METRICS_H
+#define WIBLE_METRICS_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "../WiBLE_Defs.h"
+
+#ifndef WIBLE_ENABLE_METRICS
+#define WIBLE_ENABLE_METRICS         1
+#endif
+
+#define WIBLE_METRICS_MAGIC          0x4D
+#define WIBLE_METRICS_VERSION        1
+#define WIBLE_METRICS_BUCKETS        10
+
+#ifndef WIBLE_METRICS_SAMPLE_MS
+#define WIBLE_METRICS_SAMPLE_MS      1000   // Gauge sampling period in WiBLE::loop()
+#endif
+
+namespace WiBLE {
+
+enum class MetricCounter : uint8_t {
+    NOTIFICATIONS_SENT = 0,
+    WRITES_RECEIVED,
+    GATT_OPERATIONS_FAILED,
+    CRYPTO_OPERATIONS,
+    CONTROL_COMMANDS,
+    WIFI_CONNECTIONS,
+    WIFI_DISCONNECTIONS,
+    SLOW_LISTENERS,
+    COUNT
+};
+
+enum class MetricGauge : uint8_t {
+    HEAP_FREE = 0,
+    HEAP_MIN_FREE,                  // Lowest since boot
+    HEAP_LARGEST_BLOCK,
+    GATT_QUEUE_DEPTH,
+    WRITE_QUEUE_DEPTH,
+    EVENT_QUEUE_DEPTH,
+    BLE_CONNECTIONS,
+    TELEMETRY_BACKLOG,
+    COUNT
+};
+
+enum class MetricHistogram : uint8_t {
+    NOTIFY_LATENCY_US = 0,          // GATT operation enqueue to sent (ms resolution)
+    WRITE_LATENCY_US,               // Write callback to handler return
+    CRYPTO_US,                      // One AES-GCM/CBC frame
+    HANDSHAKE_US,                   // Key exchange or resumption
+    LISTENER_US,                    // One event listener call
+    LOOP_US,                        // WiBLE::loop()
+    COUNT
+};
+
+struct HistogramSnapshot {
+    uint32_t count = 0;
+    uint32_t meanUs = 0;
+    uint32_t maxUs = 0;
+    uint32_t buckets[WIBLE_METRICS_BUCKETS] = {0};
+};
+
+struct StateMetrics {
+    uint32_t entries = 0;
+    uint32_t totalMs = 0;           // Including the current stay
+    uint32_t minFreeHeap = 0;       // Lowest sampled while in the state (0 = never entered)
+};
+
+#define WIBLE_METRICS_HEADER_SIZE    11
+#define WIBLE_METRICS_HISTOGRAM_SIZE (12 + 2 * WIBLE_METRICS_BUCKETS)
+#define WIBLE_METRICS_STATE_SIZE     10
+#define WIBLE_METRICS_SNAPSHOT_SIZE  (WIBLE_METRICS_HEADER_SIZE +                              \
+                                      4 * (size_t)MetricCounter::COUNT +                      \
+                                      4 * (size_t)MetricGauge::COUNT +                        \
+                                      WIBLE_METRICS_HISTOGRAM_SIZE * (size_t)MetricHistogram::COUNT + \
+                                      WIBLE_METRICS_STATE_SIZE * WIBLE_STATE_COUNT)
+
+// ============================================================================
+// REGISTRY
+// ============================================================================
+
+#if WIBLE_ENABLE_METRICS
+
+class Metrics {
+public:
+    static void increment(MetricCounter counter, uint32_t amount = 1);
+    static void setGauge(MetricGauge gauge, uint32_t value);
+    static void observe(MetricHistogram histogram, uint32_t valueUs);
+
+    /**
+     * Close the time of the previous state, heap sampled on the way in
+     */
+    static void enterState(ProvisioningState state);
+
+    /**
+     * Heap gauges, and the lowest free heap of the current state
+     */
+    static void sampleHeap();
+
+    static uint32_t getCounter(MetricCounter counter);
+    static uint32_t getGauge(MetricGauge gauge);
+    static HistogramSnapshot getHistogram(MetricHistogram histogram);
+    static StateMetrics getState(ProvisioningState state);
+
+    /**
+     * Binary record described above; out holds WIBLE_METRICS_SNAPSHOT_SIZE
+     * @return Bytes written, 0 if capacity is too small
+     */
+    static size_t snapshot(uint8_t* out, size_t capacity);
+
+    static void reset();
+    static void dump();
+
+    static uint8_t bucketFor(uint32_t valueUs);
+};
+
+#else
+
+class Metrics {
+public:
+    static void increment(MetricCounter, uint32_t = 1) {}
+    static void setGauge(MetricGauge, uint32_t) {}
+    static void observe(MetricHistogram, uint32_t) {}
+    static void enterState(ProvisioningState) {}
+    static void sampleHeap() {}
+    static uint32_t getCounter(MetricCounter) { return 0; }
+    static uint32_t getGauge(MetricGauge) { return 0; }
+    static HistogramSnapshot getHistogram(MetricHistogram) { return HistogramSnapshot(); }
+    static StateMetrics getState(ProvisioningState) { return StateMetrics(); }
+    static size_t snapshot(uint8_t*, size_t) { return 0; }
+    static void reset() {}
+    static void dump() {}
+};
+
+#endif // WIBLE_ENABLE_METRICS
+
+/**
+ * Observes the lifetime of the scope it is declared in
+ */
+class MetricTimer {
+public:
+#if WIBLE_ENABLE_METRICS
+    explicit MetricTimer(MetricHistogram histogram) : histogram(histogram), startedAt(esp_timer_get_time()) {}
+    ~MetricTimer() { Metrics::observe(histogram, (uint32_t)(esp_timer_get_time() - startedAt)); }
+
+private:
+    MetricHistogram histogram;
+    int64_t startedAt;
+#else
+    explicit MetricTimer(MetricHistogram) {}
+#endif
+};
+
+#define WIBLE_METRIC_CONCAT_(a, b) a##b
+#define WIBLE_METRIC_CONCAT(a, b) WIBLE_METRIC_CONCAT_(a, b)
+#define WIBLE_METRIC_TIMER(histogram) \
+    ::WiBLE::MetricTimer WIBLE_METRIC_CONCAT(metricTimer, __LINE__)(histogram)
+
+} // namespace WiBLE
+
+#endif // WIBLE_METRICS_H
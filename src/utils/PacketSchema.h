@@ -0,0 +1,288 @@
+/**
+ * PacketSchema.h - Compile-time packed message layouts
+ *
+ * A schema is a command ID followed by typed fields with a byte order:
+ *
+ *   using SensorFrame = PacketSchema<0x10, LE<float>, LE<float>, LE<uint16_t>, LE<bool>>;
+ *   uint8_t frame[SensorFrame::SIZE];            // 12, known at compile time
+ *   SensorFrame::encode(frame, 22.5f, 41.0f, 812, true);
+ *   SensorFrame::decode(frame, sizeof(frame), temperature, humidity, light, motion);
+ *
+ * Fields sit back to back after the command byte, with no padding. Field
+ * offsets are constants too, so a single field of a running broadcast can
+ * be patched in place (encodeField + updateBroadcast at offset<I>()).
+ *
+ * describe() writes a binary descriptor an app can use to parse frames
+ * without hard-coding offsets:
+ *   [0x5C][version][command id][field count]{[type | 0x80 if big-endian]}...
+ * describeJSON() writes the same with field names, for web clients.
+ */
+
+#ifndef WIBLE_PACKET_SCHEMA_H
+#define WIBLE_PACKET_SCHEMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace WiBLE {
+
+#define WIBLE_SCHEMA_DESCRIPTOR_MAGIC   0x5C
+#define WIBLE_SCHEMA_DESCRIPTOR_VERSION 1
+
+enum class ByteOrder : uint8_t {
+    LITTLE = 0,
+    BIG = 1
+};
+
+// Type codes in the descriptor
+enum class SchemaType : uint8_t {
+    UINT8 = 1,
+    INT8 = 2,
+    UINT16 = 3,
+    INT16 = 4,
+    UINT32 = 5,
+    INT32 = 6,
+    FLOAT32 = 7,
+    BOOL = 8
+};
+
+// ============================================================================
+// FIELD TYPES
+// ============================================================================
+
+template<typename T> struct SchemaTraits;
+
+// Signed values travel as their two's complement bits
+#define WIBLE_SCHEMA_INTEGER(T, BITS, CODE, NAME)                               \
+    template<> struct SchemaTraits<T> {                                          \
+        using Bits = BITS;                                                       \
+        static constexpr SchemaType TYPE = SchemaType::CODE;                     \
+        static const char* name() { return NAME; }                               \
+        static Bits toBits(T value) { return (Bits)value; }                      \
+        static T fromBits(Bits bits) { return (T)bits; }                         \
+    };
+
+WIBLE_SCHEMA_INTEGER(uint8_t, uint8_t, UINT8, "u8")
+WIBLE_SCHEMA_INTEGER(int8_t, uint8_t, INT8, "i8")
+WIBLE_SCHEMA_INTEGER(uint16_t, uint16_t, UINT16, "u16")
+WIBLE_SCHEMA_INTEGER(int16_t, uint16_t, INT16, "i16")
+WIBLE_SCHEMA_INTEGER(uint32_t, uint32_t, UINT32, "u32")
+WIBLE_SCHEMA_INTEGER(int32_t, uint32_t, INT32, "i32")
+
+#undef WIBLE_SCHEMA_INTEGER
+
+template<> struct SchemaTraits<float> {
+    using Bits = uint32_t;
+    static constexpr SchemaType TYPE = SchemaType::FLOAT32;
+    static const char* name() { return "f32"; }
+    static Bits toBits(float value) { Bits bits; memcpy(&bits, &value, sizeof(bits)); return bits; }
+    static float fromBits(Bits bits) { float value; memcpy(&value, &bits, sizeof(value)); return value; }
+};
+
+template<> struct SchemaTraits<bool> {
+    using Bits = uint8_t;
+    static constexpr SchemaType TYPE = SchemaType::BOOL;
+    static const char* name() { return "bool"; }
+    static Bits toBits(bool value) { return value ? 1 : 0; }
+    static bool fromBits(Bits bits) { return bits != 0; }
+};
+
+/**
+ * One field: its C++ type and its byte order on the wire
+ */
+template<typename T, ByteOrder Order = ByteOrder::LITTLE>
+struct Field {
+    using Type = T;
+    using Bits = typename SchemaTraits<T>::Bits;
+    static constexpr size_t SIZE = sizeof(Bits);
+
+    static void write(uint8_t* out, T value) {
+        Bits bits = SchemaTraits<T>::toBits(value);
+        for (size_t i = 0; i < SIZE; i++) {
+            out[Order == ByteOrder::LITTLE ? i : SIZE - 1 - i] = (uint8_t)(bits >> (8 * i));
+        }
+    }
+
+    static T read(const uint8_t* in) {
+        Bits bits = 0;
+        for (size_t i = 0; i < SIZE; i++) {
+            bits |= (Bits)((Bits)in[Order == ByteOrder::LITTLE ? i : SIZE - 1 - i] << (8 * i));
+        }
+        return SchemaTraits<T>::fromBits(bits);
+    }
+
+    static uint8_t descriptor() {
+        return (uint8_t)SchemaTraits<T>::TYPE | (Order == ByteOrder::BIG && SIZE > 1 ? 0x80 : 0);
+    }
+
+    static const char* suffix() { return SIZE == 1 ? "" : (Order == ByteOrder::BIG ? "be" : "le"); }
+};
+
+template<typename T> using LE = Field<T, ByteOrder::LITTLE>;
+template<typename T> using BE = Field<T, ByteOrder::BIG>;
+
+// ============================================================================
+// LAYOUT HELPERS
+// ============================================================================
+
+namespace SchemaDetail {
+
+template<typename... Fields> struct Size;
+template<> struct Size<> { static constexpr size_t value = 0; };
+template<typename F, typename... Rest> struct Size<F, Rest...> {
+    static constexpr size_t value = F::SIZE + Size<Rest...>::value;
+};
+
+// Field I and its offset after the command byte
+template<size_t I, typename... Fields> struct At;
+template<typename F, typename... Rest> struct At<0, F, Rest...> {
+    using Type = F;
+    static constexpr size_t offset = 0;
+};
+template<size_t I, typename F, typename... Rest> struct At<I, F, Rest...> {
+    using Type = typename At<I - 1, Rest...>::Type;
+    static constexpr size_t offset = F::SIZE + At<I - 1, Rest...>::offset;
+};
+
+template<typename... Fields> struct Codec;
+template<> struct Codec<> {
+    static void write(uint8_t*) {}
+    static void read(const uint8_t*) {}
+    static void describe(uint8_t*) {}
+    static int describeJSON(char*, size_t, const char* const*, bool) { return 0; }
+};
+template<typename F, typename... Rest> struct Codec<F, Rest...> {
+    template<typename... Values>
+    static void write(uint8_t* out, typename F::Type value, Values... rest) {
+        F::write(out, value);
+        Codec<Rest...>::write(out + F::SIZE, rest...);
+    }
+
+    template<typename... Values>
+    static void read(const uint8_t* in, typename F::Type& value, Values&... rest) {
+        value = F::read(in);
+        Codec<Rest...>::read(in + F::SIZE, rest...);
+    }
+
+    static void describe(uint8_t* out) {
+        out[0] = F::descriptor();
+        Codec<Rest...>::describe(out + 1);
+    }
+
+    // Characters written, or -1 if they do not fit
+    static int describeJSON(char* out, size_t capacity, const char* const* names, bool first) {
+        int n = snprintf(out, capacity, "%s[\"%s\",\"%s%s\"]", first ? "" : ",", names[0],
+                         SchemaTraits<typename F::Type>::name(), F::suffix());
+        if (n < 0 || (size_t)n >= capacity) return -1;
+        int rest = Codec<Rest...>::describeJSON(out + n, capacity - n, names + 1, false);
+        return rest < 0 ? -1 : n + rest;
+    }
+};
+
+} // namespace SchemaDetail
+
+// ============================================================================
+// PACKET SCHEMA
+// ============================================================================
+
+template<uint8_t CommandId, typename... Fields>
+class PacketSchema {
+public:
+    static constexpr uint8_t COMMAND_ID = CommandId;
+    static constexpr size_t FIELD_COUNT = sizeof...(Fields);
+    static constexpr size_t SIZE = 1 + SchemaDetail::Size<Fields...>::value;  // With the command byte
+    static constexpr size_t DESCRIPTOR_SIZE = 4 + FIELD_COUNT;
+
+    static_assert(FIELD_COUNT > 0, "A packet schema needs at least one field");
+
+    template<size_t I> using FieldAt = typename SchemaDetail::At<I, Fields...>::Type;
+
+    /**
+     * Byte offset of field I in the frame
+     */
+    template<size_t I>
+    static constexpr size_t offset() { return 1 + SchemaDetail::At<I, Fields...>::offset; }
+
+    /**
+     * Write the whole frame; out holds at least SIZE bytes
+     */
+    static size_t encode(uint8_t* out, typename Fields::Type... values) {
+        out[0] = CommandId;
+        SchemaDetail::Codec<Fields...>::write(out + 1, values...);
+        return SIZE;
+    }
+
+    /**
+     * Read a frame; false unless it is SIZE bytes with this command ID
+     */
+    static bool decode(const uint8_t* in, size_t length, typename Fields::Type&... values) {
+        if (!matches(in, length)) return false;
+        SchemaDetail::Codec<Fields...>::read(in + 1, values...);
+        return true;
+    }
+
+    static bool matches(const uint8_t* in, size_t length) {
+        return length == SIZE && in[0] == CommandId;
+    }
+
+    /**
+     * Just field I, e.g. for updateBroadcast(bytes, count, offset<I>())
+     * @return Bytes written
+     */
+    template<size_t I>
+    static size_t encodeField(uint8_t* out, typename FieldAt<I>::Type value) {
+        FieldAt<I>::write(out, value);
+        return FieldAt<I>::SIZE;
+    }
+
+    /**
+     * Field I of an encoded frame, in place
+     */
+    template<size_t I>
+    static void set(uint8_t* frame, typename FieldAt<I>::Type value) {
+        FieldAt<I>::write(frame + offset<I>(), value);
+    }
+
+    template<size_t I>
+    static typename FieldAt<I>::Type get(const uint8_t* frame) {
+        return FieldAt<I>::read(frame + offset<I>());
+    }
+
+    /**
+     * Binary descriptor; out holds at least DESCRIPTOR_SIZE bytes
+     */
+    static size_t describe(uint8_t* out) {
+        out[0] = WIBLE_SCHEMA_DESCRIPTOR_MAGIC;
+        out[1] = WIBLE_SCHEMA_DESCRIPTOR_VERSION;
+        out[2] = CommandId;
+        out[3] = (uint8_t)FIELD_COUNT;
+        SchemaDetail::Codec<Fields...>::describe(out + 4);
+        return DESCRIPTOR_SIZE;
+    }
+
+    /**
+     * {"name":"...","cmd":16,"size":12,"fields":[["temperature","f32le"],...]}
+     * @param fieldNames FIELD_COUNT names, in field order
+     * @return Length written, 0 if it does not fit
+     */
+    static size_t describeJSON(char* out, size_t capacity, const char* name, const char* const* fieldNames) {
+        int head = snprintf(out, capacity, "{\"name\":\"%s\",\"cmd\":%u,\"size\":%u,\"fields\":[", name,
+                            (unsigned)CommandId, (unsigned)SIZE);
+        if (head < 0 || (size_t)head >= capacity) return 0;
+        int fields = SchemaDetail::Codec<Fields...>::describeJSON(out + head, capacity - head, fieldNames, true);
+        if (fields < 0 || (size_t)(head + fields + 2) >= capacity) return 0;
+        memcpy(out + head + fields, "]}", 3);
+        return head + fields + 2;
+    }
+};
+
+template<uint8_t C, typename... F> constexpr uint8_t PacketSchema<C, F...>::COMMAND_ID;
+template<uint8_t C, typename... F> constexpr size_t PacketSchema<C, F...>::FIELD_COUNT;
+template<uint8_t C, typename... F> constexpr size_t PacketSchema<C, F...>::SIZE;
+template<uint8_t C, typename... F> constexpr size_t PacketSchema<C, F...>::DESCRIPTOR_SIZE;
+
+} // namespace WiBLE
+
+#endif // WIBLE_PACKET_SCHEMA_H
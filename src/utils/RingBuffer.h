@@ -0,0 +1,106 @@
+/**
+ * RingBuffer.h - Fixed-capacity circular buffer for WiBLE
+ *
+ * Storage is inline and sized at compile time. Pushing into a full buffer
+ * overwrites the oldest element. Iteration runs oldest to newest without
+ * copying. Not synchronized; use from a single task.
+ */
+
+#ifndef WIBLE_RING_BUFFER_H
+#define WIBLE_RING_BUFFER_H
+
+#include <stddef.h>
+
+namespace WiBLE {
+
+template<typename T, size_t Capacity>
+class RingBuffer {
+    static_assert(Capacity > 0, "RingBuffer capacity must be non-zero");
+
+public:
+    RingBuffer() : head(0), count(0) {}
+
+    // ========================================================================
+    // MODIFIERS
+    // ========================================================================
+
+    /**
+     * Append an element, dropping the oldest if full
+     */
+    void push(const T& value) {
+        items[(head + count) % Capacity] = value;
+        if (count < Capacity) {
+            count++;
+        } else {
+            head = (head + 1) % Capacity;
+        }
+    }
+
+    /**
+     * Drop the n oldest elements
+     */
+    void discard(size_t n) {
+        if (n >= count) {
+            clear();
+            return;
+        }
+        head = (head + n) % Capacity;
+        count -= n;
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+    // ========================================================================
+    // ACCESS (index 0 is the oldest element)
+    // ========================================================================
+
+    const T& operator[](size_t index) const { return items[(head + index) % Capacity]; }
+    const T& front() const { return (*this)[0]; }
+    const T& back() const { return (*this)[count - 1]; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == Capacity; }
+    static constexpr size_t capacity() { return Capacity; }
+
+    /**
+     * Call `visit(const T&)` for each element, oldest first
+     */
+    template<typename Visitor>
+    void forEach(Visitor visit) const {
+        for (size_t i = 0; i < count; i++) visit((*this)[i]);
+    }
+
+    // ========================================================================
+    // ITERATION
+    // ========================================================================
+
+    class const_iterator {
+    public:
+        const_iterator(const RingBuffer* ring, size_t index) : ring(ring), index(index) {}
+        const T& operator*() const { return (*ring)[index]; }
+        const T* operator->() const { return &(*ring)[index]; }
+        const_iterator& operator++() { index++; return *this; }
+        bool operator==(const const_iterator& other) const { return index == other.index; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+
+    private:
+        const RingBuffer* ring;
+        size_t index;
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+
+private:
+    T items[Capacity];
+    size_t head;   // Oldest element
+    size_t count;
+};
+
+} // namespace WiBLE
+
+#endif // WIBLE_RING_BUFFER_H
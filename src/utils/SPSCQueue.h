@@ -0,0 +1,84 @@
+/**
+ * SPSCQueue.h - Bounded lock-free single-producer/single-consumer queue
+ *
+ * Slots are preallocated inside the queue. The producer fills a slot in
+ * place (beginWrite/commitWrite) and the consumer reads it in place
+ * (front/pop), so nothing is copied or allocated after construction.
+ */
+
+#ifndef WIBLE_SPSC_QUEUE_H
+#define WIBLE_SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+
+namespace WiBLE {
+
+template<typename T, size_t Capacity>
+class SPSCQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SPSCQueue capacity must be a power of two");
+
+public:
+    SPSCQueue() : head(0), tail(0) {}
+
+    // ========================================================================
+    // PRODUCER
+    // ========================================================================
+
+    /**
+     * Get the next free slot, or nullptr if the queue is full
+     */
+    T* beginWrite() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) >= Capacity) return nullptr;
+        return &slots[t & (Capacity - 1)];
+    }
+
+    /**
+     * Publish the slot returned by beginWrite()
+     */
+    void commitWrite() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // ========================================================================
+    // CONSUMER
+    // ========================================================================
+
+    /**
+     * Get the oldest published slot, or nullptr if the queue is empty
+     */
+    T* front() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return nullptr;
+        return &slots[h & (Capacity - 1)];
+    }
+
+    /**
+     * Release the slot returned by front()
+     */
+    void pop() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // ========================================================================
+    // STATUS (approximate while the other side is running)
+    // ========================================================================
+
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    T slots[Capacity];
+    std::atomic<size_t> head;  // Written by consumer only
+    std::atomic<size_t> tail;  // Written by producer only
+};
+
+} // namespace WiBLE
+
+#endif // WIBLE_SPSC_QUEUE_H
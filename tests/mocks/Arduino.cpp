@@ -1,3 +1,6 @@
 #include "Arduino.h"
+#include "WiFi.h"
 
 SerialMock Serial;
+EspClass ESP;
+WiFiClass WiFi;
@@ -7,6 +7,11 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <chrono>
+#include "esp_timer.h"
+
+// Placement attributes (esp_attr.h) mean nothing on the host
+#define RTC_DATA_ATTR
 
 // Mock String class
 class String : public std::string {
@@ -40,9 +45,20 @@ public:
     }
 };
 
-// Mock time functions
-inline uint32_t millis() { return 0; }
-inline void delay(uint32_t ms) {}
+// Mock time functions (real elapsed time since first use, or the manual clock)
+inline uint64_t mockElapsedUs() {
+    if (mockClock().manual) return (uint64_t)mockClock().nowUs;
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+inline uint32_t millis() { return (uint32_t)(mockElapsedUs() / 1000); }
+inline uint32_t micros() { return (uint32_t)mockElapsedUs(); }
+// Blocking: on the manual clock the whole simulation waits with the caller
+inline void delay(uint32_t ms) { if (mockClock().manual) mockAdvanceClock((int64_t)ms * 1000); }
+
+// Hardware RNG (esp_system.h on the target)
+inline uint32_t esp_random() { return (uint32_t)rand() ^ ((uint32_t)rand() << 16); }
 
 // Mock Serial
 class SerialMock {
@@ -54,4 +70,20 @@ public:
 
 extern SerialMock Serial;
 
+// Mock ESP (heap figures are host-meaningless; benchmarks count allocations instead)
+class EspClass {
+public:
+    uint32_t getHeapSize() { return 0; }
+    uint32_t getFreeHeap() { return 0; }
+    uint32_t getMinFreeHeap() { return 0; }
+    uint32_t getMaxAllocHeap() { return 0; }
+    uint32_t getCycleCount() { return 0; }
+    uint32_t getCpuFreqMHz() { return 240; }
+    void restart() { mockRestarts++; }
+    
+    uint32_t mockRestarts = 0;
+};
+
+extern EspClass ESP;
+
 #endif // ARDUINO_H
@@ -5,24 +5,19 @@
 #include <vector>
 #include <string>
 #include <functional>
-
-// Mock ESP32 UUID types
-typedef struct {
-    uint16_t len;
-    union {
-        uint16_t uuid16;
-        uint32_t uuid32;
-        uint8_t uuid128[16];
-    } uuid;
-} esp_bt_uuid_t;
+#include <map>
+#include "esp_gap_ble_api.h"
+#include "esp_gatts_api.h"
+#include "esp_gattc_api.h"
+#include "esp_bt_defs.h"
 
 class BLEUUID {
 public:
     BLEUUID(const char*) {}
-    esp_bt_uuid_t getNative() {
-        esp_bt_uuid_t u;
+    esp_bt_uuid_t* getNative() {
+        static esp_bt_uuid_t u;
         u.len = 16; // Mock as 128-bit
-        return u;
+        return &u;
     }
 };
 
@@ -50,17 +45,45 @@ public:
     static const uint32_t PROPERTY_WRITE  = 1<<1;
     static const uint32_t PROPERTY_NOTIFY = 1<<2;
 
-    void setCallbacks(BLECharacteristicCallbacks* callbacks) {}
+    BLECharacteristic() : handle(mockNextHandle()++) {}
+
+    void setCallbacks(BLECharacteristicCallbacks* callbacks) { this->callbacks = callbacks; }
+    uint16_t getHandle() { return handle; }
     void addDescriptor(BLEDescriptor* descriptor) {}
-    void setValue(uint8_t* data, size_t size) {}
+    void setValue(uint8_t* data, size_t size) { value.assign((const char*)data, size); }
     void notify() {}
-    std::string getValue() { return ""; }
+    void indicate() {}
+    std::string getValue() { return value; }
+    uint8_t* getData() { return value.empty() ? nullptr : (uint8_t*)&value[0]; }
+    size_t getLength() { return value.size(); }
+
+    // Host simulation: a central writes to this characteristic
+    inline void mockWrite(const uint8_t* data, size_t size, uint16_t connId = 0);
+    inline void mockRead();
+
+    // Characteristics by UUID, as created through BLEService
+    static std::map<std::string, BLECharacteristic*>& mockRegistry() {
+        static std::map<std::string, BLECharacteristic*> registry;
+        return registry;
+    }
+    static BLECharacteristic* mockFind(const char* uuid) {
+        auto it = mockRegistry().find(uuid);
+        return it == mockRegistry().end() ? nullptr : it->second;
+    }
+    static uint16_t& mockNextHandle() { static uint16_t next = 0x2A; return next; }
+
+private:
+    BLECharacteristicCallbacks* callbacks = nullptr;
+    uint16_t handle;
+    std::string value;
 };
 
 class BLEService {
 public:
     BLECharacteristic* createCharacteristic(const char* uuid, uint32_t properties) {
-        return new BLECharacteristic();
+        BLECharacteristic* characteristic = new BLECharacteristic();
+        BLECharacteristic::mockRegistry()[uuid] = characteristic;
+        return characteristic;
     }
     void start() {}
 };
@@ -70,17 +93,30 @@ public:
     void setFlags(uint8_t) {}
     void setManufacturerData(std::string) {}
     void setServiceUUID(const char*) {}
+    void addData(std::string data) { payload += data; }
+    std::string getPayload() { return payload; }
+
+private:
+    std::string payload;
 };
 
 class BLEAdvertising {
 public:
     void addServiceUUID(const char* uuid) {}
-    void start() {}
-    void stop() {}
+    void start() { mockAdvertising = true; }
+    void stop() { mockAdvertising = false; }
     void setScanResponse(bool) {}
     void setMinPreferred(uint8_t) {}
-    void setAdvertisementData(BLEAdvertisementData&) {}
-    void setScanResponseData(BLEAdvertisementData&) {}
+    void setAdvertisementData(BLEAdvertisementData& data) {
+        mockAdvData = data.getPayload();
+        esp_ble_gap_config_adv_data_raw((uint8_t*)mockAdvData.data(), mockAdvData.size());
+    }
+    void setScanResponseData(BLEAdvertisementData& data) { mockScanResponse = data.getPayload(); }
+
+    // Host simulation: what the stack would put on air
+    std::string mockAdvData;
+    std::string mockScanResponse;
+    bool mockAdvertising = false;
 };
 
 class BLEScanResults {
@@ -100,34 +136,120 @@ public:
 
 class BLEServer {
 public:
-    void setCallbacks(BLEServerCallbacks* callbacks) {}
+    void setCallbacks(BLEServerCallbacks* callbacks) { this->callbacks = callbacks; }
     BLEService* createService(const char* uuid) { return new BLEService(); }
     void startAdvertising() {}
-    int getConnectedCount() { return 0; }
+    int getConnectedCount() { return mockConnectedCount(); }
+    static int& mockConnectedCount() { static int count = 0; return count; }  // Set by host benchmarks
+    uint16_t getConnId() { return lastConnId; }
+    uint16_t getGattsIf() { return 3; }
+    inline void disconnect(uint16_t connId);
+
+    // Host simulation: a central connects, negotiates an MTU, disconnects
+    inline void mockConnect(uint16_t connId = 0);
+    inline void mockMtu(uint16_t mtu, uint16_t connId = 0);
+    inline void mockDisconnect(uint16_t connId = 0);
+
+    // The most recently created server
+    static BLEServer*& mockInstance() { static BLEServer* server = nullptr; return server; }
+
+private:
+    BLEServerCallbacks* callbacks = nullptr;
+    uint16_t lastConnId = 0;
 };
 
+typedef esp_gap_ble_cb_t gap_event_handler;
+typedef esp_gattc_cb_t gattc_event_handler;
+
 class BLEDevice {
 public:
-    static void init(std::string) {}
-    static BLEServer* createServer() { return new BLEServer(); }
-    static BLEAdvertising* getAdvertising() { return new BLEAdvertising(); }
+    static void init(std::string) { mockInitialized() = true; }
+    static void deinit(bool releaseMemory = false) {
+        mockInitialized() = false;
+        if (releaseMemory) mockMemoryReleased() = true;
+    }
+    static void setCustomGapHandler(gap_event_handler handler) { mockGapHandler() = handler; }
+    static void setCustomGattcHandler(gattc_event_handler handler) { mockGattcHandler() = handler; }
+    static void setMTU(uint16_t) {}
+    static BLEServer* createServer() { return BLEServer::mockInstance() = new BLEServer(); }
+    static BLEAdvertising* getAdvertising() { static BLEAdvertising advertising; return &advertising; }
     static BLEScan* getScan() { return new BLEScan(); }
+
+    // Host simulation: stack state after init() / deinit()
+    static bool& mockInitialized() { static bool initialized = false; return initialized; }
+    static bool& mockMemoryReleased() { static bool released = false; return released; }
 };
 
 class BLEServerCallbacks {
 public:
     virtual ~BLEServerCallbacks() {}
     virtual void onConnect(BLEServer* server) {}
+    virtual void onConnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) {}
     virtual void onDisconnect(BLEServer* server) {}
-    virtual void onMtuChanged(BLEServer* server, uint16_t mtu) {}
+    virtual void onDisconnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) {}
+    virtual void onMtuChanged(BLEServer* server, esp_ble_gatts_cb_param_t* param) {}
 };
 
 class BLECharacteristicCallbacks {
 public:
     virtual ~BLECharacteristicCallbacks() {}
     virtual void onWrite(BLECharacteristic* characteristic) {}
+    virtual void onWrite(BLECharacteristic* characteristic, esp_ble_gatts_cb_param_t* param) { onWrite(characteristic); }
     virtual void onRead(BLECharacteristic* characteristic) {}
     virtual void onNotify(BLECharacteristic* characteristic) {}
 };
 
+// Like Bluedroid, every server event goes to both callback overloads
+inline void BLECharacteristic::mockWrite(const uint8_t* data, size_t size, uint16_t connId) {
+    value.assign((const char*)data, size);
+    esp_ble_gatts_cb_param_t param;
+    param.write.conn_id = connId;
+    param.write.handle = handle;
+    param.write.len = (uint16_t)size;
+    param.write.value = (uint8_t*)data;
+    if (callbacks) callbacks->onWrite(this, &param);
+}
+
+inline void BLECharacteristic::mockRead() {
+    if (callbacks) callbacks->onRead(this);
+}
+
+inline void BLEServer::mockConnect(uint16_t connId) {
+    mockConnectedCount()++;
+    lastConnId = connId;
+    esp_ble_gatts_cb_param_t param;
+    param.connect.conn_id = connId;
+    param.connect.link_role = 1;        // The central is the phone
+    for (int i = 0; i < 6; i++) param.connect.remote_bda[i] = (uint8_t)(0xA0 + i);
+    param.connect.remote_bda[5] = (uint8_t)connId;
+    if (callbacks) {
+        callbacks->onConnect(this);
+        callbacks->onConnect(this, &param);
+    }
+}
+
+inline void BLEServer::mockMtu(uint16_t mtu, uint16_t connId) {
+    esp_ble_gatts_cb_param_t param;
+    param.mtu.conn_id = connId;
+    param.mtu.mtu = mtu;
+    if (callbacks) callbacks->onMtuChanged(this, &param);
+}
+
+inline void BLEServer::mockDisconnect(uint16_t connId) {
+    if (mockConnectedCount() > 0) mockConnectedCount()--;
+    esp_ble_gatts_cb_param_t param;
+    param.disconnect.conn_id = connId;
+    param.disconnect.reason = 0x13;  // Remote user terminated connection
+    for (int i = 0; i < 6; i++) param.disconnect.remote_bda[i] = (uint8_t)(0xA0 + i);
+    param.disconnect.remote_bda[5] = (uint8_t)connId;
+    if (callbacks) {
+        callbacks->onDisconnect(this);
+        callbacks->onDisconnect(this, &param);
+    }
+}
+
+inline void BLEServer::disconnect(uint16_t connId) {
+    mockDisconnect(connId);
+}
+
 #endif
@@ -13,6 +13,7 @@ public:
     size_t putString(const char* key, const String& value) { return value.length(); }
     String getString(const char* key, const String& defaultValue = String()) { return defaultValue; }
     
+    bool remove(const char* key) { return true; }
     void clear() {}
 };
 
@@ -5,11 +5,27 @@
 
 class UpdateClass {
 public:
-    bool begin(size_t size, int command = 0) { return true; }
-    size_t write(uint8_t* data, size_t len) { return len; }
-    bool end(bool evenIfRemaining = true) { return true; }
+    bool begin(size_t size, int command = 0) {
+        mockImage.clear();
+        mockEnded = mockAborted = false;
+        return size <= mockPartitionSize;
+    }
+    size_t write(uint8_t* data, size_t len) {
+        if (mockFailWrites) return 0;
+        mockImage.insert(mockImage.end(), data, data + len);
+        return len;
+    }
+    bool end(bool evenIfRemaining = true) { mockEnded = true; return true; }
+    void abort() { mockAborted = true; }
     bool hasError() { return false; }
     int getError() { return 0; }
+    
+    // Host simulation: what reached the "partition"
+    std::vector<uint8_t> mockImage;
+    size_t mockPartitionSize = 0x1E0000;
+    bool mockFailWrites = false;
+    bool mockEnded = false;
+    bool mockAborted = false;
 };
 
 extern UpdateClass Update;
@@ -3,15 +3,27 @@
 
 #include "Arduino.h"
 #include <vector>
+#include <cstdio>
+#include <functional>
 
 #define WIFI_STA 1
+#define WL_IDLE_STATUS 0
+#define WL_NO_SSID_AVAIL 1
 #define WL_CONNECTED 3
+#define WL_CONNECT_FAILED 4
+#define WL_CONNECTION_LOST 5
+#define WL_DISCONNECTED 6
 #define WIFI_AUTH_OPEN 0
 #define WIFI_AUTH_WEP 1
 #define WIFI_AUTH_WPA_PSK 2
 #define WIFI_AUTH_WPA2_PSK 3
 #define WIFI_AUTH_WPA_WPA2_PSK 4
 #define WIFI_AUTH_WPA2_ENTERPRISE 5
+#define WIFI_AUTH_WPA3_PSK 6
+#define WIFI_AUTH_WPA2_WPA3_PSK 7
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
 
 #define WIFI_PS_MIN_MODEM 1
 
@@ -21,34 +33,188 @@ typedef int wifi_ps_type_t;
 typedef int wifi_auth_mode_t;
 typedef int WiFiEvent_t;
 
+// Arduino-ESP32 2.x event ids (subset)
+#define ARDUINO_EVENT_WIFI_SCAN_DONE 1
+#define ARDUINO_EVENT_WIFI_STA_CONNECTED 4
+#define ARDUINO_EVENT_WIFI_STA_DISCONNECTED 5
+#define ARDUINO_EVENT_WIFI_STA_GOT_IP 7
+#define ARDUINO_EVENT_WIFI_STA_LOST_IP 8
+
+typedef void (*WiFiEventCb)(WiFiEvent_t event);
+struct WiFiEventInfo_t {};      // arduino_event_info_t, unused by the mocks
+typedef std::function<void(WiFiEvent_t event, WiFiEventInfo_t info)> WiFiEventFuncCb;
+typedef int wifi_event_id_t;
+
+// Access points the mock scan reports; empty reports the single "TestNetwork"
+struct MockAccessPoint {
+    String ssid;
+    int32_t rssi;
+    int32_t channel;
+    int auth;
+    uint8_t bssid[6];
+    String passphrase;          // With mockAssociation: empty accepts any
+    uint32_t associationMs;     // With mockAssociation: begin() to WL_CONNECTED
+};
+
 class IPAddress {
 public:
-    String toString() const { return "192.168.1.100"; }
+    IPAddress() : address(0) {}
+    IPAddress(uint32_t address) : address(address) {}
+    operator uint32_t() const { return address; }
+    
+    bool fromString(const char* text) {
+        unsigned a, b, c, d;
+        if (sscanf(text, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) return false;
+        address = a | (b << 8) | (c << 16) | (d << 24);
+        return true;
+    }
+    bool fromString(const String& text) { return fromString(text.c_str()); }
+    
+    String toString() const {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", (unsigned)(address & 0xFF), (unsigned)((address >> 8) & 0xFF),
+                 (unsigned)((address >> 16) & 0xFF), (unsigned)(address >> 24));
+        return String(text);
+    }
+    
+private:
+    uint32_t address;  // Network byte order, like the core's
 };
 
 class WiFiClass {
 public:
     void mode(int m) {}
     void setAutoReconnect(bool b) {}
-    void begin(const char* ssid, const char* pass) {}
-    int status() { return WL_CONNECTED; }
-    void disconnect(bool wifioff = false) {}
-    
-    int16_t scanNetworks(bool async) { return 1; }
-    int16_t scanComplete() { return 1; }
-    void scanDelete() {}
-    
-    String SSID(int i) { return "TestNetwork"; }
-    String SSID() { return "TestNetwork"; }
-    int32_t RSSI(int i) { return -60; }
-    int32_t RSSI() { return -60; }
-    int32_t channel(int i) { return 6; }
-    int encryptionType(int i) { return WIFI_AUTH_WPA2_PSK; }
-    
-    IPAddress localIP() { return IPAddress(); }
-    IPAddress gatewayIP() { return IPAddress(); }
-    IPAddress subnetMask() { return IPAddress(); }
-    String macAddress() { return "00:11:22:33:44:55"; }
+    wifi_event_id_t onEvent(WiFiEventCb cb) {
+        return onEvent([cb](WiFiEvent_t event, WiFiEventInfo_t) { cb(event); });
+    }
+    wifi_event_id_t onEvent(WiFiEventFuncCb cb) {
+        eventCbs.push_back(cb);
+        return (wifi_event_id_t)eventCbs.size();
+    }
+    void removeEvent(wifi_event_id_t id) {
+        if (id > 0 && (size_t)id <= eventCbs.size()) eventCbs[id - 1] = nullptr;
+    }
+    void begin(const char* ssid, const char* pass = nullptr, int32_t channel = 0,
+               const uint8_t* bssid = nullptr, bool connect = true) {
+        joinSsid = ssid ? ssid : "";
+        joinPassphrase = pass ? pass : "";
+        joinStartedAt = millis();
+        joining = true;
+        linkUp = false;
+        joinResult = WL_DISCONNECTED;
+    }
+    bool config(IPAddress local, IPAddress gateway, IPAddress subnet,
+                IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress()) { return true; }
+    int status() {
+        if (!associate) return WL_CONNECTED;
+        if (joining) finishAssociation();
+        return linkUp ? WL_CONNECTED : joinResult;
+    }
+    void disconnect(bool wifioff = false) {
+        bool wasUp = linkUp;
+        joining = false;
+        linkUp = false;
+        joinResult = WL_DISCONNECTED;
+        if (wasUp && associate) mockEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    }
+    
+    int16_t scanNetworks(bool async, bool show_hidden = false, bool passive = false,
+                         uint32_t max_ms_per_chan = 300, uint8_t channel = 0) {
+        scanResults.clear();
+        if (accessPoints.empty()) {
+            MockAccessPoint ap = { "TestNetwork", -60, 6, WIFI_AUTH_WPA2_PSK, { 0x02, 0, 0, 0, 0, 0x01 } };
+            scanResults.push_back(ap);
+        }
+        for (const MockAccessPoint& ap : accessPoints) {
+            if (channel == 0 || ap.channel == channel) scanResults.push_back(ap);
+        }
+        scanStarts++;
+        scanRunning = async;
+        return async ? WIFI_SCAN_RUNNING : (int16_t)scanResults.size();
+    }
+    int16_t scanComplete() { return scanRunning ? WIFI_SCAN_RUNNING : (int16_t)scanResults.size(); }
+    void scanDelete() { scanResults.clear(); scanRunning = false; }
+    
+    // Finish the running async scan and raise ARDUINO_EVENT_WIFI_SCAN_DONE
+    void mockCompleteScan() {
+        scanRunning = false;
+        mockEvent(ARDUINO_EVENT_WIFI_SCAN_DONE);
+    }
+    void mockEvent(WiFiEvent_t event) {
+        for (const WiFiEventFuncCb& cb : eventCbs) {
+            if (cb) cb(event, WiFiEventInfo_t());
+        }
+    }
+    
+    // Host simulation: begin() joins one of mockAccessPoints() after its
+    // associationMs and checks the passphrase; an unknown SSID fails after
+    // mockMissingSsidMs. Off, status() is always WL_CONNECTED.
+    void mockAssociation(bool enabled) { associate = enabled; }
+    void mockMissingSsidMs(uint32_t ms) { missingSsidMs = ms; }
+    void mockMacAddress(const String& mac) { macText = mac; }
+    std::vector<MockAccessPoint>& mockAccessPoints() { return accessPoints; }
+    uint32_t mockScanStarts() const { return scanStarts; }
+    void mockLinkRssi(int32_t rssi) { linkRssi = rssi; }
+    
+    String SSID(int i) { return scanResults[i].ssid; }
+    String SSID() { return associate ? joinSsid : String("TestNetwork"); }
+    int32_t RSSI(int i) { return scanResults[i].rssi; }
+    int32_t RSSI() { return linkRssi; }
+    int32_t channel(int i) { return scanResults[i].channel; }
+    int32_t channel() { return 6; }
+    uint8_t* BSSID(int i) { return scanResults[i].bssid; }
+    uint8_t* BSSID() { static uint8_t bssid[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 }; return bssid; }
+    int encryptionType(int i) { return scanResults[i].auth; }
+    
+    IPAddress localIP() { return IPAddress(0x6401A8C0); }      // 192.168.1.100
+    IPAddress gatewayIP() { return IPAddress(0x0101A8C0); }    // 192.168.1.1
+    IPAddress subnetMask() { return IPAddress(0x00FFFFFF); }   // 255.255.255.0
+    IPAddress dnsIP(uint8_t index = 0) { return IPAddress(0x0101A8C0); }
+    String macAddress() { return macText; }
+    
+private:
+    std::vector<WiFiEventFuncCb> eventCbs;
+    std::vector<MockAccessPoint> accessPoints;
+    std::vector<MockAccessPoint> scanResults;
+    uint32_t scanStarts = 0;
+    int32_t linkRssi = -60;
+    bool scanRunning = false;
+    
+    bool associate = false;
+    uint32_t missingSsidMs = 3000;
+    String macText = "00:11:22:33:44:55";
+    String joinSsid;
+    String joinPassphrase;
+    uint32_t joinStartedAt = 0;
+    bool joining = false;
+    bool linkUp = false;
+    int joinResult = WL_DISCONNECTED;
+    
+    void finishAssociation() {
+        uint32_t elapsed = millis() - joinStartedAt;
+        const MockAccessPoint* target = nullptr;
+        for (const MockAccessPoint& ap : accessPoints) {
+            if (ap.ssid == joinSsid) target = &ap;
+        }
+        if (!target) {
+            if (elapsed < missingSsidMs) return;
+            joining = false;
+            joinResult = WL_NO_SSID_AVAIL;
+            mockEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+            return;
+        }
+        if (elapsed < target->associationMs) return;
+        joining = false;
+        if (!target->passphrase.empty() && target->passphrase != joinPassphrase) {
+            joinResult = WL_CONNECT_FAILED;
+            mockEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+            return;
+        }
+        linkUp = true;
+        mockEvent(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+        mockEvent(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    }
 };
 
 extern WiFiClass WiFi;
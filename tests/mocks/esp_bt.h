@@ -0,0 +1,33 @@
+#ifndef ESP_BT_H
+#define ESP_BT_H
+
+#include <esp_gap_ble_api.h>
+
+// Mock controller TX power (subset of esp_bt.h)
+typedef enum {
+    ESP_BLE_PWR_TYPE_CONN_HDL0 = 0,
+    ESP_BLE_PWR_TYPE_ADV = 9,
+    ESP_BLE_PWR_TYPE_SCAN = 10,
+    ESP_BLE_PWR_TYPE_DEFAULT = 11,
+} esp_ble_power_type_t;
+
+typedef enum {
+    ESP_PWR_LVL_N12 = 0,
+    ESP_PWR_LVL_N9 = 1,
+    ESP_PWR_LVL_N6 = 2,
+    ESP_PWR_LVL_N3 = 3,
+    ESP_PWR_LVL_N0 = 4,
+    ESP_PWR_LVL_P3 = 5,
+    ESP_PWR_LVL_P6 = 6,
+    ESP_PWR_LVL_P9 = 7,
+} esp_power_level_t;
+
+// Host simulation: last advertising TX power level set
+inline esp_power_level_t& mockAdvTxPower() { static esp_power_level_t level = ESP_PWR_LVL_P3; return level; }
+
+inline esp_err_t esp_ble_tx_power_set(esp_ble_power_type_t power_type, esp_power_level_t power_level) {
+    if (power_type == ESP_BLE_PWR_TYPE_ADV) mockAdvTxPower() = power_level;
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef ESP_BT_DEFS_H
+#define ESP_BT_DEFS_H
+
+#include <stdint.h>
+
+// Mock Bluetooth UUID (subset of esp_bt_defs.h)
+#define ESP_UUID_LEN_16  2
+#define ESP_UUID_LEN_32  4
+#define ESP_UUID_LEN_128 16
+
+typedef struct {
+    uint16_t len;
+    union {
+        uint16_t uuid16;
+        uint32_t uuid32;
+        uint8_t uuid128[ESP_UUID_LEN_128];
+    } uuid;
+} esp_bt_uuid_t;
+
+#endif
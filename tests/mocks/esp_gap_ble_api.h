@@ -0,0 +1,257 @@
+#ifndef ESP_GAP_BLE_API_H
+#define ESP_GAP_BLE_API_H
+
+#include <stdint.h>
+
+#ifndef ESP_OK
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#endif
+
+typedef uint8_t esp_bd_addr_t[6];
+
+inline uint16_t esp_ble_get_cur_sendable_packets_num(uint16_t) { return 10; }
+
+// Mock GAP scanning (subset of esp_gap_ble_api.h)
+#define ESP_BLE_ADV_DATA_LEN_MAX 31
+#define ESP_BLE_SCAN_RSP_DATA_LEN_MAX 31
+
+typedef enum { ESP_BT_STATUS_SUCCESS = 0, ESP_BT_STATUS_FAIL } esp_bt_status_t;
+typedef enum { BLE_SCAN_TYPE_PASSIVE = 0, BLE_SCAN_TYPE_ACTIVE } esp_ble_scan_type_t;
+typedef enum { BLE_ADDR_TYPE_PUBLIC = 0, BLE_ADDR_TYPE_RANDOM } esp_ble_addr_type_t;
+typedef enum { BLE_SCAN_FILTER_ALLOW_ALL = 0 } esp_ble_scan_filter_t;
+typedef enum { BLE_SCAN_DUPLICATE_DISABLE = 0, BLE_SCAN_DUPLICATE_ENABLE } esp_ble_scan_duplicate_t;
+typedef enum { ESP_GAP_SEARCH_INQ_RES_EVT = 0, ESP_GAP_SEARCH_INQ_CMPL_EVT = 1 } esp_gap_search_evt_t;
+
+typedef enum {
+    ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT = 2,
+    ESP_GAP_BLE_SCAN_RESULT_EVT = 3,
+    ESP_GAP_BLE_SCAN_START_COMPLETE_EVT = 7,
+    ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT = 18,
+} esp_gap_ble_cb_event_t;
+
+typedef struct {
+    esp_ble_scan_type_t scan_type;
+    esp_ble_addr_type_t own_addr_type;
+    esp_ble_scan_filter_t scan_filter_policy;
+    uint16_t scan_interval;
+    uint16_t scan_window;
+    esp_ble_scan_duplicate_t scan_duplicate;
+} esp_ble_scan_params_t;
+
+typedef union {
+    struct {
+        esp_gap_search_evt_t search_evt;
+        esp_bd_addr_t bda;
+        esp_ble_addr_type_t ble_addr_type;
+        int rssi;
+        uint8_t ble_adv[ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX];
+        uint8_t adv_data_len;
+        uint8_t scan_rsp_len;
+    } scan_rst;
+    struct { esp_bt_status_t status; } scan_param_cmpl;
+    struct { esp_bt_status_t status; } scan_start_cmpl;
+    struct { esp_bt_status_t status; } scan_stop_cmpl;
+} esp_ble_gap_cb_param_t;
+
+typedef void (*esp_gap_ble_cb_t)(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+
+// Host simulation: the handler installed through BLEDevice::setCustomGapHandler,
+// and the last scan parameters / state requested by the library
+inline esp_gap_ble_cb_t& mockGapHandler() { static esp_gap_ble_cb_t handler = nullptr; return handler; }
+inline esp_ble_scan_params_t& mockScanParams() { static esp_ble_scan_params_t params; return params; }
+inline bool& mockScanning() { static bool scanning = false; return scanning; }
+
+inline void mockGapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+    if (mockGapHandler()) mockGapHandler()(event, param);
+}
+
+inline esp_err_t esp_ble_gap_set_scan_params(esp_ble_scan_params_t* scan_params) {
+    mockScanParams() = *scan_params;
+    esp_ble_gap_cb_param_t param = {};
+    param.scan_param_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    mockGapEvent(ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT, &param);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_start_scanning(uint32_t) {
+    mockScanning() = true;
+    esp_ble_gap_cb_param_t param = {};
+    param.scan_start_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    mockGapEvent(ESP_GAP_BLE_SCAN_START_COMPLETE_EVT, &param);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_stop_scanning() {
+    mockScanning() = false;
+    return ESP_OK;
+}
+
+// Host simulation: the raw advertising data last given to the controller
+struct MockAdvData { uint8_t data[ESP_BLE_ADV_DATA_LEN_MAX]; uint32_t length; uint32_t configs; };
+inline MockAdvData& mockAdvData() { static MockAdvData adv = {}; return adv; }
+
+inline esp_err_t esp_ble_gap_config_adv_data_raw(uint8_t* raw_data, uint32_t raw_data_len) {
+    if (raw_data_len > ESP_BLE_ADV_DATA_LEN_MAX) return ESP_FAIL;
+    for (uint32_t i = 0; i < raw_data_len; i++) mockAdvData().data[i] = raw_data[i];
+    mockAdvData().length = raw_data_len;
+    mockAdvData().configs++;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_config_scan_rsp_data_raw(uint8_t*, uint32_t raw_data_len) {
+    return raw_data_len > ESP_BLE_SCAN_RSP_DATA_LEN_MAX ? ESP_FAIL : ESP_OK;
+}
+
+// Mock legacy advertising
+typedef enum { ADV_TYPE_IND = 0x00, ADV_TYPE_SCAN_IND = 0x02, ADV_TYPE_NONCONN_IND = 0x03 } esp_ble_adv_type_t;
+typedef enum { ADV_CHNL_37 = 0x01, ADV_CHNL_38 = 0x02, ADV_CHNL_39 = 0x04, ADV_CHNL_ALL = 0x07 } esp_ble_adv_channel_t;
+typedef enum { ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY = 0x00 } esp_ble_adv_filter_t;
+
+typedef struct {
+    uint16_t adv_int_min;
+    uint16_t adv_int_max;
+    esp_ble_adv_type_t adv_type;
+    esp_ble_addr_type_t own_addr_type;
+    esp_bd_addr_t peer_addr;
+    esp_ble_addr_type_t peer_addr_type;
+    esp_ble_adv_channel_t channel_map;
+    esp_ble_adv_filter_t adv_filter_policy;
+} esp_ble_adv_params_t;
+
+// Host simulation: legacy advertiser state and the last parameters
+inline bool& mockLegacyAdvertising() { static bool advertising = false; return advertising; }
+inline esp_ble_adv_params_t& mockLegacyAdvParams() { static esp_ble_adv_params_t params; return params; }
+
+inline esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t* adv_params) {
+    mockLegacyAdvParams() = *adv_params;
+    mockLegacyAdvertising() = true;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_stop_advertising() {
+    mockLegacyAdvertising() = false;
+    return ESP_OK;
+}
+
+// Mock BLE 5.0 extended advertising
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_IND     (0x13)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_SCAN    (0x12)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_NONCONN (0x10)
+#define ESP_BLE_GAP_PHY_1M 1
+
+typedef struct {
+    uint16_t type;
+    uint32_t interval_min;
+    uint32_t interval_max;
+    esp_ble_adv_channel_t channel_map;
+    esp_ble_addr_type_t own_addr_type;
+    esp_ble_addr_type_t peer_addr_type;
+    esp_bd_addr_t peer_addr;
+    esp_ble_adv_filter_t filter_policy;
+    int8_t tx_power;
+    uint8_t primary_phy;
+    uint8_t max_skip;
+    uint8_t secondary_phy;
+    uint8_t sid;
+    bool scan_req_notif;
+} esp_ble_gap_ext_adv_params_t;
+
+typedef struct {
+    uint8_t instance;
+    int duration;
+    int max_events;
+} esp_ble_gap_ext_adv_t;
+
+// Host simulation: per-instance extended advertising state
+struct MockExtAdvSet { esp_ble_gap_ext_adv_params_t params; uint8_t data[ESP_BLE_ADV_DATA_LEN_MAX]; uint16_t length; uint32_t configs; bool advertising; };
+inline MockExtAdvSet* mockExtAdv() { static MockExtAdvSet sets[10] = {}; return sets; }
+
+inline esp_err_t esp_ble_gap_ext_adv_set_params(uint8_t instance, const esp_ble_gap_ext_adv_params_t* params) {
+    if (instance >= 10) return ESP_FAIL;
+    mockExtAdv()[instance].params = *params;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_config_ext_adv_data_raw(uint8_t instance, uint16_t length, const uint8_t* data) {
+    if (instance >= 10 || length > ESP_BLE_ADV_DATA_LEN_MAX) return ESP_FAIL;
+    for (uint16_t i = 0; i < length; i++) mockExtAdv()[instance].data[i] = data[i];
+    mockExtAdv()[instance].length = length;
+    mockExtAdv()[instance].configs++;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_config_ext_scan_rsp_data_raw(uint8_t instance, uint16_t length, const uint8_t*) {
+    return (instance >= 10 || length > ESP_BLE_SCAN_RSP_DATA_LEN_MAX) ? ESP_FAIL : ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_ext_adv_start(uint8_t num_adv, const esp_ble_gap_ext_adv_t* ext_adv) {
+    for (uint8_t i = 0; i < num_adv; i++) mockExtAdv()[ext_adv[i].instance].advertising = true;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_ext_adv_stop(uint8_t num_adv, const uint8_t* ext_adv_inst) {
+    for (uint8_t i = 0; i < num_adv; i++) mockExtAdv()[ext_adv_inst[i]].advertising = false;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_ext_adv_set_remove(uint8_t instance) {
+    if (instance >= 10) return ESP_FAIL;
+    mockExtAdv()[instance] = MockExtAdvSet();
+    return ESP_OK;
+}
+
+// Mock connection parameters, data length and PHY requests
+typedef struct {
+    esp_bd_addr_t bda;
+    uint16_t min_int;
+    uint16_t max_int;
+    uint16_t latency;
+    uint16_t timeout;
+} esp_ble_conn_update_params_t;
+
+typedef uint8_t esp_ble_gap_all_phys_t;
+typedef uint8_t esp_ble_gap_phy_mask_t;
+typedef uint16_t esp_ble_gap_prefer_phy_options_t;
+#define ESP_BLE_GAP_PHY_1M_PREF_MASK    (1 << 0)
+#define ESP_BLE_GAP_PHY_2M_PREF_MASK    (1 << 1)
+#define ESP_BLE_GAP_PHY_OPTIONS_NO_PREF 0
+
+// Host simulation: the last requests per peer (by the last address byte)
+struct MockLinkRequests { esp_ble_conn_update_params_t params; uint32_t updates; uint16_t txOctets; uint8_t phyMask; };
+inline MockLinkRequests* mockLinkRequests() { static MockLinkRequests links[256] = {}; return links; }
+
+inline esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t* params) {
+    MockLinkRequests& link = mockLinkRequests()[params->bda[5]];
+    link.params = *params;
+    link.updates++;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t remote_device, uint16_t tx_data_length) {
+    mockLinkRequests()[remote_device[5]].txOctets = tx_data_length;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_set_prefered_phy(esp_bd_addr_t bd_addr, esp_ble_gap_all_phys_t,
+                                              esp_ble_gap_phy_mask_t tx_phy_mask, esp_ble_gap_phy_mask_t,
+                                              esp_ble_gap_prefer_phy_options_t) {
+    mockLinkRequests()[bd_addr[5]].phyMask = tx_phy_mask;
+    return ESP_OK;
+}
+
+// Host simulation: a peripheral advertises while the scan is running
+inline void mockAdvertisement(const uint8_t* address, int rssi, const uint8_t* data, uint8_t length) {
+    if (!mockScanning()) return;
+    esp_ble_gap_cb_param_t param = {};
+    param.scan_rst.search_evt = ESP_GAP_SEARCH_INQ_RES_EVT;
+    for (int i = 0; i < 6; i++) param.scan_rst.bda[i] = address[i];
+    param.scan_rst.rssi = rssi;
+    if (length > ESP_BLE_ADV_DATA_LEN_MAX) length = ESP_BLE_ADV_DATA_LEN_MAX;
+    for (uint8_t i = 0; i < length; i++) param.scan_rst.ble_adv[i] = data[i];
+    param.scan_rst.adv_data_len = length;
+    mockGapEvent(ESP_GAP_BLE_SCAN_RESULT_EVT, &param);
+}
+
+#endif
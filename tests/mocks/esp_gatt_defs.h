@@ -0,0 +1,43 @@
+#ifndef ESP_GATT_DEFS_H
+#define ESP_GATT_DEFS_H
+
+#include <stdint.h>
+#include "esp_bt_defs.h"
+
+// Mock GATT definitions (subset of esp_gatt_defs.h)
+typedef uint8_t esp_gatt_if_t;
+typedef uint8_t esp_gatt_char_prop_t;
+
+#define ESP_GATT_IF_NONE                 0xFF
+#define ESP_GATT_UUID_CHAR_CLIENT_CONFIG 0x2902
+
+typedef enum {
+    ESP_GATT_OK = 0x00,
+    ESP_GATT_ERROR = 0x85,
+    ESP_GATT_NOT_FOUND = 0x8B,
+    ESP_GATT_INVALID_PDU = 0x04
+} esp_gatt_status_t;
+
+typedef enum {
+    ESP_GATT_WRITE_TYPE_NO_RSP = 1,
+    ESP_GATT_WRITE_TYPE_RSP = 2
+} esp_gatt_write_type_t;
+
+typedef enum {
+    ESP_GATT_AUTH_REQ_NONE = 0
+} esp_gatt_auth_req_t;
+
+typedef enum {
+    ESP_GATT_CONN_UNKNOWN = 0,
+    ESP_GATT_CONN_TIMEOUT = 0x08,
+    ESP_GATT_CONN_TERMINATE_PEER_USER = 0x13,
+    ESP_GATT_CONN_TERMINATE_LOCAL_HOST = 0x16,
+    ESP_GATT_CONN_FAIL_ESTABLISH = 0x3E
+} esp_gatt_conn_reason_t;
+
+typedef struct {
+    esp_bt_uuid_t uuid;
+    uint8_t inst_id;
+} esp_gatt_id_t;
+
+#endif
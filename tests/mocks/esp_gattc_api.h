@@ -0,0 +1,174 @@
+#ifndef ESP_GATTC_API_H
+#define ESP_GATTC_API_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include "esp_gap_ble_api.h"
+#include "esp_gatt_defs.h"
+
+// Mock GATT client (subset of esp_gattc_api.h, IDF 4.4 values)
+typedef enum {
+    ESP_GATTC_REG_EVT = 0,
+    ESP_GATTC_UNREG_EVT = 1,
+    ESP_GATTC_OPEN_EVT = 2,
+    ESP_GATTC_WRITE_CHAR_EVT = 4,
+    ESP_GATTC_CLOSE_EVT = 5,
+    ESP_GATTC_SEARCH_CMPL_EVT = 6,
+    ESP_GATTC_SEARCH_RES_EVT = 7,
+    ESP_GATTC_WRITE_DESCR_EVT = 9,
+    ESP_GATTC_NOTIFY_EVT = 10,
+    ESP_GATTC_CFG_MTU_EVT = 18,
+    ESP_GATTC_REG_FOR_NOTIFY_EVT = 38,
+    ESP_GATTC_CONNECT_EVT = 40,
+    ESP_GATTC_DISCONNECT_EVT = 41
+} esp_gattc_cb_event_t;
+
+typedef union {
+    struct { esp_gatt_status_t status; uint16_t app_id; } reg;
+    struct { esp_gatt_status_t status; uint16_t conn_id; esp_bd_addr_t remote_bda; uint16_t mtu; } open;
+    struct { esp_gatt_status_t status; uint16_t conn_id; esp_bd_addr_t remote_bda;
+             esp_gatt_conn_reason_t reason; } close;
+    struct { esp_gatt_status_t status; uint16_t conn_id; uint16_t mtu; } cfg_mtu;
+    struct { esp_gatt_status_t status; uint16_t conn_id; int searched_service_source; } search_cmpl;
+    struct { uint16_t conn_id; uint16_t start_handle; uint16_t end_handle; esp_gatt_id_t srvc_id;
+             bool is_primary; } search_res;
+    struct { esp_gatt_status_t status; uint16_t conn_id; uint16_t handle; uint16_t offset; } write;
+    struct { uint16_t conn_id; esp_bd_addr_t remote_bda; uint16_t handle; uint16_t value_len;
+             uint8_t* value; bool is_notify; } notify;
+    struct { esp_gatt_status_t status; uint16_t handle; } reg_for_notify;
+    struct { uint16_t conn_id; uint8_t link_role; esp_bd_addr_t remote_bda; } connect;
+    struct { esp_gatt_conn_reason_t reason; uint16_t conn_id; esp_bd_addr_t remote_bda; } disconnect;
+} esp_ble_gattc_cb_param_t;
+
+typedef void (*esp_gattc_cb_t)(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t* param);
+
+typedef struct {
+    uint16_t char_handle;
+    esp_gatt_char_prop_t properties;
+    esp_bt_uuid_t uuid;
+} esp_gattc_char_elem_t;
+
+typedef struct {
+    uint16_t handle;
+    esp_bt_uuid_t uuid;
+} esp_gattc_descr_elem_t;
+
+// Host simulation: nothing answers on its own. Every request the library
+// makes goes to the hook; a test or the simulator replies through
+// mockGattcEvent(), and serves the attribute cache through the lookup.
+enum class MockGattcOp : uint8_t {
+    APP_REGISTER = 0,
+    APP_UNREGISTER,
+    OPEN,
+    CLOSE,
+    MTU,
+    SEARCH,
+    REGISTER_NOTIFY,
+    WRITE_CHAR,
+    WRITE_DESCR
+};
+
+struct MockGattcRequest {
+    MockGattcOp op;
+    esp_gatt_if_t gattc_if;
+    uint16_t app_id;
+    uint16_t conn_id;
+    uint16_t handle;
+    const uint8_t* address;
+    const uint8_t* value;
+    uint16_t length;
+};
+
+using MockGattcHook = std::function<void(const MockGattcRequest& request)>;
+// Handle of a characteristic (charHandle 0) or of a characteristic's descriptor, 0 if absent
+using MockGattcLookup = std::function<uint16_t(uint16_t conn_id, const esp_bt_uuid_t& uuid, uint16_t charHandle)>;
+
+inline esp_gattc_cb_t& mockGattcHandler() { static esp_gattc_cb_t handler = nullptr; return handler; }
+inline MockGattcHook& mockGattcHook() { static MockGattcHook hook; return hook; }
+inline MockGattcLookup& mockGattcLookup() { static MockGattcLookup lookup; return lookup; }
+
+inline void mockGattcEvent(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t* param) {
+    if (mockGattcHandler()) mockGattcHandler()(event, gattc_if, param);
+}
+
+inline esp_err_t mockGattcRequest(MockGattcOp op, esp_gatt_if_t gattc_if, uint16_t conn_id = 0, uint16_t handle = 0,
+                                  const uint8_t* address = nullptr, const uint8_t* value = nullptr,
+                                  uint16_t length = 0, uint16_t app_id = 0) {
+    MockGattcRequest request = { op, gattc_if, app_id, conn_id, handle, address, value, length };
+    if (mockGattcHook()) mockGattcHook()(request);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gattc_app_register(uint16_t app_id) {
+    return mockGattcRequest(MockGattcOp::APP_REGISTER, ESP_GATT_IF_NONE, 0, 0, nullptr, nullptr, 0, app_id);
+}
+
+inline esp_err_t esp_ble_gattc_app_unregister(esp_gatt_if_t gattc_if) {
+    return mockGattcRequest(MockGattcOp::APP_UNREGISTER, gattc_if);
+}
+
+inline esp_err_t esp_ble_gattc_open(esp_gatt_if_t gattc_if, esp_bd_addr_t remote_bda,
+                                    esp_ble_addr_type_t, bool) {
+    return mockGattcRequest(MockGattcOp::OPEN, gattc_if, 0, 0, remote_bda);
+}
+
+inline esp_err_t esp_ble_gattc_close(esp_gatt_if_t gattc_if, uint16_t conn_id) {
+    return mockGattcRequest(MockGattcOp::CLOSE, gattc_if, conn_id);
+}
+
+inline esp_err_t esp_ble_gattc_send_mtu_req(esp_gatt_if_t gattc_if, uint16_t conn_id) {
+    return mockGattcRequest(MockGattcOp::MTU, gattc_if, conn_id);
+}
+
+inline esp_err_t esp_ble_gattc_search_service(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_bt_uuid_t*) {
+    return mockGattcRequest(MockGattcOp::SEARCH, gattc_if, conn_id);
+}
+
+inline esp_err_t esp_ble_gattc_register_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda,
+                                                   uint16_t handle) {
+    return mockGattcRequest(MockGattcOp::REGISTER_NOTIFY, gattc_if, 0, handle, server_bda);
+}
+
+inline esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle,
+                                          uint16_t value_len, uint8_t* value, esp_gatt_write_type_t,
+                                          esp_gatt_auth_req_t) {
+    return mockGattcRequest(MockGattcOp::WRITE_CHAR, gattc_if, conn_id, handle, nullptr, value, value_len);
+}
+
+inline esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle,
+                                                uint16_t value_len, uint8_t* value, esp_gatt_write_type_t,
+                                                esp_gatt_auth_req_t) {
+    return mockGattcRequest(MockGattcOp::WRITE_DESCR, gattc_if, conn_id, handle, nullptr, value, value_len);
+}
+
+inline esp_gatt_status_t esp_ble_gattc_get_char_by_uuid(esp_gatt_if_t, uint16_t conn_id, uint16_t, uint16_t,
+                                                        esp_bt_uuid_t char_uuid, esp_gattc_char_elem_t* result,
+                                                        uint16_t* count) {
+    uint16_t handle = mockGattcLookup() ? mockGattcLookup()(conn_id, char_uuid, 0) : 0;
+    if (!handle || !count || *count == 0) {
+        if (count) *count = 0;
+        return ESP_GATT_NOT_FOUND;
+    }
+    result[0].char_handle = handle;
+    result[0].properties = 0;
+    result[0].uuid = char_uuid;
+    *count = 1;
+    return ESP_GATT_OK;
+}
+
+inline esp_gatt_status_t esp_ble_gattc_get_descr_by_char_handle(esp_gatt_if_t, uint16_t conn_id, uint16_t char_handle,
+                                                                esp_bt_uuid_t descr_uuid,
+                                                                esp_gattc_descr_elem_t* result, uint16_t* count) {
+    uint16_t handle = mockGattcLookup() ? mockGattcLookup()(conn_id, descr_uuid, char_handle) : 0;
+    if (!handle || !count || *count == 0) {
+        if (count) *count = 0;
+        return ESP_GATT_NOT_FOUND;
+    }
+    result[0].handle = handle;
+    result[0].uuid = descr_uuid;
+    *count = 1;
+    return ESP_GATT_OK;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef ESP_GATTS_API_H
+#define ESP_GATTS_API_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include "esp_gap_ble_api.h"
+#include "esp_gatt_defs.h"
+
+// Mock GATTS callback parameters (subset of esp_gatts_api.h)
+typedef union {
+    struct { uint16_t conn_id; uint8_t link_role; esp_bd_addr_t remote_bda; } connect;  // link_role 0: we are central
+    struct { uint16_t conn_id; esp_bd_addr_t remote_bda; int reason; } disconnect;
+    struct { uint16_t conn_id; uint16_t mtu; } mtu;
+    struct { uint16_t conn_id; uint16_t handle; uint16_t len; uint8_t* value; } write;
+} esp_ble_gatts_cb_param_t;
+
+// Host simulation: observe notifications/indications per connection
+using MockIndicateHook = std::function<void(uint16_t connId, uint16_t handle,
+                                            const uint8_t* value, size_t length, bool confirm)>;
+inline MockIndicateHook& mockIndicateHook() { static MockIndicateHook hook; return hook; }
+
+inline esp_err_t esp_ble_gatts_send_indicate(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t attr_handle,
+                                             uint16_t value_len, uint8_t* value, bool need_confirm) {
+    if (mockIndicateHook()) mockIndicateHook()(conn_id, attr_handle, value, value_len, need_confirm);
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <stdint.h>
+#include <chrono>
+
+// Host simulation: a manual clock the simulator advances (tests/sim).
+// Off by default, so host benchmarks measure real monotonic time.
+struct MockClock {
+    bool manual = false;
+    int64_t nowUs = 0;
+};
+inline MockClock& mockClock() { static MockClock clock; return clock; }
+inline void mockAdvanceClock(int64_t us) { mockClock().nowUs += us; }
+
+inline int64_t esp_timer_get_time() {
+    if (mockClock().manual) return mockClock().nowUs;
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif
@@ -1,6 +1,18 @@
 #ifndef SEMPHR_H
 #define SEMPHR_H
 
+#include <stdint.h>
+
 typedef void* SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdTRUE 1
+#define pdFALSE 0
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { static int dummy; return &dummy; }
+inline int xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline int xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+inline void vSemaphoreDelete(SemaphoreHandle_t) {}
 
 #endif
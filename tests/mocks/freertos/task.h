@@ -0,0 +1,33 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <stdint.h>
+#include "semphr.h"
+
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define portTICK_PERIOD_MS 1
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define taskENTER_CRITICAL(mux) ((void)(mux))
+#define taskEXIT_CRITICAL(mux) ((void)(mux))
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char*, uint32_t, void*,
+                                          UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+    if (handle) *handle = nullptr;
+    return pdFAIL;
+}
+inline void vTaskDelete(TaskHandle_t) {}
+inline void vTaskDelay(TickType_t) {}
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+inline BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+
+#endif
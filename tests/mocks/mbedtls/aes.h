@@ -6,28 +6,31 @@
 
 // Mock MPI (Multi-Precision Integer)
 typedef struct {
-    int X;
-    int Z;
+    int s;
+    size_t n;
+    uint32_t* p;
 } mbedtls_mpi;
 
 // Mock ECP Point
 typedef struct {
-    int X;
-    int Z;
+    mbedtls_mpi X;
+    mbedtls_mpi Y;
+    mbedtls_mpi Z;
 } mbedtls_ecp_point;
 
 // Mock ECP Group
 typedef struct {
-    int P;
+    int id;
+    mbedtls_mpi P;
 } mbedtls_ecp_group;
 
 // Context structs
 typedef struct { 
     mbedtls_ecp_group grp; 
-    int d; 
+    mbedtls_mpi d; 
     mbedtls_ecp_point Q; 
     mbedtls_ecp_point Qp; 
-    int z; 
+    mbedtls_mpi z; 
 } mbedtls_ecdh_context;
 
 typedef struct {} mbedtls_entropy_context;
@@ -41,13 +44,22 @@ typedef struct {} mbedtls_sha256_context;
 #define MBEDTLS_AES_DECRYPT 0
 
 // Functions
-inline int mbedtls_ecdh_gen_public(mbedtls_ecp_group*, int*, mbedtls_ecp_point*, int(*)(void*, unsigned char*, size_t), void*) { return 0; }
+inline int mbedtls_ecdh_gen_public(mbedtls_ecp_group*, mbedtls_mpi*, mbedtls_ecp_point*, int(*)(void*, unsigned char*, size_t), void*) { return 0; }
 inline int mbedtls_ctr_drbg_random(void*, unsigned char*, size_t) { return 0; }
-inline int mbedtls_mpi_write_binary(int*, unsigned char*, size_t) { return 0; }
-inline size_t mbedtls_mpi_size(int*) { return 32; }
-inline int mbedtls_mpi_read_binary(int*, const unsigned char*, size_t) { return 0; }
-inline int mbedtls_mpi_lset(int*, int) { return 0; }
-inline int mbedtls_ecdh_compute_shared(mbedtls_ecp_group*, int*, mbedtls_ecp_point*, int*, int(*)(void*, unsigned char*, size_t), void*) { return 0; }
+inline int mbedtls_mpi_write_binary(const mbedtls_mpi*, unsigned char*, size_t) { return 0; }
+inline size_t mbedtls_mpi_size(const mbedtls_mpi*) { return 32; }
+inline int mbedtls_mpi_read_binary(mbedtls_mpi*, const unsigned char*, size_t) { return 0; }
+inline int mbedtls_mpi_lset(mbedtls_mpi*, int) { return 0; }
+inline int mbedtls_ecdh_compute_shared(mbedtls_ecp_group*, mbedtls_mpi*, const mbedtls_ecp_point*, const mbedtls_mpi*, int(*)(void*, unsigned char*, size_t), void*) { return 0; }
+inline void mbedtls_mpi_init(mbedtls_mpi*) {}
+inline void mbedtls_mpi_free(mbedtls_mpi*) {}
+inline int mbedtls_mpi_copy(mbedtls_mpi*, const mbedtls_mpi*) { return 0; }
+inline void mbedtls_ecp_point_init(mbedtls_ecp_point*) {}
+inline void mbedtls_ecp_point_free(mbedtls_ecp_point*) {}
+inline int mbedtls_ecp_copy(mbedtls_ecp_point*, const mbedtls_ecp_point*) { return 0; }
+inline void mbedtls_ecp_group_init(mbedtls_ecp_group*) {}
+inline int mbedtls_ecp_group_load(mbedtls_ecp_group*, int) { return 0; }
+inline void mbedtls_ecp_group_free(mbedtls_ecp_group*) {}
 
 inline int mbedtls_aes_crypt_cbc(mbedtls_aes_context*, int, size_t, unsigned char*, const unsigned char*, unsigned char*) { return 0; }
 inline void mbedtls_ecdh_init(mbedtls_ecdh_context*) {}
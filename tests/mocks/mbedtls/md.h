@@ -0,0 +1,13 @@
+#ifndef MBEDTLS_MD_MOCK_H
+#define MBEDTLS_MD_MOCK_H
+
+#include <stddef.h>
+
+typedef enum { MBEDTLS_MD_NONE = 0, MBEDTLS_MD_SHA256 = 6 } mbedtls_md_type_t;
+typedef struct {} mbedtls_md_info_t;
+
+inline const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t) { static mbedtls_md_info_t info; return &info; }
+inline int mbedtls_md_hmac(const mbedtls_md_info_t*, const unsigned char*, size_t,
+                           const unsigned char*, size_t, unsigned char*) { return 0; }
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef NVS_H
+#define NVS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef ESP_OK
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#endif
+
+// Mock NVS (subset of nvs.h), kept in memory
+#define ESP_ERR_NVS_BASE             0x1100
+#define ESP_ERR_NVS_NOT_FOUND        (ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_NVS_INVALID_LENGTH   (ESP_ERR_NVS_BASE + 0x0c)
+
+typedef uint32_t nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+
+// Host simulation: namespaces with their committed keys, and counters
+struct MockNvs {
+    std::map<std::string, std::map<std::string, std::vector<uint8_t>>> namespaces;
+    std::vector<std::string> handles;   // handle - 1 -> namespace
+    uint32_t sets = 0;
+    uint32_t erases = 0;
+    uint32_t commits = 0;
+};
+inline MockNvs& mockNvs() { static MockNvs nvs; return nvs; }
+
+inline std::map<std::string, std::vector<uint8_t>>* mockNvsNamespace(nvs_handle_t handle) {
+    if (handle == 0 || handle > mockNvs().handles.size()) return nullptr;
+    return &mockNvs().namespaces[mockNvs().handles[handle - 1]];
+}
+
+inline esp_err_t nvs_open(const char* name, nvs_open_mode_t mode, nvs_handle_t* out_handle) {
+    if (mode == NVS_READONLY && !mockNvs().namespaces.count(name)) return ESP_ERR_NVS_NOT_FOUND;
+    mockNvs().namespaces[name];
+    mockNvs().handles.push_back(name);
+    *out_handle = (nvs_handle_t)mockNvs().handles.size();
+    return ESP_OK;
+}
+
+inline void nvs_close(nvs_handle_t) {}
+
+inline esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length) {
+    auto* ns = mockNvsNamespace(handle);
+    if (!ns) return ESP_FAIL;
+    auto it = ns->find(key);
+    if (it == ns->end()) return ESP_ERR_NVS_NOT_FOUND;
+    if (!out_value) {
+        *length = it->second.size();
+        return ESP_OK;
+    }
+    if (*length < it->second.size()) return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(out_value, it->second.data(), it->second.size());
+    *length = it->second.size();
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value, size_t* length) {
+    auto* ns = mockNvsNamespace(handle);
+    if (!ns) return ESP_FAIL;
+    auto it = ns->find(key);
+    if (it == ns->end()) return ESP_ERR_NVS_NOT_FOUND;
+    size_t needed = it->second.size() + 1;
+    if (!out_value) {
+        *length = needed;
+        return ESP_OK;
+    }
+    if (*length < needed) return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(out_value, it->second.data(), it->second.size());
+    out_value[it->second.size()] = '\0';
+    *length = needed;
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length) {
+    auto* ns = mockNvsNamespace(handle);
+    if (!ns) return ESP_FAIL;
+    (*ns)[key].assign((const uint8_t*)value, (const uint8_t*)value + length);
+    mockNvs().sets++;
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value) {
+    return nvs_set_blob(handle, key, value, strlen(value));
+}
+
+inline esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    auto* ns = mockNvsNamespace(handle);
+    if (!ns) return ESP_FAIL;
+    if (!ns->erase(key)) return ESP_ERR_NVS_NOT_FOUND;
+    mockNvs().erases++;
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    auto* ns = mockNvsNamespace(handle);
+    if (!ns) return ESP_FAIL;
+    ns->clear();
+    mockNvs().erases++;
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_commit(nvs_handle_t) {
+    mockNvs().commits++;
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,844 @@
+/**
+ * Simulator.cpp - Devices, phones and the link between them
+ */
+
+#include "Simulator.h"
+#include "ProvisioningOrchestrator.h"
+#include "ProvisioningProtocol.h"
+#include "SecurityManager.h"
+#include "utils/AdvertisingData.h"
+#include "utils/BenchReport.h"
+#include "utils/Metrics.h"
+#include <algorithm>
+#include <chrono>
+
+namespace WiBLE {
+namespace Sim {
+
+// Retry period of a CONNECT that found no GATT server
+#define WIBLE_SIM_CONNECT_RETRY_MS   500
+
+// A PDU lost this many times in a row is delivered anyway
+#define WIBLE_SIM_MAX_RETRANSMITS    32
+
+// Lead-to-peer links: connection IDs above the phones', the attribute
+// handles leads discover (characteristic, then its CCCD) and the GATT
+// client interface every lead gets
+#define WIBLE_SIM_LINK_CONN_BASE     16
+#define WIBLE_SIM_LINK_HANDLE_BASE   0x20
+#define WIBLE_SIM_GATTC_IF           4
+
+static const char* const LINK_CHARACTERISTICS[] = {
+    WIBLE_CRED_CHARACTERISTIC, WIBLE_CONTROL_CHARACTERISTIC, WIBLE_STATUS_CHARACTERISTIC
+};
+#define WIBLE_SIM_LINK_STATUS_HANDLE (WIBLE_SIM_LINK_HANDLE_BASE + 2 * 2)
+
+static void deviceAddress(uint16_t device, uint8_t* out) {
+    const uint8_t prefix[4] = { 0x24, 0x0A, 0xC4, 0x00 };
+    memcpy(out, prefix, sizeof(prefix));
+    out[4] = (uint8_t)(device >> 8);
+    out[5] = (uint8_t)(device & 0xFF);
+}
+
+static int32_t deviceFromAddress(const uint8_t* address, size_t devices) {
+    uint8_t expected[6];
+    deviceAddress(0, expected);
+    if (!address || memcmp(address, expected, 4) != 0) return -1;
+    uint16_t device = (uint16_t)((address[4] << 8) | address[5]);
+    return device < devices ? device : -1;
+}
+
+// Fixed per pair of devices: -45..-79 dBm
+static int8_t pairRSSI(uint16_t a, uint16_t b) {
+    uint32_t hash = (uint32_t)std::min(a, b) * 2654435761u ^ (uint32_t)std::max(a, b) * 40503u;
+    hash ^= hash >> 15;
+    return (int8_t)(-45 - (int)(hash % 35));
+}
+
+// ============================================================================
+// MOCK CONTEXT
+// ============================================================================
+
+void Simulation::MockContext::exchange() {
+    std::swap(WiFi, wifi);
+    std::swap(mockNvs(), nvs);
+    std::swap(BLECharacteristic::mockRegistry(), characteristics);
+    std::swap(BLEServer::mockInstance(), server);
+    std::swap(BLEServer::mockConnectedCount(), connectedCount);
+    std::swap(mockAdvData(), advData);
+}
+
+// ============================================================================
+// CONSTRUCTOR & DESTRUCTOR
+// ============================================================================
+
+Simulation::Simulation(const SimConfig& config)
+    : config(config), script(defaultScript(config.secure || config.group)), scheduled(0), current(-1),
+      lead(-1), rng(config.seed ? config.seed : 1) {
+    // Peers only accept a lead over a session bound to the fleet secret
+    if (this->config.group) {
+        this->config.secure = true;
+        if (this->config.device.group.fleetSecret.isEmpty()) this->config.device.group.fleetSecret = "sim-fleet";
+    }
+}
+
+Simulation::~Simulation() {
+    destroyDevices();
+}
+
+PhoneScript Simulation::defaultScript(bool secure) {
+    PhoneScript actions;
+    actions.push_back({ PhoneStep::CONNECT, 0 });
+    actions.push_back({ PhoneStep::EXCHANGE_MTU, 0 });
+    if (secure) actions.push_back({ PhoneStep::KEY_EXCHANGE, 5000 });
+    actions.push_back({ PhoneStep::SEND_CREDENTIALS, 0 });
+    actions.push_back({ PhoneStep::AWAIT_RESULT, 60000 });
+    actions.push_back({ PhoneStep::DISCONNECT, 0 });
+    return actions;
+}
+
+void Simulation::createDevices() {
+    devices.resize(config.devices);
+    for (uint16_t i = 0; i < config.devices; i++) {
+        Device& device = devices[i];
+        WiFiClass& wifi = device.context.wifi;
+        wifi.mockAssociation(true);
+
+        uint32_t spread = config.accessPoint.associationMaxMs > config.accessPoint.associationMinMs
+            ? config.accessPoint.associationMaxMs - config.accessPoint.associationMinMs : 0;
+        uint32_t associationMs = config.accessPoint.associationMinMs + (spread ? nextRandom() % (spread + 1) : 0);
+        MockAccessPoint ap = { config.accessPoint.ssid, -55, 6, WIFI_AUTH_WPA2_PSK,
+                               { 0x02, 0x51, 0x4D, 0x00, 0x00, 0x01 },
+                               config.accessPoint.passphrase, associationMs };
+        wifi.mockAccessPoints().push_back(ap);
+
+        char mac[18];
+        snprintf(mac, sizeof(mac), "24:0A:C4:00:%02X:%02X", (unsigned)(i >> 8), (unsigned)(i & 0xFF));
+        wifi.mockMacAddress(mac);
+
+        ProvisioningConfig deviceConfig = config.device;
+        char name[24];
+        snprintf(name, sizeof(name), "WiBLE_Sim_%u", (unsigned)i);
+        deviceConfig.deviceName = name;
+        deviceConfig.securityLevel = config.secure ? SecurityLevel::SECURE : SecurityLevel::NONE;
+        deviceConfig.mtuSize = config.link.mtu;
+        deviceConfig.enableGroupProvisioning = false;  // Leads are driven by stepLead()
+
+        enter(i);
+        device.core = std::unique_ptr<::WiBLE::WiBLE>(new ::WiBLE::WiBLE());
+        device.core->begin(deviceConfig);
+        device.core->startProvisioning();
+        leave();
+    }
+}
+
+void Simulation::createPhones() {
+    phones.resize((size_t)(config.group ? 1 : config.devices) * config.phonesPerDevice);
+    for (size_t i = 0; i < phones.size(); i++) {
+        Phone& phone = phones[i];
+        phone.device = (uint16_t)(i / config.phonesPerDevice);
+        phone.connId = (uint16_t)(i % config.phonesPerDevice);
+        phone.wrongPassphrase = nextRandom() % 100 < config.wrongPassphrasePercent;
+        phone.startUs = mockClock().nowUs +
+                        (config.arrivalSpreadMs ? (int64_t)(nextRandom() % config.arrivalSpreadMs) * 1000 : 0);
+        wake((uint32_t)i, phone.startUs);
+    }
+}
+
+void Simulation::destroyDevices() {
+    for (uint16_t i = 0; i < devices.size(); i++) {
+        if (!devices[i].core) continue;
+        enter(i);
+        lead = i;
+        devices[i].group.reset();
+        lead = -1;
+        devices[i].core.reset();
+        leave();
+    }
+}
+
+// ============================================================================
+// DEVICE CONTEXT
+// ============================================================================
+
+void Simulation::enter(uint16_t device) {
+    devices[device].context.exchange();
+    current = device;
+}
+
+void Simulation::leave() {
+    if (current < 0) return;
+    devices[current].context.exchange();
+    current = -1;
+}
+
+// ============================================================================
+// LINK
+// ============================================================================
+
+uint32_t Simulation::nextRandom() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+int64_t Simulation::linkDelayUs(int64_t& lastUs) {
+    const LinkProfile& link = config.link;
+    int64_t delayUs = (int64_t)link.latencyMs * 1000;
+    if (link.jitterMs) delayUs += (int64_t)(nextRandom() % (link.jitterMs * 1000 + 1));
+    for (uint32_t i = 0; i < WIBLE_SIM_MAX_RETRANSMITS && nextRandom() % 100 < link.lossPercent; i++) {
+        delayUs += (int64_t)link.connectionIntervalMs * 1000;
+        totals.pdusLost++;
+    }
+
+    // Nothing overtakes an earlier PDU on the same link
+    int64_t atUs = std::max(mockClock().nowUs + delayUs, lastUs);
+    lastUs = atUs;
+    return atUs;
+}
+
+void Simulation::schedule(int64_t atUs, DeliveryKind kind, uint32_t phone, const char* uuid,
+                          const uint8_t* data, size_t length) {
+    Delivery delivery;
+    delivery.atUs = atUs;
+    delivery.order = scheduled++;
+    delivery.kind = kind;
+    delivery.phone = phone;
+    delivery.generation = phones[phone].generation;
+    delivery.uuid = uuid;
+    delivery.event = 0;
+    delivery.status = 0;
+    delivery.handle = 0;
+    if (data) delivery.data.assign(data, data + length);
+    queue.push(delivery);
+}
+
+void Simulation::wake(uint32_t phone, int64_t atUs) {
+    schedule(atUs, DeliveryKind::PHONE_WAKE, phone);
+}
+
+void Simulation::upload(uint32_t phone, DeliveryKind kind, const char* uuid, const uint8_t* data, size_t length) {
+    schedule(linkDelayUs(phones[phone].upLastUs), kind, phone, uuid, data, length);
+}
+
+void Simulation::scheduleLink(int64_t atUs, DeliveryKind kind, uint32_t link, uint8_t event, uint8_t status,
+                              uint16_t handle, const char* uuid, const uint8_t* data, size_t length) {
+    Delivery delivery;
+    delivery.atUs = atUs;
+    delivery.order = scheduled++;
+    delivery.kind = kind;
+    delivery.phone = link;
+    delivery.generation = 0;
+    delivery.uuid = uuid;
+    delivery.event = event;
+    delivery.status = status;
+    delivery.handle = handle;
+    if (data) delivery.data.assign(data, data + length);
+    queue.push(delivery);
+}
+
+void Simulation::reply(uint32_t link, esp_gattc_cb_event_t event, uint8_t status, uint16_t handle,
+                       const uint8_t* data, size_t length) {
+    scheduleLink(linkDelayUs(links[link].downLastUs), DeliveryKind::LEAD_EVENT, link, (uint8_t)event, status,
+                 handle, nullptr, data, length);
+}
+
+void Simulation::onIndicate(uint16_t connId, const uint8_t* value, size_t length) {
+    if (current < 0) return;
+    if (connId >= WIBLE_SIM_LINK_CONN_BASE) {
+        // Peers only notify leads on the status characteristic
+        Link* link = findLink(connId);
+        if (link && link->open && link->peer == current) {
+            reply((uint32_t)(link - links.data()), ESP_GATTC_NOTIFY_EVT, ESP_GATT_OK, WIBLE_SIM_LINK_STATUS_HANDLE,
+                  value, length);
+        }
+        return;
+    }
+    size_t index = (size_t)current * config.phonesPerDevice + connId;
+    if (connId >= config.phonesPerDevice || index >= phones.size()) return;
+    schedule(linkDelayUs(phones[index].downLastUs), DeliveryKind::NOTIFY, (uint32_t)index, nullptr, value, length);
+    totals.pdusToPhone++;
+}
+
+// ============================================================================
+// DELIVERY
+// ============================================================================
+
+void Simulation::process(const Delivery& delivery) {
+    if (delivery.kind >= DeliveryKind::LINK_OPEN) {
+        processLink(delivery);
+        return;
+    }
+    Phone& phone = phones[delivery.phone];
+
+    switch (delivery.kind) {
+        case DeliveryKind::PHONE_WAKE:
+            if (delivery.generation != phone.generation) return;    // The wait already ended
+            if (phone.waiting) {
+                phone.result = PhoneResult::TIMED_OUT;
+                phone.finishedUs = mockClock().nowUs;
+                abandon(delivery.phone);
+                return;
+            }
+            advancePhone(delivery.phone);
+            return;
+
+        case DeliveryKind::NOTIFY:
+            receive(delivery.phone, delivery.data);
+            return;
+
+        default:
+            break;
+    }
+
+    // The rest reach the device
+    totals.pdusToDevice++;
+    enter(phone.device);
+    BLEServer* server = BLEServer::mockInstance();
+    bool connected = server != nullptr;
+    if (server) {
+        switch (delivery.kind) {
+            case DeliveryKind::CONNECT:
+                server->mockConnect(phone.connId);
+                break;
+            case DeliveryKind::MTU:
+                server->mockMtu(config.link.mtu, phone.connId);
+                break;
+            case DeliveryKind::WRITE: {
+                BLECharacteristic* characteristic = BLECharacteristic::mockFind(delivery.uuid);
+                if (characteristic) {
+                    characteristic->mockWrite(delivery.data.data(), delivery.data.size(), phone.connId);
+                }
+                break;
+            }
+            case DeliveryKind::DISCONNECT:
+                server->mockDisconnect(phone.connId);
+                break;
+            default:
+                break;
+        }
+    }
+    leave();
+
+    // Connection and MTU exchange complete once the phone hears back
+    if (delivery.kind == DeliveryKind::CONNECT && !connected) {
+        wake(delivery.phone, mockClock().nowUs + (int64_t)WIBLE_SIM_CONNECT_RETRY_MS * 1000);
+    } else if (delivery.kind == DeliveryKind::CONNECT || delivery.kind == DeliveryKind::MTU) {
+        phone.step++;
+        wake(delivery.phone, linkDelayUs(phone.downLastUs));
+    }
+}
+
+// ============================================================================
+// PHONES
+// ============================================================================
+
+void Simulation::advancePhone(uint32_t index) {
+    Phone& phone = phones[index];
+    while (phone.step < script.size() && !phone.waiting) {
+        const PhoneAction& action = script[phone.step];
+        switch (action.step) {
+            case PhoneStep::CONNECT:
+                upload(index, DeliveryKind::CONNECT);
+                return;                     // Resumed by process()
+
+            case PhoneStep::EXCHANGE_MTU:
+                upload(index, DeliveryKind::MTU);
+                return;
+
+            case PhoneStep::KEY_EXCHANGE: {
+                uint8_t frame[1 + WIBLE_ECDH_KEY_SIZE];
+                frame[0] = WIBLE_OP_KEY_EXCHANGE;
+                for (size_t i = 1; i < sizeof(frame); i++) frame[i] = (uint8_t)nextRandom();
+                upload(index, DeliveryKind::WRITE, WIBLE_CONTROL_CHARACTERISTIC, frame, sizeof(frame));
+                phone.waiting = true;
+                wake(index, mockClock().nowUs + (int64_t)action.ms * 1000);
+                return;
+            }
+
+            case PhoneStep::SEND_CREDENTIALS:
+                sendCredentials(index);
+                phone.step++;
+                break;
+
+            case PhoneStep::AWAIT_RESULT:
+                if (phone.result != PhoneResult::PENDING) {
+                    phone.step++;
+                    break;
+                }
+                phone.waiting = true;
+                wake(index, mockClock().nowUs + (int64_t)action.ms * 1000);
+                return;
+
+            case PhoneStep::DISCONNECT:
+                upload(index, DeliveryKind::DISCONNECT);
+                phone.step++;
+                break;
+
+            case PhoneStep::WAIT:
+                phone.step++;
+                wake(index, mockClock().nowUs + (int64_t)action.ms * 1000);
+                return;
+        }
+    }
+}
+
+void Simulation::finishWait(uint32_t index) {
+    Phone& phone = phones[index];
+    phone.waiting = false;
+    phone.generation++;
+    phone.step++;
+    advancePhone(index);
+}
+
+void Simulation::abandon(uint32_t index) {
+    Phone& phone = phones[index];
+    phone.waiting = false;
+    phone.generation++;
+    phone.step = script.size();
+    upload(index, DeliveryKind::DISCONNECT);
+}
+
+void Simulation::receive(uint32_t index, const std::vector<uint8_t>& data) {
+    Phone& phone = phones[index];
+    if (data.empty() || phone.step >= script.size()) return;
+    PhoneStep awaiting = script[phone.step].step;
+
+    if (data[0] == WIBLE_OP_KEY_EXCHANGE && phone.waiting && awaiting == PhoneStep::KEY_EXCHANGE) {
+        phone.sealed = true;
+        finishWait(index);
+        return;
+    }
+
+    // [frame][ProtocolStatus][progress][detail]...
+    if (data[0] != WIBLE_TLV_FRAME_V1 || data.size() < 4 || phone.result != PhoneResult::PENDING) return;
+    ProtocolStatus status = (ProtocolStatus)data[1];
+    if (status != ProtocolStatus::SUCCESS && status != ProtocolStatus::ERROR) return;
+
+    phone.result = status == ProtocolStatus::SUCCESS ? PhoneResult::PROVISIONED : PhoneResult::FAILED;
+    phone.finishedUs = mockClock().nowUs;
+    if (!phone.waiting) return;
+    if (awaiting == PhoneStep::AWAIT_RESULT) {
+        finishWait(index);
+    } else if (phone.result == PhoneResult::FAILED) {
+        abandon(index);             // The key exchange was refused
+    }
+}
+
+void Simulation::sendCredentials(uint32_t index) {
+    Phone& phone = phones[index];
+    const char* ssid = config.accessPoint.ssid.c_str();
+    const char* passphrase = phone.wrongPassphrase ? "wrong-passphrase" : config.accessPoint.passphrase.c_str();
+    size_t ssidLength = strlen(ssid);
+    size_t passphraseLength = strlen(passphrase);
+
+    // Sealed: [nonce][TLV][tag]; the mock cipher leaves the bytes as they are
+    uint8_t frame[WIBLE_GCM_OVERHEAD + 5 + 32 + 64];
+    size_t header = phone.sealed ? WIBLE_GCM_NONCE_SIZE : 0;
+    size_t length = header;
+    memset(frame, 0, sizeof(frame));
+    frame[length++] = WIBLE_TLV_FRAME_V1;
+    frame[length++] = WIBLE_TLV_SSID;
+    frame[length++] = (uint8_t)ssidLength;
+    memcpy(frame + length, ssid, ssidLength);
+    length += ssidLength;
+    frame[length++] = WIBLE_TLV_PASSPHRASE;
+    frame[length++] = (uint8_t)passphraseLength;
+    memcpy(frame + length, passphrase, passphraseLength);
+    length += passphraseLength;
+    if (phone.sealed) length += WIBLE_GCM_TAG_SIZE;
+
+    upload(index, DeliveryKind::WRITE, WIBLE_CRED_CHARACTERISTIC, frame, length);
+}
+
+// ============================================================================
+// GROUP PROVISIONING
+// ============================================================================
+
+void Simulation::startLead(uint16_t index) {
+    Device& device = devices[index];
+    device.group = std::unique_ptr<GroupProvisioner>(new GroupProvisioner());
+    lead = index;
+    bool started = device.group->start(config.device.group, device.core->getStoredCredentials());
+    lead = -1;
+    if (!started) {
+        device.group.reset();
+        return;
+    }
+    device.nextBatchUs = mockClock().nowUs + (int64_t)config.device.group.scanBatchMs * 1000;
+}
+
+void Simulation::stepLead(uint16_t index) {
+    Device& device = devices[index];
+    if (device.provisionedUs < 0 && device.core->getState() == ProvisioningState::PROVISIONED) {
+        device.provisionedUs = mockClock().nowUs;
+        if (index == 0 || config.device.group.relay) startLead(index);
+    }
+    if (!device.group || !device.group->isActive()) return;
+
+    lead = index;
+    if (mockClock().nowUs >= device.nextBatchUs) {
+        deliverCandidates(index);
+        device.nextBatchUs = mockClock().nowUs + (int64_t)config.device.group.scanBatchMs * 1000;
+    }
+    device.group->loop();
+    if (device.group->isIdle()) device.group->stop();
+    lead = -1;
+}
+
+void Simulation::deliverCandidates(uint16_t index) {
+    // Every other device is in range, advertising what it last configured
+    std::vector<ScanEntry> entries;
+    entries.reserve(devices.size());
+    for (uint16_t i = 0; i < devices.size(); i++) {
+        const MockAdvData& adv = devices[i].context.advData;
+        if (i == index || adv.length == 0) continue;
+
+        ScanEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        deviceAddress(i, entry.address);
+        entry.rssi = entry.lastRSSI = pairRSSI(index, i);
+        entry.dataLength = (uint8_t)std::min<uint32_t>(adv.length, WIBLE_SCAN_DATA_SIZE);
+        memcpy(entry.data, adv.data, entry.dataLength);
+        uint16_t company;
+        AdStructure field;
+        entry.companyId = AdvertisingDataView(entry.data, entry.dataLength).findManufacturerData(company, field)
+            ? company : WIBLE_COMPANY_ID_ANY;
+        entry.advertisementCount = 1;
+        entry.firstSeen = entry.lastSeen = millis();
+        entries.push_back(entry);
+    }
+    devices[index].group->addCandidates(entries.data(), entries.size());
+}
+
+void Simulation::onGattcRequest(const MockGattcRequest& request) {
+    if (lead < 0 || !devices[lead].group) return;
+
+    if (request.op == MockGattcOp::APP_REGISTER) {
+        esp_ble_gattc_cb_param_t param;
+        memset(&param, 0, sizeof(param));
+        param.reg.status = ESP_GATT_OK;
+        param.reg.app_id = request.app_id;
+        devices[lead].group->handleGattcEvent(ESP_GATTC_REG_EVT, WIBLE_SIM_GATTC_IF, &param);
+        return;
+    }
+
+    if (request.op == MockGattcOp::OPEN) {
+        int32_t peer = deviceFromAddress(request.address, devices.size());
+        Link link = { (uint16_t)lead, (uint16_t)(peer < 0 ? lead : peer),
+                      (uint16_t)(WIBLE_SIM_LINK_CONN_BASE + links.size()), false, 0, 0 };
+        links.push_back(link);
+        uint32_t index = (uint32_t)(links.size() - 1);
+        scheduleLink(linkDelayUs(links[index].upLastUs), DeliveryKind::LINK_OPEN, index);
+        return;
+    }
+
+    Link* link = findLink(request.conn_id);
+    if (!link || link->lead != lead) return;
+    uint32_t index = (uint32_t)(link - links.data());
+    int64_t atUs = linkDelayUs(link->upLastUs);
+
+    switch (request.op) {
+        case MockGattcOp::MTU: scheduleLink(atUs, DeliveryKind::LINK_MTU, index); break;
+        case MockGattcOp::SEARCH: scheduleLink(atUs, DeliveryKind::LINK_SEARCH, index); break;
+        case MockGattcOp::WRITE_DESCR:
+            scheduleLink(atUs, DeliveryKind::LINK_SUBSCRIBE, index, 0, 0, request.handle);
+            break;
+        case MockGattcOp::WRITE_CHAR: {
+            uint16_t slot = (uint16_t)((request.handle - WIBLE_SIM_LINK_HANDLE_BASE) / 2);
+            const char* uuid = request.handle >= WIBLE_SIM_LINK_HANDLE_BASE && slot < 3
+                ? LINK_CHARACTERISTICS[slot] : nullptr;
+            scheduleLink(atUs, DeliveryKind::LINK_WRITE, index, 0, 0, request.handle, uuid, request.value,
+                         request.length);
+            break;
+        }
+        case MockGattcOp::CLOSE: scheduleLink(atUs, DeliveryKind::LINK_CLOSE, index); break;
+        default: break;
+    }
+}
+
+void Simulation::processLink(const Delivery& delivery) {
+    uint32_t index = delivery.phone;
+    Link& link = links[index];
+
+    if (delivery.kind == DeliveryKind::LEAD_EVENT) {
+        GroupProvisioner* provisioner = devices[link.lead].group.get();
+        if (!provisioner) return;
+        std::vector<uint8_t> value = delivery.data;
+        esp_ble_gattc_cb_param_t param;
+        memset(&param, 0, sizeof(param));
+        esp_gatt_status_t status = (esp_gatt_status_t)delivery.status;
+        switch ((esp_gattc_cb_event_t)delivery.event) {
+            case ESP_GATTC_OPEN_EVT:
+                param.open.status = status;
+                param.open.conn_id = link.connId;
+                deviceAddress(link.peer, param.open.remote_bda);
+                param.open.mtu = 23;
+                break;
+            case ESP_GATTC_CFG_MTU_EVT:
+                param.cfg_mtu.status = status;
+                param.cfg_mtu.conn_id = link.connId;
+                param.cfg_mtu.mtu = config.link.mtu;
+                break;
+            case ESP_GATTC_SEARCH_RES_EVT:
+                param.search_res.conn_id = link.connId;
+                param.search_res.start_handle = 1;
+                param.search_res.end_handle = 0xFFFF;
+                param.search_res.is_primary = true;
+                break;
+            case ESP_GATTC_SEARCH_CMPL_EVT:
+                param.search_cmpl.status = status;
+                param.search_cmpl.conn_id = link.connId;
+                break;
+            case ESP_GATTC_WRITE_DESCR_EVT:
+            case ESP_GATTC_WRITE_CHAR_EVT:
+                param.write.status = status;
+                param.write.conn_id = link.connId;
+                param.write.handle = delivery.handle;
+                break;
+            case ESP_GATTC_NOTIFY_EVT:
+                param.notify.conn_id = link.connId;
+                deviceAddress(link.peer, param.notify.remote_bda);
+                param.notify.handle = delivery.handle;
+                param.notify.value_len = (uint16_t)value.size();
+                param.notify.value = value.data();
+                param.notify.is_notify = true;
+                break;
+            default:
+                return;
+        }
+        provisioner->handleGattcEvent((esp_gattc_cb_event_t)delivery.event, WIBLE_SIM_GATTC_IF, &param);
+        return;
+    }
+
+    // The rest reach the peer; nothing answers on a closed link
+    totals.linkPdus++;
+    if (delivery.kind != DeliveryKind::LINK_OPEN && !link.open) return;
+    if (delivery.kind == DeliveryKind::LINK_WRITE) {
+        // The write response goes out before the peer acts on the value
+        BLECharacteristic* characteristic = nullptr;
+        if (delivery.uuid) {
+            std::map<std::string, BLECharacteristic*>& registry = devices[link.peer].context.characteristics;
+            std::map<std::string, BLECharacteristic*>::iterator it = registry.find(delivery.uuid);
+            if (it != registry.end()) characteristic = it->second;
+        }
+        reply(index, ESP_GATTC_WRITE_CHAR_EVT, characteristic ? ESP_GATT_OK : ESP_GATT_INVALID_PDU, delivery.handle);
+        if (!characteristic) return;
+    }
+
+    enter(link.peer);
+    BLEServer* server = BLEServer::mockInstance();
+    switch (delivery.kind) {
+        case DeliveryKind::LINK_OPEN:
+            links[index].open = server != nullptr && link.peer != link.lead;
+            if (links[index].open) server->mockConnect(link.connId);
+            break;
+        case DeliveryKind::LINK_MTU:
+            if (server) server->mockMtu(config.link.mtu, link.connId);
+            break;
+        case DeliveryKind::LINK_WRITE: {
+            BLECharacteristic* characteristic = BLECharacteristic::mockFind(delivery.uuid);
+            if (characteristic) characteristic->mockWrite(delivery.data.data(), delivery.data.size(), link.connId);
+            break;
+        }
+        case DeliveryKind::LINK_CLOSE:
+            if (server) server->mockDisconnect(link.connId);
+            links[index].open = false;
+            break;
+        default:
+            break;
+    }
+    leave();
+
+    switch (delivery.kind) {
+        case DeliveryKind::LINK_OPEN:
+            reply(index, ESP_GATTC_OPEN_EVT, links[index].open ? ESP_GATT_OK : ESP_GATT_ERROR);
+            break;
+        case DeliveryKind::LINK_MTU:
+            reply(index, ESP_GATTC_CFG_MTU_EVT, ESP_GATT_OK);
+            break;
+        case DeliveryKind::LINK_SEARCH:
+            reply(index, ESP_GATTC_SEARCH_RES_EVT);
+            reply(index, ESP_GATTC_SEARCH_CMPL_EVT, ESP_GATT_OK);
+            break;
+        case DeliveryKind::LINK_SUBSCRIBE:
+            reply(index, ESP_GATTC_WRITE_DESCR_EVT, ESP_GATT_OK, delivery.handle);
+            break;
+        default:
+            break;
+    }
+}
+
+uint16_t Simulation::lookupHandle(uint16_t connId, const esp_bt_uuid_t& uuid, uint16_t charHandle) {
+    Link* link = findLink(connId);
+    if (!link) return 0;
+    if (charHandle) {
+        bool cccd = uuid.len == ESP_UUID_LEN_16 && uuid.uuid.uuid16 == ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
+        return cccd && charHandle >= WIBLE_SIM_LINK_HANDLE_BASE ? (uint16_t)(charHandle + 1) : 0;
+    }
+    if (uuid.len != ESP_UUID_LEN_128) return 0;
+    for (uint16_t i = 0; i < 3; i++) {
+        uint8_t expected[16];
+        parseUUID128(LINK_CHARACTERISTICS[i], expected, true);
+        if (memcmp(expected, uuid.uuid.uuid128, sizeof(expected)) != 0) continue;
+        return devices[link->peer].context.characteristics.count(LINK_CHARACTERISTICS[i])
+            ? (uint16_t)(WIBLE_SIM_LINK_HANDLE_BASE + 2 * i) : 0;
+    }
+    return 0;
+}
+
+Simulation::Link* Simulation::findLink(uint16_t connId) {
+    if (connId < WIBLE_SIM_LINK_CONN_BASE || connId - WIBLE_SIM_LINK_CONN_BASE >= (int)links.size()) return nullptr;
+    return &links[connId - WIBLE_SIM_LINK_CONN_BASE];
+}
+
+bool Simulation::allDevicesProvisioned() const {
+    for (const Device& device : devices) {
+        if (device.provisionedUs < 0) return false;
+    }
+    return true;
+}
+
+bool Simulation::allPhonesDone() const {
+    for (const Phone& phone : phones) {
+        if (phone.step < script.size() || phone.result == PhoneResult::PENDING) return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// RUN
+// ============================================================================
+
+SimResults Simulation::run() {
+    totals = SimResults();
+    mockClock().manual = true;
+    srand(config.seed);                 // esp_random() in the mocks
+    int64_t startUs = mockClock().nowUs;
+    std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+
+    mockIndicateHook() = [this](uint16_t connId, uint16_t, const uint8_t* value, size_t length, bool) {
+        onIndicate(connId, value, length);
+    };
+    mockGattcHook() = [this](const MockGattcRequest& request) {
+        onGattcRequest(request);
+    };
+    mockGattcLookup() = [this](uint16_t connId, const esp_bt_uuid_t& uuid, uint16_t charHandle) {
+        return lookupHandle(connId, uuid, charHandle);
+    };
+    links.clear();
+
+    createDevices();
+    createPhones();
+
+    int64_t tickUs = (int64_t)(config.tickMs ? config.tickMs : 1) * 1000;
+    int64_t endUs = startUs + (int64_t)config.durationMs * 1000;
+    for (int64_t nowUs = startUs; nowUs <= endUs; nowUs += tickUs) {
+        while (!queue.empty() && queue.top().atUs <= nowUs) {
+            Delivery delivery = queue.top();
+            queue.pop();
+            if (delivery.atUs > mockClock().nowUs) mockClock().nowUs = delivery.atUs;
+            process(delivery);
+        }
+        if (nowUs > mockClock().nowUs) mockClock().nowUs = nowUs;
+
+        for (uint16_t i = 0; i < devices.size(); i++) {
+            enter(i);
+            devices[i].core->loop();
+            if (config.group) stepLead(i);
+            leave();
+        }
+        totals.deviceLoops += devices.size();
+
+        if (allPhonesDone() && (!config.group || allDevicesProvisioned())) break;
+    }
+
+    uint32_t wallMs = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - wallStart).count();
+    SimResults results = collect(startUs, wallMs);
+    destroyDevices();
+    mockIndicateHook() = nullptr;
+    mockGattcHook() = nullptr;
+    mockGattcLookup() = nullptr;
+    return results;
+}
+
+SimResults Simulation::collect(int64_t startUs, uint32_t wallMs) {
+    SimResults results = totals;
+    results.phones = (uint32_t)phones.size();
+    results.virtualMs = (uint32_t)((mockClock().nowUs - startUs) / 1000);
+    results.wallMs = wallMs;
+
+    std::vector<uint32_t> times;
+    for (const Phone& phone : phones) {
+        switch (phone.result) {
+            case PhoneResult::PROVISIONED:
+                results.provisioned++;
+                times.push_back((uint32_t)((phone.finishedUs - phone.startUs) / 1000));
+                break;
+            case PhoneResult::FAILED: results.failed++; break;
+            case PhoneResult::TIMED_OUT: results.timedOut++; break;
+            default: results.pending++; break;
+        }
+    }
+    if (!times.empty()) {
+        std::sort(times.begin(), times.end());
+        results.provisionP50Ms = times[times.size() / 2];
+        results.provisionP95Ms = times[std::min(times.size() - 1, times.size() * 95 / 100)];
+        results.provisionMaxMs = times.back();
+    }
+
+    if (config.group) {
+        for (uint16_t i = 0; i < devices.size(); i++) {
+            const Device& device = devices[i];
+            if (device.provisionedUs < 0) {
+                results.groupPending++;
+            } else {
+                if (i > 0) results.groupProvisioned++;
+                results.groupAllMs = std::max(results.groupAllMs,
+                                              (uint32_t)((device.provisionedUs - startUs) / 1000));
+            }
+            if (!device.group) continue;
+            GroupStatistics statistics = device.group->getStatistics();
+            results.groupSessions += statistics.sessionsStarted;
+            results.groupFailures += statistics.peersFailed;
+            results.groupHandshakeFailures += statistics.handshakeFailures;
+        }
+    }
+    return results;
+}
+
+void Simulation::report(const SimResults& results) const {
+    Bench::report("sim", "devices", config.devices, "count");
+    Bench::report("sim", "phones", results.phones, "count");
+    Bench::report("sim", "provisioned", results.provisioned, "count");
+    Bench::report("sim", "failed", results.failed, "count");
+    Bench::report("sim", "timed_out", results.timedOut, "count");
+    Bench::report("sim", "pending", results.pending, "count");
+    Bench::report("sim", "provision_p50_ms", results.provisionP50Ms, "ms");
+    Bench::report("sim", "provision_p95_ms", results.provisionP95Ms, "ms");
+    Bench::report("sim", "provision_max_ms", results.provisionMaxMs, "ms");
+    Bench::report("sim", "virtual_ms", results.virtualMs, "ms");
+    Bench::report("sim", "wall_ms", results.wallMs, "ms");
+    Bench::report("sim", "device_loops", (double)results.deviceLoops, "count");
+    Bench::report("sim", "wall_ns_per_device_loop",
+                  results.deviceLoops ? (double)results.wallMs * 1e6 / results.deviceLoops : 0.0, "ns");
+    Bench::report("sim", "pdus_to_device", results.pdusToDevice, "count");
+    Bench::report("sim", "pdus_to_phone", results.pdusToPhone, "count");
+    Bench::report("sim", "pdus_lost", results.pdusLost, "count");
+    Bench::report("sim", "notifications_sent", Metrics::getCounter(MetricCounter::NOTIFICATIONS_SENT), "count");
+    Bench::report("sim", "writes_received", Metrics::getCounter(MetricCounter::WRITES_RECEIVED), "count");
+    Bench::report("sim", "crypto_operations", Metrics::getCounter(MetricCounter::CRYPTO_OPERATIONS), "count");
+    if (!config.group) return;
+    Bench::report("sim", "group_provisioned", results.groupProvisioned, "count");
+    Bench::report("sim", "group_pending", results.groupPending, "count");
+    Bench::report("sim", "group_all_provisioned_ms", results.groupAllMs, "ms");
+    Bench::report("sim", "group_sessions", results.groupSessions, "count");
+    Bench::report("sim", "group_failures", results.groupFailures, "count");
+    Bench::report("sim", "group_handshake_failures", results.groupHandshakeFailures, "count");
+    Bench::report("sim", "group_link_pdus", results.linkPdus, "count");
+}
+
+} // namespace Sim
+} // namespace WiBLE
@@ -0,0 +1,298 @@
+/**
+ * Simulator.h - Deterministic host simulation of many WiBLE devices
+ *
+ * Runs hundreds of WiBLE cores in one process against tests/mocks, each
+ * provisioned by scripted phones over a simulated BLE link:
+ *
+ *   SimConfig config;
+ *   config.devices = 200;
+ *   config.link.lossPercent = 5;
+ *   Simulation sim(config);
+ *   SimResults results = sim.run();
+ *   sim.report(results);
+ *
+ * Everything runs on one thread on the mocks' manual clock (mockClock()),
+ * so a run depends only on the config and the seed, and perf or valgrind
+ * see the library's own work without radio or scheduler noise. The mock
+ * globals that stand for one chip (WiFi, NVS, the GATT server and its
+ * characteristics) are swapped in for the device being stepped.
+ *
+ * Link model: every PDU in either direction takes latencyMs plus up to
+ * jitterMs, and each lost attempt (lossPercent) costs one more connection
+ * interval, as a link-layer retransmission would. PDUs of one direction
+ * arrive in order. WiFi association takes associationMinMs..MaxMs on the
+ * simulated access point and fails on a wrong passphrase.
+ *
+ * Group mode: phones only provision device 0. Every device that reaches
+ * PROVISIONED runs a GroupProvisioner fed with the other devices' real
+ * status advertisements, and its GATT client links to them take the same
+ * link model, so the run shows how long a whole batch takes from one
+ * phone session.
+ */
+
+#ifndef WIBLE_SIM_SIMULATOR_H
+#define WIBLE_SIM_SIMULATOR_H
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <WiFi.h>
+#include <nvs.h>
+#include <map>
+#include <memory>
+#include <queue>
+#include <vector>
+#include "WiBLE.h"
+#include "GroupProvisioner.h"
+
+namespace WiBLE {
+namespace Sim {
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+struct LinkProfile {
+    uint16_t mtu = 185;                     // Requested by the phone after connecting
+    uint32_t latencyMs = 15;                // One way, per PDU
+    uint32_t jitterMs = 10;
+    uint8_t lossPercent = 0;                // Per attempt; a lost PDU waits one more interval
+    uint16_t connectionIntervalMs = 30;
+};
+
+struct AccessPointProfile {
+    String ssid = "SimNet";
+    String passphrase = "simpass123";
+    uint32_t associationMinMs = 800;        // begin() to WL_CONNECTED, drawn per device
+    uint32_t associationMaxMs = 4000;
+};
+
+enum class PhoneStep : uint8_t {
+    CONNECT = 0,                            // Retried every ms until the device has a GATT server
+    EXCHANGE_MTU,
+    KEY_EXCHANGE,                           // KEY_EXCHANGE on control; waits ms for the reply
+    SEND_CREDENTIALS,                       // TLV frame, sealed when the script did KEY_EXCHANGE
+    AWAIT_RESULT,                           // Waits ms for a SUCCESS or ERROR status
+    DISCONNECT,
+    WAIT                                    // Idles ms
+};
+
+struct PhoneAction {
+    PhoneStep step;
+    uint32_t ms;
+};
+
+using PhoneScript = std::vector<PhoneAction>;
+
+struct SimConfig {
+    uint16_t devices = 100;
+    uint8_t phonesPerDevice = 1;            // Extra phones contend for the device
+    uint32_t seed = 1;
+    uint32_t tickMs = 5;                    // WiBLE::loop() period of every device
+    uint32_t durationMs = 120000;           // Virtual time limit
+    uint32_t arrivalSpreadMs = 10000;       // Phones start uniformly within this window
+    uint8_t wrongPassphrasePercent = 0;     // Phones that send a bad passphrase
+    bool secure = false;                    // SecurityLevel::SECURE and a key exchange per phone
+    bool group = false;                     // Phones for device 0 only; leads provision the rest (secure)
+    LinkProfile link;
+    AccessPointProfile accessPoint;
+    ProvisioningConfig device;              // Template for every device; group holds the lead config
+};
+
+enum class PhoneResult : uint8_t {
+    PENDING = 0,
+    PROVISIONED,
+    FAILED,                                 // ERROR status from the device
+    TIMED_OUT                               // A step's wait ran out
+};
+
+struct SimResults {
+    uint32_t phones = 0;
+    uint32_t provisioned = 0;
+    uint32_t failed = 0;
+    uint32_t timedOut = 0;
+    uint32_t pending = 0;
+    uint32_t provisionP50Ms = 0;            // Phone start to SUCCESS, virtual time
+    uint32_t provisionP95Ms = 0;
+    uint32_t provisionMaxMs = 0;
+    uint32_t virtualMs = 0;
+    uint32_t wallMs = 0;
+    uint64_t deviceLoops = 0;
+    uint32_t pdusToDevice = 0;
+    uint32_t pdusToPhone = 0;
+    uint32_t pdusLost = 0;
+
+    // Group mode
+    uint32_t groupProvisioned = 0;          // Devices provisioned by a lead
+    uint32_t groupPending = 0;              // Devices never provisioned
+    uint32_t groupAllMs = 0;                // Start to the last device provisioned
+    uint32_t groupSessions = 0;
+    uint32_t groupFailures = 0;             // Peers out of attempts
+    uint32_t groupHandshakeFailures = 0;
+    uint32_t linkPdus = 0;                  // Between leads and peers, both directions
+};
+
+// ============================================================================
+// SIMULATION
+// ============================================================================
+
+class Simulation {
+public:
+    explicit Simulation(const SimConfig& config);
+    ~Simulation();
+
+    /**
+     * Replace the default script for every phone; call before run()
+     */
+    void setScript(const PhoneScript& actions) { script = actions; }
+    static PhoneScript defaultScript(bool secure);
+
+    SimResults run();
+
+    /**
+     * Print the results as benchmark JSON lines (utils/BenchReport.h)
+     */
+    void report(const SimResults& results) const;
+
+private:
+    /**
+     * The mock globals that belong to one chip; exchange() swaps them in
+     * or back out
+     */
+    struct MockContext {
+        WiFiClass wifi;
+        MockNvs nvs;
+        std::map<std::string, BLECharacteristic*> characteristics;
+        BLEServer* server = nullptr;
+        int connectedCount = 0;
+        MockAdvData advData = {};
+
+        void exchange();
+    };
+
+    struct Device {
+        std::unique_ptr<::WiBLE::WiBLE> core;
+        MockContext context;
+        std::unique_ptr<GroupProvisioner> group;    // Once PROVISIONED, in group mode
+        int64_t provisionedUs = -1;
+        int64_t nextBatchUs = 0;            // Next candidate batch while leading
+    };
+
+    /**
+     * A lead's GATT client connection to a peer; connId is the same on
+     * both ends
+     */
+    struct Link {
+        uint16_t lead;
+        uint16_t peer;
+        uint16_t connId;
+        bool open;
+        int64_t upLastUs;                   // Lead to peer
+        int64_t downLastUs;
+    };
+
+    struct Phone {
+        uint16_t device = 0;
+        uint16_t connId = 0;
+        size_t step = 0;
+        uint32_t generation = 0;            // Invalidates pending wakes once a wait ends
+        bool waiting = false;
+        bool sealed = false;                // Key exchange done: credentials go in a GCM frame
+        bool wrongPassphrase = false;
+        PhoneResult result = PhoneResult::PENDING;
+        int64_t startUs = 0;
+        int64_t finishedUs = 0;
+        int64_t upLastUs = 0;               // In-order delivery per direction
+        int64_t downLastUs = 0;
+    };
+
+    enum class DeliveryKind : uint8_t {
+        PHONE_WAKE = 0,
+        CONNECT,
+        MTU,
+        WRITE,
+        NOTIFY,
+        DISCONNECT,
+        LINK_OPEN,                          // Lead requests, at the peer
+        LINK_MTU,
+        LINK_SEARCH,
+        LINK_SUBSCRIBE,
+        LINK_WRITE,
+        LINK_CLOSE,
+        LEAD_EVENT                          // GATT client event, at the lead
+    };
+
+    struct Delivery {
+        int64_t atUs;
+        uint64_t order;                     // Ties keep scheduling order
+        DeliveryKind kind;
+        uint32_t phone;                     // The link for LINK_* and LEAD_EVENT
+        uint32_t generation;
+        const char* uuid;
+        std::vector<uint8_t> data;
+        uint8_t event;                      // LEAD_EVENT: esp_gattc_cb_event_t
+        uint8_t status;
+        uint16_t handle;
+    };
+
+    struct Later {
+        bool operator()(const Delivery& a, const Delivery& b) const {
+            return a.atUs != b.atUs ? a.atUs > b.atUs : a.order > b.order;
+        }
+    };
+
+    SimConfig config;
+    PhoneScript script;
+    std::vector<Device> devices;
+    std::vector<Phone> phones;
+    std::vector<Link> links;
+    std::priority_queue<Delivery, std::vector<Delivery>, Later> queue;
+    uint64_t scheduled;
+    int32_t current;                        // Device whose mocks are swapped in, -1 for none
+    int32_t lead;                           // Device whose GroupProvisioner is running, -1 for none
+    uint32_t rng;                           // xorshift32 state
+    SimResults totals;
+
+    void createDevices();
+    void createPhones();
+    void destroyDevices();
+
+    void enter(uint16_t device);
+    void leave();
+
+    uint32_t nextRandom();
+    int64_t linkDelayUs(int64_t& lastUs);
+    void schedule(int64_t atUs, DeliveryKind kind, uint32_t phone, const char* uuid = nullptr,
+                  const uint8_t* data = nullptr, size_t length = 0);
+    void wake(uint32_t phone, int64_t atUs);
+    void upload(uint32_t phone, DeliveryKind kind, const char* uuid = nullptr,
+                const uint8_t* data = nullptr, size_t length = 0);
+
+    void process(const Delivery& delivery);
+    void advancePhone(uint32_t index);
+    void finishWait(uint32_t index);
+    void abandon(uint32_t index);
+    void receive(uint32_t index, const std::vector<uint8_t>& data);
+    void onIndicate(uint16_t connId, const uint8_t* value, size_t length);
+    void sendCredentials(uint32_t index);
+    bool allPhonesDone() const;
+
+    void startLead(uint16_t device);
+    void stepLead(uint16_t device);
+    void deliverCandidates(uint16_t device);
+    void onGattcRequest(const MockGattcRequest& request);
+    void processLink(const Delivery& delivery);
+    void scheduleLink(int64_t atUs, DeliveryKind kind, uint32_t link, uint8_t event = 0, uint8_t status = 0,
+                      uint16_t handle = 0, const char* uuid = nullptr, const uint8_t* data = nullptr,
+                      size_t length = 0);
+    void reply(uint32_t link, esp_gattc_cb_event_t event, uint8_t status = 0, uint16_t handle = 0,
+               const uint8_t* data = nullptr, size_t length = 0);
+    uint16_t lookupHandle(uint16_t connId, const esp_bt_uuid_t& uuid, uint16_t charHandle);
+    Link* findLink(uint16_t connId);
+    bool allDevicesProvisioned() const;
+    SimResults collect(int64_t startUs, uint32_t wallMs);
+};
+
+} // namespace Sim
+} // namespace WiBLE
+
+#endif // WIBLE_SIM_SIMULATOR_H
@@ -0,0 +1,29 @@
+#!/bin/sh
+# Build the host simulator against tests/mocks and run it.
+#
+#   tests/sim/build.sh                            # 100 devices, default link
+#   tests/sim/build.sh --devices 500 --loss 10    # options go to the simulator
+#   RUN=0 tests/sim/build.sh                      # build only
+#
+# Results are JSON lines on stdout (see tests/README.md). Set CXXFLAGS for
+# profiling builds, e.g. CXXFLAGS="-O2 -g" before perf or valgrind.
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/../.." && pwd)
+OUT=${OUT:-"$ROOT/tests/sim/out"}
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:-"-O2"}
+RUN=${RUN:-1}
+
+mkdir -p "$OUT"
+
+"$CXX" -std=gnu++11 $CXXFLAGS -DARDUINO=100 \
+    -I "$ROOT/src" -I "$ROOT/src/utils" -I "$ROOT/tests/mocks" \
+    "$ROOT/tests/sim/sim_main.cpp" "$ROOT/tests/sim/Simulator.cpp" \
+    "$ROOT"/src/*.cpp "$ROOT"/src/utils/*.cpp "$ROOT"/tests/mocks/*.cpp \
+    -lpthread -o "$OUT/wible_sim"
+
+if [ "$RUN" = "1" ]; then
+    "$OUT/wible_sim" "$@"
+fi
@@ -0,0 +1,72 @@
+/**
+ * sim_main.cpp - Command line front end for the host simulator
+ *
+ *   tests/sim/build.sh --devices 300 --loss 5 --secure
+ *   tests/sim/build.sh --devices 64 --group
+ *
+ * Prints the results as benchmark JSON lines and exits non-zero when a
+ * phone timed out or never finished, or a group left a device behind.
+ */
+
+#include "Simulator.h"
+#include "utils/BenchReport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace WiBLE;
+using namespace WiBLE::Sim;
+
+static void usage() {
+    printf("options: --devices N --phones N --seed N --tick-ms N --duration-ms N --spread-ms N\n"
+           "         --mtu N --latency-ms N --jitter-ms N --loss PERCENT --interval-ms N\n"
+           "         --assoc-min-ms N --assoc-max-ms N --wrong-pass PERCENT --secure --log\n"
+           "         --group --sessions N --no-relay\n");
+}
+
+int main(int argc, char** argv) {
+    SimConfig config;
+    config.device.logLevel = LogLevel::NONE;
+    config.device.enableSerialLog = false;
+    config.device.validateConnectivity = false;     // No network behind the mock access point
+
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        bool hasValue = i + 1 < argc;
+        unsigned long value = hasValue ? strtoul(argv[i + 1], nullptr, 10) : 0;
+
+        if (strcmp(option, "--secure") == 0) { config.secure = true; continue; }
+        if (strcmp(option, "--group") == 0) { config.group = true; continue; }
+        if (strcmp(option, "--no-relay") == 0) { config.device.group.relay = false; continue; }
+        if (strcmp(option, "--log") == 0) {
+            config.device.logLevel = LogLevel::WARN;
+            config.device.enableSerialLog = true;
+            continue;
+        }
+        if (!hasValue) { usage(); return 2; }
+        i++;
+
+        if (strcmp(option, "--devices") == 0) config.devices = (uint16_t)value;
+        else if (strcmp(option, "--phones") == 0) config.phonesPerDevice = (uint8_t)(value ? value : 1);
+        else if (strcmp(option, "--seed") == 0) config.seed = (uint32_t)value;
+        else if (strcmp(option, "--tick-ms") == 0) config.tickMs = (uint32_t)value;
+        else if (strcmp(option, "--duration-ms") == 0) config.durationMs = (uint32_t)value;
+        else if (strcmp(option, "--spread-ms") == 0) config.arrivalSpreadMs = (uint32_t)value;
+        else if (strcmp(option, "--mtu") == 0) config.link.mtu = (uint16_t)value;
+        else if (strcmp(option, "--latency-ms") == 0) config.link.latencyMs = (uint32_t)value;
+        else if (strcmp(option, "--jitter-ms") == 0) config.link.jitterMs = (uint32_t)value;
+        else if (strcmp(option, "--loss") == 0) config.link.lossPercent = (uint8_t)(value > 99 ? 99 : value);
+        else if (strcmp(option, "--interval-ms") == 0) config.link.connectionIntervalMs = (uint16_t)value;
+        else if (strcmp(option, "--assoc-min-ms") == 0) config.accessPoint.associationMinMs = (uint32_t)value;
+        else if (strcmp(option, "--assoc-max-ms") == 0) config.accessPoint.associationMaxMs = (uint32_t)value;
+        else if (strcmp(option, "--wrong-pass") == 0) config.wrongPassphrasePercent = (uint8_t)value;
+        else if (strcmp(option, "--sessions") == 0) config.device.group.parallelSessions = (uint8_t)value;
+        else { usage(); return 2; }
+    }
+
+    Simulation simulation(config);
+    SimResults results = simulation.run();
+    simulation.report(results);
+    Bench::finish();
+    return results.timedOut == 0 && results.pending == 0 && results.groupPending == 0 ? 0 : 1;
+}